@@ -11,6 +11,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 /**
  * @brief Enum representing possible result codes for socket operations.
@@ -39,6 +40,11 @@ typedef enum {
   PS_ERROR_IPV6_SOCKET_CREATION, /**< Error creating IPv6 socket. */
   PS_ERROR_IPV6_SOCKET_BINDING,  /**< Error binding IPv6 socket. */
   PS_ERROR_IPV6_SOCKET_CLOSED,   /**< IPv6 socket was closed unexpectedly. */
+
+  /* Non-blocking I/O */
+  PS_ERROR_WOULDBLOCK,         /**< Operation would block on a non-blocking socket. */
+  PS_ERROR_UNSUPPORTED,        /**< Operation is not supported on this platform. */
+  PS_ERROR_PROTOCOL,           /**< Peer violated the protocol spoken on the socket. */
   
   PS_ERROR_UNKNOWN             /**< Unknown error code. */
 } ps_result_t;
@@ -57,6 +63,10 @@ const char *ps_result_to_cstr(ps_result_t result);
 typedef enum {
   PS_PROTOCOL_TCP = 0,         /**< Transmission Control Protocol. */
   PS_PROTOCOL_UDP,             /**< User Datagram Protocol. */
+  PS_PROTOCOL_MEMORY,          /**< In-process stream transport, see `ps_create_socket`. */
+  PS_PROTOCOL_SHM,             /**< Shared-memory stream transport between processes on a host (Linux), see `ps_create_socket`. */
+  PS_PROTOCOL_UNIX_STREAM,     /**< Unix domain stream socket (Linux), see `ps_create_socket`. */
+  PS_PROTOCOL_UNIX_DGRAM,      /**< Unix domain datagram socket (Linux), see `ps_create_socket`. */
 
   COUNT_PS_PROTOCOLS          /**< Count of protocols. */
 } ps_protocol_t;
@@ -85,7 +95,8 @@ bool ps_init();
 /**
  * @brief Cleans up the socket library.
  * 
- * This function must be called to clean up resources after using socket operations.
+ * This function must be called to clean up resources after using socket operations. Connections of destroyed
+ * sockets still held open for zero-copy packets are given up to a second to hand them back, then closed.
  */
 void ps_cleanup();
 
@@ -99,8 +110,33 @@ typedef struct ps_socket_s *ps_socket_t;
 /**
  * @brief Creates a socket of the specified protocol.
  * 
+ * `PS_PROTOCOL_MEMORY` sockets behave like TCP ones within the process, without the kernel: bind, listen,
+ * accept, connect, reads, sends, timeouts and non-blocking mode work the same, and so do the framed
+ * socket, buffered stream and connection pool built on them. Addresses are IP literals in a registry of
+ * their own, so they never collide with real ports. Each connection moves bytes through two lock-free
+ * single-producer single-consumer rings of 256 KiB: one thread may read and one send at a time, and
+ * neither makes a system call unless it has to sleep. A full backlog refuses connects. Memory sockets
+ * cannot be added to a loop, and calls that need a kernel socket (file sending, zero-copy, segmentation
+ * offload, batched datagrams) fail.
+ *
+ * `PS_PROTOCOL_SHM` sockets work like memory sockets between processes of the same host and user: a bound
+ * address is a segment in `/dev/shm` owned by the binding process, and each connection maps its two
+ * rings from a segment of its own. Waiting sides spin for a few microseconds before sleeping on a futex,
+ * so a peer that answers quickly is seen without a system call. A peer process that exits without
+ * destroying its socket is noticed within 100 ms of it being reaped, and an address whose owner died can
+ * be bound again. At most 128 connections wait for accept. Not available on Windows
+ * (`PS_ERROR_UNSUPPORTED`).
+ *
+ * `PS_PROTOCOL_UNIX_STREAM` and `PS_PROTOCOL_UNIX_DGRAM` sockets take a filesystem path wherever an IP
+ * address is expected, and ignore the port and `address`; a path starting with '@' names the abstract
+ * namespace, which needs no file and disappears with the socket. A bound path stays on disk until it is
+ * unlinked. They can pass descriptors and whole sockets to another process (`ps_pass_socket`), but have
+ * no `ps_endpoint_t` (`ps_get_socket_endpoint` fails), so datagrams are sent to a connected peer or to
+ * the `from` socket of a read. Not available on Windows (`PS_ERROR_UNSUPPORTED`).
+ *
  * @param socket Pointer to a variable that will hold the created socket.
- * @param protocol The protocol to use for the socket (TCP or UDP).
+ * @param protocol The protocol to use for the socket (TCP, UDP, in-process memory, shared memory or Unix domain).
+ * @param address The address family to use for the socket (IPv4 or IPv6).
  * @return A `ps_result_t` result code indicating the success or failure of the operation.
  */
 ps_result_t ps_create_socket(ps_socket_t *socket, ps_protocol_t protocol, ps_address_t address);
@@ -110,11 +146,12 @@ ps_result_t ps_create_socket(ps_socket_t *socket, ps_protocol_t protocol, ps_add
  * 
  * @param socket Pointer to a variable that will hold the created socket.
  * @param protocol The protocol to use for the socket (TCP or UDP).
+ * @param address The address family to use for the socket (IPv4 or IPv6).
  * @param ip The IP address to bind the socket to.
  * @param port The port to bind the socket to.
  * @return A `ps_result_t` result code indicating the success or failure of the operation.
  */
-ps_result_t ps_create_socket_from_addr(ps_socket_t *socket, ps_protocol_t protocol, const char *ip, ps_port_t port);
+ps_result_t ps_create_socket_from_addr(ps_socket_t *socket, ps_protocol_t protocol, ps_address_t address, const char *ip, ps_port_t port);
 
 /**
  * @brief Destroys a socket, releasing its resources.
@@ -136,11 +173,34 @@ ps_result_t ps_bind_socket(ps_socket_t socket, const char *ip, ps_port_t port);
 /**
  * @brief Puts the socket into listening mode, waiting for incoming connections.
  * 
+ * The backlog of pending connections is the largest the system allows.
+ *
  * @param socket The socket to listen on.
  * @return A `ps_result_t` result code indicating the success or failure of the operation.
  */
 ps_result_t ps_listen_socket(ps_socket_t socket);
 
+/**
+ * @brief Puts the socket into listening mode with a backlog of `backlog` pending connections.
+ * 
+ * @param socket The socket to listen on.
+ * @param backlog Maximum number of connections waiting to be accepted, 0 for the largest the system allows.
+ * @return A `ps_result_t` result code indicating the success or failure of the operation.
+ */
+ps_result_t ps_listen_socket_backlog(ps_socket_t socket, int backlog);
+
+/**
+ * @brief Allows several sockets to bind the same address and port (SO_REUSEPORT), with incoming connections
+ *        or datagrams spread across them by the kernel.
+ * 
+ * Must be set on every socket sharing the port before it is bound.
+ *
+ * @param socket The socket to configure.
+ * @param enabled `true` to share the port.
+ * @return A `ps_result_t` result code; `PS_ERROR_UNSUPPORTED` where the platform cannot balance a shared port.
+ */
+ps_result_t ps_set_socket_reuseport(ps_socket_t socket, bool enabled);
+
 /**
  * @brief Accepts an incoming connection on a listening socket.
  * 
@@ -172,6 +232,10 @@ typedef struct {
 /**
  * @brief Reads a packet of data from a socket.
  * 
+ * Data is received directly into `packet->buf`, up to `packet->capacity` bytes. If `packet->buf` is NULL
+ * a buffer is acquired from the default packet pool, which must be returned with `ps_packet_release`.
+ * A UDP datagram larger than the buffer is truncated and `PS_ERROR_MSGTOOLONG` is returned.
+ *
  * @param socket The socket to read data from.
  * @param packet Pointer to a `ps_packet_t` structure to hold the read data.
  * @param from Pointer to a `ps_socket_t` variable to hold the sender's socket (optional).
@@ -182,6 +246,10 @@ ps_result_t ps_read_socket_packet(ps_socket_t socket, ps_packet_t *packet, ps_so
 /**
  * @brief Sends a packet of data through a socket.
  * 
+ * On a stream socket the packet is sent whole or not at all. A non-blocking socket that fills up returns
+ * `PS_ERROR_WOULDBLOCK` if nothing went out; once part of the packet is out, the socket keeps the rest and
+ * `PS_SUCCESS` is returned. Kept bytes go out before anything sent later, see `ps_flush_socket`.
+ *
  * @param socket The socket to send data through.
  * @param packet The packet of data to send.
  * @param to The socket to send the data to.
@@ -189,4 +257,1956 @@ ps_result_t ps_read_socket_packet(ps_socket_t socket, ps_packet_t *packet, ps_so
  */
 ps_result_t ps_send_socket_packet(ps_socket_t socket, ps_packet_t packet, ps_socket_t to);
 
+/**
+ * @brief Sends the bytes a non-blocking stream socket kept from an earlier send, without blocking.
+ * 
+ * Every send flushes them first and returns `PS_ERROR_WOULDBLOCK` while they do not all fit. Callers that
+ * may stop sending with bytes kept call this when the socket becomes writable, e.g. from `on_write`.
+ *
+ * @param socket The socket to flush.
+ * @return `PS_SUCCESS` once nothing is kept, `PS_ERROR_WOULDBLOCK` if the socket is full again.
+ */
+ps_result_t ps_flush_socket(ps_socket_t socket);
+
+/**
+ * @brief Returns how many bytes of earlier sends the socket still keeps, see `ps_flush_socket`.
+ */
+size_t ps_get_socket_unsent(ps_socket_t socket);
+
+/**
+ * @brief Sends part of a file through a TCP socket without copying it through user space (sendfile on Linux).
+ * 
+ * Falls back to reading and sending the file in chunks where the kernel cannot send from the descriptor.
+ * On a non-blocking socket `PS_ERROR_WOULDBLOCK` is returned once the socket is full; `sent` tells how far
+ * the transfer got, so it can be resumed at `offset + *sent` when the socket becomes writable.
+ *
+ * @param socket The TCP socket to send through.
+ * @param fd Descriptor of the file to send; its file position is not used.
+ * @param offset Offset in the file to start at.
+ * @param length Number of bytes to send, 0 to send up to the end of the file.
+ * @param sent Pointer to a variable that receives the number of bytes sent (optional).
+ * @return A `ps_result_t` result code indicating the success or failure of the operation.
+ */
+ps_result_t ps_send_file(ps_socket_t socket, int fd, uint64_t offset, uint64_t length, uint64_t *sent);
+
+/**
+ * @brief Opens the file at `path` and sends it like `ps_send_file`.
+ * 
+ * @param socket The TCP socket to send through.
+ * @param path Path of the file to send.
+ * @param offset Offset in the file to start at.
+ * @param length Number of bytes to send, 0 to send up to the end of the file.
+ * @param sent Pointer to a variable that receives the number of bytes sent (optional).
+ * @return A `ps_result_t` result code; `PS_ERROR_INVALID_ARGUMENT` if the file cannot be opened.
+ */
+ps_result_t ps_send_file_path(ps_socket_t socket, const char *path, uint64_t offset, uint64_t length, uint64_t *sent);
+
+/**
+ * @brief Moves data from one TCP socket to another without copying it through user space (splice on Linux).
+ * 
+ * Behaves like a read on `from`: it waits for data if `from` is blocking, then moves what is available,
+ * up to `length` bytes, and writes it to `to`. Call it repeatedly to proxy a connection.
+ *
+ * A blocking `to` is waited on up to its write timeout; a non-blocking one never is. Bytes `to` cannot
+ * take yet are kept like the rest of a partial `ps_send_socket_packet`, `moved` still counts them, and the
+ * result is `PS_ERROR_WOULDBLOCK` or `PS_ERROR_TIMEOUT`. While bytes are kept, nothing is taken from `from`
+ * until they are flushed.
+ *
+ * @param from The socket to read from.
+ * @param to The socket to write to.
+ * @param length Maximum number of bytes to move.
+ * @param moved Pointer to a variable that receives the number of bytes moved.
+ * @return A `ps_result_t` result code; `PS_CONNCLOSED` once `from` has been closed by its peer.
+ */
+ps_result_t ps_splice(ps_socket_t from, ps_socket_t to, size_t length, size_t *moved);
+
+/**
+ * @brief Sends a packet together with file descriptors over a Unix domain socket (SCM_RIGHTS).
+ *
+ * The receiving process gets its own descriptors for the same open files; the caller keeps and still
+ * has to close its own. The descriptors travel with the first byte of the packet.
+ *
+ * @param socket The Unix domain socket to send through.
+ * @param packet The data to send; it must not be empty.
+ * @param fds Descriptors to pass.
+ * @param count Number of descriptors, at most 253.
+ * @return A `ps_result_t` result code; `PS_ERROR_INVALID_ARGUMENT` for other sockets.
+ */
+ps_result_t ps_send_socket_fds(ps_socket_t socket, ps_packet_t packet, const int *fds, size_t count);
+
+/**
+ * @brief Reads a packet and the file descriptors sent with it over a Unix domain socket.
+ *
+ * Received descriptors are close-on-exec and belong to the caller. A stream read stops at a packet that
+ * carries descriptors, so they are never merged with those of another packet.
+ *
+ * @param socket The Unix domain socket to read from.
+ * @param packet The packet to read into; `buf` and `capacity` must be set.
+ * @param fds Array that receives the descriptors.
+ * @param capacity Number of descriptors `fds` can hold.
+ * @param count Pointer to a variable that receives the number of descriptors received.
+ * @return A `ps_result_t` result code; `PS_ERROR_MSGTOOLONG` if data or descriptors did not fit, in which
+ *         case the descriptors that did not are closed.
+ */
+ps_result_t ps_read_socket_fds(ps_socket_t socket, ps_packet_t *packet, int *fds, size_t capacity, size_t *count);
+
+/**
+ * @brief Hands a socket to the process at the other end of a Unix domain socket.
+ *
+ * Meant for handing accepted connections to worker processes without proxying their bytes. The
+ * connection stays open until both the sender's socket and the received one are destroyed, so the
+ * sender usually destroys its socket once this succeeded. Memory and shared-memory sockets cannot be passed.
+ *
+ * @param channel The Unix domain socket to send through.
+ * @param socket The socket to pass.
+ * @return A `ps_result_t` result code.
+ */
+ps_result_t ps_pass_socket(ps_socket_t channel, ps_socket_t socket);
+
+/**
+ * @brief Receives a socket passed with `ps_pass_socket`.
+ *
+ * @param channel The Unix domain socket to read from.
+ * @param socket Pointer to a variable that receives the socket, destroyed with `ps_destroy_socket`.
+ * @return A `ps_result_t` result code; `PS_ERROR_INVALID_ARGUMENT` if the message was not a passed socket.
+ */
+ps_result_t ps_accept_passed_socket(ps_socket_t channel, ps_socket_t *socket);
+
+/**
+ * @brief Smallest packet `ps_send_socket_packet_zerocopy` sends without copying; smaller ones are copied as usual.
+ */
+#define PS_ZEROCOPY_THRESHOLD (16 * 1024)
+
+/**
+ * @brief Callback handing a buffer passed to `ps_send_socket_packet_zerocopy` back to its owner.
+ * 
+ * @param socket The socket the packet was sent through. It must not be destroyed from the callback. NULL if
+ *               the socket was destroyed while the kernel still held the packet: its connection is then kept
+ *               open until the kernel lets go, and the callback runs from a later zero-copy call or
+ *               `ps_destroy_socket` on any socket, possibly on another thread, or at the latest from
+ *               `ps_cleanup`, which waits up to a second for such packets.
+ * @param packet The packet as it was passed to the send.
+ * @param copied `true` if the data was copied after all (small packets, failed sends, routes such as
+ *               loopback that cannot send from user memory), a hint that zero-copy does not pay off here.
+ * @param user_data The user data passed to the send.
+ */
+typedef void (*ps_zerocopy_completion_t)(ps_socket_t socket, ps_packet_t *packet, bool copied, void *user_data);
+
+/**
+ * @brief Enables or disables zero-copy sends (SO_ZEROCOPY) on a socket.
+ * 
+ * @param socket The socket to configure.
+ * @param enabled `true` to allow `ps_send_socket_packet_zerocopy` to send without copying.
+ * @return A `ps_result_t` result code; `PS_ERROR_UNSUPPORTED` if the kernel has no MSG_ZEROCOPY.
+ */
+ps_result_t ps_set_socket_zerocopy(ps_socket_t socket, bool enabled);
+
+/**
+ * @brief Sends a packet like `ps_send_socket_packet`, letting the kernel transmit straight from `packet.buf`.
+ * 
+ * Ownership of the buffer passes to purrsock for the whole call and comes back exactly once through `callback`,
+ * also when the send fails, in which case the callback runs before this function returns. Until then
+ * the buffer must not be modified or freed. With a NULL `callback` the buffer is instead returned to its pool
+ * with `ps_packet_release`, so it must come from `ps_packet_acquire`.
+ *
+ * Like `ps_send_socket_packet`, a non-blocking socket keeps a copy of the rest of a packet it could only send
+ * part of, and earlier kept bytes are flushed first.
+ *
+ * Completions are reported on the socket's error queue. Sockets registered with a loop have them handled as
+ * they arrive; otherwise call `ps_process_zerocopy_completions`, which every zero-copy send also does first.
+ *
+ * @param socket The connected socket to send through.
+ * @param packet The packet to send.
+ * @param callback Callback receiving the buffer back, or NULL to release it to its pool.
+ * @param user_data User data passed to the callback.
+ * @return A `ps_result_t` result code indicating the success or failure of the operation.
+ */
+ps_result_t ps_send_socket_packet_zerocopy(ps_socket_t socket, ps_packet_t packet, ps_zerocopy_completion_t callback, void *user_data);
+
+/**
+ * @brief Runs the completions of zero-copy sends the kernel has finished with, without blocking.
+ * 
+ * @param socket The socket to process.
+ * @param completed Pointer to a variable that receives the number of completed packets (optional).
+ * @return A `ps_result_t` result code indicating the success or failure of the operation.
+ */
+ps_result_t ps_process_zerocopy_completions(ps_socket_t socket, size_t *completed);
+
+/**
+ * @brief Maximum number of packets moved by one call to `ps_read_socket_packets`.
+ */
+#define PS_MAX_PACKET_BATCH 64
+
+/**
+ * @brief Plain address of a datagram peer, used by the batched packet functions instead of a `ps_socket_t`.
+ */
+typedef struct {
+  ps_address_t family; /**< Address family of `addr`. */
+  ps_port_t port;      /**< Port in host byte order. */
+  uint8_t addr[16];    /**< Address in network byte order; IPv4 uses the first 4 bytes. */
+} ps_endpoint_t;
+
+/**
+ * @brief Parses an IP address and port into an endpoint.
+ * 
+ * @param endpoint Pointer to the endpoint to fill.
+ * @param ip The IPv4 or IPv6 address.
+ * @param port The port.
+ * @return A `ps_result_t` result code indicating the success or failure of the operation.
+ */
+ps_result_t ps_endpoint_from_addr(ps_endpoint_t *endpoint, const char *ip, ps_port_t port);
+
+/**
+ * @brief Retrieves the local address a socket is bound to, e.g. the port picked for a bind to port 0.
+ * 
+ * @param socket The bound socket.
+ * @param endpoint Pointer to the endpoint to fill.
+ * @return A `ps_result_t` result code indicating the success or failure of the operation.
+ */
+ps_result_t ps_get_socket_endpoint(ps_socket_t socket, ps_endpoint_t *endpoint);
+
+/**
+ * @brief Reads up to `count` datagrams from a UDP socket in one call (recvmmsg on Linux).
+ * 
+ * Blocks until at least one datagram is available on a blocking socket, then returns every datagram
+ * already queued without waiting for more. Each packet is filled like with `ps_read_socket_packet`,
+ * including taking a pooled buffer when its `buf` is NULL; pooled buffers of packets that received nothing
+ * are released again. At most `PS_MAX_PACKET_BATCH` packets are read per call.
+ * If a datagram was truncated, `PS_ERROR_MSGTOOLONG` is returned and `received` is still valid.
+ *
+ * @param socket The UDP socket to read from.
+ * @param packets Array of `count` packets to fill.
+ * @param from Optional array of `count` endpoints receiving the sender of each packet.
+ * @param count Number of entries in `packets` (and `from`).
+ * @param received Pointer to a variable that receives the number of packets read.
+ * @return A `ps_result_t` result code indicating the success or failure of the operation.
+ */
+ps_result_t ps_read_socket_packets(ps_socket_t socket, ps_packet_t *packets, ps_endpoint_t *from, size_t count, size_t *received);
+
+/**
+ * @brief Sends `count` datagrams through a UDP socket in as few calls as possible (sendmmsg on Linux).
+ * 
+ * @param socket The UDP socket to send through.
+ * @param packets Array of `count` packets to send.
+ * @param to Optional array of `count` destinations; NULL sends to the connected peer.
+ * @param count Number of entries in `packets` (and `to`).
+ * @param sent Pointer to a variable that receives the number of packets sent, also on failure.
+ * @return A `ps_result_t` result code indicating the success or failure of the operation.
+ */
+ps_result_t ps_send_socket_packets(ps_socket_t socket, const ps_packet_t *packets, const ps_endpoint_t *to, size_t count, size_t *sent);
+
+/**
+ * @brief Maximum number of slices `ps_sendv` and `ps_recvv` take in one call.
+ */
+#define PS_MAX_PACKET_SLICES 64
+
+/**
+ * @brief Sends several buffers as one contiguous message, without joining them first (writev/sendmsg on Linux).
+ * 
+ * The `size` bytes of each slice go out in order. On TCP everything is sent, like with `ps_send_socket_packet`,
+ * including the rest a non-blocking socket keeps when it fills up; on UDP the slices together form a single datagram.
+ *
+ * @param socket The socket to send data through.
+ * @param slices Array of `count` packets to send back to back.
+ * @param count Number of entries in `slices`, at most `PS_MAX_PACKET_SLICES`.
+ * @param to Optional destination of a UDP datagram; NULL sends to the connected peer.
+ * @return A `ps_result_t` result code indicating the success or failure of the operation.
+ */
+ps_result_t ps_sendv(ps_socket_t socket, const ps_packet_t *slices, size_t count, const ps_endpoint_t *to);
+
+/**
+ * @brief Sends as much of several buffers as a stream socket takes right now, keeping nothing back.
+ * 
+ * Unlike `ps_sendv`, the rest of a partial write is left to the caller, who resumes after the first `sent` bytes
+ * once the socket is writable again. Bytes kept by earlier sends are flushed first; if they cannot all go out,
+ * nothing of `slices` is sent and their result is returned.
+ *
+ * @param socket The TCP or UNIX stream socket to send data through.
+ * @param slices Array of `count` packets to send back to back.
+ * @param count Number of entries in `slices`, at most `PS_MAX_PACKET_SLICES`.
+ * @param sent Pointer to a variable that receives the number of bytes of `slices` sent, also on failure.
+ * @return A `ps_result_t` result code; `PS_ERROR_WOULDBLOCK` if a non-blocking socket filled up before the end.
+ */
+ps_result_t ps_sendv_partial(ps_socket_t socket, const ps_packet_t *slices, size_t count, size_t *sent);
+
+/**
+ * @brief Reads data into several buffers in one call (readv/recvmsg on Linux).
+ * 
+ * Each slice is filled up to its `capacity` before the next is used, and its `size` is set to the bytes it received.
+ * Like `ps_read_socket_packet`, TCP returns what is available and UDP one datagram; a datagram larger than all
+ * slices together is truncated and `PS_ERROR_MSGTOOLONG` is returned. Every slice needs a caller-provided buffer.
+ *
+ * @param socket The socket to read data from.
+ * @param slices Array of `count` packets to fill.
+ * @param count Number of entries in `slices`, at most `PS_MAX_PACKET_SLICES`.
+ * @param received Pointer to a variable that receives the total number of bytes read.
+ * @param from Optional endpoint receiving the sender of a UDP datagram.
+ * @return A `ps_result_t` result code indicating the success or failure of the operation.
+ */
+ps_result_t ps_recvv(ps_socket_t socket, ps_packet_t *slices, size_t count, size_t *received, ps_endpoint_t *from);
+
+/**
+ * @brief Maximum number of datagrams a coalesced receive can be split into.
+ */
+#define PS_MAX_PACKET_SEGMENTS 64
+
+/**
+ * @brief Sends a buffer as a train of UDP datagrams of `segment_size` bytes each, the last one possibly shorter.
+ * 
+ * On Linux the kernel (or NIC) segments the buffer (UDP_SEGMENT), so one call replaces up to 64 sends.
+ * Where segmentation offload is unavailable the datagrams are sent one by one; receivers see the same datagrams.
+ * A send that fails part way, e.g. with `PS_ERROR_WOULDBLOCK`, is resumed from byte `sent * segment_size`.
+ *
+ * @param socket The UDP socket to send through.
+ * @param packet The buffer to segment and send.
+ * @param segment_size Payload size of every datagram but the last.
+ * @param to Optional destination; NULL sends to the connected peer.
+ * @param sent Pointer to a variable that receives the number of datagrams sent, also on failure.
+ * @return A `ps_result_t` result code indicating the success or failure of the operation.
+ */
+ps_result_t ps_send_socket_packet_segmented(ps_socket_t socket, ps_packet_t packet, size_t segment_size, const ps_endpoint_t *to, size_t *sent);
+
+/**
+ * @brief Enables or disables receiving coalesced datagrams (UDP_GRO) on a UDP socket.
+ * 
+ * With GRO enabled, use `ps_read_socket_packet_segmented` so coalesced datagrams are split again;
+ * a plain read would return them concatenated.
+ *
+ * @param socket The UDP socket to configure.
+ * @param enabled `true` to accept coalesced datagrams.
+ * @return A `ps_result_t` result code; `PS_ERROR_UNSUPPORTED` if the platform has no UDP GRO.
+ */
+ps_result_t ps_set_socket_gro(ps_socket_t socket, bool enabled);
+
+/**
+ * @brief Reads one, possibly coalesced, receive from a UDP socket and splits it into its original datagrams.
+ * 
+ * `packet` is filled like with `ps_read_socket_packet` and should hold 64 KiB to take a full coalesced receive.
+ * Each entry of `segments` is set to point into `packet->buf`, so they stay valid until the packet is reused.
+ * If there are more datagrams than `max_segments`, the extra ones are dropped and `PS_ERROR_MSGTOOLONG` is returned.
+ *
+ * @param socket The UDP socket to read from.
+ * @param packet The packet receiving the data.
+ * @param segments Array receiving a view of each datagram.
+ * @param max_segments Number of entries in `segments`, `PS_MAX_PACKET_SEGMENTS` covers any receive.
+ * @param segment_count Pointer to a variable that receives the number of datagrams.
+ * @param from Optional endpoint receiving the sender.
+ * @return A `ps_result_t` result code indicating the success or failure of the operation.
+ */
+ps_result_t ps_read_socket_packet_segmented(ps_socket_t socket, ps_packet_t *packet, ps_packet_t *segments, size_t max_segments, size_t *segment_count, ps_endpoint_t *from);
+
+/**
+ * @brief Opaque structure representing a pool of reusable packet buffers.
+ * 
+ * Buffers are carved from slabs in fixed size classes (256 bytes to 64 KiB) and cached per thread,
+ * so acquiring and releasing a buffer normally takes no lock and no allocation.
+ */
+typedef struct ps_packet_pool_s *ps_packet_pool_t;
+
+/**
+ * @brief Statistics about the memory held by a packet pool.
+ */
+typedef struct {
+  uint64_t slabs;          /**< Number of slabs allocated. */
+  uint64_t bytes_reserved; /**< Bytes reserved by all slabs. */
+  uint64_t refills;        /**< Times a thread cache was refilled from the pool. */
+} ps_packet_pool_stats_t;
+
+/**
+ * @brief Creates a packet pool. At most 64 pools, the default one included, exist at the same time.
+ * 
+ * @param pool Pointer to a variable that will hold the created pool.
+ * @return A `ps_result_t` result code; `PS_ERROR_WOULDBLOCK` if 64 pools exist already.
+ */
+ps_result_t ps_create_packet_pool(ps_packet_pool_t *pool);
+
+/**
+ * @brief Destroys a packet pool and frees all of its buffers.
+ * 
+ * Every packet acquired from the pool must be released before, and no thread may use it afterwards.
+ *
+ * @param pool The pool to destroy.
+ */
+void ps_destroy_packet_pool(ps_packet_pool_t pool);
+
+/**
+ * @brief Acquires a buffer of at least `size` bytes from a pool.
+ * 
+ * On success `packet->buf` and `packet->capacity` describe the buffer and `packet->size` is 0.
+ * Sizes above the largest size class are served by a dedicated allocation.
+ *
+ * @param pool The pool to acquire from, or NULL for the default pool created by `ps_init`.
+ * @param size The minimum capacity required.
+ * @param packet The packet that receives the buffer.
+ * @return A `ps_result_t` result code indicating the success or failure of the operation.
+ */
+ps_result_t ps_packet_acquire(ps_packet_pool_t pool, size_t size, ps_packet_t *packet);
+
+/**
+ * @brief Returns a buffer obtained from `ps_packet_acquire` to its pool.
+ * 
+ * The packet is reset to an empty state. Releasing a packet without a buffer does nothing.
+ * Packets may be released on any thread.
+ *
+ * @param packet The packet whose buffer to release.
+ */
+void ps_packet_release(ps_packet_t *packet);
+
+/**
+ * @brief Retrieves statistics about a packet pool.
+ * 
+ * @param pool The pool to inspect, or NULL for the default pool.
+ * @param stats Pointer to a structure that receives the statistics.
+ */
+void ps_get_packet_pool_stats(ps_packet_pool_t pool, ps_packet_pool_stats_t *stats);
+
+/**
+ * @brief Switches a socket between blocking and non-blocking mode.
+ * 
+ * Operations on a non-blocking socket that cannot complete immediately return `PS_ERROR_WOULDBLOCK`.
+ *
+ * @param socket The socket to configure.
+ * @param blocking `true` to make the socket blocking, `false` to make it non-blocking.
+ * @return A `ps_result_t` result code indicating the success or failure of the operation.
+ */
+ps_result_t ps_set_socket_blocking(ps_socket_t socket, bool blocking);
+
+/**
+ * @brief Enables or disables Nagle's algorithm (TCP_NODELAY) on a TCP socket.
+ * 
+ * @param socket The TCP socket to configure.
+ * @param enabled `true` to send small writes immediately instead of waiting to merge them.
+ * @return A `ps_result_t` result code indicating the success or failure of the operation.
+ */
+ps_result_t ps_set_socket_nodelay(ps_socket_t socket, bool enabled);
+
+/**
+ * @brief Timeouts of blocking socket operations, in milliseconds. 0 waits as long as the system does.
+ */
+typedef struct {
+  uint32_t connect_ms;         /**< Blocking `ps_connect_socket`. */
+  uint32_t read_ms;            /**< Blocking reads and accepts. */
+  uint32_t write_ms;           /**< Blocking sends. */
+} ps_socket_timeouts_t;
+
+/**
+ * @brief Sets the timeouts of blocking operations on a socket, which then fail with `PS_ERROR_TIMEOUT`.
+ * 
+ * A send that times out part way may have sent some of the packet. Non-blocking sockets are not affected;
+ * see `ps_loop_set_socket_heartbeat` for sockets driven by a loop.
+ *
+ * @param socket The socket to configure.
+ * @param timeouts The timeouts.
+ * @return A `ps_result_t` result code indicating the success or failure of the operation.
+ */
+ps_result_t ps_set_socket_timeouts(ps_socket_t socket, const ps_socket_timeouts_t *timeouts);
+
+/**
+ * @brief Opaque structure representing an event loop.
+ * 
+ * An event loop multiplexes many non-blocking sockets on a single thread (epoll on Linux).
+ */
+typedef struct ps_loop_s *ps_loop_t;
+
+/**
+ * @brief Callback invoked by the event loop for a socket event.
+ *
+ * @param loop The loop dispatching the event.
+ * @param socket The socket the event belongs to.
+ * @param user_data The user data registered with the socket.
+ */
+typedef void (*ps_loop_socket_callback_t)(ps_loop_t loop, ps_socket_t socket, void *user_data);
+
+/**
+ * @brief Callback invoked by the event loop for every connection accepted on a listening socket.
+ *
+ * The client socket is owned by the callee and is not registered with the loop.
+ *
+ * @param loop The loop dispatching the event.
+ * @param socket The listening socket.
+ * @param client The accepted client socket.
+ * @param user_data The user data registered with the listening socket.
+ */
+typedef void (*ps_loop_accept_callback_t)(ps_loop_t loop, ps_socket_t socket, ps_socket_t client, void *user_data);
+
+/**
+ * @brief Set of callbacks registered for a socket on an event loop.
+ * 
+ * The loop is edge-triggered: `on_read` and `on_write` are only invoked again after the socket
+ * returned `PS_ERROR_WOULDBLOCK`, so they must read or write until then.
+ */
+typedef struct {
+  ps_loop_socket_callback_t on_read;   /**< Socket has data to read (optional). */
+  ps_loop_socket_callback_t on_write;  /**< Socket became writable (optional). */
+  ps_loop_accept_callback_t on_accept; /**< Connection accepted on a listening socket (optional). */
+  ps_loop_socket_callback_t on_close;  /**< Peer hung up or the socket failed; the socket was removed from the loop (optional). */
+  void *user_data;                     /**< User data passed to every callback. */
+} ps_loop_callbacks_t;
+
+/**
+ * @brief Enum representing the I/O backends an event loop can run on.
+ */
+typedef enum {
+  PS_LOOP_BACKEND_AUTO = 0,    /**< io_uring when the kernel supports it, epoll otherwise. */
+  PS_LOOP_BACKEND_EPOLL,       /**< Readiness based epoll; asynchronous operations are emulated. */
+  PS_LOOP_BACKEND_IO_URING,    /**< Completion based io_uring with batched submissions. */
+
+  COUNT_PS_LOOP_BACKENDS       /**< Count of backends. */
+} ps_loop_backend_t;
+
+/**
+ * @brief Options used to create an event loop.
+ */
+typedef struct {
+  ps_loop_backend_t backend;   /**< Backend to run on. */
+  size_t recv_buffer_size;     /**< Size of each buffer handed out by multishot reads, 0 for 4096. */
+  uint32_t recv_buffer_count;  /**< Number of multishot read buffers (a power of two), 0 for 256. */
+} ps_loop_options_t;
+
+/**
+ * @brief Creates an event loop with default options.
+ *
+ * @param loop Pointer to a variable that will hold the created loop.
+ * @return A `ps_result_t` result code indicating the success or failure of the operation.
+ */
+ps_result_t ps_create_loop(ps_loop_t *loop);
+
+/**
+ * @brief Creates an event loop.
+ *
+ * Requesting `PS_LOOP_BACKEND_IO_URING` fails with `PS_ERROR_UNSUPPORTED` when the running kernel
+ * lacks io_uring, while `PS_LOOP_BACKEND_AUTO` falls back to epoll.
+ *
+ * @param loop Pointer to a variable that will hold the created loop.
+ * @param options The loop options, or NULL for the defaults.
+ * @return A `ps_result_t` result code indicating the success or failure of the operation.
+ */
+ps_result_t ps_create_loop_with_options(ps_loop_t *loop, const ps_loop_options_t *options);
+
+/**
+ * @brief Destroys an event loop. All sockets must be removed or destroyed beforehand.
+ *
+ * @param loop The loop to destroy.
+ */
+void ps_destroy_loop(ps_loop_t loop);
+
+/**
+ * @brief Returns the backend an event loop ended up running on.
+ *
+ * @param loop The loop to query.
+ * @return `PS_LOOP_BACKEND_EPOLL` or `PS_LOOP_BACKEND_IO_URING`.
+ */
+ps_loop_backend_t ps_loop_get_backend(ps_loop_t loop);
+
+/**
+ * @brief Registers a socket with an event loop and switches it to non-blocking mode.
+ *
+ * Registering an already registered socket replaces its callbacks.
+ *
+ * @param loop The loop to register with.
+ * @param socket The socket to register.
+ * @param callbacks The callbacks to invoke for the socket's events.
+ * @return A `ps_result_t` result code indicating the success or failure of the operation.
+ */
+ps_result_t ps_loop_add_socket(ps_loop_t loop, ps_socket_t socket, ps_loop_callbacks_t callbacks);
+
+/**
+ * @brief Removes a socket from its event loop. Safe to call from within a callback.
+ * 
+ * `ps_destroy_socket` removes the socket automatically.
+ *
+ * @param loop The loop the socket is registered with.
+ * @param socket The socket to remove.
+ * @return A `ps_result_t` result code indicating the success or failure of the operation.
+ */
+ps_result_t ps_loop_remove_socket(ps_loop_t loop, ps_socket_t socket);
+
+/**
+ * @brief Waits for events and dispatches them once.
+ *
+ * @param loop The loop to run.
+ * @param timeout_ms Maximum time to wait in milliseconds, `-1` to wait indefinitely, `0` to poll.
+ * @return A `ps_result_t` result code indicating the success or failure of the operation.
+ */
+ps_result_t ps_loop_run_once(ps_loop_t loop, int timeout_ms);
+
+/**
+ * @brief Dispatches events until `ps_loop_stop` is called.
+ *
+ * @param loop The loop to run.
+ * @return A `ps_result_t` result code indicating the success or failure of the operation.
+ */
+ps_result_t ps_loop_run(ps_loop_t loop);
+
+/**
+ * @brief Makes `ps_loop_run` return after the current iteration. Safe to call from any thread.
+ *
+ * If the loop is not running yet, the next `ps_loop_run` returns right away instead.
+ *
+ * @param loop The loop to stop.
+ */
+void ps_loop_stop(ps_loop_t loop);
+
+/**
+ * @brief Callback invoked at the end of every loop iteration.
+ *
+ * @param loop The loop that finished an iteration.
+ * @param user_data The user data passed to `ps_loop_add_tick`.
+ */
+typedef void (*ps_loop_tick_callback_t)(ps_loop_t loop, void *user_data);
+
+/**
+ * @brief Registers a callback run after the events of each `ps_loop_run_once` were dispatched, before waiting again.
+ * 
+ * Useful for work batched up by the iteration's callbacks, such as flushing buffered writes once per iteration.
+ *
+ * @param loop The loop to register with.
+ * @param callback The callback to invoke.
+ * @param user_data User data passed to the callback.
+ * @return A `ps_result_t` result code indicating the success or failure of the operation.
+ */
+ps_result_t ps_loop_add_tick(ps_loop_t loop, ps_loop_tick_callback_t callback, void *user_data);
+
+/**
+ * @brief Unregisters a tick callback added with the same `callback` and `user_data`. Safe to call from a tick.
+ *
+ * @param loop The loop the callback is registered with.
+ * @param callback The registered callback.
+ * @param user_data The registered user data.
+ * @return A `ps_result_t` result code; `PS_ERROR_INVALID_ARGUMENT` if no such callback is registered.
+ */
+ps_result_t ps_loop_remove_tick(ps_loop_t loop, ps_loop_tick_callback_t callback, void *user_data);
+
+/**
+ * @brief Callback of a task run by an executor or posted to an event loop.
+ *
+ * @param user_data The user data the task was submitted with.
+ */
+typedef void (*ps_task_callback_t)(void *user_data);
+
+/**
+ * @brief Queues a callback to run on the loop's thread. Safe to call from any thread.
+ * 
+ * Posting takes no lock: callbacks go onto a lock-free list, and only the first post since the loop last
+ * drained it wakes the loop. Posted callbacks run in posting order, after the iteration's events and before
+ * its ticks. Callbacks still queued when the loop is destroyed are dropped.
+ *
+ * @param loop The loop to run the callback on.
+ * @param callback The callback to invoke.
+ * @param user_data User data passed to the callback.
+ * @return A `ps_result_t` result code indicating the success or failure of the operation.
+ */
+ps_result_t ps_loop_post(ps_loop_t loop, ps_task_callback_t callback, void *user_data);
+
+/**
+ * @brief Returns the loop a socket is registered with, e.g. to post a reply computed elsewhere back to it.
+ * 
+ * Should be called on the loop's thread, before handing the work off.
+ *
+ * @param socket The socket to query.
+ * @return The socket's loop, or NULL if it is not registered with one.
+ */
+ps_loop_t ps_socket_get_loop(ps_socket_t socket);
+
+typedef struct ps_timer_s ps_timer_t;
+
+/**
+ * @brief Callback invoked on the loop's thread when a timer expires.
+ *
+ * @param loop The loop the timer ran on.
+ * @param timer The expired timer, which may be started again from the callback.
+ * @param user_data The user data passed to `ps_timer_init`.
+ */
+typedef void (*ps_timer_callback_t)(ps_loop_t loop, ps_timer_t *timer, void *user_data);
+
+/**
+ * @brief A one-shot timer run by an event loop.
+ * 
+ * Timers live in the caller's memory, typically inside the structure they time out, so starting and
+ * stopping them never allocates. Loops keep them in a hierarchical timing wheel of 64-slot levels with
+ * millisecond ticks: starting, stopping and expiring are O(1), and finding the next expiry is a handful of
+ * bit scans however many timers there are. The fields are private; set them up with `ps_timer_init`.
+ */
+struct ps_timer_s {
+  ps_timer_t *next;
+  ps_timer_t **prev;           /**< Link pointing at this timer, NULL while it is not running. */
+  uint64_t expires;
+  uint32_t slot;
+  ps_timer_callback_t callback;
+  void *user_data;
+};
+
+/**
+ * @brief Initializes a stopped timer.
+ *
+ * @param timer The timer to initialize.
+ * @param callback The callback to invoke when the timer expires.
+ * @param user_data User data passed to the callback.
+ */
+void ps_timer_init(ps_timer_t *timer, ps_timer_callback_t callback, void *user_data);
+
+/**
+ * @brief Returns whether a timer is running.
+ *
+ * @param timer The timer to query.
+ * @return `true` if the timer is started and has not expired or been stopped.
+ */
+bool ps_timer_is_active(const ps_timer_t *timer);
+
+/**
+ * @brief Starts a timer, or restarts it if it is running. Must be called on the loop's thread.
+ * 
+ * The timer expires during the first iteration at least `timeout_ms` after the time of `ps_loop_now`,
+ * rounded up to the next millisecond.
+ *
+ * @param loop The loop to run the timer on.
+ * @param timer The timer to start, which must not be running on another loop.
+ * @param timeout_ms Milliseconds until the timer expires.
+ * @return A `ps_result_t` result code indicating the success or failure of the operation.
+ */
+ps_result_t ps_loop_start_timer(ps_loop_t loop, ps_timer_t *timer, uint64_t timeout_ms);
+
+/**
+ * @brief Stops a timer if it is running. Must be called on the loop's thread.
+ *
+ * @param loop The loop the timer was started on.
+ * @param timer The timer to stop.
+ */
+void ps_loop_stop_timer(ps_loop_t loop, ps_timer_t *timer);
+
+/**
+ * @brief Returns the loop's clock: monotonic milliseconds, sampled once the loop stopped waiting in each iteration.
+ *
+ * @param loop The loop to query.
+ * @return The time in milliseconds.
+ */
+uint64_t ps_loop_now(ps_loop_t loop);
+
+/**
+ * @brief Options of a loop heartbeat, which detects dead peers of a socket registered with the loop.
+ */
+typedef struct {
+  uint32_t interval_ms;        /**< Silence, in milliseconds, after which a heartbeat is sent; 0 disables the heartbeat. */
+  uint32_t max_missed;         /**< Heartbeats left unanswered before the peer is closed; 0 makes `interval_ms` a plain idle timeout. */
+  ps_packet_t message;         /**< Heartbeat sent to the peer, which must stay valid; empty to only watch for silence. */
+} ps_heartbeat_options_t;
+
+/**
+ * @brief Watches a socket registered with the loop for silence from its peer.
+ * 
+ * Whenever nothing was received for `interval_ms`, `message` is sent; anything received answers it.
+ * Once `max_missed` heartbeats went unanswered and one more interval passed in silence, the socket is removed
+ * from the loop and its `on_close` callback invoked, as when the peer hangs up. The message is sent without
+ * waiting: when the socket buffer is full it is skipped and still counts as unanswered, and when the send
+ * fails the socket is closed the same way right away. Receiving costs no timer operation: the loop only notes
+ * the time, and the timer checks it when it expires.
+ *
+ * @param loop The loop the socket is registered with.
+ * @param socket The socket to watch.
+ * @param options The heartbeat options, or NULL to stop watching.
+ * @return A `ps_result_t` result code; `PS_ERROR_INVALID_ARGUMENT` if the socket is not registered with the loop.
+ */
+ps_result_t ps_loop_set_socket_heartbeat(ps_loop_t loop, ps_socket_t socket, const ps_heartbeat_options_t *options);
+
+/**
+ * @brief Maximum number of addresses a lookup yields.
+ */
+#define PS_RESOLVE_MAX_ADDRESSES 16
+
+/**
+ * @brief Options of a DNS resolver.
+ */
+typedef struct {
+  const ps_endpoint_t *servers; /**< Name servers to query, or NULL for those of /etc/resolv.conf (127.0.0.1 if none). At most 4. */
+  size_t server_count;          /**< Number of entries in `servers`. */
+  uint32_t timeout_ms;          /**< Time to wait for an answer before asking the next server; 0 for the default of 1000. */
+  uint32_t attempts;            /**< Times every server is asked before a lookup times out; 0 for the default of 2. */
+  size_t cache_shards;          /**< Independently locked parts of the cache, rounded up to a power of two; 0 for 16. */
+  size_t cache_capacity;        /**< Names cached in all shards together; 0 for 4096. */
+  uint32_t min_ttl_ms;          /**< Shortest time an answer is cached, whatever its TTL says. */
+  uint32_t max_ttl_ms;          /**< Longest time an answer is cached; 0 for one day. */
+  uint32_t negative_ttl_ms;     /**< Time a missing name is cached when the answer carries no SOA record; 0 for 5000. */
+} ps_resolver_options_t;
+
+/**
+ * @brief Statistics of a DNS resolver.
+ */
+typedef struct {
+  uint64_t cache_hits;          /**< Names answered with cached addresses. */
+  uint64_t negative_hits;       /**< Names answered by a cached miss. */
+  uint64_t cache_misses;        /**< Names not in the cache, or expired. */
+  uint64_t lookups;             /**< Lookups sent to the network; concurrent lookups of a name share one. */
+  uint64_t queries;             /**< Query datagrams sent, one per address family and attempt. */
+  uint64_t retransmits;         /**< Attempts that followed a timeout, or an answer that was an error or truncated. */
+  uint64_t timeouts;            /**< Lookups no server answered. */
+  uint64_t failures;            /**< Lookups the servers failed with an error. */
+} ps_resolver_stats_t;
+
+/**
+ * @brief Handle for a DNS resolver.
+ */
+typedef struct ps_resolver_s *ps_resolver_t;
+
+/**
+ * @brief Callback invoked on the loop's thread when a lookup completes.
+ *
+ * @param resolver The resolver that ran the lookup.
+ * @param result `PS_SUCCESS`; `PS_ERROR_ADDRNOTAVAIL` if the name has no address; `PS_ERROR_TIMEOUT` if no
+ *               server answered; `PS_ERROR_HOSTDOWN` if they failed; `PS_ERROR_SHUTDOWN` if the resolver was destroyed first.
+ * @param addresses The addresses found, IPv6 ones first, with port 0; valid during the callback only. NULL on failure.
+ * @param count Number of addresses.
+ * @param user_data The user data passed to `ps_resolve_async`.
+ */
+typedef void (*ps_resolve_callback_t)(ps_resolver_t resolver, ps_result_t result, const ps_endpoint_t *addresses, size_t count, void *user_data);
+
+/**
+ * @brief Creates a DNS resolver whose queries run on a loop.
+ * 
+ * Lookups ask the name servers for A and AAAA records at once over UDP, without blocking the loop. Each lookup
+ * draws its query ids from the system's secure random source and sends from sockets of its own, on a fresh source
+ * port, so forging an answer takes guessing both.
+ * Answers are cached for their TTL and missing names for the negative TTL of their SOA record (RFC 2308),
+ * in a cache split in shards by name hash, so concurrent lookups from other threads rarely contend.
+ *
+ * @param resolver Pointer to a variable that will hold the created resolver.
+ * @param loop The loop to run queries on.
+ * @param options The resolver options, or NULL for the defaults.
+ * @return A `ps_result_t` result code indicating the success or failure of the operation.
+ */
+ps_result_t ps_create_resolver(ps_resolver_t *resolver, ps_loop_t loop, const ps_resolver_options_t *options);
+
+/**
+ * @brief Destroys a resolver on its loop's thread. Lookups still running complete with `PS_ERROR_SHUTDOWN`.
+ *
+ * @param resolver The resolver to destroy.
+ */
+void ps_destroy_resolver(ps_resolver_t resolver);
+
+/**
+ * @brief Resolves a host name without blocking. Must be called on the loop's thread, not from a resolver callback.
+ * 
+ * Literal addresses and `localhost` names are answered without a query, and cached names from the cache;
+ * either way the callback runs from the loop, never before the call returns. Lookups of a name already
+ * being queried wait for that query instead of sending another one.
+ *
+ * @param resolver The resolver to use.
+ * @param host The host name or literal address.
+ * @param callback The callback to invoke exactly once, if the call succeeded.
+ * @param user_data User data passed to the callback.
+ * @return A `ps_result_t` result code; `PS_ERROR_INVALID_ARGUMENT` if `host` is not a valid name.
+ */
+ps_result_t ps_resolve_async(ps_resolver_t resolver, const char *host, ps_resolve_callback_t callback, void *user_data);
+
+/**
+ * @brief Looks a host name up in the cache only, costing a hash lookup. Safe to call from any thread.
+ *
+ * @param resolver The resolver whose cache to use.
+ * @param host The host name or literal address.
+ * @param addresses Array receiving the addresses, with port 0.
+ * @param capacity Number of entries in `addresses`.
+ * @param count Pointer to a variable that receives the number of addresses stored.
+ * @return A `ps_result_t` result code; `PS_ERROR_WOULDBLOCK` if the name is not cached, so it needs
+ *         `ps_resolve_async`; `PS_ERROR_ADDRNOTAVAIL` if it is cached as missing.
+ */
+ps_result_t ps_resolver_lookup(ps_resolver_t resolver, const char *host, ps_endpoint_t *addresses, size_t capacity, size_t *count);
+
+/**
+ * @brief Gets statistics about a resolver.
+ *
+ * @param resolver The resolver to query.
+ * @param stats Pointer to a structure that receives the statistics.
+ */
+void ps_get_resolver_stats(ps_resolver_t resolver, ps_resolver_stats_t *stats);
+
+/**
+ * @brief Options of an asynchronous connect.
+ */
+typedef struct {
+  uint32_t timeout_ms;         /**< Time for the whole connect, over all addresses; 0 leaves every attempt to the system's timeout. */
+  uint32_t attempt_delay_ms;   /**< Time an attempt may stay pending before the next address is tried as well; 0 for the default of 250. */
+  ps_resolver_t resolver;      /**< Resolver to look the host up with, on the connect's loop; NULL to resolve with the system's blocking resolver. */
+} ps_connect_options_t;
+
+/**
+ * @brief Callback invoked on the loop's thread when an asynchronous connect completes.
+ *
+ * @param loop The loop that ran the connect.
+ * @param result `PS_SUCCESS`, `PS_ERROR_TIMEOUT`, or the error of the last address that failed.
+ * @param socket The connected non-blocking TCP socket, not registered with the loop and owned by the callee; NULL on failure.
+ * @param user_data The user data passed to `ps_connect_async`.
+ */
+typedef void (*ps_connect_callback_t)(ps_loop_t loop, ps_result_t result, ps_socket_t socket, void *user_data);
+
+/**
+ * @brief Connects to every address of a host in parallel, as in happy eyeballs (RFC 8305). Must be called on the loop's thread.
+ * 
+ * The host's IPv6 and IPv4 addresses are dialed alternately, in the order the resolver ranked them,
+ * starting with the family of its first address. Each attempt gets `attempt_delay_ms` before the next one
+ * starts alongside, and a failed attempt starts the next one immediately, so a dead address costs the
+ * attempt delay instead of a whole connect timeout. The first handshake to complete wins; the others are
+ * closed. Without a resolver in the options, the host name is resolved before the call returns; with one,
+ * resolution is part of the connect, counts against `timeout_ms` and reports its errors through the callback.
+ *
+ * @param loop The loop to run the connect on.
+ * @param host The host name or literal address to connect to.
+ * @param port The port to connect to.
+ * @param options The connect options, or NULL for the defaults.
+ * @param callback The callback to invoke exactly once when the connect completes, if the call succeeded.
+ * @param user_data User data passed to the callback.
+ * @return A `ps_result_t` result code; `PS_ERROR_ADDRNOTAVAIL` if the host does not resolve. If no
+ *         address could even be dialed, the error is returned here and the callback is not invoked.
+ */
+ps_result_t ps_connect_async(ps_loop_t loop, const char *host, ps_port_t port, const ps_connect_options_t *options, ps_connect_callback_t callback, void *user_data);
+
+/**
+ * @brief Callback invoked when an asynchronous read or send completes.
+ *
+ * @param loop The loop that ran the operation.
+ * @param socket The socket the operation was submitted on.
+ * @param result `PS_SUCCESS`, `PS_CONNCLOSED` once the peer closed the connection, or an error.
+ * @param packet The submitted packet, or for multishot reads a packet borrowing a loop buffer
+ *               that is only valid until the callback returns.
+ * @param user_data The user data passed when submitting the operation.
+ */
+typedef void (*ps_loop_packet_completion_t)(ps_loop_t loop, ps_socket_t socket, ps_result_t result, ps_packet_t *packet, void *user_data);
+
+/**
+ * @brief Callback invoked when an asynchronous accept completes.
+ *
+ * @param loop The loop that ran the operation.
+ * @param socket The listening socket.
+ * @param result `PS_SUCCESS` or an error, in which case `client` is NULL.
+ * @param client The accepted client socket, owned by the callee.
+ * @param user_data The user data passed when submitting the operation.
+ */
+typedef void (*ps_loop_accept_completion_t)(ps_loop_t loop, ps_socket_t socket, ps_result_t result, ps_socket_t client, void *user_data);
+
+/**
+ * @brief Reads a packet asynchronously into `packet->buf`, up to `packet->capacity` bytes.
+ * 
+ * One read (single or multishot) may be pending per socket. The packet must stay valid until the
+ * callback runs. Destroying the socket cancels the operation without invoking the callback.
+ *
+ * @param loop The loop to run the operation on.
+ * @param socket The socket to read from.
+ * @param packet The packet to fill, with `buf` and `capacity` set.
+ * @param callback The callback to invoke on completion.
+ * @param user_data User data passed to the callback.
+ * @return A `ps_result_t` result code indicating whether the operation was submitted.
+ */
+ps_result_t ps_loop_read_socket_packet(ps_loop_t loop, ps_socket_t socket, ps_packet_t *packet, ps_loop_packet_completion_t callback, void *user_data);
+
+/**
+ * @brief Reads packets continuously into buffers owned by the loop.
+ * 
+ * The callback is invoked for every received packet until the connection is closed, an error
+ * occurs, or the socket is removed from the loop. On io_uring this is a single multishot receive
+ * using a provided buffer ring.
+ *
+ * @param loop The loop to run the operation on.
+ * @param socket The socket to read from.
+ * @param callback The callback to invoke for each packet.
+ * @param user_data User data passed to the callback.
+ * @return A `ps_result_t` result code indicating whether the operation was submitted.
+ */
+ps_result_t ps_loop_read_socket_packet_multishot(ps_loop_t loop, ps_socket_t socket, ps_loop_packet_completion_t callback, void *user_data);
+
+/**
+ * @brief Sends a whole packet asynchronously.
+ * 
+ * One send may be pending per socket. The packet must stay valid until the callback runs.
+ *
+ * @param loop The loop to run the operation on.
+ * @param socket The socket to send through.
+ * @param packet The packet to send.
+ * @param callback The callback to invoke on completion (optional).
+ * @param user_data User data passed to the callback.
+ * @return A `ps_result_t` result code indicating whether the operation was submitted.
+ */
+ps_result_t ps_loop_send_socket_packet(ps_loop_t loop, ps_socket_t socket, ps_packet_t *packet, ps_loop_packet_completion_t callback, void *user_data);
+
+/**
+ * @brief Accepts connections asynchronously on a listening socket.
+ *
+ * @param loop The loop to run the operation on.
+ * @param socket The listening socket.
+ * @param multishot `true` to keep accepting until the socket is removed, `false` for one connection.
+ * @param callback The callback to invoke for each accepted connection.
+ * @param user_data User data passed to the callback.
+ * @return A `ps_result_t` result code indicating whether the operation was submitted.
+ */
+ps_result_t ps_loop_accept_socket(ps_loop_t loop, ps_socket_t socket, bool multishot, ps_loop_accept_completion_t callback, void *user_data);
+
+/**
+ * @brief Enum representing the ways a framed socket delimits messages on a byte stream.
+ */
+typedef enum {
+  PS_FRAMING_VARINT,    /**< Each frame is preceded by its length as an unsigned LEB128 varint. */
+  PS_FRAMING_FIXED32,   /**< Each frame is preceded by its length as a 4-byte big-endian integer. */
+  PS_FRAMING_DELIMITER, /**< Each frame is followed by a delimiter, which is not part of the frame. */
+} ps_framing_t;
+
+/**
+ * @brief Longest delimiter supported by `PS_FRAMING_DELIMITER`.
+ */
+#define PS_FRAMING_MAX_DELIMITER 16
+
+/**
+ * @brief Options used to create a framed socket.
+ */
+typedef struct {
+  ps_framing_t framing;     /**< How frames are delimited. */
+  const char *delimiter;    /**< Delimiter for `PS_FRAMING_DELIMITER`, e.g. "\r\n"; copied on creation. */
+  size_t delimiter_size;    /**< Size of `delimiter`, at most `PS_FRAMING_MAX_DELIMITER`. */
+  size_t max_frame_size;    /**< Largest frame accepted, 0 for 16 MiB. Larger frames fail with `PS_ERROR_MSGTOOLONG`. */
+  size_t initial_capacity;  /**< Initial size of the receive buffer, 0 for 4 KiB. It grows to fit larger frames. */
+} ps_framing_options_t;
+
+/**
+ * @brief Opaque structure splitting a TCP stream into the messages sent on it.
+ * 
+ * Received bytes are collected in a ring buffer and frames are parsed in place: a complete frame is handed out
+ * as a view into the ring and only copied when it wraps around the ring's end. A framed socket is not thread-safe.
+ */
+typedef struct ps_framed_socket_s *ps_framed_socket_t;
+
+/**
+ * @brief Creates a framed socket reading from and writing to a TCP socket.
+ * 
+ * The socket remains owned by the caller and must outlive the framed socket.
+ *
+ * @param framed Pointer to a variable that will hold the created framed socket.
+ * @param socket The connected TCP socket.
+ * @param options The framing options.
+ * @return A `ps_result_t` result code indicating the success or failure of the operation.
+ */
+ps_result_t ps_create_framed_socket(ps_framed_socket_t *framed, ps_socket_t socket, const ps_framing_options_t *options);
+
+/**
+ * @brief Destroys a framed socket, discarding any partially received frame. The socket itself is not destroyed.
+ * 
+ * @param framed The framed socket to destroy.
+ */
+void ps_destroy_framed_socket(ps_framed_socket_t framed);
+
+/**
+ * @brief Returns the next complete frame, reading from the socket as needed.
+ * 
+ * `frame->buf` points into the framed socket's buffer and stays valid until the next call on it; its
+ * `size` and `capacity` are the frame's length. On a blocking socket this waits for a whole frame; on a
+ * non-blocking one `PS_ERROR_WOULDBLOCK` is returned once no complete frame is buffered and the socket is drained,
+ * so an edge-triggered loop calls it until then. A frame over the size limit leaves the stream unusable.
+ *
+ * @param framed The framed socket to read from.
+ * @param frame Pointer to a packet that receives a view of the frame.
+ * @return A `ps_result_t` result code; `PS_CONNCLOSED` once the peer closed the stream, dropping any partial frame.
+ */
+ps_result_t ps_framed_read(ps_framed_socket_t framed, ps_packet_t *frame);
+
+/**
+ * @brief Sends `payload` as one frame, writing the length prefix or delimiter along with it in a single call.
+ * 
+ * @param framed The framed socket to send through.
+ * @param payload The frame to send.
+ * @return A `ps_result_t` result code; `PS_ERROR_MSGTOOLONG` if the frame exceeds the size limit.
+ */
+ps_result_t ps_framed_send(ps_framed_socket_t framed, ps_packet_t payload);
+
+/**
+ * @brief Options used to create a buffered stream.
+ */
+typedef struct {
+  size_t read_buffer_size;   /**< Bytes read ahead per receive, 0 for 16 KiB. */
+  size_t write_buffer_size;  /**< Bytes of writes collected before they are sent, 0 for 16 KiB. */
+  ps_loop_t loop;            /**< Loop that flushes the stream at the end of every iteration (optional). */
+} ps_buffered_stream_options_t;
+
+/**
+ * @brief Opaque structure buffering reads and writes on a TCP socket.
+ * 
+ * Small writes are collected and sent together in one system call when the write buffer fills up, on
+ * `ps_buffered_stream_flush`, or, if the stream was given a loop, once per loop iteration. The stream turns on
+ * TCP_NODELAY, since it does its own coalescing, and holds TCP_CORK around large flushes so they leave in full
+ * segments. A buffered stream is not thread-safe.
+ */
+typedef struct ps_buffered_stream_s *ps_buffered_stream_t;
+
+/**
+ * @brief Creates a buffered stream over a connected TCP socket.
+ * 
+ * The socket remains owned by the caller and must outlive the stream.
+ *
+ * @param stream Pointer to a variable that will hold the created stream.
+ * @param socket The connected TCP socket.
+ * @param options The stream options, or NULL for the defaults.
+ * @return A `ps_result_t` result code indicating the success or failure of the operation.
+ */
+ps_result_t ps_create_buffered_stream(ps_buffered_stream_t *stream, ps_socket_t socket, const ps_buffered_stream_options_t *options);
+
+/**
+ * @brief Flushes and destroys a buffered stream. The socket itself is not destroyed.
+ * 
+ * Data that cannot be flushed, e.g. because a non-blocking socket is full, is discarded.
+ *
+ * @param stream The stream to destroy.
+ */
+void ps_destroy_buffered_stream(ps_buffered_stream_t stream);
+
+/**
+ * @brief Reads buffered data into `packet->buf`, up to `packet->capacity` bytes, receiving more if none is buffered.
+ * 
+ * Pending writes are flushed before waiting for the socket, so a request written to the stream is never
+ * held back while its response is awaited. Reads into a buffer at least as large as the read-ahead buffer
+ * bypass it.
+ *
+ * @param stream The stream to read from.
+ * @param packet The packet to fill; it needs a caller-provided buffer.
+ * @return A `ps_result_t` result code; `PS_CONNCLOSED` once the peer closed the stream.
+ */
+ps_result_t ps_buffered_stream_read(ps_buffered_stream_t stream, ps_packet_t *packet);
+
+/**
+ * @brief Queues `packet` for sending, sending it right away together with the buffered data if it does not fit.
+ * 
+ * The packet's data is copied or sent before the call returns. A non-blocking socket that is full never blocks:
+ * what it does not take stays buffered, and the packet is buffered as well if it fits. Otherwise
+ * `PS_ERROR_WOULDBLOCK` is returned and the packet was not taken, unless part of it already went out, in which
+ * case the rest is kept like the rest of a partial `ps_send_socket_packet`.
+ *
+ * @param stream The stream to write to.
+ * @param packet The data to write.
+ * @return A `ps_result_t` result code; also reports a failure of an earlier flush by the loop.
+ */
+ps_result_t ps_buffered_stream_write(ps_buffered_stream_t stream, ps_packet_t packet);
+
+/**
+ * @brief Sends all buffered writes.
+ * 
+ * Sends as much as a non-blocking socket takes without waiting; resume from the socket's on_write callback.
+ *
+ * @param stream The stream to flush.
+ * @return A `ps_result_t` result code; `PS_ERROR_WOULDBLOCK` if a non-blocking socket is full, keeping the rest buffered.
+ */
+ps_result_t ps_buffered_stream_flush(ps_buffered_stream_t stream);
+
+/**
+ * @brief Returns the number of written bytes waiting to be flushed.
+ * 
+ * @param stream The stream to query.
+ * @return The number of buffered bytes.
+ */
+size_t ps_buffered_stream_pending(ps_buffered_stream_t stream);
+
+/**
+ * @brief Options used to create a server.
+ */
+typedef struct {
+  size_t workers;                      /**< Worker threads, each with its own listener and loop; 0 for one per CPU. */
+  int backlog;                         /**< Backlog of each listener, 0 for the largest the system allows. */
+  bool pin_workers;                    /**< Pin worker `i` to CPU `i` modulo the CPU count. */
+  ps_loop_options_t loop_options;      /**< Options of every worker's loop. */
+  ps_loop_accept_callback_t on_accept; /**< Called on the accepting worker's thread for every new connection. */
+  void *user_data;                     /**< User data passed to `on_accept`. */
+} ps_server_options_t;
+
+/**
+ * @brief Opaque structure representing a multi-threaded TCP server.
+ * 
+ * Every worker thread has its own listening socket on the shared port (SO_REUSEPORT) and its own event loop,
+ * so the kernel spreads incoming connections across the workers and accepting never funnels through one thread.
+ * Accepted connections are handed to `on_accept` together with the loop of the worker that accepted them,
+ * which they should be registered with to stay on that thread.
+ */
+typedef struct ps_server_s *ps_server_t;
+
+/**
+ * @brief Creates a server listening on `ip` and `port`. Connections queue up until the server is started.
+ * 
+ * Port 0 picks a free port for all workers; see `ps_server_get_port`.
+ *
+ * @param server Pointer to a variable that will hold the created server.
+ * @param address The address family to listen on.
+ * @param ip The IP address to listen on.
+ * @param port The port to listen on.
+ * @param options The server options; `on_accept` is required.
+ * @return A `ps_result_t` result code; `PS_ERROR_UNSUPPORTED` for several workers where ports cannot be shared.
+ */
+ps_result_t ps_create_server(ps_server_t *server, ps_address_t address, const char *ip, ps_port_t port, const ps_server_options_t *options);
+
+/**
+ * @brief Stops the server if it is running and destroys it.
+ * 
+ * Client sockets registered with a worker loop must be destroyed beforehand.
+ *
+ * @param server The server to destroy.
+ */
+void ps_destroy_server(ps_server_t server);
+
+/**
+ * @brief Starts the worker threads, which run their loops until `ps_server_stop`.
+ * 
+ * @param server The server to start.
+ * @return A `ps_result_t` result code indicating the success or failure of the operation.
+ */
+ps_result_t ps_server_start(ps_server_t server);
+
+/**
+ * @brief Stops the worker loops and waits for the worker threads to exit. Must not be called from a worker.
+ * 
+ * @param server The server to stop.
+ * @return `PS_SUCCESS`, or the error a worker loop stopped with.
+ */
+ps_result_t ps_server_stop(ps_server_t server);
+
+/**
+ * @brief Returns the port the server listens on.
+ * 
+ * @param server The server to query.
+ * @return The port.
+ */
+ps_port_t ps_server_get_port(ps_server_t server);
+
+/**
+ * @brief Returns the number of worker threads of a server.
+ * 
+ * @param server The server to query.
+ * @return The number of workers.
+ */
+size_t ps_server_get_worker_count(ps_server_t server);
+
+/**
+ * @brief Returns the event loop of a worker, e.g. to register sockets with it before the server is started.
+ * 
+ * @param server The server to query.
+ * @param worker Index of the worker, below `ps_server_get_worker_count`.
+ * @return The worker's loop.
+ */
+ps_loop_t ps_server_get_loop(ps_server_t server, size_t worker);
+
+/**
+ * @brief Options used to create an executor.
+ */
+typedef struct {
+  size_t workers;          /**< Worker threads, 0 for one per CPU. */
+  size_t queue_capacity;   /**< Tasks submitted from outside the executor that can wait to be picked up, 0 for 4096. */
+  bool pin_workers;        /**< Pin worker `i` to CPU `i` modulo the CPU count. */
+} ps_executor_options_t;
+
+/**
+ * @brief Opaque structure representing a work-stealing thread pool.
+ * 
+ * Meant for handlers too heavy to run on an event loop's thread: the loop submits decoded messages, and
+ * handlers post their replies back with `ps_loop_post`. Every worker has its own lock-free deque, where
+ * tasks submitted from within a task go; idle workers steal from the others' deques. Tasks submitted from
+ * other threads go through a shared lock-free queue. Workers only take a lock to go to sleep or wake up.
+ */
+typedef struct ps_executor_s *ps_executor_t;
+
+/**
+ * @brief Creates an executor and starts its worker threads.
+ *
+ * @param executor Pointer to a variable that will hold the created executor.
+ * @param options The executor options, or NULL for the defaults.
+ * @return A `ps_result_t` result code indicating the success or failure of the operation.
+ */
+ps_result_t ps_create_executor(ps_executor_t *executor, const ps_executor_options_t *options);
+
+/**
+ * @brief Runs the tasks still queued, stops the worker threads and destroys the executor. Must not be called from a task.
+ *
+ * @param executor The executor to destroy.
+ */
+void ps_destroy_executor(ps_executor_t executor);
+
+/**
+ * @brief Queues a task to run on one of the executor's workers. Safe to call from any thread.
+ *
+ * @param executor The executor to run the task on.
+ * @param callback The task to run.
+ * @param user_data User data passed to the task.
+ * @return A `ps_result_t` result code; `PS_ERROR_WOULDBLOCK` if the queue for tasks submitted from outside the executor is full.
+ */
+ps_result_t ps_executor_submit(ps_executor_t executor, ps_task_callback_t callback, void *user_data);
+
+/**
+ * @brief Returns the number of worker threads of an executor.
+ *
+ * @param executor The executor to query.
+ * @return The number of workers.
+ */
+size_t ps_executor_get_worker_count(ps_executor_t executor);
+
+/**
+ * @brief Callback deciding whether an idle pooled connection is still worth keeping, e.g. by exchanging a ping.
+ *
+ * @param socket The idle connection, in blocking mode.
+ * @param user_data The user data of the pool options.
+ * @return `true` to keep the connection, `false` to close it.
+ */
+typedef bool (*ps_conn_pool_health_check_t)(ps_socket_t socket, void *user_data);
+
+/**
+ * @brief Options used to create a connection pool. Every limit applies to each (host, port, protocol) separately.
+ */
+typedef struct {
+  size_t max_connections;       /**< Connections idle or checked out, 0 for no limit. */
+  size_t max_idle;              /**< Idle connections kept, 0 for 8. Beyond, connections checked in are closed. */
+  size_t min_idle;              /**< Idle connections `ps_conn_pool_maintain` keeps open ahead of demand. */
+  size_t max_hosts;             /**< Distinct destinations the pool can hold, 0 for 64. A pool never forgets one. */
+  uint32_t idle_timeout_ms;     /**< Idle connections older than this are closed instead of reused, 0 to keep them. */
+  uint32_t wait_timeout_ms;     /**< Time a checkout waits for a connection once `max_connections` are open, 0 to wait indefinitely. */
+  uint32_t connect_timeout_ms;  /**< Timeout of new connections, 0 for the system's. */
+  ps_conn_pool_health_check_t health_check; /**< Run by `ps_conn_pool_maintain` on idle connections (optional). */
+  void *user_data;              /**< User data passed to `health_check`. */
+  ps_resolver_t resolver;       /**< Resolver to look host names up with, its loop running on another thread; NULL to resolve with the system's blocking resolver. */
+} ps_conn_pool_options_t;
+
+/**
+ * @brief Statistics of a connection pool, to size it: a low hit rate asks for more idle connections,
+ *        long waits for more connections overall.
+ */
+typedef struct {
+  uint64_t checkouts;           /**< Successful checkouts. */
+  uint64_t hits;                /**< Checkouts served by an idle connection. */
+  uint64_t misses;              /**< Checkouts that opened a new connection. */
+  uint64_t waits;               /**< Checkouts that had to wait for a connection. */
+  uint64_t wait_time_us;        /**< Microseconds spent waiting, over all checkouts. */
+  uint64_t max_wait_time_us;    /**< Longest wait of a single checkout. */
+  uint64_t timeouts;            /**< Checkouts that gave up waiting. */
+  uint64_t connect_failures;    /**< New connections that failed. */
+  uint64_t evictions;           /**< Idle connections closed because they were too old or too many. */
+  uint64_t failed_checks;       /**< Idle connections closed because the peer hung up or a health check failed. */
+  uint64_t idle;                /**< Connections idle in the pool right now. */
+  uint64_t active;              /**< Connections checked out right now. */
+} ps_conn_pool_stats_t;
+
+/**
+ * @brief Opaque structure representing a pool of outbound connections.
+ * 
+ * Idle connections of every destination wait in a lock-free stack, so checkouts and checkins from many threads
+ * never queue behind each other. Checkouts reuse the most recently used connection first, after checking the peer
+ * did not hang up in the meantime, so rarely used connections age at the bottom until they expire.
+ */
+typedef struct ps_conn_pool_s *ps_conn_pool_t;
+
+/**
+ * @brief Creates a connection pool.
+ *
+ * @param pool Pointer to a variable that will hold the created pool.
+ * @param options The pool options, or NULL for the defaults.
+ * @return A `ps_result_t` result code indicating the success or failure of the operation.
+ */
+ps_result_t ps_create_conn_pool(ps_conn_pool_t *pool, const ps_conn_pool_options_t *options);
+
+/**
+ * @brief Closes every idle connection and destroys a pool. Every checked out connection must have been checked in.
+ *
+ * @param pool The pool to destroy.
+ */
+void ps_destroy_conn_pool(ps_conn_pool_t pool);
+
+/**
+ * @brief Takes a connection to a destination out of the pool, opening one if none is idle. Safe to call from any thread.
+ *
+ * @param pool The pool to take the connection from.
+ * @param host The IP address or host name to connect to. Names are resolved for every new connection: from the
+ *             cache of the pool's resolver, else by a lookup on its loop that the checkout waits for, so a checkout
+ *             must not run on that loop's thread.
+ * @param port The port to connect to.
+ * @param protocol The protocol of the connection.
+ * @param socket Pointer to a variable that receives the connected socket, in blocking mode.
+ * @return A `ps_result_t` result code; `PS_ERROR_TIMEOUT` if no connection became available within `wait_timeout_ms`,
+ *         `PS_ERROR_WOULDBLOCK` if the pool already holds `max_hosts` other destinations.
+ */
+ps_result_t ps_conn_pool_checkout(ps_conn_pool_t pool, const char *host, ps_port_t port, ps_protocol_t protocol, ps_socket_t *socket);
+
+/**
+ * @brief Returns a connection to the pool. Safe to call from any thread.
+ * 
+ * A connection that saw an error, or was left in the middle of an exchange, must not be reused: it is
+ * closed, which lets a waiting checkout open a new one. The socket must not be used afterwards either way.
+ *
+ * @param pool The pool the connection was checked out from.
+ * @param socket The connection, in blocking mode and not registered with a loop.
+ * @param reusable `true` to keep the connection for later checkouts.
+ */
+void ps_conn_pool_checkin(ps_conn_pool_t pool, ps_socket_t socket, bool reusable);
+
+/**
+ * @brief Closes idle connections that are too old or fail the health check, and opens new ones up to `min_idle`
+ *        for every destination seen so far. Meant to be called periodically from a single thread.
+ *
+ * @param pool The pool to maintain.
+ */
+void ps_conn_pool_maintain(ps_conn_pool_t pool);
+
+/**
+ * @brief Gets statistics about a connection pool.
+ *
+ * @param pool The pool to query.
+ * @param stats Pointer to a structure that receives the statistics.
+ */
+void ps_get_conn_pool_stats(ps_conn_pool_t pool, ps_conn_pool_stats_t *stats);
+
+/**
+ * @brief Number of buckets of a latency histogram.
+ *
+ * Latencies below 8 ns get a bucket each; every power of two above is split into 8 buckets, so a bucket is
+ * never wider than an eighth of the values it holds. The last bucket, from about 2.2e12 ns on, takes anything larger.
+ */
+#define PS_LATENCY_BUCKETS 320
+
+/**
+ * @brief I/O counters of a socket, or of all sockets of a thread or the process.
+ *
+ * Calls count the system calls made to move data, successful or not; memory sockets make none and only count
+ * bytes and packets. A packet is a datagram, or one read or send call on a stream.
+ */
+typedef struct {
+  uint64_t bytes_read;          /**< Bytes received. */
+  uint64_t bytes_sent;          /**< Bytes sent. */
+  uint64_t packets_read;        /**< Packets received. */
+  uint64_t packets_sent;        /**< Packets sent. */
+  uint64_t read_calls;          /**< System calls made to receive. */
+  uint64_t send_calls;          /**< System calls made to send. */
+  uint64_t read_wouldblocks;    /**< Receiving calls that failed because no data was ready. */
+  uint64_t send_wouldblocks;    /**< Sending calls that failed because the send buffer was full. */
+} ps_socket_stats_t;
+
+/**
+ * @brief Histogram of system call latencies in nanoseconds.
+ */
+typedef struct {
+  uint64_t count;               /**< Latencies recorded. */
+  uint64_t total_ns;            /**< Sum of the latencies, for the mean. */
+  uint64_t max_ns;              /**< Highest latency. */
+  uint64_t buckets[PS_LATENCY_BUCKETS]; /**< Latencies per bucket, see `PS_LATENCY_BUCKETS`. */
+} ps_latency_histogram_t;
+
+/**
+ * @brief I/O statistics of a thread or of the process, with the latencies of receiving and sending system calls.
+ */
+typedef struct {
+  ps_socket_stats_t io;                 /**< Counters summed over the sockets. */
+  ps_latency_histogram_t read_latency;  /**< Latencies of receiving calls. */
+  ps_latency_histogram_t send_latency;  /**< Latencies of sending calls. */
+} ps_stats_t;
+
+/**
+ * @brief Gets the I/O counters of a socket.
+ *
+ * Statistics are kept unless the library is built with `PURRSOCK_STATS` off. Counters are updated without
+ * locks, so a snapshot taken while another thread does I/O on the socket may lag that I/O slightly.
+ *
+ * @param socket The socket to query.
+ * @param stats Pointer to a structure that receives the counters.
+ * @return PS_SUCCESS, or PS_ERROR_UNSUPPORTED if statistics are compiled out; `stats` is zeroed then.
+ */
+ps_result_t ps_get_socket_stats(ps_socket_t socket, ps_socket_stats_t *stats);
+
+/**
+ * @brief Gets the I/O statistics of the whole process.
+ *
+ * Every thread that does I/O records into its own shard without locks; this sums the shards, including
+ * those of threads that have exited.
+ *
+ * @param stats Pointer to a structure that receives the statistics.
+ * @return PS_SUCCESS, or PS_ERROR_UNSUPPORTED if statistics are compiled out; `stats` is zeroed then.
+ */
+ps_result_t ps_get_stats(ps_stats_t *stats);
+
+/**
+ * @brief Gets the I/O statistics of the thread that runs a loop.
+ *
+ * These are the statistics of the thread that last ran the loop, so they cover other loops and blocking
+ * I/O of the same thread too. A loop that never ran has none.
+ *
+ * @param loop The loop to query.
+ * @param stats Pointer to a structure that receives the statistics.
+ * @return PS_SUCCESS, or PS_ERROR_UNSUPPORTED if statistics are compiled out; `stats` is zeroed then.
+ */
+ps_result_t ps_get_loop_stats(ps_loop_t loop, ps_stats_t *stats);
+
+/**
+ * @brief Gets a percentile of a latency histogram.
+ *
+ * @param histogram The histogram to query.
+ * @param percentile The percentile, from 0 to 100 (e.g. 99.9).
+ * @return The highest latency in nanoseconds of the bucket holding the percentile, at most `max_ns`; 0 if the
+ *         histogram is empty.
+ */
+uint64_t ps_latency_percentile(const ps_latency_histogram_t *histogram, double percentile);
+
+/**
+ * @brief Enum representing the instruction sets the `ps_scan_*` functions can run on.
+ */
+typedef enum {
+  PS_SCAN_SCALAR, /**< Portable code, one byte at a time. */
+  PS_SCAN_SSE42,  /**< 16 bytes at a time with SSE4.2 (and the SSSE3 it implies) on x86. */
+  PS_SCAN_AVX2,   /**< 32 bytes at a time with AVX2 on x86. */
+} ps_scan_isa_t;
+
+/**
+ * @brief Gets the instruction set the `ps_scan_*` functions use.
+ *
+ * `ps_init` picks the widest one the CPU and operating system support; until then the scalar code is used.
+ *
+ * @return The instruction set in use.
+ */
+ps_scan_isa_t ps_scan_get_isa(void);
+
+/**
+ * @brief Makes the `ps_scan_*` functions use another instruction set, e.g. to compare them.
+ *
+ * This also picks the code that masks and unmasks WebSocket payloads. Not thread-safe: call it while no
+ * other thread scans, which includes the HTTP server's workers.
+ *
+ * @param isa The instruction set to use.
+ * @return true if it is used now, false if this CPU or build does not support it.
+ */
+bool ps_scan_set_isa(ps_scan_isa_t isa);
+
+/**
+ * @brief Finds the first occurrence of a byte sequence, e.g. "\r\n".
+ *
+ * @param buf The bytes to search.
+ * @param size Number of bytes in `buf`.
+ * @param needle The sequence to find.
+ * @param needle_size Number of bytes in `needle`, at least 1.
+ * @return Offset of the first complete occurrence, or `size` if there is none.
+ */
+size_t ps_scan_find(const char *buf, size_t size, const char *needle, size_t needle_size);
+
+/**
+ * @brief Finds the end of a token, such as an HTTP method or header field name.
+ *
+ * Token characters are the letters, digits and "!#$%&'*+-.^_`|~" (RFC 9110 5.6.2).
+ *
+ * @param buf The bytes to search.
+ * @param size Number of bytes in `buf`.
+ * @return Offset of the first byte that is not a token character, e.g. the ':' after a field name, or `size`.
+ */
+size_t ps_scan_token(const char *buf, size_t size);
+
+/**
+ * @brief Finds the end of an HTTP field value.
+ *
+ * Field values may hold any byte but the control characters other than horizontal tab (RFC 9110 5.5), so the
+ * search stops at the CR ending the line as well as at a bare LF or NUL that a valid value cannot contain.
+ *
+ * @param buf The bytes to search.
+ * @param size Number of bytes in `buf`.
+ * @return Offset of the first control character other than HTAB (0x00-0x08, 0x0a-0x1f or 0x7f), or `size`.
+ */
+size_t ps_scan_field_value(const char *buf, size_t size);
+
+/**
+ * @brief Most header fields a request may carry; requests with more are answered with 431.
+ */
+#define PS_HTTP_MAX_HEADERS 64
+
+/**
+ * @brief A string inside a request, not NUL-terminated.
+ */
+typedef struct {
+  const char *buf;   /**< First character. */
+  size_t size;       /**< Length in bytes. */
+} ps_http_string_t;
+
+/**
+ * @brief A header field of a request.
+ */
+typedef struct {
+  ps_http_string_t name;   /**< Field name as sent; compare it without regard to case. */
+  ps_http_string_t value;  /**< Field value without surrounding whitespace. */
+} ps_http_header_t;
+
+/**
+ * @brief An HTTP/1.x request passed to a handler.
+ *
+ * All strings point into the connection's receive buffer and are only valid during the handler call.
+ */
+typedef struct {
+  ps_http_string_t method;     /**< Method, e.g. "GET". */
+  ps_http_string_t target;     /**< Request target as sent, e.g. "/search?q=cat". */
+  ps_http_string_t path;       /**< Target up to the query. */
+  ps_http_string_t query;      /**< Target after the '?', empty if there is none. */
+  int minor_version;           /**< 1 for HTTP/1.1, 0 for HTTP/1.0. */
+  ps_http_header_t headers[PS_HTTP_MAX_HEADERS]; /**< Header fields in the order they were sent. */
+  size_t header_count;         /**< Number of header fields. */
+  ps_http_string_t body;       /**< Body, already decoded if it was sent with chunked transfer coding. */
+  bool keep_alive;             /**< Whether the connection stays open after the response. */
+} ps_http_request_t;
+
+/**
+ * @brief Looks up a header field of a request by name, without regard to case.
+ *
+ * @param request The request to search.
+ * @param name The field name, e.g. "Content-Type".
+ * @param value Pointer to a string that receives the value of the first matching field (optional).
+ * @return `true` if the request has the field.
+ */
+bool ps_http_request_header(const ps_http_request_t *request, const char *name, ps_http_string_t *value);
+
+/**
+ * @brief Opaque structure building the response to the request being handled.
+ */
+typedef struct ps_http_response_s *ps_http_response_t;
+
+/**
+ * @brief Handler of the requests matching a route.
+ *
+ * Handlers run on the worker thread that owns the connection and must finish the response before they return,
+ * with `ps_http_response_send`, `ps_http_response_send_file` or a series of `ps_http_response_write` calls; a
+ * response left unfinished is ended with what was written so far, or an empty body.
+ *
+ * @param request The request.
+ * @param response The response to fill in.
+ * @param user_data The user data registered with the route.
+ */
+typedef void (*ps_http_handler_t)(const ps_http_request_t *request, ps_http_response_t response, void *user_data);
+
+/**
+ * @brief Options used to create an HTTP server.
+ */
+typedef struct {
+  size_t workers;                  /**< Worker threads, each with its own listener and loop; 0 for one per CPU. */
+  bool pin_workers;                /**< Pin worker `i` to CPU `i` modulo the CPU count. */
+  ps_loop_options_t loop_options;  /**< Options of every worker's loop. */
+  size_t max_header_size;          /**< Largest request line and header section, 0 for 8 KiB. Larger heads get 431. */
+  size_t max_body_size;            /**< Largest request body, 0 for 1 MiB. Larger bodies get 413. */
+  uint32_t idle_timeout_ms;        /**< Connections that complete no request for this long are closed, 0 for 10 s. */
+  const char *server_name;         /**< Value of the Server header, NULL for "purrsock", "" for none. */
+} ps_http_server_options_t;
+
+/**
+ * @brief Opaque structure representing an HTTP/1.1 server running on the event loops of a `ps_server_t`.
+ *
+ * Requests are parsed in place as they arrive: a request head is scanned once however many reads it takes,
+ * bodies are decoded inside the receive buffer, and handlers see views into it. Connections are kept alive
+ * and pipelined requests are answered in order, with all responses to one read going out in a single send.
+ * Status lines are preformatted and the Date header is formatted once per second per worker.
+ */
+typedef struct ps_http_server_s *ps_http_server_t;
+
+/**
+ * @brief Creates an HTTP server listening on `ip` and `port`. Requests are answered once the server is started.
+ *
+ * @param server Pointer to a variable that will hold the created server.
+ * @param address The address family to listen on.
+ * @param ip The IP address to listen on.
+ * @param port The port to listen on, 0 for a free one; see `ps_http_server_get_port`.
+ * @param options The server options, or NULL for the defaults.
+ * @return A `ps_result_t` result code indicating the success or failure of the operation.
+ */
+ps_result_t ps_create_http_server(ps_http_server_t *server, ps_address_t address, const char *ip, ps_port_t port, const ps_http_server_options_t *options);
+
+/**
+ * @brief Stops the server if it is running, closes its connections and destroys it.
+ *
+ * @param server The server to destroy.
+ */
+void ps_destroy_http_server(ps_http_server_t server);
+
+/**
+ * @brief Routes requests for `path` to `handler`. Routes must be added before the server is started.
+ *
+ * A path ending in '*' matches every path starting with the rest, the longest such prefix winning; other
+ * paths match exactly, ignoring the query. HEAD requests fall back to GET routes and get the response
+ * without its body. Requests no route matches are answered with 404, or 405 if only the method differs.
+ *
+ * @param server The server to add the route to.
+ * @param method The method to match, e.g. "GET", or NULL for any.
+ * @param path The path to match, starting with '/'.
+ * @param handler The handler of matching requests.
+ * @param user_data User data passed to the handler.
+ * @return A `ps_result_t` result code; `PS_ERROR_INVALID_ARGUMENT` for a route that already exists.
+ */
+ps_result_t ps_http_route(ps_http_server_t server, const char *method, const char *path, ps_http_handler_t handler, void *user_data);
+
+/**
+ * @brief Starts the worker threads.
+ *
+ * @param server The server to start.
+ * @return A `ps_result_t` result code indicating the success or failure of the operation.
+ */
+ps_result_t ps_http_server_start(ps_http_server_t server);
+
+/**
+ * @brief Stops the worker threads. Open connections stay open and are served again once the server is restarted.
+ *
+ * @param server The server to stop.
+ * @return `PS_SUCCESS`, or the error a worker loop stopped with.
+ */
+ps_result_t ps_http_server_stop(ps_http_server_t server);
+
+/**
+ * @brief Returns the port the server listens on.
+ *
+ * @param server The server to query.
+ * @return The port.
+ */
+ps_port_t ps_http_server_get_port(ps_http_server_t server);
+
+/**
+ * @brief Sets the status code of a response, 200 unless set. Must be called before any of the body is written.
+ *
+ * @param response The response to modify.
+ * @param status The status code, from 200 to 999.
+ * @return A `ps_result_t` result code; `PS_ERROR_INVALID_ARGUMENT` once the head was sent.
+ */
+ps_result_t ps_http_response_set_status(ps_http_response_t response, int status);
+
+/**
+ * @brief Adds a header field to a response. Must be called before any of the body is written.
+ *
+ * Content-Length, Transfer-Encoding and Connection are managed by the server and cannot be added.
+ *
+ * @param response The response to modify.
+ * @param name The field name.
+ * @param value The field value.
+ * @return A `ps_result_t` result code; `PS_ERROR_INVALID_ARGUMENT` for a managed field, line breaks
+ *         in the name or value, or once the head was sent.
+ */
+ps_result_t ps_http_response_add_header(ps_http_response_t response, const char *name, const char *value);
+
+/**
+ * @brief Sends the response with `body` as its whole body, which finishes it.
+ *
+ * Large bodies are sent straight from `body` together with the buffered responses before them.
+ *
+ * @param response The response to send.
+ * @param body The body, possibly empty.
+ * @return A `ps_result_t` result code; `PS_ERROR_INVALID_ARGUMENT` if the response was already sent or written to.
+ */
+ps_result_t ps_http_response_send(ps_http_response_t response, ps_packet_t body);
+
+/**
+ * @brief Sends the response with a range of a regular file as its whole body, which finishes it.
+ *
+ * The body is sent straight from the file, as with `ps_send_file`, after the responses before it. When
+ * the client reads slowly the rest is sent as it makes room, and later requests on the connection are
+ * answered once the file is out.
+ *
+ * The response takes `fd` over and closes it once the body is sent or the connection closes, and also
+ * when the call fails. A failed call leaves the response unsent, so the handler can still answer otherwise.
+ *
+ * @param response The response to send.
+ * @param fd Descriptor of a regular file opened for reading.
+ * @param offset Offset in the file to start at.
+ * @param length Number of bytes to send, 0 to send up to the end of the file.
+ * @return A `ps_result_t` result code; `PS_ERROR_INVALID_ARGUMENT` if the response was already sent or
+ *         written to, `fd` is not a regular file, or the range goes past its end.
+ */
+ps_result_t ps_http_response_send_file(ps_http_response_t response, int fd, uint64_t offset, uint64_t length);
+
+/**
+ * @brief Sends the response with the regular file at `path` as its whole body; see `ps_http_response_send_file`.
+ *
+ * @param response The response to send.
+ * @param path Path of the file.
+ * @return A `ps_result_t` result code; `PS_ERROR_INVALID_ARGUMENT` if the file cannot be opened or is not a
+ *         regular file, in which case the response is left unsent.
+ */
+ps_result_t ps_http_response_send_file_path(ps_http_response_t response, const char *path);
+
+/**
+ * @brief Sends part of the body of a response whose length is not known in advance.
+ *
+ * The first call sends the head. HTTP/1.1 clients get the body in chunked transfer coding; for HTTP/1.0
+ * clients the body ends when the connection is closed.
+ *
+ * @param response The response to write to.
+ * @param data The next part of the body; empty parts are skipped.
+ * @return A `ps_result_t` result code; `PS_ERROR_INVALID_ARGUMENT` if the response was already finished.
+ */
+ps_result_t ps_http_response_write(ps_http_response_t response, ps_packet_t data);
+
+/**
+ * @brief Finishes a response started with `ps_http_response_write`.
+ *
+ * @param response The response to finish.
+ * @return A `ps_result_t` result code; `PS_ERROR_INVALID_ARGUMENT` if the response was already finished.
+ */
+ps_result_t ps_http_response_end(ps_http_response_t response);
+
+/**
+ * @brief Enum representing WebSocket frame opcodes (RFC 6455 5.2).
+ */
+typedef enum {
+  PS_WEBSOCKET_CONTINUATION = 0x0, /**< Later fragment of a message, see `ps_websocket_send_fragment`. */
+  PS_WEBSOCKET_TEXT = 0x1,         /**< Text message in UTF-8. */
+  PS_WEBSOCKET_BINARY = 0x2,       /**< Binary message. */
+  PS_WEBSOCKET_CLOSE = 0x8,        /**< Closing handshake. */
+  PS_WEBSOCKET_PING = 0x9,         /**< Ping; received pings are answered by the library. */
+  PS_WEBSOCKET_PONG = 0xa,         /**< Answer to a ping. */
+} ps_websocket_opcode_t;
+
+/**
+ * @brief Options used to create a WebSocket.
+ */
+typedef struct {
+  size_t max_message_size;   /**< Largest message accepted, fragments together, 0 for 16 MiB. */
+  size_t max_handshake_size; /**< Largest handshake request or response head, 0 for 8 KiB. */
+  size_t initial_capacity;   /**< Initial size of the receive buffer, 0 for 4 KiB. It grows to fit larger messages. */
+} ps_websocket_options_t;
+
+/**
+ * @brief A message or control frame returned by `ps_websocket_read`.
+ */
+typedef struct {
+  ps_websocket_opcode_t opcode; /**< `PS_WEBSOCKET_TEXT`, `PS_WEBSOCKET_BINARY`, `PS_WEBSOCKET_PONG` or `PS_WEBSOCKET_CLOSE`. */
+  ps_packet_t payload;          /**< The message with its fragments joined, the pong's data or the close reason. */
+  uint16_t close_code;          /**< Status code of a close frame, 1005 if it had none. */
+} ps_websocket_message_t;
+
+/**
+ * @brief Opaque structure speaking the WebSocket protocol (RFC 6455) over a TCP socket.
+ *
+ * Frames are parsed and unmasked in place in the receive buffer, with vector instructions where the CPU has
+ * them, and fragments are joined there too, so receiving allocates nothing once the buffer fits the largest
+ * message. Frames are sent with the header and payload in one call; only clients, which have to mask what
+ * they send, copy the payload. Sending never waits on a non-blocking socket: what does not fit is queued and
+ * sent by `ps_websocket_flush` once the socket is writable. A WebSocket is not thread-safe.
+ */
+typedef struct ps_websocket_s *ps_websocket_t;
+
+/**
+ * @brief Creates the server side of a WebSocket on a connection accepted from a client.
+ *
+ * The socket remains owned by the caller and must outlive the WebSocket. The opening handshake is performed
+ * by `ps_websocket_handshake`.
+ *
+ * @param websocket Pointer to a variable that will hold the created WebSocket.
+ * @param socket The connected TCP socket.
+ * @param options The options, or NULL for the defaults.
+ * @return A `ps_result_t` result code indicating the success or failure of the operation.
+ */
+ps_result_t ps_create_websocket_server(ps_websocket_t *websocket, ps_socket_t socket, const ps_websocket_options_t *options);
+
+/**
+ * @brief Creates the client side of a WebSocket on a connection to a server.
+ *
+ * The socket remains owned by the caller and must outlive the WebSocket. The opening handshake is performed
+ * by `ps_websocket_handshake`.
+ *
+ * @param websocket Pointer to a variable that will hold the created WebSocket.
+ * @param socket The connected TCP socket.
+ * @param host Value of the Host header, e.g. "example.com:8080".
+ * @param path Request target of the handshake, e.g. "/feed"; copied on creation.
+ * @param options The options, or NULL for the defaults.
+ * @return A `ps_result_t` result code; `PS_ERROR_INVALID_ARGUMENT` for a path not starting with '/' or line
+ *         breaks in the host or path.
+ */
+ps_result_t ps_create_websocket_client(ps_websocket_t *websocket, ps_socket_t socket, const char *host, const char *path, const ps_websocket_options_t *options);
+
+/**
+ * @brief Destroys a WebSocket without a closing handshake. The socket itself is not destroyed.
+ *
+ * @param websocket The WebSocket to destroy.
+ */
+void ps_destroy_websocket(ps_websocket_t websocket);
+
+/**
+ * @brief Performs the opening handshake.
+ *
+ * A server reads the upgrade request and answers it with 101 Switching Protocols, or with 400 (426 for an
+ * unsupported version) if it is not a valid WebSocket request. A client sends the request and checks the
+ * answer. On a non-blocking socket `PS_ERROR_WOULDBLOCK` is returned until the handshake is complete, so it is
+ * called again whenever the socket becomes readable. Frames that arrive along with the handshake are kept
+ * for `ps_websocket_read`. A server's answer that did not fit in the socket is queued like a frame. A client's
+ * request that did not fit is queued too, and each call sends what it can of it first: while
+ * `ps_websocket_get_unsent` is not 0, call again once the socket is writable rather than readable.
+ *
+ * @param websocket The WebSocket.
+ * @return A `ps_result_t` result code; `PS_ERROR_PROTOCOL` if the peer's handshake is invalid and
+ *         `PS_ERROR_MSGTOOLONG` if it exceeds `max_handshake_size`.
+ */
+ps_result_t ps_websocket_handshake(ps_websocket_t websocket);
+
+/**
+ * @brief Gets the request target of the handshake, e.g. "/feed?topic=cpu".
+ *
+ * @param websocket The WebSocket.
+ * @return The target the client asked for, or NULL on a server before the handshake is complete.
+ */
+const char *ps_websocket_get_path(ps_websocket_t websocket);
+
+/**
+ * @brief Returns the next message, pong or close frame, reading from the socket as needed.
+ *
+ * `message->payload.buf` points into the WebSocket's buffer and stays valid until the next call on it. Pings
+ * are answered with a pong and not returned. A close frame is answered with one, unless `ps_websocket_close`
+ * sent one first, and returned; after it every call returns `PS_CONNCLOSED`, and the socket can be closed.
+ * On a non-blocking socket `PS_ERROR_WOULDBLOCK` is returned once no complete message is buffered and the
+ * socket is drained, so an edge-triggered loop calls it until then.
+ *
+ * Frames that break the protocol, unmasked frames from a client, masked frames from a server and text that
+ * is not UTF-8 fail with `PS_ERROR_PROTOCOL`, and messages over `max_message_size` with `PS_ERROR_MSGTOOLONG`,
+ * after a close frame with the matching status code was sent. The WebSocket is unusable after an error.
+ *
+ * @param websocket The WebSocket to read from; the handshake must be complete.
+ * @param message Pointer to a structure that receives the message.
+ * @return A `ps_result_t` result code; `PS_CONNCLOSED` once the peer closed the stream or the connection.
+ */
+ps_result_t ps_websocket_read(ps_websocket_t websocket, ps_websocket_message_t *message);
+
+/**
+ * @brief Sends a whole message or a control frame.
+ *
+ * On a non-blocking socket the part of the frame the socket has no room for is queued behind any frames
+ * queued before and `PS_SUCCESS` is returned; see `ps_websocket_flush`.
+ *
+ * @param websocket The WebSocket to send through; the handshake must be complete.
+ * @param opcode `PS_WEBSOCKET_TEXT`, `PS_WEBSOCKET_BINARY`, `PS_WEBSOCKET_PING` or `PS_WEBSOCKET_PONG`.
+ * @param payload The message; at most 125 bytes for control frames. Text is not checked to be UTF-8.
+ * @return A `ps_result_t` result code; `PS_ERROR_INVALID_ARGUMENT` for another opcode, an oversized control
+ *         frame or while a fragmented message is being sent, `PS_ERROR_SHUTDOWN` once a close frame was sent.
+ */
+ps_result_t ps_websocket_send(ps_websocket_t websocket, ps_websocket_opcode_t opcode, ps_packet_t payload);
+
+/**
+ * @brief Sends one fragment of a message whose length is not known in advance.
+ *
+ * The first fragment carries `PS_WEBSOCKET_TEXT` or `PS_WEBSOCKET_BINARY`, the later ones
+ * `PS_WEBSOCKET_CONTINUATION`; `final` marks the last one. Control frames may be sent between fragments.
+ *
+ * @param websocket The WebSocket to send through; the handshake must be complete.
+ * @param opcode The opcode of the fragment.
+ * @param payload The fragment, possibly empty.
+ * @param final Whether this fragment ends the message.
+ * @return A `ps_result_t` result code; `PS_ERROR_INVALID_ARGUMENT` for fragments out of order,
+ *         `PS_ERROR_SHUTDOWN` once a close frame was sent.
+ */
+ps_result_t ps_websocket_send_fragment(ps_websocket_t websocket, ps_websocket_opcode_t opcode, ps_packet_t payload, bool final);
+
+/**
+ * @brief Starts the closing handshake by sending a close frame.
+ *
+ * Nothing can be sent afterwards. Reading goes on until the peer's close frame arrives.
+ *
+ * @param websocket The WebSocket to close; the handshake must be complete.
+ * @param code The status code, e.g. 1000 for a normal closure, or 0 to send none.
+ * @param reason Reason in UTF-8, or NULL; at most 123 bytes.
+ * @return A `ps_result_t` result code; `PS_ERROR_INVALID_ARGUMENT` for a reason that is too long or a
+ *         reason without a code, `PS_ERROR_SHUTDOWN` if a close frame was already sent.
+ */
+ps_result_t ps_websocket_close(ps_websocket_t websocket, uint16_t code, const char *reason);
+
+/**
+ * @brief Sends the frames queued while the socket was full, without blocking a non-blocking socket.
+ *
+ * Every send and read flushes them first. Callers call this from the socket's `on_write` callback, and
+ * before closing the socket, until it returns `PS_SUCCESS`.
+ *
+ * @param websocket The WebSocket to flush.
+ * @return `PS_SUCCESS` once nothing is queued, `PS_ERROR_WOULDBLOCK` if the socket is full again.
+ */
+ps_result_t ps_websocket_flush(ps_websocket_t websocket);
+
+/**
+ * @brief Returns how many bytes of frames are queued, see `ps_websocket_flush`.
+ */
+size_t ps_websocket_get_unsent(ps_websocket_t websocket);
+
 #endif // PURRSOCK_H_
@@ -0,0 +1,538 @@
+// Copyright (c) 2024 ClawsoftSolutions. All rights reserved.
+//
+// This software is licensed under the MIT License.
+// See LICENSE file for more information.
+//
+
+
+
+#include "internal.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#define PS_CONN_POOL_DEFAULT_MAX_IDLE 8
+#define PS_CONN_POOL_DEFAULT_MAX_HOSTS 64
+#define PS_CONN_POOL_IP_SIZE 64
+
+// Idle connections of a destination sit in a fixed array of `max_idle` cells, linked into two lock-free
+// (Treiber) stacks: the idle stack, whose top is the most recently checked in connection, and the stack of free
+// cells. Checkout takes the top, so the fewest connections stay warm and the surplus ages at the bottom until
+// it expires. A checkin that finds no free cell closes its connection instead of waiting for one.
+// Each stack head packs the top cell's index plus one (0 when empty) with a counter bumped by every change,
+// so a head popped and pushed back in between fails the compare-and-swap instead of corrupting the list.
+
+typedef struct {
+  _purrsock_socket_t *socket;
+  uint64_t idle_since;             // Monotonic milliseconds of the checkin.
+  uint32_t next;                   // Index plus one of the cell below, read racily by concurrent pops.
+} _purrsock_idle_cell_t;
+
+struct _purrsock_conn_pool_key_s {
+  _purrsock_conn_pool_t *pool;
+  uint64_t hash;
+  ps_protocol_t protocol;
+  ps_port_t port;
+
+  _purrsock_idle_cell_t *cells;    // `max_idle` cells, each on exactly one of the stacks or held by a thread.
+  uint64_t idle_top;               // Tagged head of the idle stack.
+  uint64_t free_top;               // Tagged head of the free stack.
+  size_t idle;                     // Connections idle; raised before a push and lowered after a pop, so never short.
+
+  size_t open;                     // Connections idle or checked out.
+  size_t waiters;                  // Checkouts waiting for a connection at the limit.
+  _purrsock_mutex_t mutex;         // Only taken to wait and to wake waiters up.
+  _purrsock_cond_t available;
+  char host[];                     // Host name or address as passed to checkout, resolved for every new connection.
+};
+
+struct _purrsock_conn_pool_s {
+  ps_conn_pool_options_t options;
+  _purrsock_mutex_t lock;          // Serializes adding destinations.
+  _purrsock_conn_pool_key_t **keys; // Open addressing at most half full; a slot only ever goes from NULL to a key.
+  size_t key_mask;
+  size_t key_count;
+  ps_conn_pool_stats_t stats;      // Counters, updated atomically; `idle` and `active` are computed.
+};
+
+static void _purrsock_conn_pool_count(uint64_t *counter, uint64_t value) {
+  __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+// Pops the top cell of a stack, returning its index plus one, or 0 if the stack is empty.
+static uint32_t _purrsock_stack_pop(_purrsock_conn_pool_key_t *key, uint64_t *top) {
+  uint64_t head = __atomic_load_n(top, __ATOMIC_ACQUIRE);
+  while ((uint32_t)head) {
+    // `next` may be stale if the cell was popped meanwhile; the counter then fails the swap.
+    uint32_t next = __atomic_load_n(&key->cells[(uint32_t)head - 1].next, __ATOMIC_RELAXED);
+    uint64_t popped = (((head >> 32) + 1) << 32) | next;
+    if (__atomic_compare_exchange_n(top, &head, popped, true, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) return (uint32_t)head;
+  }
+  return 0;
+}
+
+// Pushes a cell the caller holds; the release publishes what the caller wrote into it.
+static void _purrsock_stack_push(_purrsock_conn_pool_key_t *key, uint64_t *top, uint32_t cell) {
+  uint64_t head = __atomic_load_n(top, __ATOMIC_RELAXED);
+  do {
+    __atomic_store_n(&key->cells[cell - 1].next, (uint32_t)head, __ATOMIC_RELAXED);
+  } while (!__atomic_compare_exchange_n(top, &head, (((head >> 32) + 1) << 32) | cell, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+// Adds a connection on top of the idle stack, returning false if every cell is taken.
+static bool _purrsock_idle_push(_purrsock_conn_pool_key_t *key, _purrsock_socket_t *socket, uint64_t idle_since) {
+  uint32_t cell = _purrsock_stack_pop(key, &key->free_top);
+  if (!cell) return false;
+  key->cells[cell - 1].socket = socket;
+  key->cells[cell - 1].idle_since = idle_since;
+  __atomic_fetch_add(&key->idle, 1, __ATOMIC_RELAXED);
+  _purrsock_stack_push(key, &key->idle_top, cell);
+  return true;
+}
+
+// Takes the most recently checked in connection.
+static bool _purrsock_idle_pop(_purrsock_conn_pool_key_t *key, _purrsock_socket_t **socket, uint64_t *idle_since) {
+  uint32_t cell = _purrsock_stack_pop(key, &key->idle_top);
+  if (!cell) return false;
+  __atomic_fetch_sub(&key->idle, 1, __ATOMIC_RELAXED);
+  *socket = key->cells[cell - 1].socket;
+  *idle_since = key->cells[cell - 1].idle_since;
+  _purrsock_stack_push(key, &key->free_top, cell);
+  return true;
+}
+
+static size_t _purrsock_idle_count(_purrsock_conn_pool_key_t *key) {
+  return __atomic_load_n(&key->idle, __ATOMIC_ACQUIRE);
+}
+
+static size_t _purrsock_round_up_pow2(size_t value) {
+  size_t capacity = 1;
+  while (capacity < value) capacity <<= 1;
+  return capacity;
+}
+
+static uint64_t _purrsock_conn_pool_hash(const char *host, ps_port_t port, ps_protocol_t protocol) {
+  // FNV-1a.
+  uint64_t hash = 14695981039346656037ULL;
+  for (const char *c = host; *c; ++c) hash = (hash ^ (uint8_t)*c) * 1099511628211ULL;
+  hash = (hash ^ port) * 1099511628211ULL;
+  hash = (hash ^ (uint64_t)protocol) * 1099511628211ULL;
+  return hash;
+}
+
+static _purrsock_conn_pool_key_t *_purrsock_conn_pool_find(_purrsock_conn_pool_t *pool, const char *host, ps_port_t port, ps_protocol_t protocol, uint64_t hash) {
+  for (size_t i = hash & pool->key_mask;; i = (i + 1) & pool->key_mask) {
+    _purrsock_conn_pool_key_t *key = __atomic_load_n(&pool->keys[i], __ATOMIC_ACQUIRE);
+    if (!key) return NULL;
+    if (key->hash == hash && key->port == port && key->protocol == protocol && !strcmp(key->host, host)) return key;
+  }
+}
+
+static void _purrsock_conn_pool_destroy_key(_purrsock_conn_pool_key_t *key) {
+  _purrsock_socket_t *socket;
+  uint64_t idle_since;
+  while (_purrsock_idle_pop(key, &socket, &idle_since)) {
+    _purrsock_destroy_socket(socket);
+    free(socket);
+  }
+  _purrsock_cond_destroy(&key->available);
+  _purrsock_mutex_destroy(&key->mutex);
+  free(key->cells);
+  free(key);
+}
+
+static ps_result_t _purrsock_conn_pool_get_key(_purrsock_conn_pool_t *pool, const char *host, ps_port_t port, ps_protocol_t protocol, _purrsock_conn_pool_key_t **out_key) {
+  uint64_t hash = _purrsock_conn_pool_hash(host, port, protocol);
+  *out_key = _purrsock_conn_pool_find(pool, host, port, protocol, hash);
+  if (*out_key) return PS_SUCCESS;
+  if (!*host) return PS_ERROR_INVALID_ARGUMENT;
+
+  _purrsock_mutex_lock(&pool->lock);
+  _purrsock_conn_pool_key_t *key = _purrsock_conn_pool_find(pool, host, port, protocol, hash);
+  if (key) {
+    _purrsock_mutex_unlock(&pool->lock);
+    *out_key = key;
+    return PS_SUCCESS;
+  }
+  // Lookups hold on to keys without a lock, so destinations are never dropped: a full table turns new ones away.
+  if (pool->key_count == pool->options.max_hosts) {
+    _purrsock_mutex_unlock(&pool->lock);
+    return PS_ERROR_WOULDBLOCK;
+  }
+
+  size_t host_size = strlen(host) + 1;
+  key = (_purrsock_conn_pool_key_t *)calloc(1, sizeof(*key) + host_size);
+  _purrsock_idle_cell_t *cells = key ? (_purrsock_idle_cell_t *)calloc(pool->options.max_idle, sizeof(*cells)) : NULL;
+  if (!key || !cells) {
+    _purrsock_mutex_unlock(&pool->lock);
+    free(key);
+    return PS_ERROR_INTERNAL;
+  }
+  key->pool = pool;
+  key->hash = hash;
+  key->protocol = protocol;
+  key->port = port;
+  key->cells = cells;
+  for (size_t i = 0; i < pool->options.max_idle; ++i) cells[i].next = (uint32_t)i;
+  key->free_top = pool->options.max_idle;
+  _purrsock_mutex_init(&key->mutex);
+  _purrsock_cond_init(&key->available);
+  memcpy(key->host, host, host_size);
+
+  size_t i = hash & pool->key_mask;
+  while (pool->keys[i]) i = (i + 1) & pool->key_mask;
+  __atomic_store_n(&pool->keys[i], key, __ATOMIC_RELEASE);
+  pool->key_count++;
+  _purrsock_mutex_unlock(&pool->lock);
+
+  *out_key = key;
+  return PS_SUCCESS;
+}
+
+ps_result_t _purrsock_create_conn_pool(_purrsock_conn_pool_t **out_pool, const ps_conn_pool_options_t *options) {
+  assert(out_pool);
+  _purrsock_conn_pool_t *pool = (_purrsock_conn_pool_t *)calloc(1, sizeof(*pool));
+  if (!pool) return PS_ERROR_INTERNAL;
+
+  if (options) pool->options = *options;
+  if (!pool->options.max_idle) pool->options.max_idle = PS_CONN_POOL_DEFAULT_MAX_IDLE;
+  if (!pool->options.max_hosts) pool->options.max_hosts = PS_CONN_POOL_DEFAULT_MAX_HOSTS;
+  // Cells are numbered in 32 bits, next to the counter of the stack heads.
+  if (pool->options.max_idle > UINT32_MAX) {
+    free(pool);
+    return PS_ERROR_INVALID_ARGUMENT;
+  }
+
+  size_t capacity = _purrsock_round_up_pow2(pool->options.max_hosts * 2);
+  pool->keys = (_purrsock_conn_pool_key_t **)calloc(capacity, sizeof(*pool->keys));
+  if (!pool->keys) {
+    free(pool);
+    return PS_ERROR_INTERNAL;
+  }
+  pool->key_mask = capacity - 1;
+  _purrsock_mutex_init(&pool->lock);
+
+  *out_pool = pool;
+  return PS_SUCCESS;
+}
+
+void _purrsock_destroy_conn_pool(_purrsock_conn_pool_t *pool) {
+  assert(pool);
+  for (size_t i = 0; i <= pool->key_mask; ++i) {
+    if (pool->keys[i]) _purrsock_conn_pool_destroy_key(pool->keys[i]);
+  }
+  _purrsock_mutex_destroy(&pool->lock);
+  free(pool->keys);
+  free(pool);
+}
+
+// Wakes a checkout waiting at the limit, after a connection was checked in or closed.
+static void _purrsock_conn_pool_wake(_purrsock_conn_pool_key_t *key) {
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (!__atomic_load_n(&key->waiters, __ATOMIC_RELAXED)) return;
+  _purrsock_mutex_lock(&key->mutex);
+  _purrsock_cond_signal(&key->available);
+  _purrsock_mutex_unlock(&key->mutex);
+}
+
+static void _purrsock_conn_pool_close(_purrsock_conn_pool_key_t *key, _purrsock_socket_t *socket) {
+  _purrsock_destroy_socket(socket);
+  free(socket);
+  __atomic_fetch_sub(&key->open, 1, __ATOMIC_RELAXED);
+  _purrsock_conn_pool_wake(key);
+}
+
+// A lookup a checkout started on the resolver's loop, and waits for.
+typedef struct {
+  _purrsock_resolver_t *resolver;
+  const char *host;
+  _purrsock_mutex_t mutex;
+  _purrsock_cond_t resolved;
+  bool done;
+  ps_result_t result;
+  ps_endpoint_t address;
+} _purrsock_conn_pool_lookup_t;
+
+static void _purrsock_conn_pool_lookup_done(_purrsock_conn_pool_lookup_t *lookup, ps_result_t result, const ps_endpoint_t *address) {
+  _purrsock_mutex_lock(&lookup->mutex);
+  lookup->result = result;
+  if (address) lookup->address = *address;
+  lookup->done = true;
+  _purrsock_cond_signal(&lookup->resolved);
+  _purrsock_mutex_unlock(&lookup->mutex);
+}
+
+static void _purrsock_conn_pool_on_resolve(ps_resolver_t resolver, ps_result_t result, const ps_endpoint_t *addresses, size_t count, void *user_data) {
+  (void)resolver;
+  if (result == PS_SUCCESS && !count) result = PS_ERROR_ADDRNOTAVAIL;
+  _purrsock_conn_pool_lookup_done((_purrsock_conn_pool_lookup_t *)user_data, result, result == PS_SUCCESS ? &addresses[0] : NULL);
+}
+
+// Runs on the resolver's loop.
+static void _purrsock_conn_pool_start_lookup(void *user_data) {
+  _purrsock_conn_pool_lookup_t *lookup = (_purrsock_conn_pool_lookup_t *)user_data;
+  ps_result_t result = _purrsock_resolve_async(lookup->resolver, lookup->host, _purrsock_conn_pool_on_resolve, lookup);
+  if (result != PS_SUCCESS) _purrsock_conn_pool_lookup_done(lookup, result, NULL);
+}
+
+// Looks the host up with the pool's resolver: a cached name costs a hash lookup, any other is queried on the
+// resolver's loop while the checkout sleeps.
+static ps_result_t _purrsock_conn_pool_resolve(_purrsock_conn_pool_key_t *key, ps_endpoint_t *address) {
+  _purrsock_resolver_t *resolver = (_purrsock_resolver_t *)key->pool->options.resolver;
+  size_t count;
+  ps_result_t result = _purrsock_resolver_lookup(resolver, key->host, address, 1, &count);
+  if (result != PS_ERROR_WOULDBLOCK) return result == PS_SUCCESS && !count ? PS_ERROR_ADDRNOTAVAIL : result;
+
+  _purrsock_conn_pool_lookup_t lookup = {0};
+  lookup.resolver = resolver;
+  lookup.host = key->host;
+  _purrsock_mutex_init(&lookup.mutex);
+  _purrsock_cond_init(&lookup.resolved);
+  result = _purrsock_loop_post(_purrsock_resolver_get_loop(resolver), _purrsock_conn_pool_start_lookup, &lookup);
+  if (result == PS_SUCCESS) {
+    _purrsock_mutex_lock(&lookup.mutex);
+    while (!lookup.done) _purrsock_cond_wait(&lookup.resolved, &lookup.mutex);
+    _purrsock_mutex_unlock(&lookup.mutex);
+    result = lookup.result;
+    *address = lookup.address;
+  }
+  _purrsock_cond_destroy(&lookup.resolved);
+  _purrsock_mutex_destroy(&lookup.mutex);
+  return result;
+}
+
+// Opens a connection the caller already counted in `open`.
+static ps_result_t _purrsock_conn_pool_connect(_purrsock_conn_pool_key_t *key, _purrsock_socket_t **out_socket) {
+  // Host names are looked up again for every connection, so the pool follows changes of their addresses.
+  const char *ip = key->host;
+  char resolved[PS_CONN_POOL_IP_SIZE];
+  ps_endpoint_t endpoint;
+  if (_purrsock_endpoint_from_addr(&endpoint, ip, key->port) != PS_SUCCESS) {
+    ps_result_t result;
+    if (key->pool->options.resolver) {
+      result = _purrsock_conn_pool_resolve(key, &endpoint);
+      if (result == PS_SUCCESS) result = _purrsock_endpoint_to_addr(&endpoint, resolved, sizeof(resolved));
+    } else {
+      result = _purrsock_resolve_host(key->host, resolved, sizeof(resolved));
+      if (result == PS_SUCCESS && _purrsock_endpoint_from_addr(&endpoint, resolved, key->port) != PS_SUCCESS) result = PS_ERROR_ADDRNOTAVAIL;
+    }
+    if (result != PS_SUCCESS) return result;
+    ip = resolved;
+  }
+
+  _purrsock_socket_t *socket = (_purrsock_socket_t *)calloc(1, sizeof(*socket));
+  if (!socket) return PS_ERROR_INTERNAL;
+  socket->protocol = key->protocol;
+  socket->addr_storage.ss_family = endpoint.family;
+
+  ps_result_t result = _purrsock_create_socket(socket);
+  if (result == PS_SUCCESS && key->pool->options.connect_timeout_ms) {
+    ps_socket_timeouts_t timeouts = {0};
+    timeouts.connect_ms = key->pool->options.connect_timeout_ms;
+    result = _purrsock_set_socket_timeouts(socket, &timeouts);
+  }
+  if (result == PS_SUCCESS) result = _purrsock_connect_socket(socket, ip, key->port);
+  if (result != PS_SUCCESS) {
+    _purrsock_destroy_socket(socket);
+    free(socket);
+    return result;
+  }
+
+  socket->pool_key = key;
+  *out_socket = socket;
+  return PS_SUCCESS;
+}
+
+// Claims a slot below `max_connections`, returning false at the limit.
+static bool _purrsock_conn_pool_reserve(_purrsock_conn_pool_key_t *key) {
+  size_t max_connections = key->pool->options.max_connections;
+  size_t open = __atomic_load_n(&key->open, __ATOMIC_RELAXED);
+  while (!max_connections || open < max_connections) {
+    if (__atomic_compare_exchange_n(&key->open, &open, open + 1, true, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) return true;
+  }
+  return false;
+}
+
+// Sleeps until a connection may have become available, returning false once the wait timed out.
+static bool _purrsock_conn_pool_wait(_purrsock_conn_pool_key_t *key, uint64_t wait_start_us) {
+  _purrsock_conn_pool_t *pool = key->pool;
+  uint32_t timeout_ms = pool->options.wait_timeout_ms;
+  bool available = true;
+
+  _purrsock_mutex_lock(&key->mutex);
+  __atomic_fetch_add(&key->waiters, 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  // Checked after announcing the wait: a checkin or close from now on signals under the mutex.
+  if (!_purrsock_idle_count(key) && __atomic_load_n(&key->open, __ATOMIC_RELAXED) >= pool->options.max_connections) {
+    if (!timeout_ms) {
+      _purrsock_cond_wait(&key->available, &key->mutex);
+    } else {
+      uint64_t elapsed_ms = (_purrsock_monotonic_us() - wait_start_us) / 1000;
+      available = elapsed_ms < timeout_ms && _purrsock_cond_timed_wait(&key->available, &key->mutex, timeout_ms - (uint32_t)elapsed_ms);
+    }
+  }
+  __atomic_fetch_sub(&key->waiters, 1, __ATOMIC_RELAXED);
+  _purrsock_mutex_unlock(&key->mutex);
+  return available;
+}
+
+ps_result_t _purrsock_conn_pool_checkout(_purrsock_conn_pool_t *pool, const char *host, ps_port_t port, ps_protocol_t protocol, _purrsock_socket_t **out_socket) {
+  assert(pool && host && out_socket);
+  _purrsock_conn_pool_key_t *key;
+  ps_result_t result = _purrsock_conn_pool_get_key(pool, host, port, protocol, &key);
+  if (result != PS_SUCCESS) return result;
+
+  uint32_t idle_timeout_ms = pool->options.idle_timeout_ms;
+  uint64_t wait_start_us = 0;
+  while (1) {
+    _purrsock_socket_t *socket;
+    uint64_t idle_since;
+    if (_purrsock_idle_pop(key, &socket, &idle_since)) {
+      if (idle_timeout_ms && _purrsock_monotonic_ms() - idle_since >= idle_timeout_ms) {
+        _purrsock_conn_pool_count(&pool->stats.evictions, 1);
+        _purrsock_conn_pool_close(key, socket);
+        continue;
+      }
+      if (!_purrsock_socket_is_idle_alive(socket)) {
+        _purrsock_conn_pool_count(&pool->stats.failed_checks, 1);
+        _purrsock_conn_pool_close(key, socket);
+        continue;
+      }
+      _purrsock_conn_pool_count(&pool->stats.hits, 1);
+      *out_socket = socket;
+      break;
+    }
+
+    if (_purrsock_conn_pool_reserve(key)) {
+      result = _purrsock_conn_pool_connect(key, out_socket);
+      if (result != PS_SUCCESS) {
+        _purrsock_conn_pool_count(&pool->stats.connect_failures, 1);
+        __atomic_fetch_sub(&key->open, 1, __ATOMIC_RELAXED);
+        _purrsock_conn_pool_wake(key);
+        break;
+      }
+      _purrsock_conn_pool_count(&pool->stats.misses, 1);
+      break;
+    }
+
+    if (!wait_start_us) {
+      wait_start_us = _purrsock_monotonic_us();
+      _purrsock_conn_pool_count(&pool->stats.waits, 1);
+    }
+    if (!_purrsock_conn_pool_wait(key, wait_start_us)) {
+      _purrsock_conn_pool_count(&pool->stats.timeouts, 1);
+      result = PS_ERROR_TIMEOUT;
+      break;
+    }
+  }
+
+  if (wait_start_us) {
+    uint64_t waited = _purrsock_monotonic_us() - wait_start_us;
+    _purrsock_conn_pool_count(&pool->stats.wait_time_us, waited);
+    uint64_t max_waited = __atomic_load_n(&pool->stats.max_wait_time_us, __ATOMIC_RELAXED);
+    while (waited > max_waited &&
+           !__atomic_compare_exchange_n(&pool->stats.max_wait_time_us, &max_waited, waited, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+  }
+  if (result == PS_SUCCESS) _purrsock_conn_pool_count(&pool->stats.checkouts, 1);
+  return result;
+}
+
+// Keeps an idle connection, or closes it if `max_idle` are idle already.
+static void _purrsock_conn_pool_keep(_purrsock_conn_pool_key_t *key, _purrsock_socket_t *socket, uint64_t idle_since) {
+  if (_purrsock_idle_push(key, socket, idle_since)) {
+    _purrsock_conn_pool_wake(key);
+  } else {
+    _purrsock_conn_pool_count(&key->pool->stats.evictions, 1);
+    _purrsock_conn_pool_close(key, socket);
+  }
+}
+
+void _purrsock_conn_pool_checkin(_purrsock_conn_pool_t *pool, _purrsock_socket_t *socket, bool reusable) {
+  assert(pool && socket && socket->pool_key && socket->pool_key->pool == pool && !socket->loop);
+  _purrsock_conn_pool_key_t *key = socket->pool_key;
+
+  if (!reusable) {
+    _purrsock_conn_pool_close(key, socket);
+    return;
+  }
+  _purrsock_conn_pool_keep(key, socket, _purrsock_monotonic_ms());
+}
+
+static void _purrsock_conn_pool_maintain_key(_purrsock_conn_pool_key_t *key) {
+  _purrsock_conn_pool_t *pool = key->pool;
+  uint64_t now = _purrsock_monotonic_ms();
+
+  // Each connection idle at the start is taken and looked at once. Survivors go back oldest first, so they
+  // keep their order, though above connections checked in meanwhile.
+  size_t count = _purrsock_idle_count(key);
+  _purrsock_idle_cell_t *survivors = count ? (_purrsock_idle_cell_t *)malloc(count * sizeof(*survivors)) : NULL;
+  size_t survivor_count = 0;
+  for (size_t i = 0; i < count && survivors; ++i) {
+    _purrsock_socket_t *socket;
+    uint64_t idle_since;
+    if (!_purrsock_idle_pop(key, &socket, &idle_since)) break;
+
+    if (pool->options.idle_timeout_ms && now - idle_since >= pool->options.idle_timeout_ms) {
+      _purrsock_conn_pool_count(&pool->stats.evictions, 1);
+      _purrsock_conn_pool_close(key, socket);
+    } else if (!_purrsock_socket_is_idle_alive(socket) ||
+               (pool->options.health_check && !pool->options.health_check((ps_socket_t)socket, pool->options.user_data))) {
+      _purrsock_conn_pool_count(&pool->stats.failed_checks, 1);
+      _purrsock_conn_pool_close(key, socket);
+    } else {
+      survivors[survivor_count].socket = socket;
+      survivors[survivor_count++].idle_since = idle_since;
+    }
+  }
+  while (survivor_count > 0) {
+    _purrsock_idle_cell_t *survivor = &survivors[--survivor_count];
+    _purrsock_conn_pool_keep(key, survivor->socket, survivor->idle_since);
+  }
+  free(survivors);
+
+  while (_purrsock_idle_count(key) < pool->options.min_idle && _purrsock_conn_pool_reserve(key)) {
+    _purrsock_socket_t *socket;
+    if (_purrsock_conn_pool_connect(key, &socket) != PS_SUCCESS) {
+      _purrsock_conn_pool_count(&pool->stats.connect_failures, 1);
+      __atomic_fetch_sub(&key->open, 1, __ATOMIC_RELAXED);
+      _purrsock_conn_pool_wake(key);
+      break;
+    }
+    _purrsock_conn_pool_keep(key, socket, _purrsock_monotonic_ms());
+  }
+}
+
+void _purrsock_conn_pool_maintain(_purrsock_conn_pool_t *pool) {
+  assert(pool);
+  for (size_t i = 0; i <= pool->key_mask; ++i) {
+    _purrsock_conn_pool_key_t *key = __atomic_load_n(&pool->keys[i], __ATOMIC_ACQUIRE);
+    if (key) _purrsock_conn_pool_maintain_key(key);
+  }
+}
+
+void _purrsock_get_conn_pool_stats(_purrsock_conn_pool_t *pool, ps_conn_pool_stats_t *stats) {
+  assert(pool && stats);
+  stats->checkouts = __atomic_load_n(&pool->stats.checkouts, __ATOMIC_RELAXED);
+  stats->hits = __atomic_load_n(&pool->stats.hits, __ATOMIC_RELAXED);
+  stats->misses = __atomic_load_n(&pool->stats.misses, __ATOMIC_RELAXED);
+  stats->waits = __atomic_load_n(&pool->stats.waits, __ATOMIC_RELAXED);
+  stats->wait_time_us = __atomic_load_n(&pool->stats.wait_time_us, __ATOMIC_RELAXED);
+  stats->max_wait_time_us = __atomic_load_n(&pool->stats.max_wait_time_us, __ATOMIC_RELAXED);
+  stats->timeouts = __atomic_load_n(&pool->stats.timeouts, __ATOMIC_RELAXED);
+  stats->connect_failures = __atomic_load_n(&pool->stats.connect_failures, __ATOMIC_RELAXED);
+  stats->evictions = __atomic_load_n(&pool->stats.evictions, __ATOMIC_RELAXED);
+  stats->failed_checks = __atomic_load_n(&pool->stats.failed_checks, __ATOMIC_RELAXED);
+
+  // A snapshot: connections move between idle and checked out while it is taken.
+  uint64_t open = 0, idle = 0;
+  for (size_t i = 0; i <= pool->key_mask; ++i) {
+    _purrsock_conn_pool_key_t *key = __atomic_load_n(&pool->keys[i], __ATOMIC_ACQUIRE);
+    if (!key) continue;
+    open += __atomic_load_n(&key->open, __ATOMIC_RELAXED);
+    idle += _purrsock_idle_count(key);
+  }
+  stats->idle = idle;
+  stats->active = open > idle ? open - idle : 0;
+}
@@ -0,0 +1,366 @@
+// Copyright (c) 2024 ClawsoftSolutions. All rights reserved.
+//
+// This software is licensed under the MIT License.
+// See LICENSE file for more information.
+//
+
+
+
+#include "internal.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+
+#define PS_EXECUTOR_DEFAULT_QUEUE_CAPACITY 4096
+#define PS_EXECUTOR_DEQUE_CAPACITY 256   // Initial size of each worker's deque, which doubles when full.
+#define PS_EXECUTOR_IDLE_ROUNDS 64       // Fruitless rounds of stealing before a worker goes to sleep.
+#define PS_EXECUTOR_CACHE_LINE 64
+
+typedef struct {
+  ps_task_callback_t callback;
+  void *user_data;
+} _purrsock_task_t;
+
+// Slots are read by thieves while the owner may write them, so each field is accessed atomically.
+// A thief can read a torn task only for a slot it then fails to claim.
+static void _purrsock_task_store(_purrsock_task_t *slot, _purrsock_task_t task) {
+  __atomic_store_n(&slot->callback, task.callback, __ATOMIC_RELAXED);
+  __atomic_store_n(&slot->user_data, task.user_data, __ATOMIC_RELAXED);
+}
+
+static _purrsock_task_t _purrsock_task_load(_purrsock_task_t *slot) {
+  _purrsock_task_t task;
+  task.callback = __atomic_load_n(&slot->callback, __ATOMIC_RELAXED);
+  task.user_data = __atomic_load_n(&slot->user_data, __ATOMIC_RELAXED);
+  return task;
+}
+
+// Chase-Lev deque (with the memory orderings of Lê et al., "Correct and Efficient Work-Stealing for
+// Weak Memory Models"): the owner pushes and pops at the bottom, thieves take from the top.
+
+typedef struct _purrsock_deque_array_s {
+  struct _purrsock_deque_array_s *retired;  // Array this one replaced; thieves may still be reading it.
+  int64_t mask;
+  _purrsock_task_t tasks[];
+} _purrsock_deque_array_t;
+
+typedef struct {
+  int64_t top;
+  char top_pad[PS_EXECUTOR_CACHE_LINE - sizeof(int64_t)];
+  int64_t bottom;
+  _purrsock_deque_array_t *array;
+} _purrsock_deque_t;
+
+static _purrsock_deque_array_t *_purrsock_deque_array_create(int64_t capacity) {
+  _purrsock_deque_array_t *array = (_purrsock_deque_array_t *)malloc(sizeof(*array) + (size_t)capacity * sizeof(_purrsock_task_t));
+  if (!array) return NULL;
+  array->retired = NULL;
+  array->mask = capacity - 1;
+  return array;
+}
+
+static ps_result_t _purrsock_deque_push(_purrsock_deque_t *deque, _purrsock_task_t task) {
+  int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+  int64_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+  _purrsock_deque_array_t *array = __atomic_load_n(&deque->array, __ATOMIC_RELAXED);
+
+  if (bottom - top > array->mask) {
+    _purrsock_deque_array_t *grown = _purrsock_deque_array_create((array->mask + 1) * 2);
+    if (!grown) return PS_ERROR_INTERNAL;
+    for (int64_t i = top; i < bottom; ++i) {
+      _purrsock_task_store(&grown->tasks[i & grown->mask], _purrsock_task_load(&array->tasks[i & array->mask]));
+    }
+    grown->retired = array;
+    __atomic_store_n(&deque->array, grown, __ATOMIC_RELEASE);
+    array = grown;
+  }
+
+  _purrsock_task_store(&array->tasks[bottom & array->mask], task);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+  return PS_SUCCESS;
+}
+
+static bool _purrsock_deque_pop(_purrsock_deque_t *deque, _purrsock_task_t *task) {
+  int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+  _purrsock_deque_array_t *array = __atomic_load_n(&deque->array, __ATOMIC_RELAXED);
+  __atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  int64_t top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+
+  if (top > bottom) {
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+    return false;
+  }
+
+  *task = _purrsock_task_load(&array->tasks[bottom & array->mask]);
+  if (top < bottom) return true;
+
+  // The last task: thieves may be going for it too.
+  bool won = __atomic_compare_exchange_n(&deque->top, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+  __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+  return won;
+}
+
+static bool _purrsock_deque_steal(_purrsock_deque_t *deque, _purrsock_task_t *task) {
+  int64_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+  if (top >= bottom) return false;
+
+  _purrsock_deque_array_t *array = __atomic_load_n(&deque->array, __ATOMIC_ACQUIRE);
+  *task = _purrsock_task_load(&array->tasks[top & array->mask]);
+  return __atomic_compare_exchange_n(&deque->top, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+static bool _purrsock_deque_empty(_purrsock_deque_t *deque) {
+  return __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE) <= __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+}
+
+// Bounded multi-producer multi-consumer queue (Vyukov) for tasks submitted from outside the executor:
+// every cell's sequence number tells whether it is free for the enqueue or ready for the dequeue at a position.
+
+typedef struct {
+  size_t sequence;
+  _purrsock_task_t task;
+} _purrsock_queue_cell_t;
+
+typedef struct {
+  _purrsock_queue_cell_t *cells;
+  size_t mask;
+  char cells_pad[PS_EXECUTOR_CACHE_LINE];
+  size_t enqueue_pos;
+  char enqueue_pad[PS_EXECUTOR_CACHE_LINE - sizeof(size_t)];
+  size_t dequeue_pos;
+  char dequeue_pad[PS_EXECUTOR_CACHE_LINE - sizeof(size_t)];
+} _purrsock_task_queue_t;
+
+static bool _purrsock_task_queue_push(_purrsock_task_queue_t *queue, _purrsock_task_t task) {
+  size_t pos = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_RELAXED);
+  _purrsock_queue_cell_t *cell;
+  while (1) {
+    cell = &queue->cells[pos & queue->mask];
+    intptr_t diff = (intptr_t)__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) - (intptr_t)pos;
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&queue->enqueue_pos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+    } else if (diff < 0) {
+      return false;
+    } else {
+      pos = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_RELAXED);
+    }
+  }
+  cell->task = task;
+  __atomic_store_n(&cell->sequence, pos + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+static bool _purrsock_task_queue_pop(_purrsock_task_queue_t *queue, _purrsock_task_t *task) {
+  size_t pos = __atomic_load_n(&queue->dequeue_pos, __ATOMIC_RELAXED);
+  _purrsock_queue_cell_t *cell;
+  while (1) {
+    cell = &queue->cells[pos & queue->mask];
+    intptr_t diff = (intptr_t)__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) - (intptr_t)(pos + 1);
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&queue->dequeue_pos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+    } else if (diff < 0) {
+      return false;
+    } else {
+      pos = __atomic_load_n(&queue->dequeue_pos, __ATOMIC_RELAXED);
+    }
+  }
+  *task = cell->task;
+  __atomic_store_n(&cell->sequence, pos + queue->mask + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+// Also true while a push has claimed a cell but not filled it yet, so workers do not sleep through it.
+static bool _purrsock_task_queue_empty(_purrsock_task_queue_t *queue) {
+  return __atomic_load_n(&queue->enqueue_pos, __ATOMIC_ACQUIRE) == __atomic_load_n(&queue->dequeue_pos, __ATOMIC_ACQUIRE);
+}
+
+typedef struct {
+  _purrsock_deque_t deque;
+  _purrsock_executor_t *executor;
+  _purrsock_thread_t thread;
+  uint32_t seed;                   // xorshift state picking the first worker to steal from.
+} _purrsock_executor_worker_t;
+
+struct _purrsock_executor_s {
+  _purrsock_executor_worker_t *workers;
+  size_t worker_count;
+  size_t started;                  // Worker threads running.
+  _purrsock_task_queue_t queue;
+  _purrsock_mutex_t mutex;         // Only taken to go to sleep and to wake sleepers up.
+  _purrsock_cond_t wake;
+  size_t sleepers;
+  bool stopping;
+};
+
+// Worker the calling thread is, so tasks submitted from tasks go to its own deque.
+static PS_THREAD_LOCAL _purrsock_executor_worker_t *_purrsock_current_worker = NULL;
+
+static bool _purrsock_executor_find_task(_purrsock_executor_worker_t *worker, _purrsock_task_t *task) {
+  _purrsock_executor_t *executor = worker->executor;
+  if (_purrsock_deque_pop(&worker->deque, task)) return true;
+  if (_purrsock_task_queue_pop(&executor->queue, task)) return true;
+
+  // Start at a random victim so thieves spread over the busy workers.
+  worker->seed ^= worker->seed << 13;
+  worker->seed ^= worker->seed >> 17;
+  worker->seed ^= worker->seed << 5;
+  size_t start = worker->seed % executor->worker_count;
+  for (size_t i = 0; i < executor->worker_count; ++i) {
+    _purrsock_executor_worker_t *victim = &executor->workers[(start + i) % executor->worker_count];
+    if (victim != worker && _purrsock_deque_steal(&victim->deque, task)) return true;
+  }
+  return false;
+}
+
+static bool _purrsock_executor_has_work(_purrsock_executor_t *executor) {
+  if (!_purrsock_task_queue_empty(&executor->queue)) return true;
+  for (size_t i = 0; i < executor->worker_count; ++i) {
+    if (!_purrsock_deque_empty(&executor->workers[i].deque)) return true;
+  }
+  return false;
+}
+
+static void _purrsock_executor_worker_main(void *arg) {
+  _purrsock_executor_worker_t *worker = (_purrsock_executor_worker_t *)arg;
+  _purrsock_executor_t *executor = worker->executor;
+  _purrsock_current_worker = worker;
+
+  size_t idle = 0;
+  while (1) {
+    _purrsock_task_t task;
+    if (_purrsock_executor_find_task(worker, &task)) {
+      idle = 0;
+      task.callback(task.user_data);
+      continue;
+    }
+    if (++idle < PS_EXECUTOR_IDLE_ROUNDS) continue;
+    idle = 0;
+
+    // Counting itself as a sleeper before the last look for work pairs with submitters looking for
+    // sleepers after queueing: one of the two sees the other.
+    _purrsock_mutex_lock(&executor->mutex);
+    __atomic_add_fetch(&executor->sleepers, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    bool exit = false;
+    if (!_purrsock_executor_has_work(executor)) {
+      // Stopping only once everything queued has run.
+      if (executor->stopping) {
+        exit = true;
+      } else {
+        _purrsock_cond_wait(&executor->wake, &executor->mutex);
+      }
+    }
+    __atomic_sub_fetch(&executor->sleepers, 1, __ATOMIC_SEQ_CST);
+    _purrsock_mutex_unlock(&executor->mutex);
+    if (exit) break;
+  }
+  _purrsock_current_worker = NULL;
+}
+
+ps_result_t _purrsock_create_executor(_purrsock_executor_t **executor, const ps_executor_options_t *options) {
+  assert(executor);
+  ps_executor_options_t defaults = {0};
+  if (!options) options = &defaults;
+
+  _purrsock_executor_t *new_executor = (_purrsock_executor_t *)calloc(1, sizeof(*new_executor));
+  if (!new_executor) return PS_ERROR_INTERNAL;
+  _purrsock_mutex_init(&new_executor->mutex);
+  _purrsock_cond_init(&new_executor->wake);
+
+  size_t capacity = 2;
+  size_t requested = options->queue_capacity ? options->queue_capacity : PS_EXECUTOR_DEFAULT_QUEUE_CAPACITY;
+  while (capacity < requested) capacity *= 2;
+  new_executor->queue.cells = (_purrsock_queue_cell_t *)malloc(capacity * sizeof(_purrsock_queue_cell_t));
+  new_executor->queue.mask = capacity - 1;
+
+  new_executor->worker_count = options->workers ? options->workers : _purrsock_cpu_count();
+  new_executor->workers = (_purrsock_executor_worker_t *)calloc(new_executor->worker_count, sizeof(*new_executor->workers));
+  if (!new_executor->queue.cells || !new_executor->workers) {
+    _purrsock_destroy_executor(new_executor);
+    return PS_ERROR_INTERNAL;
+  }
+  for (size_t i = 0; i < capacity; ++i) new_executor->queue.cells[i].sequence = i;
+
+  for (size_t i = 0; i < new_executor->worker_count; ++i) {
+    _purrsock_executor_worker_t *worker = &new_executor->workers[i];
+    worker->executor = new_executor;
+    worker->seed = (uint32_t)(i * 2654435761u) | 1;
+    worker->deque.array = _purrsock_deque_array_create(PS_EXECUTOR_DEQUE_CAPACITY);
+    if (!worker->deque.array) {
+      _purrsock_destroy_executor(new_executor);
+      return PS_ERROR_INTERNAL;
+    }
+  }
+
+  size_t cpu_count = _purrsock_cpu_count();
+  for (size_t i = 0; i < new_executor->worker_count; ++i) {
+    _purrsock_executor_worker_t *worker = &new_executor->workers[i];
+    ps_result_t result = _purrsock_thread_create(&worker->thread, _purrsock_executor_worker_main, worker);
+    if (result != PS_SUCCESS) {
+      _purrsock_destroy_executor(new_executor);
+      return result;
+    }
+    new_executor->started++;
+    if (options->pin_workers) _purrsock_thread_pin(worker->thread, i % cpu_count);
+  }
+
+  *executor = new_executor;
+  return PS_SUCCESS;
+}
+
+void _purrsock_destroy_executor(_purrsock_executor_t *executor) {
+  assert(executor);
+  _purrsock_mutex_lock(&executor->mutex);
+  executor->stopping = true;
+  _purrsock_cond_broadcast(&executor->wake);
+  _purrsock_mutex_unlock(&executor->mutex);
+  for (size_t i = 0; i < executor->started; ++i) {
+    _purrsock_thread_join(executor->workers[i].thread);
+  }
+
+  for (size_t i = 0; executor->workers && i < executor->worker_count; ++i) {
+    _purrsock_deque_array_t *array = executor->workers[i].deque.array;
+    while (array) {
+      _purrsock_deque_array_t *retired = array->retired;
+      free(array);
+      array = retired;
+    }
+  }
+  _purrsock_cond_destroy(&executor->wake);
+  _purrsock_mutex_destroy(&executor->mutex);
+  free(executor->queue.cells);
+  free(executor->workers);
+  free(executor);
+}
+
+ps_result_t _purrsock_executor_submit(_purrsock_executor_t *executor, ps_task_callback_t callback, void *user_data) {
+  assert(executor && callback);
+  _purrsock_task_t task = { callback, user_data };
+
+  _purrsock_executor_worker_t *worker = _purrsock_current_worker;
+  if (worker && worker->executor == executor) {
+    ps_result_t result = _purrsock_deque_push(&worker->deque, task);
+    if (result != PS_SUCCESS) return result;
+  } else if (!_purrsock_task_queue_push(&executor->queue, task)) {
+    return PS_ERROR_WOULDBLOCK;
+  }
+
+  // While every worker is busy this is the whole cost of waking: no lock is taken.
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&executor->sleepers, __ATOMIC_RELAXED)) {
+    _purrsock_mutex_lock(&executor->mutex);
+    _purrsock_cond_signal(&executor->wake);
+    _purrsock_mutex_unlock(&executor->mutex);
+  }
+  return PS_SUCCESS;
+}
+
+size_t _purrsock_executor_get_worker_count(_purrsock_executor_t *executor) {
+  assert(executor);
+  return executor->worker_count;
+}
@@ -0,0 +1,254 @@
+// Copyright (c) 2024 ClawsoftSolutions. All rights reserved.
+//
+// This software is licensed under the MIT License.
+// See LICENSE file for more information.
+//
+
+
+
+#include "internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define PS_FRAMING_DEFAULT_MAX_FRAME (16 * 1024 * 1024)
+#define PS_FRAMING_DEFAULT_CAPACITY 4096
+#define PS_FRAMING_MAX_VARINT 10   // Bytes of a LEB128-encoded 64-bit length.
+
+struct _purrsock_framed_socket_s {
+  _purrsock_socket_t *socket;
+  ps_framing_t framing;
+  char delimiter[PS_FRAMING_MAX_DELIMITER];
+  size_t delimiter_size;
+  size_t max_frame_size;
+  char *ring;
+  size_t capacity;          // Always a power of two, so offsets wrap with a mask.
+  size_t head;              // Offset of the first buffered byte.
+  size_t count;             // Bytes buffered.
+  size_t scanned;           // Delimiter framing: leading buffered bytes known not to start a delimiter.
+  char *scratch;            // Frames that wrap around the end of the ring are copied here.
+  size_t scratch_capacity;
+};
+
+static unsigned char _purrsock_framed_at(const _purrsock_framed_socket_t *framed, size_t offset) {
+  return (unsigned char)framed->ring[(framed->head + offset) & (framed->capacity - 1)];
+}
+
+static size_t _purrsock_framed_round_capacity(size_t size) {
+  size_t capacity = 64;
+  while (capacity < size) capacity *= 2;
+  return capacity;
+}
+
+// Grows the ring to hold at least `size` bytes, moving the buffered bytes to its start.
+static ps_result_t _purrsock_framed_grow(_purrsock_framed_socket_t *framed, size_t size) {
+  size_t capacity = _purrsock_framed_round_capacity(size);
+  char *ring = (char *)malloc(capacity);
+  if (!ring) return PS_ERROR_INTERNAL;
+
+  size_t first = framed->capacity - framed->head;
+  if (first > framed->count) first = framed->count;
+  memcpy(ring, framed->ring + framed->head, first);
+  memcpy(ring + first, framed->ring, framed->count - first);
+
+  free(framed->ring);
+  framed->ring = ring;
+  framed->capacity = capacity;
+  framed->head = 0;
+  return PS_SUCCESS;
+}
+
+// Hands out the `size` bytes at `offset` as a frame and drops everything up to `consumed` from the ring.
+static ps_result_t _purrsock_framed_emit(_purrsock_framed_socket_t *framed, size_t offset, size_t size, size_t consumed, ps_packet_t *frame) {
+  size_t start = (framed->head + offset) & (framed->capacity - 1);
+  if (start + size <= framed->capacity) {
+    *frame = (ps_packet_t){ size, framed->ring + start, size };
+  } else {
+    if (framed->scratch_capacity < size) {
+      char *scratch = (char *)realloc(framed->scratch, size);
+      if (!scratch) return PS_ERROR_INTERNAL;
+      framed->scratch = scratch;
+      framed->scratch_capacity = size;
+    }
+    size_t first = framed->capacity - start;
+    memcpy(framed->scratch, framed->ring + start, first);
+    memcpy(framed->scratch + first, framed->ring, size - first);
+    *frame = (ps_packet_t){ size, framed->scratch, size };
+  }
+
+  // The frame's bytes stay untouched until the next read refills the ring.
+  framed->count -= consumed;
+  framed->head = framed->count ? (framed->head + consumed) & (framed->capacity - 1) : 0;
+  framed->scanned = 0;
+  return PS_SUCCESS;
+}
+
+// Parses a length prefix; on an incomplete frame returns PS_ERROR_WOULDBLOCK and the bytes needed in `needed`.
+static ps_result_t _purrsock_framed_parse_length(_purrsock_framed_socket_t *framed, ps_packet_t *frame, size_t *needed) {
+  uint64_t length = 0;
+  size_t header = 0;
+  if (framed->framing == PS_FRAMING_FIXED32) {
+    if (framed->count < 4) {
+      *needed = 4;
+      return PS_ERROR_WOULDBLOCK;
+    }
+    for (size_t i = 0; i < 4; ++i) length = (length << 8) | _purrsock_framed_at(framed, i);
+    header = 4;
+  } else {
+    for (size_t i = 0; !header; ++i) {
+      if (i == PS_FRAMING_MAX_VARINT) return PS_ERROR_MSGTOOLONG;
+      if (i == framed->count) {
+        *needed = i + 1;
+        return PS_ERROR_WOULDBLOCK;
+      }
+      unsigned char byte = _purrsock_framed_at(framed, i);
+      length |= (uint64_t)(byte & 0x7f) << (7 * i);
+      if (!(byte & 0x80)) header = i + 1;
+    }
+  }
+
+  if (length > framed->max_frame_size) return PS_ERROR_MSGTOOLONG;
+  if (framed->count < header + length) {
+    *needed = header + (size_t)length;
+    return PS_ERROR_WOULDBLOCK;
+  }
+  return _purrsock_framed_emit(framed, header, (size_t)length, header + (size_t)length, frame);
+}
+
+static ps_result_t _purrsock_framed_parse_delimited(_purrsock_framed_socket_t *framed, ps_packet_t *frame, size_t *needed) {
+  size_t delimiter_size = framed->delimiter_size;
+  size_t i = framed->scanned;
+  while (i + delimiter_size <= framed->count) {
+    // Scan the contiguous run for whole delimiters, then compare the ones that start in its last bytes
+    // and continue across the wrap.
+    size_t start = (framed->head + i) & (framed->capacity - 1);
+    size_t run = framed->capacity - start;
+    if (run > framed->count - i) run = framed->count - i;
+    size_t found = _purrsock_scan_find(framed->ring + start, run, framed->delimiter, delimiter_size);
+    if (found == run) {
+      for (found = run >= delimiter_size ? run - delimiter_size + 1 : 0; found < run && i + found + delimiter_size <= framed->count; ++found) {
+        size_t matched = 0;
+        while (matched < delimiter_size && _purrsock_framed_at(framed, i + found + matched) == (unsigned char)framed->delimiter[matched]) matched++;
+        if (matched == delimiter_size) break;
+      }
+    }
+    if (found < run && i + found + delimiter_size <= framed->count) {
+      i += found;
+      if (i > framed->max_frame_size) return PS_ERROR_MSGTOOLONG;
+      return _purrsock_framed_emit(framed, 0, i, i + delimiter_size, frame);
+    }
+    i += run;
+  }
+
+  // Only the last `delimiter_size - 1` bytes can still turn out to start a delimiter.
+  if (framed->count >= delimiter_size) framed->scanned = framed->count - delimiter_size + 1;
+  if (framed->count >= framed->max_frame_size + delimiter_size) return PS_ERROR_MSGTOOLONG;
+  *needed = framed->count + 1;
+  return PS_ERROR_WOULDBLOCK;
+}
+
+ps_result_t _purrsock_create_framed_socket(_purrsock_framed_socket_t **framed, _purrsock_socket_t *socket, const ps_framing_options_t *options) {
+  assert(framed && socket && options);
+  if (_purrsock_is_datagram(socket->protocol)) return PS_ERROR_INVALID_ARGUMENT;
+  switch (options->framing) {
+  case PS_FRAMING_VARINT:
+  case PS_FRAMING_FIXED32:
+    break;
+  case PS_FRAMING_DELIMITER:
+    if (!options->delimiter || !options->delimiter_size || options->delimiter_size > PS_FRAMING_MAX_DELIMITER) return PS_ERROR_INVALID_ARGUMENT;
+    break;
+  default:
+    return PS_ERROR_INVALID_ARGUMENT;
+  }
+
+  _purrsock_framed_socket_t *result = (_purrsock_framed_socket_t *)calloc(1, sizeof(*result));
+  if (!result) return PS_ERROR_INTERNAL;
+  result->socket = socket;
+  result->framing = options->framing;
+  if (options->framing == PS_FRAMING_DELIMITER) {
+    memcpy(result->delimiter, options->delimiter, options->delimiter_size);
+    result->delimiter_size = options->delimiter_size;
+  }
+  result->max_frame_size = options->max_frame_size ? options->max_frame_size : PS_FRAMING_DEFAULT_MAX_FRAME;
+  if (options->framing == PS_FRAMING_FIXED32 && result->max_frame_size > UINT32_MAX) result->max_frame_size = UINT32_MAX;
+
+  result->capacity = _purrsock_framed_round_capacity(options->initial_capacity ? options->initial_capacity : PS_FRAMING_DEFAULT_CAPACITY);
+  result->ring = (char *)malloc(result->capacity);
+  if (!result->ring) {
+    free(result);
+    return PS_ERROR_INTERNAL;
+  }
+
+  *framed = result;
+  return PS_SUCCESS;
+}
+
+void _purrsock_destroy_framed_socket(_purrsock_framed_socket_t *framed) {
+  assert(framed);
+  free(framed->ring);
+  free(framed->scratch);
+  free(framed);
+}
+
+ps_result_t _purrsock_framed_read(_purrsock_framed_socket_t *framed, ps_packet_t *frame) {
+  assert(framed && frame);
+  while (1) {
+    size_t needed = 0;
+    ps_result_t result = framed->framing == PS_FRAMING_DELIMITER
+      ? _purrsock_framed_parse_delimited(framed, frame, &needed)
+      : _purrsock_framed_parse_length(framed, frame, &needed);
+    if (result != PS_ERROR_WOULDBLOCK) return result;
+
+    if (needed > framed->capacity) {
+      result = _purrsock_framed_grow(framed, needed);
+      if (result != PS_SUCCESS) return result;
+    }
+
+    // Receive into all free space at once; it wraps around the end of the ring after the first slice.
+    size_t tail = (framed->head + framed->count) & (framed->capacity - 1);
+    ps_packet_t slices[2];
+    size_t slice_count = 1;
+    if (tail >= framed->head && framed->count < framed->capacity) {
+      slices[0] = (ps_packet_t){ 0, framed->ring + tail, framed->capacity - tail };
+      if (framed->head > 0) {
+        slices[1] = (ps_packet_t){ 0, framed->ring, framed->head };
+        slice_count = 2;
+      }
+    } else {
+      slices[0] = (ps_packet_t){ 0, framed->ring + tail, framed->head - tail };
+    }
+
+    size_t received = 0;
+    result = _purrsock_recvv(framed->socket, slices, slice_count, &received, NULL);
+    if (result != PS_SUCCESS) return result;
+    framed->count += received;
+  }
+}
+
+ps_result_t _purrsock_framed_send(_purrsock_framed_socket_t *framed, ps_packet_t payload) {
+  assert(framed);
+  if (payload.size > framed->max_frame_size) return PS_ERROR_MSGTOOLONG;
+
+  char header[PS_FRAMING_MAX_VARINT];
+  size_t header_size = 0;
+  switch (framed->framing) {
+  case PS_FRAMING_VARINT: {
+    uint64_t length = payload.size;
+    do {
+      header[header_size++] = (char)((length & 0x7f) | (length > 0x7f ? 0x80 : 0));
+      length >>= 7;
+    } while (length);
+  } break;
+  case PS_FRAMING_FIXED32:
+    for (int shift = 24; shift >= 0; shift -= 8) header[header_size++] = (char)(payload.size >> shift);
+    break;
+  case PS_FRAMING_DELIMITER: {
+    ps_packet_t slices[2] = { payload, { framed->delimiter_size, framed->delimiter, framed->delimiter_size } };
+    return _purrsock_sendv(framed->socket, slices, 2, NULL);
+  }
+  }
+
+  ps_packet_t slices[2] = { { header_size, header, header_size }, payload };
+  return _purrsock_sendv(framed->socket, slices, 2, NULL);
+}
@@ -0,0 +1,1177 @@
+// Copyright (c) 2024 ClawsoftSolutions. All rights reserved.
+//
+// This software is licensed under the MIT License.
+// See LICENSE file for more information.
+//
+
+
+
+#include "internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#define PS_HTTP_DEFAULT_MAX_HEADER_SIZE (8 * 1024)
+#define PS_HTTP_DEFAULT_MAX_BODY_SIZE (1024 * 1024)
+#define PS_HTTP_DEFAULT_IDLE_TIMEOUT_MS 10000
+#define PS_HTTP_READ_BUFFER_SIZE 4096
+#define PS_HTTP_KEPT_BUFFER_SIZE (64 * 1024)   // Buffers that grew past this are given back once empty.
+#define PS_HTTP_DIRECT_SEND_SIZE (16 * 1024)   // Bodies from this size are sent from the handler's buffer.
+#define PS_HTTP_MAX_CHUNK_LINE 256             // Chunk size line of a chunked body, extensions included.
+#define PS_HTTP_DATE_LINE_SIZE 37              // "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+
+// Parser results besides the status code a bad request is answered with.
+#define PS_HTTP_COMPLETE 0
+#define PS_HTTP_INCOMPLETE -1
+
+typedef struct _purrsock_http_worker_s _purrsock_http_worker_t;
+typedef struct _purrsock_http_connection_s _purrsock_http_connection_t;
+typedef struct _purrsock_http_route_s _purrsock_http_route_t;
+
+typedef struct {
+  char *buf;
+  size_t size;
+  size_t capacity;
+} _purrsock_http_buffer_t;
+
+typedef enum {
+  PS_HTTP_RESPONSE_PENDING,        // Nothing sent yet; status and headers may change.
+  PS_HTTP_RESPONSE_STREAMING,      // Head sent, body written piece by piece.
+  PS_HTTP_RESPONSE_DONE,
+} _purrsock_http_response_state_t;
+
+struct _purrsock_http_response_s {
+  _purrsock_http_connection_t *connection;
+  int status;
+  _purrsock_http_buffer_t headers; // Header fields added by the handler, already formatted.
+  _purrsock_http_response_state_t state;
+  int minor_version;
+  bool keep_alive;
+  bool head_only;                  // Answer to a HEAD request: the body is left out.
+  bool chunked;                    // Streamed body in chunked coding; HTTP/1.0 bodies end with the connection.
+};
+
+struct _purrsock_http_route_s {
+  const char *method;              // NULL matches any method.
+  size_t method_size;
+  const char *path;                // Prefix routes without the trailing '*'.
+  size_t path_size;
+  bool prefix;
+  uint64_t hash;
+  ps_http_handler_t handler;
+  void *user_data;
+  _purrsock_http_route_t *next;    // Next route in the same bucket, or next shorter prefix route.
+};
+
+struct _purrsock_http_connection_s {
+  _purrsock_http_worker_t *worker;
+  ps_socket_t socket;
+  ps_timer_t idle_timer;
+  uint64_t active_since;           // Loop time of the last completed request, or of the accept.
+  char *in;
+  size_t in_capacity;
+  size_t in_start;                 // Unanswered bytes are `in[in_start, in_end)`.
+  size_t in_end;
+  // Progress on the request at `in_start`, relative to it, so that no byte is looked at twice.
+  size_t scanned;                  // Bytes known not to end the head.
+  size_t head_size;                // Size of the head once it is complete, 0 before.
+  size_t body_size;                // Content-Length, or bytes of a chunked body decoded so far.
+  size_t chunk_offset;             // Chunked bodies: start of the next chunk size line.
+  size_t request_size;             // Bytes the complete request takes up in `in`.
+  bool chunked;
+  bool continue_sent;              // "100 Continue" went out for the request.
+  _purrsock_http_buffer_t out;     // Responses not sent yet.
+  size_t out_sent;                 // Bytes at the front of `out` a partial write already sent.
+  int file;                        // Body of a file response, sent after `out`; -1 without one.
+  uint64_t file_offset;            // Next byte of `file` to send.
+  uint64_t file_remaining;
+  bool blocked;                    // `out` waits for the socket to become writable.
+  bool closing;                    // Close once `out` is sent.
+  ps_result_t error;               // Failure of a send; nothing more is sent after it.
+  _purrsock_http_connection_t *next;
+  _purrsock_http_connection_t **prev;
+};
+
+struct _purrsock_http_worker_s {
+  _purrsock_http_server_t *server;
+  ps_loop_t loop;
+  _purrsock_http_connection_t *connections;
+  ps_http_request_t request;       // Request being handled; a worker handles one at a time.
+  _purrsock_http_response_t response;
+  char *common;                    // Server and Date header lines, preformatted for every response.
+  size_t common_size;
+  uint64_t date_expires;           // Loop time at which the Date line is a second old.
+};
+
+struct _purrsock_http_server_s {
+  ps_http_server_options_t options;
+  ps_server_t server;
+  _purrsock_http_worker_t *workers;
+  size_t worker_count;
+  _purrsock_http_route_t **buckets; // Exact routes hashed by path.
+  size_t bucket_count;              // Power of two, at least the number of exact routes.
+  size_t exact_count;
+  _purrsock_http_route_t *prefix_routes; // Longest prefix first.
+  bool started;
+};
+
+typedef struct {
+  uint64_t content_length;
+  bool has_content_length;
+  bool chunked;
+  bool close;                      // "Connection: close"
+  bool keep_alive;                 // "Connection: keep-alive", which HTTP/1.0 needs to stay open.
+  bool expect_continue;
+} _purrsock_http_head_t;
+
+static bool _purrsock_http_iequals(const char *a, const char *b, size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    char x = a[i] >= 'A' && a[i] <= 'Z' ? a[i] + 32 : a[i];
+    char y = b[i] >= 'A' && b[i] <= 'Z' ? b[i] + 32 : b[i];
+    if (x != y) return false;
+  }
+  return true;
+}
+
+static bool _purrsock_http_is(ps_http_string_t string, const char *literal) {
+  size_t size = strlen(literal);
+  return string.size == size && _purrsock_http_iequals(string.buf, literal, size);
+}
+
+bool _purrsock_http_list_contains(ps_http_string_t list, const char *token) {
+  for (const char *element = list.buf, *end = list.buf + list.size; element < end;) {
+    const char *comma = (const char *)memchr(element, ',', (size_t)(end - element));
+    if (!comma) comma = end;
+    const char *element_end = comma;
+    while (element < element_end && (*element == ' ' || *element == '\t')) element++;
+    while (element_end > element && (element_end[-1] == ' ' || element_end[-1] == '\t')) element_end--;
+    if (_purrsock_http_is((ps_http_string_t){ element, (size_t)(element_end - element) }, token)) return true;
+    element = comma + 1;
+  }
+  return false;
+}
+
+// Methods and field names are tokens (RFC 9110 5.6.2); the bitmaps hold the allowed ASCII characters.
+static bool _purrsock_http_is_token(const char *buf, size_t size) {
+  return size && _purrsock_scan_token(buf, size) == size;
+}
+
+static size_t _purrsock_http_format_number(char *out, uint64_t value, unsigned base) {
+  char digits[20];
+  size_t count = 0;
+  do {
+    digits[count++] = "0123456789abcdef"[value % base];
+    value /= base;
+  } while (value);
+  for (size_t i = 0; i < count; ++i) out[i] = digits[count - 1 - i];
+  return count;
+}
+
+static ps_result_t _purrsock_http_reserve(_purrsock_http_buffer_t *buffer, size_t size) {
+  if (buffer->capacity - buffer->size >= size) return PS_SUCCESS;
+  size_t capacity = buffer->capacity ? buffer->capacity : 1024;
+  while (capacity - buffer->size < size) capacity *= 2;
+  char *buf = (char *)realloc(buffer->buf, capacity);
+  if (!buf) return PS_ERROR_INTERNAL;
+  buffer->buf = buf;
+  buffer->capacity = capacity;
+  return PS_SUCCESS;
+}
+
+static ps_result_t _purrsock_http_append(_purrsock_http_buffer_t *buffer, const char *data, size_t size) {
+  ps_result_t result = _purrsock_http_reserve(buffer, size);
+  if (result != PS_SUCCESS) return result;
+  memcpy(buffer->buf + buffer->size, data, size);
+  buffer->size += size;
+  return PS_SUCCESS;
+}
+
+// Formats seconds since the epoch as an IMF-fixdate (RFC 9110 5.6.7), using the days-to-civil conversion
+// from Howard Hinnant's date algorithms so that no thread-unsafe or platform-specific gmtime is needed.
+static void _purrsock_http_format_date(char *out, uint64_t seconds) {
+  static const char weekdays[] = "ThuFriSatSunMonTueWed";  // 1970-01-01 was a Thursday.
+  static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+  uint64_t days = seconds / 86400;
+  unsigned second_of_day = (unsigned)(seconds % 86400);
+
+  uint64_t shifted = days + 719468;  // Days since 0000-03-01.
+  uint64_t era = shifted / 146097;
+  unsigned day_of_era = (unsigned)(shifted - era * 146097);
+  unsigned year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+  unsigned day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+  unsigned month_index = (5 * day_of_year + 2) / 153;  // From March.
+  unsigned day = day_of_year - (153 * month_index + 2) / 5 + 1;
+  unsigned month = month_index < 10 ? month_index + 3 : month_index - 9;
+  unsigned year = (unsigned)(year_of_era + era * 400) + (month <= 2);
+
+  snprintf(out, PS_HTTP_DATE_LINE_SIZE + 1, "Date: %.3s, %02u %.3s %04u %02u:%02u:%02u GMT\r\n",
+           weekdays + days % 7 * 3, day, months + (month - 1) * 3, year,
+           second_of_day / 3600, second_of_day / 60 % 60, second_of_day % 60);
+}
+
+// Reformats the Date line when the wall clock moved to the next second, going by the loop's clock in between.
+static void _purrsock_http_refresh_date(_purrsock_http_worker_t *worker) {
+  uint64_t now = ps_loop_now(worker->loop);
+  if (now < worker->date_expires) return;
+
+  struct timespec wall;
+  timespec_get(&wall, TIME_UTC);
+  _purrsock_http_format_date(worker->common + worker->common_size - PS_HTTP_DATE_LINE_SIZE, (uint64_t)wall.tv_sec);
+  worker->date_expires = now + 1000 - (uint64_t)wall.tv_nsec / 1000000;
+}
+
+static ps_http_string_t _purrsock_http_status_line(int status, char *scratch, size_t scratch_size) {
+#define PS_HTTP_STATUS_LINE(code, reason) \
+  case code: return (ps_http_string_t){ "HTTP/1.1 " #code " " reason "\r\n", sizeof("HTTP/1.1 " #code " " reason "\r\n") - 1 }
+  switch (status) {
+  PS_HTTP_STATUS_LINE(200, "OK");
+  PS_HTTP_STATUS_LINE(201, "Created");
+  PS_HTTP_STATUS_LINE(202, "Accepted");
+  PS_HTTP_STATUS_LINE(204, "No Content");
+  PS_HTTP_STATUS_LINE(206, "Partial Content");
+  PS_HTTP_STATUS_LINE(301, "Moved Permanently");
+  PS_HTTP_STATUS_LINE(302, "Found");
+  PS_HTTP_STATUS_LINE(303, "See Other");
+  PS_HTTP_STATUS_LINE(304, "Not Modified");
+  PS_HTTP_STATUS_LINE(307, "Temporary Redirect");
+  PS_HTTP_STATUS_LINE(308, "Permanent Redirect");
+  PS_HTTP_STATUS_LINE(400, "Bad Request");
+  PS_HTTP_STATUS_LINE(401, "Unauthorized");
+  PS_HTTP_STATUS_LINE(403, "Forbidden");
+  PS_HTTP_STATUS_LINE(404, "Not Found");
+  PS_HTTP_STATUS_LINE(405, "Method Not Allowed");
+  PS_HTTP_STATUS_LINE(408, "Request Timeout");
+  PS_HTTP_STATUS_LINE(409, "Conflict");
+  PS_HTTP_STATUS_LINE(410, "Gone");
+  PS_HTTP_STATUS_LINE(411, "Length Required");
+  PS_HTTP_STATUS_LINE(413, "Content Too Large");
+  PS_HTTP_STATUS_LINE(414, "URI Too Long");
+  PS_HTTP_STATUS_LINE(415, "Unsupported Media Type");
+  PS_HTTP_STATUS_LINE(417, "Expectation Failed");
+  PS_HTTP_STATUS_LINE(422, "Unprocessable Content");
+  PS_HTTP_STATUS_LINE(429, "Too Many Requests");
+  PS_HTTP_STATUS_LINE(431, "Request Header Fields Too Large");
+  PS_HTTP_STATUS_LINE(500, "Internal Server Error");
+  PS_HTTP_STATUS_LINE(501, "Not Implemented");
+  PS_HTTP_STATUS_LINE(502, "Bad Gateway");
+  PS_HTTP_STATUS_LINE(503, "Service Unavailable");
+  PS_HTTP_STATUS_LINE(504, "Gateway Timeout");
+  PS_HTTP_STATUS_LINE(505, "HTTP Version Not Supported");
+  }
+#undef PS_HTTP_STATUS_LINE
+
+  // The reason phrase is optional; clients go by the code.
+  int size = snprintf(scratch, scratch_size, "HTTP/1.1 %d \r\n", status);
+  return (ps_http_string_t){ scratch, (size_t)size };
+}
+
+static int _purrsock_http_parse_field(const ps_http_header_t *header, size_t max_body_size, _purrsock_http_head_t *head) {
+  ps_http_string_t value = header->value;
+  switch (header->name.size) {
+  case 14: {
+    if (!_purrsock_http_is(header->name, "content-length")) break;
+    if (!value.size) return 400;
+    uint64_t length = 0;
+    for (size_t i = 0; i < value.size; ++i) {
+      if (value.buf[i] < '0' || value.buf[i] > '9') return 400;
+      length = length * 10 + (uint64_t)(value.buf[i] - '0');
+      if (length > max_body_size) return 413;
+    }
+    if (head->has_content_length && head->content_length != length) return 400;
+    head->content_length = length;
+    head->has_content_length = true;
+  } break;
+  case 17:
+    if (!_purrsock_http_is(header->name, "transfer-encoding")) break;
+    // Only chunked is decoded, the one coding every HTTP/1.1 recipient has to understand.
+    if (!_purrsock_http_is(value, "chunked") || head->chunked) return 501;
+    head->chunked = true;
+    break;
+  case 10:
+    if (!_purrsock_http_is(header->name, "connection")) break;
+    if (_purrsock_http_list_contains(value, "close")) head->close = true;
+    if (_purrsock_http_list_contains(value, "keep-alive")) head->keep_alive = true;
+    break;
+  case 6:
+    if (!_purrsock_http_is(header->name, "expect")) break;
+    if (!_purrsock_http_is(value, "100-continue")) return 417;
+    head->expect_continue = true;
+    break;
+  }
+  return PS_HTTP_COMPLETE;
+}
+
+// Parses a complete head, which ends with an empty line, into `request`.
+static int _purrsock_http_parse_head(const char *buf, size_t size, size_t max_body_size, ps_http_request_t *request, _purrsock_http_head_t *head) {
+  memset(head, 0, sizeof(*head));
+  const char *end = buf + size;
+
+  // Request line: method SP request-target SP HTTP-version CRLF. The head ends with CRLF CRLF, so every
+  // scan below stops inside it.
+  const char *line_end = buf + _purrsock_scan_field_value(buf, size);
+  if (line_end[0] != '\r' || line_end[1] != '\n') return 400;
+  const char *space = buf + _purrsock_scan_token(buf, (size_t)(line_end - buf));
+  if (space == buf || *space != ' ') return 400;
+  request->method = (ps_http_string_t){ buf, (size_t)(space - buf) };
+
+  const char *target = space + 1;
+  space = (const char *)memchr(target, ' ', (size_t)(line_end - target));
+  if (!space || space == target) return 400;
+  request->target = (ps_http_string_t){ target, (size_t)(space - target) };
+  const char *query = (const char *)memchr(target, '?', request->target.size);
+  request->path = (ps_http_string_t){ target, query ? (size_t)(query - target) : request->target.size };
+  request->query = query ? (ps_http_string_t){ query + 1, (size_t)(space - query - 1) } : (ps_http_string_t){ space, 0 };
+
+  const char *version = space + 1;
+  if (line_end - version != 8 || memcmp(version, "HTTP/", 5) != 0) return 400;
+  if (version[5] != '1' || version[6] != '.' || (version[7] != '0' && version[7] != '1')) return 505;
+  request->minor_version = version[7] - '0';
+
+  request->header_count = 0;
+  const char *line = line_end + 2;
+  while (*line != '\r') {
+    // Also rejects obsolete line folding, whose continuation lines start with whitespace.
+    const char *colon = line + _purrsock_scan_token(line, (size_t)(end - line));
+    if (colon == line || *colon != ':') return 400;
+
+    const char *value = colon + 1;
+    while (*value == ' ' || *value == '\t') value++;
+    // Parsers that end lines at a bare LF would see a second field here; refuse to disagree with them.
+    line_end = value + _purrsock_scan_field_value(value, (size_t)(end - value));
+    if (line_end[0] != '\r' || line_end[1] != '\n') return 400;
+    const char *value_end = line_end;
+    while (value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t')) value_end--;
+
+    if (request->header_count == PS_HTTP_MAX_HEADERS) return 431;
+    ps_http_header_t *header = &request->headers[request->header_count++];
+    header->name = (ps_http_string_t){ line, (size_t)(colon - line) };
+    header->value = (ps_http_string_t){ value, (size_t)(value_end - value) };
+    int status = _purrsock_http_parse_field(header, max_body_size, head);
+    if (status != PS_HTTP_COMPLETE) return status;
+    line = line_end + 2;
+  }
+  if (line + 2 != end) return 400;
+
+  // Both framings at once is how requests are smuggled past proxies that pick the other one.
+  if (head->chunked && head->has_content_length) return 400;
+  request->keep_alive = !head->close && (request->minor_version >= 1 || head->keep_alive);
+  return PS_HTTP_COMPLETE;
+}
+
+int _purrsock_http_parse_request(const char *buf, size_t size, ps_http_request_t *request) {
+  _purrsock_http_head_t head;
+  return _purrsock_http_parse_head(buf, size, 0, request, &head);
+}
+
+// Decodes the chunks that arrived since the last call, moving their data down to the end of the body
+// decoded so far, right after the head. Chunk data is only moved once the whole chunk is there.
+static int _purrsock_http_dechunk(_purrsock_http_connection_t *connection, char *buf, size_t size) {
+  const ps_http_server_options_t *options = &connection->worker->server->options;
+  while (1) {
+    size_t offset = connection->chunk_offset;
+    size_t available = size - offset;
+    const char *line = buf + offset;
+    const char *newline = (const char *)memchr(line, '\n', available < PS_HTTP_MAX_CHUNK_LINE ? available : PS_HTTP_MAX_CHUNK_LINE);
+    if (!newline) return available < PS_HTTP_MAX_CHUNK_LINE ? PS_HTTP_INCOMPLETE : 400;
+    if (newline == line || newline[-1] != '\r') return 400;
+
+    // chunk-size [ chunk-ext ] CRLF; extensions are ignored.
+    uint64_t chunk_size = 0;
+    const char *digit = line;
+    for (; digit < newline - 1; ++digit) {
+      char c = *digit;
+      int value = c >= '0' && c <= '9' ? c - '0' : (c | 0x20) >= 'a' && (c | 0x20) <= 'f' ? (c | 0x20) - 'a' + 10 : -1;
+      if (value < 0) break;
+      chunk_size = chunk_size * 16 + (uint64_t)value;
+      if (connection->body_size + chunk_size > options->max_body_size) return 413;
+    }
+    if (digit == line || (digit < newline - 1 && *digit != ';' && *digit != ' ' && *digit != '\t')) return 400;
+    size_t data = (size_t)(newline - buf) + 1;
+
+    if (chunk_size == 0) {
+      // Trailer fields up to an empty line; they are skipped.
+      for (size_t trailer = data; ;) {
+        const char *trailer_end = (const char *)memchr(buf + trailer, '\n', size - trailer);
+        if (!trailer_end) return size - data > options->max_header_size ? 431 : PS_HTTP_INCOMPLETE;
+        if (trailer_end == buf + trailer || trailer_end[-1] != '\r') return 400;
+        size_t next = (size_t)(trailer_end - buf) + 1;
+        if (next - trailer == 2) {
+          connection->request_size = next;
+          return PS_HTTP_COMPLETE;
+        }
+        trailer = next;
+      }
+    }
+
+    if (size - data < chunk_size + 2) return PS_HTTP_INCOMPLETE;
+    if (buf[data + chunk_size] != '\r' || buf[data + chunk_size + 1] != '\n') return 400;
+    memmove(buf + connection->head_size + connection->body_size, buf + data, (size_t)chunk_size);
+    connection->body_size += (size_t)chunk_size;
+    connection->chunk_offset = data + (size_t)chunk_size + 2;
+  }
+}
+
+static void _purrsock_http_flush(_purrsock_http_connection_t *connection);
+
+// Finds the request at `in_start` and fills `request` once it is complete.
+static int _purrsock_http_parse(_purrsock_http_connection_t *connection, ps_http_request_t *request) {
+  const ps_http_server_options_t *options = &connection->worker->server->options;
+  char *buf = connection->in + connection->in_start;
+  size_t size = connection->in_end - connection->in_start;
+
+  bool new_head = !connection->head_size;
+  if (new_head) {
+    // Empty lines before a request line are ignored (RFC 9112 2.2).
+    if (!connection->scanned) {
+      while (size && (*buf == '\r' || *buf == '\n')) {
+        buf++;
+        size--;
+        connection->in_start++;
+      }
+    }
+
+    // Only the bytes that arrived since the last look are searched, along with the three before them that
+    // may start the CRLF CRLF ending the head.
+    size_t start = connection->scanned > 3 ? connection->scanned - 3 : 0;
+    size_t found = start + _purrsock_scan_find(buf + start, size - start, "\r\n\r\n", 4);
+    size_t head_size = found < size ? found + 4 : 0;
+    if (!head_size) {
+      connection->scanned = size;
+      return size > options->max_header_size ? 431 : PS_HTTP_INCOMPLETE;
+    }
+    if (head_size > options->max_header_size) return 431;
+    connection->head_size = head_size;
+  }
+
+  // A head waiting for its body is parsed again when the body is complete, since the request it was parsed
+  // into has been reused for other connections meanwhile.
+  _purrsock_http_head_t head;
+  int status = _purrsock_http_parse_head(buf, connection->head_size, options->max_body_size, request, &head);
+  if (status != PS_HTTP_COMPLETE) return status;
+  if (new_head) {
+    connection->chunked = head.chunked;
+    connection->body_size = head.chunked ? 0 : (size_t)head.content_length;
+    connection->chunk_offset = connection->head_size;
+  }
+
+  if (connection->chunked) {
+    status = _purrsock_http_dechunk(connection, buf, size);
+  } else {
+    connection->request_size = connection->head_size + connection->body_size;
+    status = size < connection->request_size ? PS_HTTP_INCOMPLETE : PS_HTTP_COMPLETE;
+  }
+
+  if (status == PS_HTTP_INCOMPLETE && head.expect_continue && request->minor_version >= 1 && !connection->continue_sent) {
+    // The client holds the body back until it hears it is wanted.
+    static const char interim[] = "HTTP/1.1 100 Continue\r\n\r\n";
+    connection->continue_sent = true;
+    if (_purrsock_http_append(&connection->out, interim, sizeof(interim) - 1) != PS_SUCCESS) return 500;
+    if (!connection->blocked) _purrsock_http_flush(connection);
+  }
+  if (status != PS_HTTP_COMPLETE) return status;
+
+  request->body = (ps_http_string_t){ buf + connection->head_size, connection->body_size };
+  return PS_HTTP_COMPLETE;
+}
+
+// Takes the result of a partial write of `out` and of `sent` bytes of it: an emptied buffer starts over, a
+// full socket leaves the rest in place for `on_write` to resume.
+static void _purrsock_http_sent(_purrsock_http_connection_t *connection, ps_result_t result, size_t sent) {
+  connection->out_sent += sent;
+  connection->blocked = result == PS_ERROR_WOULDBLOCK;
+  if (result == PS_SUCCESS) {
+    connection->out.size = 0;
+    connection->out_sent = 0;
+    if (connection->out.capacity > PS_HTTP_KEPT_BUFFER_SIZE) {
+      free(connection->out.buf);
+      connection->out = (_purrsock_http_buffer_t){0};
+    }
+  } else if (!connection->blocked) {
+    connection->error = result;
+    connection->closing = true;
+  }
+}
+
+static void _purrsock_http_drop_file(_purrsock_http_connection_t *connection) {
+  if (connection->file < 0) return;
+  _purrsock_close_file(connection->file);
+  connection->file = -1;
+}
+
+// Sends what the socket takes of the file body once `out` is out; the rest waits for `on_write` like `out`.
+static void _purrsock_http_send_file(_purrsock_http_connection_t *connection) {
+  uint64_t sent = 0;
+  ps_result_t result = ps_send_file(connection->socket, connection->file, connection->file_offset, connection->file_remaining, &sent);
+  connection->file_offset += sent;
+  connection->file_remaining -= sent;
+  connection->blocked = result == PS_ERROR_WOULDBLOCK;
+  if (connection->blocked) return;
+
+  _purrsock_http_drop_file(connection);
+  if (result != PS_SUCCESS) {
+    connection->error = result;
+    connection->closing = true;
+  } else if (connection->file_remaining) {
+    // The file shrank after its Content-Length went out; only closing tells the client the body is short.
+    connection->closing = true;
+  }
+}
+
+// Sends what the socket takes of `out`, then of the file body, without waiting; one connection that does not
+// read its responses must not hold up the others of the worker.
+static void _purrsock_http_flush(_purrsock_http_connection_t *connection) {
+  if (connection->error != PS_SUCCESS) return;
+  size_t size = connection->out.size - connection->out_sent;
+  ps_packet_t packet = { size, connection->out.buf + connection->out_sent, size };
+  size_t sent = 0;
+  ps_result_t result = size ? ps_sendv_partial(connection->socket, &packet, 1, &sent) : PS_SUCCESS;
+  _purrsock_http_sent(connection, result, sent);
+  if (result == PS_SUCCESS && connection->file >= 0) _purrsock_http_send_file(connection);
+}
+
+static ps_result_t _purrsock_http_output(_purrsock_http_connection_t *connection, const char *data, size_t size) {
+  if (connection->error != PS_SUCCESS) return connection->error;
+  ps_result_t result = _purrsock_http_append(&connection->out, data, size);
+  if (result != PS_SUCCESS) {
+    connection->error = result;
+    connection->closing = true;
+  }
+  return result;
+}
+
+// Large bodies go out right away behind the buffered responses, without being copied; they are only
+// buffered when the socket is full.
+static ps_result_t _purrsock_http_output_body(_purrsock_http_connection_t *connection, const char *data, size_t size) {
+  if (size < PS_HTTP_DIRECT_SEND_SIZE || connection->blocked || connection->error != PS_SUCCESS) {
+    return _purrsock_http_output(connection, data, size);
+  }
+
+  size_t buffered = connection->out.size - connection->out_sent;
+  ps_packet_t slices[2] = { { buffered, connection->out.buf + connection->out_sent, buffered }, { size, (char *)data, size } };
+  size_t first = buffered ? 0 : 1;
+  size_t sent = 0;
+  ps_result_t result = ps_sendv_partial(connection->socket, slices + first, 2 - first, &sent);
+  if (result != PS_ERROR_WOULDBLOCK) {
+    _purrsock_http_sent(connection, result, sent);
+    return result;
+  }
+
+  // Whatever of the body did not go out is buffered behind the rest of `out`.
+  size_t body_sent = sent > buffered ? sent - buffered : 0;
+  _purrsock_http_sent(connection, result, sent - body_sent);
+  return _purrsock_http_output(connection, data + body_sent, size - body_sent);
+}
+
+static ps_result_t _purrsock_http_write_head(_purrsock_http_response_t *response, const char *framing, size_t framing_size) {
+  _purrsock_http_connection_t *connection = response->connection;
+  _purrsock_http_worker_t *worker = connection->worker;
+  if (connection->error != PS_SUCCESS) return connection->error;
+
+  char scratch[32];
+  ps_http_string_t status_line = _purrsock_http_status_line(response->status, scratch, sizeof(scratch));
+  _purrsock_http_refresh_date(worker);
+
+  ps_http_string_t persistence = { "", 0 };
+  if (!response->keep_alive) {
+    persistence = (ps_http_string_t){ "Connection: close\r\n", 19 };
+  } else if (response->minor_version == 0) {
+    persistence = (ps_http_string_t){ "Connection: keep-alive\r\n", 24 };
+  }
+
+  size_t size = status_line.size + worker->common_size + response->headers.size + framing_size + persistence.size + 2;
+  ps_result_t result = _purrsock_http_reserve(&connection->out, size);
+  if (result != PS_SUCCESS) {
+    connection->error = result;
+    connection->closing = true;
+    return result;
+  }
+
+  char *out = connection->out.buf + connection->out.size;
+  memcpy(out, status_line.buf, status_line.size);
+  out += status_line.size;
+  memcpy(out, worker->common, worker->common_size);
+  out += worker->common_size;
+  if (response->headers.size) memcpy(out, response->headers.buf, response->headers.size);
+  out += response->headers.size;
+  memcpy(out, framing, framing_size);
+  out += framing_size;
+  memcpy(out, persistence.buf, persistence.size);
+  out += persistence.size;
+  memcpy(out, "\r\n", 2);
+  connection->out.size += size;
+  return PS_SUCCESS;
+}
+
+ps_result_t _purrsock_http_response_set_status(_purrsock_http_response_t *response, int status) {
+  assert(response);
+  if (response->state != PS_HTTP_RESPONSE_PENDING || status < 200 || status > 999) return PS_ERROR_INVALID_ARGUMENT;
+  response->status = status;
+  return PS_SUCCESS;
+}
+
+ps_result_t _purrsock_http_response_add_header(_purrsock_http_response_t *response, const char *name, const char *value) {
+  assert(response && name && value);
+  if (response->state != PS_HTTP_RESPONSE_PENDING) return PS_ERROR_INVALID_ARGUMENT;
+
+  ps_http_string_t field = { name, strlen(name) };
+  size_t value_size = strlen(value);
+  if (!_purrsock_http_is_token(field.buf, field.size) || strpbrk(value, "\r\n")) return PS_ERROR_INVALID_ARGUMENT;
+  if (_purrsock_http_is(field, "content-length") || _purrsock_http_is(field, "transfer-encoding") || _purrsock_http_is(field, "connection")) {
+    return PS_ERROR_INVALID_ARGUMENT;
+  }
+
+  ps_result_t result = _purrsock_http_reserve(&response->headers, field.size + value_size + 4);
+  if (result != PS_SUCCESS) return result;
+  char *out = response->headers.buf + response->headers.size;
+  memcpy(out, name, field.size);
+  memcpy(out + field.size, ": ", 2);
+  memcpy(out + field.size + 2, value, value_size);
+  memcpy(out + field.size + 2 + value_size, "\r\n", 2);
+  response->headers.size += field.size + value_size + 4;
+  return PS_SUCCESS;
+}
+
+// 204 and 304 responses end with their head.
+static bool _purrsock_http_bodyless(const _purrsock_http_response_t *response) {
+  return response->status == 204 || response->status == 304;
+}
+
+// Writes the head of a response whose body is `size` bytes long.
+static ps_result_t _purrsock_http_write_sized_head(_purrsock_http_response_t *response, uint64_t size) {
+  char framing[48] = "Content-Length: ";
+  size_t framing_size = 0;
+  if (!_purrsock_http_bodyless(response)) {
+    framing_size = 16 + _purrsock_http_format_number(framing + 16, size, 10);
+    memcpy(framing + framing_size, "\r\n", 2);
+    framing_size += 2;
+  }
+  return _purrsock_http_write_head(response, framing, framing_size);
+}
+
+ps_result_t _purrsock_http_response_send(_purrsock_http_response_t *response, ps_packet_t body) {
+  assert(response);
+  if (response->state != PS_HTTP_RESPONSE_PENDING) return PS_ERROR_INVALID_ARGUMENT;
+  response->state = PS_HTTP_RESPONSE_DONE;
+
+  ps_result_t result = _purrsock_http_write_sized_head(response, body.size);
+  if (result != PS_SUCCESS || response->head_only || _purrsock_http_bodyless(response) || !body.size) return result;
+  return _purrsock_http_output_body(response->connection, body.buf, body.size);
+}
+
+ps_result_t _purrsock_http_response_send_file(_purrsock_http_response_t *response, int fd, uint64_t offset, uint64_t length) {
+  assert(response);
+  // The range is checked before anything is sent, so that a failing handler can still answer otherwise.
+  uint64_t size = 0;
+  ps_result_t result = PS_ERROR_INVALID_ARGUMENT;
+  if (fd >= 0 && response->state == PS_HTTP_RESPONSE_PENDING) result = _purrsock_file_size(fd, &size);
+  if (result == PS_SUCCESS && (offset > size || length > size - offset)) result = PS_ERROR_INVALID_ARGUMENT;
+  if (result != PS_SUCCESS) {
+    if (fd >= 0) _purrsock_close_file(fd);
+    return result;
+  }
+  if (!length) length = size - offset;
+  response->state = PS_HTTP_RESPONSE_DONE;
+
+  _purrsock_http_connection_t *connection = response->connection;
+  result = _purrsock_http_write_sized_head(response, length);
+  if (result != PS_SUCCESS || response->head_only || _purrsock_http_bodyless(response) || !length) {
+    _purrsock_close_file(fd);
+    return result;
+  }
+
+  // The body is sent from the file once the responses before it are out; see `_purrsock_http_answer`.
+  connection->file = fd;
+  connection->file_offset = offset;
+  connection->file_remaining = length;
+  return PS_SUCCESS;
+}
+
+ps_result_t _purrsock_http_response_write(_purrsock_http_response_t *response, ps_packet_t data) {
+  assert(response);
+  if (response->state == PS_HTTP_RESPONSE_DONE) return PS_ERROR_INVALID_ARGUMENT;
+  _purrsock_http_connection_t *connection = response->connection;
+
+  if (response->state == PS_HTTP_RESPONSE_PENDING) {
+    response->state = PS_HTTP_RESPONSE_STREAMING;
+    response->chunked = response->minor_version >= 1;
+    if (!response->chunked) response->keep_alive = false;
+    const char *framing = response->chunked ? "Transfer-Encoding: chunked\r\n" : "";
+    ps_result_t result = _purrsock_http_write_head(response, framing, strlen(framing));
+    if (result != PS_SUCCESS) return result;
+  }
+  if (!data.size || response->head_only) return connection->error;
+  if (!response->chunked) return _purrsock_http_output_body(connection, data.buf, data.size);
+
+  char size_line[20];
+  size_t size_line_size = _purrsock_http_format_number(size_line, data.size, 16);
+  memcpy(size_line + size_line_size, "\r\n", 2);
+  ps_result_t result = _purrsock_http_output(connection, size_line, size_line_size + 2);
+  if (result == PS_SUCCESS) result = _purrsock_http_output_body(connection, data.buf, data.size);
+  if (result == PS_SUCCESS) result = _purrsock_http_output(connection, "\r\n", 2);
+  return result;
+}
+
+ps_result_t _purrsock_http_response_end(_purrsock_http_response_t *response) {
+  assert(response);
+  if (response->state == PS_HTTP_RESPONSE_PENDING) return _purrsock_http_response_send(response, (ps_packet_t){0});
+  if (response->state != PS_HTTP_RESPONSE_STREAMING) return PS_ERROR_INVALID_ARGUMENT;
+  response->state = PS_HTTP_RESPONSE_DONE;
+  if (!response->chunked || response->head_only) return response->connection->error;
+  return _purrsock_http_output(response->connection, "0\r\n\r\n", 5);
+}
+
+bool _purrsock_http_request_header(const ps_http_request_t *request, const char *name, ps_http_string_t *value) {
+  assert(request && name);
+  size_t size = strlen(name);
+  for (size_t i = 0; i < request->header_count; ++i) {
+    const ps_http_header_t *header = &request->headers[i];
+    if (header->name.size == size && _purrsock_http_iequals(header->name.buf, name, size)) {
+      if (value) *value = header->value;
+      return true;
+    }
+  }
+  return false;
+}
+
+static uint64_t _purrsock_http_hash(const char *path, size_t size) {
+  uint64_t hash = 0xcbf29ce484222325ull;  // FNV-1a
+  for (size_t i = 0; i < size; ++i) hash = (hash ^ (unsigned char)path[i]) * 0x100000001b3ull;
+  return hash;
+}
+
+static bool _purrsock_http_route_accepts(const _purrsock_http_route_t *route, ps_http_string_t method) {
+  return !route->method || (route->method_size == method.size && memcmp(route->method, method.buf, method.size) == 0);
+}
+
+// Picks the most specific route accepting the method: exact paths before prefixes, longer prefixes first.
+static const _purrsock_http_route_t *_purrsock_http_find_route(const _purrsock_http_server_t *server, const ps_http_request_t *request, bool *path_found) {
+  ps_http_string_t path = request->path;
+  bool head = request->method.size == 4 && memcmp(request->method.buf, "HEAD", 4) == 0;
+  ps_http_string_t get = { "GET", 3 };
+  const _purrsock_http_route_t *fallback = NULL;  // GET route answering a HEAD request.
+  *path_found = false;
+
+  if (server->bucket_count) {
+    uint64_t hash = _purrsock_http_hash(path.buf, path.size);
+    for (const _purrsock_http_route_t *route = server->buckets[hash & (server->bucket_count - 1)]; route; route = route->next) {
+      if (route->hash != hash || route->path_size != path.size || memcmp(route->path, path.buf, path.size) != 0) continue;
+      *path_found = true;
+      if (_purrsock_http_route_accepts(route, request->method)) return route;
+      if (head && !fallback && _purrsock_http_route_accepts(route, get)) fallback = route;
+    }
+    if (fallback) return fallback;
+  }
+
+  for (const _purrsock_http_route_t *route = server->prefix_routes; route; route = route->next) {
+    if (route->path_size > path.size || memcmp(route->path, path.buf, route->path_size) != 0) continue;
+    *path_found = true;
+    if (_purrsock_http_route_accepts(route, request->method)) return route;
+    if (head && !fallback && _purrsock_http_route_accepts(route, get)) fallback = route;
+  }
+  return fallback;
+}
+
+static _purrsock_http_response_t *_purrsock_http_begin_response(_purrsock_http_connection_t *connection, int minor_version, bool keep_alive, bool head_only) {
+  _purrsock_http_response_t *response = &connection->worker->response;
+  response->connection = connection;
+  response->status = 200;
+  response->headers.size = 0;
+  response->state = PS_HTTP_RESPONSE_PENDING;
+  response->minor_version = minor_version;
+  response->keep_alive = keep_alive;
+  response->head_only = head_only;
+  response->chunked = false;
+  return response;
+}
+
+static void _purrsock_http_finish_response(_purrsock_http_response_t *response) {
+  if (response->state != PS_HTTP_RESPONSE_DONE) _purrsock_http_response_end(response);
+  if (!response->keep_alive) response->connection->closing = true;
+}
+
+static void _purrsock_http_dispatch(_purrsock_http_connection_t *connection, const ps_http_request_t *request) {
+  bool head = request->method.size == 4 && memcmp(request->method.buf, "HEAD", 4) == 0;
+  _purrsock_http_response_t *response = _purrsock_http_begin_response(connection, request->minor_version, request->keep_alive, head);
+
+  bool path_found;
+  const _purrsock_http_route_t *route = _purrsock_http_find_route(connection->worker->server, request, &path_found);
+  if (route) {
+    route->handler(request, (ps_http_response_t)response, route->user_data);
+  } else {
+    response->status = path_found ? 405 : 404;
+  }
+  _purrsock_http_finish_response(response);
+}
+
+// After a malformed request the stream cannot be split into requests any more, so the connection is
+// closed after the error response.
+static void _purrsock_http_reject(_purrsock_http_connection_t *connection, int status) {
+  _purrsock_http_response_t *response = _purrsock_http_begin_response(connection, 1, false, false);
+  response->status = status;
+  _purrsock_http_finish_response(response);
+}
+
+static void _purrsock_http_close(_purrsock_http_connection_t *connection) {
+  ps_loop_stop_timer(connection->worker->loop, &connection->idle_timer);
+  *connection->prev = connection->next;
+  if (connection->next) connection->next->prev = connection->prev;
+  ps_destroy_socket(connection->socket);
+  _purrsock_http_drop_file(connection);
+  free(connection->in);
+  free(connection->out.buf);
+  free(connection);
+}
+
+// Answers the complete requests buffered, in order, into `out`.
+static void _purrsock_http_answer(_purrsock_http_connection_t *connection) {
+  ps_http_request_t *request = &connection->worker->request;
+  while (!connection->closing && !connection->blocked && connection->in_start < connection->in_end) {
+    int status = _purrsock_http_parse(connection, request);
+    if (status == PS_HTTP_INCOMPLETE) break;
+    if (status != PS_HTTP_COMPLETE) {
+      _purrsock_http_reject(connection, status);
+      break;
+    }
+
+    _purrsock_http_dispatch(connection, request);
+    connection->in_start += connection->request_size;
+    connection->scanned = 0;
+    connection->head_size = 0;
+    connection->continue_sent = false;
+    connection->active_since = ps_loop_now(connection->worker->loop);
+
+    // Long pipelines are answered in batches rather than piling up in memory. A file body goes out before
+    // the next response is written; until it has, the connection counts as blocked.
+    if (connection->out.size >= PS_HTTP_KEPT_BUFFER_SIZE || connection->file >= 0) _purrsock_http_flush(connection);
+  }
+
+  if (connection->in_start == connection->in_end && !connection->head_size) {
+    connection->in_start = connection->in_end = 0;
+    if (connection->in_capacity > PS_HTTP_KEPT_BUFFER_SIZE) {
+      char *in = (char *)realloc(connection->in, PS_HTTP_READ_BUFFER_SIZE);
+      if (in) {
+        connection->in = in;
+        connection->in_capacity = PS_HTTP_READ_BUFFER_SIZE;
+      }
+    }
+  }
+}
+
+// Makes room to receive into, first by moving the unanswered bytes to the front.
+static ps_result_t _purrsock_http_reserve_input(_purrsock_http_connection_t *connection) {
+  if (connection->in_end < connection->in_capacity) return PS_SUCCESS;
+  if (connection->in_start > 0) {
+    // Parse progress is relative to `in_start`, so it survives the move.
+    memmove(connection->in, connection->in + connection->in_start, connection->in_end - connection->in_start);
+    connection->in_end -= connection->in_start;
+    connection->in_start = 0;
+    return PS_SUCCESS;
+  }
+
+  char *in = (char *)realloc(connection->in, connection->in_capacity * 2);
+  if (!in) return PS_ERROR_INTERNAL;
+  connection->in = in;
+  connection->in_capacity *= 2;
+  return PS_SUCCESS;
+}
+
+// Answers what is buffered and reads more until the socket is drained, then sends all responses at once.
+static void _purrsock_http_serve(_purrsock_http_connection_t *connection) {
+  bool drained = false;
+  while (1) {
+    _purrsock_http_answer(connection);
+    if (drained || connection->closing || connection->blocked) break;
+
+    ps_result_t result = _purrsock_http_reserve_input(connection);
+    if (result == PS_SUCCESS) {
+      ps_packet_t packet = { 0, connection->in + connection->in_end, connection->in_capacity - connection->in_end };
+      result = ps_read_socket_packet(connection->socket, &packet, NULL);
+      if (result == PS_SUCCESS) {
+        connection->in_end += packet.size;
+        // The loop is edge-triggered: a short read emptied the socket, and anything arriving later raises a
+        // new event, so the read that would only report PS_ERROR_WOULDBLOCK is skipped.
+        drained = packet.size < packet.capacity;
+        continue;
+      }
+    }
+    if (result != PS_ERROR_WOULDBLOCK) connection->closing = true;
+    break;
+  }
+
+  if (connection->out.size && !connection->blocked) _purrsock_http_flush(connection);
+  if (connection->closing && !connection->blocked) _purrsock_http_close(connection);
+}
+
+static void _purrsock_http_on_read(ps_loop_t loop, ps_socket_t socket, void *user_data) {
+  (void)loop;
+  (void)socket;
+  _purrsock_http_connection_t *connection = (_purrsock_http_connection_t *)user_data;
+  // Requests stay in the socket while responses wait for room, so TCP pushes back on the client.
+  if (!connection->blocked) _purrsock_http_serve(connection);
+}
+
+static void _purrsock_http_on_write(ps_loop_t loop, ps_socket_t socket, void *user_data) {
+  (void)loop;
+  (void)socket;
+  _purrsock_http_connection_t *connection = (_purrsock_http_connection_t *)user_data;
+  if (!connection->blocked) return;
+
+  _purrsock_http_flush(connection);
+  if (connection->blocked) return;
+  if (connection->closing) {
+    _purrsock_http_close(connection);
+    return;
+  }
+  // Requests held back while blocked, and any that arrived meanwhile without a new read event.
+  _purrsock_http_serve(connection);
+}
+
+static void _purrsock_http_on_close(ps_loop_t loop, ps_socket_t socket, void *user_data) {
+  (void)loop;
+  (void)socket;
+  _purrsock_http_close((_purrsock_http_connection_t *)user_data);
+}
+
+static void _purrsock_http_idle_expired(ps_loop_t loop, ps_timer_t *timer, void *user_data) {
+  _purrsock_http_connection_t *connection = (_purrsock_http_connection_t *)user_data;
+  uint32_t timeout = connection->worker->server->options.idle_timeout_ms;
+
+  // The timer is not restarted for every request; it waits out the rest of the timeout when it fires.
+  uint64_t idle = ps_loop_now(loop) - connection->active_since;
+  if (idle < timeout) {
+    ps_loop_start_timer(loop, timer, timeout - idle);
+    return;
+  }
+  _purrsock_http_close(connection);
+}
+
+static void _purrsock_http_on_accept(ps_loop_t loop, ps_socket_t listener, ps_socket_t client, void *user_data) {
+  (void)listener;
+  _purrsock_http_server_t *server = (_purrsock_http_server_t *)user_data;
+  _purrsock_http_worker_t *worker = NULL;
+  for (size_t i = 0; i < server->worker_count && !worker; ++i) {
+    if (server->workers[i].loop == loop) worker = &server->workers[i];
+  }
+
+  _purrsock_http_connection_t *connection = (_purrsock_http_connection_t *)calloc(1, sizeof(*connection));
+  char *in = (char *)malloc(PS_HTTP_READ_BUFFER_SIZE);
+  if (!worker || !connection || !in) {
+    free(connection);
+    free(in);
+    ps_destroy_socket(client);
+    return;
+  }
+  connection->worker = worker;
+  connection->socket = client;
+  connection->in = in;
+  connection->in_capacity = PS_HTTP_READ_BUFFER_SIZE;
+  connection->file = -1;
+
+  // Every response is written whole, so it should not wait for the ACK of the one before.
+  ps_set_socket_nodelay(client, true);
+
+  ps_loop_callbacks_t callbacks = {0};
+  callbacks.on_read = _purrsock_http_on_read;
+  callbacks.on_write = _purrsock_http_on_write;
+  callbacks.on_close = _purrsock_http_on_close;
+  callbacks.user_data = connection;
+  if (ps_loop_add_socket(loop, client, callbacks) != PS_SUCCESS) {
+    free(connection);
+    free(in);
+    ps_destroy_socket(client);
+    return;
+  }
+
+  connection->next = worker->connections;
+  connection->prev = &worker->connections;
+  if (worker->connections) worker->connections->prev = &connection->next;
+  worker->connections = connection;
+
+  ps_timer_init(&connection->idle_timer, _purrsock_http_idle_expired, connection);
+  connection->active_since = ps_loop_now(loop);
+  ps_loop_start_timer(loop, &connection->idle_timer, server->options.idle_timeout_ms);
+}
+
+ps_result_t _purrsock_create_http_server(_purrsock_http_server_t **server, ps_address_t address, const char *ip, ps_port_t port, const ps_http_server_options_t *options) {
+  assert(server && ip);
+  ps_http_server_options_t defaults = {0};
+  if (!options) options = &defaults;
+  const char *server_name = options->server_name ? options->server_name : "purrsock";
+  if (strpbrk(server_name, "\r\n")) return PS_ERROR_INVALID_ARGUMENT;
+
+  _purrsock_http_server_t *new_server = (_purrsock_http_server_t *)calloc(1, sizeof(*new_server));
+  if (!new_server) return PS_ERROR_INTERNAL;
+  new_server->options = *options;
+  new_server->options.server_name = NULL;
+  if (!new_server->options.max_header_size) new_server->options.max_header_size = PS_HTTP_DEFAULT_MAX_HEADER_SIZE;
+  if (!new_server->options.max_body_size) new_server->options.max_body_size = PS_HTTP_DEFAULT_MAX_BODY_SIZE;
+  if (!new_server->options.idle_timeout_ms) new_server->options.idle_timeout_ms = PS_HTTP_DEFAULT_IDLE_TIMEOUT_MS;
+
+  ps_server_options_t server_options = {0};
+  server_options.workers = options->workers;
+  server_options.pin_workers = options->pin_workers;
+  server_options.loop_options = options->loop_options;
+  server_options.on_accept = _purrsock_http_on_accept;
+  server_options.user_data = new_server;
+  ps_result_t result = ps_create_server(&new_server->server, address, ip, port, &server_options);
+  if (result != PS_SUCCESS) {
+    free(new_server);
+    return result;
+  }
+
+  new_server->worker_count = ps_server_get_worker_count(new_server->server);
+  new_server->workers = (_purrsock_http_worker_t *)calloc(new_server->worker_count, sizeof(*new_server->workers));
+  if (!new_server->workers) {
+    _purrsock_destroy_http_server(new_server);
+    return PS_ERROR_INTERNAL;
+  }
+
+  // "Server: <name>\r\n" unless the name is empty, then the Date line, which is filled in on first use.
+  size_t name_size = strlen(server_name);
+  size_t server_line_size = name_size ? name_size + 10 : 0;
+  for (size_t i = 0; i < new_server->worker_count; ++i) {
+    _purrsock_http_worker_t *worker = &new_server->workers[i];
+    worker->server = new_server;
+    worker->loop = ps_server_get_loop(new_server->server, i);
+    worker->common_size = server_line_size + PS_HTTP_DATE_LINE_SIZE;
+    worker->common = (char *)malloc(worker->common_size + 1);
+    if (!worker->common) {
+      _purrsock_destroy_http_server(new_server);
+      return PS_ERROR_INTERNAL;
+    }
+    if (name_size) snprintf(worker->common, server_line_size + 1, "Server: %s\r\n", server_name);
+  }
+
+  *server = new_server;
+  return PS_SUCCESS;
+}
+
+void _purrsock_destroy_http_server(_purrsock_http_server_t *server) {
+  assert(server);
+  if (server->server) ps_server_stop(server->server);
+
+  // With the workers stopped, their connections can be closed from here.
+  for (size_t i = 0; server->workers && i < server->worker_count; ++i) {
+    _purrsock_http_worker_t *worker = &server->workers[i];
+    while (worker->connections) _purrsock_http_close(worker->connections);
+    free(worker->response.headers.buf);
+    free(worker->common);
+  }
+  free(server->workers);
+  if (server->server) ps_destroy_server(server->server);
+
+  for (size_t i = 0; i < server->bucket_count; ++i) {
+    while (server->buckets[i]) {
+      _purrsock_http_route_t *route = server->buckets[i];
+      server->buckets[i] = route->next;
+      free(route);
+    }
+  }
+  free(server->buckets);
+  while (server->prefix_routes) {
+    _purrsock_http_route_t *route = server->prefix_routes;
+    server->prefix_routes = route->next;
+    free(route);
+  }
+  free(server);
+}
+
+static bool _purrsock_http_same_route(const _purrsock_http_route_t *a, const _purrsock_http_route_t *b) {
+  if (a->prefix != b->prefix || a->path_size != b->path_size || memcmp(a->path, b->path, a->path_size) != 0) return false;
+  if (!a->method || !b->method) return !a->method && !b->method;
+  return a->method_size == b->method_size && memcmp(a->method, b->method, a->method_size) == 0;
+}
+
+// Doubles the hash table once it holds as many routes as buckets.
+static ps_result_t _purrsock_http_grow_buckets(_purrsock_http_server_t *server) {
+  if (server->exact_count < server->bucket_count) return PS_SUCCESS;
+  size_t bucket_count = server->bucket_count ? server->bucket_count * 2 : 16;
+  _purrsock_http_route_t **buckets = (_purrsock_http_route_t **)calloc(bucket_count, sizeof(*buckets));
+  if (!buckets) return PS_ERROR_INTERNAL;
+  for (size_t i = 0; i < server->bucket_count; ++i) {
+    while (server->buckets[i]) {
+      _purrsock_http_route_t *route = server->buckets[i];
+      server->buckets[i] = route->next;
+      route->next = buckets[route->hash & (bucket_count - 1)];
+      buckets[route->hash & (bucket_count - 1)] = route;
+    }
+  }
+  free(server->buckets);
+  server->buckets = buckets;
+  server->bucket_count = bucket_count;
+  return PS_SUCCESS;
+}
+
+ps_result_t _purrsock_http_route(_purrsock_http_server_t *server, const char *method, const char *path, ps_http_handler_t handler, void *user_data) {
+  assert(server && path && handler);
+  if (server->started || path[0] != '/' || (method && !_purrsock_http_is_token(method, strlen(method)))) return PS_ERROR_INVALID_ARGUMENT;
+
+  // The route and copies of its strings share one allocation.
+  size_t method_size = method ? strlen(method) : 0;
+  size_t path_size = strlen(path);
+  _purrsock_http_route_t *route = (_purrsock_http_route_t *)malloc(sizeof(*route) + method_size + path_size + 2);
+  if (!route) return PS_ERROR_INTERNAL;
+  char *strings = (char *)(route + 1);
+  memcpy(strings, path, path_size + 1);
+  route->path = strings;
+  route->prefix = path[path_size - 1] == '*';
+  route->path_size = route->prefix ? path_size - 1 : path_size;
+  route->method = NULL;
+  route->method_size = method_size;
+  if (method) {
+    memcpy(strings + path_size + 1, method, method_size + 1);
+    route->method = strings + path_size + 1;
+  }
+  route->hash = _purrsock_http_hash(route->path, route->path_size);
+  route->handler = handler;
+  route->user_data = user_data;
+
+  _purrsock_http_route_t **link;
+  if (route->prefix) {
+    link = &server->prefix_routes;
+    while (*link && (*link)->path_size >= route->path_size) {
+      if (_purrsock_http_same_route(*link, route)) break;
+      link = &(*link)->next;
+    }
+  } else {
+    if (_purrsock_http_grow_buckets(server) != PS_SUCCESS) {
+      free(route);
+      return PS_ERROR_INTERNAL;
+    }
+    link = &server->buckets[route->hash & (server->bucket_count - 1)];
+    while (*link && !_purrsock_http_same_route(*link, route)) link = &(*link)->next;
+  }
+  if (*link && _purrsock_http_same_route(*link, route)) {
+    free(route);
+    return PS_ERROR_INVALID_ARGUMENT;
+  }
+
+  route->next = *link;
+  *link = route;
+  if (!route->prefix) server->exact_count++;
+  return PS_SUCCESS;
+}
+
+ps_result_t _purrsock_http_server_start(_purrsock_http_server_t *server) {
+  assert(server);
+  // Workers read the routing table without locks, so it is frozen while they run.
+  server->started = true;
+  ps_result_t result = ps_server_start(server->server);
+  if (result != PS_SUCCESS) server->started = false;
+  return result;
+}
+
+ps_result_t _purrsock_http_server_stop(_purrsock_http_server_t *server) {
+  assert(server);
+  ps_result_t result = ps_server_stop(server->server);
+  server->started = false;
+  return result;
+}
+
+ps_port_t _purrsock_http_server_get_port(_purrsock_http_server_t *server) {
+  assert(server);
+  return ps_server_get_port(server->server);
+}
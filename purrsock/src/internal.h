@@ -15,18 +15,131 @@
 #include <winsock2.h>
 #else
 #include <sys/socket.h>
+#include <pthread.h>
 #endif
 
+#ifdef _MSC_VER
+#define PS_THREAD_LOCAL __declspec(thread)
+#else
+#define PS_THREAD_LOCAL _Thread_local
+#endif
+
+#ifdef _WIN32
+typedef CRITICAL_SECTION _purrsock_mutex_t;
+typedef CONDITION_VARIABLE _purrsock_cond_t;
+typedef HANDLE _purrsock_thread_t;
+#else
+typedef pthread_mutex_t _purrsock_mutex_t;
+typedef pthread_cond_t _purrsock_cond_t;
+typedef pthread_t _purrsock_thread_t;
+#endif
+
+typedef struct _purrsock_packet_pool_s _purrsock_packet_pool_t;
+typedef struct _purrsock_framed_socket_s _purrsock_framed_socket_t;
+typedef struct _purrsock_buffered_stream_s _purrsock_buffered_stream_t;
+typedef struct _purrsock_server_s _purrsock_server_t;
+typedef struct _purrsock_executor_s _purrsock_executor_t;
+typedef struct _purrsock_conn_pool_s _purrsock_conn_pool_t;
+typedef struct _purrsock_conn_pool_key_s _purrsock_conn_pool_key_t;
+typedef struct _purrsock_resolver_s _purrsock_resolver_t;
+typedef struct _purrsock_memory_socket_s _purrsock_memory_socket_t;
+typedef struct _purrsock_http_server_s _purrsock_http_server_t;
+typedef struct _purrsock_http_response_s _purrsock_http_response_t;
+typedef struct _purrsock_websocket_s _purrsock_websocket_t;
+
+// Capacity of pooled buffers handed to reads that did not supply one.
+#define PS_PACKET_STREAM_CAPACITY 4096
+#define PS_PACKET_DATAGRAM_CAPACITY 65536
+
+typedef struct _purrsock_loop_s _purrsock_loop_t;
+typedef struct _purrsock_loop_ops_s _purrsock_loop_ops_t;
+typedef struct _purrsock_zerocopy_s _purrsock_zerocopy_t;
+typedef struct _purrsock_heartbeat_s _purrsock_heartbeat_t;
+typedef struct _purrsock_stats_shard_s _purrsock_stats_shard_t;
+
+// Hierarchical timing wheel with millisecond ticks. Level L holds timers whose expiry first differs from
+// the current time in bits [6L, 6L + 6), in the slot given by those bits; 11 levels cover all 64 bits.
+#define PS_TIMER_WHEEL_BITS 6
+#define PS_TIMER_WHEEL_SLOTS (1 << PS_TIMER_WHEEL_BITS)
+#define PS_TIMER_WHEEL_LEVELS 11
+
+typedef struct {
+  uint64_t current;                                             // Time up to which timers were expired.
+  uint64_t occupied[PS_TIMER_WHEEL_LEVELS];                     // Bit per non-empty slot.
+  ps_timer_t *slots[PS_TIMER_WHEEL_LEVELS * PS_TIMER_WHEEL_SLOTS];
+  size_t count;
+} _purrsock_timer_wheel_t;
+
 typedef struct {
   ps_protocol_t protocol;
   void *data;
   struct sockaddr_storage addr_storage;
+  _purrsock_loop_t *loop;          // Loop the socket is registered with, NULL if none.
+  ps_loop_callbacks_t callbacks;
+  uint32_t loop_events;            // Events the loop polls for, 0 if the socket is not polled.
+  _purrsock_loop_ops_t *loop_ops;  // Asynchronous operations submitted through the loop.
+  _purrsock_zerocopy_t *zerocopy;  // Zero-copy sends awaiting completion, NULL until enabled.
+  _purrsock_heartbeat_t *heartbeat; // Loop heartbeat, NULL if none.
+  ps_socket_timeouts_t timeouts;
+  _purrsock_conn_pool_key_t *pool_key; // Destination of a pooled connection, NULL if not pooled.
+  _purrsock_memory_socket_t *memory; // Transport state of a PS_PROTOCOL_MEMORY or PS_PROTOCOL_SHM socket, whose `data` stays NULL.
+  char *unsent;                    // Rest of a stream send a non-blocking socket ran out of room for; goes out first.
+  size_t unsent_offset;            // Bytes of `unsent` sent since.
+  size_t unsent_size;
+  size_t unsent_capacity;
+#ifdef PURRSOCK_STATS
+  ps_socket_stats_t stats;
+#endif
 } _purrsock_socket_t;
 
+// I/O statistics. PS_STATS_START samples the clock before a system call, PS_STATS_SYSCALL records the call
+// and its latency, PS_STATS_TRANSFER the bytes and packets moved; all compile to nothing without PURRSOCK_STATS.
+#ifdef PURRSOCK_STATS
+#define PS_STATS_START(start) uint64_t start = _purrsock_monotonic_ns()
+#define PS_STATS_SYSCALL(socket, send, wouldblock, start) _purrsock_stats_syscall(socket, send, wouldblock, start)
+#define PS_STATS_TRANSFER(socket, send, bytes, packets) _purrsock_stats_transfer(socket, send, bytes, packets)
+#else
+#define PS_STATS_START(start) ((void)0)
+// The disabled forms still name their arguments, unevaluated, so nothing reads as unused either way.
+#define PS_STATS_SYSCALL(socket, send, wouldblock, start) ((void)sizeof(socket), (void)sizeof(send), (void)sizeof(wouldblock))
+#define PS_STATS_TRANSFER(socket, send, bytes, packets) ((void)sizeof(socket), (void)sizeof(send), (void)sizeof(bytes), (void)sizeof(packets))
+#endif
+
+#ifdef __linux__
+typedef struct {
+  int sockfd;
+} _purrsock_socket_data_t;
+
+_purrsock_socket_t *_purrsock_socket_from_fd(int sockfd, ps_protocol_t protocol, const struct sockaddr_storage *addr);
+socklen_t _purrsock_endpoint_to_sockaddr(const ps_endpoint_t *endpoint, struct sockaddr_storage *addr);
+
+size_t _purrsock_zerocopy_reap(_purrsock_socket_t *socket);
+bool _purrsock_zerocopy_pending(_purrsock_socket_t *socket);
+void _purrsock_zerocopy_destroy(_purrsock_socket_t *socket);  // Takes over the socket's fd while packets are still pinned.
+void _purrsock_zerocopy_cleanup();  // Waits a bounded time for the packets of destroyed sockets.
+bool _purrsock_socket_has_error(_purrsock_socket_t *socket);
+
+#ifdef PURRSOCK_HAS_IO_URING
+struct io_uring_sqe;
+typedef struct _purrsock_uring_s _purrsock_uring_t;
+
+ps_result_t _purrsock_uring_create(_purrsock_uring_t **ring, unsigned entries);
+void _purrsock_uring_destroy(_purrsock_uring_t *ring);
+struct io_uring_sqe *_purrsock_uring_get_sqe(_purrsock_uring_t *ring);
+int _purrsock_uring_submit(_purrsock_uring_t *ring, bool get_events, int timeout_ms);
+bool _purrsock_uring_next_cqe(_purrsock_uring_t *ring, uint64_t *user_data, int32_t *res, uint32_t *flags);
+ps_result_t _purrsock_uring_setup_buffers(_purrsock_uring_t *ring, size_t buf_size, unsigned buf_count);
+char *_purrsock_uring_buffer(_purrsock_uring_t *ring, uint16_t bid);
+void _purrsock_uring_recycle_buffer(_purrsock_uring_t *ring, uint16_t bid);
+#endif
+#endif
+
 // Definitions
 
 const char* get_platform();
+bool _purrsock_is_datagram(ps_protocol_t protocol); // Keeps message boundaries; the other protocols are byte streams.
 void logWSAError(int error);
+ps_result_t _last_ps_result(const char *func_name);
 
 bool _purrsock_init();
 void _purrsock_cleanup();
@@ -36,12 +149,219 @@ ps_result_t _purrsock_create_socket_from_addr(_purrsock_socket_t *socket, const
 void _purrsock_destroy_socket(_purrsock_socket_t *socket);
 
 ps_result_t _purrsock_bind_socket(_purrsock_socket_t *socket, const char *ip, ps_port_t port);
-ps_result_t _purrsock_listen_socket(_purrsock_socket_t *socket);
+ps_result_t _purrsock_listen_socket(_purrsock_socket_t *socket, int backlog);
+ps_result_t _purrsock_set_socket_reuseport(_purrsock_socket_t *socket, bool enabled);
+ps_result_t _purrsock_get_socket_endpoint(_purrsock_socket_t *socket, ps_endpoint_t *endpoint);
 ps_result_t _purrsock_accept_socket(_purrsock_socket_t *socket, _purrsock_socket_t **client);
 
 ps_result_t _purrsock_connect_socket(_purrsock_socket_t *socket, const char *ip, ps_port_t port);
 
 ps_result_t _purrsock_read_socket_packet(_purrsock_socket_t *socket, ps_packet_t *packet, _purrsock_socket_t **from);
 ps_result_t _purrsock_send_socket_packet(_purrsock_socket_t *socket, ps_packet_t packet, _purrsock_socket_t *to);
+// Stream sends. `_partial` sends what the socket takes in one pass, never waiting for room on a non-blocking
+// socket, and counts it in `sent` also on failure. `_purrsock_send_stream` sends a message whole, or nothing
+// with PS_ERROR_WOULDBLOCK: once part of it is out, the rest is kept in `unsent` instead of waited for.
+ps_result_t _purrsock_send_stream_partial(_purrsock_socket_t *socket, const ps_packet_t *slices, size_t count, size_t *sent);
+ps_result_t _purrsock_send_stream(_purrsock_socket_t *socket, const ps_packet_t *slices, size_t count);
+ps_result_t _purrsock_flush_socket(_purrsock_socket_t *socket);
+char *_purrsock_reserve_unsent(_purrsock_socket_t *socket, size_t size);  // Room for `size` more kept bytes.
+
+ps_result_t _purrsock_set_socket_zerocopy(_purrsock_socket_t *socket, bool enabled);
+ps_result_t _purrsock_send_socket_packet_zerocopy(_purrsock_socket_t *socket, ps_packet_t packet, ps_zerocopy_completion_t callback, void *user_data);
+ps_result_t _purrsock_process_zerocopy_completions(_purrsock_socket_t *socket, size_t *completed);
+
+int _purrsock_open_file(const char *path);
+void _purrsock_close_file(int fd);
+ps_result_t _purrsock_file_size(int fd, uint64_t *size);  // Regular files only.
+ps_result_t _purrsock_send_file(_purrsock_socket_t *socket, int fd, uint64_t offset, uint64_t length, uint64_t *sent);
+ps_result_t _purrsock_send_socket_fds(_purrsock_socket_t *socket, ps_packet_t packet, const int *fds, size_t count);
+ps_result_t _purrsock_read_socket_fds(_purrsock_socket_t *socket, ps_packet_t *packet, int *fds, size_t capacity, size_t *count);
+ps_result_t _purrsock_pass_socket(_purrsock_socket_t *channel, _purrsock_socket_t *socket);
+ps_result_t _purrsock_accept_passed_socket(_purrsock_socket_t *channel, _purrsock_socket_t **socket);
+ps_result_t _purrsock_splice(_purrsock_socket_t *from, _purrsock_socket_t *to, size_t length, size_t *moved);
+
+ps_result_t _purrsock_endpoint_from_addr(ps_endpoint_t *endpoint, const char *ip, ps_port_t port);
+ps_result_t _purrsock_endpoint_to_addr(const ps_endpoint_t *endpoint, char *ip, size_t ip_size);
+ps_result_t _purrsock_resolve_host(const char *host, char *ip, size_t ip_size);  // Blocking lookup to a literal address.
+ps_result_t _purrsock_read_socket_packets(_purrsock_socket_t *socket, ps_packet_t *packets, ps_endpoint_t *from, size_t count, size_t *received);
+ps_result_t _purrsock_send_socket_packets(_purrsock_socket_t *socket, const ps_packet_t *packets, const ps_endpoint_t *to, size_t count, size_t *sent);
+ps_result_t _purrsock_sendv(_purrsock_socket_t *socket, const ps_packet_t *slices, size_t count, const ps_endpoint_t *to);
+ps_result_t _purrsock_recvv(_purrsock_socket_t *socket, ps_packet_t *slices, size_t count, size_t *received, ps_endpoint_t *from);
+
+ps_result_t _purrsock_send_socket_packet_segmented(_purrsock_socket_t *socket, ps_packet_t packet, size_t segment_size, const ps_endpoint_t *to, size_t *sent);
+ps_result_t _purrsock_set_socket_gro(_purrsock_socket_t *socket, bool enabled);
+ps_result_t _purrsock_read_socket_packet_segmented(_purrsock_socket_t *socket, ps_packet_t *packet, size_t *segment_size, ps_endpoint_t *from);
+
+ps_result_t _purrsock_set_socket_blocking(_purrsock_socket_t *socket, bool blocking);
+ps_result_t _purrsock_set_socket_nodelay(_purrsock_socket_t *socket, bool enabled);
+ps_result_t _purrsock_set_socket_timeouts(_purrsock_socket_t *socket, const ps_socket_timeouts_t *timeouts);
+ps_result_t _purrsock_set_socket_cork(_purrsock_socket_t *socket, bool enabled);
+bool _purrsock_socket_is_idle_alive(_purrsock_socket_t *socket);
+
+void _purrsock_mutex_init(_purrsock_mutex_t *mutex);
+void _purrsock_mutex_destroy(_purrsock_mutex_t *mutex);
+void _purrsock_mutex_lock(_purrsock_mutex_t *mutex);
+void _purrsock_mutex_unlock(_purrsock_mutex_t *mutex);
+void _purrsock_cond_init(_purrsock_cond_t *cond);
+void _purrsock_cond_destroy(_purrsock_cond_t *cond);
+void _purrsock_cond_wait(_purrsock_cond_t *cond, _purrsock_mutex_t *mutex);
+bool _purrsock_cond_timed_wait(_purrsock_cond_t *cond, _purrsock_mutex_t *mutex, uint32_t timeout_ms);  // false once timed out.
+void _purrsock_cond_signal(_purrsock_cond_t *cond);
+void _purrsock_cond_broadcast(_purrsock_cond_t *cond);
+void _purrsock_at_thread_exit(void (*callback)(void));  // One callback per thread; used by the packet pool.
+ps_result_t _purrsock_thread_create(_purrsock_thread_t *thread, void (*entry)(void *), void *arg);
+void _purrsock_thread_join(_purrsock_thread_t thread);
+bool _purrsock_thread_pin(_purrsock_thread_t thread, size_t cpu);
+size_t _purrsock_cpu_count();
+uint64_t _purrsock_monotonic_ms();
+uint64_t _purrsock_monotonic_us();
+uint64_t _purrsock_monotonic_ns();
+bool _purrsock_random(void *buf, size_t size);  // Fills `buf` from the system's secure random source.
+
+// Named shared memory and futexes for PS_PROTOCOL_SHM. Creating fails with PS_ERROR_ADDRINUSE if the name
+// exists, opening with PS_ERROR_CONNREFUSED if it does not; new segments are zeroed.
+ps_result_t _purrsock_shm_map(const char *name, size_t size, bool create, void **addr);
+void _purrsock_shm_unmap(void *addr, size_t size);
+void _purrsock_shm_unlink(const char *name);
+void _purrsock_futex_wait(uint32_t *word, uint32_t value, uint32_t timeout_ms);
+void _purrsock_futex_wake(uint32_t *word);
+uint32_t _purrsock_process_id();
+bool _purrsock_process_alive(uint32_t pid);
+
+ps_result_t _purrsock_create_packet_pool(_purrsock_packet_pool_t **pool);
+void _purrsock_destroy_packet_pool(_purrsock_packet_pool_t *pool);
+bool _purrsock_init_default_packet_pool();
+_purrsock_packet_pool_t *_purrsock_default_packet_pool();
+ps_result_t _purrsock_packet_acquire(_purrsock_packet_pool_t *pool, size_t size, ps_packet_t *packet);
+void _purrsock_packet_release(ps_packet_t *packet);
+void _purrsock_get_packet_pool_stats(_purrsock_packet_pool_t *pool, ps_packet_pool_stats_t *stats);
+
+ps_result_t _purrsock_create_framed_socket(_purrsock_framed_socket_t **framed, _purrsock_socket_t *socket, const ps_framing_options_t *options);
+void _purrsock_destroy_framed_socket(_purrsock_framed_socket_t *framed);
+ps_result_t _purrsock_framed_read(_purrsock_framed_socket_t *framed, ps_packet_t *frame);
+ps_result_t _purrsock_framed_send(_purrsock_framed_socket_t *framed, ps_packet_t payload);
+
+ps_result_t _purrsock_create_buffered_stream(_purrsock_buffered_stream_t **stream, _purrsock_socket_t *socket, const ps_buffered_stream_options_t *options);
+void _purrsock_destroy_buffered_stream(_purrsock_buffered_stream_t *stream);
+ps_result_t _purrsock_buffered_stream_read(_purrsock_buffered_stream_t *stream, ps_packet_t *packet);
+ps_result_t _purrsock_buffered_stream_write(_purrsock_buffered_stream_t *stream, ps_packet_t packet);
+ps_result_t _purrsock_buffered_stream_flush(_purrsock_buffered_stream_t *stream);
+size_t _purrsock_buffered_stream_pending(_purrsock_buffered_stream_t *stream);
+
+ps_result_t _purrsock_create_server(_purrsock_server_t **server, ps_address_t address, const char *ip, ps_port_t port, const ps_server_options_t *options);
+void _purrsock_destroy_server(_purrsock_server_t *server);
+ps_result_t _purrsock_server_start(_purrsock_server_t *server);
+ps_result_t _purrsock_server_stop(_purrsock_server_t *server);
+ps_port_t _purrsock_server_get_port(_purrsock_server_t *server);
+size_t _purrsock_server_get_worker_count(_purrsock_server_t *server);
+ps_loop_t _purrsock_server_get_loop(_purrsock_server_t *server, size_t worker);
+
+ps_result_t _purrsock_create_executor(_purrsock_executor_t **executor, const ps_executor_options_t *options);
+void _purrsock_destroy_executor(_purrsock_executor_t *executor);
+ps_result_t _purrsock_executor_submit(_purrsock_executor_t *executor, ps_task_callback_t callback, void *user_data);
+size_t _purrsock_executor_get_worker_count(_purrsock_executor_t *executor);
+
+ps_result_t _purrsock_create_conn_pool(_purrsock_conn_pool_t **pool, const ps_conn_pool_options_t *options);
+void _purrsock_destroy_conn_pool(_purrsock_conn_pool_t *pool);
+ps_result_t _purrsock_conn_pool_checkout(_purrsock_conn_pool_t *pool, const char *host, ps_port_t port, ps_protocol_t protocol, _purrsock_socket_t **socket);
+void _purrsock_conn_pool_checkin(_purrsock_conn_pool_t *pool, _purrsock_socket_t *socket, bool reusable);
+void _purrsock_conn_pool_maintain(_purrsock_conn_pool_t *pool);
+void _purrsock_get_conn_pool_stats(_purrsock_conn_pool_t *pool, ps_conn_pool_stats_t *stats);
+
+ps_result_t _purrsock_memory_create(_purrsock_socket_t *socket);
+void _purrsock_memory_destroy(_purrsock_socket_t *socket);
+ps_result_t _purrsock_memory_bind(_purrsock_socket_t *socket, const char *ip, ps_port_t port);
+ps_result_t _purrsock_memory_listen(_purrsock_socket_t *socket, int backlog);
+ps_result_t _purrsock_memory_accept(_purrsock_socket_t *socket, _purrsock_socket_t **client);
+ps_result_t _purrsock_memory_connect(_purrsock_socket_t *socket, const char *ip, ps_port_t port);
+ps_result_t _purrsock_memory_get_endpoint(_purrsock_socket_t *socket, ps_endpoint_t *endpoint);
+ps_result_t _purrsock_memory_set_blocking(_purrsock_socket_t *socket, bool blocking);
+ps_result_t _purrsock_memory_read(_purrsock_socket_t *socket, ps_packet_t *packet);
+ps_result_t _purrsock_memory_recvv(_purrsock_socket_t *socket, ps_packet_t *slices, size_t count, size_t *received);
+ps_result_t _purrsock_memory_sendv(_purrsock_socket_t *socket, const ps_packet_t *slices, size_t count, size_t *sent);
+bool _purrsock_memory_is_idle_alive(_purrsock_socket_t *socket);
+
+void _purrsock_stats_syscall(_purrsock_socket_t *socket, bool send, bool wouldblock, uint64_t start_ns);
+void _purrsock_stats_transfer(_purrsock_socket_t *socket, bool send, uint64_t bytes, uint64_t packets);
+_purrsock_stats_shard_t *_purrsock_stats_thread_shard();  // Shard of the calling thread, created on first use.
+ps_result_t _purrsock_get_shard_stats(_purrsock_stats_shard_t *shard, ps_stats_t *stats);
+ps_result_t _purrsock_get_socket_stats(_purrsock_socket_t *socket, ps_socket_stats_t *stats);
+ps_result_t _purrsock_get_stats(ps_stats_t *stats);
+uint64_t _purrsock_latency_percentile(const ps_latency_histogram_t *histogram, double percentile);
+
+void _purrsock_scan_init();
+ps_scan_isa_t _purrsock_scan_get_isa();
+bool _purrsock_scan_set_isa(ps_scan_isa_t isa);
+size_t _purrsock_scan_find(const char *buf, size_t size, const char *needle, size_t needle_size);
+size_t _purrsock_scan_token(const char *buf, size_t size);
+size_t _purrsock_scan_field_value(const char *buf, size_t size);
+// XORs `size` bytes of `src` with the repeated 4-byte WebSocket masking key, which holds the key's bytes
+// in memory order, into `dst`; the two may be the same.
+void _purrsock_scan_mask(char *dst, const char *src, size_t size, uint32_t key);
+
+ps_result_t _purrsock_create_http_server(_purrsock_http_server_t **server, ps_address_t address, const char *ip, ps_port_t port, const ps_http_server_options_t *options);
+void _purrsock_destroy_http_server(_purrsock_http_server_t *server);
+ps_result_t _purrsock_http_route(_purrsock_http_server_t *server, const char *method, const char *path, ps_http_handler_t handler, void *user_data);
+ps_result_t _purrsock_http_server_start(_purrsock_http_server_t *server);
+ps_result_t _purrsock_http_server_stop(_purrsock_http_server_t *server);
+ps_port_t _purrsock_http_server_get_port(_purrsock_http_server_t *server);
+// Parses a complete request head ending with an empty line, for protocols that start out as HTTP. Returns
+// 0, or the status to answer with; requests with a body are refused with 413.
+int _purrsock_http_parse_request(const char *buf, size_t size, ps_http_request_t *request);
+// Whether a comma-separated header value holds `token`, compared without regard to case.
+bool _purrsock_http_list_contains(ps_http_string_t list, const char *token);
+bool _purrsock_http_request_header(const ps_http_request_t *request, const char *name, ps_http_string_t *value);
+ps_result_t _purrsock_http_response_set_status(_purrsock_http_response_t *response, int status);
+ps_result_t _purrsock_http_response_add_header(_purrsock_http_response_t *response, const char *name, const char *value);
+ps_result_t _purrsock_http_response_send(_purrsock_http_response_t *response, ps_packet_t body);
+ps_result_t _purrsock_http_response_send_file(_purrsock_http_response_t *response, int fd, uint64_t offset, uint64_t length);
+ps_result_t _purrsock_http_response_write(_purrsock_http_response_t *response, ps_packet_t data);
+ps_result_t _purrsock_http_response_end(_purrsock_http_response_t *response);
+
+ps_result_t _purrsock_create_websocket(_purrsock_websocket_t **websocket, _purrsock_socket_t *socket, bool client, const char *host, const char *path, const ps_websocket_options_t *options);
+void _purrsock_destroy_websocket(_purrsock_websocket_t *websocket);
+ps_result_t _purrsock_websocket_handshake(_purrsock_websocket_t *websocket);
+const char *_purrsock_websocket_get_path(_purrsock_websocket_t *websocket);
+ps_result_t _purrsock_websocket_read(_purrsock_websocket_t *websocket, ps_websocket_message_t *message);
+ps_result_t _purrsock_websocket_send(_purrsock_websocket_t *websocket, ps_websocket_opcode_t opcode, ps_packet_t payload, bool final);
+ps_result_t _purrsock_websocket_close(_purrsock_websocket_t *websocket, uint16_t code, const char *reason);
+ps_result_t _purrsock_websocket_flush(_purrsock_websocket_t *websocket);
+size_t _purrsock_websocket_get_unsent(_purrsock_websocket_t *websocket);
+
+ps_result_t _purrsock_create_resolver(_purrsock_resolver_t **resolver, _purrsock_loop_t *loop, const ps_resolver_options_t *options);
+void _purrsock_destroy_resolver(_purrsock_resolver_t *resolver);
+_purrsock_loop_t *_purrsock_resolver_get_loop(_purrsock_resolver_t *resolver);
+ps_result_t _purrsock_resolve_async(_purrsock_resolver_t *resolver, const char *host, ps_resolve_callback_t callback, void *user_data);
+ps_result_t _purrsock_resolver_lookup(_purrsock_resolver_t *resolver, const char *host, ps_endpoint_t *addresses, size_t capacity, size_t *count);
+void _purrsock_get_resolver_stats(_purrsock_resolver_t *resolver, ps_resolver_stats_t *stats);
+
+ps_result_t _purrsock_create_loop(_purrsock_loop_t **loop, const ps_loop_options_t *options);
+void _purrsock_destroy_loop(_purrsock_loop_t *loop);
+ps_result_t _purrsock_loop_add_socket(_purrsock_loop_t *loop, _purrsock_socket_t *socket, ps_loop_callbacks_t callbacks);
+ps_result_t _purrsock_loop_remove_socket(_purrsock_loop_t *loop, _purrsock_socket_t *socket);
+ps_result_t _purrsock_loop_run_once(_purrsock_loop_t *loop, int timeout_ms);
+ps_result_t _purrsock_loop_run(_purrsock_loop_t *loop);
+void _purrsock_loop_stop(_purrsock_loop_t *loop);
+ps_loop_backend_t _purrsock_loop_get_backend(_purrsock_loop_t *loop);
+ps_result_t _purrsock_loop_add_tick(_purrsock_loop_t *loop, ps_loop_tick_callback_t callback, void *user_data);
+ps_result_t _purrsock_loop_remove_tick(_purrsock_loop_t *loop, ps_loop_tick_callback_t callback, void *user_data);
+ps_result_t _purrsock_loop_post(_purrsock_loop_t *loop, ps_task_callback_t callback, void *user_data);
+ps_result_t _purrsock_loop_start_timer(_purrsock_loop_t *loop, ps_timer_t *timer, uint64_t timeout_ms);
+void _purrsock_loop_stop_timer(_purrsock_loop_t *loop, ps_timer_t *timer);
+uint64_t _purrsock_loop_now(_purrsock_loop_t *loop);
+ps_result_t _purrsock_get_loop_stats(_purrsock_loop_t *loop, ps_stats_t *stats);
+ps_result_t _purrsock_loop_set_socket_heartbeat(_purrsock_loop_t *loop, _purrsock_socket_t *socket, const ps_heartbeat_options_t *options);
+ps_result_t _purrsock_connect_async(_purrsock_loop_t *loop, const char *host, ps_port_t port, const ps_connect_options_t *options, ps_connect_callback_t callback, void *user_data);
+
+void _purrsock_timer_wheel_init(_purrsock_timer_wheel_t *wheel, uint64_t now);
+void _purrsock_timer_wheel_add(_purrsock_timer_wheel_t *wheel, ps_timer_t *timer, uint64_t expires);
+void _purrsock_timer_wheel_remove(_purrsock_timer_wheel_t *wheel, ps_timer_t *timer);
+uint64_t _purrsock_timer_wheel_next(_purrsock_timer_wheel_t *wheel);
+void _purrsock_timer_wheel_advance(_purrsock_timer_wheel_t *wheel, uint64_t now, ps_loop_t loop);
+
+ps_result_t _purrsock_loop_read_socket_packet(_purrsock_loop_t *loop, _purrsock_socket_t *socket, ps_packet_t *packet, ps_loop_packet_completion_t callback, void *user_data);
+ps_result_t _purrsock_loop_read_socket_packet_multishot(_purrsock_loop_t *loop, _purrsock_socket_t *socket, ps_loop_packet_completion_t callback, void *user_data);
+ps_result_t _purrsock_loop_send_socket_packet(_purrsock_loop_t *loop, _purrsock_socket_t *socket, ps_packet_t *packet, ps_loop_packet_completion_t callback, void *user_data);
+ps_result_t _purrsock_loop_accept_socket(_purrsock_loop_t *loop, _purrsock_socket_t *socket, bool multishot, ps_loop_accept_completion_t callback, void *user_data);
 
 #endif // INTERNAL_H
\ No newline at end of file
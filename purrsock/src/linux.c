@@ -6,11 +6,29 @@
 
 #ifdef __linux__
 
+#define _GNU_SOURCE
 #include "internal.h"
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
+#include <netdb.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <sys/time.h>
+#include <time.h>
+#include <errno.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
@@ -26,22 +44,202 @@ bool _purrsock_init() {
 }
 
 void _purrsock_cleanup() {
+  _purrsock_zerocopy_cleanup();
   is_initialized = false;
 }
 
-ps_result_t _purrsock_create_socket(_purrsock_socket_t *socket) {
-  assert(socket);
+ps_result_t _last_ps_result(const char *func_name) {
+  (void)func_name;
+
+  switch (errno) {
+  case 0:             return PS_SUCCESS;
+  case EAGAIN:        return PS_ERROR_WOULDBLOCK;
+  case EINPROGRESS:   return PS_ERROR_WOULDBLOCK;
+  case EMSGSIZE:      return PS_ERROR_MSGTOOLONG;
+  case EADDRINUSE:    return PS_ERROR_ADDRINUSE;
+  case EADDRNOTAVAIL: return PS_ERROR_ADDRNOTAVAIL;
+  case ENETDOWN:      return PS_ERROR_NETDOWN;
+  case ENETUNREACH:   return PS_ERROR_NETDOWN;
+  case ENETRESET:     return PS_ERROR_NETRESET;
+  case ECONNRESET:    return PS_ERROR_CONNRESET;
+  case ECONNREFUSED:  return PS_ERROR_CONNREFUSED;
+  case EHOSTDOWN:     return PS_ERROR_HOSTDOWN;
+  case EHOSTUNREACH:  return PS_ERROR_HOSTDOWN;
+  case EPIPE:         return PS_ERROR_SHUTDOWN;
+  case ESHUTDOWN:     return PS_ERROR_SHUTDOWN;
+  case ETIMEDOUT:     return PS_ERROR_TIMEOUT;
+  case EINVAL:        return PS_ERROR_INVALID_ARGUMENT;
+  case EAFNOSUPPORT:  return PS_ERROR_IPV6_ADDR_INVALID;
+  case ENOTSOCK:      return PS_ERROR_IPV6_SOCKET_CREATION;
+  case EOPNOTSUPP:    return PS_ERROR_UNSUPPORTED;
+  case ENOPROTOOPT:   return PS_ERROR_UNSUPPORTED;
+  default:            return PS_ERROR_UNKNOWN;
+  }
+}
+
+// Fills `addr` from a literal IPv4 or IPv6 address, returning the address length or 0 if `ip` is not an address.
+static socklen_t _purrsock_parse_addr(const char *ip, ps_port_t port, struct sockaddr_storage *addr) {
+  memset(addr, 0, sizeof(*addr));
+
+  struct sockaddr_in *addr4 = (struct sockaddr_in *)addr;
+  if (inet_pton(AF_INET, ip, &addr4->sin_addr) == 1) {
+    addr4->sin_family = AF_INET;
+    addr4->sin_port = htons(port);
+    return sizeof(*addr4);
+  }
+
+  struct sockaddr_in6 *addr6 = (struct sockaddr_in6 *)addr;
+  if (inet_pton(AF_INET6, ip, &addr6->sin6_addr) == 1) {
+    addr6->sin6_family = AF_INET6;
+    addr6->sin6_port = htons(port);
+    return sizeof(*addr6);
+  }
+
+  return 0;
+}
+
+static bool _purrsock_is_unix(ps_protocol_t protocol) {
+  return protocol == PS_PROTOCOL_UNIX_STREAM || protocol == PS_PROTOCOL_UNIX_DGRAM;
+}
+
+// Fills `addr` from a Unix socket path; a leading '@' names the abstract namespace. Returns 0 if it does not fit.
+static socklen_t _purrsock_parse_unix_addr(const char *path, struct sockaddr_storage *addr) {
+  memset(addr, 0, sizeof(*addr));
+  struct sockaddr_un *addr_un = (struct sockaddr_un *)addr;
+  size_t length = strlen(path);
+  if (!length || length >= sizeof(addr_un->sun_path)) return 0;
+
+  addr_un->sun_family = AF_UNIX;
+  memcpy(addr_un->sun_path, path, length);
+  if (path[0] != '@') return (socklen_t)(offsetof(struct sockaddr_un, sun_path) + length + 1);
+  // Abstract names are not NUL-terminated; their length is part of the address.
+  addr_un->sun_path[0] = '\0';
+  return (socklen_t)(offsetof(struct sockaddr_un, sun_path) + length);
+}
+
+// Unix sockets take a path in place of the IP address and ignore the port.
+static socklen_t _purrsock_socket_addr(ps_protocol_t protocol, const char *ip, ps_port_t port, struct sockaddr_storage *addr) {
+  return _purrsock_is_unix(protocol) ? _purrsock_parse_unix_addr(ip, addr) : _purrsock_parse_addr(ip, port, addr);
+}
+
+static socklen_t _purrsock_addr_len(const struct sockaddr_storage *addr) {
+  switch (addr->ss_family) {
+  case AF_INET:  return sizeof(struct sockaddr_in);
+  case AF_INET6: return sizeof(struct sockaddr_in6);
+  case AF_UNIX: {
+    const struct sockaddr_un *addr_un = (const struct sockaddr_un *)addr;
+    size_t max = sizeof(addr_un->sun_path) - 1;
+    // An abstract name runs up to the first NUL after the leading one, as we never create others. An
+    // unbound sender has no name at all and cannot be answered.
+    if (!addr_un->sun_path[0] && !addr_un->sun_path[1]) return 0;
+    if (!addr_un->sun_path[0]) return (socklen_t)(offsetof(struct sockaddr_un, sun_path) + 1 + strnlen(addr_un->sun_path + 1, max));
+    return (socklen_t)(offsetof(struct sockaddr_un, sun_path) + strnlen(addr_un->sun_path, max) + 1);
+  }
+  default:       return 0;
+  }
+}
+
+static void _purrsock_endpoint_from_sockaddr(const struct sockaddr_storage *addr, ps_endpoint_t *endpoint) {
+  memset(endpoint, 0, sizeof(*endpoint));
+  if (addr->ss_family == AF_INET6) {
+    const struct sockaddr_in6 *addr6 = (const struct sockaddr_in6 *)addr;
+    endpoint->family = PS_ADDRESS_IPV6;
+    endpoint->port = ntohs(addr6->sin6_port);
+    memcpy(endpoint->addr, &addr6->sin6_addr, sizeof(addr6->sin6_addr));
+  } else {
+    const struct sockaddr_in *addr4 = (const struct sockaddr_in *)addr;
+    endpoint->family = PS_ADDRESS_IPV4;
+    endpoint->port = ntohs(addr4->sin_port);
+    memcpy(endpoint->addr, &addr4->sin_addr, sizeof(addr4->sin_addr));
+  }
+}
+
+socklen_t _purrsock_endpoint_to_sockaddr(const ps_endpoint_t *endpoint, struct sockaddr_storage *addr) {
+  memset(addr, 0, sizeof(*addr));
+  if (endpoint->family == PS_ADDRESS_IPV6) {
+    struct sockaddr_in6 *addr6 = (struct sockaddr_in6 *)addr;
+    addr6->sin6_family = AF_INET6;
+    addr6->sin6_port = htons(endpoint->port);
+    memcpy(&addr6->sin6_addr, endpoint->addr, sizeof(addr6->sin6_addr));
+    return sizeof(*addr6);
+  }
+
+  struct sockaddr_in *addr4 = (struct sockaddr_in *)addr;
+  addr4->sin_family = AF_INET;
+  addr4->sin_port = htons(endpoint->port);
+  memcpy(&addr4->sin_addr, endpoint->addr, sizeof(addr4->sin_addr));
+  return sizeof(*addr4);
+}
+
+_purrsock_socket_t *_purrsock_socket_from_fd(int sockfd, ps_protocol_t protocol, const struct sockaddr_storage *addr) {
+  _purrsock_socket_t *socket = (_purrsock_socket_t *)calloc(1, sizeof(*socket));
+  _purrsock_socket_data_t *data = (_purrsock_socket_data_t *)malloc(sizeof(*data));
+  if (!socket || !data) {
+    free(socket);
+    free(data);
+    return NULL;
+  }
+
+  data->sockfd = sockfd;
+  socket->protocol = protocol;
+  if (addr) socket->addr_storage = *addr;
+  socket->data = data;
+  return socket;
+}
+
+// Blocking calls on a socket with SO_RCVTIMEO/SO_SNDTIMEO set give up with EAGAIN once the timeout expires.
+static bool _purrsock_timed_out(_purrsock_socket_t *socket, uint32_t timeout_ms) {
+  if (errno != EAGAIN || !timeout_ms) return false;
+  int error = errno;
+  int flags = fcntl(((_purrsock_socket_data_t *)socket->data)->sockfd, F_GETFL, 0);
+  errno = error;
+  return flags >= 0 && !(flags & O_NONBLOCK);
+}
+
+static ps_result_t _purrsock_io_result(_purrsock_socket_t *socket, uint32_t timeout_ms, const char *func_name) {
+  return _purrsock_timed_out(socket, timeout_ms) ? PS_ERROR_TIMEOUT : _last_ps_result(func_name);
+}
+
+ps_result_t _purrsock_create_socket(_purrsock_socket_t *in_socket) {
+  assert(in_socket);
+  if (in_socket->protocol == PS_PROTOCOL_MEMORY || in_socket->protocol == PS_PROTOCOL_SHM) return _purrsock_memory_create(in_socket);
+
+  // `ps_create_socket` stores the requested `ps_address_t` in `ss_family` until an address is known.
+  int domain;
+  switch (in_socket->addr_storage.ss_family) {
+  case PS_ADDRESS_IPV4: domain = AF_INET; break;
+  case PS_ADDRESS_IPV6: domain = AF_INET6; break;
+  default: return PS_ERROR_INVALID_ARGUMENT;
+  }
+  if (_purrsock_is_unix(in_socket->protocol)) domain = AF_UNIX;
 
-  int domain = (socket->protocol == PS_PROTOCOL_TCP) ? AF_INET : AF_INET6;
-  int type = (socket->protocol == PS_PROTOCOL_TCP) ? SOCK_STREAM : SOCK_DGRAM;
-  int protocol = 0;
+  int type;
+  switch (in_socket->protocol) {
+  case PS_PROTOCOL_TCP: type = SOCK_STREAM; break;
+  case PS_PROTOCOL_UDP: type = SOCK_DGRAM; break;
+  case PS_PROTOCOL_UNIX_STREAM: type = SOCK_STREAM; break;
+  case PS_PROTOCOL_UNIX_DGRAM: type = SOCK_DGRAM; break;
+  default: return PS_ERROR_INVALID_ARGUMENT;
+  }
 
-  int sockfd = socket(domain, type, protocol);
+  int sockfd = socket(domain, type | SOCK_CLOEXEC, 0);
   if (sockfd < 0) {
-    return PS_ERROR_INTERNAL; 
+    return _last_ps_result("purrsock_create_socket");
+  }
+
+  if (domain == AF_INET6) {
+    int option = 0;
+    setsockopt(sockfd, IPPROTO_IPV6, IPV6_V6ONLY, &option, sizeof(option));
+  }
+
+  _purrsock_socket_data_t *data = (_purrsock_socket_data_t *)malloc(sizeof(*data));
+  if (!data) {
+    close(sockfd);
+    return PS_ERROR_INTERNAL;
   }
+  data->sockfd = sockfd;
 
-  socket->sockfd = sockfd;
+  in_socket->data = data;
   return PS_SUCCESS;
 }
 
@@ -53,83 +251,174 @@ ps_result_t _purrsock_create_socket_from_addr(_purrsock_socket_t *socket, const
     return result;
   }
 
-  struct sockaddr_in6 addr;
-  memset(&addr, 0, sizeof(addr));
-  addr.sin6_family = AF_INET6;
-  addr.sin6_port = htons(port);
-
-  if (inet_pton(AF_INET6, ip, &addr.sin6_addr) <= 0) {
-    if (inet_pton(AF_INET, ip, &addr.sin6_addr) <= 0) {
-      return PS_ERROR_ADDRINUSE; 
-    } else {
-      addr.sin6_family = AF_INET;
-    }
-  }
-
-  if (bind(socket->sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
-    return PS_ERROR_ADDRINUSE;  
+  result = _purrsock_bind_socket(socket, ip, port);
+  if (result != PS_SUCCESS) {
+    return result;
   }
 
+  _purrsock_socket_addr(socket->protocol, ip, port, &socket->addr_storage);
   return PS_SUCCESS;
 }
 
 void _purrsock_destroy_socket(_purrsock_socket_t *socket) {
   assert(socket);
-  close(socket->sockfd);
+  _purrsock_memory_destroy(socket);
+  _purrsock_zerocopy_destroy(socket);
+  _purrsock_socket_data_t *data = (_purrsock_socket_data_t *)socket->data;
+  if (data) {
+    close(data->sockfd);
+    free(data);
+  }
+  socket->data = NULL;
+  free(socket->unsent);
+  socket->unsent = NULL;
+  socket->unsent_offset = socket->unsent_size = socket->unsent_capacity = 0;
 }
 
 ps_result_t _purrsock_bind_socket(_purrsock_socket_t *socket, const char *ip, ps_port_t port) {
-  struct sockaddr_in addr;
-  memset(&addr, 0, sizeof(addr));
-  addr.sin_family = AF_INET;
-  addr.sin_port = htons(port);
-  addr.sin_addr.s_addr = inet_addr(ip);
+  assert(socket);
+  if (socket->memory) return _purrsock_memory_bind(socket, ip, port);
+  _purrsock_socket_data_t *data = (_purrsock_socket_data_t *)socket->data;
+  if (!data) return PS_ERROR_NOTINIT;
+
+  struct sockaddr_storage addr;
+  socklen_t addr_len = _purrsock_socket_addr(socket->protocol, ip, port, &addr);
+  if (!addr_len) {
+    return PS_ERROR_ADDRNOTAVAIL;
+  }
+
+  if (bind(data->sockfd, (struct sockaddr *)&addr, addr_len) < 0) {
+    return _last_ps_result("purrsock_bind_socket");
+  }
+
+  return PS_SUCCESS;
+}
+
+ps_result_t _purrsock_listen_socket(_purrsock_socket_t *socket, int backlog) {
+  assert(socket);
+  if (socket->memory) return _purrsock_memory_listen(socket, backlog);
+  _purrsock_socket_data_t *data = (_purrsock_socket_data_t *)socket->data;
+  if (!data) return PS_ERROR_NOTINIT;
 
-  if (bind(socket->sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
-    return PS_ERROR_ADDRINUSE; 
+  // The kernel caps the backlog at net.core.somaxconn.
+  if (listen(data->sockfd, backlog > 0 ? backlog : SOMAXCONN) < 0) {
+    return _last_ps_result("purrsock_listen_socket");
   }
+  return PS_SUCCESS;
+}
+
+ps_result_t _purrsock_set_socket_reuseport(_purrsock_socket_t *socket, bool enabled) {
+  assert(socket);
+  _purrsock_socket_data_t *data = (_purrsock_socket_data_t *)socket->data;
+  if (!data) return PS_ERROR_NOTINIT;
 
+  int value = enabled ? 1 : 0;
+  if (setsockopt(data->sockfd, SOL_SOCKET, SO_REUSEPORT, &value, sizeof(value)) < 0) {
+    return _last_ps_result("purrsock_set_socket_reuseport");
+  }
   return PS_SUCCESS;
 }
 
-ps_result_t _purrsock_listen_socket(_purrsock_socket_t *socket) {
-  if (listen(socket->sockfd, 10) < 0) {
-    return PS_ERROR_INTERNAL;  
+ps_result_t _purrsock_get_socket_endpoint(_purrsock_socket_t *socket, ps_endpoint_t *endpoint) {
+  assert(socket && endpoint);
+  if (socket->memory) return _purrsock_memory_get_endpoint(socket, endpoint);
+  _purrsock_socket_data_t *data = (_purrsock_socket_data_t *)socket->data;
+  if (!data) return PS_ERROR_NOTINIT;
+  // A path does not fit in an endpoint.
+  if (_purrsock_is_unix(socket->protocol)) return PS_ERROR_UNSUPPORTED;
+
+  struct sockaddr_storage addr;
+  socklen_t addr_len = sizeof(addr);
+  if (getsockname(data->sockfd, (struct sockaddr *)&addr, &addr_len) < 0) {
+    return _last_ps_result("purrsock_get_socket_endpoint");
   }
+  _purrsock_endpoint_from_sockaddr(&addr, endpoint);
   return PS_SUCCESS;
 }
 
 ps_result_t _purrsock_accept_socket(_purrsock_socket_t *socket, _purrsock_socket_t **client) {
-  assert(client);
-  struct sockaddr_in client_addr;
+  assert(socket && client);
+  if (socket->memory) return _purrsock_memory_accept(socket, client);
+  _purrsock_socket_data_t *data = (_purrsock_socket_data_t *)socket->data;
+  if (!data) return PS_ERROR_NOTINIT;
+
+  struct sockaddr_storage client_addr;
   socklen_t addr_len = sizeof(client_addr);
 
-  int client_sock = accept(socket->sockfd, (struct sockaddr *)&client_addr, &addr_len);
+  int client_sock;
+  do {
+    client_sock = accept4(data->sockfd, (struct sockaddr *)&client_addr, &addr_len, SOCK_CLOEXEC);
+  } while (client_sock < 0 && errno == EINTR);
   if (client_sock < 0) {
-    return PS_ERROR_CONNRESET; 
+    return _purrsock_io_result(socket, socket->timeouts.read_ms, "purrsock_accept_socket");
   }
 
-  _purrsock_socket_t *new_client = (_purrsock_socket_t *)malloc(sizeof(*new_client));
+  _purrsock_socket_t *new_client = _purrsock_socket_from_fd(client_sock, socket->protocol, &client_addr);
   if (!new_client) {
-    return PS_ERROR_INTERNAL; 
+    close(client_sock);
+    return PS_ERROR_INTERNAL;
   }
 
-  new_client->sockfd = client_sock;
-  new_client->protocol = socket->protocol;
   *client = new_client;
-
   return PS_SUCCESS;
 }
 
+// Starts the handshake without blocking and waits for it with the connect timeout.
+static ps_result_t _purrsock_connect_with_timeout(_purrsock_socket_t *socket, const struct sockaddr *addr, socklen_t addr_len) {
+  int sockfd = ((_purrsock_socket_data_t *)socket->data)->sockfd;
+  int flags = fcntl(sockfd, F_GETFL, 0);
+  if (flags < 0) return _last_ps_result("purrsock_connect_socket");
+
+  // Non-blocking sockets report the handshake in progress as usual.
+  bool blocking = !(flags & O_NONBLOCK);
+  if (blocking && fcntl(sockfd, F_SETFL, flags | O_NONBLOCK) < 0) return _last_ps_result("purrsock_connect_socket");
+
+  ps_result_t result = PS_SUCCESS;
+  if (connect(sockfd, addr, addr_len) < 0) {
+    if (errno != EINPROGRESS || !blocking) {
+      result = _last_ps_result("purrsock_connect_socket");
+    } else {
+      struct pollfd pfd = { .fd = sockfd, .events = POLLOUT };
+      int res;
+      do {
+        res = poll(&pfd, 1, (int)socket->timeouts.connect_ms);
+      } while (res < 0 && errno == EINTR);
+
+      int error = 0;
+      socklen_t error_len = sizeof(error);
+      if (res == 0) {
+        result = PS_ERROR_TIMEOUT;
+      } else if (res < 0 || getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &error, &error_len) < 0) {
+        result = _last_ps_result("purrsock_connect_socket");
+      } else if (error) {
+        errno = error;
+        result = _last_ps_result("purrsock_connect_socket");
+      }
+    }
+  }
+
+  if (blocking) fcntl(sockfd, F_SETFL, flags);
+  return result;
+}
+
 ps_result_t _purrsock_connect_socket(_purrsock_socket_t *socket, const char *ip, ps_port_t port) {
-  struct sockaddr_in addr;
-  memset(&addr, 0, sizeof(addr));
-  addr.sin_family = AF_INET;
-  addr.sin_port = htons(port);
-  addr.sin_addr.s_addr = inet_addr(ip);
+  assert(socket);
+  if (socket->memory) return _purrsock_memory_connect(socket, ip, port);
+  _purrsock_socket_data_t *data = (_purrsock_socket_data_t *)socket->data;
+  if (!data) return PS_ERROR_NOTINIT;
+
+  struct sockaddr_storage addr;
+  socklen_t addr_len = _purrsock_socket_addr(socket->protocol, ip, port, &addr);
+  if (!addr_len) {
+    return PS_ERROR_ADDRNOTAVAIL;
+  }
+
+  if (socket->timeouts.connect_ms) {
+    return _purrsock_connect_with_timeout(socket, (struct sockaddr *)&addr, addr_len);
+  }
 
-  if (connect(socket->sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
-    return PS_ERROR_CONNREFUSED; 
+  if (connect(data->sockfd, (struct sockaddr *)&addr, addr_len) < 0) {
+    return _last_ps_result("purrsock_connect_socket");
   }
 
   return PS_SUCCESS;
@@ -137,38 +426,1102 @@ ps_result_t _purrsock_connect_socket(_purrsock_socket_t *socket, const char *ip,
 
 ps_result_t _purrsock_read_socket_packet(_purrsock_socket_t *socket, ps_packet_t *packet, _purrsock_socket_t **from) {
   assert(socket && packet);
+  if (socket->memory) return _purrsock_memory_read(socket, packet);
+  _purrsock_socket_data_t *data = (_purrsock_socket_data_t *)socket->data;
+  if (!data) return PS_ERROR_NOTINIT;
 
-  char buffer[1024];
-  ssize_t len = recv(socket->sockfd, buffer, sizeof(buffer), 0);
+  struct sockaddr_storage addr;
+  socklen_t addr_len = sizeof(addr);
+
+  // Receive straight into the packet; MSG_TRUNC makes a datagram report its full length.
+  int flags = _purrsock_is_datagram(socket->protocol) ? MSG_TRUNC : 0;
+  ssize_t len;
+  PS_STATS_START(start);
+  do {
+    len = recvfrom(data->sockfd, packet->buf, packet->capacity, flags, (struct sockaddr *)&addr, &addr_len);
+  } while (len < 0 && errno == EINTR);
+  PS_STATS_SYSCALL(socket, false, len < 0 && errno == EAGAIN, start);
   if (len < 0) {
-    return PS_ERROR_INTERNAL;
+    return _purrsock_io_result(socket, socket->timeouts.read_ms, "purrsock_read_socket_packet");
+  }
+  if (len == 0 && !_purrsock_is_datagram(socket->protocol)) {
+    return PS_CONNCLOSED;
   }
 
+  ps_result_t result = PS_SUCCESS;
   packet->size = len;
-  packet->buf = (char *)malloc(len);
-  if (!packet->buf) {
-    return PS_ERROR_INTERNAL; 
+  if ((size_t)len > packet->capacity) {
+    packet->size = packet->capacity;
+    result = PS_ERROR_MSGTOOLONG;
   }
-  memcpy(packet->buf, buffer, len);
+  PS_STATS_TRANSFER(socket, false, packet->size, 1);
 
-  if (from) {
-    *from = (struct sockaddr_in *)malloc(sizeof(struct sockaddr_in));
-    memcpy(*from, &addr, sizeof(struct sockaddr_in));
+  if (from && _purrsock_is_datagram(socket->protocol)) {
+    _purrsock_socket_t *sender = (_purrsock_socket_t *)calloc(1, sizeof(*sender));
+    if (!sender) {
+      return PS_ERROR_INTERNAL;
+    }
+    // Unix socket names are only as long as the kernel says; the rest must not pass for part of them.
+    memset((char *)&addr + addr_len, 0, sizeof(addr) - addr_len);
+    sender->protocol = socket->protocol;
+    sender->addr_storage = addr;
+    *from = sender;
+  }
+
+  return result;
+}
+
+ps_result_t _purrsock_send_stream_partial(_purrsock_socket_t *socket, const ps_packet_t *slices, size_t count, size_t *sent) {
+  assert(socket && slices && sent && count <= PS_MAX_PACKET_SLICES);
+  *sent = 0;
+  if (socket->memory) return _purrsock_memory_sendv(socket, slices, count, sent);
+  _purrsock_socket_data_t *data = (_purrsock_socket_data_t *)socket->data;
+  if (!data) return PS_ERROR_NOTINIT;
+
+  struct iovec iovs[PS_MAX_PACKET_SLICES];
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iovs;
+  for (size_t i = 0; i < count; ++i) {
+    if (!slices[i].size) continue;
+    iovs[msg.msg_iovlen].iov_base = slices[i].buf;
+    iovs[msg.msg_iovlen++].iov_len = slices[i].size;
   }
 
+  // A blocking socket only stops early on its write timeout; a non-blocking one whenever it is full.
+  while (msg.msg_iovlen > 0) {
+    PS_STATS_START(start);
+    ssize_t res = sendmsg(data->sockfd, &msg, MSG_NOSIGNAL);
+    PS_STATS_SYSCALL(socket, true, res < 0 && errno == EAGAIN, start);
+    if (res < 0) {
+      if (errno == EINTR) continue;
+      return _purrsock_io_result(socket, socket->timeouts.write_ms, "purrsock_send_socket_packet");
+    }
+    PS_STATS_TRANSFER(socket, true, res, *sent == 0);
+    *sent += (size_t)res;
 
+    // Skip the slices sent whole and advance into the one cut short.
+    while (msg.msg_iovlen > 0 && (size_t)res >= msg.msg_iov->iov_len) {
+      res -= msg.msg_iov->iov_len;
+      msg.msg_iov++;
+      msg.msg_iovlen--;
+    }
+    if (msg.msg_iovlen > 0) {
+      msg.msg_iov->iov_base = (char *)msg.msg_iov->iov_base + res;
+      msg.msg_iov->iov_len -= res;
+    }
+  }
   return PS_SUCCESS;
 }
 
 ps_result_t _purrsock_send_socket_packet(_purrsock_socket_t *socket, ps_packet_t packet, _purrsock_socket_t *to) {
-  assert(socket && to && packet.buf);
+  assert(socket && packet.buf);
+  if (socket->memory) return _purrsock_send_stream(socket, &packet, 1);
+  _purrsock_socket_data_t *data = (_purrsock_socket_data_t *)socket->data;
+  if (!data) return PS_ERROR_NOTINIT;
+
+  switch (socket->protocol) {
+  case PS_PROTOCOL_TCP:
+  case PS_PROTOCOL_UNIX_STREAM:
+    return _purrsock_send_stream(socket, &packet, 1);
+  case PS_PROTOCOL_UDP:
+  case PS_PROTOCOL_UNIX_DGRAM: {
+    ssize_t sent;
+    PS_STATS_START(start);
+    if (to) {
+      socklen_t addr_len = _purrsock_addr_len(&to->addr_storage);
+      if (!addr_len) return PS_ERROR_INVALID_ARGUMENT;
+      sent = sendto(data->sockfd, packet.buf, packet.size, MSG_NOSIGNAL, (struct sockaddr *)&to->addr_storage, addr_len);
+    } else {
+      sent = send(data->sockfd, packet.buf, packet.size, MSG_NOSIGNAL);
+    }
+    PS_STATS_SYSCALL(socket, true, sent < 0 && errno == EAGAIN, start);
+    if (sent < 0) {
+      return _purrsock_io_result(socket, socket->timeouts.write_ms, "purrsock_send_socket_packet");
+    }
+    PS_STATS_TRANSFER(socket, true, sent, 1);
+  } break;
+  default:
+    return PS_ERROR_INTERNAL;
+  }
+
+  return PS_SUCCESS;
+}
+
+void _purrsock_mutex_init(_purrsock_mutex_t *mutex) {
+  pthread_mutex_init(mutex, NULL);
+}
+
+void _purrsock_mutex_destroy(_purrsock_mutex_t *mutex) {
+  pthread_mutex_destroy(mutex);
+}
+
+void _purrsock_mutex_lock(_purrsock_mutex_t *mutex) {
+  pthread_mutex_lock(mutex);
+}
+
+void _purrsock_mutex_unlock(_purrsock_mutex_t *mutex) {
+  pthread_mutex_unlock(mutex);
+}
+
+void _purrsock_cond_init(_purrsock_cond_t *cond) {
+  // Timed waits count against the monotonic clock, unaffected by changes to the wall clock.
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(cond, &attr);
+  pthread_condattr_destroy(&attr);
+}
+
+void _purrsock_cond_destroy(_purrsock_cond_t *cond) {
+  pthread_cond_destroy(cond);
+}
+
+void _purrsock_cond_wait(_purrsock_cond_t *cond, _purrsock_mutex_t *mutex) {
+  pthread_cond_wait(cond, mutex);
+}
+
+bool _purrsock_cond_timed_wait(_purrsock_cond_t *cond, _purrsock_mutex_t *mutex, uint32_t timeout_ms) {
+  struct timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += timeout_ms / 1000;
+  deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+  if (deadline.tv_nsec >= 1000000000) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000;
+  }
+  return pthread_cond_timedwait(cond, mutex, &deadline) == 0;
+}
+
+void _purrsock_cond_signal(_purrsock_cond_t *cond) {
+  pthread_cond_signal(cond);
+}
+
+void _purrsock_cond_broadcast(_purrsock_cond_t *cond) {
+  pthread_cond_broadcast(cond);
+}
+
+typedef struct {
+  void (*entry)(void *);
+  void *arg;
+} _purrsock_thread_start_t;
+
+static void *_purrsock_thread_main(void *arg) {
+  _purrsock_thread_start_t start = *(_purrsock_thread_start_t *)arg;
+  free(arg);
+  start.entry(start.arg);
+  return NULL;
+}
+
+ps_result_t _purrsock_thread_create(_purrsock_thread_t *thread, void (*entry)(void *), void *arg) {
+  _purrsock_thread_start_t *start = (_purrsock_thread_start_t *)malloc(sizeof(*start));
+  if (!start) return PS_ERROR_INTERNAL;
+  start->entry = entry;
+  start->arg = arg;
+
+  int error = pthread_create(thread, NULL, _purrsock_thread_main, start);
+  if (error) {
+    free(start);
+    errno = error;
+    return _last_ps_result("purrsock_thread_create");
+  }
+  return PS_SUCCESS;
+}
+
+void _purrsock_thread_join(_purrsock_thread_t thread) {
+  pthread_join(thread, NULL);
+}
+
+bool _purrsock_thread_pin(_purrsock_thread_t thread, size_t cpu) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu % CPU_SETSIZE, &set);
+  return pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+}
+
+size_t _purrsock_cpu_count() {
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return count > 0 ? (size_t)count : 1;
+}
+
+uint64_t _purrsock_monotonic_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+uint64_t _purrsock_monotonic_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+bool _purrsock_random(void *buf, size_t size) {
+  for (size_t filled = 0; filled < size;) {
+    ssize_t result = getrandom((char *)buf + filled, size - filled, 0);
+    if (result < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    filled += (size_t)result;
+  }
+  return true;
+}
+
+uint64_t _purrsock_monotonic_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+ps_result_t _purrsock_shm_map(const char *name, size_t size, bool create, void **addr) {
+  int fd = shm_open(name, create ? O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC : O_RDWR | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    if (errno == EEXIST) return PS_ERROR_ADDRINUSE;
+    if (errno == ENOENT) return PS_ERROR_CONNREFUSED;
+    return _last_ps_result("purrsock_shm_map");
+  }
+
+  // A segment being created may not have its size yet; treat it like one that does not exist.
+  struct stat st;
+  if (create ? ftruncate(fd, (off_t)size) < 0 : fstat(fd, &st) < 0 || (size_t)st.st_size < size) {
+    ps_result_t result = create ? PS_ERROR_INTERNAL : PS_ERROR_CONNREFUSED;
+    if (create) shm_unlink(name);
+    close(fd);
+    return result;
+  }
+
+  void *mapped = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    if (create) shm_unlink(name);
+    return PS_ERROR_INTERNAL;
+  }
+  *addr = mapped;
+  return PS_SUCCESS;
+}
+
+void _purrsock_shm_unmap(void *addr, size_t size) {
+  munmap(addr, size);
+}
+
+void _purrsock_shm_unlink(const char *name) {
+  shm_unlink(name);
+}
+
+// Shared futexes, since the other side may be in another process.
+void _purrsock_futex_wait(uint32_t *word, uint32_t value, uint32_t timeout_ms) {
+  struct timespec timeout = { timeout_ms / 1000, (long)(timeout_ms % 1000) * 1000000 };
+  syscall(SYS_futex, word, FUTEX_WAIT, value, &timeout, NULL, 0);
+}
+
+void _purrsock_futex_wake(uint32_t *word) {
+  syscall(SYS_futex, word, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+}
+
+uint32_t _purrsock_process_id() {
+  return (uint32_t)getpid();
+}
+
+bool _purrsock_process_alive(uint32_t pid) {
+  return kill((pid_t)pid, 0) == 0 || errno != ESRCH;
+}
+
+static pthread_key_t s_thread_exit_key;
+static pthread_once_t s_thread_exit_once = PTHREAD_ONCE_INIT;
+
+static void _purrsock_thread_exit(void *callback) {
+  ((void (*)(void))callback)();
+}
+
+static void _purrsock_thread_exit_key_init() {
+  pthread_key_create(&s_thread_exit_key, _purrsock_thread_exit);
+}
+
+void _purrsock_at_thread_exit(void (*callback)(void)) {
+  pthread_once(&s_thread_exit_once, _purrsock_thread_exit_key_init);
+  pthread_setspecific(s_thread_exit_key, (void *)callback);
+}
+
+ps_result_t _purrsock_endpoint_from_addr(ps_endpoint_t *endpoint, const char *ip, ps_port_t port) {
+  struct sockaddr_storage addr;
+  if (!_purrsock_parse_addr(ip, port, &addr)) return PS_ERROR_INVALID_ARGUMENT;
+  _purrsock_endpoint_from_sockaddr(&addr, endpoint);
+  return PS_SUCCESS;
+}
+
+ps_result_t _purrsock_endpoint_to_addr(const ps_endpoint_t *endpoint, char *ip, size_t ip_size) {
+  int family = endpoint->family == PS_ADDRESS_IPV6 ? AF_INET6 : AF_INET;
+  return inet_ntop(family, endpoint->addr, ip, (socklen_t)ip_size) ? PS_SUCCESS : PS_ERROR_INVALID_ARGUMENT;
+}
+
+ps_result_t _purrsock_resolve_host(const char *host, char *ip, size_t ip_size) {
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_flags = AI_ADDRCONFIG;
+  struct addrinfo *info = NULL;
+  if (getaddrinfo(host, NULL, &hints, &info) != 0 || !info) return PS_ERROR_ADDRNOTAVAIL;
+
+  int res = getnameinfo(info->ai_addr, info->ai_addrlen, ip, (socklen_t)ip_size, NULL, 0, NI_NUMERICHOST);
+  freeaddrinfo(info);
+  return res == 0 ? PS_SUCCESS : PS_ERROR_ADDRNOTAVAIL;
+}
+
+ps_result_t _purrsock_read_socket_packets(_purrsock_socket_t *socket, ps_packet_t *packets, ps_endpoint_t *from, size_t count, size_t *received) {
+  assert(socket && packets && received && count <= PS_MAX_PACKET_BATCH);
+  _purrsock_socket_data_t *data = (_purrsock_socket_data_t *)socket->data;
+  if (!data) return PS_ERROR_NOTINIT;
+  if (socket->protocol != PS_PROTOCOL_UDP) return PS_ERROR_INVALID_ARGUMENT;
+
+  struct mmsghdr msgs[PS_MAX_PACKET_BATCH];
+  struct iovec iovs[PS_MAX_PACKET_BATCH];
+  struct sockaddr_storage addrs[PS_MAX_PACKET_BATCH];
+  memset(msgs, 0, count * sizeof(msgs[0]));
+  for (size_t i = 0; i < count; ++i) {
+    iovs[i].iov_base = packets[i].buf;
+    iovs[i].iov_len = packets[i].capacity;
+    msgs[i].msg_hdr.msg_iov = &iovs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+    if (from) {
+      msgs[i].msg_hdr.msg_name = &addrs[i];
+      msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+    }
+  }
+
+  // MSG_WAITFORONE: block for the first datagram only, then take whatever else is queued.
+  int res;
+  PS_STATS_START(start);
+  do {
+    res = recvmmsg(data->sockfd, msgs, (unsigned int)count, MSG_WAITFORONE, NULL);
+  } while (res < 0 && errno == EINTR);
+  PS_STATS_SYSCALL(socket, false, res < 0 && errno == EAGAIN, start);
+  if (res < 0) {
+    return _purrsock_io_result(socket, socket->timeouts.read_ms, "purrsock_read_socket_packets");
+  }
+
+  ps_result_t result = PS_SUCCESS;
+  for (int i = 0; i < res; ++i) {
+    packets[i].size = msgs[i].msg_len;
+    if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) result = PS_ERROR_MSGTOOLONG;
+    if (from) _purrsock_endpoint_from_sockaddr(&addrs[i], &from[i]);
+    PS_STATS_TRANSFER(socket, false, msgs[i].msg_len, 1);
+  }
+  *received = (size_t)res;
+  return result;
+}
+
+ps_result_t _purrsock_send_socket_packets(_purrsock_socket_t *socket, const ps_packet_t *packets, const ps_endpoint_t *to, size_t count, size_t *sent) {
+  assert(socket && packets && sent);
+  *sent = 0;
+  _purrsock_socket_data_t *data = (_purrsock_socket_data_t *)socket->data;
+  if (!data) return PS_ERROR_NOTINIT;
+  if (socket->protocol != PS_PROTOCOL_UDP) return PS_ERROR_INVALID_ARGUMENT;
+
+  struct mmsghdr msgs[PS_MAX_PACKET_BATCH];
+  struct iovec iovs[PS_MAX_PACKET_BATCH];
+  struct sockaddr_storage addrs[PS_MAX_PACKET_BATCH];
+
+  size_t total = 0;
+  while (total < count) {
+    size_t batch = count - total;
+    if (batch > PS_MAX_PACKET_BATCH) batch = PS_MAX_PACKET_BATCH;
+
+    memset(msgs, 0, batch * sizeof(msgs[0]));
+    for (size_t i = 0; i < batch; ++i) {
+      iovs[i].iov_base = packets[total + i].buf;
+      iovs[i].iov_len = packets[total + i].size;
+      msgs[i].msg_hdr.msg_iov = &iovs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+      if (to) {
+        msgs[i].msg_hdr.msg_name = &addrs[i];
+        msgs[i].msg_hdr.msg_namelen = _purrsock_endpoint_to_sockaddr(&to[total + i], &addrs[i]);
+      }
+    }
+
+    PS_STATS_START(start);
+    int res = sendmmsg(data->sockfd, msgs, (unsigned int)batch, MSG_NOSIGNAL);
+    PS_STATS_SYSCALL(socket, true, res < 0 && errno == EAGAIN, start);
+    if (res < 0) {
+      if (errno == EINTR) continue;
+      *sent = total;
+      return _purrsock_io_result(socket, socket->timeouts.write_ms, "purrsock_send_socket_packets");
+    }
+    for (int i = 0; i < res; ++i) PS_STATS_TRANSFER(socket, true, iovs[i].iov_len, 1);
+    total += (size_t)res;
+  }
+
+  *sent = total;
+  return PS_SUCCESS;
+}
+
+ps_result_t _purrsock_sendv(_purrsock_socket_t *socket, const ps_packet_t *slices, size_t count, const ps_endpoint_t *to) {
+  assert(socket && slices && count <= PS_MAX_PACKET_SLICES);
+  if (socket->memory || !_purrsock_is_datagram(socket->protocol)) return _purrsock_send_stream(socket, slices, count);
+  _purrsock_socket_data_t *data = (_purrsock_socket_data_t *)socket->data;
+  if (!data) return PS_ERROR_NOTINIT;
+
+  struct iovec iovs[PS_MAX_PACKET_SLICES];
+  for (size_t i = 0; i < count; ++i) {
+    iovs[i].iov_base = slices[i].buf;
+    iovs[i].iov_len = slices[i].size;
+  }
+
+  // sendmsg rather than writev, so that MSG_NOSIGNAL applies.
+  struct sockaddr_storage addr;
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iovs;
+  msg.msg_iovlen = count;
+  if (to && socket->protocol == PS_PROTOCOL_UDP) {
+    msg.msg_name = &addr;
+    msg.msg_namelen = _purrsock_endpoint_to_sockaddr(to, &addr);
+    if (!msg.msg_namelen) return PS_ERROR_INVALID_ARGUMENT;
+  }
+
+  // A datagram goes out whole or not at all.
+  ssize_t sent;
+  do {
+    PS_STATS_START(start);
+    sent = sendmsg(data->sockfd, &msg, MSG_NOSIGNAL);
+    PS_STATS_SYSCALL(socket, true, sent < 0 && errno == EAGAIN, start);
+  } while (sent < 0 && errno == EINTR);
+  if (sent < 0) return _purrsock_io_result(socket, socket->timeouts.write_ms, "purrsock_sendv");
+  PS_STATS_TRANSFER(socket, true, sent, true);
+  return PS_SUCCESS;
+}
+
+ps_result_t _purrsock_recvv(_purrsock_socket_t *socket, ps_packet_t *slices, size_t count, size_t *received, ps_endpoint_t *from) {
+  assert(socket && slices && received && count <= PS_MAX_PACKET_SLICES);
+  if (socket->memory) return _purrsock_memory_recvv(socket, slices, count, received);
+  _purrsock_socket_data_t *data = (_purrsock_socket_data_t *)socket->data;
+  if (!data) return PS_ERROR_NOTINIT;
+
+  struct iovec iovs[PS_MAX_PACKET_SLICES];
+  for (size_t i = 0; i < count; ++i) {
+    iovs[i].iov_base = slices[i].buf;
+    iovs[i].iov_len = slices[i].capacity;
+  }
+
+  struct sockaddr_storage addr;
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iovs;
+  msg.msg_iovlen = count;
+  if (from) {
+    msg.msg_name = &addr;
+    msg.msg_namelen = sizeof(addr);
+  }
+
+  ssize_t len;
+  PS_STATS_START(start);
+  do {
+    len = recvmsg(data->sockfd, &msg, 0);
+  } while (len < 0 && errno == EINTR);
+  PS_STATS_SYSCALL(socket, false, len < 0 && errno == EAGAIN, start);
+  if (len < 0) {
+    return _purrsock_io_result(socket, socket->timeouts.read_ms, "purrsock_recvv");
+  }
+  if (len == 0 && !_purrsock_is_datagram(socket->protocol)) {
+    return PS_CONNCLOSED;
+  }
+
+  // The kernel fills the slices in order; hand out the received length the same way.
+  size_t remaining = (size_t)len;
+  for (size_t i = 0; i < count; ++i) {
+    slices[i].size = remaining < slices[i].capacity ? remaining : slices[i].capacity;
+    remaining -= slices[i].size;
+  }
+  *received = (size_t)len;
+  if (from && socket->protocol == PS_PROTOCOL_UDP) _purrsock_endpoint_from_sockaddr(&addr, from);
+  PS_STATS_TRANSFER(socket, false, len, 1);
+
+  return (msg.msg_flags & MSG_TRUNC) ? PS_ERROR_MSGTOOLONG : PS_SUCCESS;
+}
+
+// The kernel takes at most SCM_MAX_FD (253) descriptors per message.
+#define PS_MAX_PASSED_FDS 253
+
+ps_result_t _purrsock_send_socket_fds(_purrsock_socket_t *socket, ps_packet_t packet, const int *fds, size_t count) {
+  assert(socket && packet.buf && (fds || !count));
+  _purrsock_socket_data_t *data = (_purrsock_socket_data_t *)socket->data;
+  if (!data) return socket->memory ? PS_ERROR_UNSUPPORTED : PS_ERROR_NOTINIT;
+  // Descriptors ride along with at least one byte of data.
+  if (!_purrsock_is_unix(socket->protocol) || !packet.size || count > PS_MAX_PASSED_FDS) return PS_ERROR_INVALID_ARGUMENT;
+  // Bytes kept from an earlier stream send go first.
+  ps_result_t flushed = _purrsock_flush_socket(socket);
+  if (flushed != PS_SUCCESS) return flushed;
 
-  ssize_t sent = send(to->sockfd, packet.buf, packet.size, 0);
+  union {
+    struct cmsghdr header;
+    char buf[CMSG_SPACE(sizeof(int) * PS_MAX_PASSED_FDS)];
+  } control;
+  struct iovec iov = { packet.buf, packet.size };
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  if (count) {
+    msg.msg_control = control.buf;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * count);
+  }
+
+  ssize_t sent;
+  PS_STATS_START(start);
+  do {
+    sent = sendmsg(data->sockfd, &msg, MSG_NOSIGNAL);
+  } while (sent < 0 && errno == EINTR);
+  PS_STATS_SYSCALL(socket, true, sent < 0 && errno == EAGAIN, start);
   if (sent < 0) {
-    return PS_ERROR_INTERNAL; 
+    return _purrsock_io_result(socket, socket->timeouts.write_ms, "purrsock_send_socket_fds");
+  }
+  PS_STATS_TRANSFER(socket, true, sent, 1);
+
+  // The descriptors went with the first byte; the rest of a stream packet follows as usual.
+  if ((size_t)sent < packet.size && socket->protocol == PS_PROTOCOL_UNIX_STREAM) {
+    ps_packet_t rest = { packet.size - sent, packet.buf + sent, packet.size - sent };
+    return _purrsock_send_socket_packet(socket, rest, NULL);
+  }
+  return PS_SUCCESS;
+}
+
+ps_result_t _purrsock_read_socket_fds(_purrsock_socket_t *socket, ps_packet_t *packet, int *fds, size_t capacity, size_t *count) {
+  assert(socket && packet && (fds || !capacity) && count);
+  *count = 0;
+  _purrsock_socket_data_t *data = (_purrsock_socket_data_t *)socket->data;
+  if (!data) return socket->memory ? PS_ERROR_UNSUPPORTED : PS_ERROR_NOTINIT;
+  if (!_purrsock_is_unix(socket->protocol)) return PS_ERROR_INVALID_ARGUMENT;
+  if (capacity > PS_MAX_PASSED_FDS) capacity = PS_MAX_PASSED_FDS;
+
+  union {
+    struct cmsghdr header;
+    char buf[CMSG_SPACE(sizeof(int) * PS_MAX_PASSED_FDS)];
+  } control;
+  struct iovec iov = { packet->buf, packet->capacity };
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = CMSG_SPACE(sizeof(int) * capacity);
+
+  ssize_t len;
+  PS_STATS_START(start);
+  do {
+    len = recvmsg(data->sockfd, &msg, MSG_CMSG_CLOEXEC);
+  } while (len < 0 && errno == EINTR);
+  PS_STATS_SYSCALL(socket, false, len < 0 && errno == EAGAIN, start);
+  if (len < 0) {
+    return _purrsock_io_result(socket, socket->timeouts.read_ms, "purrsock_read_socket_fds");
+  }
+
+  for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) continue;
+    size_t received = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    memcpy(fds + *count, CMSG_DATA(cmsg), received * sizeof(int));
+    *count += received;
+  }
+  if (len == 0 && !*count && socket->protocol == PS_PROTOCOL_UNIX_STREAM) {
+    return PS_CONNCLOSED;
+  }
+
+  packet->size = (size_t)len;
+  PS_STATS_TRANSFER(socket, false, len, 1);
+  // The kernel closes descriptors that did not fit, like the tail of a datagram that did not.
+  return (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) ? PS_ERROR_MSGTOOLONG : PS_SUCCESS;
+}
+
+// A passed socket is one byte naming its protocol, with the descriptor attached.
+ps_result_t _purrsock_pass_socket(_purrsock_socket_t *channel, _purrsock_socket_t *socket) {
+  assert(channel && socket);
+  _purrsock_socket_data_t *data = (_purrsock_socket_data_t *)socket->data;
+  if (!data) return socket->memory ? PS_ERROR_UNSUPPORTED : PS_ERROR_NOTINIT;
+
+  char protocol = (char)socket->protocol;
+  ps_packet_t packet = { 1, &protocol, 1 };
+  return _purrsock_send_socket_fds(channel, packet, &data->sockfd, 1);
+}
+
+ps_result_t _purrsock_accept_passed_socket(_purrsock_socket_t *channel, _purrsock_socket_t **socket) {
+  assert(channel && socket);
+  char protocol;
+  ps_packet_t packet = { 0, &protocol, 1 };
+  int fd;
+  size_t count;
+  ps_result_t result = _purrsock_read_socket_fds(channel, &packet, &fd, 1, &count);
+  if (result != PS_SUCCESS && result != PS_ERROR_MSGTOOLONG) return result;
+  if (count != 1 || packet.size != 1 || protocol < 0 || protocol >= COUNT_PS_PROTOCOLS) {
+    if (count) close(fd);
+    return PS_ERROR_INVALID_ARGUMENT;
+  }
+
+  struct sockaddr_storage addr;
+  socklen_t addr_len = sizeof(addr);
+  memset(&addr, 0, sizeof(addr));
+  getpeername(fd, (struct sockaddr *)&addr, &addr_len);
+  _purrsock_socket_t *passed = _purrsock_socket_from_fd(fd, (ps_protocol_t)protocol, &addr);
+  if (!passed) {
+    close(fd);
+    return PS_ERROR_INTERNAL;
+  }
+  *socket = passed;
+  return PS_SUCCESS;
+}
+
+// sendfile and splice cannot take MSG_NOSIGNAL: keep SIGPIPE blocked around them and swallow one they raise.
+typedef struct {
+  sigset_t old_mask;
+  bool was_pending;
+} _purrsock_sigpipe_guard_t;
+
+static void _purrsock_sigpipe_block(_purrsock_sigpipe_guard_t *guard) {
+  sigset_t pending, set;
+  sigemptyset(&set);
+  sigaddset(&set, SIGPIPE);
+  sigpending(&pending);
+  guard->was_pending = sigismember(&pending, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &set, &guard->old_mask);
+}
+
+static void _purrsock_sigpipe_unblock(_purrsock_sigpipe_guard_t *guard, bool raised) {
+  if (raised && !guard->was_pending) {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGPIPE);
+    struct timespec zero = {0, 0};
+    while (sigtimedwait(&set, NULL, &zero) < 0 && errno == EINTR) {}
+  }
+  pthread_sigmask(SIG_SETMASK, &guard->old_mask, NULL);
+}
+
+int _purrsock_open_file(const char *path) {
+  return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+void _purrsock_close_file(int fd) {
+  close(fd);
+}
+
+ps_result_t _purrsock_file_size(int fd, uint64_t *size) {
+  struct stat st;
+  if (fstat(fd, &st) < 0) return _last_ps_result("purrsock_file_size");
+  if (!S_ISREG(st.st_mode)) return PS_ERROR_INVALID_ARGUMENT;
+  *size = (uint64_t)st.st_size;
+  return PS_SUCCESS;
+}
+
+// Sends a file range through a pooled buffer, for descriptors sendfile cannot read from. Resumes at `*sent`;
+// the socket's kept bytes must have been flushed.
+static ps_result_t _purrsock_send_file_copy(_purrsock_socket_t *socket, int sockfd, int fd, uint64_t offset, uint64_t length, uint64_t *sent) {
+  ps_packet_t packet = {0};
+  ps_result_t result = _purrsock_packet_acquire(NULL, PS_PACKET_DATAGRAM_CAPACITY, &packet);
+  if (result != PS_SUCCESS) return result;
+
+  while (*sent < length && result == PS_SUCCESS) {
+    size_t chunk = length - *sent < packet.capacity ? (size_t)(length - *sent) : packet.capacity;
+    ssize_t len = pread(fd, packet.buf, chunk, (off_t)(offset + *sent));
+    if (len < 0) {
+      if (errno == EINTR) continue;
+      result = _last_ps_result("purrsock_send_file");
+      break;
+    }
+    if (len == 0) break;
+
+    for (ssize_t done = 0; done < len;) {
+      PS_STATS_START(start);
+      ssize_t res = send(sockfd, packet.buf + done, len - done, MSG_NOSIGNAL);
+      PS_STATS_SYSCALL(socket, true, res < 0 && errno == EAGAIN, start);
+      if (res < 0) {
+        if (errno == EINTR) continue;
+        result = _last_ps_result("purrsock_send_file");
+        break;
+      }
+      PS_STATS_TRANSFER(socket, true, res, *sent == 0);
+      done += res;
+      *sent += res;
+    }
+  }
+
+  _purrsock_packet_release(&packet);
+  return result;
+}
+
+ps_result_t _purrsock_send_file(_purrsock_socket_t *socket, int fd, uint64_t offset, uint64_t length, uint64_t *sent) {
+  assert(socket && sent);
+  *sent = 0;
+  _purrsock_socket_data_t *data = (_purrsock_socket_data_t *)socket->data;
+  if (!data) return PS_ERROR_NOTINIT;
+  if ((socket->protocol != PS_PROTOCOL_TCP && socket->protocol != PS_PROTOCOL_UNIX_STREAM) || fd < 0) return PS_ERROR_INVALID_ARGUMENT;
+
+  // Bytes kept from an earlier send go first; none of the file goes out while they do not fit.
+  ps_result_t flushed = _purrsock_flush_socket(socket);
+  if (flushed != PS_SUCCESS) return flushed;
+
+  if (!length) {
+    struct stat st;
+    if (fstat(fd, &st) < 0) return _last_ps_result("purrsock_send_file");
+    if ((uint64_t)st.st_size <= offset) return PS_SUCCESS;
+    length = (uint64_t)st.st_size - offset;
+  }
+
+  _purrsock_sigpipe_guard_t guard;
+  _purrsock_sigpipe_block(&guard);
+
+  ps_result_t result = PS_SUCCESS;
+  while (*sent < length) {
+    off_t position = (off_t)(offset + *sent);
+    size_t chunk = length - *sent < 0x7ffff000 ? (size_t)(length - *sent) : 0x7ffff000;
+    PS_STATS_START(start);
+    ssize_t res = sendfile(data->sockfd, fd, &position, chunk);
+    PS_STATS_SYSCALL(socket, true, res < 0 && errno == EAGAIN, start);
+    if (res < 0) {
+      if (errno == EINTR) continue;
+      // Descriptors without page cache backing (pipes, some special files) cannot be sent from.
+      if (errno == EINVAL || errno == ENOSYS) {
+        result = _purrsock_send_file_copy(socket, data->sockfd, fd, offset, length, sent);
+        break;
+      }
+      result = _last_ps_result("purrsock_send_file");
+      break;
+    }
+    if (res == 0) break;  // The file ended before `length`.
+    PS_STATS_TRANSFER(socket, true, res, *sent == 0);
+    *sent += res;
+  }
+
+  _purrsock_sigpipe_unblock(&guard, result == PS_ERROR_SHUTDOWN);
+  return result;
+}
+
+// Splicing goes through a pipe; each thread keeps one, always empty between calls.
+static PS_THREAD_LOCAL int s_splice_pipe[2] = { -1, -1 };
+
+static void _purrsock_splice_pipe_reset() {
+  close(s_splice_pipe[0]);
+  close(s_splice_pipe[1]);
+  s_splice_pipe[0] = s_splice_pipe[1] = -1;
+}
+
+// Waits for room on a blocking socket, up to its write timeout; a non-blocking one is never waited on.
+static ps_result_t _purrsock_wait_socket_writable(_purrsock_socket_t *socket) {
+  int sockfd = ((_purrsock_socket_data_t *)socket->data)->sockfd;
+  int flags = fcntl(sockfd, F_GETFL, 0);
+  if (flags < 0) return _last_ps_result("purrsock_splice");
+  if (flags & O_NONBLOCK) return PS_ERROR_WOULDBLOCK;
+
+  struct pollfd pfd = { .fd = sockfd, .events = POLLOUT };
+  int timeout_ms = socket->timeouts.write_ms ? (int)socket->timeouts.write_ms : -1;
+  int res;
+  do {
+    res = poll(&pfd, 1, timeout_ms);
+  } while (res < 0 && errno == EINTR);
+  if (res < 0) return _last_ps_result("purrsock_splice");
+  return res == 0 ? PS_ERROR_TIMEOUT : PS_SUCCESS;
+}
+
+// Moves what is left in the pipe to the socket's unsent bytes, which go out before its next write.
+static ps_result_t _purrsock_splice_keep_rest(_purrsock_socket_t *socket, size_t size) {
+  char *unsent = _purrsock_reserve_unsent(socket, size);
+  if (!unsent) return PS_ERROR_INTERNAL;
+  size_t kept = 0;
+  while (kept < size) {
+    ssize_t res = read(s_splice_pipe[0], unsent + kept, size - kept);
+    if (res > 0) {
+      kept += (size_t)res;
+      continue;
+    }
+    if (res < 0 && errno == EINTR) continue;
+    socket->unsent_size -= size;
+    return _last_ps_result("purrsock_splice");
+  }
+  return PS_SUCCESS;
+}
+
+ps_result_t _purrsock_splice(_purrsock_socket_t *from, _purrsock_socket_t *to, size_t length, size_t *moved) {
+  assert(from && to && moved);
+  if (from->memory || to->memory) return PS_ERROR_UNSUPPORTED;
+  _purrsock_socket_data_t *source = (_purrsock_socket_data_t *)from->data;
+  _purrsock_socket_data_t *destination = (_purrsock_socket_data_t *)to->data;
+  if (!source || !destination) return PS_ERROR_NOTINIT;
+
+  if (s_splice_pipe[0] < 0 && pipe2(s_splice_pipe, O_CLOEXEC | O_NONBLOCK) < 0) {
+    return _last_ps_result("purrsock_splice");
+  }
+
+  // Bytes kept from an earlier call go first, and nothing more is taken from `from` while `to` is full.
+  ps_result_t result = _purrsock_flush_socket(to);
+  if (result != PS_SUCCESS) return result;
+
+  // Waits for data like a read if `from` is blocking; the pipe side never blocks.
+  ssize_t in;
+  PS_STATS_START(start);
+  do {
+    in = splice(source->sockfd, NULL, s_splice_pipe[1], NULL, length, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+  } while (in < 0 && errno == EINTR);
+  PS_STATS_SYSCALL(from, false, in < 0 && errno == EAGAIN, start);
+  if (in < 0) {
+    return errno == EINVAL ? PS_ERROR_UNSUPPORTED : _last_ps_result("purrsock_splice");
+  }
+  if (in == 0) return PS_CONNCLOSED;
+  PS_STATS_TRANSFER(from, false, in, 1);
+
+  _purrsock_sigpipe_guard_t guard;
+  _purrsock_sigpipe_block(&guard);
+
+  // Data taken from `from` has to reach `to`: a blocking `to` is waited on up to its write timeout, and
+  // whatever does not fit is kept as its unsent bytes rather than left in the pipe.
+  ssize_t out = 0;
+  while (out < in) {
+    PS_STATS_START(start);
+    ssize_t res = splice(s_splice_pipe[0], NULL, destination->sockfd, NULL, in - out, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    PS_STATS_SYSCALL(to, true, res < 0 && errno == EAGAIN, start);
+    if (res > 0) {
+      PS_STATS_TRANSFER(to, true, res, out == 0);
+      out += res;
+      continue;
+    }
+    if (res < 0 && errno == EINTR) continue;
+    if (res < 0 && errno == EAGAIN) {
+      result = _purrsock_wait_socket_writable(to);
+      if (result == PS_SUCCESS) continue;
+      if (result == PS_ERROR_WOULDBLOCK || result == PS_ERROR_TIMEOUT) {
+        ps_result_t kept = _purrsock_splice_keep_rest(to, (size_t)(in - out));
+        if (kept == PS_SUCCESS) {
+          out = in;
+          break;
+        }
+        result = kept;
+      }
+    } else {
+      result = _last_ps_result("purrsock_splice");
+    }
+    _purrsock_splice_pipe_reset();
+    break;
+  }
+
+  _purrsock_sigpipe_unblock(&guard, result == PS_ERROR_SHUTDOWN);
+  *moved = (size_t)out;
+  return result;
+}
+
+// Largest UDP payload of an IPv6 datagram, also the most one segmented send may carry.
+#define PS_UDP_MAX_PAYLOAD 65487
+#define PS_UDP_MAX_SEGMENTS 64
+
+// Sends one datagram, or a train of `segment_size` datagrams when it is non-zero.
+static ssize_t _purrsock_send_datagram(int sockfd, char *buf, size_t len, uint16_t segment_size, const struct sockaddr_storage *addr, socklen_t addr_len) {
+  struct iovec iov = { .iov_base = buf, .iov_len = len };
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_name = (void *)addr;
+  msg.msg_namelen = addr ? addr_len : 0;
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+
+  union {
+    char buf[CMSG_SPACE(sizeof(uint16_t))];
+    struct cmsghdr align;
+  } control;
+  if (segment_size) {
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_UDP;
+    cmsg->cmsg_type = UDP_SEGMENT;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    memcpy(CMSG_DATA(cmsg), &segment_size, sizeof(segment_size));
+  }
+
+  return sendmsg(sockfd, &msg, MSG_NOSIGNAL);
+}
+
+ps_result_t _purrsock_send_socket_packet_segmented(_purrsock_socket_t *socket, ps_packet_t packet, size_t segment_size, const ps_endpoint_t *to, size_t *sent) {
+  assert(socket && segment_size && sent);
+  *sent = 0;
+  _purrsock_socket_data_t *data = (_purrsock_socket_data_t *)socket->data;
+  if (!data) return PS_ERROR_NOTINIT;
+  if (socket->protocol != PS_PROTOCOL_UDP || segment_size > PS_UDP_MAX_PAYLOAD) return PS_ERROR_INVALID_ARGUMENT;
+
+  struct sockaddr_storage addr;
+  socklen_t addr_len = to ? _purrsock_endpoint_to_sockaddr(to, &addr) : 0;
+
+  size_t segments_per_send = PS_UDP_MAX_PAYLOAD / segment_size;
+  if (segments_per_send > PS_UDP_MAX_SEGMENTS) segments_per_send = PS_UDP_MAX_SEGMENTS;
+
+  // Devices without checksum offload reject UDP_SEGMENT with EIO, old kernels with EINVAL.
+  bool offload = true;
+  size_t offset = 0;
+  do {
+    size_t chunk = packet.size - offset;
+    size_t limit = offload ? segments_per_send * segment_size : segment_size;
+    if (chunk > limit) chunk = limit;
+
+    bool segmented = chunk > segment_size;
+    PS_STATS_START(start);
+    ssize_t res = _purrsock_send_datagram(data->sockfd, packet.buf + offset, chunk, segmented ? (uint16_t)segment_size : 0, to ? &addr : NULL, addr_len);
+    PS_STATS_SYSCALL(socket, true, res < 0 && errno == EAGAIN, start);
+    if (res < 0) {
+      if (errno == EINTR) continue;
+      if (segmented && (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT)) {
+        offload = false;
+        continue;
+      }
+      return _last_ps_result("purrsock_send_socket_packet_segmented");
+    }
+    // An empty buffer still goes out as one empty datagram.
+    size_t segments = chunk ? (chunk + segment_size - 1) / segment_size : 1;
+    PS_STATS_TRANSFER(socket, true, chunk, segments);
+    *sent += segments;
+    offset += chunk;
+  } while (offset < packet.size);
+
+  return PS_SUCCESS;
+}
+
+ps_result_t _purrsock_set_socket_gro(_purrsock_socket_t *socket, bool enabled) {
+  assert(socket);
+  _purrsock_socket_data_t *data = (_purrsock_socket_data_t *)socket->data;
+  if (!data) return PS_ERROR_NOTINIT;
+  if (socket->protocol != PS_PROTOCOL_UDP) return PS_ERROR_INVALID_ARGUMENT;
+
+  int value = enabled ? 1 : 0;
+  if (setsockopt(data->sockfd, SOL_UDP, UDP_GRO, &value, sizeof(value)) < 0) {
+    return _last_ps_result("purrsock_set_socket_gro");
+  }
+  return PS_SUCCESS;
+}
+
+ps_result_t _purrsock_read_socket_packet_segmented(_purrsock_socket_t *socket, ps_packet_t *packet, size_t *segment_size, ps_endpoint_t *from) {
+  assert(socket && packet && segment_size);
+  _purrsock_socket_data_t *data = (_purrsock_socket_data_t *)socket->data;
+  if (!data) return PS_ERROR_NOTINIT;
+  if (socket->protocol != PS_PROTOCOL_UDP) return PS_ERROR_INVALID_ARGUMENT;
+
+  struct sockaddr_storage addr;
+  struct iovec iov = { .iov_base = packet->buf, .iov_len = packet->capacity };
+  union {
+    char buf[CMSG_SPACE(sizeof(int))];
+    struct cmsghdr align;
+  } control;
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_name = &addr;
+  msg.msg_namelen = sizeof(addr);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+
+  ssize_t len;
+  PS_STATS_START(start);
+  do {
+    len = recvmsg(data->sockfd, &msg, MSG_TRUNC);
+  } while (len < 0 && errno == EINTR);
+  PS_STATS_SYSCALL(socket, false, len < 0 && errno == EAGAIN, start);
+  if (len < 0) {
+    return _purrsock_io_result(socket, socket->timeouts.read_ms, "purrsock_read_socket_packet_segmented");
+  }
+
+  ps_result_t result = PS_SUCCESS;
+  packet->size = len;
+  if ((size_t)len > packet->capacity) {
+    packet->size = packet->capacity;
+    result = PS_ERROR_MSGTOOLONG;
+  }
+
+  // The UDP_GRO control message carries the size of the datagrams that were coalesced.
+  *segment_size = 0;
+  for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+      int gso_size;
+      memcpy(&gso_size, CMSG_DATA(cmsg), sizeof(gso_size));
+      *segment_size = (size_t)gso_size;
+    }
+  }
+
+  if (from) _purrsock_endpoint_from_sockaddr(&addr, from);
+  PS_STATS_TRANSFER(socket, false, packet->size, *segment_size ? (packet->size + *segment_size - 1) / *segment_size : 1);
+  return result;
+}
+
+ps_result_t _purrsock_set_socket_blocking(_purrsock_socket_t *socket, bool blocking) {
+  assert(socket);
+  if (socket->memory) return _purrsock_memory_set_blocking(socket, blocking);
+  _purrsock_socket_data_t *data = (_purrsock_socket_data_t *)socket->data;
+  if (!data) return PS_ERROR_NOTINIT;
+
+  int flags = fcntl(data->sockfd, F_GETFL, 0);
+  if (flags < 0) {
+    return _last_ps_result("purrsock_set_socket_blocking");
+  }
+
+  flags = blocking ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK);
+  if (fcntl(data->sockfd, F_SETFL, flags) < 0) {
+    return _last_ps_result("purrsock_set_socket_blocking");
+  }
+
+  return PS_SUCCESS;
+}
+
+ps_result_t _purrsock_set_socket_timeouts(_purrsock_socket_t *socket, const ps_socket_timeouts_t *timeouts) {
+  assert(socket && timeouts);
+  if (socket->memory) {
+    socket->timeouts = *timeouts;
+    return PS_SUCCESS;
   }
+  _purrsock_socket_data_t *data = (_purrsock_socket_data_t *)socket->data;
+  if (!data) return PS_ERROR_NOTINIT;
+
+  struct timeval read_timeout = { timeouts->read_ms / 1000, (timeouts->read_ms % 1000) * 1000 };
+  struct timeval write_timeout = { timeouts->write_ms / 1000, (timeouts->write_ms % 1000) * 1000 };
+  if (setsockopt(data->sockfd, SOL_SOCKET, SO_RCVTIMEO, &read_timeout, sizeof(read_timeout)) < 0 ||
+      setsockopt(data->sockfd, SOL_SOCKET, SO_SNDTIMEO, &write_timeout, sizeof(write_timeout)) < 0) {
+    return _last_ps_result("purrsock_set_socket_timeouts");
+  }
+
+  socket->timeouts = *timeouts;
+  return PS_SUCCESS;
+}
+
+static ps_result_t _purrsock_set_tcp_option(_purrsock_socket_t *socket, int option, bool enabled, const char *func_name) {
+  assert(socket);
+  // Nothing is ever delayed or coalesced in memory or on Unix stream sockets.
+  if (socket->memory || socket->protocol == PS_PROTOCOL_UNIX_STREAM) return PS_SUCCESS;
+  _purrsock_socket_data_t *data = (_purrsock_socket_data_t *)socket->data;
+  if (!data) return PS_ERROR_NOTINIT;
+  if (socket->protocol != PS_PROTOCOL_TCP) return PS_ERROR_INVALID_ARGUMENT;
 
+  int value = enabled ? 1 : 0;
+  if (setsockopt(data->sockfd, IPPROTO_TCP, option, &value, sizeof(value)) < 0) {
+    return _last_ps_result(func_name);
+  }
   return PS_SUCCESS;
 }
 
+ps_result_t _purrsock_set_socket_nodelay(_purrsock_socket_t *socket, bool enabled) {
+  return _purrsock_set_tcp_option(socket, TCP_NODELAY, enabled, "purrsock_set_socket_nodelay");
+}
+
+ps_result_t _purrsock_set_socket_cork(_purrsock_socket_t *socket, bool enabled) {
+  return _purrsock_set_tcp_option(socket, TCP_CORK, enabled, "purrsock_set_socket_cork");
+}
+
+// A connection is reusable while its peer neither hung up nor sent anything nobody asked for.
+bool _purrsock_socket_is_idle_alive(_purrsock_socket_t *socket) {
+  if (socket->memory) return _purrsock_memory_is_idle_alive(socket);
+  _purrsock_socket_data_t *data = (_purrsock_socket_data_t *)socket->data;
+  if (!data) return false;
+  if (_purrsock_is_datagram(socket->protocol)) return true;
+
+  char byte;
+  ssize_t res = recv(data->sockfd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+  return res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
 #endif // __linux__
@@ -0,0 +1,325 @@
+// Copyright (c) 2024 ClawsoftSolutions. All rights reserved.
+//
+// This software is licensed under the MIT License.
+// See LICENSE file for more information.
+//
+
+#ifdef __linux__
+
+#define _GNU_SOURCE
+#include "internal.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+// Happy eyeballs (RFC 8305): addresses are tried in interleaved family order, a new attempt starting
+// whenever the previous one failed or has been pending for the attempt delay. The first handshake to
+// finish wins; the others are abandoned.
+
+#define PS_CONNECT_DEFAULT_ATTEMPT_DELAY_MS 250
+
+typedef struct _purrsock_connect_s _purrsock_connect_t;
+
+typedef struct {
+  _purrsock_connect_t *dial;
+  _purrsock_socket_t *socket;      // NULL once the attempt failed.
+} _purrsock_connect_attempt_t;
+
+struct _purrsock_connect_s {
+  _purrsock_loop_t *loop;
+  struct sockaddr_storage *addrs;  // In the order they are tried.
+  size_t addr_count;
+  _purrsock_connect_attempt_t *attempts; // One per address started so far.
+  size_t attempt_count;
+  size_t pending;                  // Attempts still in progress.
+  uint32_t attempt_delay_ms;
+  ps_result_t last_error;
+  ps_timer_t delay_timer;
+  ps_timer_t deadline_timer;
+  ps_port_t port;
+  bool resolving;                  // A resolver lookup is running; it frees the dial if the connect finished first.
+  ps_connect_callback_t callback;  // NULL once called.
+  void *user_data;
+};
+
+static socklen_t _purrsock_connect_addr_len(const struct sockaddr_storage *addr) {
+  return addr->ss_family == AF_INET6 ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+}
+
+// Orders the addresses for dialing: the families alternate, starting with the one ranked first, each
+// keeping its rank order.
+static ps_result_t _purrsock_connect_set_addrs(_purrsock_connect_t *dial, const struct sockaddr_storage *addrs, size_t count) {
+  if (!count) return PS_ERROR_ADDRNOTAVAIL;
+  dial->addrs = (struct sockaddr_storage *)calloc(count, sizeof(*dial->addrs));
+  dial->attempts = (_purrsock_connect_attempt_t *)calloc(count, sizeof(*dial->attempts));
+  if (!dial->addrs || !dial->attempts) return PS_ERROR_INTERNAL;
+
+  // Cursors over the preferred and the other family; once one runs out the other takes every turn.
+  int first_family = addrs[0].ss_family;
+  size_t next[2] = { 0, 0 };
+  for (int turn = 0; dial->addr_count < count; turn = !turn) {
+    int family = (turn == 0) == (first_family == AF_INET6) ? AF_INET6 : AF_INET;
+    size_t i = next[turn];
+    while (i < count && addrs[i].ss_family != family) i++;
+    next[turn] = i + 1;
+    if (i >= count) continue;
+
+    dial->addrs[dial->addr_count++] = addrs[i];
+  }
+  return PS_SUCCESS;
+}
+
+// Resolves `host` with the system's resolver, which blocks.
+static ps_result_t _purrsock_connect_resolve(_purrsock_connect_t *dial, const char *host, ps_port_t port) {
+  char service[8];
+  snprintf(service, sizeof(service), "%u", (unsigned)port);
+
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_ADDRCONFIG | AI_NUMERICSERV;
+
+  struct addrinfo *results = NULL;
+  if (getaddrinfo(host, service, &hints, &results) != 0) return PS_ERROR_ADDRNOTAVAIL;
+
+  size_t count = 0;
+  for (struct addrinfo *info = results; info; info = info->ai_next) count++;
+  struct sockaddr_storage *addrs = (struct sockaddr_storage *)calloc(count ? count : 1, sizeof(*addrs));
+  if (!addrs) {
+    freeaddrinfo(results);
+    return PS_ERROR_INTERNAL;
+  }
+
+  count = 0;
+  for (struct addrinfo *info = results; info; info = info->ai_next) {
+    if (info->ai_family != AF_INET && info->ai_family != AF_INET6) continue;
+    memcpy(&addrs[count++], info->ai_addr, info->ai_addrlen);
+  }
+  freeaddrinfo(results);
+
+  ps_result_t result = _purrsock_connect_set_addrs(dial, addrs, count);
+  free(addrs);
+  return result;
+}
+
+static void _purrsock_connect_free(_purrsock_connect_t *dial) {
+  free(dial->addrs);
+  free(dial->attempts);
+  free(dial);
+}
+
+static void _purrsock_connect_close_attempt(_purrsock_connect_t *dial, _purrsock_connect_attempt_t *attempt) {
+  if (!attempt->socket) return;
+  if (attempt->socket->loop) _purrsock_loop_remove_socket(dial->loop, attempt->socket);
+  _purrsock_destroy_socket(attempt->socket);
+  free(attempt->socket);
+  attempt->socket = NULL;
+  dial->pending--;
+}
+
+// Abandons every other attempt, hands the winner (or NULL) to the callback and frees the dial.
+static void _purrsock_connect_finish(_purrsock_connect_t *dial, _purrsock_socket_t *socket, ps_result_t result) {
+  _purrsock_loop_stop_timer(dial->loop, &dial->delay_timer);
+  _purrsock_loop_stop_timer(dial->loop, &dial->deadline_timer);
+  for (size_t i = 0; i < dial->attempt_count; ++i) {
+    _purrsock_connect_attempt_t *attempt = &dial->attempts[i];
+    if (attempt->socket == socket) continue;
+    _purrsock_connect_close_attempt(dial, attempt);
+  }
+  if (socket && socket->loop) _purrsock_loop_remove_socket(dial->loop, socket);
+
+  ps_connect_callback_t callback = dial->callback;
+  void *user_data = dial->user_data;
+  _purrsock_loop_t *loop = dial->loop;
+  dial->callback = NULL;
+  if (!dial->resolving) _purrsock_connect_free(dial);
+  callback((ps_loop_t)loop, result, (ps_socket_t)socket, user_data);
+}
+
+static ps_result_t _purrsock_connect_socket_error(_purrsock_socket_t *socket) {
+  int error = 0;
+  socklen_t error_len = sizeof(error);
+  if (getsockopt(((_purrsock_socket_data_t *)socket->data)->sockfd, SOL_SOCKET, SO_ERROR, &error, &error_len) < 0) {
+    return _last_ps_result("purrsock_connect_async");
+  }
+  if (!error) return PS_SUCCESS;
+  errno = error;
+  return _last_ps_result("purrsock_connect_async");
+}
+
+static bool _purrsock_connect_start_next(_purrsock_connect_t *dial);
+
+static void _purrsock_connect_attempt_failed(_purrsock_connect_t *dial, _purrsock_connect_attempt_t *attempt, ps_result_t result) {
+  _purrsock_connect_close_attempt(dial, attempt);
+  dial->last_error = result;
+
+  // No point waiting out the delay: the next address goes right away.
+  _purrsock_loop_stop_timer(dial->loop, &dial->delay_timer);
+  if (!_purrsock_connect_start_next(dial) && !dial->pending) _purrsock_connect_finish(dial, NULL, dial->last_error);
+}
+
+static void _purrsock_connect_on_writable(ps_loop_t loop, ps_socket_t socket, void *user_data) {
+  (void)loop;
+  _purrsock_connect_attempt_t *attempt = (_purrsock_connect_attempt_t *)user_data;
+  _purrsock_socket_t *internal_socket = (_purrsock_socket_t *)socket;
+
+  ps_result_t result = _purrsock_connect_socket_error(internal_socket);
+  if (result == PS_SUCCESS) {
+    _purrsock_connect_finish(attempt->dial, internal_socket, PS_SUCCESS);
+  } else {
+    _purrsock_connect_attempt_failed(attempt->dial, attempt, result);
+  }
+}
+
+// The loop already removed the socket; only the error is left to collect.
+static void _purrsock_connect_on_close(ps_loop_t loop, ps_socket_t socket, void *user_data) {
+  (void)loop;
+  _purrsock_connect_attempt_t *attempt = (_purrsock_connect_attempt_t *)user_data;
+  ps_result_t result = _purrsock_connect_socket_error((_purrsock_socket_t *)socket);
+  _purrsock_connect_attempt_failed(attempt->dial, attempt, result == PS_SUCCESS ? PS_ERROR_CONNRESET : result);
+}
+
+// Starts the handshake with the next address, returning PS_SUCCESS once it is in progress.
+static ps_result_t _purrsock_connect_start_attempt(const struct sockaddr_storage *addr, _purrsock_socket_t **out_socket) {
+  *out_socket = NULL;
+  int sockfd = socket(addr->ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (sockfd < 0) return _last_ps_result("purrsock_connect_async");
+
+  _purrsock_socket_t *socket = _purrsock_socket_from_fd(sockfd, PS_PROTOCOL_TCP, addr);
+  if (!socket) {
+    close(sockfd);
+    return PS_ERROR_INTERNAL;
+  }
+
+  ps_result_t result = PS_SUCCESS;
+  if (connect(sockfd, (const struct sockaddr *)addr, _purrsock_connect_addr_len(addr)) < 0 && errno != EINPROGRESS) {
+    result = _last_ps_result("purrsock_connect_async");
+  }
+  if (result != PS_SUCCESS) {
+    _purrsock_destroy_socket(socket);
+    free(socket);
+    return result;
+  }
+
+  *out_socket = socket;
+  return PS_SUCCESS;
+}
+
+// Starts attempts until one is in progress, returning false once no address is left to try.
+static bool _purrsock_connect_start_next(_purrsock_connect_t *dial) {
+  while (dial->attempt_count < dial->addr_count) {
+    _purrsock_connect_attempt_t *attempt = &dial->attempts[dial->attempt_count];
+    const struct sockaddr_storage *addr = &dial->addrs[dial->attempt_count];
+    dial->attempt_count++;
+
+    _purrsock_socket_t *socket;
+    ps_result_t result = _purrsock_connect_start_attempt(addr, &socket);
+    if (result != PS_SUCCESS) {
+      dial->last_error = result;
+      continue;
+    }
+
+    attempt->dial = dial;
+    attempt->socket = socket;
+    dial->pending++;
+
+    ps_loop_callbacks_t callbacks = {0};
+    callbacks.on_write = _purrsock_connect_on_writable;
+    callbacks.on_close = _purrsock_connect_on_close;
+    callbacks.user_data = attempt;
+    result = _purrsock_loop_add_socket(dial->loop, socket, callbacks);
+    if (result != PS_SUCCESS) {
+      _purrsock_connect_close_attempt(dial, attempt);
+      dial->last_error = result;
+      continue;
+    }
+
+    if (dial->attempt_count < dial->addr_count) {
+      _purrsock_loop_start_timer(dial->loop, &dial->delay_timer, dial->attempt_delay_ms);
+    }
+    return true;
+  }
+  return false;
+}
+
+static void _purrsock_connect_delay_expired(ps_loop_t loop, ps_timer_t *timer, void *user_data) {
+  (void)loop; (void)timer;
+  // With nothing left to start, the attempts still pending finish the dial.
+  _purrsock_connect_start_next((_purrsock_connect_t *)user_data);
+}
+
+static void _purrsock_connect_deadline_expired(ps_loop_t loop, ps_timer_t *timer, void *user_data) {
+  (void)loop; (void)timer;
+  _purrsock_connect_finish((_purrsock_connect_t *)user_data, NULL, PS_ERROR_TIMEOUT);
+}
+
+static void _purrsock_connect_resolved(ps_resolver_t resolver, ps_result_t result, const ps_endpoint_t *addresses, size_t count, void *user_data) {
+  (void)resolver;
+  _purrsock_connect_t *dial = (_purrsock_connect_t *)user_data;
+  dial->resolving = false;
+  if (!dial->callback) {
+    _purrsock_connect_free(dial);
+    return;
+  }
+
+  struct sockaddr_storage addrs[PS_RESOLVE_MAX_ADDRESSES];
+  for (size_t i = 0; i < count; ++i) {
+    ps_endpoint_t endpoint = addresses[i];
+    endpoint.port = dial->port;
+    _purrsock_endpoint_to_sockaddr(&endpoint, &addrs[i]);
+  }
+  if (result == PS_SUCCESS) result = _purrsock_connect_set_addrs(dial, addrs, count);
+  if (result != PS_SUCCESS) {
+    _purrsock_connect_finish(dial, NULL, result);
+  } else if (!_purrsock_connect_start_next(dial)) {
+    _purrsock_connect_finish(dial, NULL, dial->last_error);
+  }
+}
+
+ps_result_t _purrsock_connect_async(_purrsock_loop_t *loop, const char *host, ps_port_t port, const ps_connect_options_t *options, ps_connect_callback_t callback, void *user_data) {
+  assert(loop && host && callback);
+  assert(!options || !options->resolver || _purrsock_resolver_get_loop((_purrsock_resolver_t *)options->resolver) == loop);
+
+  _purrsock_connect_t *dial = (_purrsock_connect_t *)calloc(1, sizeof(*dial));
+  if (!dial) return PS_ERROR_INTERNAL;
+  dial->loop = loop;
+  dial->port = port;
+  dial->callback = callback;
+  dial->user_data = user_data;
+  dial->last_error = PS_ERROR_ADDRNOTAVAIL;
+  dial->attempt_delay_ms = options && options->attempt_delay_ms ? options->attempt_delay_ms : PS_CONNECT_DEFAULT_ATTEMPT_DELAY_MS;
+  ps_timer_init(&dial->delay_timer, _purrsock_connect_delay_expired, dial);
+  ps_timer_init(&dial->deadline_timer, _purrsock_connect_deadline_expired, dial);
+
+  if (options && options->resolver) {
+    // The lookup always answers from the loop, so everything from here on goes through the callback.
+    ps_result_t result = _purrsock_resolve_async((_purrsock_resolver_t *)options->resolver, host, _purrsock_connect_resolved, dial);
+    if (result != PS_SUCCESS) {
+      _purrsock_connect_free(dial);
+      return result;
+    }
+    dial->resolving = true;
+  } else {
+    ps_result_t result = _purrsock_connect_resolve(dial, host, port);
+
+    // The first handshake starts right away; if no address can even be dialed, nothing is left to call back.
+    if (result == PS_SUCCESS && !_purrsock_connect_start_next(dial)) result = dial->last_error;
+    if (result != PS_SUCCESS) {
+      _purrsock_connect_free(dial);
+      return result;
+    }
+  }
+
+  if (options && options->timeout_ms) _purrsock_loop_start_timer(loop, &dial->deadline_timer, options->timeout_ms);
+  return PS_SUCCESS;
+}
+
+#endif // __linux__
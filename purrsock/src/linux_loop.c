@@ -0,0 +1,1161 @@
+// Copyright (c) 2024 ClawsoftSolutions. All rights reserved.
+//
+// This software is licensed under the MIT License.
+// See LICENSE file for more information.
+//
+
+#ifdef __linux__
+
+#define _GNU_SOURCE
+#include "internal.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#ifdef PURRSOCK_HAS_IO_URING
+#include <linux/io_uring.h>
+#endif
+
+#define PS_LOOP_MAX_EVENTS 256
+#define PS_LOOP_URING_ENTRIES 256
+#define PS_LOOP_DEFAULT_RECV_BUFFER_SIZE 4096
+#define PS_LOOP_DEFAULT_RECV_BUFFER_COUNT 256
+
+// CQE user data that does not point at an operation.
+#define PS_LOOP_UD_EPOLL  1
+#define PS_LOOP_UD_CANCEL 2
+
+typedef enum {
+  PS_LOOP_OP_READ = 0,
+  PS_LOOP_OP_SEND,
+  PS_LOOP_OP_ACCEPT,
+
+  COUNT_PS_LOOP_OPS
+} _purrsock_loop_op_kind_t;
+
+typedef struct {
+  ps_loop_tick_callback_t callback;  // NULL once removed during the tick it was in.
+  void *user_data;
+} _purrsock_loop_tick_t;
+
+struct _purrsock_heartbeat_s {
+  ps_timer_t timer;
+  ps_heartbeat_options_t options;
+  uint64_t quiet_since;          // Loop time of the last receive, or of the last heartbeat sent after it.
+  uint32_t missed;               // Heartbeats sent since the last receive.
+};
+
+typedef struct _purrsock_loop_post_s {
+  struct _purrsock_loop_post_s *next;
+  ps_task_callback_t callback;
+  void *user_data;
+} _purrsock_loop_post_t;
+
+typedef struct {
+  _purrsock_loop_ops_t *owner;
+  bool active;      // Submitted and not completed yet.
+  bool multishot;
+  bool in_flight;   // io_uring still owns an SQE for this operation.
+  bool cancel_pending; // io_uring: the operation's ASYNC_CANCEL did not fit in the SQ ring yet.
+  ps_packet_t *packet;
+  size_t done;      // Bytes sent so far.
+  bool flushing;    // io_uring: the SQE sends the socket's kept bytes, which go before the packet.
+  ps_loop_packet_completion_t packet_callback;
+  ps_loop_accept_completion_t accept_callback;
+  void *user_data;
+} _purrsock_loop_op_t;
+
+struct _purrsock_loop_ops_s {
+  _purrsock_socket_t *socket;            // NULL once the socket was removed while io_uring still owns operations.
+  _purrsock_loop_op_t ops[COUNT_PS_LOOP_OPS];
+  _purrsock_loop_ops_t *next;            // Ready list (epoll and io_uring re-arms) or orphan list (io_uring).
+  bool queued;
+};
+
+struct _purrsock_loop_s {
+  ps_loop_backend_t backend;
+  int epfd;
+  int wakefd;                    // eventfd used to interrupt the loop from other threads.
+  bool stop_requested;           // Set by `_purrsock_loop_stop` from any thread, consumed by `_purrsock_loop_run`.
+
+  // Events of the iteration being dispatched, so removed sockets can be skipped.
+  struct epoll_event events[PS_LOOP_MAX_EVENTS];
+  int event_index;
+  int event_count;
+  _purrsock_socket_t *current;   // Socket being dispatched, cleared if a callback removes or destroys it.
+
+  _purrsock_loop_ops_t *ready;   // epoll: sockets whose operations must be attempted without waiting for an edge;
+                                 // io_uring: sockets whose operations must be re-armed once the SQ ring has room.
+  _purrsock_loop_tick_t *ticks;  // Callbacks run after every iteration.
+  size_t tick_count;
+  size_t tick_capacity;
+  bool ticking;
+  _purrsock_loop_post_t *posts;  // Callbacks posted from any thread, newest first.
+  uint64_t now;                  // Loop clock in milliseconds, sampled after every wait.
+  _purrsock_timer_wheel_t timers;
+#ifdef PURRSOCK_STATS
+  _purrsock_stats_shard_t *stats; // Statistics shard of the thread that last ran the loop.
+#endif
+  char *recv_buffer;             // epoll: buffer lent to multishot read callbacks.
+  size_t recv_buffer_size;
+
+#ifdef PURRSOCK_HAS_IO_URING
+  _purrsock_uring_t *ring;
+  bool epoll_armed;              // The epoll fd is polled through the ring.
+  _purrsock_loop_ops_t *orphans;
+#endif
+};
+
+static ps_result_t _purrsock_errno_result(int error) {
+  errno = error;
+  return _last_ps_result("purrsock_loop");
+}
+
+static int _purrsock_loop_fd(_purrsock_socket_t *socket) {
+  return ((_purrsock_socket_data_t *)socket->data)->sockfd;
+}
+
+static bool _purrsock_loop_has_callbacks(_purrsock_socket_t *socket) {
+  ps_loop_callbacks_t *callbacks = &socket->callbacks;
+  return callbacks->on_read || callbacks->on_write || callbacks->on_accept || callbacks->on_close;
+}
+
+static ps_result_t _purrsock_loop_poll(_purrsock_loop_t *loop, _purrsock_socket_t *socket, uint32_t events) {
+  if (socket->loop_events == events) return PS_SUCCESS;
+
+  struct epoll_event event = { .events = events, .data.ptr = socket };
+  int op = socket->loop_events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+  if (epoll_ctl(loop->epfd, op, _purrsock_loop_fd(socket), &event) < 0) {
+    return _last_ps_result("purrsock_loop_poll");
+  }
+  socket->loop_events = events;
+  return PS_SUCCESS;
+}
+
+ps_result_t _purrsock_create_loop(_purrsock_loop_t **loop, const ps_loop_options_t *options) {
+  assert(loop);
+
+  ps_loop_options_t defaults = {0};
+  if (!options) options = &defaults;
+  if (options->backend >= COUNT_PS_LOOP_BACKENDS) return PS_ERROR_INVALID_ARGUMENT;
+
+  uint32_t recv_buffer_count = options->recv_buffer_count ? options->recv_buffer_count : PS_LOOP_DEFAULT_RECV_BUFFER_COUNT;
+  size_t recv_buffer_size = options->recv_buffer_size ? options->recv_buffer_size : PS_LOOP_DEFAULT_RECV_BUFFER_SIZE;
+  if (recv_buffer_count & (recv_buffer_count - 1) || recv_buffer_count > 32768) return PS_ERROR_INVALID_ARGUMENT;
+
+  _purrsock_loop_t *new_loop = (_purrsock_loop_t *)calloc(1, sizeof(*new_loop));
+  if (!new_loop) return PS_ERROR_INTERNAL;
+  new_loop->backend = PS_LOOP_BACKEND_EPOLL;
+  new_loop->recv_buffer_size = recv_buffer_size;
+  new_loop->now = _purrsock_monotonic_ms();
+  _purrsock_timer_wheel_init(&new_loop->timers, new_loop->now);
+
+  new_loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (new_loop->epfd < 0) {
+    free(new_loop);
+    return _last_ps_result("purrsock_create_loop");
+  }
+
+  new_loop->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (new_loop->wakefd < 0) {
+    ps_result_t result = _last_ps_result("purrsock_create_loop");
+    close(new_loop->epfd);
+    free(new_loop);
+    return result;
+  }
+
+  // The wake eventfd is the only registration whose `data.ptr` is NULL.
+  struct epoll_event event = { .events = EPOLLIN | EPOLLET, .data.ptr = NULL };
+  if (epoll_ctl(new_loop->epfd, EPOLL_CTL_ADD, new_loop->wakefd, &event) < 0) {
+    ps_result_t result = _last_ps_result("purrsock_create_loop");
+    close(new_loop->wakefd);
+    close(new_loop->epfd);
+    free(new_loop);
+    return result;
+  }
+
+  if (options->backend != PS_LOOP_BACKEND_EPOLL) {
+    ps_result_t result = PS_ERROR_UNSUPPORTED;
+#ifdef PURRSOCK_HAS_IO_URING
+    result = _purrsock_uring_create(&new_loop->ring, PS_LOOP_URING_ENTRIES);
+    if (result == PS_SUCCESS) {
+      result = _purrsock_uring_setup_buffers(new_loop->ring, recv_buffer_size, recv_buffer_count);
+      if (result != PS_SUCCESS) {
+        _purrsock_uring_destroy(new_loop->ring);
+        new_loop->ring = NULL;
+      }
+    }
+    if (result == PS_SUCCESS) new_loop->backend = PS_LOOP_BACKEND_IO_URING;
+#endif
+    if (result != PS_SUCCESS && options->backend == PS_LOOP_BACKEND_IO_URING) {
+      close(new_loop->wakefd);
+      close(new_loop->epfd);
+      free(new_loop);
+      return result;
+    }
+  }
+
+  if (new_loop->backend == PS_LOOP_BACKEND_EPOLL) {
+    new_loop->recv_buffer = (char *)malloc(recv_buffer_size);
+    if (!new_loop->recv_buffer) {
+      close(new_loop->wakefd);
+      close(new_loop->epfd);
+      free(new_loop);
+      return PS_ERROR_INTERNAL;
+    }
+  }
+
+  *loop = new_loop;
+  return PS_SUCCESS;
+}
+
+void _purrsock_destroy_loop(_purrsock_loop_t *loop) {
+  assert(loop);
+#ifdef PURRSOCK_HAS_IO_URING
+  while (loop->orphans) {
+    _purrsock_loop_ops_t *next = loop->orphans->next;
+    free(loop->orphans);
+    loop->orphans = next;
+  }
+  if (loop->ring) _purrsock_uring_destroy(loop->ring);
+#endif
+  while (loop->posts) {
+    _purrsock_loop_post_t *next = loop->posts->next;
+    free(loop->posts);
+    loop->posts = next;
+  }
+  free(loop->ticks);
+  free(loop->recv_buffer);
+  close(loop->wakefd);
+  close(loop->epfd);
+  free(loop);
+}
+
+ps_loop_backend_t _purrsock_loop_get_backend(_purrsock_loop_t *loop) {
+  assert(loop);
+  return loop->backend;
+}
+
+ps_result_t _purrsock_loop_add_socket(_purrsock_loop_t *loop, _purrsock_socket_t *socket, ps_loop_callbacks_t callbacks) {
+  assert(loop && socket);
+  if (socket->memory) return PS_ERROR_UNSUPPORTED;
+  if (!socket->data) return PS_ERROR_NOTINIT;
+  if (socket->loop && socket->loop != loop) return PS_ERROR_INVALID_ARGUMENT;
+
+  ps_result_t result = _purrsock_set_socket_blocking(socket, false);
+  if (result != PS_SUCCESS) return result;
+
+  uint32_t events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+  if (callbacks.on_write || (socket->loop_ops && loop->backend == PS_LOOP_BACKEND_EPOLL)) events |= EPOLLOUT;
+
+  result = _purrsock_loop_poll(loop, socket, events);
+  if (result != PS_SUCCESS) return result;
+
+  socket->loop = loop;
+  socket->callbacks = callbacks;
+  return PS_SUCCESS;
+}
+
+static bool _purrsock_loop_ops_in_flight(_purrsock_loop_ops_t *ops) {
+  for (int kind = 0; kind < COUNT_PS_LOOP_OPS; ++kind) {
+    if (ops->ops[kind].in_flight) return true;
+  }
+  return false;
+}
+
+static void _purrsock_loop_unqueue(_purrsock_loop_t *loop, _purrsock_loop_ops_t *ops) {
+  if (!ops->queued) return;
+  for (_purrsock_loop_ops_t **it = &loop->ready; *it; it = &(*it)->next) {
+    if (*it == ops) {
+      *it = ops->next;
+      break;
+    }
+  }
+  ops->queued = false;
+  ops->next = NULL;
+}
+
+#ifdef PURRSOCK_HAS_IO_URING
+static void _purrsock_loop_release_orphan(_purrsock_loop_t *loop, _purrsock_loop_ops_t *ops) {
+  for (_purrsock_loop_ops_t **it = &loop->orphans; *it; it = &(*it)->next) {
+    if (*it == ops) {
+      *it = ops->next;
+      break;
+    }
+  }
+  free(ops);
+}
+
+// Returns false while some cancellation still waits for room in the SQ ring; the loop retries it.
+static bool _purrsock_loop_cancel_ops(_purrsock_loop_t *loop, _purrsock_loop_ops_t *ops) {
+  bool done = true;
+  for (int kind = 0; kind < COUNT_PS_LOOP_OPS; ++kind) {
+    _purrsock_loop_op_t *op = &ops->ops[kind];
+    if (!op->cancel_pending) continue;
+    if (!op->in_flight) {
+      op->cancel_pending = false;
+      continue;
+    }
+
+    struct io_uring_sqe *sqe = _purrsock_uring_get_sqe(loop->ring);
+    if (!sqe && _purrsock_uring_submit(loop->ring, false, 0) >= 0) sqe = _purrsock_uring_get_sqe(loop->ring);
+    if (!sqe) {
+      done = false;
+      continue;
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = (uint64_t)(uintptr_t)op;
+    sqe->user_data = PS_LOOP_UD_CANCEL;
+    op->cancel_pending = false;
+  }
+  return done;
+}
+#endif
+
+static void _purrsock_loop_release_ops(_purrsock_loop_t *loop, _purrsock_loop_ops_t *ops) {
+  for (int kind = 0; kind < COUNT_PS_LOOP_OPS; ++kind) ops->ops[kind].active = false;
+  ops->socket = NULL;
+  _purrsock_loop_unqueue(loop, ops);
+
+  if (loop->backend == PS_LOOP_BACKEND_EPOLL) {
+    free(ops);
+    return;
+  }
+
+#ifdef PURRSOCK_HAS_IO_URING
+  if (!_purrsock_loop_ops_in_flight(ops)) {
+    free(ops);
+    return;
+  }
+
+  // The kernel still references the operations: cancel them and free the record once their final CQEs arrive.
+  for (int kind = 0; kind < COUNT_PS_LOOP_OPS; ++kind) ops->ops[kind].cancel_pending = ops->ops[kind].in_flight;
+  _purrsock_loop_cancel_ops(loop, ops);
+  // Cancellation must reach the kernel before the socket's fd is closed and possibly reused.
+  _purrsock_uring_submit(loop->ring, false, 0);
+
+  ops->next = loop->orphans;
+  loop->orphans = ops;
+#endif
+}
+
+ps_result_t _purrsock_loop_remove_socket(_purrsock_loop_t *loop, _purrsock_socket_t *socket) {
+  assert(loop && socket);
+  if (socket->loop != loop) return PS_ERROR_INVALID_ARGUMENT;
+
+  if (socket->loop_events && socket->data) epoll_ctl(loop->epfd, EPOLL_CTL_DEL, _purrsock_loop_fd(socket), NULL);
+
+  // Drop events still queued for this socket in the current iteration.
+  for (int i = loop->event_index + 1; i < loop->event_count; ++i) {
+    if (loop->events[i].data.ptr == socket) loop->events[i].events = 0;
+  }
+  if (loop->current == socket) loop->current = NULL;
+
+  if (socket->loop_ops) _purrsock_loop_release_ops(loop, socket->loop_ops);
+  if (socket->heartbeat) {
+    _purrsock_timer_wheel_remove(&loop->timers, &socket->heartbeat->timer);
+    free(socket->heartbeat);
+    socket->heartbeat = NULL;
+  }
+
+  socket->loop = NULL;
+  socket->loop_events = 0;
+  socket->loop_ops = NULL;
+  memset(&socket->callbacks, 0, sizeof(socket->callbacks));
+  return PS_SUCCESS;
+}
+
+// Anything received answers the heartbeat; the timer compares against this time when it expires.
+static void _purrsock_loop_heard(_purrsock_loop_t *loop, _purrsock_socket_t *socket) {
+  socket->heartbeat->quiet_since = loop->now;
+  socket->heartbeat->missed = 0;
+}
+
+// Completion of asynchronous operations shared by both backends. The operation is deactivated before its
+// callback runs so the callback may submit the next one; callers check `loop->current` afterwards because
+// the callback may also destroy the socket.
+
+static void _purrsock_loop_complete_packet(_purrsock_loop_t *loop, _purrsock_loop_op_t *op, ps_result_t result, ps_packet_t *packet, bool last) {
+  _purrsock_socket_t *socket = op->owner->socket;
+  if (socket->heartbeat && op == &op->owner->ops[PS_LOOP_OP_READ] && result == PS_SUCCESS) _purrsock_loop_heard(loop, socket);
+  ps_loop_packet_completion_t callback = op->packet_callback;
+  void *user_data = op->user_data;
+  if (last) op->active = false;
+
+  loop->current = socket;
+  if (callback) callback((ps_loop_t)loop, (ps_socket_t)socket, result, packet, user_data);
+}
+
+static void _purrsock_loop_complete_accept(_purrsock_loop_t *loop, _purrsock_loop_op_t *op, ps_result_t result, _purrsock_socket_t *client, bool last) {
+  _purrsock_socket_t *socket = op->owner->socket;
+  ps_loop_accept_completion_t callback = op->accept_callback;
+  void *user_data = op->user_data;
+  if (last) op->active = false;
+
+  loop->current = socket;
+  if (callback) {
+    callback((ps_loop_t)loop, (ps_socket_t)socket, result, (ps_socket_t)client, user_data);
+  } else if (client) {
+    _purrsock_destroy_socket(client);
+    free(client);
+  }
+}
+
+// epoll backend: operations are attempted when the socket is ready, or right after submission.
+
+static void _purrsock_loop_try_read(_purrsock_loop_t *loop, _purrsock_socket_t *socket, _purrsock_loop_op_t *op) {
+  int fd = _purrsock_loop_fd(socket);
+
+  while (loop->current == socket && op->active) {
+    bool multishot = op->multishot;
+    char *buf = multishot ? loop->recv_buffer : op->packet->buf;
+    size_t capacity = multishot ? loop->recv_buffer_size : op->packet->capacity;
+
+    PS_STATS_START(start);
+    ssize_t len = recv(fd, buf, capacity, 0);
+    PS_STATS_SYSCALL(socket, false, len < 0 && errno == EAGAIN, start);
+    if (len < 0 && errno == EINTR) continue;
+    if (len < 0 && errno == EAGAIN) return;
+    if (len > 0 || (len == 0 && _purrsock_is_datagram(socket->protocol))) PS_STATS_TRANSFER(socket, false, len, 1);
+
+    ps_packet_t borrowed = { .size = len > 0 ? (size_t)len : 0, .buf = buf, .capacity = capacity };
+    ps_packet_t *packet = multishot ? &borrowed : op->packet;
+    packet->size = borrowed.size;
+
+    if (len < 0) {
+      _purrsock_loop_complete_packet(loop, op, _last_ps_result("purrsock_loop_read"), packet, true);
+    } else if (len == 0 && !_purrsock_is_datagram(socket->protocol)) {
+      _purrsock_loop_complete_packet(loop, op, PS_CONNCLOSED, packet, true);
+    } else {
+      _purrsock_loop_complete_packet(loop, op, PS_SUCCESS, packet, !multishot);
+    }
+    if (!multishot) return;
+  }
+}
+
+static void _purrsock_loop_try_send(_purrsock_loop_t *loop, _purrsock_socket_t *socket, _purrsock_loop_op_t *op) {
+  int fd = _purrsock_loop_fd(socket);
+
+  // Bytes kept from an earlier partial send go out first.
+  ps_result_t result = _purrsock_flush_socket(socket);
+  if (result == PS_ERROR_WOULDBLOCK) return;
+  if (result != PS_SUCCESS) {
+    _purrsock_loop_complete_packet(loop, op, result, op->packet, true);
+    return;
+  }
+
+  while (op->done < op->packet->size) {
+    PS_STATS_START(start);
+    ssize_t sent = send(fd, op->packet->buf + op->done, op->packet->size - op->done, MSG_NOSIGNAL);
+    PS_STATS_SYSCALL(socket, true, sent < 0 && errno == EAGAIN, start);
+    if (sent < 0 && errno == EINTR) continue;
+    if (sent < 0 && errno == EAGAIN) return;
+    if (sent < 0) {
+      _purrsock_loop_complete_packet(loop, op, _last_ps_result("purrsock_loop_send"), op->packet, true);
+      return;
+    }
+    PS_STATS_TRANSFER(socket, true, sent, op->done == 0);
+    op->done += sent;
+  }
+  _purrsock_loop_complete_packet(loop, op, PS_SUCCESS, op->packet, true);
+}
+
+static void _purrsock_loop_try_accept(_purrsock_loop_t *loop, _purrsock_socket_t *socket, _purrsock_loop_op_t *op) {
+  while (loop->current == socket && op->active) {
+    _purrsock_socket_t *client = NULL;
+    ps_result_t result = _purrsock_accept_socket(socket, &client);
+    if (result == PS_ERROR_WOULDBLOCK) return;
+    _purrsock_loop_complete_accept(loop, op, result, client, !op->multishot || result != PS_SUCCESS);
+  }
+}
+
+static void _purrsock_loop_try_ops(_purrsock_loop_t *loop, _purrsock_socket_t *socket, uint32_t events) {
+  _purrsock_loop_ops_t *ops = socket->loop_ops;
+  loop->current = socket;
+
+  if ((events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) && ops->ops[PS_LOOP_OP_ACCEPT].active) {
+    _purrsock_loop_try_accept(loop, socket, &ops->ops[PS_LOOP_OP_ACCEPT]);
+    if (loop->current != socket) return;
+  }
+  if ((events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) && ops->ops[PS_LOOP_OP_READ].active) {
+    _purrsock_loop_try_read(loop, socket, &ops->ops[PS_LOOP_OP_READ]);
+    if (loop->current != socket) return;
+  }
+  if ((events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) && ops->ops[PS_LOOP_OP_SEND].active) {
+    _purrsock_loop_try_send(loop, socket, &ops->ops[PS_LOOP_OP_SEND]);
+  }
+}
+
+static void _purrsock_loop_run_ready(_purrsock_loop_t *loop) {
+  _purrsock_loop_ops_t *ready = loop->ready;
+  loop->ready = NULL;
+
+  while (ready) {
+    _purrsock_loop_ops_t *ops = ready;
+    ready = ops->next;
+    ops->next = NULL;
+    ops->queued = false;
+
+    // A callback earlier in the list may have destroyed this socket, which unlinks it from `loop->ready`
+    // but not from the detached list: only run records that are still attached to a socket.
+    if (!ops->socket) continue;
+    _purrsock_loop_try_ops(loop, ops->socket, EPOLLIN | EPOLLOUT);
+  }
+  loop->current = NULL;
+}
+
+#ifdef PURRSOCK_HAS_IO_URING
+
+// io_uring backend: each operation is an SQE whose user data points at the operation.
+
+static ps_result_t _purrsock_loop_submit_op(_purrsock_loop_t *loop, _purrsock_loop_op_t *op, _purrsock_loop_op_kind_t kind) {
+  struct io_uring_sqe *sqe = _purrsock_uring_get_sqe(loop->ring);
+  if (!sqe) return PS_ERROR_INTERNAL;
+
+  int fd = _purrsock_loop_fd(op->owner->socket);
+  sqe->fd = fd;
+  sqe->user_data = (uint64_t)(uintptr_t)op;
+
+  switch (kind) {
+  case PS_LOOP_OP_READ:
+    sqe->opcode = IORING_OP_RECV;
+    if (op->multishot) {
+      sqe->ioprio = IORING_RECV_MULTISHOT;
+      sqe->flags = IOSQE_BUFFER_SELECT;
+      sqe->buf_group = 0;
+    } else {
+      sqe->addr = (uint64_t)(uintptr_t)op->packet->buf;
+      sqe->len = (uint32_t)op->packet->capacity;
+    }
+    break;
+  case PS_LOOP_OP_SEND: {
+    // Bytes kept from an earlier partial send go out first, each SQE sending one or the other.
+    _purrsock_socket_t *socket = op->owner->socket;
+    op->flushing = socket->unsent_offset < socket->unsent_size;
+    sqe->opcode = IORING_OP_SEND;
+    if (op->flushing) {
+      sqe->addr = (uint64_t)(uintptr_t)(socket->unsent + socket->unsent_offset);
+      sqe->len = (uint32_t)(socket->unsent_size - socket->unsent_offset);
+    } else {
+      sqe->addr = (uint64_t)(uintptr_t)(op->packet->buf + op->done);
+      sqe->len = (uint32_t)(op->packet->size - op->done);
+    }
+    sqe->msg_flags = MSG_NOSIGNAL;
+  } break;
+  case PS_LOOP_OP_ACCEPT:
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    if (op->multishot) sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    break;
+  default:
+    assert(0 && "Unreachable");
+  }
+
+  op->in_flight = true;
+  return PS_SUCCESS;
+}
+
+// Re-arms an operation from a completion; if the SQ ring is full, the socket is queued and re-armed on the next iteration.
+static void _purrsock_loop_rearm_op(_purrsock_loop_t *loop, _purrsock_loop_op_t *op, _purrsock_loop_op_kind_t kind) {
+  if (_purrsock_loop_submit_op(loop, op, kind) == PS_SUCCESS) return;
+
+  _purrsock_loop_ops_t *ops = op->owner;
+  if (!ops->queued) {
+    ops->queued = true;
+    ops->next = loop->ready;
+    loop->ready = ops;
+  }
+}
+
+static void _purrsock_loop_rearm_ready(_purrsock_loop_t *loop) {
+  _purrsock_loop_ops_t *ready = loop->ready;
+  loop->ready = NULL;
+
+  while (ready) {
+    _purrsock_loop_ops_t *ops = ready;
+    ready = ops->next;
+    ops->next = NULL;
+    ops->queued = false;
+
+    for (int kind = 0; kind < COUNT_PS_LOOP_OPS; ++kind) {
+      _purrsock_loop_op_t *op = &ops->ops[kind];
+      if (op->active && !op->in_flight) _purrsock_loop_rearm_op(loop, op, (_purrsock_loop_op_kind_t)kind);
+    }
+  }
+}
+
+static void _purrsock_loop_cancel_orphans(_purrsock_loop_t *loop) {
+  for (_purrsock_loop_ops_t *ops = loop->orphans; ops; ops = ops->next) {
+    if (!_purrsock_loop_cancel_ops(loop, ops)) return;
+  }
+}
+
+static void _purrsock_loop_handle_cqe(_purrsock_loop_t *loop, _purrsock_loop_op_t *op, int32_t res, uint32_t flags) {
+  _purrsock_loop_ops_t *ops = op->owner;
+  _purrsock_loop_op_kind_t kind = (_purrsock_loop_op_kind_t)(op - ops->ops);
+  bool more = flags & IORING_CQE_F_MORE;
+  bool has_buffer = flags & IORING_CQE_F_BUFFER;
+  uint16_t bid = (uint16_t)(flags >> IORING_CQE_BUFFER_SHIFT);
+  if (!more) op->in_flight = false;
+
+  _purrsock_socket_t *socket = ops->socket;
+  if (!socket || !op->active) {
+    if (has_buffer) _purrsock_uring_recycle_buffer(loop->ring, bid);
+    if (!socket && !_purrsock_loop_ops_in_flight(ops)) _purrsock_loop_release_orphan(loop, ops);
+    return;
+  }
+
+  switch (kind) {
+  case PS_LOOP_OP_READ: {
+    if (!op->multishot) {
+      op->packet->size = res > 0 ? (size_t)res : 0;
+      if (res < 0) {
+        _purrsock_loop_complete_packet(loop, op, _purrsock_errno_result(-res), op->packet, true);
+      } else if (res == 0 && !_purrsock_is_datagram(socket->protocol)) {
+        _purrsock_loop_complete_packet(loop, op, PS_CONNCLOSED, op->packet, true);
+      } else {
+        PS_STATS_TRANSFER(socket, false, res, 1);
+        _purrsock_loop_complete_packet(loop, op, PS_SUCCESS, op->packet, true);
+      }
+      break;
+    }
+
+    if (res == -ENOBUFS) {
+      // Every provided buffer was in use; they are recycled after each callback, so simply re-arm.
+      if (!op->in_flight) _purrsock_loop_rearm_op(loop, op, kind);
+      break;
+    }
+
+    ps_packet_t borrowed = {0};
+    if (has_buffer) {
+      borrowed.buf = _purrsock_uring_buffer(loop->ring, bid);
+      borrowed.capacity = loop->recv_buffer_size;
+      borrowed.size = res > 0 ? (size_t)res : 0;
+    }
+
+    if (res < 0) {
+      _purrsock_loop_complete_packet(loop, op, _purrsock_errno_result(-res), &borrowed, true);
+    } else if (res == 0 && !_purrsock_is_datagram(socket->protocol)) {
+      _purrsock_loop_complete_packet(loop, op, PS_CONNCLOSED, &borrowed, true);
+    } else {
+      PS_STATS_TRANSFER(socket, false, res, 1);
+      _purrsock_loop_complete_packet(loop, op, PS_SUCCESS, &borrowed, false);
+    }
+    if (has_buffer) _purrsock_uring_recycle_buffer(loop->ring, bid);
+
+    // The kernel ends a multishot receive on its own at times (e.g. buffer exhaustion): re-arm it.
+    if (loop->current == socket && op->active && !op->in_flight) _purrsock_loop_rearm_op(loop, op, kind);
+  } break;
+  case PS_LOOP_OP_SEND: {
+    if (res < 0) {
+      _purrsock_loop_complete_packet(loop, op, _purrsock_errno_result(-res), op->packet, true);
+      break;
+    }
+    PS_STATS_TRANSFER(socket, true, res, op->done == 0);
+    if (op->flushing) {
+      socket->unsent_offset += (size_t)res;
+      if (socket->unsent_offset == socket->unsent_size) socket->unsent_offset = socket->unsent_size = 0;
+      _purrsock_loop_rearm_op(loop, op, kind);
+      break;
+    }
+    op->done += res;
+    if (op->done < op->packet->size) {
+      _purrsock_loop_rearm_op(loop, op, kind);
+      break;
+    }
+    _purrsock_loop_complete_packet(loop, op, PS_SUCCESS, op->packet, true);
+  } break;
+  case PS_LOOP_OP_ACCEPT: {
+    if (res < 0) {
+      _purrsock_loop_complete_accept(loop, op, _purrsock_errno_result(-res), NULL, true);
+      break;
+    }
+
+    _purrsock_socket_t *client = _purrsock_socket_from_fd(res, socket->protocol, NULL);
+    if (!client) {
+      close(res);
+      _purrsock_loop_complete_accept(loop, op, PS_ERROR_INTERNAL, NULL, !op->multishot);
+    } else {
+      _purrsock_loop_complete_accept(loop, op, PS_SUCCESS, client, !op->multishot);
+    }
+    if (loop->current == socket && op->active && !op->in_flight) _purrsock_loop_rearm_op(loop, op, kind);
+  } break;
+  default:
+    assert(0 && "Unreachable");
+  }
+}
+
+#endif // PURRSOCK_HAS_IO_URING
+
+static ps_result_t _purrsock_loop_prepare_op(_purrsock_loop_t *loop, _purrsock_socket_t *socket, _purrsock_loop_op_kind_t kind, _purrsock_loop_op_t **out_op) {
+  assert(loop && socket);
+  if (!socket->data) return PS_ERROR_NOTINIT;
+  if (socket->loop && socket->loop != loop) return PS_ERROR_INVALID_ARGUMENT;
+
+  if (!socket->loop_ops) {
+    _purrsock_loop_ops_t *ops = (_purrsock_loop_ops_t *)calloc(1, sizeof(*ops));
+    if (!ops) return PS_ERROR_INTERNAL;
+    ops->socket = socket;
+    for (int i = 0; i < COUNT_PS_LOOP_OPS; ++i) ops->ops[i].owner = ops;
+    socket->loop_ops = ops;
+  }
+
+  // A finished multishot operation may still wait for its final CQE.
+  _purrsock_loop_op_t *op = &socket->loop_ops->ops[kind];
+  if (op->active || op->in_flight) return PS_ERROR_INVALID_ARGUMENT;
+
+  if (loop->backend == PS_LOOP_BACKEND_EPOLL) {
+    ps_result_t result = _purrsock_set_socket_blocking(socket, false);
+    if (result != PS_SUCCESS) return result;
+    result = _purrsock_loop_poll(loop, socket, socket->loop_events | EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET);
+    if (result != PS_SUCCESS) return result;
+  }
+
+  socket->loop = loop;
+  op->multishot = false;
+  memset(&op->packet, 0, sizeof(*op) - offsetof(_purrsock_loop_op_t, packet));
+  *out_op = op;
+  return PS_SUCCESS;
+}
+
+static ps_result_t _purrsock_loop_start_op(_purrsock_loop_t *loop, _purrsock_socket_t *socket, _purrsock_loop_op_t *op, _purrsock_loop_op_kind_t kind) {
+  op->active = true;
+
+  if (loop->backend == PS_LOOP_BACKEND_EPOLL) {
+    // Edges may have been consumed before the operation existed, so try it on the next iteration.
+    _purrsock_loop_ops_t *ops = socket->loop_ops;
+    if (!ops->queued) {
+      ops->queued = true;
+      ops->next = loop->ready;
+      loop->ready = ops;
+    }
+    return PS_SUCCESS;
+  }
+
+#ifdef PURRSOCK_HAS_IO_URING
+  ps_result_t result = _purrsock_loop_submit_op(loop, op, kind);
+  if (result != PS_SUCCESS) op->active = false;
+  return result;
+#else
+  (void)kind;
+  return PS_ERROR_UNSUPPORTED;
+#endif
+}
+
+ps_result_t _purrsock_loop_read_socket_packet(_purrsock_loop_t *loop, _purrsock_socket_t *socket, ps_packet_t *packet, ps_loop_packet_completion_t callback, void *user_data) {
+  assert(packet);
+  if (!packet->buf || !packet->capacity) return PS_ERROR_INVALID_ARGUMENT;
+
+  _purrsock_loop_op_t *op;
+  ps_result_t result = _purrsock_loop_prepare_op(loop, socket, PS_LOOP_OP_READ, &op);
+  if (result != PS_SUCCESS) return result;
+
+  op->packet = packet;
+  op->packet_callback = callback;
+  op->user_data = user_data;
+  return _purrsock_loop_start_op(loop, socket, op, PS_LOOP_OP_READ);
+}
+
+ps_result_t _purrsock_loop_read_socket_packet_multishot(_purrsock_loop_t *loop, _purrsock_socket_t *socket, ps_loop_packet_completion_t callback, void *user_data) {
+  _purrsock_loop_op_t *op;
+  ps_result_t result = _purrsock_loop_prepare_op(loop, socket, PS_LOOP_OP_READ, &op);
+  if (result != PS_SUCCESS) return result;
+
+  op->multishot = true;
+  op->packet_callback = callback;
+  op->user_data = user_data;
+  return _purrsock_loop_start_op(loop, socket, op, PS_LOOP_OP_READ);
+}
+
+ps_result_t _purrsock_loop_send_socket_packet(_purrsock_loop_t *loop, _purrsock_socket_t *socket, ps_packet_t *packet, ps_loop_packet_completion_t callback, void *user_data) {
+  assert(packet);
+  if (!packet->buf) return PS_ERROR_INVALID_ARGUMENT;
+
+  _purrsock_loop_op_t *op;
+  ps_result_t result = _purrsock_loop_prepare_op(loop, socket, PS_LOOP_OP_SEND, &op);
+  if (result != PS_SUCCESS) return result;
+
+  op->packet = packet;
+  op->packet_callback = callback;
+  op->user_data = user_data;
+  return _purrsock_loop_start_op(loop, socket, op, PS_LOOP_OP_SEND);
+}
+
+ps_result_t _purrsock_loop_accept_socket(_purrsock_loop_t *loop, _purrsock_socket_t *socket, bool multishot, ps_loop_accept_completion_t callback, void *user_data) {
+  _purrsock_loop_op_t *op;
+  ps_result_t result = _purrsock_loop_prepare_op(loop, socket, PS_LOOP_OP_ACCEPT, &op);
+  if (result != PS_SUCCESS) return result;
+
+  op->multishot = multishot;
+  op->accept_callback = callback;
+  op->user_data = user_data;
+  return _purrsock_loop_start_op(loop, socket, op, PS_LOOP_OP_ACCEPT);
+}
+
+static void _purrsock_loop_accept(_purrsock_loop_t *loop, _purrsock_socket_t *socket) {
+  ps_loop_callbacks_t *callbacks = &socket->callbacks;
+  while (loop->current == socket && callbacks->on_accept) {
+    _purrsock_socket_t *client = NULL;
+    ps_result_t result = _purrsock_accept_socket(socket, &client);
+    if (result != PS_SUCCESS) break;
+    callbacks->on_accept((ps_loop_t)loop, (ps_socket_t)socket, (ps_socket_t)client, callbacks->user_data);
+  }
+}
+
+static void _purrsock_loop_dispatch(_purrsock_loop_t *loop, _purrsock_socket_t *socket, uint32_t events) {
+  ps_loop_callbacks_t *callbacks = &socket->callbacks;
+  loop->current = socket;
+
+  // Zero-copy completions arrive on the error queue and raise EPOLLERR without any socket error.
+  if ((events & EPOLLERR) && _purrsock_zerocopy_pending(socket)) {
+    _purrsock_zerocopy_reap(socket);
+    if (!_purrsock_socket_has_error(socket)) events &= ~EPOLLERR;
+    if (!events) return;
+  }
+
+  if (socket->heartbeat && (events & EPOLLIN)) _purrsock_loop_heard(loop, socket);
+
+  if (socket->loop_ops && loop->backend == PS_LOOP_BACKEND_EPOLL) {
+    _purrsock_loop_try_ops(loop, socket, events);
+    if (loop->current != socket) return;
+  }
+  if (!_purrsock_loop_has_callbacks(socket)) return;
+
+  if (events & EPOLLIN) {
+    if (callbacks->on_accept) {
+      _purrsock_loop_accept(loop, socket);
+    } else if (callbacks->on_read) {
+      callbacks->on_read((ps_loop_t)loop, (ps_socket_t)socket, callbacks->user_data);
+    }
+  }
+  if (loop->current != socket) return;
+
+  if ((events & EPOLLOUT) && callbacks->on_write) {
+    callbacks->on_write((ps_loop_t)loop, (ps_socket_t)socket, callbacks->user_data);
+  }
+  if (loop->current != socket) return;
+
+  if (events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+    ps_loop_socket_callback_t on_close = callbacks->on_close;
+    void *user_data = callbacks->user_data;
+    _purrsock_loop_remove_socket(loop, socket);
+    if (on_close) on_close((ps_loop_t)loop, (ps_socket_t)socket, user_data);
+  }
+}
+
+static ps_result_t _purrsock_loop_dispatch_epoll(_purrsock_loop_t *loop, int timeout_ms) {
+  int count = epoll_wait(loop->epfd, loop->events, PS_LOOP_MAX_EVENTS, timeout_ms);
+  loop->now = _purrsock_monotonic_ms();
+  if (count < 0) {
+    if (errno == EINTR) return PS_SUCCESS;
+    return _last_ps_result("purrsock_loop_run_once");
+  }
+
+  loop->event_count = count;
+  for (loop->event_index = 0; loop->event_index < loop->event_count; ++loop->event_index) {
+    struct epoll_event *event = &loop->events[loop->event_index];
+    if (!event->events) continue;
+
+    if (!event->data.ptr) {
+      uint64_t value;
+      while (read(loop->wakefd, &value, sizeof(value)) > 0) {}
+      continue;
+    }
+
+    _purrsock_loop_dispatch(loop, (_purrsock_socket_t *)event->data.ptr, event->events);
+  }
+  loop->current = NULL;
+  loop->event_index = 0;
+  loop->event_count = 0;
+
+  return PS_SUCCESS;
+}
+
+#ifdef PURRSOCK_HAS_IO_URING
+static ps_result_t _purrsock_loop_run_once_uring(_purrsock_loop_t *loop, int timeout_ms) {
+  // Readiness callbacks still come from epoll: its fd is polled through the ring, so a single
+  // io_uring_enter both submits the batched SQEs and waits for completions or readiness.
+  // Work that did not fit in the SQ ring earlier is retried first; whatever still does not fit keeps the wait short.
+  _purrsock_loop_cancel_orphans(loop);
+  _purrsock_loop_rearm_ready(loop);
+  if (!loop->epoll_armed) {
+    struct io_uring_sqe *sqe = _purrsock_uring_get_sqe(loop->ring);
+    if (sqe) {
+      sqe->opcode = IORING_OP_POLL_ADD;
+      sqe->fd = loop->epfd;
+      sqe->poll32_events = POLLIN;
+      sqe->len = IORING_POLL_ADD_MULTI;
+      sqe->user_data = PS_LOOP_UD_EPOLL;
+      loop->epoll_armed = true;
+    }
+  }
+  if (loop->ready || !loop->epoll_armed) timeout_ms = 0;
+
+  int res = _purrsock_uring_submit(loop->ring, true, timeout_ms);
+  loop->now = _purrsock_monotonic_ms();
+  if (res < 0 && res != -EBUSY && res != -EAGAIN) {
+    return _purrsock_errno_result(-res);
+  }
+
+  bool epoll_ready = false;
+  uint64_t user_data;
+  int32_t cqe_res;
+  uint32_t cqe_flags;
+  while (_purrsock_uring_next_cqe(loop->ring, &user_data, &cqe_res, &cqe_flags)) {
+    if (user_data == PS_LOOP_UD_EPOLL) {
+      epoll_ready = true;
+      if (!(cqe_flags & IORING_CQE_F_MORE)) loop->epoll_armed = false;
+      continue;
+    }
+    if (user_data == PS_LOOP_UD_CANCEL) continue;
+
+    _purrsock_loop_handle_cqe(loop, (_purrsock_loop_op_t *)(uintptr_t)user_data, cqe_res, cqe_flags);
+  }
+  loop->current = NULL;
+
+  if (epoll_ready) return _purrsock_loop_dispatch_epoll(loop, 0);
+  return PS_SUCCESS;
+}
+#endif
+
+ps_result_t _purrsock_loop_add_tick(_purrsock_loop_t *loop, ps_loop_tick_callback_t callback, void *user_data) {
+  assert(loop && callback);
+  if (loop->tick_count == loop->tick_capacity) {
+    size_t capacity = loop->tick_capacity ? loop->tick_capacity * 2 : 8;
+    _purrsock_loop_tick_t *ticks = (_purrsock_loop_tick_t *)realloc(loop->ticks, capacity * sizeof(*ticks));
+    if (!ticks) return PS_ERROR_INTERNAL;
+    loop->ticks = ticks;
+    loop->tick_capacity = capacity;
+  }
+  loop->ticks[loop->tick_count++] = (_purrsock_loop_tick_t){ callback, user_data };
+  return PS_SUCCESS;
+}
+
+ps_result_t _purrsock_loop_remove_tick(_purrsock_loop_t *loop, ps_loop_tick_callback_t callback, void *user_data) {
+  assert(loop && callback);
+  for (size_t i = 0; i < loop->tick_count; ++i) {
+    _purrsock_loop_tick_t *tick = &loop->ticks[i];
+    if (tick->callback != callback || tick->user_data != user_data) continue;
+
+    // Entries are only compacted outside of the ticks, which index into the array.
+    if (loop->ticking) {
+      tick->callback = NULL;
+    } else {
+      memmove(tick, tick + 1, (loop->tick_count - i - 1) * sizeof(*tick));
+      loop->tick_count--;
+    }
+    return PS_SUCCESS;
+  }
+  return PS_ERROR_INVALID_ARGUMENT;
+}
+
+static void _purrsock_loop_run_ticks(_purrsock_loop_t *loop) {
+  if (!loop->tick_count) return;
+
+  loop->ticking = true;
+  for (size_t i = 0; i < loop->tick_count; ++i) {
+    _purrsock_loop_tick_t tick = loop->ticks[i];
+    if (tick.callback) tick.callback((ps_loop_t)loop, tick.user_data);
+  }
+  loop->ticking = false;
+
+  size_t kept = 0;
+  for (size_t i = 0; i < loop->tick_count; ++i) {
+    if (loop->ticks[i].callback) loop->ticks[kept++] = loop->ticks[i];
+  }
+  loop->tick_count = kept;
+}
+
+ps_result_t _purrsock_loop_post(_purrsock_loop_t *loop, ps_task_callback_t callback, void *user_data) {
+  assert(loop && callback);
+  _purrsock_loop_post_t *post = (_purrsock_loop_post_t *)malloc(sizeof(*post));
+  if (!post) return PS_ERROR_INTERNAL;
+  post->callback = callback;
+  post->user_data = user_data;
+
+  // Once published, the node belongs to the loop, which may already have run and freed it.
+  _purrsock_loop_post_t *head = __atomic_load_n(&loop->posts, __ATOMIC_RELAXED);
+  do {
+    post->next = head;
+  } while (!__atomic_compare_exchange_n(&loop->posts, &head, post, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+  // Later posts are drained together with the one that found the list empty, which woke the loop.
+  if (!head) {
+    uint64_t value = 1;
+    ssize_t res = write(loop->wakefd, &value, sizeof(value));
+    (void)res;
+  }
+  return PS_SUCCESS;
+}
+
+static void _purrsock_loop_run_posts(_purrsock_loop_t *loop) {
+  if (!__atomic_load_n(&loop->posts, __ATOMIC_RELAXED)) return;
+  _purrsock_loop_post_t *post = __atomic_exchange_n(&loop->posts, NULL, __ATOMIC_ACQUIRE);
+
+  // Newest first: reverse to run them in posting order.
+  _purrsock_loop_post_t *ordered = NULL;
+  while (post) {
+    _purrsock_loop_post_t *next = post->next;
+    post->next = ordered;
+    ordered = post;
+    post = next;
+  }
+  while (ordered) {
+    _purrsock_loop_post_t *next = ordered->next;
+    ordered->callback(ordered->user_data);
+    free(ordered);
+    ordered = next;
+  }
+}
+
+ps_result_t _purrsock_loop_start_timer(_purrsock_loop_t *loop, ps_timer_t *timer, uint64_t timeout_ms) {
+  assert(loop && timer && timer->callback);
+  _purrsock_timer_wheel_remove(&loop->timers, timer);
+  uint64_t expires = timeout_ms > UINT64_MAX - loop->now ? UINT64_MAX : loop->now + timeout_ms;
+  _purrsock_timer_wheel_add(&loop->timers, timer, expires);
+  return PS_SUCCESS;
+}
+
+void _purrsock_loop_stop_timer(_purrsock_loop_t *loop, ps_timer_t *timer) {
+  assert(loop && timer);
+  _purrsock_timer_wheel_remove(&loop->timers, timer);
+}
+
+uint64_t _purrsock_loop_now(_purrsock_loop_t *loop) {
+  assert(loop);
+  return loop->now;
+}
+
+ps_result_t _purrsock_get_loop_stats(_purrsock_loop_t *loop, ps_stats_t *stats) {
+  assert(loop && stats);
+#ifdef PURRSOCK_STATS
+  return _purrsock_get_shard_stats(__atomic_load_n(&loop->stats, __ATOMIC_RELAXED), stats);
+#else
+  memset(stats, 0, sizeof(*stats));
+  return PS_ERROR_UNSUPPORTED;
+#endif
+}
+
+static void _purrsock_loop_heartbeat_expired(ps_loop_t handle, ps_timer_t *timer, void *user_data) {
+  _purrsock_loop_t *loop = (_purrsock_loop_t *)handle;
+  _purrsock_socket_t *socket = (_purrsock_socket_t *)user_data;
+  _purrsock_heartbeat_t *heartbeat = socket->heartbeat;
+  uint32_t interval = heartbeat->options.interval_ms;
+
+  // Heard from the peer since the timer was set: wait out the rest of the interval.
+  uint64_t quiet = loop->now - heartbeat->quiet_since;
+  if (quiet < interval) {
+    _purrsock_timer_wheel_add(&loop->timers, timer, heartbeat->quiet_since + interval);
+    return;
+  }
+
+  bool dead = heartbeat->missed >= heartbeat->options.max_missed;
+
+  // Not in the middle of a loop send, which it would split. The loop made the socket non-blocking, so the
+  // send never waits: a full socket buffer means the peer is not reading either, and the heartbeat is skipped
+  // and counts as missed all the same. A heartbeat fits in a segment, so TCP takes it whole or not at all.
+  bool sending = socket->loop_ops && socket->loop_ops->ops[PS_LOOP_OP_SEND].active;
+  if (!dead && heartbeat->options.message.size && !sending) {
+    ps_result_t result = _purrsock_send_socket_packet(socket, heartbeat->options.message, NULL);
+    dead = result != PS_SUCCESS && result != PS_ERROR_WOULDBLOCK;
+  }
+  if (dead) {
+    ps_loop_socket_callback_t on_close = socket->callbacks.on_close;
+    void *callback_data = socket->callbacks.user_data;
+    _purrsock_loop_remove_socket(loop, socket);
+    if (on_close) on_close((ps_loop_t)loop, (ps_socket_t)socket, callback_data);
+    return;
+  }
+  heartbeat->missed++;
+  heartbeat->quiet_since = loop->now;
+  _purrsock_timer_wheel_add(&loop->timers, timer, loop->now + interval);
+}
+
+ps_result_t _purrsock_loop_set_socket_heartbeat(_purrsock_loop_t *loop, _purrsock_socket_t *socket, const ps_heartbeat_options_t *options) {
+  assert(loop && socket);
+  if (socket->loop != loop) return PS_ERROR_INVALID_ARGUMENT;
+  if (options && options->message.size && !options->message.buf) return PS_ERROR_INVALID_ARGUMENT;
+
+  if (!options || !options->interval_ms) {
+    if (socket->heartbeat) {
+      _purrsock_timer_wheel_remove(&loop->timers, &socket->heartbeat->timer);
+      free(socket->heartbeat);
+      socket->heartbeat = NULL;
+    }
+    return PS_SUCCESS;
+  }
+
+  if (!socket->heartbeat) {
+    socket->heartbeat = (_purrsock_heartbeat_t *)calloc(1, sizeof(*socket->heartbeat));
+    if (!socket->heartbeat) return PS_ERROR_INTERNAL;
+    ps_timer_init(&socket->heartbeat->timer, _purrsock_loop_heartbeat_expired, socket);
+  }
+  _purrsock_heartbeat_t *heartbeat = socket->heartbeat;
+  heartbeat->options = *options;
+  heartbeat->quiet_since = loop->now;
+  heartbeat->missed = 0;
+  _purrsock_timer_wheel_remove(&loop->timers, &heartbeat->timer);
+  _purrsock_timer_wheel_add(&loop->timers, &heartbeat->timer, loop->now + options->interval_ms);
+  return PS_SUCCESS;
+}
+
+ps_result_t _purrsock_loop_run_once(_purrsock_loop_t *loop, int timeout_ms) {
+  assert(loop);
+#ifdef PURRSOCK_STATS
+  __atomic_store_n(&loop->stats, _purrsock_stats_thread_shard(), __ATOMIC_RELAXED);
+#endif
+
+  // Wait no longer than until the next timer is due.
+  if (loop->timers.count) {
+    uint64_t now = _purrsock_monotonic_ms();
+    uint64_t next = _purrsock_timer_wheel_next(&loop->timers);
+    uint64_t delay = next > now ? next - now : 0;
+    if (timeout_ms < 0 || delay < (uint64_t)timeout_ms) timeout_ms = delay > INT32_MAX ? INT32_MAX : (int)delay;
+  }
+
+  ps_result_t result;
+#ifdef PURRSOCK_HAS_IO_URING
+  if (loop->backend == PS_LOOP_BACKEND_IO_URING) {
+    result = _purrsock_loop_run_once_uring(loop, timeout_ms);
+  } else
+#endif
+  {
+    _purrsock_loop_run_ready(loop);
+    result = _purrsock_loop_dispatch_epoll(loop, loop->ready ? 0 : timeout_ms);
+  }
+
+  _purrsock_timer_wheel_advance(&loop->timers, loop->now, (ps_loop_t)loop);
+  _purrsock_loop_run_posts(loop);
+  // Ticks see everything the iteration's callbacks queued, e.g. buffered writes to flush.
+  _purrsock_loop_run_ticks(loop);
+  return result;
+}
+
+ps_result_t _purrsock_loop_run(_purrsock_loop_t *loop) {
+  assert(loop);
+
+  // A stop issued before the loop got here still counts: taking the request resets it for the next run.
+  while (!__atomic_exchange_n(&loop->stop_requested, false, __ATOMIC_ACQUIRE)) {
+    ps_result_t result = _purrsock_loop_run_once(loop, -1);
+    if (result != PS_SUCCESS) return result;
+  }
+  return PS_SUCCESS;
+}
+
+void _purrsock_loop_stop(_purrsock_loop_t *loop) {
+  assert(loop);
+  __atomic_store_n(&loop->stop_requested, true, __ATOMIC_RELEASE);
+
+  uint64_t value = 1;
+  ssize_t res = write(loop->wakefd, &value, sizeof(value));
+  (void)res;
+}
+
+#endif // __linux__
@@ -0,0 +1,265 @@
+// Copyright (c) 2024 ClawsoftSolutions. All rights reserved.
+//
+// This software is licensed under the MIT License.
+// See LICENSE file for more information.
+//
+
+#ifdef __linux__
+
+#include "internal.h"
+
+#ifdef PURRSOCK_HAS_IO_URING
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+// Minimal io_uring ring management on top of the raw syscalls, so purrsock does not depend on liburing.
+
+struct _purrsock_uring_s {
+  int fd;
+  unsigned features;
+
+  // Submission queue.
+  unsigned *sq_head;
+  unsigned *sq_tail;
+  unsigned sq_mask;
+  unsigned sq_entries;
+  unsigned *sq_array;
+  struct io_uring_sqe *sqes;
+  unsigned sqe_tail;       // Local tail, published to `sq_tail` on submit.
+
+  // Completion queue.
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  unsigned cq_mask;
+  struct io_uring_cqe *cqes;
+
+  void *ring_ptr;          // SQ and CQ rings share one mapping (IORING_FEAT_SINGLE_MMAP).
+  size_t ring_size;
+  size_t sqes_size;
+
+  // Provided buffer ring for multishot receives (buffer group 0).
+  struct io_uring_buf_ring *buf_ring;
+  size_t buf_ring_size;
+  char *bufs;
+  size_t buf_size;
+  unsigned buf_count;
+};
+
+static int _purrsock_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, void *arg, size_t arg_size) {
+  return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, arg_size);
+}
+
+ps_result_t _purrsock_uring_create(_purrsock_uring_t **out_ring, unsigned entries) {
+  assert(out_ring);
+
+  _purrsock_uring_t *ring = (_purrsock_uring_t *)calloc(1, sizeof(*ring));
+  if (!ring) return PS_ERROR_INTERNAL;
+
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  params.flags = IORING_SETUP_CLAMP | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+
+  ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+  if (ring->fd < 0 && errno == EINVAL) {
+    // Older kernels reject the newer setup flags.
+    params.flags = IORING_SETUP_CLAMP;
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+  }
+  if (ring->fd < 0) {
+    free(ring);
+    return PS_ERROR_UNSUPPORTED;
+  }
+
+  // The completion API relies on timeouts passed to io_uring_enter and a single ring mapping.
+  ring->features = params.features;
+  if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_SINGLE_MMAP)) {
+    close(ring->fd);
+    free(ring);
+    return PS_ERROR_UNSUPPORTED;
+  }
+
+  size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  ring->ring_size = sq_size > cq_size ? sq_size : cq_size;
+
+  ring->ring_ptr = mmap(NULL, ring->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+  if (ring->ring_ptr == MAP_FAILED) {
+    close(ring->fd);
+    free(ring);
+    return PS_ERROR_INTERNAL;
+  }
+
+  ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  ring->sqes = (struct io_uring_sqe *)mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+  if (ring->sqes == MAP_FAILED) {
+    munmap(ring->ring_ptr, ring->ring_size);
+    close(ring->fd);
+    free(ring);
+    return PS_ERROR_INTERNAL;
+  }
+
+  char *sq = (char *)ring->ring_ptr;
+  ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+  ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+  ring->sq_mask = *(unsigned *)(sq + params.sq_off.ring_mask);
+  ring->sq_entries = *(unsigned *)(sq + params.sq_off.ring_entries);
+  ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+  ring->sqe_tail = *ring->sq_tail;
+
+  char *cq = (char *)ring->ring_ptr;
+  ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+  ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+  ring->cq_mask = *(unsigned *)(cq + params.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+  // SQ array entries map 1:1 onto SQE slots.
+  for (unsigned i = 0; i < ring->sq_entries; ++i) ring->sq_array[i] = i;
+
+  *out_ring = ring;
+  return PS_SUCCESS;
+}
+
+void _purrsock_uring_destroy(_purrsock_uring_t *ring) {
+  assert(ring);
+  if (ring->buf_ring) {
+    munmap(ring->buf_ring, ring->buf_ring_size);
+    free(ring->bufs);
+  }
+  munmap(ring->sqes, ring->sqes_size);
+  munmap(ring->ring_ptr, ring->ring_size);
+  close(ring->fd);
+  free(ring);
+}
+
+static unsigned _purrsock_uring_pending(_purrsock_uring_t *ring) {
+  return ring->sqe_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+}
+
+int _purrsock_uring_submit(_purrsock_uring_t *ring, bool get_events, int timeout_ms) {
+  assert(ring);
+
+  unsigned to_submit = ring->sqe_tail - *ring->sq_tail;
+  __atomic_store_n(ring->sq_tail, ring->sqe_tail, __ATOMIC_RELEASE);
+
+  if (!to_submit && !get_events) return 0;
+
+  // Reaping completions also needs a kernel entry: task work is deferred to it with COOP_TASKRUN.
+  unsigned flags = 0;
+  unsigned wait_nr = 0;
+  struct __kernel_timespec ts;
+  struct io_uring_getevents_arg arg;
+  memset(&arg, 0, sizeof(arg));
+  if (get_events) {
+    flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+    if (timeout_ms != 0) wait_nr = 1;
+    if (timeout_ms > 0) {
+      ts.tv_sec = timeout_ms / 1000;
+      ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+      arg.ts = (uint64_t)(uintptr_t)&ts;
+    }
+  }
+
+  int res;
+  do {
+    res = _purrsock_uring_enter(ring->fd, to_submit, wait_nr, flags, get_events ? &arg : NULL, get_events ? sizeof(arg) : 0);
+  } while (res < 0 && errno == EINTR && !get_events);
+
+  if (res < 0 && (errno == ETIME || errno == EINTR)) return 0;
+  return res < 0 ? -errno : res;
+}
+
+struct io_uring_sqe *_purrsock_uring_get_sqe(_purrsock_uring_t *ring) {
+  assert(ring);
+
+  // Flush queued submissions when the SQ is full; completions are reaped by the next loop iteration.
+  if (_purrsock_uring_pending(ring) >= ring->sq_entries) {
+    if (_purrsock_uring_submit(ring, false, 0) < 0) return NULL;
+    if (_purrsock_uring_pending(ring) >= ring->sq_entries) return NULL;
+  }
+
+  struct io_uring_sqe *sqe = &ring->sqes[ring->sqe_tail & ring->sq_mask];
+  ring->sqe_tail++;
+  memset(sqe, 0, sizeof(*sqe));
+  return sqe;
+}
+
+bool _purrsock_uring_next_cqe(_purrsock_uring_t *ring, uint64_t *user_data, int32_t *res, uint32_t *flags) {
+  assert(ring);
+
+  unsigned head = *ring->cq_head;
+  if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) return false;
+
+  struct io_uring_cqe *cqe = &ring->cqes[head & ring->cq_mask];
+  *user_data = cqe->user_data;
+  *res = cqe->res;
+  *flags = cqe->flags;
+  __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+ps_result_t _purrsock_uring_setup_buffers(_purrsock_uring_t *ring, size_t buf_size, unsigned buf_count) {
+  assert(ring && !ring->buf_ring);
+  assert(buf_count && !(buf_count & (buf_count - 1)));
+
+  ring->buf_ring_size = buf_count * sizeof(struct io_uring_buf);
+  void *mapping = mmap(NULL, ring->buf_ring_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  if (mapping == MAP_FAILED) return PS_ERROR_INTERNAL;
+
+  ring->bufs = (char *)malloc(buf_size * buf_count);
+  if (!ring->bufs) {
+    munmap(mapping, ring->buf_ring_size);
+    return PS_ERROR_INTERNAL;
+  }
+
+  struct io_uring_buf_reg reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = (uint64_t)(uintptr_t)mapping;
+  reg.ring_entries = buf_count;
+  reg.bgid = 0;
+  if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+    free(ring->bufs);
+    munmap(mapping, ring->buf_ring_size);
+    ring->bufs = NULL;
+    return PS_ERROR_UNSUPPORTED;
+  }
+
+  ring->buf_ring = (struct io_uring_buf_ring *)mapping;
+  ring->buf_size = buf_size;
+  ring->buf_count = buf_count;
+
+  for (unsigned i = 0; i < buf_count; ++i) {
+    struct io_uring_buf *buf = &ring->buf_ring->bufs[i];
+    buf->addr = (uint64_t)(uintptr_t)(ring->bufs + i * buf_size);
+    buf->len = (uint32_t)buf_size;
+    buf->bid = (uint16_t)i;
+  }
+  __atomic_store_n(&ring->buf_ring->tail, (uint16_t)buf_count, __ATOMIC_RELEASE);
+  return PS_SUCCESS;
+}
+
+char *_purrsock_uring_buffer(_purrsock_uring_t *ring, uint16_t bid) {
+  assert(ring && ring->buf_ring && bid < ring->buf_count);
+  return ring->bufs + (size_t)bid * ring->buf_size;
+}
+
+void _purrsock_uring_recycle_buffer(_purrsock_uring_t *ring, uint16_t bid) {
+  assert(ring && ring->buf_ring && bid < ring->buf_count);
+
+  uint16_t tail = ring->buf_ring->tail;
+  struct io_uring_buf *buf = &ring->buf_ring->bufs[tail & (ring->buf_count - 1)];
+  buf->addr = (uint64_t)(uintptr_t)_purrsock_uring_buffer(ring, bid);
+  buf->len = (uint32_t)ring->buf_size;
+  buf->bid = bid;
+  __atomic_store_n(&ring->buf_ring->tail, (uint16_t)(tail + 1), __ATOMIC_RELEASE);
+}
+
+#endif // PURRSOCK_HAS_IO_URING
+
+#endif // __linux__
@@ -0,0 +1,342 @@
+// Copyright (c) 2024 ClawsoftSolutions. All rights reserved.
+//
+// This software is licensed under the MIT License.
+// See LICENSE file for more information.
+//
+
+#ifdef __linux__
+
+#include "internal.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define PS_ZEROCOPY_CLEANUP_WAIT_MS 1000
+
+// MSG_ZEROCOPY sends: the kernel pins the packet's pages instead of copying them, and reports on the
+// socket's error queue, by ranges of per-socket send ids, when it has let go of them.
+
+typedef struct _purrsock_zerocopy_send_s {
+  struct _purrsock_zerocopy_send_s *next;
+  ps_packet_t packet;
+  ps_zerocopy_completion_t callback;
+  void *user_data;
+  uint32_t last_id;        // Id of the last sendmsg that referenced the packet.
+} _purrsock_zerocopy_send_t;
+
+struct _purrsock_zerocopy_s {
+  bool enabled;
+  bool lingering;          // The socket was destroyed; its fd stays open until the kernel lets go of every packet.
+  uint32_t next_id;        // Mirrors the kernel's counter: one id per successful MSG_ZEROCOPY send.
+  _purrsock_zerocopy_send_t *head;
+  _purrsock_zerocopy_send_t *tail;
+};
+
+// Destroyed sockets whose packets are still pinned, reaped by later zero-copy calls and socket destructions from
+// any thread, and by cleanup.
+typedef struct _purrsock_zerocopy_linger_s {
+  struct _purrsock_zerocopy_linger_s *next;
+  _purrsock_socket_t socket;
+} _purrsock_zerocopy_linger_t;
+
+static _purrsock_mutex_t s_linger_lock = PTHREAD_MUTEX_INITIALIZER;
+static _purrsock_zerocopy_linger_t *s_lingering = NULL;
+
+static void _purrsock_zerocopy_complete(_purrsock_socket_t *socket, ps_packet_t *packet, ps_zerocopy_completion_t callback, void *user_data, bool copied) {
+  if (callback) {
+    callback(socket->zerocopy && socket->zerocopy->lingering ? NULL : (ps_socket_t)socket, packet, copied, user_data);
+  } else {
+    _purrsock_packet_release(packet);
+  }
+}
+
+ps_result_t _purrsock_set_socket_zerocopy(_purrsock_socket_t *socket, bool enabled) {
+  assert(socket);
+  _purrsock_socket_data_t *data = (_purrsock_socket_data_t *)socket->data;
+  if (!data) return PS_ERROR_NOTINIT;
+
+  int value = enabled ? 1 : 0;
+  if (setsockopt(data->sockfd, SOL_SOCKET, SO_ZEROCOPY, &value, sizeof(value)) < 0) {
+    return _last_ps_result("purrsock_set_socket_zerocopy");
+  }
+
+  if (!socket->zerocopy) {
+    if (!enabled) return PS_SUCCESS;
+    socket->zerocopy = (_purrsock_zerocopy_t *)calloc(1, sizeof(*socket->zerocopy));
+    if (!socket->zerocopy) return PS_ERROR_INTERNAL;
+  }
+  socket->zerocopy->enabled = enabled;
+  return PS_SUCCESS;
+}
+
+size_t _purrsock_zerocopy_reap(_purrsock_socket_t *socket) {
+  assert(socket);
+  _purrsock_zerocopy_t *zerocopy = socket->zerocopy;
+  _purrsock_socket_data_t *data = (_purrsock_socket_data_t *)socket->data;
+  if (!zerocopy || !zerocopy->head || !data) return 0;
+
+  size_t completed = 0;
+  while (zerocopy->head) {
+    union {
+      char buf[CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in6))];
+      struct cmsghdr align;
+    } control;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    if (recvmsg(data->sockfd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+      if (errno == EINTR) continue;
+      break;
+    }
+
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) &&
+          !(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)) continue;
+
+      struct sock_extended_err err;
+      memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+      if (err.ee_origin != SO_EE_ORIGIN_ZEROCOPY || err.ee_errno != 0) continue;
+
+      // [ee_info, ee_data] is the range of send ids released; TCP reports them in order.
+      uint32_t last = err.ee_data;
+      bool copied = err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED;
+      while (zerocopy->head && (int32_t)(zerocopy->head->last_id - last) <= 0) {
+        _purrsock_zerocopy_send_t *pending = zerocopy->head;
+        zerocopy->head = pending->next;
+        if (!zerocopy->head) zerocopy->tail = NULL;
+        _purrsock_zerocopy_complete(socket, &pending->packet, pending->callback, pending->user_data, copied);
+        free(pending);
+        completed++;
+      }
+    }
+  }
+  return completed;
+}
+
+static void _purrsock_zerocopy_reap_lingering() {
+  // Take the whole list so completions run unlocked; a concurrent reaper just finds it empty.
+  _purrsock_mutex_lock(&s_linger_lock);
+  _purrsock_zerocopy_linger_t *lingering = s_lingering;
+  s_lingering = NULL;
+  _purrsock_mutex_unlock(&s_linger_lock);
+  if (!lingering) return;
+
+  _purrsock_zerocopy_linger_t *kept = NULL;
+  _purrsock_zerocopy_linger_t **kept_tail = &kept;
+  while (lingering) {
+    _purrsock_zerocopy_linger_t *linger = lingering;
+    lingering = linger->next;
+    _purrsock_zerocopy_reap(&linger->socket);
+    if (linger->socket.zerocopy->head) {
+      linger->next = NULL;
+      *kept_tail = linger;
+      kept_tail = &linger->next;
+      continue;
+    }
+
+    _purrsock_socket_data_t *data = (_purrsock_socket_data_t *)linger->socket.data;
+    close(data->sockfd);
+    free(data);
+    free(linger->socket.zerocopy);
+    free(linger);
+  }
+  if (!kept) return;
+
+  _purrsock_mutex_lock(&s_linger_lock);
+  *kept_tail = s_lingering;
+  s_lingering = kept;
+  _purrsock_mutex_unlock(&s_linger_lock);
+}
+
+void _purrsock_zerocopy_cleanup() {
+  // Once shut down, a connection's packets come back as soon as the kernel is done sending them.
+  _purrsock_zerocopy_reap_lingering();
+  for (int waited = 0; waited < PS_ZEROCOPY_CLEANUP_WAIT_MS; waited += 10) {
+    _purrsock_mutex_lock(&s_linger_lock);
+    bool empty = !s_lingering;
+    _purrsock_mutex_unlock(&s_linger_lock);
+    if (empty) return;
+    poll(NULL, 0, 10);
+    _purrsock_zerocopy_reap_lingering();
+  }
+
+  // Whatever the kernel still holds is leaked rather than handed back; only the fds are closed.
+  _purrsock_mutex_lock(&s_linger_lock);
+  _purrsock_zerocopy_linger_t *lingering = s_lingering;
+  s_lingering = NULL;
+  _purrsock_mutex_unlock(&s_linger_lock);
+  while (lingering) {
+    _purrsock_zerocopy_linger_t *linger = lingering;
+    lingering = linger->next;
+    while (linger->socket.zerocopy->head) {
+      _purrsock_zerocopy_send_t *pending = linger->socket.zerocopy->head;
+      linger->socket.zerocopy->head = pending->next;
+      free(pending);
+    }
+    _purrsock_socket_data_t *data = (_purrsock_socket_data_t *)linger->socket.data;
+    close(data->sockfd);
+    free(data);
+    free(linger->socket.zerocopy);
+    free(linger);
+  }
+}
+
+ps_result_t _purrsock_process_zerocopy_completions(_purrsock_socket_t *socket, size_t *completed) {
+  assert(socket && completed);
+  if (!socket->data) return PS_ERROR_NOTINIT;
+  _purrsock_zerocopy_reap_lingering();
+  *completed = _purrsock_zerocopy_reap(socket);
+  return PS_SUCCESS;
+}
+
+bool _purrsock_zerocopy_pending(_purrsock_socket_t *socket) {
+  return socket->zerocopy && socket->zerocopy->head;
+}
+
+bool _purrsock_socket_has_error(_purrsock_socket_t *socket) {
+  _purrsock_socket_data_t *data = (_purrsock_socket_data_t *)socket->data;
+  if (!data) return false;
+  struct pollfd pfd = { .fd = data->sockfd, .events = 0 };
+  return poll(&pfd, 1, 0) > 0 && (pfd.revents & (POLLERR | POLLHUP));
+}
+
+ps_result_t _purrsock_send_socket_packet_zerocopy(_purrsock_socket_t *socket, ps_packet_t packet, ps_zerocopy_completion_t callback, void *user_data) {
+  assert(socket);
+  _purrsock_socket_data_t *data = (_purrsock_socket_data_t *)socket->data;
+  _purrsock_zerocopy_t *zerocopy = socket->zerocopy;
+
+  // Small packets are cheaper to copy than to pin and track.
+  if (!data || !zerocopy || !zerocopy->enabled || packet.size < PS_ZEROCOPY_THRESHOLD) {
+    ps_result_t result = data ? _purrsock_send_socket_packet(socket, packet, NULL) : PS_ERROR_NOTINIT;
+    _purrsock_zerocopy_complete(socket, &packet, callback, user_data, true);
+    return result;
+  }
+
+  // Reap earlier completions first so blocking users need not poll for them.
+  _purrsock_zerocopy_reap_lingering();
+  _purrsock_zerocopy_reap(socket);
+
+  // Bytes kept from an earlier partial send go out first.
+  ps_result_t result = _purrsock_flush_socket(socket);
+  if (result != PS_SUCCESS) {
+    _purrsock_zerocopy_complete(socket, &packet, callback, user_data, true);
+    return result;
+  }
+
+  _purrsock_zerocopy_send_t *pending = (_purrsock_zerocopy_send_t *)malloc(sizeof(*pending));
+  if (!pending) {
+    _purrsock_zerocopy_complete(socket, &packet, callback, user_data, true);
+    return PS_ERROR_INTERNAL;
+  }
+
+  int flags = MSG_ZEROCOPY | MSG_NOSIGNAL;
+  uint32_t zerocopy_sends = 0;
+  size_t total = 0;
+  while (total < packet.size) {
+    PS_STATS_START(start);
+    ssize_t sent = send(data->sockfd, packet.buf + total, packet.size - total, flags);
+    PS_STATS_SYSCALL(socket, true, sent < 0 && errno == EAGAIN, start);
+    if (sent >= 0) {
+      PS_STATS_TRANSFER(socket, true, sent, total == 0);
+      total += sent;
+      if (flags & MSG_ZEROCOPY) {
+        zerocopy->next_id++;
+        zerocopy_sends++;
+      }
+      if (_purrsock_is_datagram(socket->protocol)) break;
+      continue;
+    }
+    if (errno == EINTR) continue;
+    // Out of notification memory (optmem): finish with ordinary copying sends.
+    if (errno == ENOBUFS && (flags & MSG_ZEROCOPY)) {
+      flags &= ~MSG_ZEROCOPY;
+      continue;
+    }
+    // Like ps_send_socket_packet, a non-blocking socket keeps the rest of a packet that started going out;
+    // a blocking one only gets here once its write timeout expires.
+    if (errno == EAGAIN && total > 0) {
+      int fd_flags = fcntl(data->sockfd, F_GETFL, 0);
+      if (fd_flags >= 0 && !(fd_flags & O_NONBLOCK)) {
+        result = PS_ERROR_TIMEOUT;
+        break;
+      }
+      char *unsent = _purrsock_reserve_unsent(socket, packet.size - total);
+      if (!unsent) {
+        result = PS_ERROR_INTERNAL;
+        break;
+      }
+      memcpy(unsent, packet.buf + total, packet.size - total);
+      break;
+    }
+    result = _last_ps_result("purrsock_send_socket_packet_zerocopy");
+    break;
+  }
+
+  if (!zerocopy_sends) {
+    free(pending);
+    _purrsock_zerocopy_complete(socket, &packet, callback, user_data, true);
+    return result;
+  }
+
+  pending->next = NULL;
+  pending->packet = packet;
+  pending->callback = callback;
+  pending->user_data = user_data;
+  pending->last_id = zerocopy->next_id - 1;
+  if (zerocopy->tail) {
+    zerocopy->tail->next = pending;
+  } else {
+    zerocopy->head = pending;
+  }
+  zerocopy->tail = pending;
+  return result;
+}
+
+void _purrsock_zerocopy_destroy(_purrsock_socket_t *socket) {
+  assert(socket);
+  _purrsock_zerocopy_reap_lingering();
+  _purrsock_zerocopy_t *zerocopy = socket->zerocopy;
+  if (!zerocopy) return;
+
+  _purrsock_zerocopy_reap(socket);
+  if (!zerocopy->head) {
+    free(zerocopy);
+    socket->zerocopy = NULL;
+    return;
+  }
+
+  // The kernel may still be transmitting from the pinned buffers, so they cannot be handed back yet:
+  // the fd is shut down but stays open, and the buffers return once their completions arrive. The linger
+  // record takes over the fd, so the caller finds no data left to close.
+  _purrsock_zerocopy_linger_t *linger = (_purrsock_zerocopy_linger_t *)calloc(1, sizeof(*linger));
+  if (!linger) {
+    // Leak the buffers rather than hand back memory the kernel may still read.
+    socket->zerocopy = NULL;
+    return;
+  }
+  _purrsock_socket_data_t *data = (_purrsock_socket_data_t *)socket->data;
+  shutdown(data->sockfd, SHUT_RDWR);
+  zerocopy->lingering = true;
+  linger->socket.protocol = socket->protocol;
+  linger->socket.data = data;
+  linger->socket.zerocopy = zerocopy;
+  socket->data = NULL;
+  socket->zerocopy = NULL;
+
+  _purrsock_mutex_lock(&s_linger_lock);
+  linger->next = s_lingering;
+  s_lingering = linger;
+  _purrsock_mutex_unlock(&s_linger_lock);
+}
+
+#endif // __linux__
@@ -0,0 +1,826 @@
+// Copyright (c) 2024 ClawsoftSolutions. All rights reserved.
+//
+// This software is licensed under the MIT License.
+// See LICENSE file for more information.
+//
+
+
+
+#include "internal.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+// Stream transports without the kernel. A connection is a pair of single-producer single-consumer byte
+// rings, one per direction; readers and writers only touch the other side's counter, and only sleep or
+// wake a sleeper through the pipe's lock (or futex) when one side has to wait.
+//
+// PS_PROTOCOL_MEMORY keeps pipes on the heap and addresses in a process-wide registry of bound sockets.
+// PS_PROTOCOL_SHM maps them from named shared memory instead: a bound socket owns a segment named after
+// its address holding a queue of connections waiting for accept, and each connect creates a segment for
+// its pipe that the accepting process maps and unlinks. Waiters there sleep on a futex in the pipe, and
+// wake up now and then to check that the process on the other side is still alive.
+
+#define PS_MEMORY_RING_CAPACITY (256 * 1024)
+#define PS_MEMORY_DEFAULT_BACKLOG 4096
+#define PS_MEMORY_EPHEMERAL_PORT 32768
+#define PS_MEMORY_SPINS 256
+#define PS_MEMORY_CACHE_LINE 64
+#define PS_MEMORY_SHM_MAGIC 0x70757273u
+#define PS_MEMORY_SHM_BACKLOG 128
+#define PS_MEMORY_SHM_SPINS 2048           // A wakeup through the kernel costs microseconds; spin longer first.
+#define PS_MEMORY_SHM_LIVENESS_MS 100
+#define PS_MEMORY_SHM_NAME 64
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PS_MEMORY_CPU_RELAX() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define PS_MEMORY_CPU_RELAX() __asm__ __volatile__("yield")
+#else
+#define PS_MEMORY_CPU_RELAX() ((void)0)
+#endif
+
+typedef struct {
+  uint64_t head;                   // Bytes consumed, written by the reader only.
+  char pad0[PS_MEMORY_CACHE_LINE - sizeof(uint64_t)];
+  uint64_t tail;                   // Bytes produced, written by the writer only.
+  char pad1[PS_MEMORY_CACHE_LINE - sizeof(uint64_t)];
+} _purrsock_memory_ring_t;
+
+// The ring buffers follow the header, so that a pipe is one block the other process can map anywhere.
+typedef struct {
+  _purrsock_memory_ring_t rings[2]; // rings[side] carries what `side` sends.
+  bool closed[2];                  // The socket of that side was destroyed.
+  bool shared;                     // Mapped from shared memory, woken through `seq`.
+  uint32_t refs;
+  uint32_t sleepers;               // Threads waiting for the pipe; writers only wake anyone when there are any.
+  uint32_t seq;                    // Futex word of a shared pipe, bumped by every wakeup.
+  uint32_t pids[2];                // Process of each side of a shared pipe.
+  _purrsock_mutex_t lock;          // Sleeping on in-process pipes.
+  _purrsock_cond_t cond;
+} _purrsock_memory_pipe_t;
+
+#define PS_MEMORY_PIPE_HEADER ((sizeof(_purrsock_memory_pipe_t) + PS_MEMORY_CACHE_LINE - 1) & ~(size_t)(PS_MEMORY_CACHE_LINE - 1))
+#define PS_MEMORY_PIPE_SIZE (PS_MEMORY_PIPE_HEADER + 2 * PS_MEMORY_RING_CAPACITY)
+
+// Segment of a bound PS_PROTOCOL_SHM socket. `magic` is stored last, once the rest is valid.
+typedef struct {
+  uint32_t magic;
+  uint32_t pid;                    // Owning process; the address is free again once it died.
+  uint32_t lock;                   // Spinlock over the queue.
+  bool listening;
+  uint32_t backlog;
+  uint32_t sleepers;
+  uint32_t seq;                    // Futex word, bumped when a connection is queued.
+  uint64_t head;
+  uint64_t tail;
+  uint64_t pipes[PS_MEMORY_SHM_BACKLOG]; // Ids of the pipes of connections waiting for accept.
+} _purrsock_memory_shm_listener_t;
+
+typedef struct _purrsock_memory_listener_s _purrsock_memory_listener_t;
+typedef bool (*_purrsock_memory_ready_t)(void *object, int side);
+
+struct _purrsock_memory_socket_s {
+  _purrsock_memory_socket_t *next; // In the accept queue of a listener.
+  _purrsock_memory_listener_t *listener; // Bound address, NULL if not bound.
+  _purrsock_memory_shm_listener_t *shm_listener; // Bound address of a shared socket, NULL if not bound.
+  _purrsock_memory_pipe_t *pipe;   // NULL until connected.
+  uint64_t pipe_id;                // Name of the shared pipe this socket created by connecting, 0 if none.
+  int side;                        // 0 for the connecting socket, 1 for the accepted one.
+  ps_endpoint_t local;
+  ps_endpoint_t remote;
+  bool shared;
+  bool nonblocking;
+};
+
+struct _purrsock_memory_listener_s {
+  _purrsock_memory_listener_t *next;
+  ps_endpoint_t endpoint;
+  bool listening;
+  size_t backlog;
+  _purrsock_memory_socket_t *queue; // Connections waiting for accept, oldest first.
+  _purrsock_memory_socket_t *queue_tail;
+  size_t queued;
+  _purrsock_mutex_t lock;
+  _purrsock_cond_t cond;
+};
+
+// The registry is only touched by bind, connect and destroy; a spinlock needs no initialization.
+static uint32_t s_registry_lock;
+static _purrsock_memory_listener_t *s_listeners;
+static uint32_t s_next_port = PS_MEMORY_EPHEMERAL_PORT;
+static uint32_t s_next_pipe;
+static int s_shm_spins = -1;
+
+static void _purrsock_memory_spin_lock(uint32_t *lock) {
+  while (__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE)) {
+    while (__atomic_load_n(lock, __ATOMIC_RELAXED)) PS_MEMORY_CPU_RELAX();
+  }
+}
+
+static void _purrsock_memory_spin_unlock(uint32_t *lock) {
+  __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+}
+
+static void _purrsock_memory_registry_lock() {
+  _purrsock_memory_spin_lock(&s_registry_lock);
+}
+
+static void _purrsock_memory_registry_unlock() {
+  _purrsock_memory_spin_unlock(&s_registry_lock);
+}
+
+static bool _purrsock_memory_is_any(const ps_endpoint_t *endpoint) {
+  static const uint8_t zero[16] = {0};
+  return !memcmp(endpoint->addr, zero, endpoint->family == PS_ADDRESS_IPV6 ? 16 : 4);
+}
+
+static bool _purrsock_memory_same_addr(const ps_endpoint_t *a, const ps_endpoint_t *b) {
+  return a->family == b->family && !memcmp(a->addr, b->addr, a->family == PS_ADDRESS_IPV6 ? 16 : 4);
+}
+
+// Finds the listener bound to `endpoint`, or to the wildcard address of its family. Registry locked.
+static _purrsock_memory_listener_t *_purrsock_memory_find(const ps_endpoint_t *endpoint, bool exact) {
+  _purrsock_memory_listener_t *any = NULL;
+  for (_purrsock_memory_listener_t *listener = s_listeners; listener; listener = listener->next) {
+    if (listener->endpoint.port != endpoint->port || listener->endpoint.family != endpoint->family) continue;
+    if (_purrsock_memory_same_addr(&listener->endpoint, endpoint)) return listener;
+    if (!exact && _purrsock_memory_is_any(&listener->endpoint)) any = listener;
+  }
+  return any;
+}
+
+// Picks an ephemeral port; bound ones are skipped so that binding to port 0 finds a free one.
+static ps_port_t _purrsock_memory_ephemeral_port(const ps_endpoint_t *endpoint) {
+  ps_endpoint_t candidate = *endpoint;
+  for (int attempt = 0; attempt < 65536 - PS_MEMORY_EPHEMERAL_PORT; ++attempt) {
+    uint32_t port = __atomic_fetch_add(&s_next_port, 1, __ATOMIC_RELAXED);
+    candidate.port = (ps_port_t)(PS_MEMORY_EPHEMERAL_PORT + port % (65536 - PS_MEMORY_EPHEMERAL_PORT));
+    if (!_purrsock_memory_find(&candidate, true)) return candidate.port;
+  }
+  return 0;
+}
+
+// Shared memory names
+
+// Listener segments are named after the address, which they own like a bound port.
+static void _purrsock_memory_shm_listener_name(char *name, const ps_endpoint_t *endpoint) {
+  const uint8_t *addr = endpoint->addr;
+  int length = snprintf(name, PS_MEMORY_SHM_NAME, "/purrsock.%u.", (unsigned)endpoint->port);
+  for (int i = 0; i < (endpoint->family == PS_ADDRESS_IPV6 ? 16 : 4); ++i) {
+    length += snprintf(name + length, PS_MEMORY_SHM_NAME - length, "%02x", addr[i]);
+  }
+}
+
+static void _purrsock_memory_shm_pipe_name(char *name, uint64_t id) {
+  snprintf(name, PS_MEMORY_SHM_NAME, "/purrsock.pipe.%08x.%08x", (unsigned)(id >> 32), (unsigned)id);
+}
+
+// Waits for `ready` on an object in shared memory, sleeping on its futex word `seq` within `deadline`.
+// Nobody wakes us for a peer process that died, so sleeps are cut short to check `peer_pid` and mark
+// the peer closed.
+static ps_result_t _purrsock_memory_futex_wait(uint32_t *seq, uint32_t *sleepers, _purrsock_memory_ready_t ready, void *object, int side, uint64_t deadline, const uint32_t *peer_pid, bool *peer_closed) {
+  ps_result_t result = PS_SUCCESS;
+  __atomic_fetch_add(sleepers, 1, __ATOMIC_SEQ_CST);
+  for (;;) {
+    uint32_t value = __atomic_load_n(seq, __ATOMIC_SEQ_CST);
+    if (ready(object, side)) break;
+
+    uint32_t sleep_ms = PS_MEMORY_SHM_LIVENESS_MS;
+    if (deadline) {
+      uint64_t now = _purrsock_monotonic_ms();
+      if (now >= deadline) {
+        result = PS_ERROR_TIMEOUT;
+        break;
+      }
+      if (deadline - now < sleep_ms) sleep_ms = (uint32_t)(deadline - now);
+    }
+    _purrsock_futex_wait(seq, value, sleep_ms);
+
+    uint32_t pid = peer_pid ? __atomic_load_n(peer_pid, __ATOMIC_RELAXED) : 0;
+    if (pid && !_purrsock_process_alive(pid)) __atomic_store_n(peer_closed, true, __ATOMIC_SEQ_CST);
+  }
+  __atomic_fetch_sub(sleepers, 1, __ATOMIC_SEQ_CST);
+  return result;
+}
+
+static void _purrsock_memory_futex_notify(uint32_t *seq, uint32_t *sleepers) {
+  if (!__atomic_load_n(sleepers, __ATOMIC_SEQ_CST)) return;
+  __atomic_fetch_add(seq, 1, __ATOMIC_SEQ_CST);
+  _purrsock_futex_wake(seq);
+}
+
+// Pipes
+
+static char *_purrsock_memory_ring_buf(_purrsock_memory_pipe_t *pipe, int side) {
+  return (char *)pipe + PS_MEMORY_PIPE_HEADER + (size_t)side * PS_MEMORY_RING_CAPACITY;
+}
+
+static _purrsock_memory_pipe_t *_purrsock_memory_create_pipe() {
+  _purrsock_memory_pipe_t *pipe = (_purrsock_memory_pipe_t *)malloc(PS_MEMORY_PIPE_SIZE);
+  if (!pipe) return NULL;
+  memset(pipe, 0, sizeof(*pipe));
+  pipe->refs = 2;
+  _purrsock_mutex_init(&pipe->lock);
+  _purrsock_cond_init(&pipe->cond);
+  return pipe;
+}
+
+static void _purrsock_memory_notify(_purrsock_memory_pipe_t *pipe) {
+  if (pipe->shared) {
+    _purrsock_memory_futex_notify(&pipe->seq, &pipe->sleepers);
+    return;
+  }
+  // Sequentially consistent with the waiter's increment and recheck, so either it sees the update or we see it.
+  if (!__atomic_load_n(&pipe->sleepers, __ATOMIC_SEQ_CST)) return;
+  _purrsock_mutex_lock(&pipe->lock);
+  _purrsock_cond_broadcast(&pipe->cond);
+  _purrsock_mutex_unlock(&pipe->lock);
+}
+
+static void _purrsock_memory_release_pipe(_purrsock_memory_pipe_t *pipe, int side) {
+  __atomic_store_n(&pipe->closed[side], true, __ATOMIC_SEQ_CST);
+  _purrsock_memory_notify(pipe);
+  // The segment of a shared pipe goes away once both processes unmapped it.
+  if (pipe->shared) {
+    _purrsock_shm_unmap(pipe, PS_MEMORY_PIPE_SIZE);
+    return;
+  }
+  if (__atomic_sub_fetch(&pipe->refs, 1, __ATOMIC_ACQ_REL)) return;
+
+  _purrsock_cond_destroy(&pipe->cond);
+  _purrsock_mutex_destroy(&pipe->lock);
+  free(pipe);
+}
+
+static void _purrsock_memory_discard_pipe(_purrsock_memory_pipe_t *pipe) {
+  _purrsock_memory_release_pipe(pipe, 0);
+  _purrsock_memory_release_pipe(pipe, 1);
+}
+
+static size_t _purrsock_memory_readable(_purrsock_memory_pipe_t *pipe, int side) {
+  _purrsock_memory_ring_t *ring = &pipe->rings[!side];
+  return (size_t)(__atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST) - ring->head);
+}
+
+static size_t _purrsock_memory_writable(_purrsock_memory_pipe_t *pipe, int side) {
+  _purrsock_memory_ring_t *ring = &pipe->rings[side];
+  return PS_MEMORY_RING_CAPACITY - (size_t)(ring->tail - __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST));
+}
+
+static bool _purrsock_memory_peer_closed(_purrsock_memory_pipe_t *pipe, int side) {
+  return __atomic_load_n(&pipe->closed[!side], __ATOMIC_SEQ_CST);
+}
+
+static bool _purrsock_memory_can_read(void *object, int side) {
+  _purrsock_memory_pipe_t *pipe = (_purrsock_memory_pipe_t *)object;
+  return _purrsock_memory_readable(pipe, side) || _purrsock_memory_peer_closed(pipe, side);
+}
+
+static bool _purrsock_memory_can_write(void *object, int side) {
+  _purrsock_memory_pipe_t *pipe = (_purrsock_memory_pipe_t *)object;
+  return _purrsock_memory_writable(pipe, side) || _purrsock_memory_peer_closed(pipe, side);
+}
+
+// Waits until `ready` holds, spinning briefly before sleeping, within the socket's timeout.
+static ps_result_t _purrsock_memory_wait(_purrsock_memory_socket_t *memory, _purrsock_memory_ready_t ready, bool nonblocking, uint32_t timeout_ms) {
+  _purrsock_memory_pipe_t *pipe = memory->pipe;
+  if (ready(pipe, memory->side)) return PS_SUCCESS;
+  if (nonblocking) return PS_ERROR_WOULDBLOCK;
+  if (pipe->shared) {
+    // With a single CPU the other process cannot answer while we spin.
+    int spins = __atomic_load_n(&s_shm_spins, __ATOMIC_RELAXED);
+    if (spins < 0) {
+      spins = _purrsock_cpu_count() > 1 ? PS_MEMORY_SHM_SPINS : 0;
+      __atomic_store_n(&s_shm_spins, spins, __ATOMIC_RELAXED);
+    }
+    for (int spin = 0; spin < spins; ++spin) {
+      if (ready(pipe, memory->side)) return PS_SUCCESS;
+      PS_MEMORY_CPU_RELAX();
+    }
+    uint64_t deadline = timeout_ms ? _purrsock_monotonic_ms() + timeout_ms : 0;
+    return _purrsock_memory_futex_wait(&pipe->seq, &pipe->sleepers, ready, pipe, memory->side, deadline, &pipe->pids[!memory->side], &pipe->closed[!memory->side]);
+  }
+  for (int spin = 0; spin < PS_MEMORY_SPINS; ++spin) {
+    if (ready(pipe, memory->side)) return PS_SUCCESS;
+  }
+
+  ps_result_t result = PS_SUCCESS;
+  uint64_t deadline = timeout_ms ? _purrsock_monotonic_ms() + timeout_ms : 0;
+  _purrsock_mutex_lock(&pipe->lock);
+  __atomic_fetch_add(&pipe->sleepers, 1, __ATOMIC_SEQ_CST);
+  while (!ready(pipe, memory->side)) {
+    if (!deadline) {
+      _purrsock_cond_wait(&pipe->cond, &pipe->lock);
+      continue;
+    }
+    uint64_t now = _purrsock_monotonic_ms();
+    if (now >= deadline) {
+      result = PS_ERROR_TIMEOUT;
+      break;
+    }
+    _purrsock_cond_timed_wait(&pipe->cond, &pipe->lock, (uint32_t)(deadline - now));
+  }
+  __atomic_fetch_sub(&pipe->sleepers, 1, __ATOMIC_SEQ_CST);
+  _purrsock_mutex_unlock(&pipe->lock);
+  return result;
+}
+
+// Shared listeners
+
+static bool _purrsock_memory_shm_pending(void *object, int side) {
+  (void)side;
+  _purrsock_memory_shm_listener_t *listener = (_purrsock_memory_shm_listener_t *)object;
+  return __atomic_load_n(&listener->tail, __ATOMIC_SEQ_CST) != __atomic_load_n(&listener->head, __ATOMIC_SEQ_CST);
+}
+
+static ps_result_t _purrsock_memory_shm_open_listener(const ps_endpoint_t *endpoint, _purrsock_memory_shm_listener_t **listener) {
+  char name[PS_MEMORY_SHM_NAME];
+  _purrsock_memory_shm_listener_name(name, endpoint);
+  ps_result_t result = _purrsock_shm_map(name, sizeof(**listener), false, (void **)listener);
+  if (result != PS_SUCCESS) return result;
+  if (__atomic_load_n(&(*listener)->magic, __ATOMIC_ACQUIRE) != PS_MEMORY_SHM_MAGIC) {
+    _purrsock_shm_unmap(*listener, sizeof(**listener));
+    return PS_ERROR_CONNREFUSED;
+  }
+  return PS_SUCCESS;
+}
+
+// A listener left behind by a process that died does not keep its address.
+static bool _purrsock_memory_shm_is_stale(const ps_endpoint_t *endpoint) {
+  _purrsock_memory_shm_listener_t *listener;
+  if (_purrsock_memory_shm_open_listener(endpoint, &listener) != PS_SUCCESS) return false;
+  bool stale = !_purrsock_process_alive(listener->pid);
+  _purrsock_shm_unmap(listener, sizeof(*listener));
+  return stale;
+}
+
+static ps_result_t _purrsock_memory_shm_create_listener(const ps_endpoint_t *endpoint, _purrsock_memory_shm_listener_t **listener) {
+  char name[PS_MEMORY_SHM_NAME];
+  _purrsock_memory_shm_listener_name(name, endpoint);
+  ps_result_t result = _purrsock_shm_map(name, sizeof(**listener), true, (void **)listener);
+  if (result == PS_ERROR_ADDRINUSE && _purrsock_memory_shm_is_stale(endpoint)) {
+    _purrsock_shm_unlink(name);
+    result = _purrsock_shm_map(name, sizeof(**listener), true, (void **)listener);
+  }
+  if (result != PS_SUCCESS) return result;
+
+  (*listener)->pid = _purrsock_process_id();
+  __atomic_store_n(&(*listener)->magic, PS_MEMORY_SHM_MAGIC, __ATOMIC_RELEASE);
+  return PS_SUCCESS;
+}
+
+static void _purrsock_memory_shm_destroy_listener(_purrsock_memory_shm_listener_t *listener, const ps_endpoint_t *endpoint) {
+  char name[PS_MEMORY_SHM_NAME];
+  // A forked child closing its copy of the socket leaves the address to the process that bound it.
+  if (listener->pid != _purrsock_process_id()) {
+    _purrsock_shm_unmap(listener, sizeof(*listener));
+    return;
+  }
+
+  _purrsock_memory_shm_listener_name(name, endpoint);
+  _purrsock_shm_unlink(name);
+  _purrsock_memory_spin_lock(&listener->lock);
+  listener->listening = false;
+  _purrsock_memory_spin_unlock(&listener->lock);
+
+  // Connections nobody accepted see the peer hang up. No connect can queue another one now.
+  while (listener->head != listener->tail) {
+    uint64_t id = listener->pipes[listener->head++ % PS_MEMORY_SHM_BACKLOG];
+    _purrsock_memory_pipe_t *pipe;
+    _purrsock_memory_shm_pipe_name(name, id);
+    if (_purrsock_shm_map(name, PS_MEMORY_PIPE_SIZE, false, (void **)&pipe) != PS_SUCCESS) continue;
+    _purrsock_shm_unlink(name);
+    _purrsock_memory_release_pipe(pipe, 1);
+  }
+  _purrsock_shm_unmap(listener, sizeof(*listener));
+}
+
+static ps_result_t _purrsock_memory_shm_bind(_purrsock_memory_socket_t *memory, ps_endpoint_t endpoint) {
+  ps_result_t result;
+  if (endpoint.port) {
+    result = _purrsock_memory_shm_create_listener(&endpoint, &memory->shm_listener);
+  } else {
+    // Other processes pick ports too, so start at a different one in each.
+    uint32_t start = _purrsock_process_id() * 7919u;
+    result = PS_ERROR_ADDRINUSE;
+    for (int attempt = 0; attempt < 65536 - PS_MEMORY_EPHEMERAL_PORT && result == PS_ERROR_ADDRINUSE; ++attempt) {
+      uint32_t port = start + __atomic_fetch_add(&s_next_port, 1, __ATOMIC_RELAXED);
+      endpoint.port = (ps_port_t)(PS_MEMORY_EPHEMERAL_PORT + port % (65536 - PS_MEMORY_EPHEMERAL_PORT));
+      result = _purrsock_memory_shm_create_listener(&endpoint, &memory->shm_listener);
+    }
+  }
+  if (result != PS_SUCCESS) return result;
+  memory->local = endpoint;
+  return PS_SUCCESS;
+}
+
+static ps_result_t _purrsock_memory_shm_accept(_purrsock_memory_socket_t *memory, uint32_t timeout_ms, _purrsock_memory_socket_t **accepted) {
+  _purrsock_memory_shm_listener_t *listener = memory->shm_listener;
+  uint64_t deadline = timeout_ms ? _purrsock_monotonic_ms() + timeout_ms : 0;
+  for (;;) {
+    if (!_purrsock_memory_shm_pending(listener, 0)) {
+      if (memory->nonblocking) return PS_ERROR_WOULDBLOCK;
+      ps_result_t result = _purrsock_memory_futex_wait(&listener->seq, &listener->sleepers, _purrsock_memory_shm_pending, listener, 0, deadline, NULL, NULL);
+      if (result != PS_SUCCESS) return result;
+    }
+
+    uint64_t id = 0;
+    _purrsock_memory_spin_lock(&listener->lock);
+    if (listener->head != listener->tail) id = listener->pipes[listener->head++ % PS_MEMORY_SHM_BACKLOG];
+    _purrsock_memory_spin_unlock(&listener->lock);
+    if (!id) continue;
+
+    // Once mapped here, the pipe's name is no longer needed; the segment lives until both sides unmap it.
+    char name[PS_MEMORY_SHM_NAME];
+    _purrsock_memory_pipe_t *pipe;
+    _purrsock_memory_shm_pipe_name(name, id);
+    if (_purrsock_shm_map(name, PS_MEMORY_PIPE_SIZE, false, (void **)&pipe) != PS_SUCCESS) continue;
+    _purrsock_shm_unlink(name);
+
+    _purrsock_memory_socket_t *peer = (_purrsock_memory_socket_t *)calloc(1, sizeof(*peer));
+    if (!peer) {
+      _purrsock_memory_release_pipe(pipe, 1);
+      return PS_ERROR_INTERNAL;
+    }
+    __atomic_store_n(&pipe->pids[1], _purrsock_process_id(), __ATOMIC_RELAXED);
+    peer->pipe = pipe;
+    peer->side = 1;
+    peer->shared = true;
+    peer->local = memory->local;
+    peer->remote.family = memory->local.family;
+    *accepted = peer;
+    return PS_SUCCESS;
+  }
+}
+
+static ps_result_t _purrsock_memory_shm_connect(_purrsock_memory_socket_t *memory, const ps_endpoint_t *remote) {
+  // Like the kernel, fall back to a listener on the wildcard address.
+  _purrsock_memory_shm_listener_t *listener;
+  ps_endpoint_t any = *remote;
+  memset(any.addr, 0, sizeof(any.addr));
+  if (_purrsock_memory_shm_open_listener(remote, &listener) != PS_SUCCESS &&
+      _purrsock_memory_shm_open_listener(&any, &listener) != PS_SUCCESS) {
+    return PS_ERROR_CONNREFUSED;
+  }
+  if (!_purrsock_process_alive(listener->pid)) {
+    _purrsock_shm_unmap(listener, sizeof(*listener));
+    return PS_ERROR_CONNREFUSED;
+  }
+
+  char name[PS_MEMORY_SHM_NAME];
+  uint64_t id = (uint64_t)_purrsock_process_id() << 32 | __atomic_add_fetch(&s_next_pipe, 1, __ATOMIC_RELAXED);
+  _purrsock_memory_pipe_t *pipe;
+  _purrsock_memory_shm_pipe_name(name, id);
+  ps_result_t result = _purrsock_shm_map(name, PS_MEMORY_PIPE_SIZE, true, (void **)&pipe);
+  if (result != PS_SUCCESS) {
+    _purrsock_shm_unmap(listener, sizeof(*listener));
+    return result == PS_ERROR_ADDRINUSE ? PS_ERROR_INTERNAL : result;
+  }
+  // The segment starts out zeroed. Until accepted, the listener's process stands in for the other side.
+  pipe->shared = true;
+  pipe->pids[0] = _purrsock_process_id();
+  pipe->pids[1] = listener->pid;
+
+  _purrsock_memory_spin_lock(&listener->lock);
+  bool queued = listener->listening && listener->tail - listener->head < listener->backlog;
+  if (queued) {
+    listener->pipes[listener->tail % PS_MEMORY_SHM_BACKLOG] = id;
+    __atomic_store_n(&listener->tail, listener->tail + 1, __ATOMIC_SEQ_CST);
+  }
+  _purrsock_memory_spin_unlock(&listener->lock);
+  if (queued) _purrsock_memory_futex_notify(&listener->seq, &listener->sleepers);
+  _purrsock_shm_unmap(listener, sizeof(*listener));
+
+  if (!queued) {
+    _purrsock_shm_unlink(name);
+    _purrsock_shm_unmap(pipe, PS_MEMORY_PIPE_SIZE);
+    return PS_ERROR_CONNREFUSED;
+  }
+  memory->pipe = pipe;
+  memory->pipe_id = id;
+  memory->side = 0;
+  memory->remote = *remote;
+  memory->local.family = remote->family;
+  memcpy(memory->local.addr, remote->addr, sizeof(remote->addr));
+  return PS_SUCCESS;
+}
+
+// Sockets
+
+ps_result_t _purrsock_memory_create(_purrsock_socket_t *socket) {
+  assert(socket);
+  _purrsock_memory_socket_t *memory = (_purrsock_memory_socket_t *)calloc(1, sizeof(*memory));
+  if (!memory) return PS_ERROR_INTERNAL;
+  // `ps_create_socket` stores the requested `ps_address_t` in `ss_family`.
+  memory->local.family = socket->addr_storage.ss_family == PS_ADDRESS_IPV6 ? PS_ADDRESS_IPV6 : PS_ADDRESS_IPV4;
+  memory->shared = socket->protocol == PS_PROTOCOL_SHM;
+  socket->memory = memory;
+  return PS_SUCCESS;
+}
+
+void _purrsock_memory_destroy(_purrsock_socket_t *socket) {
+  assert(socket);
+  _purrsock_memory_socket_t *memory = socket->memory;
+  if (!memory) return;
+
+  _purrsock_memory_listener_t *listener = memory->listener;
+  if (listener) {
+    _purrsock_memory_registry_lock();
+    for (_purrsock_memory_listener_t **link = &s_listeners; *link; link = &(*link)->next) {
+      if (*link == listener) {
+        *link = listener->next;
+        break;
+      }
+    }
+    _purrsock_memory_registry_unlock();
+
+    // Connections nobody accepted see the peer hang up.
+    while (listener->queue) {
+      _purrsock_memory_socket_t *pending = listener->queue;
+      listener->queue = pending->next;
+      _purrsock_memory_release_pipe(pending->pipe, pending->side);
+      free(pending);
+    }
+    _purrsock_cond_destroy(&listener->cond);
+    _purrsock_mutex_destroy(&listener->lock);
+    free(listener);
+  }
+  if (memory->shm_listener) _purrsock_memory_shm_destroy_listener(memory->shm_listener, &memory->local);
+
+  // A pipe nobody accepted yet would otherwise keep its name.
+  if (memory->pipe_id) {
+    char name[PS_MEMORY_SHM_NAME];
+    _purrsock_memory_shm_pipe_name(name, memory->pipe_id);
+    _purrsock_shm_unlink(name);
+  }
+  if (memory->pipe) _purrsock_memory_release_pipe(memory->pipe, memory->side);
+  free(memory);
+  socket->memory = NULL;
+}
+
+ps_result_t _purrsock_memory_bind(_purrsock_socket_t *socket, const char *ip, ps_port_t port) {
+  assert(socket && socket->memory);
+  _purrsock_memory_socket_t *memory = socket->memory;
+  if (memory->listener || memory->shm_listener || memory->pipe) return PS_ERROR_INVALID_ARGUMENT;
+
+  ps_endpoint_t endpoint;
+  if (_purrsock_endpoint_from_addr(&endpoint, ip, port) != PS_SUCCESS) return PS_ERROR_ADDRNOTAVAIL;
+  if (memory->shared) return _purrsock_memory_shm_bind(memory, endpoint);
+
+  _purrsock_memory_listener_t *listener = (_purrsock_memory_listener_t *)calloc(1, sizeof(*listener));
+  if (!listener) return PS_ERROR_INTERNAL;
+
+  _purrsock_memory_registry_lock();
+  if (!endpoint.port) endpoint.port = _purrsock_memory_ephemeral_port(&endpoint);
+  if (!endpoint.port || _purrsock_memory_find(&endpoint, true)) {
+    _purrsock_memory_registry_unlock();
+    free(listener);
+    return PS_ERROR_ADDRINUSE;
+  }
+  listener->endpoint = endpoint;
+  listener->next = s_listeners;
+  s_listeners = listener;
+  _purrsock_mutex_init(&listener->lock);
+  _purrsock_cond_init(&listener->cond);
+  _purrsock_memory_registry_unlock();
+
+  memory->listener = listener;
+  memory->local = endpoint;
+  return PS_SUCCESS;
+}
+
+ps_result_t _purrsock_memory_listen(_purrsock_socket_t *socket, int backlog) {
+  assert(socket && socket->memory);
+  _purrsock_memory_shm_listener_t *shm_listener = socket->memory->shm_listener;
+  if (shm_listener) {
+    _purrsock_memory_spin_lock(&shm_listener->lock);
+    shm_listener->backlog = backlog > 0 && backlog < PS_MEMORY_SHM_BACKLOG ? (uint32_t)backlog : PS_MEMORY_SHM_BACKLOG;
+    shm_listener->listening = true;
+    _purrsock_memory_spin_unlock(&shm_listener->lock);
+    return PS_SUCCESS;
+  }
+  _purrsock_memory_listener_t *listener = socket->memory->listener;
+  if (!listener) return PS_ERROR_INVALID_ARGUMENT;
+
+  _purrsock_mutex_lock(&listener->lock);
+  listener->backlog = backlog > 0 ? (size_t)backlog : PS_MEMORY_DEFAULT_BACKLOG;
+  listener->listening = true;
+  _purrsock_mutex_unlock(&listener->lock);
+  return PS_SUCCESS;
+}
+
+ps_result_t _purrsock_memory_accept(_purrsock_socket_t *socket, _purrsock_socket_t **client) {
+  assert(socket && socket->memory && client);
+  _purrsock_memory_socket_t *memory = socket->memory;
+  if (memory->shm_listener) {
+    if (!memory->shm_listener->listening) return PS_ERROR_INVALID_ARGUMENT;
+    _purrsock_socket_t *new_client = (_purrsock_socket_t *)calloc(1, sizeof(*new_client));
+    if (!new_client) return PS_ERROR_INTERNAL;
+    ps_result_t result = _purrsock_memory_shm_accept(memory, socket->timeouts.read_ms, &new_client->memory);
+    if (result != PS_SUCCESS) {
+      free(new_client);
+      return result;
+    }
+    new_client->protocol = PS_PROTOCOL_SHM;
+    *client = new_client;
+    return PS_SUCCESS;
+  }
+  _purrsock_memory_listener_t *listener = memory->listener;
+  if (!listener || !listener->listening) return PS_ERROR_INVALID_ARGUMENT;
+
+  _purrsock_socket_t *new_client = (_purrsock_socket_t *)calloc(1, sizeof(*new_client));
+  if (!new_client) return PS_ERROR_INTERNAL;
+
+  ps_result_t result = PS_SUCCESS;
+  uint32_t timeout_ms = socket->timeouts.read_ms;
+  uint64_t deadline = timeout_ms ? _purrsock_monotonic_ms() + timeout_ms : 0;
+  _purrsock_mutex_lock(&listener->lock);
+  while (!listener->queue && result == PS_SUCCESS) {
+    if (memory->nonblocking) {
+      result = PS_ERROR_WOULDBLOCK;
+    } else if (!deadline) {
+      _purrsock_cond_wait(&listener->cond, &listener->lock);
+    } else {
+      uint64_t now = _purrsock_monotonic_ms();
+      if (now >= deadline) {
+        result = PS_ERROR_TIMEOUT;
+      } else {
+        _purrsock_cond_timed_wait(&listener->cond, &listener->lock, (uint32_t)(deadline - now));
+      }
+    }
+  }
+  _purrsock_memory_socket_t *accepted = NULL;
+  if (result == PS_SUCCESS) {
+    accepted = listener->queue;
+    listener->queue = accepted->next;
+    if (!listener->queue) listener->queue_tail = NULL;
+    listener->queued--;
+    accepted->next = NULL;
+  }
+  _purrsock_mutex_unlock(&listener->lock);
+
+  if (result != PS_SUCCESS) {
+    free(new_client);
+    return result;
+  }
+  new_client->protocol = PS_PROTOCOL_MEMORY;
+  new_client->memory = accepted;
+  *client = new_client;
+  return PS_SUCCESS;
+}
+
+ps_result_t _purrsock_memory_connect(_purrsock_socket_t *socket, const char *ip, ps_port_t port) {
+  assert(socket && socket->memory);
+  _purrsock_memory_socket_t *memory = socket->memory;
+  if (memory->pipe || (memory->listener && memory->listener->listening) || memory->shm_listener) return PS_ERROR_INVALID_ARGUMENT;
+
+  ps_endpoint_t remote;
+  if (_purrsock_endpoint_from_addr(&remote, ip, port) != PS_SUCCESS) return PS_ERROR_ADDRNOTAVAIL;
+  if (memory->shared) return _purrsock_memory_shm_connect(memory, &remote);
+
+  _purrsock_memory_pipe_t *pipe = _purrsock_memory_create_pipe();
+  _purrsock_memory_socket_t *peer = (_purrsock_memory_socket_t *)calloc(1, sizeof(*peer));
+  if (!pipe || !peer) {
+    if (pipe) _purrsock_memory_discard_pipe(pipe);
+    free(peer);
+    return PS_ERROR_INTERNAL;
+  }
+
+  ps_result_t result = PS_SUCCESS;
+  _purrsock_memory_registry_lock();
+  if (!memory->listener) {
+    memory->local = remote;
+    memory->local.port = _purrsock_memory_ephemeral_port(&remote);
+  }
+  // Holding the registry lock keeps the listener from being destroyed under us.
+  _purrsock_memory_listener_t *listener = _purrsock_memory_find(&remote, false);
+  if (!listener) {
+    result = PS_ERROR_CONNREFUSED;
+  } else {
+    _purrsock_mutex_lock(&listener->lock);
+    // Like a Unix domain socket, a full backlog refuses instead of leaving the connect hanging.
+    if (!listener->listening || listener->queued >= listener->backlog) {
+      result = PS_ERROR_CONNREFUSED;
+    } else {
+      peer->pipe = pipe;
+      peer->side = 1;
+      peer->local = remote;
+      peer->remote = memory->local;
+      if (listener->queue_tail) {
+        listener->queue_tail->next = peer;
+      } else {
+        listener->queue = peer;
+      }
+      listener->queue_tail = peer;
+      listener->queued++;
+      _purrsock_cond_signal(&listener->cond);
+    }
+    _purrsock_mutex_unlock(&listener->lock);
+  }
+  _purrsock_memory_registry_unlock();
+
+  if (result != PS_SUCCESS) {
+    _purrsock_memory_discard_pipe(pipe);
+    free(peer);
+    return result;
+  }
+  memory->pipe = pipe;
+  memory->side = 0;
+  memory->remote = remote;
+  return PS_SUCCESS;
+}
+
+ps_result_t _purrsock_memory_get_endpoint(_purrsock_socket_t *socket, ps_endpoint_t *endpoint) {
+  assert(socket && socket->memory && endpoint);
+  *endpoint = socket->memory->local;
+  return PS_SUCCESS;
+}
+
+ps_result_t _purrsock_memory_set_blocking(_purrsock_socket_t *socket, bool blocking) {
+  assert(socket && socket->memory);
+  socket->memory->nonblocking = !blocking;
+  return PS_SUCCESS;
+}
+
+ps_result_t _purrsock_memory_recvv(_purrsock_socket_t *socket, ps_packet_t *slices, size_t count, size_t *received) {
+  assert(socket && socket->memory && slices && received);
+  _purrsock_memory_socket_t *memory = socket->memory;
+  _purrsock_memory_pipe_t *pipe = memory->pipe;
+  if (!pipe) return PS_ERROR_NOTINIT;
+
+  ps_result_t result = _purrsock_memory_wait(memory, _purrsock_memory_can_read, memory->nonblocking, socket->timeouts.read_ms);
+  if (result != PS_SUCCESS) return result;
+  size_t available = _purrsock_memory_readable(pipe, memory->side);
+  if (!available) return PS_CONNCLOSED;
+
+  // Like a stream socket, hand out whatever arrived, in slice order.
+  _purrsock_memory_ring_t *ring = &pipe->rings[!memory->side];
+  char *buf = _purrsock_memory_ring_buf(pipe, !memory->side);
+  uint64_t head = ring->head;
+  size_t total = 0;
+  for (size_t i = 0; i < count; ++i) {
+    size_t length = available - total < slices[i].capacity ? available - total : slices[i].capacity;
+    size_t offset = (size_t)(head + total) & (PS_MEMORY_RING_CAPACITY - 1);
+    size_t first = length < PS_MEMORY_RING_CAPACITY - offset ? length : PS_MEMORY_RING_CAPACITY - offset;
+    memcpy(slices[i].buf, buf + offset, first);
+    memcpy(slices[i].buf + first, buf, length - first);
+    slices[i].size = length;
+    total += length;
+  }
+  __atomic_store_n(&ring->head, head + total, __ATOMIC_SEQ_CST);
+  _purrsock_memory_notify(pipe);
+  PS_STATS_TRANSFER(socket, false, total, 1);
+
+  *received = total;
+  return PS_SUCCESS;
+}
+
+ps_result_t _purrsock_memory_sendv(_purrsock_socket_t *socket, const ps_packet_t *slices, size_t count, size_t *sent) {
+  assert(socket && socket->memory && slices && sent);
+  *sent = 0;
+  _purrsock_memory_socket_t *memory = socket->memory;
+  _purrsock_memory_pipe_t *pipe = memory->pipe;
+  if (!pipe) return PS_ERROR_NOTINIT;
+
+  _purrsock_memory_ring_t *ring = &pipe->rings[memory->side];
+  char *buf = _purrsock_memory_ring_buf(pipe, memory->side);
+  for (size_t i = 0; i < count; ++i) {
+    size_t done = 0;
+    while (done < slices[i].size) {
+      if (_purrsock_memory_peer_closed(pipe, memory->side)) return PS_ERROR_CONNRESET;
+      size_t space = _purrsock_memory_writable(pipe, memory->side);
+      if (!space) {
+        // Like the kernel transports, a full non-blocking socket stops here and reports how far it got.
+        ps_result_t result = _purrsock_memory_wait(memory, _purrsock_memory_can_write, memory->nonblocking, socket->timeouts.write_ms);
+        if (result != PS_SUCCESS) return result;
+        continue;
+      }
+
+      size_t length = slices[i].size - done < space ? slices[i].size - done : space;
+      size_t offset = (size_t)ring->tail & (PS_MEMORY_RING_CAPACITY - 1);
+      size_t first = length < PS_MEMORY_RING_CAPACITY - offset ? length : PS_MEMORY_RING_CAPACITY - offset;
+      memcpy(buf + offset, slices[i].buf + done, first);
+      memcpy(buf, slices[i].buf + done + first, length - first);
+      __atomic_store_n(&ring->tail, ring->tail + length, __ATOMIC_SEQ_CST);
+      _purrsock_memory_notify(pipe);
+      PS_STATS_TRANSFER(socket, true, length, *sent == 0);
+      done += length;
+      *sent += length;
+    }
+  }
+  return PS_SUCCESS;
+}
+
+ps_result_t _purrsock_memory_read(_purrsock_socket_t *socket, ps_packet_t *packet) {
+  size_t received;
+  return _purrsock_memory_recvv(socket, packet, 1, &received);
+}
+
+bool _purrsock_memory_is_idle_alive(_purrsock_socket_t *socket) {
+  _purrsock_memory_socket_t *memory = socket->memory;
+  return memory->pipe && !_purrsock_memory_peer_closed(memory->pipe, memory->side) && !_purrsock_memory_readable(memory->pipe, memory->side);
+}
@@ -0,0 +1,319 @@
+// Copyright (c) 2024 ClawsoftSolutions. All rights reserved.
+//
+// This software is licensed under the MIT License.
+// See LICENSE file for more information.
+//
+
+
+
+#include "internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define PS_POOL_CLASSES 5
+#define PS_POOL_CLASS_LARGE UINT32_MAX
+#define PS_POOL_SLAB_SIZE (256 * 1024)
+#define PS_POOL_CACHE_SLOTS 4      // Pools a thread caches chunks for at the same time.
+#define PS_POOL_CACHE_LIMIT 64     // Chunks per size class kept in a thread cache before spilling.
+#define PS_POOL_CACHE_BATCH 16     // Chunks moved between the pool and a thread cache at once.
+#define PS_POOL_MAX_POOLS 64       // Pools alive at the same time, the default one included.
+
+static const size_t s_class_sizes[PS_POOL_CLASSES] = { 256, 1024, 4096, 16384, 65536 };
+
+typedef struct _purrsock_chunk_s _purrsock_chunk_t;
+
+// Header in front of every buffer handed out, so a packet can be released without naming its pool.
+struct _purrsock_chunk_s {
+  union {
+    struct {
+      _purrsock_packet_pool_t *pool;
+      _purrsock_chunk_t *next;      // Free list link.
+      uint32_t size_class;
+    };
+    max_align_t align;
+  };
+};
+
+typedef struct _purrsock_slab_s {
+  struct _purrsock_slab_s *next;
+} _purrsock_slab_t;
+
+struct _purrsock_packet_pool_s {
+  uint64_t id;
+  _purrsock_mutex_t lock;
+  _purrsock_chunk_t *free[PS_POOL_CLASSES];
+  _purrsock_slab_t *slabs;
+  ps_packet_pool_stats_t stats;
+};
+
+typedef struct {
+  uint64_t pool_id;                 // 0 for an empty slot.
+  _purrsock_packet_pool_t *pool;
+  _purrsock_chunk_t *free[PS_POOL_CLASSES];
+  uint32_t count[PS_POOL_CLASSES];
+} _purrsock_pool_cache_t;
+
+static PS_THREAD_LOCAL _purrsock_pool_cache_t s_caches[PS_POOL_CACHE_SLOTS];
+static PS_THREAD_LOCAL bool s_caches_registered = false;
+
+// Live pools, consulted when a thread cache slot is reused so chunks of destroyed pools are dropped untouched.
+static _purrsock_mutex_t s_registry_lock;
+static _purrsock_packet_pool_t *s_registry[PS_POOL_MAX_POOLS];
+static size_t s_registry_count = 0;
+static uint64_t s_next_pool_id = 1;
+static uint32_t s_registry_state = 0; // 0 before the lock is initialized, 1 while it is, 2 after.
+
+static _purrsock_packet_pool_t *s_default_pool = NULL;
+
+static uint32_t _purrsock_pool_class(size_t size) {
+  for (uint32_t size_class = 0; size_class < PS_POOL_CLASSES; ++size_class) {
+    if (size <= s_class_sizes[size_class]) return size_class;
+  }
+  return PS_POOL_CLASS_LARGE;
+}
+
+static char *_purrsock_chunk_buf(_purrsock_chunk_t *chunk) {
+  return (char *)(chunk + 1);
+}
+
+static _purrsock_chunk_t *_purrsock_buf_chunk(char *buf) {
+  return (_purrsock_chunk_t *)buf - 1;
+}
+
+// Must be called with the pool locked.
+static bool _purrsock_pool_grow(_purrsock_packet_pool_t *pool, uint32_t size_class) {
+  size_t stride = sizeof(_purrsock_chunk_t) + s_class_sizes[size_class];
+  size_t count = (PS_POOL_SLAB_SIZE - sizeof(_purrsock_chunk_t)) / stride;
+  if (count < PS_POOL_CACHE_BATCH) count = PS_POOL_CACHE_BATCH;
+
+  // The slab link sits in a chunk-sized header so every chunk stays max_align_t aligned.
+  char *slab = (char *)malloc(sizeof(_purrsock_chunk_t) + count * stride);
+  if (!slab) return false;
+  ((_purrsock_slab_t *)slab)->next = pool->slabs;
+  pool->slabs = (_purrsock_slab_t *)slab;
+
+  char *base = slab + sizeof(_purrsock_chunk_t);
+  for (size_t i = 0; i < count; ++i) {
+    _purrsock_chunk_t *chunk = (_purrsock_chunk_t *)(base + i * stride);
+    chunk->pool = pool;
+    chunk->size_class = size_class;
+    chunk->next = pool->free[size_class];
+    pool->free[size_class] = chunk;
+  }
+  pool->stats.slabs++;
+  pool->stats.bytes_reserved += count * stride;
+  return true;
+}
+
+// Pools may be created from several threads at once, so the first one to get here initializes the lock and the
+// others wait for it.
+static void _purrsock_registry_init() {
+  uint32_t state = 0;
+  if (__atomic_compare_exchange_n(&s_registry_state, &state, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+    _purrsock_mutex_init(&s_registry_lock);
+    __atomic_store_n(&s_registry_state, 2, __ATOMIC_RELEASE);
+    return;
+  }
+  while (__atomic_load_n(&s_registry_state, __ATOMIC_ACQUIRE) != 2) {}
+}
+
+ps_result_t _purrsock_create_packet_pool(_purrsock_packet_pool_t **out_pool) {
+  assert(out_pool);
+  _purrsock_registry_init();
+
+  _purrsock_packet_pool_t *pool = (_purrsock_packet_pool_t *)calloc(1, sizeof(*pool));
+  if (!pool) return PS_ERROR_INTERNAL;
+  _purrsock_mutex_init(&pool->lock);
+
+  _purrsock_mutex_lock(&s_registry_lock);
+  if (s_registry_count == PS_POOL_MAX_POOLS) {
+    _purrsock_mutex_unlock(&s_registry_lock);
+    _purrsock_mutex_destroy(&pool->lock);
+    free(pool);
+    return PS_ERROR_WOULDBLOCK;
+  }
+  pool->id = s_next_pool_id++;
+  s_registry[s_registry_count++] = pool;
+  _purrsock_mutex_unlock(&s_registry_lock);
+
+  *out_pool = pool;
+  return PS_SUCCESS;
+}
+
+void _purrsock_destroy_packet_pool(_purrsock_packet_pool_t *pool) {
+  assert(pool && pool != s_default_pool);
+
+  _purrsock_mutex_lock(&s_registry_lock);
+  for (size_t i = 0; i < s_registry_count; ++i) {
+    if (s_registry[i] == pool) {
+      s_registry[i] = s_registry[--s_registry_count];
+      break;
+    }
+  }
+  _purrsock_mutex_unlock(&s_registry_lock);
+
+  // Only the calling thread's cache can be cleared here; other threads drop theirs lazily by id.
+  for (int slot = 0; slot < PS_POOL_CACHE_SLOTS; ++slot) {
+    if (s_caches[slot].pool_id == pool->id) memset(&s_caches[slot], 0, sizeof(s_caches[slot]));
+  }
+
+  while (pool->slabs) {
+    _purrsock_slab_t *next = pool->slabs->next;
+    free(pool->slabs);
+    pool->slabs = next;
+  }
+  _purrsock_mutex_destroy(&pool->lock);
+  free(pool);
+}
+
+_purrsock_packet_pool_t *_purrsock_default_packet_pool() {
+  return s_default_pool;
+}
+
+bool _purrsock_init_default_packet_pool() {
+  if (s_default_pool) return true;
+  return _purrsock_create_packet_pool(&s_default_pool) == PS_SUCCESS;
+}
+
+// Moves up to `count` chunks of a cache slot back to the pool's free list.
+static void _purrsock_cache_spill(_purrsock_pool_cache_t *cache, uint32_t size_class, uint32_t count) {
+  _purrsock_chunk_t *first = cache->free[size_class];
+  _purrsock_chunk_t *last = first;
+  for (uint32_t i = 1; i < count && last->next; ++i) last = last->next;
+
+  uint32_t moved = 1;
+  for (_purrsock_chunk_t *it = first; it != last; it = it->next) ++moved;
+
+  cache->free[size_class] = last->next;
+  cache->count[size_class] -= moved;
+
+  _purrsock_packet_pool_t *pool = cache->pool;
+  _purrsock_mutex_lock(&pool->lock);
+  last->next = pool->free[size_class];
+  pool->free[size_class] = first;
+  _purrsock_mutex_unlock(&pool->lock);
+}
+
+// Empties a cache slot: chunks go back to their pool if it is still alive, otherwise they are forgotten.
+static void _purrsock_cache_flush(_purrsock_pool_cache_t *cache) {
+  if (!cache->pool_id) return;
+
+  _purrsock_mutex_lock(&s_registry_lock);
+  bool alive = false;
+  for (size_t i = 0; i < s_registry_count; ++i) {
+    if (s_registry[i] == cache->pool && s_registry[i]->id == cache->pool_id) alive = true;
+  }
+  if (alive) {
+    for (uint32_t size_class = 0; size_class < PS_POOL_CLASSES; ++size_class) {
+      if (cache->count[size_class]) _purrsock_cache_spill(cache, size_class, cache->count[size_class]);
+    }
+  }
+  _purrsock_mutex_unlock(&s_registry_lock);
+
+  memset(cache, 0, sizeof(*cache));
+}
+
+static void _purrsock_flush_thread_caches() {
+  for (int slot = 0; slot < PS_POOL_CACHE_SLOTS; ++slot) _purrsock_cache_flush(&s_caches[slot]);
+}
+
+static _purrsock_pool_cache_t *_purrsock_cache_for(_purrsock_packet_pool_t *pool) {
+  _purrsock_pool_cache_t *victim = &s_caches[0];
+  for (int slot = 0; slot < PS_POOL_CACHE_SLOTS; ++slot) {
+    if (s_caches[slot].pool_id == pool->id) return &s_caches[slot];
+    if (!s_caches[slot].pool_id) victim = &s_caches[slot];
+  }
+
+  // Hand cached chunks back when the thread exits, so short-lived threads do not strand them.
+  if (!s_caches_registered) {
+    _purrsock_at_thread_exit(_purrsock_flush_thread_caches);
+    s_caches_registered = true;
+  }
+
+  _purrsock_cache_flush(victim);
+  victim->pool_id = pool->id;
+  victim->pool = pool;
+  return victim;
+}
+
+ps_result_t _purrsock_packet_acquire(_purrsock_packet_pool_t *pool, size_t size, ps_packet_t *packet) {
+  assert(packet);
+  if (!pool) pool = s_default_pool;
+  if (!pool) return PS_ERROR_NOTINIT;
+
+  uint32_t size_class = _purrsock_pool_class(size);
+  if (size_class == PS_POOL_CLASS_LARGE) {
+    _purrsock_chunk_t *chunk = (_purrsock_chunk_t *)malloc(sizeof(*chunk) + size);
+    if (!chunk) return PS_ERROR_INTERNAL;
+    chunk->pool = pool;
+    chunk->size_class = PS_POOL_CLASS_LARGE;
+    packet->buf = _purrsock_chunk_buf(chunk);
+    packet->capacity = size;
+    packet->size = 0;
+    return PS_SUCCESS;
+  }
+
+  _purrsock_pool_cache_t *cache = _purrsock_cache_for(pool);
+  if (!cache->free[size_class]) {
+    _purrsock_mutex_lock(&pool->lock);
+    if (!pool->free[size_class] && !_purrsock_pool_grow(pool, size_class)) {
+      _purrsock_mutex_unlock(&pool->lock);
+      return PS_ERROR_INTERNAL;
+    }
+    for (int i = 0; i < PS_POOL_CACHE_BATCH && pool->free[size_class]; ++i) {
+      _purrsock_chunk_t *chunk = pool->free[size_class];
+      pool->free[size_class] = chunk->next;
+      chunk->next = cache->free[size_class];
+      cache->free[size_class] = chunk;
+      cache->count[size_class]++;
+    }
+    pool->stats.refills++;
+    _purrsock_mutex_unlock(&pool->lock);
+  }
+
+  _purrsock_chunk_t *chunk = cache->free[size_class];
+  cache->free[size_class] = chunk->next;
+  cache->count[size_class]--;
+
+  packet->buf = _purrsock_chunk_buf(chunk);
+  packet->capacity = s_class_sizes[size_class];
+  packet->size = 0;
+  return PS_SUCCESS;
+}
+
+void _purrsock_packet_release(ps_packet_t *packet) {
+  assert(packet);
+  if (!packet->buf) return;
+
+  _purrsock_chunk_t *chunk = _purrsock_buf_chunk(packet->buf);
+  packet->buf = NULL;
+  packet->size = 0;
+  packet->capacity = 0;
+
+  if (chunk->size_class == PS_POOL_CLASS_LARGE) {
+    free(chunk);
+    return;
+  }
+
+  _purrsock_pool_cache_t *cache = _purrsock_cache_for(chunk->pool);
+  chunk->next = cache->free[chunk->size_class];
+  cache->free[chunk->size_class] = chunk;
+  if (++cache->count[chunk->size_class] > PS_POOL_CACHE_LIMIT) {
+    _purrsock_cache_spill(cache, chunk->size_class, PS_POOL_CACHE_LIMIT / 2);
+  }
+}
+
+void _purrsock_get_packet_pool_stats(_purrsock_packet_pool_t *pool, ps_packet_pool_stats_t *stats) {
+  assert(stats);
+  if (!pool) pool = s_default_pool;
+  if (!pool) {
+    memset(stats, 0, sizeof(*stats));
+    return;
+  }
+
+  _purrsock_mutex_lock(&pool->lock);
+  *stats = pool->stats;
+  _purrsock_mutex_unlock(&pool->lock);
+}
@@ -9,6 +9,7 @@
 #include "internal.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 const char *ps_result_to_cstr(ps_result_t result) {
@@ -26,6 +27,17 @@ const char *ps_result_to_cstr(ps_result_t result) {
   case PS_ERROR_CONNREFUSED:  return "Error conn refused";
   case PS_ERROR_HOSTDOWN:     return "Error host down";
   case PS_ERROR_SHUTDOWN:     return "Error shut down";
+  case PS_ERROR_TIMEOUT:      return "Error timeout";
+  case PS_ERROR_INVALID_ARGUMENT:     return "Error invalid argument";
+  case PS_ERROR_IPV6_ADDR_PARSE:      return "Error IPv6 addr parse";
+  case PS_ERROR_IPV6_ADDR_INVALID:    return "Error IPv6 addr invalid";
+  case PS_ERROR_IPV6_CONNECT_FAILED:  return "Error IPv6 connect failed";
+  case PS_ERROR_IPV6_SOCKET_CREATION: return "Error IPv6 socket creation";
+  case PS_ERROR_IPV6_SOCKET_BINDING:  return "Error IPv6 socket binding";
+  case PS_ERROR_IPV6_SOCKET_CLOSED:   return "Error IPv6 socket closed";
+  case PS_ERROR_WOULDBLOCK:   return "Error would block";
+  case PS_ERROR_UNSUPPORTED:  return "Error unsupported";
+  case PS_ERROR_PROTOCOL:     return "Error protocol";
   case PS_ERROR_UNKNOWN:      return "Unknown error";
 
   }
@@ -33,6 +45,10 @@ const char *ps_result_to_cstr(ps_result_t result) {
   return NULL;
 }
 
+bool _purrsock_is_datagram(ps_protocol_t protocol) {
+  return protocol == PS_PROTOCOL_UDP || protocol == PS_PROTOCOL_UNIX_DGRAM;
+}
+
 const char* get_platform() {
   #ifdef PLATFORM_WINDOWS
       return "Windows";
@@ -44,7 +60,8 @@ const char* get_platform() {
 }
 
 bool ps_init() {
-  return _purrsock_init();
+  _purrsock_scan_init();
+  return _purrsock_init() && _purrsock_init_default_packet_pool();
 }
 
 void ps_cleanup() {
@@ -53,7 +70,7 @@ void ps_cleanup() {
 
 ps_result_t ps_create_socket(ps_socket_t *socket, ps_protocol_t protocol, ps_address_t address) {
   assert(socket);
-  _purrsock_socket_t *internal_socket = (_purrsock_socket_t*)malloc(sizeof(*internal_socket));
+  _purrsock_socket_t *internal_socket = (_purrsock_socket_t*)calloc(1, sizeof(*internal_socket));
   assert(internal_socket);
   internal_socket->protocol = protocol;
   internal_socket->addr_storage.ss_family = address;
@@ -64,7 +81,7 @@ ps_result_t ps_create_socket(ps_socket_t *socket, ps_protocol_t protocol, ps_add
 
 ps_result_t ps_create_socket_from_addr(ps_socket_t *socket, ps_protocol_t protocol, ps_address_t address, const char *ip, ps_port_t port) {
   assert(socket);
-  _purrsock_socket_t *internal_socket = (_purrsock_socket_t*)malloc(sizeof(*internal_socket));
+  _purrsock_socket_t *internal_socket = (_purrsock_socket_t*)calloc(1, sizeof(*internal_socket));
   assert(internal_socket);
   internal_socket->protocol = protocol;
   internal_socket->addr_storage.ss_family = address;
@@ -75,7 +92,9 @@ ps_result_t ps_create_socket_from_addr(ps_socket_t *socket, ps_protocol_t protoc
 
 void ps_destroy_socket(ps_socket_t socket) {
   assert(socket);
-  _purrsock_destroy_socket((_purrsock_socket_t*)socket);
+  _purrsock_socket_t *internal_socket = (_purrsock_socket_t*)socket;
+  if (internal_socket->loop) _purrsock_loop_remove_socket(internal_socket->loop, internal_socket);
+  _purrsock_destroy_socket(internal_socket);
   free(socket);
 }
 
@@ -84,7 +103,15 @@ ps_result_t ps_bind_socket(ps_socket_t socket, const char *ip, ps_port_t port) {
 }
 
 ps_result_t ps_listen_socket(ps_socket_t socket) {
-  return _purrsock_listen_socket((_purrsock_socket_t*)socket);
+  return _purrsock_listen_socket((_purrsock_socket_t*)socket, 0);
+}
+
+ps_result_t ps_listen_socket_backlog(ps_socket_t socket, int backlog) {
+  return _purrsock_listen_socket((_purrsock_socket_t*)socket, backlog);
+}
+
+ps_result_t ps_set_socket_reuseport(ps_socket_t socket, bool enabled) {
+  return _purrsock_set_socket_reuseport((_purrsock_socket_t*)socket, enabled);
 }
 
 ps_result_t ps_accept_socket(ps_socket_t socket, ps_socket_t *client) {
@@ -95,10 +122,780 @@ ps_result_t ps_connect_socket(ps_socket_t socket, const char *ip, ps_port_t port
   return _purrsock_connect_socket((_purrsock_socket_t*)socket, ip, port);
 }
 
+// Without a caller buffer, reads go into a pooled one big enough for a whole datagram.
+static ps_result_t _purrsock_prepare_read(_purrsock_socket_t *socket, ps_packet_t *packet, bool *pooled) {
+  *pooled = !packet->buf;
+  if (*pooled) {
+    size_t size = _purrsock_is_datagram(socket->protocol) ? PS_PACKET_DATAGRAM_CAPACITY : PS_PACKET_STREAM_CAPACITY;
+    return _purrsock_packet_acquire(NULL, size, packet);
+  }
+  return packet->capacity ? PS_SUCCESS : PS_ERROR_INVALID_ARGUMENT;
+}
+
 ps_result_t ps_read_socket_packet(ps_socket_t socket, ps_packet_t *packet, ps_socket_t *from) {
-  return _purrsock_read_socket_packet((_purrsock_socket_t*)socket, packet, (_purrsock_socket_t**)from);
+  assert(socket && packet);
+  _purrsock_socket_t *internal_socket = (_purrsock_socket_t*)socket;
+
+  bool pooled;
+  ps_result_t result = _purrsock_prepare_read(internal_socket, packet, &pooled);
+  if (result != PS_SUCCESS) return result;
+
+  result = _purrsock_read_socket_packet(internal_socket, packet, (_purrsock_socket_t**)from);
+  if (pooled && result != PS_SUCCESS && result != PS_ERROR_MSGTOOLONG) {
+    _purrsock_packet_release(packet);
+  }
+  return result;
 }
 
 ps_result_t ps_send_socket_packet(ps_socket_t socket, ps_packet_t packet, ps_socket_t to) {
   return _purrsock_send_socket_packet((_purrsock_socket_t*)socket, packet, (_purrsock_socket_t*)to);
-}
\ No newline at end of file
+}
+
+char *_purrsock_reserve_unsent(_purrsock_socket_t *socket, size_t size) {
+  if (socket->unsent_offset && socket->unsent_offset == socket->unsent_size) socket->unsent_offset = socket->unsent_size = 0;
+  size_t required = socket->unsent_size + size;
+  if (required > socket->unsent_capacity) {
+    size_t capacity = socket->unsent_capacity ? socket->unsent_capacity : PS_PACKET_STREAM_CAPACITY;
+    while (capacity < required) capacity *= 2;
+    char *unsent = (char *)realloc(socket->unsent, capacity);
+    if (!unsent) return NULL;
+    socket->unsent = unsent;
+    socket->unsent_capacity = capacity;
+  }
+  char *reserved = socket->unsent + socket->unsent_size;
+  socket->unsent_size = required;
+  return reserved;
+}
+
+ps_result_t _purrsock_flush_socket(_purrsock_socket_t *socket) {
+  if (socket->unsent_offset == socket->unsent_size) return PS_SUCCESS;
+  size_t size = socket->unsent_size - socket->unsent_offset;
+  ps_packet_t rest = { size, socket->unsent + socket->unsent_offset, size };
+  size_t sent = 0;
+  ps_result_t result = _purrsock_send_stream_partial(socket, &rest, 1, &sent);
+  socket->unsent_offset += sent;
+  if (socket->unsent_offset == socket->unsent_size) socket->unsent_offset = socket->unsent_size = 0;
+  return result;
+}
+
+ps_result_t _purrsock_send_stream(_purrsock_socket_t *socket, const ps_packet_t *slices, size_t count) {
+  ps_result_t result = _purrsock_flush_socket(socket);
+  if (result != PS_SUCCESS) return result;
+
+  size_t sent = 0;
+  result = _purrsock_send_stream_partial(socket, slices, count, &sent);
+  if (result != PS_ERROR_WOULDBLOCK || !sent) return result;
+
+  // Part of the message is out, so it must be finished; keep the rest rather than wait for room.
+  size_t skip = sent, total = 0;
+  for (size_t i = 0; i < count; ++i) total += slices[i].size;
+  char *unsent = _purrsock_reserve_unsent(socket, total - sent);
+  if (!unsent) return PS_ERROR_INTERNAL;
+  for (size_t i = 0; i < count; ++i) {
+    if (skip >= slices[i].size) {
+      skip -= slices[i].size;
+      continue;
+    }
+    memcpy(unsent, slices[i].buf + skip, slices[i].size - skip);
+    unsent += slices[i].size - skip;
+    skip = 0;
+  }
+  return PS_SUCCESS;
+}
+
+ps_result_t ps_flush_socket(ps_socket_t socket) {
+  assert(socket);
+  return _purrsock_flush_socket((_purrsock_socket_t*)socket);
+}
+
+size_t ps_get_socket_unsent(ps_socket_t socket) {
+  assert(socket);
+  _purrsock_socket_t *internal_socket = (_purrsock_socket_t*)socket;
+  return internal_socket->unsent_size - internal_socket->unsent_offset;
+}
+
+ps_result_t ps_set_socket_zerocopy(ps_socket_t socket, bool enabled) {
+  assert(socket);
+  return _purrsock_set_socket_zerocopy((_purrsock_socket_t*)socket, enabled);
+}
+
+ps_result_t ps_send_socket_packet_zerocopy(ps_socket_t socket, ps_packet_t packet, ps_zerocopy_completion_t callback, void *user_data) {
+  assert(socket && packet.buf);
+  return _purrsock_send_socket_packet_zerocopy((_purrsock_socket_t*)socket, packet, callback, user_data);
+}
+
+ps_result_t ps_process_zerocopy_completions(ps_socket_t socket, size_t *completed) {
+  assert(socket);
+  size_t ignored;
+  return _purrsock_process_zerocopy_completions((_purrsock_socket_t*)socket, completed ? completed : &ignored);
+}
+
+ps_result_t ps_send_file(ps_socket_t socket, int fd, uint64_t offset, uint64_t length, uint64_t *sent) {
+  assert(socket);
+  uint64_t ignored;
+  return _purrsock_send_file((_purrsock_socket_t*)socket, fd, offset, length, sent ? sent : &ignored);
+}
+
+ps_result_t ps_send_file_path(ps_socket_t socket, const char *path, uint64_t offset, uint64_t length, uint64_t *sent) {
+  assert(socket && path);
+  int fd = _purrsock_open_file(path);
+  if (fd < 0) return PS_ERROR_INVALID_ARGUMENT;
+  ps_result_t result = ps_send_file(socket, fd, offset, length, sent);
+  _purrsock_close_file(fd);
+  return result;
+}
+
+ps_result_t ps_splice(ps_socket_t from, ps_socket_t to, size_t length, size_t *moved) {
+  assert(from && to && moved);
+  *moved = 0;
+  if (!length) return PS_ERROR_INVALID_ARGUMENT;
+  _purrsock_socket_t *source = (_purrsock_socket_t*)from;
+  _purrsock_socket_t *destination = (_purrsock_socket_t*)to;
+  if (_purrsock_is_datagram(source->protocol) || _purrsock_is_datagram(destination->protocol)) return PS_ERROR_INVALID_ARGUMENT;
+
+  ps_result_t result = _purrsock_splice(source, destination, length, moved);
+  if (result != PS_ERROR_UNSUPPORTED) return result;
+
+  // No kernel splicing: copy through a pooled buffer instead, under the same rules as the kernel path.
+  // Kept bytes go first and nothing is read while `to` is full; whatever does not fit is kept.
+  result = _purrsock_flush_socket(destination);
+  if (result != PS_SUCCESS) return result;
+
+  ps_packet_t packet = {0};
+  result = _purrsock_packet_acquire(NULL, length < PS_PACKET_DATAGRAM_CAPACITY ? length : PS_PACKET_DATAGRAM_CAPACITY, &packet);
+  if (result != PS_SUCCESS) return result;
+  if (packet.capacity > length) packet.capacity = length;
+
+  result = _purrsock_read_socket_packet(source, &packet, NULL);
+  if (result == PS_SUCCESS) {
+    size_t sent = 0;
+    result = _purrsock_send_stream_partial(destination, &packet, 1, &sent);
+    // The bytes are already out of `from`, so a send cut short by a full socket or its timeout keeps them.
+    if (result == PS_ERROR_WOULDBLOCK || result == PS_ERROR_TIMEOUT) {
+      char *unsent = _purrsock_reserve_unsent(destination, packet.size - sent);
+      if (unsent) {
+        memcpy(unsent, packet.buf + sent, packet.size - sent);
+        sent = packet.size;
+      } else {
+        result = PS_ERROR_INTERNAL;
+      }
+    }
+    *moved = sent;
+  }
+  _purrsock_packet_release(&packet);
+  return result;
+}
+
+ps_result_t ps_send_socket_fds(ps_socket_t socket, ps_packet_t packet, const int *fds, size_t count) {
+  assert(socket && packet.buf && (fds || !count));
+  return _purrsock_send_socket_fds((_purrsock_socket_t*)socket, packet, fds, count);
+}
+
+ps_result_t ps_read_socket_fds(ps_socket_t socket, ps_packet_t *packet, int *fds, size_t capacity, size_t *count) {
+  assert(socket && packet && packet->buf && (fds || !capacity) && count);
+  return _purrsock_read_socket_fds((_purrsock_socket_t*)socket, packet, fds, capacity, count);
+}
+
+ps_result_t ps_pass_socket(ps_socket_t channel, ps_socket_t socket) {
+  assert(channel && socket);
+  return _purrsock_pass_socket((_purrsock_socket_t*)channel, (_purrsock_socket_t*)socket);
+}
+
+ps_result_t ps_accept_passed_socket(ps_socket_t channel, ps_socket_t *socket) {
+  assert(channel && socket);
+  return _purrsock_accept_passed_socket((_purrsock_socket_t*)channel, (_purrsock_socket_t**)socket);
+}
+
+ps_result_t ps_endpoint_from_addr(ps_endpoint_t *endpoint, const char *ip, ps_port_t port) {
+  assert(endpoint && ip);
+  return _purrsock_endpoint_from_addr(endpoint, ip, port);
+}
+
+ps_result_t ps_get_socket_endpoint(ps_socket_t socket, ps_endpoint_t *endpoint) {
+  assert(socket && endpoint);
+  return _purrsock_get_socket_endpoint((_purrsock_socket_t*)socket, endpoint);
+}
+
+ps_result_t ps_read_socket_packets(ps_socket_t socket, ps_packet_t *packets, ps_endpoint_t *from, size_t count, size_t *received) {
+  assert(socket && packets && received);
+  *received = 0;
+  if (count > PS_MAX_PACKET_BATCH) count = PS_MAX_PACKET_BATCH;
+
+  bool pooled[PS_MAX_PACKET_BATCH];
+  for (size_t i = 0; i < count; ++i) {
+    pooled[i] = !packets[i].buf;
+    if (pooled[i]) {
+      ps_result_t result = _purrsock_packet_acquire(NULL, PS_PACKET_DATAGRAM_CAPACITY, &packets[i]);
+      if (result != PS_SUCCESS) {
+        count = i;
+        break;
+      }
+    } else if (!packets[i].capacity) {
+      count = i;
+      break;
+    }
+  }
+  if (!count) return PS_ERROR_INVALID_ARGUMENT;
+
+  ps_result_t result = _purrsock_read_socket_packets((_purrsock_socket_t*)socket, packets, from, count, received);
+  for (size_t i = *received; i < count; ++i) {
+    if (pooled[i]) _purrsock_packet_release(&packets[i]);
+  }
+  return result;
+}
+
+ps_result_t ps_send_socket_packets(ps_socket_t socket, const ps_packet_t *packets, const ps_endpoint_t *to, size_t count, size_t *sent) {
+  assert(socket && packets && sent);
+  return _purrsock_send_socket_packets((_purrsock_socket_t*)socket, packets, to, count, sent);
+}
+
+ps_result_t ps_sendv(ps_socket_t socket, const ps_packet_t *slices, size_t count, const ps_endpoint_t *to) {
+  assert(socket && slices);
+  if (!count || count > PS_MAX_PACKET_SLICES) return PS_ERROR_INVALID_ARGUMENT;
+  return _purrsock_sendv((_purrsock_socket_t*)socket, slices, count, to);
+}
+
+ps_result_t ps_sendv_partial(ps_socket_t socket, const ps_packet_t *slices, size_t count, size_t *sent) {
+  assert(socket && slices && sent);
+  *sent = 0;
+  if (!count || count > PS_MAX_PACKET_SLICES) return PS_ERROR_INVALID_ARGUMENT;
+  _purrsock_socket_t *internal_socket = (_purrsock_socket_t*)socket;
+  if (_purrsock_is_datagram(internal_socket->protocol)) return PS_ERROR_INVALID_ARGUMENT;
+
+  // Kept bytes come first, so nothing of the new slices goes out before they are gone.
+  ps_result_t result = _purrsock_flush_socket(internal_socket);
+  if (result != PS_SUCCESS) return result;
+  return _purrsock_send_stream_partial(internal_socket, slices, count, sent);
+}
+
+ps_result_t ps_recvv(ps_socket_t socket, ps_packet_t *slices, size_t count, size_t *received, ps_endpoint_t *from) {
+  assert(socket && slices && received);
+  *received = 0;
+  if (!count || count > PS_MAX_PACKET_SLICES) return PS_ERROR_INVALID_ARGUMENT;
+  for (size_t i = 0; i < count; ++i) {
+    if (!slices[i].buf) return PS_ERROR_INVALID_ARGUMENT;
+  }
+  return _purrsock_recvv((_purrsock_socket_t*)socket, slices, count, received, from);
+}
+
+ps_result_t ps_send_socket_packet_segmented(ps_socket_t socket, ps_packet_t packet, size_t segment_size, const ps_endpoint_t *to, size_t *sent) {
+  assert(socket && sent);
+  *sent = 0;
+  if (!segment_size) return PS_ERROR_INVALID_ARGUMENT;
+  return _purrsock_send_socket_packet_segmented((_purrsock_socket_t*)socket, packet, segment_size, to, sent);
+}
+
+ps_result_t ps_set_socket_gro(ps_socket_t socket, bool enabled) {
+  assert(socket);
+  return _purrsock_set_socket_gro((_purrsock_socket_t*)socket, enabled);
+}
+
+ps_result_t ps_read_socket_packet_segmented(ps_socket_t socket, ps_packet_t *packet, ps_packet_t *segments, size_t max_segments, size_t *segment_count, ps_endpoint_t *from) {
+  assert(socket && packet && segments && segment_count);
+  *segment_count = 0;
+  if (!max_segments) return PS_ERROR_INVALID_ARGUMENT;
+  _purrsock_socket_t *internal_socket = (_purrsock_socket_t*)socket;
+
+  bool pooled;
+  ps_result_t result = _purrsock_prepare_read(internal_socket, packet, &pooled);
+  if (result != PS_SUCCESS) return result;
+
+  size_t segment_size = 0;
+  result = _purrsock_read_socket_packet_segmented(internal_socket, packet, &segment_size, from);
+  if (result != PS_SUCCESS && result != PS_ERROR_MSGTOOLONG) {
+    if (pooled) _purrsock_packet_release(packet);
+    return result;
+  }
+
+  // Every coalesced datagram is `segment_size` bytes except possibly the last.
+  if (!segment_size) segment_size = packet->size;
+  size_t offset = 0;
+  do {
+    if (*segment_count == max_segments) {
+      result = PS_ERROR_MSGTOOLONG;
+      break;
+    }
+    size_t size = packet->size - offset < segment_size ? packet->size - offset : segment_size;
+    segments[(*segment_count)++] = (ps_packet_t){ size, packet->buf + offset, size };
+    offset += size;
+  } while (offset < packet->size);
+
+  return result;
+}
+
+ps_result_t ps_create_packet_pool(ps_packet_pool_t *pool) {
+  assert(pool);
+  return _purrsock_create_packet_pool((_purrsock_packet_pool_t**)pool);
+}
+
+void ps_destroy_packet_pool(ps_packet_pool_t pool) {
+  assert(pool);
+  _purrsock_destroy_packet_pool((_purrsock_packet_pool_t*)pool);
+}
+
+ps_result_t ps_packet_acquire(ps_packet_pool_t pool, size_t size, ps_packet_t *packet) {
+  return _purrsock_packet_acquire((_purrsock_packet_pool_t*)pool, size, packet);
+}
+
+void ps_packet_release(ps_packet_t *packet) {
+  _purrsock_packet_release(packet);
+}
+
+void ps_get_packet_pool_stats(ps_packet_pool_t pool, ps_packet_pool_stats_t *stats) {
+  _purrsock_get_packet_pool_stats((_purrsock_packet_pool_t*)pool, stats);
+}
+
+ps_result_t ps_set_socket_blocking(ps_socket_t socket, bool blocking) {
+  return _purrsock_set_socket_blocking((_purrsock_socket_t*)socket, blocking);
+}
+
+ps_result_t ps_set_socket_nodelay(ps_socket_t socket, bool enabled) {
+  return _purrsock_set_socket_nodelay((_purrsock_socket_t*)socket, enabled);
+}
+
+ps_result_t ps_set_socket_timeouts(ps_socket_t socket, const ps_socket_timeouts_t *timeouts) {
+  assert(socket && timeouts);
+  return _purrsock_set_socket_timeouts((_purrsock_socket_t*)socket, timeouts);
+}
+
+ps_result_t ps_create_loop(ps_loop_t *loop) {
+  assert(loop);
+  return _purrsock_create_loop((_purrsock_loop_t**)loop, NULL);
+}
+
+ps_result_t ps_create_loop_with_options(ps_loop_t *loop, const ps_loop_options_t *options) {
+  assert(loop);
+  return _purrsock_create_loop((_purrsock_loop_t**)loop, options);
+}
+
+void ps_destroy_loop(ps_loop_t loop) {
+  assert(loop);
+  _purrsock_destroy_loop((_purrsock_loop_t*)loop);
+}
+
+ps_result_t ps_loop_add_socket(ps_loop_t loop, ps_socket_t socket, ps_loop_callbacks_t callbacks) {
+  return _purrsock_loop_add_socket((_purrsock_loop_t*)loop, (_purrsock_socket_t*)socket, callbacks);
+}
+
+ps_result_t ps_loop_remove_socket(ps_loop_t loop, ps_socket_t socket) {
+  return _purrsock_loop_remove_socket((_purrsock_loop_t*)loop, (_purrsock_socket_t*)socket);
+}
+
+ps_result_t ps_loop_run_once(ps_loop_t loop, int timeout_ms) {
+  return _purrsock_loop_run_once((_purrsock_loop_t*)loop, timeout_ms);
+}
+
+ps_result_t ps_loop_run(ps_loop_t loop) {
+  return _purrsock_loop_run((_purrsock_loop_t*)loop);
+}
+
+void ps_loop_stop(ps_loop_t loop) {
+  _purrsock_loop_stop((_purrsock_loop_t*)loop);
+}
+
+ps_loop_backend_t ps_loop_get_backend(ps_loop_t loop) {
+  return _purrsock_loop_get_backend((_purrsock_loop_t*)loop);
+}
+
+ps_result_t ps_loop_add_tick(ps_loop_t loop, ps_loop_tick_callback_t callback, void *user_data) {
+  return _purrsock_loop_add_tick((_purrsock_loop_t*)loop, callback, user_data);
+}
+
+ps_result_t ps_loop_remove_tick(ps_loop_t loop, ps_loop_tick_callback_t callback, void *user_data) {
+  return _purrsock_loop_remove_tick((_purrsock_loop_t*)loop, callback, user_data);
+}
+
+ps_result_t ps_loop_post(ps_loop_t loop, ps_task_callback_t callback, void *user_data) {
+  assert(loop && callback);
+  return _purrsock_loop_post((_purrsock_loop_t*)loop, callback, user_data);
+}
+
+ps_loop_t ps_socket_get_loop(ps_socket_t socket) {
+  assert(socket);
+  return (ps_loop_t)((_purrsock_socket_t*)socket)->loop;
+}
+
+void ps_timer_init(ps_timer_t *timer, ps_timer_callback_t callback, void *user_data) {
+  assert(timer && callback);
+  *timer = (ps_timer_t){0};
+  timer->callback = callback;
+  timer->user_data = user_data;
+}
+
+bool ps_timer_is_active(const ps_timer_t *timer) {
+  assert(timer);
+  return timer->prev != NULL;
+}
+
+ps_result_t ps_loop_start_timer(ps_loop_t loop, ps_timer_t *timer, uint64_t timeout_ms) {
+  assert(loop && timer);
+  return _purrsock_loop_start_timer((_purrsock_loop_t*)loop, timer, timeout_ms);
+}
+
+void ps_loop_stop_timer(ps_loop_t loop, ps_timer_t *timer) {
+  assert(loop && timer);
+  _purrsock_loop_stop_timer((_purrsock_loop_t*)loop, timer);
+}
+
+uint64_t ps_loop_now(ps_loop_t loop) {
+  assert(loop);
+  return _purrsock_loop_now((_purrsock_loop_t*)loop);
+}
+
+ps_result_t ps_loop_set_socket_heartbeat(ps_loop_t loop, ps_socket_t socket, const ps_heartbeat_options_t *options) {
+  assert(loop && socket);
+  return _purrsock_loop_set_socket_heartbeat((_purrsock_loop_t*)loop, (_purrsock_socket_t*)socket, options);
+}
+
+ps_result_t ps_connect_async(ps_loop_t loop, const char *host, ps_port_t port, const ps_connect_options_t *options, ps_connect_callback_t callback, void *user_data) {
+  assert(loop && host && callback);
+  return _purrsock_connect_async((_purrsock_loop_t*)loop, host, port, options, callback, user_data);
+}
+
+ps_result_t ps_create_resolver(ps_resolver_t *resolver, ps_loop_t loop, const ps_resolver_options_t *options) {
+  assert(resolver && loop);
+  return _purrsock_create_resolver((_purrsock_resolver_t**)resolver, (_purrsock_loop_t*)loop, options);
+}
+
+void ps_destroy_resolver(ps_resolver_t resolver) {
+  assert(resolver);
+  _purrsock_destroy_resolver((_purrsock_resolver_t*)resolver);
+}
+
+ps_result_t ps_resolve_async(ps_resolver_t resolver, const char *host, ps_resolve_callback_t callback, void *user_data) {
+  assert(resolver && host && callback);
+  return _purrsock_resolve_async((_purrsock_resolver_t*)resolver, host, callback, user_data);
+}
+
+ps_result_t ps_resolver_lookup(ps_resolver_t resolver, const char *host, ps_endpoint_t *addresses, size_t capacity, size_t *count) {
+  assert(resolver && host && addresses && capacity && count);
+  return _purrsock_resolver_lookup((_purrsock_resolver_t*)resolver, host, addresses, capacity, count);
+}
+
+void ps_get_resolver_stats(ps_resolver_t resolver, ps_resolver_stats_t *stats) {
+  assert(resolver && stats);
+  _purrsock_get_resolver_stats((_purrsock_resolver_t*)resolver, stats);
+}
+
+ps_result_t ps_loop_read_socket_packet(ps_loop_t loop, ps_socket_t socket, ps_packet_t *packet, ps_loop_packet_completion_t callback, void *user_data) {
+  return _purrsock_loop_read_socket_packet((_purrsock_loop_t*)loop, (_purrsock_socket_t*)socket, packet, callback, user_data);
+}
+
+ps_result_t ps_loop_read_socket_packet_multishot(ps_loop_t loop, ps_socket_t socket, ps_loop_packet_completion_t callback, void *user_data) {
+  return _purrsock_loop_read_socket_packet_multishot((_purrsock_loop_t*)loop, (_purrsock_socket_t*)socket, callback, user_data);
+}
+
+ps_result_t ps_loop_send_socket_packet(ps_loop_t loop, ps_socket_t socket, ps_packet_t *packet, ps_loop_packet_completion_t callback, void *user_data) {
+  return _purrsock_loop_send_socket_packet((_purrsock_loop_t*)loop, (_purrsock_socket_t*)socket, packet, callback, user_data);
+}
+
+ps_result_t ps_loop_accept_socket(ps_loop_t loop, ps_socket_t socket, bool multishot, ps_loop_accept_completion_t callback, void *user_data) {
+  return _purrsock_loop_accept_socket((_purrsock_loop_t*)loop, (_purrsock_socket_t*)socket, multishot, callback, user_data);
+}
+
+ps_result_t ps_create_framed_socket(ps_framed_socket_t *framed, ps_socket_t socket, const ps_framing_options_t *options) {
+  assert(framed && socket && options);
+  return _purrsock_create_framed_socket((_purrsock_framed_socket_t**)framed, (_purrsock_socket_t*)socket, options);
+}
+
+void ps_destroy_framed_socket(ps_framed_socket_t framed) {
+  assert(framed);
+  _purrsock_destroy_framed_socket((_purrsock_framed_socket_t*)framed);
+}
+
+ps_result_t ps_framed_read(ps_framed_socket_t framed, ps_packet_t *frame) {
+  assert(framed && frame);
+  return _purrsock_framed_read((_purrsock_framed_socket_t*)framed, frame);
+}
+
+ps_result_t ps_framed_send(ps_framed_socket_t framed, ps_packet_t payload) {
+  assert(framed);
+  return _purrsock_framed_send((_purrsock_framed_socket_t*)framed, payload);
+}
+
+ps_result_t ps_create_buffered_stream(ps_buffered_stream_t *stream, ps_socket_t socket, const ps_buffered_stream_options_t *options) {
+  assert(stream && socket);
+  return _purrsock_create_buffered_stream((_purrsock_buffered_stream_t**)stream, (_purrsock_socket_t*)socket, options);
+}
+
+void ps_destroy_buffered_stream(ps_buffered_stream_t stream) {
+  assert(stream);
+  _purrsock_destroy_buffered_stream((_purrsock_buffered_stream_t*)stream);
+}
+
+ps_result_t ps_buffered_stream_read(ps_buffered_stream_t stream, ps_packet_t *packet) {
+  assert(stream && packet);
+  if (!packet->buf || !packet->capacity) return PS_ERROR_INVALID_ARGUMENT;
+  return _purrsock_buffered_stream_read((_purrsock_buffered_stream_t*)stream, packet);
+}
+
+ps_result_t ps_buffered_stream_write(ps_buffered_stream_t stream, ps_packet_t packet) {
+  assert(stream);
+  return _purrsock_buffered_stream_write((_purrsock_buffered_stream_t*)stream, packet);
+}
+
+ps_result_t ps_buffered_stream_flush(ps_buffered_stream_t stream) {
+  assert(stream);
+  return _purrsock_buffered_stream_flush((_purrsock_buffered_stream_t*)stream);
+}
+
+size_t ps_buffered_stream_pending(ps_buffered_stream_t stream) {
+  assert(stream);
+  return _purrsock_buffered_stream_pending((_purrsock_buffered_stream_t*)stream);
+}
+
+ps_result_t ps_create_server(ps_server_t *server, ps_address_t address, const char *ip, ps_port_t port, const ps_server_options_t *options) {
+  assert(server && ip && options);
+  return _purrsock_create_server((_purrsock_server_t**)server, address, ip, port, options);
+}
+
+void ps_destroy_server(ps_server_t server) {
+  assert(server);
+  _purrsock_destroy_server((_purrsock_server_t*)server);
+}
+
+ps_result_t ps_server_start(ps_server_t server) {
+  assert(server);
+  return _purrsock_server_start((_purrsock_server_t*)server);
+}
+
+ps_result_t ps_server_stop(ps_server_t server) {
+  assert(server);
+  return _purrsock_server_stop((_purrsock_server_t*)server);
+}
+
+ps_port_t ps_server_get_port(ps_server_t server) {
+  assert(server);
+  return _purrsock_server_get_port((_purrsock_server_t*)server);
+}
+
+size_t ps_server_get_worker_count(ps_server_t server) {
+  assert(server);
+  return _purrsock_server_get_worker_count((_purrsock_server_t*)server);
+}
+
+ps_loop_t ps_server_get_loop(ps_server_t server, size_t worker) {
+  assert(server);
+  return _purrsock_server_get_loop((_purrsock_server_t*)server, worker);
+}
+
+ps_result_t ps_create_executor(ps_executor_t *executor, const ps_executor_options_t *options) {
+  assert(executor);
+  return _purrsock_create_executor((_purrsock_executor_t**)executor, options);
+}
+
+void ps_destroy_executor(ps_executor_t executor) {
+  assert(executor);
+  _purrsock_destroy_executor((_purrsock_executor_t*)executor);
+}
+
+ps_result_t ps_executor_submit(ps_executor_t executor, ps_task_callback_t callback, void *user_data) {
+  assert(executor && callback);
+  return _purrsock_executor_submit((_purrsock_executor_t*)executor, callback, user_data);
+}
+
+size_t ps_executor_get_worker_count(ps_executor_t executor) {
+  assert(executor);
+  return _purrsock_executor_get_worker_count((_purrsock_executor_t*)executor);
+}
+
+ps_result_t ps_create_conn_pool(ps_conn_pool_t *pool, const ps_conn_pool_options_t *options) {
+  assert(pool);
+  return _purrsock_create_conn_pool((_purrsock_conn_pool_t**)pool, options);
+}
+
+void ps_destroy_conn_pool(ps_conn_pool_t pool) {
+  assert(pool);
+  _purrsock_destroy_conn_pool((_purrsock_conn_pool_t*)pool);
+}
+
+ps_result_t ps_conn_pool_checkout(ps_conn_pool_t pool, const char *host, ps_port_t port, ps_protocol_t protocol, ps_socket_t *socket) {
+  assert(pool && host && socket);
+  return _purrsock_conn_pool_checkout((_purrsock_conn_pool_t*)pool, host, port, protocol, (_purrsock_socket_t**)socket);
+}
+
+void ps_conn_pool_checkin(ps_conn_pool_t pool, ps_socket_t socket, bool reusable) {
+  assert(pool && socket);
+  _purrsock_conn_pool_checkin((_purrsock_conn_pool_t*)pool, (_purrsock_socket_t*)socket, reusable);
+}
+
+void ps_conn_pool_maintain(ps_conn_pool_t pool) {
+  assert(pool);
+  _purrsock_conn_pool_maintain((_purrsock_conn_pool_t*)pool);
+}
+
+void ps_get_conn_pool_stats(ps_conn_pool_t pool, ps_conn_pool_stats_t *stats) {
+  assert(pool && stats);
+  _purrsock_get_conn_pool_stats((_purrsock_conn_pool_t*)pool, stats);
+}
+
+ps_result_t ps_get_socket_stats(ps_socket_t socket, ps_socket_stats_t *stats) {
+  assert(socket && stats);
+  return _purrsock_get_socket_stats((_purrsock_socket_t*)socket, stats);
+}
+
+ps_result_t ps_get_stats(ps_stats_t *stats) {
+  assert(stats);
+  return _purrsock_get_stats(stats);
+}
+
+ps_result_t ps_get_loop_stats(ps_loop_t loop, ps_stats_t *stats) {
+  assert(loop && stats);
+  return _purrsock_get_loop_stats((_purrsock_loop_t*)loop, stats);
+}
+
+uint64_t ps_latency_percentile(const ps_latency_histogram_t *histogram, double percentile) {
+  assert(histogram);
+  return _purrsock_latency_percentile(histogram, percentile);
+}
+
+ps_scan_isa_t ps_scan_get_isa(void) {
+  return _purrsock_scan_get_isa();
+}
+
+bool ps_scan_set_isa(ps_scan_isa_t isa) {
+  return _purrsock_scan_set_isa(isa);
+}
+
+size_t ps_scan_find(const char *buf, size_t size, const char *needle, size_t needle_size) {
+  assert((buf || !size) && needle && needle_size);
+  return _purrsock_scan_find(buf, size, needle, needle_size);
+}
+
+size_t ps_scan_token(const char *buf, size_t size) {
+  assert(buf || !size);
+  return _purrsock_scan_token(buf, size);
+}
+
+size_t ps_scan_field_value(const char *buf, size_t size) {
+  assert(buf || !size);
+  return _purrsock_scan_field_value(buf, size);
+}
+
+ps_result_t ps_create_http_server(ps_http_server_t *server, ps_address_t address, const char *ip, ps_port_t port, const ps_http_server_options_t *options) {
+  assert(server && ip);
+  return _purrsock_create_http_server((_purrsock_http_server_t**)server, address, ip, port, options);
+}
+
+void ps_destroy_http_server(ps_http_server_t server) {
+  assert(server);
+  _purrsock_destroy_http_server((_purrsock_http_server_t*)server);
+}
+
+ps_result_t ps_http_route(ps_http_server_t server, const char *method, const char *path, ps_http_handler_t handler, void *user_data) {
+  assert(server && path && handler);
+  return _purrsock_http_route((_purrsock_http_server_t*)server, method, path, handler, user_data);
+}
+
+ps_result_t ps_http_server_start(ps_http_server_t server) {
+  assert(server);
+  return _purrsock_http_server_start((_purrsock_http_server_t*)server);
+}
+
+ps_result_t ps_http_server_stop(ps_http_server_t server) {
+  assert(server);
+  return _purrsock_http_server_stop((_purrsock_http_server_t*)server);
+}
+
+ps_port_t ps_http_server_get_port(ps_http_server_t server) {
+  assert(server);
+  return _purrsock_http_server_get_port((_purrsock_http_server_t*)server);
+}
+
+bool ps_http_request_header(const ps_http_request_t *request, const char *name, ps_http_string_t *value) {
+  assert(request && name);
+  return _purrsock_http_request_header(request, name, value);
+}
+
+ps_result_t ps_http_response_set_status(ps_http_response_t response, int status) {
+  assert(response);
+  return _purrsock_http_response_set_status((_purrsock_http_response_t*)response, status);
+}
+
+ps_result_t ps_http_response_add_header(ps_http_response_t response, const char *name, const char *value) {
+  assert(response && name && value);
+  return _purrsock_http_response_add_header((_purrsock_http_response_t*)response, name, value);
+}
+
+ps_result_t ps_http_response_send(ps_http_response_t response, ps_packet_t body) {
+  assert(response);
+  return _purrsock_http_response_send((_purrsock_http_response_t*)response, body);
+}
+
+ps_result_t ps_http_response_send_file(ps_http_response_t response, int fd, uint64_t offset, uint64_t length) {
+  assert(response);
+  return _purrsock_http_response_send_file((_purrsock_http_response_t*)response, fd, offset, length);
+}
+
+ps_result_t ps_http_response_send_file_path(ps_http_response_t response, const char *path) {
+  assert(response && path);
+  int fd = _purrsock_open_file(path);
+  if (fd < 0) return PS_ERROR_INVALID_ARGUMENT;
+  return _purrsock_http_response_send_file((_purrsock_http_response_t*)response, fd, 0, 0);
+}
+
+ps_result_t ps_http_response_write(ps_http_response_t response, ps_packet_t data) {
+  assert(response);
+  return _purrsock_http_response_write((_purrsock_http_response_t*)response, data);
+}
+
+ps_result_t ps_http_response_end(ps_http_response_t response) {
+  assert(response);
+  return _purrsock_http_response_end((_purrsock_http_response_t*)response);
+}
+
+ps_result_t ps_create_websocket_server(ps_websocket_t *websocket, ps_socket_t socket, const ps_websocket_options_t *options) {
+  assert(websocket && socket);
+  return _purrsock_create_websocket((_purrsock_websocket_t**)websocket, (_purrsock_socket_t*)socket, false, NULL, NULL, options);
+}
+
+ps_result_t ps_create_websocket_client(ps_websocket_t *websocket, ps_socket_t socket, const char *host, const char *path, const ps_websocket_options_t *options) {
+  assert(websocket && socket && host && path);
+  return _purrsock_create_websocket((_purrsock_websocket_t**)websocket, (_purrsock_socket_t*)socket, true, host, path, options);
+}
+
+void ps_destroy_websocket(ps_websocket_t websocket) {
+  assert(websocket);
+  _purrsock_destroy_websocket((_purrsock_websocket_t*)websocket);
+}
+
+ps_result_t ps_websocket_handshake(ps_websocket_t websocket) {
+  assert(websocket);
+  return _purrsock_websocket_handshake((_purrsock_websocket_t*)websocket);
+}
+
+const char *ps_websocket_get_path(ps_websocket_t websocket) {
+  assert(websocket);
+  return _purrsock_websocket_get_path((_purrsock_websocket_t*)websocket);
+}
+
+ps_result_t ps_websocket_read(ps_websocket_t websocket, ps_websocket_message_t *message) {
+  assert(websocket && message);
+  return _purrsock_websocket_read((_purrsock_websocket_t*)websocket, message);
+}
+
+ps_result_t ps_websocket_send(ps_websocket_t websocket, ps_websocket_opcode_t opcode, ps_packet_t payload) {
+  assert(websocket);
+  if (opcode == PS_WEBSOCKET_CONTINUATION) return PS_ERROR_INVALID_ARGUMENT;
+  return _purrsock_websocket_send((_purrsock_websocket_t*)websocket, opcode, payload, true);
+}
+
+ps_result_t ps_websocket_send_fragment(ps_websocket_t websocket, ps_websocket_opcode_t opcode, ps_packet_t payload, bool final) {
+  assert(websocket);
+  return _purrsock_websocket_send((_purrsock_websocket_t*)websocket, opcode, payload, final);
+}
+
+ps_result_t ps_websocket_close(ps_websocket_t websocket, uint16_t code, const char *reason) {
+  assert(websocket);
+  return _purrsock_websocket_close((_purrsock_websocket_t*)websocket, code, reason);
+}
+
+ps_result_t ps_websocket_flush(ps_websocket_t websocket) {
+  assert(websocket);
+  return _purrsock_websocket_flush((_purrsock_websocket_t*)websocket);
+}
+
+size_t ps_websocket_get_unsent(ps_websocket_t websocket) {
+  assert(websocket);
+  return _purrsock_websocket_get_unsent((_purrsock_websocket_t*)websocket);
+}
@@ -0,0 +1,807 @@
+// Copyright (c) 2024 ClawsoftSolutions. All rights reserved.
+//
+// This software is licensed under the MIT License.
+// See LICENSE file for more information.
+//
+
+
+
+#include "internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#define PS_RESOLVER_DEFAULT_TIMEOUT_MS 1000
+#define PS_RESOLVER_DEFAULT_ATTEMPTS 2
+#define PS_RESOLVER_DEFAULT_SHARDS 16
+#define PS_RESOLVER_DEFAULT_CAPACITY 4096
+#define PS_RESOLVER_DEFAULT_MAX_TTL_MS (24 * 60 * 60 * 1000)
+#define PS_RESOLVER_DEFAULT_NEGATIVE_TTL_MS 5000
+#define PS_RESOLVER_MAX_SERVERS 4
+#define PS_RESOLVER_CACHE_LINE 64
+
+#define PS_DNS_PORT 53
+#define PS_DNS_MAX_NAME 253
+#define PS_DNS_MAX_MESSAGE 1232          // EDNS buffer size advertised, which avoids IP fragmentation.
+#define PS_DNS_TYPE_A 1
+#define PS_DNS_TYPE_SOA 6
+#define PS_DNS_TYPE_AAAA 28
+#define PS_DNS_TYPE_OPT 41
+#define PS_DNS_CLASS_IN 1
+#define PS_DNS_RCODE_NXDOMAIN 3
+#define PS_DNS_FLAG_RESPONSE 0x8000
+#define PS_DNS_FLAG_TRUNCATED 0x0200
+
+// Both queries of a lookup: AAAA first, so IPv6 addresses lead the answer as RFC 6724 usually ranks them.
+static const uint16_t s_query_types[2] = { PS_DNS_TYPE_AAAA, PS_DNS_TYPE_A };
+
+typedef struct _purrsock_dns_waiter_s {
+  struct _purrsock_dns_waiter_s *next;
+  ps_resolve_callback_t callback;
+  void *user_data;
+} _purrsock_dns_waiter_t;
+
+// A lookup in flight; every caller asking for the same name while it is joins its waiters.
+// Its ids are random and it asks from sockets of its own, so each lookup also gets a fresh source port:
+// an off-path attacker has to guess both to forge an answer.
+typedef struct _purrsock_dns_query_s {
+  struct _purrsock_dns_query_s *next;
+  _purrsock_resolver_t *resolver;
+  _purrsock_dns_waiter_t *waiters;
+  ps_timer_t timer;                // Retransmits, then gives up.
+  uint32_t attempt;
+  size_t server;
+  _purrsock_socket_t *sockets[2];  // Per address family of the servers asked, opened on first use.
+  uint16_t ids[2];
+  bool done[2];
+  bool failed;                     // A server answered with an error other than NXDOMAIN, or truncated.
+  bool nxdomain;
+  ps_endpoint_t addresses[2][PS_RESOLVE_MAX_ADDRESSES];
+  size_t counts[2];
+  // Per question, so that an empty answer to one does not cut how long the addresses of the other are cached.
+  uint64_t ttl_ms[2];              // Smallest TTL of the answer records.
+  uint64_t negative_ttl_ms[2];     // Of an empty answer: its SOA's TTL, capped by the MINIMUM field.
+  char host[PS_DNS_MAX_NAME + 1];
+} _purrsock_dns_query_t;
+
+// A lookup answered without the network, delivered from the loop like any other.
+typedef struct _purrsock_dns_ready_s {
+  struct _purrsock_dns_ready_s *next;
+  ps_resolve_callback_t callback;
+  void *user_data;
+  ps_result_t result;
+  size_t count;
+  ps_endpoint_t addresses[PS_RESOLVE_MAX_ADDRESSES];
+} _purrsock_dns_ready_t;
+
+typedef struct _purrsock_dns_entry_s {
+  struct _purrsock_dns_entry_s *hash_next;
+  struct _purrsock_dns_entry_s *lru_prev;
+  struct _purrsock_dns_entry_s *lru_next;
+  uint64_t hash;
+  uint64_t expires;                // Monotonic milliseconds.
+  ps_result_t result;              // PS_SUCCESS, or PS_ERROR_ADDRNOTAVAIL for a cached miss.
+  size_t count;
+  ps_endpoint_t addresses[PS_RESOLVE_MAX_ADDRESSES];
+  char host[];
+} _purrsock_dns_entry_t;
+
+typedef struct {
+  _purrsock_mutex_t lock;
+  _purrsock_dns_entry_t **buckets;
+  size_t bucket_mask;
+  _purrsock_dns_entry_t lru;       // Sentinel: next is the most recently used entry, prev the least.
+  size_t count;
+  char pad[PS_RESOLVER_CACHE_LINE];
+} _purrsock_dns_shard_t;
+
+struct _purrsock_resolver_s {
+  _purrsock_loop_t *loop;
+  ps_resolver_options_t options;
+  ps_endpoint_t servers[PS_RESOLVER_MAX_SERVERS];
+  size_t server_count;
+  _purrsock_dns_query_t *queries;
+  _purrsock_dns_ready_t *ready;
+  _purrsock_dns_ready_t *ready_tail;
+  ps_timer_t ready_timer;
+  _purrsock_dns_shard_t *shards;
+  size_t shard_mask;
+  size_t shard_capacity;
+  ps_resolver_stats_t stats;       // Updated atomically: lookups of the cache come from any thread.
+  uint8_t buffer[PS_DNS_MAX_MESSAGE];
+};
+
+static void _purrsock_resolver_count(uint64_t *counter) {
+  __atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+}
+
+static size_t _purrsock_resolver_round_up_pow2(size_t value) {
+  size_t capacity = 1;
+  while (capacity < value) capacity <<= 1;
+  return capacity;
+}
+
+static uint64_t _purrsock_resolver_hash(const char *host) {
+  // FNV-1a.
+  uint64_t hash = 14695981039346656037ULL;
+  for (const char *c = host; *c; ++c) hash = (hash ^ (uint8_t)*c) * 1099511628211ULL;
+  return hash;
+}
+
+static char _purrsock_dns_lower(char c) {
+  return c >= 'A' && c <= 'Z' ? (char)(c - 'A' + 'a') : c;
+}
+
+// Lowercases `host` into `name` without a trailing dot, checking it is a valid domain name.
+static bool _purrsock_dns_normalize(const char *host, char *name) {
+  size_t length = strlen(host);
+  if (length && host[length - 1] == '.') length--;
+  if (!length || length > PS_DNS_MAX_NAME) return false;
+
+  size_t label = 0;
+  for (size_t i = 0; i < length; ++i) {
+    if (host[i] == '.') {
+      if (!label) return false;
+      label = 0;
+    } else if (++label > 63) {
+      return false;
+    }
+    name[i] = _purrsock_dns_lower(host[i]);
+  }
+  name[length] = '\0';
+  return label > 0;
+}
+
+static bool _purrsock_dns_is_localhost(const char *name) {
+  size_t length = strlen(name);
+  return !strcmp(name, "localhost") || (length > 10 && !strcmp(name + length - 10, ".localhost"));
+}
+
+// Answers literal addresses and, as RFC 6761 asks, localhost names without a query.
+static bool _purrsock_resolver_answer_locally(const char *host, const char *name, ps_endpoint_t *addresses, size_t *count) {
+  if (_purrsock_endpoint_from_addr(&addresses[0], host, 0) == PS_SUCCESS) {
+    *count = 1;
+    return true;
+  }
+  if (name && _purrsock_dns_is_localhost(name)) {
+    _purrsock_endpoint_from_addr(&addresses[0], "::1", 0);
+    _purrsock_endpoint_from_addr(&addresses[1], "127.0.0.1", 0);
+    *count = 2;
+    return true;
+  }
+  return false;
+}
+
+static bool _purrsock_endpoint_equal(const ps_endpoint_t *a, const ps_endpoint_t *b) {
+  size_t size = a->family == PS_ADDRESS_IPV6 ? 16 : 4;
+  return a->family == b->family && a->port == b->port && !memcmp(a->addr, b->addr, size);
+}
+
+// Cache
+
+static _purrsock_dns_shard_t *_purrsock_resolver_shard(_purrsock_resolver_t *resolver, uint64_t hash) {
+  return &resolver->shards[(hash >> 32) & resolver->shard_mask];
+}
+
+static void _purrsock_dns_lru_unlink(_purrsock_dns_entry_t *entry) {
+  entry->lru_prev->lru_next = entry->lru_next;
+  entry->lru_next->lru_prev = entry->lru_prev;
+}
+
+static void _purrsock_dns_lru_push(_purrsock_dns_shard_t *shard, _purrsock_dns_entry_t *entry) {
+  entry->lru_prev = &shard->lru;
+  entry->lru_next = shard->lru.lru_next;
+  shard->lru.lru_next->lru_prev = entry;
+  shard->lru.lru_next = entry;
+}
+
+// Must be called with the shard locked.
+static _purrsock_dns_entry_t **_purrsock_dns_shard_find(_purrsock_dns_shard_t *shard, const char *name, uint64_t hash) {
+  _purrsock_dns_entry_t **link = &shard->buckets[hash & shard->bucket_mask];
+  while (*link && ((*link)->hash != hash || strcmp((*link)->host, name))) link = &(*link)->hash_next;
+  return link;
+}
+
+static void _purrsock_dns_shard_remove(_purrsock_dns_shard_t *shard, _purrsock_dns_entry_t *entry) {
+  _purrsock_dns_entry_t **link = _purrsock_dns_shard_find(shard, entry->host, entry->hash);
+  *link = entry->hash_next;
+  _purrsock_dns_lru_unlink(entry);
+  shard->count--;
+  free(entry);
+}
+
+// Returns PS_SUCCESS or PS_ERROR_ADDRNOTAVAIL for a cached answer, PS_ERROR_WOULDBLOCK if there is none.
+static ps_result_t _purrsock_resolver_cache_get(_purrsock_resolver_t *resolver, const char *name, ps_endpoint_t *addresses, size_t capacity, size_t *count) {
+  uint64_t hash = _purrsock_resolver_hash(name);
+  _purrsock_dns_shard_t *shard = _purrsock_resolver_shard(resolver, hash);
+  ps_result_t result = PS_ERROR_WOULDBLOCK;
+
+  _purrsock_mutex_lock(&shard->lock);
+  _purrsock_dns_entry_t *entry = *_purrsock_dns_shard_find(shard, name, hash);
+  if (entry && entry->expires > _purrsock_monotonic_ms()) {
+    result = entry->result;
+    *count = entry->count < capacity ? entry->count : capacity;
+    memcpy(addresses, entry->addresses, *count * sizeof(*addresses));
+    _purrsock_dns_lru_unlink(entry);
+    _purrsock_dns_lru_push(shard, entry);
+  }
+  _purrsock_mutex_unlock(&shard->lock);
+
+  if (result == PS_SUCCESS) {
+    _purrsock_resolver_count(&resolver->stats.cache_hits);
+  } else if (result == PS_ERROR_ADDRNOTAVAIL) {
+    _purrsock_resolver_count(&resolver->stats.negative_hits);
+  } else {
+    _purrsock_resolver_count(&resolver->stats.cache_misses);
+  }
+  return result;
+}
+
+static void _purrsock_resolver_cache_put(_purrsock_resolver_t *resolver, const char *name, ps_result_t result, const ps_endpoint_t *addresses, size_t count, uint64_t ttl_ms) {
+  if (!ttl_ms) return;
+  uint64_t hash = _purrsock_resolver_hash(name);
+  _purrsock_dns_shard_t *shard = _purrsock_resolver_shard(resolver, hash);
+
+  _purrsock_mutex_lock(&shard->lock);
+  _purrsock_dns_entry_t *entry = *_purrsock_dns_shard_find(shard, name, hash);
+  if (!entry) {
+    if (shard->count >= resolver->shard_capacity) _purrsock_dns_shard_remove(shard, shard->lru.lru_prev);
+
+    size_t name_size = strlen(name) + 1;
+    entry = (_purrsock_dns_entry_t *)malloc(sizeof(*entry) + name_size);
+    if (!entry) {
+      _purrsock_mutex_unlock(&shard->lock);
+      return;
+    }
+    entry->hash = hash;
+    memcpy(entry->host, name, name_size);
+    _purrsock_dns_entry_t **bucket = &shard->buckets[hash & shard->bucket_mask];
+    entry->hash_next = *bucket;
+    *bucket = entry;
+    shard->count++;
+  } else {
+    _purrsock_dns_lru_unlink(entry);
+  }
+  _purrsock_dns_lru_push(shard, entry);
+
+  entry->expires = _purrsock_monotonic_ms() + ttl_ms;
+  entry->result = result;
+  entry->count = count;
+  if (count) memcpy(entry->addresses, addresses, count * sizeof(*addresses));
+  _purrsock_mutex_unlock(&shard->lock);
+}
+
+// Wire format (RFC 1035)
+
+static size_t _purrsock_dns_encode_query(uint8_t *buf, uint16_t id, const char *name, uint16_t type) {
+  memset(buf, 0, 12);
+  buf[0] = (uint8_t)(id >> 8);
+  buf[1] = (uint8_t)id;
+  buf[2] = 0x01;                   // Recursion desired.
+  buf[5] = 1;                      // One question.
+  buf[11] = 1;                     // One additional record: the EDNS OPT.
+
+  size_t offset = 12;
+  const char *label = name;
+  while (*label) {
+    const char *end = strchr(label, '.');
+    size_t length = end ? (size_t)(end - label) : strlen(label);
+    buf[offset++] = (uint8_t)length;
+    memcpy(&buf[offset], label, length);
+    offset += length;
+    label += length + (end ? 1 : 0);
+  }
+  buf[offset++] = 0;
+  buf[offset++] = (uint8_t)(type >> 8);
+  buf[offset++] = (uint8_t)type;
+  buf[offset++] = 0;
+  buf[offset++] = PS_DNS_CLASS_IN;
+
+  // OPT: root name, type, UDP payload size as class, no extended flags or options.
+  uint8_t opt[11] = { 0, 0, PS_DNS_TYPE_OPT, PS_DNS_MAX_MESSAGE >> 8, PS_DNS_MAX_MESSAGE & 0xff, 0, 0, 0, 0, 0, 0 };
+  memcpy(&buf[offset], opt, sizeof(opt));
+  return offset + sizeof(opt);
+}
+
+static uint16_t _purrsock_dns_u16(const uint8_t *p) {
+  return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t _purrsock_dns_u32(const uint8_t *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// Returns the offset past a possibly compressed name, or 0 if it runs off the message.
+static size_t _purrsock_dns_skip_name(const uint8_t *msg, size_t size, size_t offset) {
+  while (offset < size) {
+    uint8_t length = msg[offset];
+    if ((length & 0xc0) == 0xc0) return offset + 2 <= size ? offset + 2 : 0;
+    if (length & 0xc0) return 0;
+    if (!length) return offset + 1;
+    offset += 1 + length;
+  }
+  return 0;
+}
+
+// Compares a name of the message, following compression pointers, to a normalized name.
+static bool _purrsock_dns_name_equals(const uint8_t *msg, size_t size, size_t offset, const char *name) {
+  int jumps = 0;
+  while (offset < size) {
+    uint8_t length = msg[offset];
+    if ((length & 0xc0) == 0xc0) {
+      if (offset + 2 > size || ++jumps > 16) return false;
+      offset = ((size_t)(length & 0x3f) << 8) | msg[offset + 1];
+      continue;
+    }
+    if (length & 0xc0) return false;
+    if (!length) return *name == '\0';
+    if (offset + 1 + length > size) return false;
+
+    for (uint8_t i = 0; i < length; ++i) {
+      if (_purrsock_dns_lower((char)msg[offset + 1 + i]) != name[i]) return false;
+    }
+    name += length;
+    if (*name == '.') {
+      name++;
+    } else if (*name) {
+      return false;
+    }
+    offset += 1 + length;
+  }
+  return false;
+}
+
+// Queries
+
+static void _purrsock_resolver_on_read(ps_loop_t loop, ps_socket_t socket, void *user_data);
+
+// Opens the query's socket for the family of `server`, bound to a port the system picks at random.
+static ps_result_t _purrsock_resolver_socket(_purrsock_dns_query_t *query, const ps_endpoint_t *server, _purrsock_socket_t **out_socket) {
+  int index = server->family == PS_ADDRESS_IPV6 ? 1 : 0;
+  if (query->sockets[index]) {
+    *out_socket = query->sockets[index];
+    return PS_SUCCESS;
+  }
+
+  _purrsock_socket_t *socket = (_purrsock_socket_t *)calloc(1, sizeof(*socket));
+  if (!socket) return PS_ERROR_INTERNAL;
+  socket->protocol = PS_PROTOCOL_UDP;
+  socket->addr_storage.ss_family = server->family;
+  query->sockets[index] = socket;
+
+  ps_result_t result = _purrsock_create_socket_from_addr(socket, server->family == PS_ADDRESS_IPV6 ? "::" : "0.0.0.0", 0);
+  if (result == PS_SUCCESS) result = _purrsock_set_socket_blocking(socket, false);
+  if (result != PS_SUCCESS) return result;
+
+  ps_loop_callbacks_t callbacks = {0};
+  callbacks.on_read = _purrsock_resolver_on_read;
+  callbacks.user_data = query;
+  result = _purrsock_loop_add_socket(query->resolver->loop, socket, callbacks);
+  if (result == PS_SUCCESS) *out_socket = socket;
+  return result;
+}
+
+static void _purrsock_resolver_close_sockets(_purrsock_dns_query_t *query) {
+  for (int i = 0; i < 2; ++i) {
+    _purrsock_socket_t *socket = query->sockets[i];
+    if (!socket) continue;
+    if (socket->loop) _purrsock_loop_remove_socket(query->resolver->loop, socket);
+    _purrsock_destroy_socket(socket);
+    free(socket);
+    query->sockets[i] = NULL;
+  }
+}
+
+static ps_result_t _purrsock_resolver_send(_purrsock_resolver_t *resolver, _purrsock_dns_query_t *query) {
+  const ps_endpoint_t *server = &resolver->servers[query->server];
+  _purrsock_socket_t *socket;
+  ps_result_t result = _purrsock_resolver_socket(query, server, &socket);
+  if (result != PS_SUCCESS) return result;
+  for (int type = 0; type < 2; ++type) {
+    if (query->done[type]) continue;
+    uint8_t buf[12 + PS_DNS_MAX_NAME + 2 + 4 + 11];
+    ps_packet_t packet = { 0, (char *)buf, sizeof(buf) };
+    packet.size = _purrsock_dns_encode_query(buf, query->ids[type], query->host, s_query_types[type]);
+    // A lost query is retransmitted when the timer expires, like a lost answer.
+    size_t sent;
+    _purrsock_send_socket_packets(socket, &packet, server, 1, &sent);
+    _purrsock_resolver_count(&resolver->stats.queries);
+  }
+  return PS_SUCCESS;
+}
+
+static void _purrsock_resolver_finish(_purrsock_resolver_t *resolver, _purrsock_dns_query_t *query, ps_result_t result) {
+  for (_purrsock_dns_query_t **link = &resolver->queries; *link; link = &(*link)->next) {
+    if (*link == query) {
+      *link = query->next;
+      break;
+    }
+  }
+  _purrsock_loop_stop_timer(resolver->loop, &query->timer);
+  _purrsock_resolver_close_sockets(query);
+
+  ps_endpoint_t addresses[PS_RESOLVE_MAX_ADDRESSES];
+  size_t count = 0;
+  for (int type = 0; type < 2; ++type) {
+    for (size_t i = 0; i < query->counts[type] && count < PS_RESOLVE_MAX_ADDRESSES; ++i) addresses[count++] = query->addresses[type][i];
+  }
+
+  if (result == PS_SUCCESS) {
+    const ps_resolver_options_t *options = &resolver->options;
+    if (count) {
+      uint64_t ttl_ms = UINT64_MAX;
+      for (int type = 0; type < 2; ++type) {
+        if (query->counts[type] && query->ttl_ms[type] < ttl_ms) ttl_ms = query->ttl_ms[type];
+      }
+      if (ttl_ms < options->min_ttl_ms) ttl_ms = options->min_ttl_ms;
+      if (ttl_ms > options->max_ttl_ms) ttl_ms = options->max_ttl_ms;
+      _purrsock_resolver_cache_put(resolver, query->host, PS_SUCCESS, addresses, count, ttl_ms);
+    } else if (query->nxdomain || (query->done[0] && query->done[1])) {
+      // NXDOMAIN, or no address of either type: remember the miss for the SOA's negative TTL (RFC 2308).
+      uint64_t ttl_ms = query->negative_ttl_ms[0] < query->negative_ttl_ms[1] ? query->negative_ttl_ms[0] : query->negative_ttl_ms[1];
+      if (ttl_ms == UINT64_MAX) ttl_ms = options->negative_ttl_ms;
+      if (ttl_ms > options->max_ttl_ms) ttl_ms = options->max_ttl_ms;
+      result = PS_ERROR_ADDRNOTAVAIL;
+      _purrsock_resolver_cache_put(resolver, query->host, result, NULL, 0, ttl_ms);
+    } else {
+      result = PS_ERROR_HOSTDOWN;
+      _purrsock_resolver_count(&resolver->stats.failures);
+    }
+  }
+
+  _purrsock_dns_waiter_t *waiter = query->waiters;
+  free(query);
+  while (waiter) {
+    _purrsock_dns_waiter_t *next = waiter->next;
+    waiter->callback((ps_resolver_t)resolver, result, result == PS_SUCCESS ? addresses : NULL, result == PS_SUCCESS ? count : 0, waiter->user_data);
+    free(waiter);
+    waiter = next;
+  }
+}
+
+// Asks the next server the questions still open, after a timeout or an answer that cannot be used; returns
+// true if that was the last attempt and the query finished.
+static bool _purrsock_resolver_next_attempt(_purrsock_resolver_t *resolver, _purrsock_dns_query_t *query) {
+  // Attempts go round the servers, so a dead or failing one only costs one attempt per round.
+  if (++query->attempt >= resolver->options.attempts * resolver->server_count) {
+    // Servers that answered with errors fail the lookup rather than time it out; see `_purrsock_resolver_finish`.
+    bool answered = query->counts[0] || query->counts[1] || query->failed;
+    if (!answered) _purrsock_resolver_count(&resolver->stats.timeouts);
+    _purrsock_resolver_finish(resolver, query, answered ? PS_SUCCESS : PS_ERROR_TIMEOUT);
+    return true;
+  }
+  query->server = query->attempt % resolver->server_count;
+  _purrsock_resolver_count(&resolver->stats.retransmits);
+  // A server whose family has no socket to spare is skipped like one that did not answer.
+  _purrsock_resolver_send(resolver, query);
+  _purrsock_loop_start_timer(resolver->loop, &query->timer, resolver->options.timeout_ms);
+  return false;
+}
+
+static void _purrsock_resolver_retransmit(ps_loop_t loop, ps_timer_t *timer, void *user_data) {
+  (void)loop; (void)timer;
+  _purrsock_dns_query_t *query = (_purrsock_dns_query_t *)user_data;
+  _purrsock_resolver_next_attempt(query->resolver, query);
+}
+
+// Collects the records of an answer to one of the query's questions.
+static void _purrsock_resolver_parse_answer(_purrsock_dns_query_t *query, int type, const uint8_t *msg, size_t size, size_t offset, uint16_t answers, uint16_t authorities) {
+  uint16_t wanted = s_query_types[type];
+  size_t address_size = wanted == PS_DNS_TYPE_AAAA ? 16 : 4;
+  uint64_t *kept_ttl_ms = &query->ttl_ms[type];
+
+  for (uint32_t i = 0; i < (uint32_t)answers + authorities; ++i) {
+    offset = _purrsock_dns_skip_name(msg, size, offset);
+    if (!offset || offset + 10 > size) return;
+    uint16_t rr_type = _purrsock_dns_u16(&msg[offset]);
+    uint16_t rr_class = _purrsock_dns_u16(&msg[offset + 2]);
+    uint64_t ttl_ms = (uint64_t)_purrsock_dns_u32(&msg[offset + 4]) * 1000;
+    uint16_t length = _purrsock_dns_u16(&msg[offset + 8]);
+    size_t rdata = offset + 10;
+    if (rdata + length > size) return;
+    offset = rdata + length;
+    if (rr_class != PS_DNS_CLASS_IN) continue;
+
+    if (i < answers) {
+      // CNAMEs need no following: recursive servers include the records of the name they point at.
+      if (rr_type != wanted || length != address_size || query->counts[type] == PS_RESOLVE_MAX_ADDRESSES) continue;
+      ps_endpoint_t *endpoint = &query->addresses[type][query->counts[type]++];
+      memset(endpoint, 0, sizeof(*endpoint));
+      endpoint->family = wanted == PS_DNS_TYPE_AAAA ? PS_ADDRESS_IPV6 : PS_ADDRESS_IPV4;
+      memcpy(endpoint->addr, &msg[rdata], address_size);
+      if (ttl_ms < *kept_ttl_ms) *kept_ttl_ms = ttl_ms;
+    } else {
+      // The SOA of a negative answer caps how long it may be cached by its MINIMUM field.
+      if (rr_type != PS_DNS_TYPE_SOA || query->counts[type]) continue;
+      size_t field = _purrsock_dns_skip_name(msg, size, rdata);
+      field = field ? _purrsock_dns_skip_name(msg, size, field) : 0;
+      if (!field || field + 20 > rdata + length) continue;
+      uint64_t minimum_ms = (uint64_t)_purrsock_dns_u32(&msg[field + 16]) * 1000;
+      ttl_ms = minimum_ms < ttl_ms ? minimum_ms : ttl_ms;
+      if (ttl_ms < query->negative_ttl_ms[type]) query->negative_ttl_ms[type] = ttl_ms;
+    }
+  }
+}
+
+// Takes in a message that arrived on the query's sockets, returning true once the query finished.
+static bool _purrsock_resolver_handle_message(_purrsock_dns_query_t *query, const uint8_t *msg, size_t size, const ps_endpoint_t *from) {
+  _purrsock_resolver_t *resolver = query->resolver;
+  if (size < 12) return false;
+  uint16_t id = _purrsock_dns_u16(&msg[0]);
+  uint16_t flags = _purrsock_dns_u16(&msg[2]);
+  if (!(flags & PS_DNS_FLAG_RESPONSE) || _purrsock_dns_u16(&msg[4]) != 1) return false;
+
+  int type;
+  if (!query->done[0] && query->ids[0] == id) {
+    type = 0;
+  } else if (!query->done[1] && query->ids[1] == id) {
+    type = 1;
+  } else {
+    return false;
+  }
+  // Answers must come from the server asked, about the name and type asked.
+  if (!_purrsock_endpoint_equal(from, &resolver->servers[query->server])) return false;
+  if (!_purrsock_dns_name_equals(msg, size, 12, query->host)) return false;
+  size_t offset = _purrsock_dns_skip_name(msg, size, 12);
+  if (!offset || offset + 4 > size || _purrsock_dns_u16(&msg[offset]) != s_query_types[type]) return false;
+  offset += 4;
+
+  // A server failure (SERVFAIL, REFUSED, ...) or an answer too large for UDP says nothing about the name:
+  // the next server is asked at once, as after a timeout. Truncated answers are not retried over TCP.
+  uint16_t rcode = flags & 0xf;
+  if ((rcode && rcode != PS_DNS_RCODE_NXDOMAIN) || (flags & PS_DNS_FLAG_TRUNCATED)) {
+    query->failed = true;
+    _purrsock_loop_stop_timer(resolver->loop, &query->timer);
+    return _purrsock_resolver_next_attempt(resolver, query);
+  }
+  if (rcode == PS_DNS_RCODE_NXDOMAIN) query->nxdomain = true;
+  _purrsock_resolver_parse_answer(query, type, msg, size, offset, _purrsock_dns_u16(&msg[6]), _purrsock_dns_u16(&msg[8]));
+  query->done[type] = true;
+
+  if (!query->done[0] || !query->done[1]) return false;
+  _purrsock_resolver_finish(resolver, query, PS_SUCCESS);
+  return true;
+}
+
+static void _purrsock_resolver_on_read(ps_loop_t loop, ps_socket_t socket, void *user_data) {
+  (void)loop;
+  _purrsock_dns_query_t *query = (_purrsock_dns_query_t *)user_data;
+  _purrsock_resolver_t *resolver = query->resolver;
+  while (1) {
+    ps_packet_t packet = { 0, (char *)resolver->buffer, sizeof(resolver->buffer) };
+    ps_endpoint_t from;
+    size_t received = 0;
+    if (_purrsock_read_socket_packets((_purrsock_socket_t *)socket, &packet, &from, 1, &received) != PS_SUCCESS || !received) return;
+    // A finished query took its sockets with it.
+    if (_purrsock_resolver_handle_message(query, resolver->buffer, packet.size, &from)) return;
+  }
+}
+
+static void _purrsock_resolver_run_ready(ps_loop_t loop, ps_timer_t *timer, void *user_data) {
+  (void)loop; (void)timer;
+  _purrsock_resolver_t *resolver = (_purrsock_resolver_t *)user_data;
+  _purrsock_dns_ready_t *ready = resolver->ready;
+  resolver->ready = NULL;
+  resolver->ready_tail = NULL;
+  while (ready) {
+    _purrsock_dns_ready_t *next = ready->next;
+    ready->callback((ps_resolver_t)resolver, ready->result, ready->count ? ready->addresses : NULL, ready->count, ready->user_data);
+    free(ready);
+    ready = next;
+  }
+}
+
+// Resolver
+
+// Reads the name servers from resolv.conf, where there is one.
+static void _purrsock_resolver_load_servers(_purrsock_resolver_t *resolver) {
+  FILE *file = fopen("/etc/resolv.conf", "r");
+  if (!file) return;
+  char line[256];
+  while (resolver->server_count < PS_RESOLVER_MAX_SERVERS && fgets(line, sizeof(line), file)) {
+    char address[64];
+    if (sscanf(line, " nameserver %63s", address) != 1) continue;
+    if (_purrsock_endpoint_from_addr(&resolver->servers[resolver->server_count], address, PS_DNS_PORT) == PS_SUCCESS) {
+      resolver->server_count++;
+    }
+  }
+  fclose(file);
+}
+
+ps_result_t _purrsock_create_resolver(_purrsock_resolver_t **out_resolver, _purrsock_loop_t *loop, const ps_resolver_options_t *options) {
+  assert(out_resolver && loop);
+  if (options && options->server_count > PS_RESOLVER_MAX_SERVERS) return PS_ERROR_INVALID_ARGUMENT;
+
+  _purrsock_resolver_t *resolver = (_purrsock_resolver_t *)calloc(1, sizeof(*resolver));
+  if (!resolver) return PS_ERROR_INTERNAL;
+  resolver->loop = loop;
+  if (options) resolver->options = *options;
+  ps_resolver_options_t *opts = &resolver->options;
+  if (!opts->timeout_ms) opts->timeout_ms = PS_RESOLVER_DEFAULT_TIMEOUT_MS;
+  if (!opts->attempts) opts->attempts = PS_RESOLVER_DEFAULT_ATTEMPTS;
+  if (!opts->cache_shards) opts->cache_shards = PS_RESOLVER_DEFAULT_SHARDS;
+  if (!opts->cache_capacity) opts->cache_capacity = PS_RESOLVER_DEFAULT_CAPACITY;
+  if (!opts->max_ttl_ms) opts->max_ttl_ms = PS_RESOLVER_DEFAULT_MAX_TTL_MS;
+  if (!opts->negative_ttl_ms) opts->negative_ttl_ms = PS_RESOLVER_DEFAULT_NEGATIVE_TTL_MS;
+
+  if (opts->servers && opts->server_count) {
+    memcpy(resolver->servers, opts->servers, opts->server_count * sizeof(*opts->servers));
+    resolver->server_count = opts->server_count;
+  } else {
+    _purrsock_resolver_load_servers(resolver);
+  }
+  if (!resolver->server_count) {
+    _purrsock_endpoint_from_addr(&resolver->servers[0], "127.0.0.1", PS_DNS_PORT);
+    resolver->server_count = 1;
+  }
+  opts->servers = NULL;
+  opts->server_count = 0;
+
+  size_t shard_count = _purrsock_resolver_round_up_pow2(opts->cache_shards);
+  resolver->shard_mask = shard_count - 1;
+  resolver->shard_capacity = (opts->cache_capacity + shard_count - 1) / shard_count;
+  size_t bucket_count = _purrsock_resolver_round_up_pow2(resolver->shard_capacity);
+  resolver->shards = (_purrsock_dns_shard_t *)calloc(shard_count, sizeof(*resolver->shards));
+  if (!resolver->shards) {
+    free(resolver);
+    return PS_ERROR_INTERNAL;
+  }
+  ps_timer_init(&resolver->ready_timer, _purrsock_resolver_run_ready, resolver);
+
+  bool allocated = true;
+  for (size_t i = 0; i < shard_count; ++i) {
+    _purrsock_dns_shard_t *shard = &resolver->shards[i];
+    _purrsock_mutex_init(&shard->lock);
+    shard->lru.lru_next = shard->lru.lru_prev = &shard->lru;
+    shard->bucket_mask = bucket_count - 1;
+    shard->buckets = (_purrsock_dns_entry_t **)calloc(bucket_count, sizeof(*shard->buckets));
+    allocated = allocated && shard->buckets;
+  }
+  if (!allocated) {
+    _purrsock_destroy_resolver(resolver);
+    return PS_ERROR_INTERNAL;
+  }
+
+  *out_resolver = resolver;
+  return PS_SUCCESS;
+}
+
+void _purrsock_destroy_resolver(_purrsock_resolver_t *resolver) {
+  assert(resolver);
+  while (resolver->queries) _purrsock_resolver_finish(resolver, resolver->queries, PS_ERROR_SHUTDOWN);
+  _purrsock_loop_stop_timer(resolver->loop, &resolver->ready_timer);
+  while (resolver->ready) {
+    _purrsock_dns_ready_t *ready = resolver->ready;
+    resolver->ready = ready->next;
+    ready->callback((ps_resolver_t)resolver, PS_ERROR_SHUTDOWN, NULL, 0, ready->user_data);
+    free(ready);
+  }
+
+  for (size_t i = 0; resolver->shards && i <= resolver->shard_mask; ++i) {
+    _purrsock_dns_shard_t *shard = &resolver->shards[i];
+    while (shard->count) _purrsock_dns_shard_remove(shard, shard->lru.lru_prev);
+    free(shard->buckets);
+    _purrsock_mutex_destroy(&shard->lock);
+  }
+  free(resolver->shards);
+  free(resolver);
+}
+
+_purrsock_loop_t *_purrsock_resolver_get_loop(_purrsock_resolver_t *resolver) {
+  assert(resolver);
+  return resolver->loop;
+}
+
+static ps_result_t _purrsock_resolver_defer(_purrsock_resolver_t *resolver, ps_result_t result, const ps_endpoint_t *addresses, size_t count, ps_resolve_callback_t callback, void *user_data) {
+  _purrsock_dns_ready_t *ready = (_purrsock_dns_ready_t *)calloc(1, sizeof(*ready));
+  if (!ready) return PS_ERROR_INTERNAL;
+  ready->callback = callback;
+  ready->user_data = user_data;
+  ready->result = result;
+  ready->count = count;
+  if (count) memcpy(ready->addresses, addresses, count * sizeof(*addresses));
+
+  if (resolver->ready_tail) {
+    resolver->ready_tail->next = ready;
+  } else {
+    resolver->ready = ready;
+  }
+  resolver->ready_tail = ready;
+  if (!ps_timer_is_active(&resolver->ready_timer)) _purrsock_loop_start_timer(resolver->loop, &resolver->ready_timer, 0);
+  return PS_SUCCESS;
+}
+
+ps_result_t _purrsock_resolve_async(_purrsock_resolver_t *resolver, const char *host, ps_resolve_callback_t callback, void *user_data) {
+  assert(resolver && host && callback);
+
+  char name[PS_DNS_MAX_NAME + 1];
+  bool valid = _purrsock_dns_normalize(host, name);
+  ps_endpoint_t addresses[PS_RESOLVE_MAX_ADDRESSES];
+  size_t count = 0;
+  if (_purrsock_resolver_answer_locally(host, valid ? name : NULL, addresses, &count)) {
+    return _purrsock_resolver_defer(resolver, PS_SUCCESS, addresses, count, callback, user_data);
+  }
+  if (!valid) return PS_ERROR_INVALID_ARGUMENT;
+
+  ps_result_t result = _purrsock_resolver_cache_get(resolver, name, addresses, PS_RESOLVE_MAX_ADDRESSES, &count);
+  if (result != PS_ERROR_WOULDBLOCK) {
+    return _purrsock_resolver_defer(resolver, result, addresses, result == PS_SUCCESS ? count : 0, callback, user_data);
+  }
+
+  _purrsock_dns_waiter_t *waiter = (_purrsock_dns_waiter_t *)calloc(1, sizeof(*waiter));
+  if (!waiter) return PS_ERROR_INTERNAL;
+  waiter->callback = callback;
+  waiter->user_data = user_data;
+
+  _purrsock_dns_query_t *query = resolver->queries;
+  while (query && strcmp(query->host, name)) query = query->next;
+  if (query) {
+    waiter->next = query->waiters;
+    query->waiters = waiter;
+    return PS_SUCCESS;
+  }
+
+  query = (_purrsock_dns_query_t *)calloc(1, sizeof(*query));
+  if (!query) {
+    free(waiter);
+    return PS_ERROR_INTERNAL;
+  }
+  query->resolver = resolver;
+  query->waiters = waiter;
+  query->ttl_ms[0] = query->ttl_ms[1] = UINT64_MAX;
+  query->negative_ttl_ms[0] = query->negative_ttl_ms[1] = UINT64_MAX;
+  strcpy(query->host, name);
+  do {
+    if (!_purrsock_random(query->ids, sizeof(query->ids))) {
+      free(query);
+      free(waiter);
+      return PS_ERROR_INTERNAL;
+    }
+  } while (query->ids[1] == query->ids[0]);
+  ps_timer_init(&query->timer, _purrsock_resolver_retransmit, query);
+
+  result = _purrsock_resolver_send(resolver, query);
+  if (result != PS_SUCCESS) {
+    _purrsock_resolver_close_sockets(query);
+    free(query);
+    free(waiter);
+    return result;
+  }
+  query->next = resolver->queries;
+  resolver->queries = query;
+  _purrsock_resolver_count(&resolver->stats.lookups);
+  _purrsock_loop_start_timer(resolver->loop, &query->timer, resolver->options.timeout_ms);
+  return PS_SUCCESS;
+}
+
+ps_result_t _purrsock_resolver_lookup(_purrsock_resolver_t *resolver, const char *host, ps_endpoint_t *addresses, size_t capacity, size_t *count) {
+  assert(resolver && host && addresses && capacity && count);
+  *count = 0;
+
+  char name[PS_DNS_MAX_NAME + 1];
+  bool valid = _purrsock_dns_normalize(host, name);
+  ps_endpoint_t local[PS_RESOLVE_MAX_ADDRESSES];
+  size_t local_count;
+  if (_purrsock_resolver_answer_locally(host, valid ? name : NULL, local, &local_count)) {
+    *count = local_count < capacity ? local_count : capacity;
+    memcpy(addresses, local, *count * sizeof(*addresses));
+    return PS_SUCCESS;
+  }
+  if (!valid) return PS_ERROR_INVALID_ARGUMENT;
+  return _purrsock_resolver_cache_get(resolver, name, addresses, capacity, count);
+}
+
+void _purrsock_get_resolver_stats(_purrsock_resolver_t *resolver, ps_resolver_stats_t *stats) {
+  assert(resolver && stats);
+  stats->cache_hits = __atomic_load_n(&resolver->stats.cache_hits, __ATOMIC_RELAXED);
+  stats->negative_hits = __atomic_load_n(&resolver->stats.negative_hits, __ATOMIC_RELAXED);
+  stats->cache_misses = __atomic_load_n(&resolver->stats.cache_misses, __ATOMIC_RELAXED);
+  stats->lookups = __atomic_load_n(&resolver->stats.lookups, __ATOMIC_RELAXED);
+  stats->queries = __atomic_load_n(&resolver->stats.queries, __ATOMIC_RELAXED);
+  stats->retransmits = __atomic_load_n(&resolver->stats.retransmits, __ATOMIC_RELAXED);
+  stats->timeouts = __atomic_load_n(&resolver->stats.timeouts, __ATOMIC_RELAXED);
+  stats->failures = __atomic_load_n(&resolver->stats.failures, __ATOMIC_RELAXED);
+}
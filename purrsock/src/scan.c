@@ -0,0 +1,273 @@
+// Copyright (c) 2024 ClawsoftSolutions. All rights reserved.
+//
+// This software is licensed under the MIT License.
+// See LICENSE file for more information.
+//
+
+
+
+#include "internal.h"
+
+#include <string.h>
+
+// The vector scanners need GCC or Clang for per-function target attributes; elsewhere only the scalar ones exist.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PS_SCAN_X86
+#include <immintrin.h>
+#endif
+
+typedef struct {
+  size_t (*find)(const char *buf, size_t size, const char *needle, size_t needle_size);
+  size_t (*token)(const char *buf, size_t size);
+  size_t (*field_value)(const char *buf, size_t size);
+  void (*mask)(char *dst, const char *src, size_t size, uint32_t key);
+  ps_scan_isa_t isa;
+} _purrsock_scanner_t;
+
+// Bit c of the 128-bit map is set for each token character c (RFC 9110 5.6.2).
+static const uint64_t s_tchar[2] = { 0x03ff6cfa00000000ull, 0x57ffffffc7fffffeull };
+
+static bool _purrsock_scan_is_tchar(unsigned char c) {
+  return c < 128 && (s_tchar[c >> 6] >> (c & 63) & 1);
+}
+
+static bool _purrsock_scan_is_field_ctl(unsigned char c) {
+  return (c < 0x20 && c != '\t') || c == 0x7f;
+}
+
+static size_t _purrsock_scan_find_scalar(const char *buf, size_t size, const char *needle, size_t needle_size) {
+  if (size < needle_size) return size;
+  const char *last = buf + size - needle_size;
+  for (const char *at = buf; at <= last; ++at) {
+    at = (const char *)memchr(at, needle[0], (size_t)(last - at) + 1);
+    if (!at) break;
+    if (memcmp(at + 1, needle + 1, needle_size - 1) == 0) return (size_t)(at - buf);
+  }
+  return size;
+}
+
+static size_t _purrsock_scan_token_scalar(const char *buf, size_t size) {
+  size_t i = 0;
+  while (i < size && _purrsock_scan_is_tchar((unsigned char)buf[i])) i++;
+  return i;
+}
+
+static size_t _purrsock_scan_field_value_scalar(const char *buf, size_t size) {
+  size_t i = 0;
+  while (i < size && !_purrsock_scan_is_field_ctl((unsigned char)buf[i])) i++;
+  return i;
+}
+
+// Eight bytes at a time, which keeps the key aligned with the payload, then the rest one by one.
+static void _purrsock_scan_mask_scalar(char *dst, const char *src, size_t size, uint32_t key) {
+  uint64_t wide_key = (uint64_t)key << 32 | key;
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    memcpy(&word, src + i, 8);
+    word ^= wide_key;
+    memcpy(dst + i, &word, 8);
+  }
+  const unsigned char *key_bytes = (const unsigned char *)&key;
+  for (; i < size; ++i) dst[i] = (char)(src[i] ^ key_bytes[i & 3]);
+}
+
+#ifdef PS_SCAN_X86
+
+// Token characters are looked up by nibble with a byte shuffle: entry n of the low table has bit h set when
+// the character 0xhn is a token character, and the high table turns h into that bit. Non-ASCII high nibbles
+// map to no bit, so those bytes are never token characters.
+#define PS_SCAN_TCHAR_LOW 0xe8, 0xfc, 0xf8, 0xfc, 0xfc, 0xfc, 0xfc, 0xfc, 0xf8, 0xf8, 0xf4, 0x54, 0xd0, 0x54, 0xf4, 0x70
+#define PS_SCAN_TCHAR_HIGH 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0, 0, 0, 0, 0, 0, 0, 0
+
+// The SSE4.2 scanners also finish the AVX2 ones, and are inlined there to be encoded with VEX: calling
+// legacy SSE code while the upper halves of the ymm registers are in use stalls on many CPUs.
+#define PS_SCAN_SSE42_INLINE __attribute__((target("sse4.2"), always_inline)) static inline
+
+// Candidates are the positions where both the first and the last byte of the needle match; only those
+// are compared in full.
+PS_SCAN_SSE42_INLINE size_t _purrsock_scan_find_sse42(const char *buf, size_t size, const char *needle, size_t needle_size) {
+  if (needle_size == 1) return _purrsock_scan_find_scalar(buf, size, needle, needle_size);
+  const __m128i first = _mm_set1_epi8(needle[0]);
+  const __m128i last = _mm_set1_epi8(needle[needle_size - 1]);
+  size_t i = 0;
+  for (; i + needle_size - 1 + 16 <= size; i += 16) {
+    __m128i head = _mm_loadu_si128((const __m128i *)(buf + i));
+    __m128i tail = _mm_loadu_si128((const __m128i *)(buf + i + needle_size - 1));
+    unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(head, first), _mm_cmpeq_epi8(tail, last)));
+    for (; mask; mask &= mask - 1) {
+      size_t at = i + (size_t)__builtin_ctz(mask);
+      if (memcmp(buf + at + 1, needle + 1, needle_size - 2) == 0) return at;
+    }
+  }
+  return i + _purrsock_scan_find_scalar(buf + i, size - i, needle, needle_size);
+}
+
+PS_SCAN_SSE42_INLINE size_t _purrsock_scan_token_sse42(const char *buf, size_t size) {
+  const __m128i low_table = _mm_setr_epi8(PS_SCAN_TCHAR_LOW);
+  const __m128i high_table = _mm_setr_epi8(PS_SCAN_TCHAR_HIGH);
+  const __m128i nibble = _mm_set1_epi8(0x0f);
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    __m128i bytes = _mm_loadu_si128((const __m128i *)(buf + i));
+    __m128i low = _mm_shuffle_epi8(low_table, _mm_and_si128(bytes, nibble));
+    __m128i high = _mm_shuffle_epi8(high_table, _mm_and_si128(_mm_srli_epi16(bytes, 4), nibble));
+    unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(low, high), _mm_setzero_si128()));
+    if (mask) return i + (size_t)__builtin_ctz(mask);
+  }
+  return i + _purrsock_scan_token_scalar(buf + i, size - i);
+}
+
+// PCMPESTRI finds the first byte in any of the ranges 0x00-0x08, 0x0a-0x1f and 0x7f-0x7f in one instruction.
+PS_SCAN_SSE42_INLINE size_t _purrsock_scan_field_value_sse42(const char *buf, size_t size) {
+  const __m128i ranges = _mm_setr_epi8(0x00, 0x08, 0x0a, 0x1f, 0x7f, 0x7f, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    __m128i bytes = _mm_loadu_si128((const __m128i *)(buf + i));
+    int found = _mm_cmpestri(ranges, 6, bytes, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+    if (found != 16) return i + (size_t)found;
+  }
+  return i + _purrsock_scan_field_value_scalar(buf + i, size - i);
+}
+
+PS_SCAN_SSE42_INLINE void _purrsock_scan_mask_sse42(char *dst, const char *src, size_t size, uint32_t key) {
+  const __m128i wide_key = _mm_set1_epi32((int)key);
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(_mm_loadu_si128((const __m128i *)(src + i)), wide_key));
+  }
+  _purrsock_scan_mask_scalar(dst + i, src + i, size - i, key);
+}
+
+__attribute__((target("avx2")))
+static size_t _purrsock_scan_find_avx2(const char *buf, size_t size, const char *needle, size_t needle_size) {
+  if (needle_size == 1) return _purrsock_scan_find_scalar(buf, size, needle, needle_size);
+  const __m256i first = _mm256_set1_epi8(needle[0]);
+  const __m256i last = _mm256_set1_epi8(needle[needle_size - 1]);
+  size_t i = 0;
+  for (; i + needle_size - 1 + 32 <= size; i += 32) {
+    __m256i head = _mm256_loadu_si256((const __m256i *)(buf + i));
+    __m256i tail = _mm256_loadu_si256((const __m256i *)(buf + i + needle_size - 1));
+    unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(head, first), _mm256_cmpeq_epi8(tail, last)));
+    for (; mask; mask &= mask - 1) {
+      size_t at = i + (size_t)__builtin_ctz(mask);
+      if (memcmp(buf + at + 1, needle + 1, needle_size - 2) == 0) return at;
+    }
+  }
+  return i + _purrsock_scan_find_sse42(buf + i, size - i, needle, needle_size);
+}
+
+// VPSHUFB shuffles within each 128-bit lane, so both lanes hold the same nibble tables.
+__attribute__((target("avx2")))
+static size_t _purrsock_scan_token_avx2(const char *buf, size_t size) {
+  const __m256i low_table = _mm256_setr_epi8(PS_SCAN_TCHAR_LOW, PS_SCAN_TCHAR_LOW);
+  const __m256i high_table = _mm256_setr_epi8(PS_SCAN_TCHAR_HIGH, PS_SCAN_TCHAR_HIGH);
+  const __m256i nibble = _mm256_set1_epi8(0x0f);
+  size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    __m256i bytes = _mm256_loadu_si256((const __m256i *)(buf + i));
+    __m256i low = _mm256_shuffle_epi8(low_table, _mm256_and_si256(bytes, nibble));
+    __m256i high = _mm256_shuffle_epi8(high_table, _mm256_and_si256(_mm256_srli_epi16(bytes, 4), nibble));
+    unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(low, high), _mm256_setzero_si256()));
+    if (mask) return i + (size_t)__builtin_ctz(mask);
+  }
+  return i + _purrsock_scan_token_sse42(buf + i, size - i);
+}
+
+// Plain compares beat PCMPESTRI at this width: a byte is a control character when min(byte, 0x1f) is the byte.
+__attribute__((target("avx2")))
+static size_t _purrsock_scan_field_value_avx2(const char *buf, size_t size) {
+  const __m256i ctl_max = _mm256_set1_epi8(0x1f);
+  const __m256i tab = _mm256_set1_epi8('\t');
+  const __m256i del = _mm256_set1_epi8(0x7f);
+  size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    __m256i bytes = _mm256_loadu_si256((const __m256i *)(buf + i));
+    __m256i ctl = _mm256_cmpeq_epi8(_mm256_min_epu8(bytes, ctl_max), bytes);
+    ctl = _mm256_or_si256(_mm256_andnot_si256(_mm256_cmpeq_epi8(bytes, tab), ctl), _mm256_cmpeq_epi8(bytes, del));
+    unsigned mask = (unsigned)_mm256_movemask_epi8(ctl);
+    if (mask) return i + (size_t)__builtin_ctz(mask);
+  }
+  return i + _purrsock_scan_field_value_sse42(buf + i, size - i);
+}
+
+__attribute__((target("avx2")))
+static void _purrsock_scan_mask_avx2(char *dst, const char *src, size_t size, uint32_t key) {
+  const __m256i wide_key = _mm256_set1_epi32((int)key);
+  size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(src + i)), wide_key));
+  }
+  _purrsock_scan_mask_sse42(dst + i, src + i, size - i, key);
+}
+
+#endif
+
+static const _purrsock_scanner_t s_scanners[] = {
+  { _purrsock_scan_find_scalar, _purrsock_scan_token_scalar, _purrsock_scan_field_value_scalar, _purrsock_scan_mask_scalar, PS_SCAN_SCALAR },
+#ifdef PS_SCAN_X86
+  { _purrsock_scan_find_sse42, _purrsock_scan_token_sse42, _purrsock_scan_field_value_sse42, _purrsock_scan_mask_sse42, PS_SCAN_SSE42 },
+  { _purrsock_scan_find_avx2, _purrsock_scan_token_avx2, _purrsock_scan_field_value_avx2, _purrsock_scan_mask_avx2, PS_SCAN_AVX2 },
+#endif
+};
+
+// Read on every scan, so other threads only ever see one of the tables above.
+static const _purrsock_scanner_t *s_scanner = &s_scanners[0];
+
+static const _purrsock_scanner_t *_purrsock_scanner(void) {
+  return __atomic_load_n(&s_scanner, __ATOMIC_RELAXED);
+}
+
+static bool _purrsock_scan_supported(ps_scan_isa_t isa) {
+  switch (isa) {
+  case PS_SCAN_SCALAR:
+    return true;
+#ifdef PS_SCAN_X86
+  // These also check that the operating system saves the vector registers.
+  case PS_SCAN_SSE42:
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.2");
+  case PS_SCAN_AVX2:
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+  default:
+    return false;
+  }
+}
+
+void _purrsock_scan_init() {
+  size_t best = 0;
+  for (size_t i = 1; i < sizeof(s_scanners) / sizeof(s_scanners[0]); ++i) {
+    if (_purrsock_scan_supported(s_scanners[i].isa)) best = i;
+  }
+  __atomic_store_n(&s_scanner, &s_scanners[best], __ATOMIC_RELAXED);
+}
+
+ps_scan_isa_t _purrsock_scan_get_isa() {
+  return _purrsock_scanner()->isa;
+}
+
+bool _purrsock_scan_set_isa(ps_scan_isa_t isa) {
+  if (!_purrsock_scan_supported(isa)) return false;
+  for (size_t i = 0; i < sizeof(s_scanners) / sizeof(s_scanners[0]); ++i) {
+    if (s_scanners[i].isa == isa) __atomic_store_n(&s_scanner, &s_scanners[i], __ATOMIC_RELAXED);
+  }
+  return true;
+}
+
+size_t _purrsock_scan_find(const char *buf, size_t size, const char *needle, size_t needle_size) {
+  return _purrsock_scanner()->find(buf, size, needle, needle_size);
+}
+
+size_t _purrsock_scan_token(const char *buf, size_t size) {
+  return _purrsock_scanner()->token(buf, size);
+}
+
+size_t _purrsock_scan_field_value(const char *buf, size_t size) {
+  return _purrsock_scanner()->field_value(buf, size);
+}
+
+void _purrsock_scan_mask(char *dst, const char *src, size_t size, uint32_t key) {
+  _purrsock_scanner()->mask(dst, src, size, key);
+}
@@ -0,0 +1,163 @@
+// Copyright (c) 2024 ClawsoftSolutions. All rights reserved.
+//
+// This software is licensed under the MIT License.
+// See LICENSE file for more information.
+//
+
+
+
+#include "internal.h"
+
+#include <stdlib.h>
+#include <assert.h>
+
+typedef struct {
+  _purrsock_server_t *server;
+  ps_socket_t listener;
+  ps_loop_t loop;
+  _purrsock_thread_t thread;
+  ps_result_t result;              // Error the worker's loop stopped with.
+} _purrsock_server_worker_t;
+
+struct _purrsock_server_s {
+  ps_server_options_t options;
+  _purrsock_server_worker_t *workers;
+  size_t worker_count;
+  ps_port_t port;
+  size_t started;                  // Worker threads running.
+  bool stopping;
+};
+
+static void _purrsock_server_worker_main(void *arg) {
+  _purrsock_server_worker_t *worker = (_purrsock_server_worker_t *)arg;
+
+  // `ps_loop_stop` wakes the loop, so a stop between the check and the wait is not missed.
+  while (!__atomic_load_n(&worker->server->stopping, __ATOMIC_ACQUIRE)) {
+    ps_result_t result = ps_loop_run_once(worker->loop, -1);
+    if (result != PS_SUCCESS) {
+      worker->result = result;
+      break;
+    }
+  }
+}
+
+static ps_result_t _purrsock_server_open_worker(_purrsock_server_t *server, _purrsock_server_worker_t *worker, ps_address_t address, const char *ip, ps_port_t port) {
+  worker->server = server;
+
+  ps_result_t result = ps_create_socket(&worker->listener, PS_PROTOCOL_TCP, address);
+  if (result != PS_SUCCESS) return result;
+
+  // Only one listener does not need to share its port, which also keeps single-worker servers portable.
+  if (server->worker_count > 1) {
+    result = ps_set_socket_reuseport(worker->listener, true);
+    if (result != PS_SUCCESS) return result;
+  }
+  result = ps_bind_socket(worker->listener, ip, port);
+  if (result != PS_SUCCESS) return result;
+  result = ps_listen_socket_backlog(worker->listener, server->options.backlog);
+  if (result != PS_SUCCESS) return result;
+
+  result = ps_create_loop_with_options(&worker->loop, &server->options.loop_options);
+  if (result != PS_SUCCESS) return result;
+
+  ps_loop_callbacks_t callbacks = {0};
+  callbacks.on_accept = server->options.on_accept;
+  callbacks.user_data = server->options.user_data;
+  return ps_loop_add_socket(worker->loop, worker->listener, callbacks);
+}
+
+ps_result_t _purrsock_create_server(_purrsock_server_t **server, ps_address_t address, const char *ip, ps_port_t port, const ps_server_options_t *options) {
+  assert(server && ip && options);
+  if (!options->on_accept) return PS_ERROR_INVALID_ARGUMENT;
+
+  _purrsock_server_t *new_server = (_purrsock_server_t *)calloc(1, sizeof(*new_server));
+  if (!new_server) return PS_ERROR_INTERNAL;
+  new_server->options = *options;
+  new_server->worker_count = options->workers ? options->workers : _purrsock_cpu_count();
+  new_server->workers = (_purrsock_server_worker_t *)calloc(new_server->worker_count, sizeof(*new_server->workers));
+  if (!new_server->workers) {
+    free(new_server);
+    return PS_ERROR_INTERNAL;
+  }
+
+  // The first listener settles the port, which matters when binding to port 0.
+  new_server->port = port;
+  for (size_t i = 0; i < new_server->worker_count; ++i) {
+    ps_result_t result = _purrsock_server_open_worker(new_server, &new_server->workers[i], address, ip, new_server->port);
+    if (result == PS_SUCCESS && i == 0) {
+      ps_endpoint_t endpoint;
+      result = ps_get_socket_endpoint(new_server->workers[0].listener, &endpoint);
+      new_server->port = endpoint.port;
+    }
+    if (result != PS_SUCCESS) {
+      _purrsock_destroy_server(new_server);
+      return result;
+    }
+  }
+
+  *server = new_server;
+  return PS_SUCCESS;
+}
+
+void _purrsock_destroy_server(_purrsock_server_t *server) {
+  assert(server);
+  _purrsock_server_stop(server);
+  for (size_t i = 0; i < server->worker_count; ++i) {
+    _purrsock_server_worker_t *worker = &server->workers[i];
+    if (worker->listener) ps_destroy_socket(worker->listener);
+    if (worker->loop) ps_destroy_loop(worker->loop);
+  }
+  free(server->workers);
+  free(server);
+}
+
+ps_result_t _purrsock_server_start(_purrsock_server_t *server) {
+  assert(server);
+  if (server->started) return PS_ERROR_INVALID_ARGUMENT;
+
+  server->stopping = false;
+  size_t cpu_count = _purrsock_cpu_count();
+  for (size_t i = 0; i < server->worker_count; ++i) {
+    _purrsock_server_worker_t *worker = &server->workers[i];
+    worker->result = PS_SUCCESS;
+    ps_result_t result = _purrsock_thread_create(&worker->thread, _purrsock_server_worker_main, worker);
+    if (result != PS_SUCCESS) {
+      _purrsock_server_stop(server);
+      return result;
+    }
+    server->started++;
+    if (server->options.pin_workers) _purrsock_thread_pin(worker->thread, i % cpu_count);
+  }
+  return PS_SUCCESS;
+}
+
+ps_result_t _purrsock_server_stop(_purrsock_server_t *server) {
+  assert(server);
+  __atomic_store_n(&server->stopping, true, __ATOMIC_RELEASE);
+  for (size_t i = 0; i < server->started; ++i) {
+    ps_loop_stop(server->workers[i].loop);
+  }
+
+  ps_result_t result = PS_SUCCESS;
+  for (size_t i = 0; i < server->started; ++i) {
+    _purrsock_thread_join(server->workers[i].thread);
+    if (result == PS_SUCCESS) result = server->workers[i].result;
+  }
+  server->started = 0;
+  return result;
+}
+
+ps_port_t _purrsock_server_get_port(_purrsock_server_t *server) {
+  assert(server);
+  return server->port;
+}
+
+size_t _purrsock_server_get_worker_count(_purrsock_server_t *server) {
+  assert(server);
+  return server->worker_count;
+}
+
+ps_loop_t _purrsock_server_get_loop(_purrsock_server_t *server, size_t worker) {
+  assert(server && worker < server->worker_count);
+  return server->workers[worker].loop;
+}
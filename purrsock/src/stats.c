@@ -0,0 +1,189 @@
+// Copyright (c) 2024 ClawsoftSolutions. All rights reserved.
+//
+// This software is licensed under the MIT License.
+// See LICENSE file for more information.
+//
+
+
+
+#include "internal.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+// Histograms are log-linear: values below 8 get a bucket each, every power of two above is split into
+// 8 buckets, so a bucket is never wider than 1/8 of its values. The last bucket also takes anything larger.
+#define PS_LATENCY_SUB_BITS 3
+#define PS_LATENCY_SUB_COUNT (1 << PS_LATENCY_SUB_BITS)
+
+static uint64_t _purrsock_latency_bucket_max(size_t bucket) {
+  if (bucket < PS_LATENCY_SUB_COUNT) return bucket;
+  int shift = (int)(bucket / PS_LATENCY_SUB_COUNT) - 1;
+  uint64_t lowest = (uint64_t)(PS_LATENCY_SUB_COUNT + bucket % PS_LATENCY_SUB_COUNT) << shift;
+  return lowest + ((uint64_t)1 << shift) - 1;
+}
+
+uint64_t _purrsock_latency_percentile(const ps_latency_histogram_t *histogram, double percentile) {
+  if (!histogram->count) return 0;
+  if (percentile <= 0) percentile = 0;
+  if (percentile >= 100) return histogram->max_ns;
+
+  // Rank of the value asked for, counting from 1; the answer is the highest value its bucket can hold.
+  double exact = percentile / 100 * (double)histogram->count;
+  uint64_t rank = (uint64_t)exact;
+  if ((double)rank < exact || !rank) rank++;
+  uint64_t seen = 0;
+  for (size_t i = 0; i < PS_LATENCY_BUCKETS; ++i) {
+    seen += histogram->buckets[i];
+    if (seen >= rank) {
+      uint64_t value = _purrsock_latency_bucket_max(i);
+      return value < histogram->max_ns ? value : histogram->max_ns;
+    }
+  }
+  return histogram->max_ns;
+}
+
+#ifdef PURRSOCK_STATS
+
+// Every counter has a single writer: the socket's reading or sending thread, or the shard's thread. Relaxed
+// loads and stores keep snapshots from other threads tear-free without paying for locked adds.
+#define PS_STATS_ADD(field, value) \
+  __atomic_store_n(&(field), __atomic_load_n(&(field), __ATOMIC_RELAXED) + (value), __ATOMIC_RELAXED)
+#define PS_STATS_GET(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+
+struct _purrsock_stats_shard_s {
+  ps_stats_t stats;
+  _purrsock_stats_shard_t *next;
+};
+
+// Shards outlive their threads, so I/O of threads that exited stays in the totals.
+static _purrsock_stats_shard_t *s_shards;
+static PS_THREAD_LOCAL _purrsock_stats_shard_t *s_shard;
+
+_purrsock_stats_shard_t *_purrsock_stats_thread_shard() {
+  if (s_shard) return s_shard;
+  _purrsock_stats_shard_t *shard = (_purrsock_stats_shard_t *)calloc(1, sizeof(*shard));
+  if (!shard) return NULL;
+  shard->next = __atomic_load_n(&s_shards, __ATOMIC_RELAXED);
+  while (!__atomic_compare_exchange_n(&s_shards, &shard->next, shard, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+  s_shard = shard;
+  return shard;
+}
+
+static size_t _purrsock_latency_bucket(uint64_t ns) {
+  if (ns < PS_LATENCY_SUB_COUNT) return (size_t)ns;
+  int exponent = 63 - __builtin_clzll(ns);
+  size_t bucket = (size_t)(exponent - PS_LATENCY_SUB_BITS + 1) * PS_LATENCY_SUB_COUNT +
+                  (size_t)((ns >> (exponent - PS_LATENCY_SUB_BITS)) & (PS_LATENCY_SUB_COUNT - 1));
+  return bucket < PS_LATENCY_BUCKETS ? bucket : PS_LATENCY_BUCKETS - 1;
+}
+
+static void _purrsock_stats_record(ps_latency_histogram_t *histogram, uint64_t ns) {
+  PS_STATS_ADD(histogram->count, 1);
+  PS_STATS_ADD(histogram->total_ns, ns);
+  PS_STATS_ADD(histogram->buckets[_purrsock_latency_bucket(ns)], 1);
+  if (ns > PS_STATS_GET(histogram->max_ns)) __atomic_store_n(&histogram->max_ns, ns, __ATOMIC_RELAXED);
+}
+
+// Both run between a failed call and the translation of its errno, so they keep errno intact.
+void _purrsock_stats_syscall(_purrsock_socket_t *socket, bool send, bool wouldblock, uint64_t start_ns) {
+  uint64_t ns = _purrsock_monotonic_ns() - start_ns;
+  int saved_errno = errno;
+  _purrsock_stats_shard_t *shard = _purrsock_stats_thread_shard();
+  errno = saved_errno;
+  if (send) {
+    PS_STATS_ADD(socket->stats.send_calls, 1);
+    if (wouldblock) PS_STATS_ADD(socket->stats.send_wouldblocks, 1);
+    if (!shard) return;
+    PS_STATS_ADD(shard->stats.io.send_calls, 1);
+    if (wouldblock) PS_STATS_ADD(shard->stats.io.send_wouldblocks, 1);
+    _purrsock_stats_record(&shard->stats.send_latency, ns);
+  } else {
+    PS_STATS_ADD(socket->stats.read_calls, 1);
+    if (wouldblock) PS_STATS_ADD(socket->stats.read_wouldblocks, 1);
+    if (!shard) return;
+    PS_STATS_ADD(shard->stats.io.read_calls, 1);
+    if (wouldblock) PS_STATS_ADD(shard->stats.io.read_wouldblocks, 1);
+    _purrsock_stats_record(&shard->stats.read_latency, ns);
+  }
+}
+
+void _purrsock_stats_transfer(_purrsock_socket_t *socket, bool send, uint64_t bytes, uint64_t packets) {
+  int saved_errno = errno;
+  _purrsock_stats_shard_t *shard = _purrsock_stats_thread_shard();
+  errno = saved_errno;
+  if (send) {
+    PS_STATS_ADD(socket->stats.bytes_sent, bytes);
+    PS_STATS_ADD(socket->stats.packets_sent, packets);
+    if (!shard) return;
+    PS_STATS_ADD(shard->stats.io.bytes_sent, bytes);
+    PS_STATS_ADD(shard->stats.io.packets_sent, packets);
+  } else {
+    PS_STATS_ADD(socket->stats.bytes_read, bytes);
+    PS_STATS_ADD(socket->stats.packets_read, packets);
+    if (!shard) return;
+    PS_STATS_ADD(shard->stats.io.bytes_read, bytes);
+    PS_STATS_ADD(shard->stats.io.packets_read, packets);
+  }
+}
+
+static void _purrsock_socket_stats_add(ps_socket_stats_t *total, const ps_socket_stats_t *stats) {
+  total->bytes_read += PS_STATS_GET(stats->bytes_read);
+  total->bytes_sent += PS_STATS_GET(stats->bytes_sent);
+  total->packets_read += PS_STATS_GET(stats->packets_read);
+  total->packets_sent += PS_STATS_GET(stats->packets_sent);
+  total->read_calls += PS_STATS_GET(stats->read_calls);
+  total->send_calls += PS_STATS_GET(stats->send_calls);
+  total->read_wouldblocks += PS_STATS_GET(stats->read_wouldblocks);
+  total->send_wouldblocks += PS_STATS_GET(stats->send_wouldblocks);
+}
+
+static void _purrsock_latency_histogram_add(ps_latency_histogram_t *total, const ps_latency_histogram_t *histogram) {
+  total->count += PS_STATS_GET(histogram->count);
+  total->total_ns += PS_STATS_GET(histogram->total_ns);
+  uint64_t max_ns = PS_STATS_GET(histogram->max_ns);
+  if (max_ns > total->max_ns) total->max_ns = max_ns;
+  for (size_t i = 0; i < PS_LATENCY_BUCKETS; ++i) total->buckets[i] += PS_STATS_GET(histogram->buckets[i]);
+}
+
+static void _purrsock_stats_add(ps_stats_t *total, const ps_stats_t *stats) {
+  _purrsock_socket_stats_add(&total->io, &stats->io);
+  _purrsock_latency_histogram_add(&total->read_latency, &stats->read_latency);
+  _purrsock_latency_histogram_add(&total->send_latency, &stats->send_latency);
+}
+
+ps_result_t _purrsock_get_socket_stats(_purrsock_socket_t *socket, ps_socket_stats_t *stats) {
+  memset(stats, 0, sizeof(*stats));
+  _purrsock_socket_stats_add(stats, &socket->stats);
+  return PS_SUCCESS;
+}
+
+ps_result_t _purrsock_get_shard_stats(_purrsock_stats_shard_t *shard, ps_stats_t *stats) {
+  memset(stats, 0, sizeof(*stats));
+  if (shard) _purrsock_stats_add(stats, &shard->stats);
+  return PS_SUCCESS;
+}
+
+ps_result_t _purrsock_get_stats(ps_stats_t *stats) {
+  memset(stats, 0, sizeof(*stats));
+  for (_purrsock_stats_shard_t *shard = __atomic_load_n(&s_shards, __ATOMIC_ACQUIRE); shard; shard = shard->next) {
+    _purrsock_stats_add(stats, &shard->stats);
+  }
+  return PS_SUCCESS;
+}
+
+#else
+
+ps_result_t _purrsock_get_socket_stats(_purrsock_socket_t *socket, ps_socket_stats_t *stats) {
+  (void)socket;
+  memset(stats, 0, sizeof(*stats));
+  return PS_ERROR_UNSUPPORTED;
+}
+
+ps_result_t _purrsock_get_stats(ps_stats_t *stats) {
+  memset(stats, 0, sizeof(*stats));
+  return PS_ERROR_UNSUPPORTED;
+}
+
+#endif
@@ -0,0 +1,197 @@
+// Copyright (c) 2024 ClawsoftSolutions. All rights reserved.
+//
+// This software is licensed under the MIT License.
+// See LICENSE file for more information.
+//
+
+
+
+#include "internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define PS_STREAM_DEFAULT_BUFFER_SIZE (16 * 1024)
+
+struct _purrsock_buffered_stream_s {
+  _purrsock_socket_t *socket;
+  _purrsock_loop_t *loop;        // Loop flushing the stream every iteration, NULL if none.
+  char *read_buf;
+  size_t read_capacity;
+  size_t read_start;             // Buffered read data is `read_buf[read_start, read_end)`.
+  size_t read_end;
+  char *write_buf;
+  size_t write_capacity;
+  size_t write_start;            // Buffered write data is `write_buf[write_start, write_size)`, the rest already went out.
+  size_t write_size;
+  ps_result_t deferred_error;    // Failure of a flush run by the loop, reported by the next write or flush.
+};
+
+static size_t _purrsock_buffered_stream_unsent(_purrsock_buffered_stream_t *stream) {
+  return stream->write_size - stream->write_start + (stream->socket->unsent_size - stream->socket->unsent_offset);
+}
+
+// Keeps `packet` after the buffered writes, moving them to the front of the buffer first.
+static bool _purrsock_buffered_stream_append(_purrsock_buffered_stream_t *stream, ps_packet_t packet) {
+  size_t buffered = stream->write_size - stream->write_start;
+  if (stream->write_capacity - buffered < packet.size) return false;
+  if (stream->write_start) memmove(stream->write_buf, stream->write_buf + stream->write_start, buffered);
+  memcpy(stream->write_buf + buffered, packet.buf, packet.size);
+  stream->write_start = 0;
+  stream->write_size = buffered + packet.size;
+  return true;
+}
+
+// Sends the buffered writes followed by `extra`, which may be empty, in one call. A non-blocking socket that
+// fills up never blocks: the rest of the buffer stays buffered, and `extra` is either not taken, with
+// `PS_ERROR_WOULDBLOCK`, or, once part of it went out, kept whole.
+static ps_result_t _purrsock_buffered_stream_send(_purrsock_buffered_stream_t *stream, ps_packet_t extra) {
+  // Bytes the socket kept from an earlier send precede everything buffered here.
+  ps_result_t result = _purrsock_flush_socket(stream->socket);
+  if (result != PS_SUCCESS) {
+    if (result == PS_ERROR_WOULDBLOCK && extra.size && _purrsock_buffered_stream_append(stream, extra)) return PS_SUCCESS;
+    return result;
+  }
+
+  size_t buffered = stream->write_size - stream->write_start;
+  ps_packet_t slices[2] = { { buffered, stream->write_buf + stream->write_start, buffered }, extra };
+  size_t count = extra.size ? 2 : 1;
+  size_t total = buffered + extra.size;
+
+  // Past the write buffer's size a flush may take several partial sends; cork so that with TCP_NODELAY
+  // each one does not end in a short segment. Small flushes are a single send and skip the two setsockopts.
+  bool corked = total > stream->write_capacity && _purrsock_set_socket_cork(stream->socket, true) == PS_SUCCESS;
+  size_t sent = 0;
+  result = _purrsock_send_stream_partial(stream->socket, slices, count, &sent);
+  if (corked) _purrsock_set_socket_cork(stream->socket, false);
+
+  if (sent < total && sent <= buffered) {
+    stream->write_start += sent;
+    if (result == PS_ERROR_WOULDBLOCK && extra.size && _purrsock_buffered_stream_append(stream, extra)) return PS_SUCCESS;
+    return result;
+  }
+  stream->write_start = stream->write_size = 0;
+  if (sent == total || result != PS_ERROR_WOULDBLOCK) return result;
+
+  // Part of `extra` is out, so the rest has to follow: keep it in the buffer, or on the socket if it is larger.
+  ps_packet_t rest = { total - sent, extra.buf + (sent - buffered), total - sent };
+  if (_purrsock_buffered_stream_append(stream, rest)) return PS_SUCCESS;
+  char *unsent = _purrsock_reserve_unsent(stream->socket, rest.size);
+  if (!unsent) return PS_ERROR_INTERNAL;
+  memcpy(unsent, rest.buf, rest.size);
+  return PS_SUCCESS;
+}
+
+static void _purrsock_buffered_stream_tick(ps_loop_t loop, void *user_data) {
+  (void)loop;
+  _purrsock_buffered_stream_t *stream = (_purrsock_buffered_stream_t *)user_data;
+  if (!_purrsock_buffered_stream_unsent(stream) || stream->deferred_error != PS_SUCCESS) return;
+
+  // What a full socket does not take stays buffered and is sent again after the next iteration, or earlier
+  // by a write or flush; flushing from the socket's on_write callback resumes as soon as there is room.
+  ps_result_t result = _purrsock_buffered_stream_send(stream, (ps_packet_t){0});
+  if (result != PS_SUCCESS && result != PS_ERROR_WOULDBLOCK) stream->deferred_error = result;
+}
+
+ps_result_t _purrsock_create_buffered_stream(_purrsock_buffered_stream_t **stream, _purrsock_socket_t *socket, const ps_buffered_stream_options_t *options) {
+  assert(stream && socket);
+  if (_purrsock_is_datagram(socket->protocol)) return PS_ERROR_INVALID_ARGUMENT;
+
+  ps_buffered_stream_options_t defaults = {0};
+  if (!options) options = &defaults;
+
+  ps_result_t result = _purrsock_set_socket_nodelay(socket, true);
+  if (result != PS_SUCCESS) return result;
+
+  _purrsock_buffered_stream_t *new_stream = (_purrsock_buffered_stream_t *)calloc(1, sizeof(*new_stream));
+  if (!new_stream) return PS_ERROR_INTERNAL;
+  new_stream->socket = socket;
+  new_stream->read_capacity = options->read_buffer_size ? options->read_buffer_size : PS_STREAM_DEFAULT_BUFFER_SIZE;
+  new_stream->write_capacity = options->write_buffer_size ? options->write_buffer_size : PS_STREAM_DEFAULT_BUFFER_SIZE;
+  new_stream->read_buf = (char *)malloc(new_stream->read_capacity);
+  new_stream->write_buf = (char *)malloc(new_stream->write_capacity);
+  if (!new_stream->read_buf || !new_stream->write_buf) {
+    _purrsock_destroy_buffered_stream(new_stream);
+    return PS_ERROR_INTERNAL;
+  }
+
+  if (options->loop) {
+    result = _purrsock_loop_add_tick((_purrsock_loop_t *)options->loop, _purrsock_buffered_stream_tick, new_stream);
+    if (result != PS_SUCCESS) {
+      _purrsock_destroy_buffered_stream(new_stream);
+      return result;
+    }
+    new_stream->loop = (_purrsock_loop_t *)options->loop;
+  }
+
+  *stream = new_stream;
+  return PS_SUCCESS;
+}
+
+void _purrsock_destroy_buffered_stream(_purrsock_buffered_stream_t *stream) {
+  assert(stream);
+  if (stream->loop) _purrsock_loop_remove_tick(stream->loop, _purrsock_buffered_stream_tick, stream);
+  if (_purrsock_buffered_stream_unsent(stream) && stream->deferred_error == PS_SUCCESS) _purrsock_buffered_stream_send(stream, (ps_packet_t){0});
+  free(stream->read_buf);
+  free(stream->write_buf);
+  free(stream);
+}
+
+ps_result_t _purrsock_buffered_stream_read(_purrsock_buffered_stream_t *stream, ps_packet_t *packet) {
+  assert(stream && packet && packet->buf);
+
+  if (stream->read_start == stream->read_end) {
+    // Nothing buffered, so this read may wait: make sure the peer has everything it might be waiting for.
+    if (_purrsock_buffered_stream_unsent(stream)) {
+      ps_result_t result = _purrsock_buffered_stream_flush(stream);
+      if (result != PS_SUCCESS && result != PS_ERROR_WOULDBLOCK) return result;
+    }
+
+    if (packet->capacity >= stream->read_capacity) {
+      return _purrsock_read_socket_packet(stream->socket, packet, NULL);
+    }
+
+    ps_packet_t ahead = { 0, stream->read_buf, stream->read_capacity };
+    ps_result_t result = _purrsock_read_socket_packet(stream->socket, &ahead, NULL);
+    if (result != PS_SUCCESS) return result;
+    stream->read_start = 0;
+    stream->read_end = ahead.size;
+  }
+
+  size_t size = stream->read_end - stream->read_start;
+  if (size > packet->capacity) size = packet->capacity;
+  memcpy(packet->buf, stream->read_buf + stream->read_start, size);
+  packet->size = size;
+  stream->read_start += size;
+  return PS_SUCCESS;
+}
+
+ps_result_t _purrsock_buffered_stream_write(_purrsock_buffered_stream_t *stream, ps_packet_t packet) {
+  assert(stream);
+  if (stream->deferred_error != PS_SUCCESS) return stream->deferred_error;
+  if (!packet.size) return PS_SUCCESS;
+
+  if (stream->write_capacity - stream->write_size >= packet.size) {
+    memcpy(stream->write_buf + stream->write_size, packet.buf, packet.size);
+    stream->write_size += packet.size;
+    return PS_SUCCESS;
+  }
+
+  // Does not fit: the buffer and the packet leave together, without copying the packet.
+  return _purrsock_buffered_stream_send(stream, packet);
+}
+
+ps_result_t _purrsock_buffered_stream_flush(_purrsock_buffered_stream_t *stream) {
+  assert(stream);
+  if (stream->deferred_error != PS_SUCCESS) return stream->deferred_error;
+  if (!_purrsock_buffered_stream_unsent(stream)) return PS_SUCCESS;
+  ps_result_t result = _purrsock_buffered_stream_send(stream, (ps_packet_t){0});
+  if (result == PS_SUCCESS && _purrsock_buffered_stream_unsent(stream)) return PS_ERROR_WOULDBLOCK;
+  return result;
+}
+
+size_t _purrsock_buffered_stream_pending(_purrsock_buffered_stream_t *stream) {
+  assert(stream);
+  return _purrsock_buffered_stream_unsent(stream);
+}
@@ -0,0 +1,134 @@
+// Copyright (c) 2024 ClawsoftSolutions. All rights reserved.
+//
+// This software is licensed under the MIT License.
+// See LICENSE file for more information.
+//
+
+
+
+#include "internal.h"
+
+#include <string.h>
+#include <assert.h>
+
+// Invariant: an occupied slot of level L is always ahead of the current time's bits at that level, so the
+// earliest time anything is due at a level is the start of its first occupied slot. The wheel jumps straight
+// from one such time to the next; at each, the due slot's timers either run or move down a level.
+
+static int _purrsock_timer_wheel_level(uint64_t current, uint64_t expires) {
+  uint64_t diff = current ^ expires;
+  int level = 0;
+  while (level < PS_TIMER_WHEEL_LEVELS - 1 && diff >> (PS_TIMER_WHEEL_BITS * (level + 1))) level++;
+  return level;
+}
+
+static uint64_t _purrsock_timer_wheel_slot_time(uint64_t current, int level, int slot) {
+  int shift = PS_TIMER_WHEEL_BITS * level;
+  int upper = shift + PS_TIMER_WHEEL_BITS;
+  uint64_t prefix = upper < 64 ? (current >> upper) << upper : 0;
+  return prefix | ((uint64_t)slot << shift);
+}
+
+static int _purrsock_timer_wheel_lowest_bit(uint64_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_ctzll(bits);
+#else
+  int index = 0;
+  while (!(bits & 1)) {
+    bits >>= 1;
+    index++;
+  }
+  return index;
+#endif
+}
+
+void _purrsock_timer_wheel_init(_purrsock_timer_wheel_t *wheel, uint64_t now) {
+  assert(wheel);
+  memset(wheel, 0, sizeof(*wheel));
+  wheel->current = now;
+}
+
+void _purrsock_timer_wheel_add(_purrsock_timer_wheel_t *wheel, ps_timer_t *timer, uint64_t expires) {
+  assert(wheel && timer && !timer->prev);
+  // Ticks are whole milliseconds: anything due now runs at the next one.
+  if (expires <= wheel->current) expires = wheel->current + 1;
+
+  int level = _purrsock_timer_wheel_level(wheel->current, expires);
+  int slot = (int)((expires >> (PS_TIMER_WHEEL_BITS * level)) & (PS_TIMER_WHEEL_SLOTS - 1));
+  uint32_t index = (uint32_t)(level * PS_TIMER_WHEEL_SLOTS + slot);
+
+  timer->expires = expires;
+  timer->slot = index;
+  timer->next = wheel->slots[index];
+  if (timer->next) timer->next->prev = &timer->next;
+  timer->prev = &wheel->slots[index];
+  wheel->slots[index] = timer;
+  wheel->occupied[level] |= (uint64_t)1 << slot;
+  wheel->count++;
+}
+
+void _purrsock_timer_wheel_remove(_purrsock_timer_wheel_t *wheel, ps_timer_t *timer) {
+  assert(wheel && timer);
+  if (!timer->prev) return;
+
+  *timer->prev = timer->next;
+  if (timer->next) timer->next->prev = timer->prev;
+  timer->next = NULL;
+  timer->prev = NULL;
+  wheel->count--;
+
+  // Timers being expired were detached from their slot, which may meanwhile hold others again.
+  if (!wheel->slots[timer->slot]) {
+    wheel->occupied[timer->slot / PS_TIMER_WHEEL_SLOTS] &= ~((uint64_t)1 << (timer->slot % PS_TIMER_WHEEL_SLOTS));
+  }
+}
+
+uint64_t _purrsock_timer_wheel_next(_purrsock_timer_wheel_t *wheel) {
+  assert(wheel);
+  uint64_t next = UINT64_MAX;
+  if (!wheel->count) return next;
+
+  for (int level = 0; level < PS_TIMER_WHEEL_LEVELS; ++level) {
+    if (!wheel->occupied[level]) continue;
+    uint64_t time = _purrsock_timer_wheel_slot_time(wheel->current, level, _purrsock_timer_wheel_lowest_bit(wheel->occupied[level]));
+    if (time < next) next = time;
+  }
+  return next;
+}
+
+static void _purrsock_timer_wheel_expire_slot(_purrsock_timer_wheel_t *wheel, int level, int slot, ps_loop_t loop) {
+  uint32_t index = (uint32_t)(level * PS_TIMER_WHEEL_SLOTS + slot);
+
+  // Detach the slot, so callbacks may stop any of its timers or start new ones while it is walked.
+  ps_timer_t *pending = wheel->slots[index];
+  wheel->slots[index] = NULL;
+  wheel->occupied[level] &= ~((uint64_t)1 << slot);
+  pending->prev = &pending;
+
+  while (pending) {
+    ps_timer_t *timer = pending;
+    uint64_t expires = timer->expires;
+    _purrsock_timer_wheel_remove(wheel, timer);
+    if (expires <= wheel->current) {
+      timer->callback(loop, timer, timer->user_data);
+    } else {
+      _purrsock_timer_wheel_add(wheel, timer, expires);
+    }
+  }
+}
+
+void _purrsock_timer_wheel_advance(_purrsock_timer_wheel_t *wheel, uint64_t now, ps_loop_t loop) {
+  assert(wheel);
+  while (wheel->count) {
+    uint64_t next = _purrsock_timer_wheel_next(wheel);
+    if (next > now) break;
+
+    // Higher levels first: their timers due right now run, the rest settle into lower levels.
+    wheel->current = next;
+    for (int level = PS_TIMER_WHEEL_LEVELS - 1; level >= 0; --level) {
+      int slot = (int)((next >> (PS_TIMER_WHEEL_BITS * level)) & (PS_TIMER_WHEEL_SLOTS - 1));
+      if (wheel->occupied[level] & ((uint64_t)1 << slot)) _purrsock_timer_wheel_expire_slot(wheel, level, slot, loop);
+    }
+  }
+  if (now > wheel->current) wheel->current = now;
+}
@@ -0,0 +1,769 @@
+// Copyright (c) 2024 ClawsoftSolutions. All rights reserved.
+//
+// This software is licensed under the MIT License.
+// See LICENSE file for more information.
+//
+
+
+
+#include "internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define PS_WEBSOCKET_DEFAULT_MAX_MESSAGE (16 * 1024 * 1024)
+#define PS_WEBSOCKET_DEFAULT_MAX_HANDSHAKE (8 * 1024)
+#define PS_WEBSOCKET_DEFAULT_CAPACITY 4096
+#define PS_WEBSOCKET_MAX_HEADER 14       // Two bytes, an 8-byte extended length and the masking key.
+#define PS_WEBSOCKET_MAX_CONTROL 125     // Payload of control frames (RFC 6455 5.5).
+#define PS_WEBSOCKET_KEY_SIZE 24         // Base64 of the 16 random bytes of Sec-WebSocket-Key.
+#define PS_WEBSOCKET_ACCEPT_SIZE 28      // Base64 of the SHA-1 of the key and the GUID.
+#define PS_WEBSOCKET_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+// Status codes of close frames (RFC 6455 7.4.1).
+#define PS_WEBSOCKET_CLOSE_PROTOCOL_ERROR 1002
+#define PS_WEBSOCKET_CLOSE_NO_STATUS 1005
+#define PS_WEBSOCKET_CLOSE_INVALID_DATA 1007
+#define PS_WEBSOCKET_CLOSE_TOO_BIG 1009
+
+#define PS_WEBSOCKET_FIN 0x80
+
+struct _purrsock_websocket_s {
+  _purrsock_socket_t *socket;
+  bool client;
+  size_t max_message_size;
+  size_t max_handshake_size;
+  char *host;                      // Client: Host header of the handshake.
+  char *path;                      // Request target; NULL on a server until the handshake is complete.
+  char key[PS_WEBSOCKET_KEY_SIZE + 1]; // Client: Sec-WebSocket-Key, once the request was sent.
+  bool open;                       // The handshake is complete.
+  bool close_sent;
+  bool close_received;
+  ps_result_t error;               // Failure that made the WebSocket unusable; returned from then on.
+  char *in;
+  size_t in_capacity;
+  size_t in_start;                 // Unread bytes are `in[in_start, in_end)`.
+  size_t in_end;
+  // Fragments are joined at `in_start`: the message so far takes `message_size` bytes there, and the next
+  // frame starts at `frame_offset`, after whatever the joined fragments' headers and control frames left.
+  size_t message_size;
+  size_t frame_offset;
+  bool in_message;
+  ps_websocket_opcode_t message_opcode;
+  bool sending_fragments;
+  // Framed bytes the socket had no room for yet are `out[out_start, out_size)`; clients also mask into it.
+  char *out;
+  size_t out_start;
+  size_t out_size;
+  size_t out_capacity;
+  char pong[PS_WEBSOCKET_MAX_HEADER + PS_WEBSOCKET_MAX_CONTROL]; // Framed pong waiting for `out` to drain.
+  size_t pong_size;
+  uint64_t seed;                   // xorshift state for masking keys, seeded from the system.
+};
+
+static uint32_t _purrsock_websocket_rotl(uint32_t x, int bits) {
+  return x << bits | x >> (32 - bits);
+}
+
+static void _purrsock_websocket_sha1_block(uint32_t state[5], const unsigned char *block) {
+  uint32_t w[80];
+  for (int i = 0; i < 16; ++i) {
+    w[i] = (uint32_t)block[4 * i] << 24 | (uint32_t)block[4 * i + 1] << 16 | (uint32_t)block[4 * i + 2] << 8 | block[4 * i + 3];
+  }
+  for (int i = 16; i < 80; ++i) w[i] = _purrsock_websocket_rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+  uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+  for (int i = 0; i < 80; ++i) {
+    uint32_t f, k;
+    if (i < 20) {
+      f = (b & c) | (~b & d);
+      k = 0x5a827999;
+    } else if (i < 40) {
+      f = b ^ c ^ d;
+      k = 0x6ed9eba1;
+    } else if (i < 60) {
+      f = (b & c) | (b & d) | (c & d);
+      k = 0x8f1bbcdc;
+    } else {
+      f = b ^ c ^ d;
+      k = 0xca62c1d6;
+    }
+    uint32_t t = _purrsock_websocket_rotl(a, 5) + f + e + k + w[i];
+    e = d;
+    d = c;
+    c = _purrsock_websocket_rotl(b, 30);
+    b = a;
+    a = t;
+  }
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+  state[4] += e;
+}
+
+// SHA-1 (RFC 3174), which the handshake uses to prove the server read the client's key.
+static void _purrsock_websocket_sha1(const char *data, size_t size, unsigned char digest[20]) {
+  uint32_t state[5] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+  size_t i = 0;
+  for (; i + 64 <= size; i += 64) _purrsock_websocket_sha1_block(state, (const unsigned char *)data + i);
+
+  // The rest, a 1 bit and the length in bits fill one or two more blocks.
+  unsigned char tail[128] = {0};
+  size_t rest = size - i;
+  memcpy(tail, data + i, rest);
+  tail[rest] = 0x80;
+  size_t tail_size = rest + 9 <= 64 ? 64 : 128;
+  uint64_t bits = (uint64_t)size * 8;
+  for (int byte = 0; byte < 8; ++byte) tail[tail_size - 1 - byte] = (unsigned char)(bits >> (8 * byte));
+  for (size_t block = 0; block < tail_size; block += 64) _purrsock_websocket_sha1_block(state, tail + block);
+
+  for (int word = 0; word < 5; ++word) {
+    for (int byte = 0; byte < 4; ++byte) digest[4 * word + byte] = (unsigned char)(state[word] >> (24 - 8 * byte));
+  }
+}
+
+// Writes the Base64 of `data` and a terminating NUL to `out`, which holds 4 * ceil(size / 3) + 1 bytes.
+static void _purrsock_websocket_base64(const unsigned char *data, size_t size, char *out) {
+  static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  for (size_t i = 0; i < size; i += 3) {
+    uint32_t group = (uint32_t)data[i] << 16 | (i + 1 < size ? (uint32_t)data[i + 1] << 8 : 0) | (i + 2 < size ? data[i + 2] : 0);
+    *out++ = alphabet[group >> 18];
+    *out++ = alphabet[group >> 12 & 63];
+    *out++ = i + 1 < size ? alphabet[group >> 6 & 63] : '=';
+    *out++ = i + 2 < size ? alphabet[group & 63] : '=';
+  }
+  *out = '\0';
+}
+
+// Sec-WebSocket-Accept for a Sec-WebSocket-Key, into `accept` of PS_WEBSOCKET_ACCEPT_SIZE + 1 bytes.
+static void _purrsock_websocket_accept_key(const char *key, char *accept) {
+  char text[PS_WEBSOCKET_KEY_SIZE + sizeof(PS_WEBSOCKET_GUID) - 1];
+  memcpy(text, key, PS_WEBSOCKET_KEY_SIZE);
+  memcpy(text + PS_WEBSOCKET_KEY_SIZE, PS_WEBSOCKET_GUID, sizeof(PS_WEBSOCKET_GUID) - 1);
+  unsigned char digest[20];
+  _purrsock_websocket_sha1(text, sizeof(text), digest);
+  _purrsock_websocket_base64(digest, sizeof(digest), accept);
+}
+
+// UTF-8 as RFC 3629 has it: no overlong forms, surrogates or code points past U+10FFFF. ASCII is skipped
+// eight bytes at a time, which is most of what dashboards send.
+static bool _purrsock_websocket_is_utf8(const char *buf, size_t size) {
+  const unsigned char *bytes = (const unsigned char *)buf;
+  size_t i = 0;
+  while (i < size) {
+    if (i + 8 <= size) {
+      uint64_t word;
+      memcpy(&word, bytes + i, 8);
+      if (!(word & 0x8080808080808080ull)) {
+        i += 8;
+        continue;
+      }
+    }
+    unsigned char lead = bytes[i];
+    if (lead < 0x80) {
+      i++;
+      continue;
+    }
+    size_t length;
+    uint32_t code_point, min;
+    if ((lead & 0xe0) == 0xc0) {
+      length = 2;
+      code_point = lead & 0x1f;
+      min = 0x80;
+    } else if ((lead & 0xf0) == 0xe0) {
+      length = 3;
+      code_point = lead & 0x0f;
+      min = 0x800;
+    } else if ((lead & 0xf8) == 0xf0) {
+      length = 4;
+      code_point = lead & 0x07;
+      min = 0x10000;
+    } else {
+      return false;
+    }
+    if (size - i < length) return false;
+    for (size_t k = 1; k < length; ++k) {
+      if ((bytes[i + k] & 0xc0) != 0x80) return false;
+      code_point = code_point << 6 | (bytes[i + k] & 0x3f);
+    }
+    if (code_point < min || code_point > 0x10ffff || (code_point >= 0xd800 && code_point <= 0xdfff)) return false;
+    i += length;
+  }
+  return true;
+}
+
+// Codes a close frame may carry; 1004-1006 and 1015 are only for reporting locally.
+static bool _purrsock_websocket_is_close_code(uint16_t code) {
+  return (code >= 1000 && code <= 1003) || (code >= 1007 && code <= 1014) || (code >= 3000 && code <= 4999);
+}
+
+static uint32_t _purrsock_websocket_mask_key(_purrsock_websocket_t *websocket) {
+  uint64_t x = websocket->seed;  // xorshift64*
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  websocket->seed = x;
+  return (uint32_t)((x * 0x2545f4914f6cdd1dull) >> 32);
+}
+
+// Writes the header of a frame with `size` bytes of payload; a client's comes with a new masking key.
+static size_t _purrsock_websocket_write_header(_purrsock_websocket_t *websocket, char *out, unsigned char first, size_t size, uint32_t *key) {
+  unsigned char masked = websocket->client ? 0x80 : 0;
+  size_t header_size = 0;
+  out[header_size++] = (char)first;
+  if (size < 126) {
+    out[header_size++] = (char)(masked | size);
+  } else if (size <= 0xffff) {
+    out[header_size++] = (char)(masked | 126);
+    out[header_size++] = (char)(size >> 8);
+    out[header_size++] = (char)size;
+  } else {
+    out[header_size++] = (char)(masked | 127);
+    for (int shift = 56; shift >= 0; shift -= 8) out[header_size++] = (char)((uint64_t)size >> shift);
+  }
+  if (masked) {
+    *key = _purrsock_websocket_mask_key(websocket);
+    memcpy(out + header_size, key, 4);
+    header_size += 4;
+  }
+  return header_size;
+}
+
+// Writes a whole frame to `out`, with the payload masked on a client.
+static size_t _purrsock_websocket_write_frame(_purrsock_websocket_t *websocket, char *out, unsigned char first, const char *payload, size_t size) {
+  uint32_t key = 0;
+  size_t header_size = _purrsock_websocket_write_header(websocket, out, first, size, &key);
+  if (websocket->client) {
+    _purrsock_scan_mask(out + header_size, payload, size, key);
+  } else if (size) {
+    memcpy(out + header_size, payload, size);
+  }
+  return header_size + size;
+}
+
+// Makes room for `size` more bytes at the end of `out`, first by dropping the bytes already sent.
+static ps_result_t _purrsock_websocket_reserve(_purrsock_websocket_t *websocket, size_t size) {
+  if (websocket->out_start) {
+    memmove(websocket->out, websocket->out + websocket->out_start, websocket->out_size - websocket->out_start);
+    websocket->out_size -= websocket->out_start;
+    websocket->out_start = 0;
+  }
+  if (websocket->out_capacity - websocket->out_size >= size) return PS_SUCCESS;
+  size_t capacity = websocket->out_capacity ? websocket->out_capacity : PS_WEBSOCKET_DEFAULT_CAPACITY;
+  while (capacity - websocket->out_size < size) capacity *= 2;
+  char *out = (char *)realloc(websocket->out, capacity);
+  if (!out) return PS_ERROR_INTERNAL;
+  websocket->out = out;
+  websocket->out_capacity = capacity;
+  return PS_SUCCESS;
+}
+
+// Sends what the socket takes of `slices` right away and queues the rest in `out`, which must be empty.
+// A full socket is not an error: the frames are on their way once queued.
+static ps_result_t _purrsock_websocket_write(_purrsock_websocket_t *websocket, const ps_packet_t *slices, size_t count) {
+  size_t sent = 0;
+  ps_result_t result = _purrsock_flush_socket(websocket->socket);
+  if (result == PS_SUCCESS) result = _purrsock_send_stream_partial(websocket->socket, slices, count, &sent);
+  if (result == PS_SUCCESS) return PS_SUCCESS;
+
+  size_t rest = 0;
+  for (size_t i = 0; i < count; ++i) rest += slices[i].size;
+  rest -= sent;
+  if (_purrsock_websocket_reserve(websocket, rest) != PS_SUCCESS) {
+    // Part of a frame went out and the rest cannot follow: the stream is broken.
+    websocket->error = PS_ERROR_INTERNAL;
+    return PS_ERROR_INTERNAL;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    size_t skip = sent < slices[i].size ? sent : slices[i].size;
+    sent -= skip;
+    memcpy(websocket->out + websocket->out_size, slices[i].buf + skip, slices[i].size - skip);
+    websocket->out_size += slices[i].size - skip;
+  }
+  return result == PS_ERROR_WOULDBLOCK ? PS_SUCCESS : result;
+}
+
+// Sends the queued bytes and then a pending pong, without blocking a non-blocking socket.
+static ps_result_t _purrsock_websocket_drain(_purrsock_websocket_t *websocket) {
+  while (websocket->out_start < websocket->out_size) {
+    size_t size = websocket->out_size - websocket->out_start;
+    ps_packet_t slice = { size, websocket->out + websocket->out_start, size };
+    size_t sent = 0;
+    ps_result_t result = _purrsock_flush_socket(websocket->socket);
+    if (result == PS_SUCCESS) result = _purrsock_send_stream_partial(websocket->socket, &slice, 1, &sent);
+    websocket->out_start += sent;
+    if (result != PS_SUCCESS) return result;
+  }
+  websocket->out_start = websocket->out_size = 0;
+
+  if (!websocket->pong_size) return PS_SUCCESS;
+  ps_packet_t frame = { websocket->pong_size, websocket->pong, websocket->pong_size };
+  websocket->pong_size = 0;
+  ps_result_t result = _purrsock_websocket_write(websocket, &frame, 1);
+  if (result == PS_SUCCESS && websocket->out_size) return PS_ERROR_WOULDBLOCK;
+  return result;
+}
+
+// Sends a frame, or queues it behind the frames still waiting for room.
+static ps_result_t _purrsock_websocket_send_frame(_purrsock_websocket_t *websocket, unsigned char first, const char *payload, size_t size) {
+  ps_result_t result = _purrsock_websocket_drain(websocket);
+  if (result != PS_SUCCESS && result != PS_ERROR_WOULDBLOCK) return result;
+  bool queued = result == PS_ERROR_WOULDBLOCK;
+
+  if (!websocket->client) {
+    char header[PS_WEBSOCKET_MAX_HEADER];
+    size_t header_size = _purrsock_websocket_write_header(websocket, header, first, size, NULL);
+    ps_packet_t slices[2] = { { header_size, header, header_size }, { size, (char *)payload, size } };
+    if (!queued) return _purrsock_websocket_write(websocket, slices, size ? 2 : 1);
+    if (_purrsock_websocket_reserve(websocket, header_size + size) != PS_SUCCESS) return PS_ERROR_INTERNAL;
+    memcpy(websocket->out + websocket->out_size, header, header_size);
+    if (size) memcpy(websocket->out + websocket->out_size + header_size, payload, size);
+    websocket->out_size += header_size + size;
+    return PS_SUCCESS;
+  }
+
+  // A client sends a masked copy, built in the queue right after the header so that the frame goes out in one piece.
+  if (_purrsock_websocket_reserve(websocket, PS_WEBSOCKET_MAX_HEADER + size) != PS_SUCCESS) return PS_ERROR_INTERNAL;
+  websocket->out_size += _purrsock_websocket_write_frame(websocket, websocket->out + websocket->out_size, first, payload, size);
+  if (queued) return PS_SUCCESS;
+  result = _purrsock_websocket_drain(websocket);
+  return result == PS_ERROR_WOULDBLOCK ? PS_SUCCESS : result;
+}
+
+static ps_result_t _purrsock_websocket_send_close(_purrsock_websocket_t *websocket, uint16_t code, const char *reason, size_t reason_size) {
+  char payload[PS_WEBSOCKET_MAX_CONTROL];
+  size_t size = 0;
+  if (code && code != PS_WEBSOCKET_CLOSE_NO_STATUS) {
+    payload[0] = (char)(code >> 8);
+    payload[1] = (char)code;
+    if (reason_size) memcpy(payload + 2, reason, reason_size);
+    size = 2 + reason_size;
+  }
+  // Nothing may follow the close frame, so a pending pong goes first or not at all.
+  _purrsock_websocket_drain(websocket);
+  websocket->pong_size = 0;
+  websocket->close_sent = true;
+  return _purrsock_websocket_send_frame(websocket, PS_WEBSOCKET_FIN | PS_WEBSOCKET_CLOSE, payload, size);
+}
+
+// Tells the peer why the connection failed, once, and keeps the failure for every later call.
+static ps_result_t _purrsock_websocket_fail(_purrsock_websocket_t *websocket, uint16_t code, ps_result_t result) {
+  if (!websocket->close_sent) _purrsock_websocket_send_close(websocket, code, NULL, 0);
+  websocket->error = result;
+  return result;
+}
+
+// Receives what the socket has, first making room for `needed` bytes from the start of the next frame.
+static ps_result_t _purrsock_websocket_fill(_purrsock_websocket_t *websocket, size_t needed) {
+  if (websocket->in_end == websocket->in_capacity || websocket->in_start + websocket->frame_offset + needed > websocket->in_capacity) {
+    // Close the gap between the joined fragments and the next frame, then move everything to the front.
+    size_t gap = websocket->frame_offset - websocket->message_size;
+    if (gap) {
+      char *frame = websocket->in + websocket->in_start + websocket->frame_offset;
+      memmove(frame - gap, frame, (size_t)(websocket->in + websocket->in_end - frame));
+      websocket->in_end -= gap;
+      websocket->frame_offset = websocket->message_size;
+    }
+    if (websocket->in_start) {
+      memmove(websocket->in, websocket->in + websocket->in_start, websocket->in_end - websocket->in_start);
+      websocket->in_end -= websocket->in_start;
+      websocket->in_start = 0;
+    }
+    size_t required = websocket->frame_offset + needed;
+    if (required > websocket->in_capacity) {
+      size_t capacity = websocket->in_capacity;
+      while (capacity < required) capacity *= 2;
+      char *in = (char *)realloc(websocket->in, capacity);
+      if (!in) return PS_ERROR_INTERNAL;
+      websocket->in = in;
+      websocket->in_capacity = capacity;
+    }
+  }
+
+  ps_packet_t slice = { 0, websocket->in + websocket->in_end, websocket->in_capacity - websocket->in_end };
+  size_t received = 0;
+  ps_result_t result = _purrsock_recvv(websocket->socket, &slice, 1, &received, NULL);
+  if (result != PS_SUCCESS) return result;
+  websocket->in_end += received;
+  return PS_SUCCESS;
+}
+
+// Reads until the buffer holds a head ending with an empty line; its size goes to `head_size`.
+static ps_result_t _purrsock_websocket_read_head(_purrsock_websocket_t *websocket, size_t *head_size) {
+  while (1) {
+    size_t size = websocket->in_end - websocket->in_start;
+    size_t found = _purrsock_scan_find(websocket->in + websocket->in_start, size, "\r\n\r\n", 4);
+    if (found < size) {
+      *head_size = found + 4;
+      return *head_size <= websocket->max_handshake_size ? PS_SUCCESS : PS_ERROR_MSGTOOLONG;
+    }
+    if (size >= websocket->max_handshake_size) return PS_ERROR_MSGTOOLONG;
+    ps_result_t result = _purrsock_websocket_fill(websocket, size + 1);
+    if (result != PS_SUCCESS) return result;
+  }
+}
+
+static ps_result_t _purrsock_websocket_refuse(_purrsock_websocket_t *websocket, const char *status, bool version) {
+  char response[128];
+  int size = snprintf(response, sizeof(response), "HTTP/1.1 %s\r\nConnection: close\r\nContent-Length: 0\r\n%s\r\n",
+                      status, version ? "Sec-WebSocket-Version: 13\r\n" : "");
+  ps_packet_t packet = { (size_t)size, response, (size_t)size };
+  _purrsock_websocket_write(websocket, &packet, 1);
+  websocket->error = PS_ERROR_PROTOCOL;
+  return PS_ERROR_PROTOCOL;
+}
+
+static ps_result_t _purrsock_websocket_accept(_purrsock_websocket_t *websocket) {
+  size_t head_size = 0;
+  ps_result_t result = _purrsock_websocket_read_head(websocket, &head_size);
+  if (result == PS_ERROR_MSGTOOLONG) {
+    _purrsock_websocket_refuse(websocket, "431 Request Header Fields Too Large", false);
+    websocket->error = PS_ERROR_MSGTOOLONG;
+  }
+  if (result != PS_SUCCESS) return result;
+
+  ps_http_request_t request;
+  ps_http_string_t upgrade, connection, version, key;
+  if (_purrsock_http_parse_request(websocket->in + websocket->in_start, head_size, &request) != 0 ||
+      request.minor_version < 1 || request.method.size != 3 || memcmp(request.method.buf, "GET", 3) != 0 ||
+      !_purrsock_http_request_header(&request, "upgrade", &upgrade) || !_purrsock_http_list_contains(upgrade, "websocket") ||
+      !_purrsock_http_request_header(&request, "connection", &connection) || !_purrsock_http_list_contains(connection, "upgrade") ||
+      !_purrsock_http_request_header(&request, "sec-websocket-key", &key) || key.size != PS_WEBSOCKET_KEY_SIZE) {
+    return _purrsock_websocket_refuse(websocket, "400 Bad Request", false);
+  }
+  if (!_purrsock_http_request_header(&request, "sec-websocket-version", &version) || version.size != 2 || memcmp(version.buf, "13", 2) != 0) {
+    return _purrsock_websocket_refuse(websocket, "426 Upgrade Required", true);
+  }
+
+  char accept[PS_WEBSOCKET_ACCEPT_SIZE + 1];
+  _purrsock_websocket_accept_key(key.buf, accept);
+  char response[160];
+  int size = snprintf(response, sizeof(response), "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n"
+                      "Connection: Upgrade\r\nSec-WebSocket-Accept: %s\r\n\r\n", accept);
+  char *path = (char *)malloc(request.target.size + 1);
+  if (!path) return PS_ERROR_INTERNAL;
+  memcpy(path, request.target.buf, request.target.size);
+  path[request.target.size] = '\0';
+
+  // On a full socket the answer is queued like a frame, and frames sent meanwhile follow it.
+  ps_packet_t packet = { (size_t)size, response, (size_t)size };
+  result = _purrsock_websocket_write(websocket, &packet, 1);
+  if (result != PS_SUCCESS) {
+    free(path);
+    return result;
+  }
+  websocket->path = path;
+  websocket->in_start += head_size;
+  websocket->open = true;
+  return PS_SUCCESS;
+}
+
+static ps_result_t _purrsock_websocket_connect(_purrsock_websocket_t *websocket) {
+  // A request queued on a full socket must be out before an answer can come.
+  ps_result_t result = _purrsock_websocket_drain(websocket);
+  if (result != PS_SUCCESS) return result;
+
+  if (!websocket->key[0]) {
+    unsigned char nonce[16];
+    char key[PS_WEBSOCKET_KEY_SIZE + 1];
+    if (!_purrsock_random(nonce, sizeof(nonce))) return PS_ERROR_INTERNAL;
+    _purrsock_websocket_base64(nonce, sizeof(nonce), key);
+
+    static const char format[] = "GET %s HTTP/1.1\r\nHost: %s\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                                 "Sec-WebSocket-Key: %s\r\nSec-WebSocket-Version: 13\r\n\r\n";
+    int size = snprintf(NULL, 0, format, websocket->path, websocket->host, key);
+    char *request = (char *)malloc((size_t)size + 1);
+    if (!request) return PS_ERROR_INTERNAL;
+    snprintf(request, (size_t)size + 1, format, websocket->path, websocket->host, key);
+    ps_packet_t packet = { (size_t)size, request, (size_t)size };
+    result = _purrsock_websocket_write(websocket, &packet, 1);
+    free(request);
+    if (result != PS_SUCCESS) return result;
+    memcpy(websocket->key, key, sizeof(key));
+  }
+
+  size_t head_size = 0;
+  result = _purrsock_websocket_read_head(websocket, &head_size);
+  if (result == PS_ERROR_MSGTOOLONG) websocket->error = result;
+  if (result != PS_SUCCESS) return result;
+
+  // Status line, then the fields the answer must have (RFC 6455 4.1).
+  const char *head = websocket->in + websocket->in_start;
+  const char *end = head + head_size - 2;
+  if (head_size < 16 || memcmp(head, "HTTP/1.1 101", 12) != 0 || (head[12] != ' ' && head[12] != '\r')) {
+    websocket->error = PS_ERROR_PROTOCOL;
+    return PS_ERROR_PROTOCOL;
+  }
+  ps_http_request_t response;
+  response.header_count = 0;
+  for (const char *line = (const char *)memchr(head, '\n', head_size) + 1; line < end;) {
+    const char *colon = line + _purrsock_scan_token(line, (size_t)(end - line));
+    const char *value = colon + 1;
+    const char *line_end = NULL;
+    if (colon != line && *colon == ':') {
+      while (*value == ' ' || *value == '\t') value++;
+      line_end = value + _purrsock_scan_field_value(value, (size_t)(end - value));
+    }
+    if (!line_end || line_end[0] != '\r' || line_end[1] != '\n' || response.header_count == PS_HTTP_MAX_HEADERS) {
+      websocket->error = PS_ERROR_PROTOCOL;
+      return PS_ERROR_PROTOCOL;
+    }
+    const char *value_end = line_end;
+    while (value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t')) value_end--;
+    response.headers[response.header_count++] = (ps_http_header_t){ { line, (size_t)(colon - line) }, { value, (size_t)(value_end - value) } };
+    line = line_end + 2;
+  }
+
+  char expected[PS_WEBSOCKET_ACCEPT_SIZE + 1];
+  _purrsock_websocket_accept_key(websocket->key, expected);
+  ps_http_string_t upgrade, connection, accept;
+  if (!_purrsock_http_request_header(&response, "upgrade", &upgrade) || !_purrsock_http_list_contains(upgrade, "websocket") ||
+      !_purrsock_http_request_header(&response, "connection", &connection) || !_purrsock_http_list_contains(connection, "upgrade") ||
+      !_purrsock_http_request_header(&response, "sec-websocket-accept", &accept) ||
+      accept.size != PS_WEBSOCKET_ACCEPT_SIZE || memcmp(accept.buf, expected, PS_WEBSOCKET_ACCEPT_SIZE) != 0) {
+    websocket->error = PS_ERROR_PROTOCOL;
+    return PS_ERROR_PROTOCOL;
+  }
+  websocket->in_start += head_size;
+  websocket->open = true;
+  return PS_SUCCESS;
+}
+
+// Parses the buffered frames up to the next message to return. Returns PS_ERROR_WOULDBLOCK with the bytes
+// the incomplete frame needs, counted from its start, in `needed`.
+static ps_result_t _purrsock_websocket_parse(_purrsock_websocket_t *websocket, ps_websocket_message_t *message, size_t *needed) {
+  while (1) {
+    char *frame = websocket->in + websocket->in_start + websocket->frame_offset;
+    size_t available = websocket->in_end - websocket->in_start - websocket->frame_offset;
+    if (available < 2) {
+      *needed = 2;
+      return PS_ERROR_WOULDBLOCK;
+    }
+
+    unsigned char first = (unsigned char)frame[0], second = (unsigned char)frame[1];
+    bool fin = first & PS_WEBSOCKET_FIN;
+    unsigned char opcode = first & 0x0f;
+    bool masked = second & 0x80;
+    bool control = opcode & 0x8;
+    size_t length_size = (second & 0x7f) == 126 ? 2 : (second & 0x7f) == 127 ? 8 : 0;
+    size_t header_size = 2 + length_size + (masked ? 4 : 0);
+
+    // No extensions are negotiated, so the reserved bits stay clear; only clients mask (RFC 6455 5.1).
+    bool valid = !(first & 0x70) && masked == !websocket->client;
+    if (control) {
+      valid = valid && fin && (second & 0x7f) <= PS_WEBSOCKET_MAX_CONTROL && opcode <= PS_WEBSOCKET_PONG;
+    } else {
+      valid = valid && opcode <= PS_WEBSOCKET_BINARY && (opcode == PS_WEBSOCKET_CONTINUATION) == websocket->in_message;
+    }
+    if (!valid) return _purrsock_websocket_fail(websocket, PS_WEBSOCKET_CLOSE_PROTOCOL_ERROR, PS_ERROR_PROTOCOL);
+    if (available < header_size) {
+      *needed = header_size;
+      return PS_ERROR_WOULDBLOCK;
+    }
+
+    uint64_t length = second & 0x7f;
+    if (length_size) {
+      length = 0;
+      for (size_t i = 0; i < length_size; ++i) length = length << 8 | (unsigned char)frame[2 + i];
+      if (length >> 63) return _purrsock_websocket_fail(websocket, PS_WEBSOCKET_CLOSE_PROTOCOL_ERROR, PS_ERROR_PROTOCOL);
+    }
+    if (!control && length > websocket->max_message_size - websocket->message_size) {
+      return _purrsock_websocket_fail(websocket, PS_WEBSOCKET_CLOSE_TOO_BIG, PS_ERROR_MSGTOOLONG);
+    }
+    if (available - header_size < length) {
+      *needed = header_size + (size_t)length;
+      return PS_ERROR_WOULDBLOCK;
+    }
+
+    char *payload = frame + header_size;
+    size_t size = (size_t)length;
+    if (masked) {
+      uint32_t key;
+      memcpy(&key, payload - 4, 4);
+      _purrsock_scan_mask(payload, payload, size, key);
+    }
+    websocket->frame_offset += header_size + size;
+
+    if (control) {
+      // Control frames may come between fragments; their bytes are left in the gap until the next fill.
+      if (!websocket->in_message) {
+        websocket->in_start += websocket->frame_offset;
+        websocket->frame_offset = 0;
+      }
+      if (opcode == PS_WEBSOCKET_PING) {
+        if (websocket->close_sent) continue;
+        // Only the latest ping needs an answer, so a pong still waiting for room is replaced.
+        websocket->pong_size = _purrsock_websocket_write_frame(websocket, websocket->pong, PS_WEBSOCKET_FIN | PS_WEBSOCKET_PONG, payload, size);
+        ps_result_t result = _purrsock_websocket_drain(websocket);
+        if (result != PS_SUCCESS && result != PS_ERROR_WOULDBLOCK) return result;
+        continue;
+      }
+      if (opcode == PS_WEBSOCKET_CLOSE) {
+        uint16_t code = size >= 2 ? (uint16_t)((unsigned char)payload[0] << 8 | (unsigned char)payload[1]) : PS_WEBSOCKET_CLOSE_NO_STATUS;
+        if (size == 1 || (size >= 2 && !_purrsock_websocket_is_close_code(code))) {
+          return _purrsock_websocket_fail(websocket, PS_WEBSOCKET_CLOSE_PROTOCOL_ERROR, PS_ERROR_PROTOCOL);
+        }
+        if (size > 2 && !_purrsock_websocket_is_utf8(payload + 2, size - 2)) {
+          return _purrsock_websocket_fail(websocket, PS_WEBSOCKET_CLOSE_INVALID_DATA, PS_ERROR_PROTOCOL);
+        }
+        websocket->close_received = true;
+        websocket->pong_size = 0;
+        if (!websocket->close_sent) _purrsock_websocket_send_close(websocket, code, NULL, 0);
+        payload = size > 2 ? payload + 2 : payload;
+        size = size > 2 ? size - 2 : 0;
+        *message = (ps_websocket_message_t){ PS_WEBSOCKET_CLOSE, { size, payload, size }, code };
+        return PS_SUCCESS;
+      }
+      *message = (ps_websocket_message_t){ PS_WEBSOCKET_PONG, { size, payload, size }, 0 };
+      return PS_SUCCESS;
+    }
+
+    if (!websocket->in_message && fin) {
+      // A message in one frame is handed out where it is.
+      websocket->in_start += websocket->frame_offset;
+      websocket->frame_offset = 0;
+    } else {
+      if (!websocket->in_message) {
+        websocket->in_message = true;
+        websocket->message_opcode = (ps_websocket_opcode_t)opcode;
+      }
+      char *joined = websocket->in + websocket->in_start;
+      memmove(joined + websocket->message_size, payload, size);
+      websocket->message_size += size;
+      if (!fin) continue;
+
+      opcode = (unsigned char)websocket->message_opcode;
+      payload = joined;
+      size = websocket->message_size;
+      websocket->in_start += websocket->frame_offset;
+      websocket->frame_offset = 0;
+      websocket->message_size = 0;
+      websocket->in_message = false;
+    }
+    if (opcode == PS_WEBSOCKET_TEXT && !_purrsock_websocket_is_utf8(payload, size)) {
+      return _purrsock_websocket_fail(websocket, PS_WEBSOCKET_CLOSE_INVALID_DATA, PS_ERROR_PROTOCOL);
+    }
+    *message = (ps_websocket_message_t){ (ps_websocket_opcode_t)opcode, { size, payload, size }, 0 };
+    return PS_SUCCESS;
+  }
+}
+
+ps_result_t _purrsock_create_websocket(_purrsock_websocket_t **websocket, _purrsock_socket_t *socket, bool client, const char *host, const char *path, const ps_websocket_options_t *options) {
+  assert(websocket && socket);
+  if (_purrsock_is_datagram(socket->protocol)) return PS_ERROR_INVALID_ARGUMENT;
+  if (client && (!host || !path || path[0] != '/' || strpbrk(host, "\r\n") || strpbrk(path, "\r\n"))) return PS_ERROR_INVALID_ARGUMENT;
+
+  _purrsock_websocket_t *result = (_purrsock_websocket_t *)calloc(1, sizeof(*result));
+  if (!result) return PS_ERROR_INTERNAL;
+  result->socket = socket;
+  result->client = client;
+  result->max_message_size = options && options->max_message_size ? options->max_message_size : PS_WEBSOCKET_DEFAULT_MAX_MESSAGE;
+  result->max_handshake_size = options && options->max_handshake_size ? options->max_handshake_size : PS_WEBSOCKET_DEFAULT_MAX_HANDSHAKE;
+  result->in_capacity = options && options->initial_capacity ? options->initial_capacity : PS_WEBSOCKET_DEFAULT_CAPACITY;
+  result->in = (char *)malloc(result->in_capacity);
+  if (client) {
+    result->host = strdup(host);
+    result->path = strdup(path);
+  }
+  // Clients mask with keys an intermediary cannot predict (RFC 6455 10.3).
+  bool seeded = !client || _purrsock_random(&result->seed, sizeof(result->seed));
+  if (!result->in || (client && (!result->host || !result->path)) || !seeded) {
+    _purrsock_destroy_websocket(result);
+    return PS_ERROR_INTERNAL;
+  }
+  result->seed |= 1;
+
+  *websocket = result;
+  return PS_SUCCESS;
+}
+
+void _purrsock_destroy_websocket(_purrsock_websocket_t *websocket) {
+  assert(websocket);
+  free(websocket->host);
+  free(websocket->path);
+  free(websocket->in);
+  free(websocket->out);
+  free(websocket);
+}
+
+ps_result_t _purrsock_websocket_handshake(_purrsock_websocket_t *websocket) {
+  assert(websocket);
+  if (websocket->open) return PS_SUCCESS;
+  if (websocket->error != PS_SUCCESS) return websocket->error;
+  return websocket->client ? _purrsock_websocket_connect(websocket) : _purrsock_websocket_accept(websocket);
+}
+
+const char *_purrsock_websocket_get_path(_purrsock_websocket_t *websocket) {
+  assert(websocket);
+  return websocket->path;
+}
+
+ps_result_t _purrsock_websocket_read(_purrsock_websocket_t *websocket, ps_websocket_message_t *message) {
+  assert(websocket && message);
+  if (!websocket->open) return PS_ERROR_INVALID_ARGUMENT;
+  if (websocket->error != PS_SUCCESS) return websocket->error;
+  if (websocket->close_received) return PS_CONNCLOSED;
+
+  ps_result_t result = _purrsock_websocket_drain(websocket);
+  if (result != PS_SUCCESS && result != PS_ERROR_WOULDBLOCK) return result;
+  while (1) {
+    size_t needed = 0;
+    result = _purrsock_websocket_parse(websocket, message, &needed);
+    if (result != PS_ERROR_WOULDBLOCK) return result;
+    result = _purrsock_websocket_fill(websocket, needed);
+    if (result != PS_SUCCESS) return result;
+  }
+}
+
+ps_result_t _purrsock_websocket_send(_purrsock_websocket_t *websocket, ps_websocket_opcode_t opcode, ps_packet_t payload, bool final) {
+  assert(websocket);
+  if (!websocket->open) return PS_ERROR_INVALID_ARGUMENT;
+  if (websocket->error != PS_SUCCESS) return websocket->error;
+  if (websocket->close_sent) return PS_ERROR_SHUTDOWN;
+  switch (opcode) {
+  case PS_WEBSOCKET_CONTINUATION:
+    if (!websocket->sending_fragments) return PS_ERROR_INVALID_ARGUMENT;
+    break;
+  case PS_WEBSOCKET_TEXT:
+  case PS_WEBSOCKET_BINARY:
+    if (websocket->sending_fragments) return PS_ERROR_INVALID_ARGUMENT;
+    break;
+  case PS_WEBSOCKET_PING:
+  case PS_WEBSOCKET_PONG:
+    if (!final || payload.size > PS_WEBSOCKET_MAX_CONTROL) return PS_ERROR_INVALID_ARGUMENT;
+    break;
+  default:
+    return PS_ERROR_INVALID_ARGUMENT;
+  }
+
+  ps_result_t result = _purrsock_websocket_send_frame(websocket, (unsigned char)((final ? PS_WEBSOCKET_FIN : 0) | opcode), payload.buf, payload.size);
+  if (result == PS_SUCCESS && !(opcode & 0x8)) websocket->sending_fragments = !final;
+  return result;
+}
+
+ps_result_t _purrsock_websocket_close(_purrsock_websocket_t *websocket, uint16_t code, const char *reason) {
+  assert(websocket);
+  if (!websocket->open) return PS_ERROR_INVALID_ARGUMENT;
+  if (websocket->error != PS_SUCCESS) return websocket->error;
+  if (websocket->close_sent) return PS_ERROR_SHUTDOWN;
+  size_t reason_size = reason ? strlen(reason) : 0;
+  if (reason_size > PS_WEBSOCKET_MAX_CONTROL - 2 || (reason_size && !code)) return PS_ERROR_INVALID_ARGUMENT;
+
+  ps_result_t result = _purrsock_websocket_send_close(websocket, code, reason, reason_size);
+  if (result != PS_SUCCESS) websocket->close_sent = false;
+  return result;
+}
+
+ps_result_t _purrsock_websocket_flush(_purrsock_websocket_t *websocket) {
+  assert(websocket);
+  // Also after an error, so that the close frame telling the peer about it goes out.
+  return _purrsock_websocket_drain(websocket);
+}
+
+size_t _purrsock_websocket_get_unsent(_purrsock_websocket_t *websocket) {
+  assert(websocket);
+  return websocket->out_size - websocket->out_start + websocket->pong_size;
+}
@@ -15,7 +15,11 @@
 #include <in6addr.h>
 #include <ws2spi.h>
 #include <ws2tcpip.h>
+#include <bcrypt.h>
 #include <stdio.h>
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 #include <assert.h>
 
 typedef struct {
@@ -133,6 +137,10 @@ typedef struct {
 
 ps_result_t _purrsock_create_socket(_purrsock_socket_t* in_socket) {
     assert(in_socket);
+    if (in_socket->protocol == PS_PROTOCOL_MEMORY) return _purrsock_memory_create(in_socket);
+    if (in_socket->protocol == PS_PROTOCOL_SHM || in_socket->protocol == PS_PROTOCOL_UNIX_STREAM || in_socket->protocol == PS_PROTOCOL_UNIX_DGRAM) {
+        return PS_ERROR_UNSUPPORTED;
+    }
 
     _purrsock_socket_data_t* data = (_purrsock_socket_data_t*)malloc(sizeof(*data));
     if (!data) {
@@ -218,17 +226,22 @@ ps_result_t _purrsock_create_socket_from_addr(_purrsock_socket_t *in_socket, con
 
 void _purrsock_destroy_socket(_purrsock_socket_t *socket) {
     assert(socket);
+    _purrsock_memory_destroy(socket);
     _purrsock_socket_data_t *data = (_purrsock_socket_data_t*)socket->data;
     if (data) {
         if (data->socket != INVALID_SOCKET) closesocket(data->socket);
         free(data);
     }
     socket->data = NULL;
+    free(socket->unsent);
+    socket->unsent = NULL;
+    socket->unsent_offset = socket->unsent_size = socket->unsent_capacity = 0;
 }
 
 
 ps_result_t _purrsock_bind_socket(_purrsock_socket_t* socket, const char* ip, ps_port_t port) {
     assert(socket);
+    if (socket->memory) return _purrsock_memory_bind(socket, ip, port);
 
     _purrsock_socket_data_t* data = (_purrsock_socket_data_t*)socket->data;
     if (!data) return PS_ERROR_NOTINIT;
@@ -276,15 +289,17 @@ ps_result_t _purrsock_bind_socket(_purrsock_socket_t* socket, const char* ip, ps
 
 
 
-ps_result_t _purrsock_listen_socket(_purrsock_socket_t* socket) {
-    assert(socket && socket->protocol == PS_PROTOCOL_TCP);
+ps_result_t _purrsock_listen_socket(_purrsock_socket_t* socket, int backlog) {
+    assert(socket);
+    if (socket->memory) return _purrsock_memory_listen(socket, backlog);
+    assert(socket->protocol == PS_PROTOCOL_TCP);
 
     _purrsock_socket_data_t* data = (_purrsock_socket_data_t*)socket->data;
     if (!data) return PS_ERROR_NOTINIT;
 
     printf("Attempting to listen on socket %d...\n", data->socket);
 
-    if (listen(data->socket, SOMAXCONN) == SOCKET_ERROR) {
+    if (listen(data->socket, backlog > 0 ? backlog : SOMAXCONN) == SOCKET_ERROR) {
         return _last_ps_result("purrsock_listen_socket");
     }
 
@@ -293,8 +308,15 @@ ps_result_t _purrsock_listen_socket(_purrsock_socket_t* socket) {
 }
 
 
+// Winsock's SO_REUSEADDR lets sockets steal a port rather than share its connections.
+ps_result_t _purrsock_set_socket_reuseport(_purrsock_socket_t* socket, bool enabled) {
+    (void)socket; (void)enabled;
+    return PS_ERROR_UNSUPPORTED;
+}
+
 ps_result_t _purrsock_accept_socket(_purrsock_socket_t* socket, _purrsock_socket_t** client) {
     assert(socket && client);
+    if (socket->memory) return _purrsock_memory_accept(socket, client);
     _purrsock_socket_data_t* data = (_purrsock_socket_data_t*)socket->data;
     if (!data) return PS_ERROR_NOTINIT;
 
@@ -310,7 +332,7 @@ ps_result_t _purrsock_accept_socket(_purrsock_socket_t* socket, _purrsock_socket
         if (sock == INVALID_SOCKET) return _last_ps_result("purrsock_accept_socket");
     }
 
-    *client = (_purrsock_socket_t*)malloc(sizeof(**client));
+    *client = (_purrsock_socket_t*)calloc(1, sizeof(**client));
     assert(*client);
     (*client)->protocol = socket->protocol;
 
@@ -331,8 +353,47 @@ ps_result_t _purrsock_accept_socket(_purrsock_socket_t* socket, _purrsock_socket
 }
 
 
+// Starts the handshake without blocking and waits for it with the connect timeout.
+static ps_result_t _purrsock_connect_with_timeout(_purrsock_socket_t* socket, const struct sockaddr* addr, int addr_len) {
+    _purrsock_socket_data_t* data = (_purrsock_socket_data_t*)socket->data;
+    u_long mode = 1;
+    if (ioctlsocket(data->socket, FIONBIO, &mode) == SOCKET_ERROR) return _last_ps_result("purrsock_connect_socket");
+
+    ps_result_t result = PS_SUCCESS;
+    if (connect(data->socket, addr, addr_len) == SOCKET_ERROR) {
+        if (WSAGetLastError() != WSAEWOULDBLOCK) {
+            result = _last_ps_result("purrsock_connect_socket");
+        } else {
+            fd_set writable, failed;
+            FD_ZERO(&writable);
+            FD_ZERO(&failed);
+            FD_SET(data->socket, &writable);
+            FD_SET(data->socket, &failed);
+            struct timeval timeout = { (long)(socket->timeouts.connect_ms / 1000), (long)(socket->timeouts.connect_ms % 1000) * 1000 };
+
+            int res = select(0, NULL, &writable, &failed, &timeout);
+            if (res == 0) {
+                result = PS_ERROR_TIMEOUT;
+            } else if (res == SOCKET_ERROR) {
+                result = _last_ps_result("purrsock_connect_socket");
+            } else if (FD_ISSET(data->socket, &failed)) {
+                int error = 0;
+                int error_len = sizeof(error);
+                getsockopt(data->socket, SOL_SOCKET, SO_ERROR, (char*)&error, &error_len);
+                WSASetLastError(error);
+                result = _last_ps_result("purrsock_connect_socket");
+            }
+        }
+    }
+
+    mode = 0;
+    ioctlsocket(data->socket, FIONBIO, &mode);
+    return result;
+}
+
 ps_result_t _purrsock_connect_socket(_purrsock_socket_t *socket, const char *ip, ps_port_t port) {
   assert(socket);
+  if (socket->memory) return _purrsock_memory_connect(socket, ip, port);
   _purrsock_socket_data_t *data = (_purrsock_socket_data_t*)socket->data;
   if (!data) return PS_ERROR_NOTINIT;
 
@@ -342,6 +403,7 @@ ps_result_t _purrsock_connect_socket(_purrsock_socket_t *socket, const char *ip,
   if (inet_pton(AF_INET6, ip, &addr6.sin6_addr) > 0) {
     addr6.sin6_family = AF_INET6;
     addr6.sin6_port = htons(port);
+    if (socket->timeouts.connect_ms) return _purrsock_connect_with_timeout(socket, (struct sockaddr*)&addr6, sizeof(addr6));
     if (connect(data->socket, (struct sockaddr*)&addr6, sizeof(addr6)) == SOCKET_ERROR) {
       return _last_ps_result("purrsock_connect_socket IPv6");
     }
@@ -349,6 +411,7 @@ ps_result_t _purrsock_connect_socket(_purrsock_socket_t *socket, const char *ip,
     addr4.sin_family = AF_INET;
     addr4.sin_port = htons(port);
     addr4.sin_addr.s_addr = inet_addr(ip);
+    if (socket->timeouts.connect_ms) return _purrsock_connect_with_timeout(socket, (struct sockaddr*)&addr4, sizeof(addr4));
     if (connect(data->socket, (struct sockaddr*)&addr4, sizeof(addr4)) == SOCKET_ERROR) {
       return _last_ps_result("purrsock_connect_socket IPv4");
     }
@@ -359,10 +422,12 @@ ps_result_t _purrsock_connect_socket(_purrsock_socket_t *socket, const char *ip,
 
 ps_result_t _purrsock_read_socket_packet(_purrsock_socket_t* socket, ps_packet_t* packet, _purrsock_socket_t** from) {
     assert(socket && packet);
+    if (socket->memory) return _purrsock_memory_read(socket, packet);
     _purrsock_socket_data_t* data = (_purrsock_socket_data_t*)socket->data;
     if (!data) return PS_ERROR_NOTINIT;
 
     int res = 0;
+    PS_STATS_START(start);
     switch (socket->protocol) {
     case PS_PROTOCOL_TCP: {
         res = recv(data->socket, packet->buf, packet->capacity, 0);
@@ -403,14 +468,56 @@ ps_result_t _purrsock_read_socket_packet(_purrsock_socket_t* socket, ps_packet_t
     default: return PS_ERROR_INTERNAL;
     }
 
+    PS_STATS_SYSCALL(socket, false, res == SOCKET_ERROR && WSAGetLastError() == WSAEWOULDBLOCK, start);
     if (res == SOCKET_ERROR) return _last_ps_result("purrsock_read_socket_packet");
 
     packet->size = res;
+    PS_STATS_TRANSFER(socket, false, res, 1);
     return PS_SUCCESS;
 }
 
-ps_result_t _purrsock_send_socket_packet(_purrsock_socket_t* socket, ps_packet_t* packet, _purrsock_socket_t* to) {
-    assert(socket && packet);
+ps_result_t _purrsock_send_stream_partial(_purrsock_socket_t* socket, const ps_packet_t* slices, size_t count, size_t* sent) {
+    assert(socket && slices && sent && count <= PS_MAX_PACKET_SLICES);
+    *sent = 0;
+    if (socket->memory) return _purrsock_memory_sendv(socket, slices, count, sent);
+    _purrsock_socket_data_t* data = (_purrsock_socket_data_t*)socket->data;
+    if (!data) return PS_ERROR_NOTINIT;
+
+    WSABUF bufs[PS_MAX_PACKET_SLICES];
+    DWORD remaining = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (!slices[i].size) continue;
+        bufs[remaining].buf = slices[i].buf;
+        bufs[remaining++].len = (ULONG)slices[i].size;
+    }
+
+    // A non-blocking socket stops with WSAEWOULDBLOCK once full, after whatever it took.
+    WSABUF* next = bufs;
+    while (remaining > 0) {
+        DWORD res = 0;
+        PS_STATS_START(start);
+        int error = WSASend(data->socket, next, remaining, &res, 0, NULL, NULL);
+        PS_STATS_SYSCALL(socket, true, error == SOCKET_ERROR && WSAGetLastError() == WSAEWOULDBLOCK, start);
+        if (error == SOCKET_ERROR) return _last_ps_result("purrsock_send_socket_packet");
+        PS_STATS_TRANSFER(socket, true, res, *sent == 0);
+        *sent += res;
+
+        while (remaining > 0 && res >= next->len) {
+            res -= next->len;
+            next++;
+            remaining--;
+        }
+        if (remaining > 0) {
+            next->buf += res;
+            next->len -= res;
+        }
+    }
+    return PS_SUCCESS;
+}
+
+ps_result_t _purrsock_send_socket_packet(_purrsock_socket_t* socket, ps_packet_t packet, _purrsock_socket_t* to) {
+    assert(socket && packet.buf);
+    if (socket->memory || socket->protocol == PS_PROTOCOL_TCP) return _purrsock_send_stream(socket, &packet, 1);
 
     if (to) {
         _purrsock_socket_data_t* to_data = (_purrsock_socket_data_t*)(to)->data;
@@ -421,10 +528,8 @@ ps_result_t _purrsock_send_socket_packet(_purrsock_socket_t* socket, ps_packet_t
     if (!data) return PS_ERROR_NOTINIT;
 
     int res = 0;
+    PS_STATS_START(start);
     switch (socket->protocol) {
-    case PS_PROTOCOL_TCP: {
-        res = send(data->socket, packet->buf, packet->size, 0);
-    } break;
     case PS_PROTOCOL_UDP: {
         if (!to) return PS_ERROR_INVALID_ARGUMENT;
 
@@ -435,23 +540,722 @@ ps_result_t _purrsock_send_socket_packet(_purrsock_socket_t* socket, ps_packet_t
             struct sockaddr_in addr4 = { 0 };
             addr4.sin_family = AF_INET;
             addr4 = to_data->addr4;
-            res = sendto(data->socket, packet->buf, packet->size, 0, (struct sockaddr*)&addr4, sizeof(addr4));
+            res = sendto(data->socket, packet.buf, packet.size, 0, (struct sockaddr*)&addr4, sizeof(addr4));
         }
         else if (to_data->addr6.sin6_family == AF_INET6) {
             struct sockaddr_in6 addr6 = { 0 };
             addr6.sin6_family = AF_INET6;
             addr6 = to_data->addr6;
-            res = sendto(data->socket, packet->buf, packet->size, 0, (struct sockaddr*)&addr6, sizeof(addr6));
+            res = sendto(data->socket, packet.buf, packet.size, 0, (struct sockaddr*)&addr6, sizeof(addr6));
         }
     } break;
     default:
         return PS_ERROR_INTERNAL;
     }
 
+    PS_STATS_SYSCALL(socket, true, res == SOCKET_ERROR && WSAGetLastError() == WSAEWOULDBLOCK, start);
     if (res == SOCKET_ERROR) return _last_ps_result("purrsock_send_socket_packet");
+    PS_STATS_TRANSFER(socket, true, res, 1);
+    return PS_SUCCESS;
+}
+
+
+
+static void _purrsock_endpoint_from_sockaddr(const struct sockaddr_storage* addr, ps_endpoint_t* endpoint) {
+    memset(endpoint, 0, sizeof(*endpoint));
+    if (addr->ss_family == AF_INET6) {
+        const struct sockaddr_in6* addr6 = (const struct sockaddr_in6*)addr;
+        endpoint->family = PS_ADDRESS_IPV6;
+        endpoint->port = ntohs(addr6->sin6_port);
+        memcpy(endpoint->addr, &addr6->sin6_addr, sizeof(addr6->sin6_addr));
+    }
+    else {
+        const struct sockaddr_in* addr4 = (const struct sockaddr_in*)addr;
+        endpoint->family = PS_ADDRESS_IPV4;
+        endpoint->port = ntohs(addr4->sin_port);
+        memcpy(endpoint->addr, &addr4->sin_addr, sizeof(addr4->sin_addr));
+    }
+}
+
+static int _purrsock_endpoint_to_sockaddr(const ps_endpoint_t* endpoint, struct sockaddr_storage* addr) {
+    memset(addr, 0, sizeof(*addr));
+    if (endpoint->family == PS_ADDRESS_IPV6) {
+        struct sockaddr_in6* addr6 = (struct sockaddr_in6*)addr;
+        addr6->sin6_family = AF_INET6;
+        addr6->sin6_port = htons(endpoint->port);
+        memcpy(&addr6->sin6_addr, endpoint->addr, sizeof(addr6->sin6_addr));
+        return sizeof(*addr6);
+    }
+
+    struct sockaddr_in* addr4 = (struct sockaddr_in*)addr;
+    addr4->sin_family = AF_INET;
+    addr4->sin_port = htons(endpoint->port);
+    memcpy(&addr4->sin_addr, endpoint->addr, sizeof(addr4->sin_addr));
+    return sizeof(*addr4);
+}
+
+ps_result_t _purrsock_endpoint_from_addr(ps_endpoint_t* endpoint, const char* ip, ps_port_t port) {
+    struct sockaddr_storage addr;
+    memset(&addr, 0, sizeof(addr));
+    if (inet_pton(AF_INET, ip, &((struct sockaddr_in*)&addr)->sin_addr) == 1) {
+        addr.ss_family = AF_INET;
+    }
+    else if (inet_pton(AF_INET6, ip, &((struct sockaddr_in6*)&addr)->sin6_addr) == 1) {
+        addr.ss_family = AF_INET6;
+    }
+    else {
+        return PS_ERROR_INVALID_ARGUMENT;
+    }
+    _purrsock_endpoint_from_sockaddr(&addr, endpoint);
+    endpoint->port = port;
+    return PS_SUCCESS;
+}
+
+ps_result_t _purrsock_endpoint_to_addr(const ps_endpoint_t* endpoint, char* ip, size_t ip_size) {
+    int family = endpoint->family == PS_ADDRESS_IPV6 ? AF_INET6 : AF_INET;
+    return inet_ntop(family, endpoint->addr, ip, ip_size) ? PS_SUCCESS : PS_ERROR_INVALID_ARGUMENT;
+}
+
+ps_result_t _purrsock_resolve_host(const char* host, char* ip, size_t ip_size) {
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_flags = AI_ADDRCONFIG;
+    struct addrinfo* info = NULL;
+    if (getaddrinfo(host, NULL, &hints, &info) != 0 || !info) return PS_ERROR_ADDRNOTAVAIL;
+
+    int res = getnameinfo(info->ai_addr, (socklen_t)info->ai_addrlen, ip, (DWORD)ip_size, NULL, 0, NI_NUMERICHOST);
+    freeaddrinfo(info);
+    return res == 0 ? PS_SUCCESS : PS_ERROR_ADDRNOTAVAIL;
+}
+
+// Winsock has no recvmmsg/sendmmsg; the batched calls loop over single datagrams.
+
+ps_result_t _purrsock_get_socket_endpoint(_purrsock_socket_t* socket, ps_endpoint_t* endpoint) {
+    assert(socket && endpoint);
+    if (socket->memory) return _purrsock_memory_get_endpoint(socket, endpoint);
+    _purrsock_socket_data_t* data = (_purrsock_socket_data_t*)socket->data;
+    if (!data) return PS_ERROR_NOTINIT;
+
+    struct sockaddr_storage addr;
+    int addr_len = sizeof(addr);
+    if (getsockname(data->socket, (struct sockaddr*)&addr, &addr_len) == SOCKET_ERROR) {
+        return _last_ps_result("purrsock_get_socket_endpoint");
+    }
+    _purrsock_endpoint_from_sockaddr(&addr, endpoint);
+    return PS_SUCCESS;
+}
+
+ps_result_t _purrsock_read_socket_packets(_purrsock_socket_t* socket, ps_packet_t* packets, ps_endpoint_t* from, size_t count, size_t* received) {
+    assert(socket && packets && received);
+    _purrsock_socket_data_t* data = (_purrsock_socket_data_t*)socket->data;
+    if (!data) return PS_ERROR_NOTINIT;
+    if (socket->protocol != PS_PROTOCOL_UDP) return PS_ERROR_INVALID_ARGUMENT;
+
+    ps_result_t result = PS_SUCCESS;
+    size_t total = 0;
+    while (total < count) {
+        // Only the first datagram may block; stop once nothing else is queued.
+        if (total > 0) {
+            u_long pending = 0;
+            if (ioctlsocket(data->socket, FIONREAD, &pending) == SOCKET_ERROR || pending == 0) break;
+        }
+
+        struct sockaddr_storage addr;
+        int addr_len = sizeof(addr);
+        int res = recvfrom(data->socket, packets[total].buf, (int)packets[total].capacity, 0, (struct sockaddr*)&addr, &addr_len);
+        if (res == SOCKET_ERROR) {
+            if (WSAGetLastError() == WSAEMSGSIZE) {
+                res = (int)packets[total].capacity;
+                result = PS_ERROR_MSGTOOLONG;
+            }
+            else if (total > 0) {
+                break;
+            }
+            else {
+                return _last_ps_result("purrsock_read_socket_packets");
+            }
+        }
+
+        packets[total].size = res;
+        if (from) _purrsock_endpoint_from_sockaddr(&addr, &from[total]);
+        total++;
+    }
+
+    *received = total;
+    return result;
+}
+
+ps_result_t _purrsock_send_socket_packets(_purrsock_socket_t* socket, const ps_packet_t* packets, const ps_endpoint_t* to, size_t count, size_t* sent) {
+    assert(socket && packets && sent);
+    *sent = 0;
+    _purrsock_socket_data_t* data = (_purrsock_socket_data_t*)socket->data;
+    if (!data) return PS_ERROR_NOTINIT;
+    if (socket->protocol != PS_PROTOCOL_UDP) return PS_ERROR_INVALID_ARGUMENT;
+
+    for (size_t i = 0; i < count; ++i) {
+        int res;
+        if (to) {
+            struct sockaddr_storage addr;
+            int addr_len = _purrsock_endpoint_to_sockaddr(&to[i], &addr);
+            res = sendto(data->socket, packets[i].buf, (int)packets[i].size, 0, (struct sockaddr*)&addr, addr_len);
+        }
+        else {
+            res = send(data->socket, packets[i].buf, (int)packets[i].size, 0);
+        }
+        if (res == SOCKET_ERROR) return _last_ps_result("purrsock_send_socket_packets");
+        *sent = i + 1;
+    }
+    return PS_SUCCESS;
+}
+
+ps_result_t _purrsock_sendv(_purrsock_socket_t* socket, const ps_packet_t* slices, size_t count, const ps_endpoint_t* to) {
+    assert(socket && slices && count <= PS_MAX_PACKET_SLICES);
+    if (socket->memory || socket->protocol == PS_PROTOCOL_TCP) return _purrsock_send_stream(socket, slices, count);
+    _purrsock_socket_data_t* data = (_purrsock_socket_data_t*)socket->data;
+    if (!data) return PS_ERROR_NOTINIT;
+
+    WSABUF bufs[PS_MAX_PACKET_SLICES];
+    for (size_t i = 0; i < count; ++i) {
+        bufs[i].buf = slices[i].buf;
+        bufs[i].len = (ULONG)slices[i].size;
+    }
+
+    struct sockaddr_storage addr;
+    int addr_len = 0;
+    if (to) addr_len = _purrsock_endpoint_to_sockaddr(to, &addr);
+
+    // A datagram goes out whole or not at all.
+    DWORD sent = 0;
+    int res = addr_len
+        ? WSASendTo(data->socket, bufs, (DWORD)count, &sent, 0, (struct sockaddr*)&addr, addr_len, NULL, NULL)
+        : WSASend(data->socket, bufs, (DWORD)count, &sent, 0, NULL, NULL);
+    if (res == SOCKET_ERROR) return _last_ps_result("purrsock_sendv");
+    return PS_SUCCESS;
+}
+
+ps_result_t _purrsock_recvv(_purrsock_socket_t* socket, ps_packet_t* slices, size_t count, size_t* received, ps_endpoint_t* from) {
+    assert(socket && slices && received && count <= PS_MAX_PACKET_SLICES);
+    if (socket->memory) return _purrsock_memory_recvv(socket, slices, count, received);
+    _purrsock_socket_data_t* data = (_purrsock_socket_data_t*)socket->data;
+    if (!data) return PS_ERROR_NOTINIT;
+
+    WSABUF bufs[PS_MAX_PACKET_SLICES];
+    for (size_t i = 0; i < count; ++i) {
+        bufs[i].buf = slices[i].buf;
+        bufs[i].len = (ULONG)slices[i].capacity;
+    }
+
+    struct sockaddr_storage addr;
+    int addr_len = sizeof(addr);
+    DWORD len = 0;
+    DWORD flags = 0;
+    ps_result_t result = PS_SUCCESS;
+    if (WSARecvFrom(data->socket, bufs, (DWORD)count, &len, &flags, (struct sockaddr*)&addr, &addr_len, NULL, NULL) == SOCKET_ERROR) {
+        if (WSAGetLastError() != WSAEMSGSIZE) return _last_ps_result("purrsock_recvv");
+        result = PS_ERROR_MSGTOOLONG;
+    }
+    if (len == 0 && socket->protocol == PS_PROTOCOL_TCP) return PS_CONNCLOSED;
+
+    size_t remaining = len;
+    for (size_t i = 0; i < count; ++i) {
+        slices[i].size = remaining < slices[i].capacity ? remaining : slices[i].capacity;
+        remaining -= slices[i].size;
+    }
+    *received = len;
+    if (from && socket->protocol == PS_PROTOCOL_UDP) _purrsock_endpoint_from_sockaddr(&addr, from);
+    return result;
+}
+
+// Winsock has no MSG_ZEROCOPY: zero-copy sends copy and complete immediately.
+
+ps_result_t _purrsock_set_socket_zerocopy(_purrsock_socket_t* socket, bool enabled) {
+    (void)socket; (void)enabled;
+    return PS_ERROR_UNSUPPORTED;
+}
+
+ps_result_t _purrsock_send_socket_packet_zerocopy(_purrsock_socket_t* socket, ps_packet_t packet, ps_zerocopy_completion_t callback, void* user_data) {
+    ps_result_t result = _purrsock_send_socket_packet(socket, packet, NULL);
+    if (callback) {
+        callback((ps_socket_t)socket, &packet, true, user_data);
+    }
+    else {
+        _purrsock_packet_release(&packet);
+    }
+    return result;
+}
+
+ps_result_t _purrsock_process_zerocopy_completions(_purrsock_socket_t* socket, size_t* completed) {
+    (void)socket;
+    *completed = 0;
+    return PS_SUCCESS;
+}
+
+int _purrsock_open_file(const char* path) {
+    return _open(path, _O_RDONLY | _O_BINARY);
+}
+
+void _purrsock_close_file(int fd) {
+    _close(fd);
+}
+
+ps_result_t _purrsock_file_size(int fd, uint64_t* size) {
+    struct _stat64 st;
+    if (_fstat64(fd, &st) != 0 || !(st.st_mode & _S_IFREG)) return PS_ERROR_INVALID_ARGUMENT;
+    *size = (uint64_t)st.st_size;
+    return PS_SUCCESS;
+}
+
+// TransmitFile is not used yet: files are read at explicit offsets and sent through a pooled buffer.
+ps_result_t _purrsock_send_file(_purrsock_socket_t* socket, int fd, uint64_t offset, uint64_t length, uint64_t* sent) {
+    assert(socket && sent);
+    *sent = 0;
+    _purrsock_socket_data_t* data = (_purrsock_socket_data_t*)socket->data;
+    if (!data) return PS_ERROR_NOTINIT;
+    if (socket->protocol != PS_PROTOCOL_TCP || fd < 0) return PS_ERROR_INVALID_ARGUMENT;
+
+    HANDLE file = (HANDLE)_get_osfhandle(fd);
+    if (file == INVALID_HANDLE_VALUE) return PS_ERROR_INVALID_ARGUMENT;
+
+    if (!length) {
+        __int64 size = _filelengthi64(fd);
+        if (size < 0 || (uint64_t)size <= offset) return PS_SUCCESS;
+        length = (uint64_t)size - offset;
+    }
+
+    ps_packet_t packet = { 0 };
+    ps_result_t result = _purrsock_packet_acquire(NULL, PS_PACKET_DATAGRAM_CAPACITY, &packet);
+    if (result != PS_SUCCESS) return result;
+
+    while (*sent < length && result == PS_SUCCESS) {
+        DWORD chunk = (DWORD)(length - *sent < packet.capacity ? length - *sent : packet.capacity);
+        OVERLAPPED position = { 0 };
+        position.Offset = (DWORD)(offset + *sent);
+        position.OffsetHigh = (DWORD)((offset + *sent) >> 32);
+        DWORD len = 0;
+        if (!ReadFile(file, packet.buf, chunk, &len, &position) || len == 0) break;
+
+        for (DWORD done = 0; done < len;) {
+            int res = send(data->socket, packet.buf + done, (int)(len - done), 0);
+            if (res == SOCKET_ERROR) {
+                result = _last_ps_result("purrsock_send_file");
+                break;
+            }
+            done += res;
+            *sent += res;
+        }
+    }
+
+    _purrsock_packet_release(&packet);
+    return result;
+}
+
+ps_result_t _purrsock_splice(_purrsock_socket_t* from, _purrsock_socket_t* to, size_t length, size_t* moved) {
+    (void)from; (void)to; (void)length; (void)moved;
+    return PS_ERROR_UNSUPPORTED;
+}
+
+// Unix domain sockets cannot be created here, so there is nothing to pass descriptors over.
+ps_result_t _purrsock_send_socket_fds(_purrsock_socket_t* socket, ps_packet_t packet, const int* fds, size_t count) {
+    (void)socket; (void)packet; (void)fds; (void)count;
+    return PS_ERROR_UNSUPPORTED;
+}
+
+ps_result_t _purrsock_read_socket_fds(_purrsock_socket_t* socket, ps_packet_t* packet, int* fds, size_t capacity, size_t* count) {
+    (void)socket; (void)packet; (void)fds; (void)capacity;
+    *count = 0;
+    return PS_ERROR_UNSUPPORTED;
+}
+
+ps_result_t _purrsock_pass_socket(_purrsock_socket_t* channel, _purrsock_socket_t* socket) {
+    (void)channel; (void)socket;
+    return PS_ERROR_UNSUPPORTED;
+}
+
+ps_result_t _purrsock_accept_passed_socket(_purrsock_socket_t* channel, _purrsock_socket_t** socket) {
+    (void)channel; (void)socket;
+    return PS_ERROR_UNSUPPORTED;
+}
+
+// Segmentation offload needs WSASendMsg/UDP_SEND_MSG_SIZE, which purrsock does not use yet: send datagrams one by one.
+
+ps_result_t _purrsock_send_socket_packet_segmented(_purrsock_socket_t* socket, ps_packet_t packet, size_t segment_size, const ps_endpoint_t* to, size_t* sent) {
+    assert(socket && segment_size && sent);
+    *sent = 0;
+    _purrsock_socket_data_t* data = (_purrsock_socket_data_t*)socket->data;
+    if (!data) return PS_ERROR_NOTINIT;
+    if (socket->protocol != PS_PROTOCOL_UDP) return PS_ERROR_INVALID_ARGUMENT;
+
+    struct sockaddr_storage addr;
+    int addr_len = to ? _purrsock_endpoint_to_sockaddr(to, &addr) : 0;
+
+    size_t offset = 0;
+    do {
+        size_t chunk = packet.size - offset < segment_size ? packet.size - offset : segment_size;
+        int res = to
+            ? sendto(data->socket, packet.buf + offset, (int)chunk, 0, (struct sockaddr*)&addr, addr_len)
+            : send(data->socket, packet.buf + offset, (int)chunk, 0);
+        if (res == SOCKET_ERROR) return _last_ps_result("purrsock_send_socket_packet_segmented");
+        (*sent)++;
+        offset += chunk;
+    } while (offset < packet.size);
+
+    return PS_SUCCESS;
+}
+
+ps_result_t _purrsock_set_socket_gro(_purrsock_socket_t* socket, bool enabled) {
+    (void)socket; (void)enabled;
+    return PS_ERROR_UNSUPPORTED;
+}
+
+ps_result_t _purrsock_read_socket_packet_segmented(_purrsock_socket_t* socket, ps_packet_t* packet, size_t* segment_size, ps_endpoint_t* from) {
+    assert(socket && packet && segment_size);
+    _purrsock_socket_data_t* data = (_purrsock_socket_data_t*)socket->data;
+    if (!data) return PS_ERROR_NOTINIT;
+    if (socket->protocol != PS_PROTOCOL_UDP) return PS_ERROR_INVALID_ARGUMENT;
+
+    // Without GRO every receive is a single datagram.
+    *segment_size = 0;
+    struct sockaddr_storage addr;
+    int addr_len = sizeof(addr);
+    int res = recvfrom(data->socket, packet->buf, (int)packet->capacity, 0, (struct sockaddr*)&addr, &addr_len);
+    ps_result_t result = PS_SUCCESS;
+    if (res == SOCKET_ERROR) {
+        if (WSAGetLastError() != WSAEMSGSIZE) return _last_ps_result("purrsock_read_socket_packet_segmented");
+        res = (int)packet->capacity;
+        result = PS_ERROR_MSGTOOLONG;
+    }
+
+    packet->size = res;
+    if (from) _purrsock_endpoint_from_sockaddr(&addr, from);
+    return result;
+}
+
+ps_result_t _purrsock_set_socket_blocking(_purrsock_socket_t *socket, bool blocking) {
+    assert(socket);
+    if (socket->memory) return _purrsock_memory_set_blocking(socket, blocking);
+    _purrsock_socket_data_t *data = (_purrsock_socket_data_t*)socket->data;
+    if (!data) return PS_ERROR_NOTINIT;
+
+    u_long mode = blocking ? 0 : 1;
+    if (ioctlsocket(data->socket, FIONBIO, &mode) == SOCKET_ERROR) {
+        return _last_ps_result("purrsock_set_socket_blocking");
+    }
+    return PS_SUCCESS;
+}
+
+ps_result_t _purrsock_set_socket_nodelay(_purrsock_socket_t* socket, bool enabled) {
+    assert(socket);
+    if (socket->memory) return PS_SUCCESS;
+    _purrsock_socket_data_t* data = (_purrsock_socket_data_t*)socket->data;
+    if (!data) return PS_ERROR_NOTINIT;
+    if (socket->protocol != PS_PROTOCOL_TCP) return PS_ERROR_INVALID_ARGUMENT;
+
+    BOOL value = enabled ? TRUE : FALSE;
+    if (setsockopt(data->socket, IPPROTO_TCP, TCP_NODELAY, (const char*)&value, sizeof(value)) == SOCKET_ERROR) {
+        return _last_ps_result("purrsock_set_socket_nodelay");
+    }
+    return PS_SUCCESS;
+}
+
+// Winsock reports expired SO_RCVTIMEO/SO_SNDTIMEO timeouts as WSAETIMEDOUT.
+ps_result_t _purrsock_set_socket_timeouts(_purrsock_socket_t* socket, const ps_socket_timeouts_t* timeouts) {
+    assert(socket && timeouts);
+    if (socket->memory) {
+        socket->timeouts = *timeouts;
+        return PS_SUCCESS;
+    }
+    _purrsock_socket_data_t* data = (_purrsock_socket_data_t*)socket->data;
+    if (!data) return PS_ERROR_NOTINIT;
+
+    DWORD read_timeout = timeouts->read_ms;
+    DWORD write_timeout = timeouts->write_ms;
+    if (setsockopt(data->socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&read_timeout, sizeof(read_timeout)) == SOCKET_ERROR ||
+        setsockopt(data->socket, SOL_SOCKET, SO_SNDTIMEO, (const char*)&write_timeout, sizeof(write_timeout)) == SOCKET_ERROR) {
+        return _last_ps_result("purrsock_set_socket_timeouts");
+    }
+
+    socket->timeouts = *timeouts;
+    return PS_SUCCESS;
+}
+
+// Winsock has no TCP_CORK.
+ps_result_t _purrsock_set_socket_cork(_purrsock_socket_t* socket, bool enabled) {
+    (void)enabled;
+    return socket->memory ? PS_SUCCESS : PS_ERROR_UNSUPPORTED;
+}
+
+bool _purrsock_socket_is_idle_alive(_purrsock_socket_t* socket) {
+    if (socket->memory) return _purrsock_memory_is_idle_alive(socket);
+    _purrsock_socket_data_t* data = (_purrsock_socket_data_t*)socket->data;
+    if (!data) return false;
+    if (socket->protocol != PS_PROTOCOL_TCP) return true;
+
+    // Readable means either a hang-up or unsolicited data, neither of which leaves the connection reusable.
+    fd_set read_set;
+    FD_ZERO(&read_set);
+    FD_SET(data->socket, &read_set);
+    struct timeval timeout = { 0, 0 };
+    return select(0, &read_set, NULL, NULL, &timeout) == 0;
+}
+
+void _purrsock_mutex_init(_purrsock_mutex_t *mutex) {
+    InitializeCriticalSection(mutex);
+}
+
+void _purrsock_mutex_destroy(_purrsock_mutex_t *mutex) {
+    DeleteCriticalSection(mutex);
+}
+
+void _purrsock_mutex_lock(_purrsock_mutex_t *mutex) {
+    EnterCriticalSection(mutex);
+}
+
+void _purrsock_mutex_unlock(_purrsock_mutex_t *mutex) {
+    LeaveCriticalSection(mutex);
+}
+
+void _purrsock_cond_init(_purrsock_cond_t *cond) {
+    InitializeConditionVariable(cond);
+}
+
+void _purrsock_cond_destroy(_purrsock_cond_t *cond) {
+    (void)cond;
+}
+
+void _purrsock_cond_wait(_purrsock_cond_t *cond, _purrsock_mutex_t *mutex) {
+    SleepConditionVariableCS(cond, mutex, INFINITE);
+}
+
+bool _purrsock_cond_timed_wait(_purrsock_cond_t *cond, _purrsock_mutex_t *mutex, uint32_t timeout_ms) {
+    return SleepConditionVariableCS(cond, mutex, timeout_ms) != 0;
+}
+
+void _purrsock_cond_signal(_purrsock_cond_t *cond) {
+    WakeConditionVariable(cond);
+}
+
+void _purrsock_cond_broadcast(_purrsock_cond_t *cond) {
+    WakeAllConditionVariable(cond);
+}
+
+typedef struct {
+    void (*entry)(void*);
+    void* arg;
+} _purrsock_thread_start_t;
+
+static DWORD WINAPI _purrsock_thread_main(void* arg) {
+    _purrsock_thread_start_t start = *(_purrsock_thread_start_t*)arg;
+    free(arg);
+    start.entry(start.arg);
+    return 0;
+}
+
+ps_result_t _purrsock_thread_create(_purrsock_thread_t* thread, void (*entry)(void*), void* arg) {
+    _purrsock_thread_start_t* start = (_purrsock_thread_start_t*)malloc(sizeof(*start));
+    if (!start) return PS_ERROR_INTERNAL;
+    start->entry = entry;
+    start->arg = arg;
+
+    *thread = CreateThread(NULL, 0, _purrsock_thread_main, start, 0, NULL);
+    if (!*thread) {
+        free(start);
+        return PS_ERROR_INTERNAL;
+    }
     return PS_SUCCESS;
 }
 
+void _purrsock_thread_join(_purrsock_thread_t thread) {
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
 
+bool _purrsock_thread_pin(_purrsock_thread_t thread, size_t cpu) {
+    return SetThreadAffinityMask(thread, (DWORD_PTR)1 << (cpu % (sizeof(DWORD_PTR) * 8))) != 0;
+}
+
+size_t _purrsock_cpu_count() {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors ? info.dwNumberOfProcessors : 1;
+}
+
+uint64_t _purrsock_monotonic_ms() {
+    return GetTickCount64();
+}
+
+uint64_t _purrsock_monotonic_us() {
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000 +
+           (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000 / frequency.QuadPart;
+}
+
+uint64_t _purrsock_monotonic_ns() {
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000000 +
+           (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000000 / frequency.QuadPart;
+}
+
+bool _purrsock_random(void *buf, size_t size) {
+    return size <= ULONG_MAX && BCRYPT_SUCCESS(BCryptGenRandom(NULL, (PUCHAR)buf, (ULONG)size, BCRYPT_USE_SYSTEM_PREFERRED_RNG));
+}
+
+// PS_PROTOCOL_SHM sockets cannot be created here, so none of these is reached.
+ps_result_t _purrsock_shm_map(const char* name, size_t size, bool create, void** addr) {
+    (void)name; (void)size; (void)create; (void)addr;
+    return PS_ERROR_UNSUPPORTED;
+}
+
+void _purrsock_shm_unmap(void* addr, size_t size) {
+    (void)addr; (void)size;
+}
+
+void _purrsock_shm_unlink(const char* name) {
+    (void)name;
+}
+
+void _purrsock_futex_wait(uint32_t* word, uint32_t value, uint32_t timeout_ms) {
+    (void)word; (void)value; (void)timeout_ms;
+}
+
+void _purrsock_futex_wake(uint32_t* word) {
+    (void)word;
+}
+
+uint32_t _purrsock_process_id() {
+    return (uint32_t)GetCurrentProcessId();
+}
+
+bool _purrsock_process_alive(uint32_t pid) {
+    (void)pid;
+    return true;
+}
+
+static INIT_ONCE s_thread_exit_once = INIT_ONCE_STATIC_INIT;
+static DWORD s_thread_exit_index = FLS_OUT_OF_INDEXES;
+
+static void WINAPI _purrsock_thread_exit(void *callback) {
+    if (callback) ((void (*)(void))callback)();
+}
+
+static BOOL CALLBACK _purrsock_thread_exit_index_init(PINIT_ONCE once, void *param, void **context) {
+    (void)once; (void)param; (void)context;
+    s_thread_exit_index = FlsAlloc(_purrsock_thread_exit);
+    return s_thread_exit_index != FLS_OUT_OF_INDEXES;
+}
+
+void _purrsock_at_thread_exit(void (*callback)(void)) {
+    if (!InitOnceExecuteOnce(&s_thread_exit_once, _purrsock_thread_exit_index_init, NULL, NULL)) return;
+    FlsSetValue(s_thread_exit_index, (void*)callback);
+}
+
+// The event loop is epoll based and not available on Windows yet.
+
+ps_result_t _purrsock_create_loop(_purrsock_loop_t **loop, const ps_loop_options_t *options) {
+    (void)loop; (void)options;
+    return PS_ERROR_UNSUPPORTED;
+}
+
+void _purrsock_destroy_loop(_purrsock_loop_t *loop) {
+    (void)loop;
+}
+
+ps_result_t _purrsock_loop_add_socket(_purrsock_loop_t *loop, _purrsock_socket_t *socket, ps_loop_callbacks_t callbacks) {
+    (void)loop; (void)socket; (void)callbacks;
+    return PS_ERROR_UNSUPPORTED;
+}
+
+ps_result_t _purrsock_loop_remove_socket(_purrsock_loop_t *loop, _purrsock_socket_t *socket) {
+    (void)loop; (void)socket;
+    return PS_ERROR_UNSUPPORTED;
+}
+
+ps_result_t _purrsock_loop_run_once(_purrsock_loop_t *loop, int timeout_ms) {
+    (void)loop; (void)timeout_ms;
+    return PS_ERROR_UNSUPPORTED;
+}
+
+ps_result_t _purrsock_loop_add_tick(_purrsock_loop_t *loop, ps_loop_tick_callback_t callback, void *user_data) {
+    (void)loop; (void)callback; (void)user_data;
+    return PS_ERROR_UNSUPPORTED;
+}
+
+ps_result_t _purrsock_loop_remove_tick(_purrsock_loop_t *loop, ps_loop_tick_callback_t callback, void *user_data) {
+    (void)loop; (void)callback; (void)user_data;
+    return PS_ERROR_UNSUPPORTED;
+}
+
+ps_result_t _purrsock_loop_post(_purrsock_loop_t *loop, ps_task_callback_t callback, void *user_data) {
+    (void)loop; (void)callback; (void)user_data;
+    return PS_ERROR_UNSUPPORTED;
+}
+
+ps_result_t _purrsock_loop_start_timer(_purrsock_loop_t *loop, ps_timer_t *timer, uint64_t timeout_ms) {
+    (void)loop; (void)timer; (void)timeout_ms;
+    return PS_ERROR_UNSUPPORTED;
+}
+
+void _purrsock_loop_stop_timer(_purrsock_loop_t *loop, ps_timer_t *timer) {
+    (void)loop; (void)timer;
+}
+
+uint64_t _purrsock_loop_now(_purrsock_loop_t *loop) {
+    (void)loop;
+    return _purrsock_monotonic_ms();
+}
+
+ps_result_t _purrsock_get_loop_stats(_purrsock_loop_t *loop, ps_stats_t *stats) {
+    (void)loop;
+    memset(stats, 0, sizeof(*stats));
+    return PS_ERROR_UNSUPPORTED;
+}
+
+ps_result_t _purrsock_loop_set_socket_heartbeat(_purrsock_loop_t *loop, _purrsock_socket_t *socket, const ps_heartbeat_options_t *options) {
+    (void)loop; (void)socket; (void)options;
+    return PS_ERROR_UNSUPPORTED;
+}
+
+ps_result_t _purrsock_connect_async(_purrsock_loop_t *loop, const char *host, ps_port_t port, const ps_connect_options_t *options, ps_connect_callback_t callback, void *user_data) {
+    (void)loop; (void)host; (void)port; (void)options; (void)callback; (void)user_data;
+    return PS_ERROR_UNSUPPORTED;
+}
+
+ps_result_t _purrsock_loop_run(_purrsock_loop_t *loop) {
+    (void)loop;
+    return PS_ERROR_UNSUPPORTED;
+}
+
+void _purrsock_loop_stop(_purrsock_loop_t *loop) {
+    (void)loop;
+}
+
+ps_loop_backend_t _purrsock_loop_get_backend(_purrsock_loop_t *loop) {
+    (void)loop;
+    return PS_LOOP_BACKEND_AUTO;
+}
+
+ps_result_t _purrsock_loop_read_socket_packet(_purrsock_loop_t *loop, _purrsock_socket_t *socket, ps_packet_t *packet, ps_loop_packet_completion_t callback, void *user_data) {
+    (void)loop; (void)socket; (void)packet; (void)callback; (void)user_data;
+    return PS_ERROR_UNSUPPORTED;
+}
+
+ps_result_t _purrsock_loop_read_socket_packet_multishot(_purrsock_loop_t *loop, _purrsock_socket_t *socket, ps_loop_packet_completion_t callback, void *user_data) {
+    (void)loop; (void)socket; (void)callback; (void)user_data;
+    return PS_ERROR_UNSUPPORTED;
+}
+
+ps_result_t _purrsock_loop_send_socket_packet(_purrsock_loop_t *loop, _purrsock_socket_t *socket, ps_packet_t *packet, ps_loop_packet_completion_t callback, void *user_data) {
+    (void)loop; (void)socket; (void)packet; (void)callback; (void)user_data;
+    return PS_ERROR_UNSUPPORTED;
+}
+
+ps_result_t _purrsock_loop_accept_socket(_purrsock_loop_t *loop, _purrsock_socket_t *socket, bool multishot, ps_loop_accept_completion_t callback, void *user_data) {
+    (void)loop; (void)socket; (void)multishot; (void)callback; (void)user_data;
+    return PS_ERROR_UNSUPPORTED;
+}
 
 #endif
@@ -0,0 +1,140 @@
+#include <purrsock/purrsock.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_SECONDS 1.0
+#define BENCH_CLIENTS 4
+
+/**
+ * @brief Connection rate: one listener accepting on one thread versus `ps_server_t` with SO_REUSEPORT workers.
+ *
+ * Client threads connect and immediately reset their connections for a fixed time against each mode,
+ * and the connections accepted per second are reported.
+ * Usage: bench_accept [seconds] [workers] [clients]
+ */
+
+static atomic_bool s_stop;
+static atomic_ullong s_accepted;
+static ps_port_t s_port;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Clients use plain sockets so they can close with a reset: TIME_WAIT would exhaust the ephemeral ports.
+static void *client_thread(void *arg) {
+    (void)arg;
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(s_port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    struct linger linger = {1, 0};
+
+    while (!atomic_load(&s_stop)) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) continue;
+        setsockopt(fd, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+        connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+        close(fd);
+    }
+    return NULL;
+}
+
+static double run_clients(int clients, double seconds) {
+    atomic_store(&s_stop, false);
+    atomic_store(&s_accepted, 0);
+    pthread_t threads[64];
+    for (int i = 0; i < clients; ++i) pthread_create(&threads[i], NULL, client_thread, NULL);
+
+    double start = now_seconds();
+    while (now_seconds() - start < seconds) usleep(10000);
+    double elapsed = now_seconds() - start;
+    unsigned long long accepted = atomic_load(&s_accepted);
+
+    atomic_store(&s_stop, true);
+    for (int i = 0; i < clients; ++i) pthread_join(threads[i], NULL);
+    return accepted / elapsed;
+}
+
+static void *single_accept_thread(void *arg) {
+    ps_socket_t listener = (ps_socket_t)arg;
+    ps_socket_t client;
+    while (ps_accept_socket(listener, &client) == PS_SUCCESS) {
+        ps_destroy_socket(client);
+        atomic_fetch_add(&s_accepted, 1);
+    }
+    return NULL;
+}
+
+static void on_accept(ps_loop_t loop, ps_socket_t socket, ps_socket_t client, void *user_data) {
+    (void)loop; (void)socket; (void)user_data;
+    ps_destroy_socket(client);
+    atomic_fetch_add(&s_accepted, 1);
+}
+
+int main(int argc, char **argv) {
+    double seconds = argc > 1 ? atof(argv[1]) : BENCH_SECONDS;
+    size_t workers = argc > 2 ? (size_t)atoi(argv[2]) : 0;
+    int clients = argc > 3 ? atoi(argv[3]) : BENCH_CLIENTS;
+    if (clients < 1 || clients > 64) clients = BENCH_CLIENTS;
+    if (!ps_init()) return 1;
+
+    // One listener, accepted on a single thread as with ps_listen_socket/ps_accept_socket.
+    ps_socket_t listener;
+    ps_endpoint_t endpoint;
+    if (ps_create_socket(&listener, PS_PROTOCOL_TCP, PS_ADDRESS_IPV4) != PS_SUCCESS ||
+        ps_bind_socket(listener, "127.0.0.1", 0) != PS_SUCCESS ||
+        ps_listen_socket(listener) != PS_SUCCESS ||
+        ps_get_socket_endpoint(listener, &endpoint) != PS_SUCCESS) {
+        fprintf(stderr, "Failed to create the listener\n");
+        return 1;
+    }
+    s_port = endpoint.port;
+    pthread_t acceptor;
+    pthread_create(&acceptor, NULL, single_accept_thread, listener);
+    double single = run_clients(clients, seconds);
+
+    // Closing the listener under a blocked accept does not wake it; one more connection does.
+    ps_set_socket_blocking(listener, false);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(s_port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+    close(fd);
+    pthread_join(acceptor, NULL);
+    ps_destroy_socket(listener);
+
+    ps_server_options_t options = {0};
+    options.workers = workers;
+    options.pin_workers = true;
+    options.on_accept = on_accept;
+    ps_server_t server;
+    if (ps_create_server(&server, PS_ADDRESS_IPV4, "127.0.0.1", 0, &options) != PS_SUCCESS ||
+        ps_server_start(server) != PS_SUCCESS) {
+        fprintf(stderr, "Failed to start the server\n");
+        return 1;
+    }
+    s_port = ps_server_get_port(server);
+    double multi = run_clients(clients, seconds);
+    ps_server_stop(server);
+
+    printf("TCP accept, %d client threads, %.1fs per mode\n", clients, seconds);
+    printf("%-24s %12.0f connections/s\n", "single listener", single);
+    printf("reuseport, %2zu workers   %12.0f connections/s\n", ps_server_get_worker_count(server), multi);
+
+    ps_destroy_server(server);
+    ps_cleanup();
+    return 0;
+}
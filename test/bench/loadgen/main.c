@@ -0,0 +1,559 @@
+#include <purrsock/purrsock.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#define LOADGEN_CONNECTIONS 16
+#define LOADGEN_THREADS 2
+#define LOADGEN_SECONDS 10.0
+#define LOADGEN_SIZE 64
+#define LOADGEN_TIMEOUT_MS 2000
+#define LOADGEN_CONNECT_WAIT_MS 5000
+#define LOADGEN_RETRY_DELAY_MS 100
+#define LOADGEN_RESPONSE_BUFFER 65536
+
+/**
+ * @brief Load generator driving TCP, UDP or HTTP/1.1 servers through purrsock's own client path.
+ *
+ * Every thread runs a `ps_loop_t` over its share of the connections, which are opened with `ps_connect_async`
+ * and driven with asynchronous sends and reads, one request in flight per connection.
+ *
+ * Closed loop (the default) sends the next request as soon as the previous answer arrives. With `--rate`,
+ * requests are sent open loop on a fixed schedule spread over the connections, and latency is measured from
+ * when a request was due rather than when it could go out: a stalled server then shows in the percentiles
+ * instead of silently lowering the request rate (coordinated omission).
+ *
+ * Every request due during the run is measured: once the duration is over no new requests go out, but those
+ * still in flight are waited for, up to `--timeout`, so the slowest answers are not cut off by the end of the
+ * run. Requests that get no answer within the timeout are reported as timeouts.
+ *
+ * TCP and UDP expect an echo of the `--size` byte request. UDP requests carry a sequence number so late
+ * answers to requests that timed out are ignored; UDP hosts must be literal addresses. HTTP sends GET
+ * requests for `--path` on keep-alive connections and needs a Content-Length in the answers; connections the
+ * server closes are reopened and the request is sent again. Non-2xx answers count as errors.
+ *
+ * Usage: ps_loadgen [--protocol tcp|udp|http] [--connections N] [--threads M] [--duration S] [--rate R]
+ *                   [--size B] [--path P] [--timeout MS] host port
+ */
+
+typedef enum {
+    LOADGEN_TCP,
+    LOADGEN_UDP,
+    LOADGEN_HTTP,
+} loadgen_protocol_t;
+
+typedef enum {
+    CONN_CLOSED,
+    CONN_CONNECTING,
+    CONN_IDLE,
+    CONN_BUSY,
+} conn_state_t;
+
+typedef struct worker_s worker_t;
+
+typedef struct {
+    worker_t *worker;
+    size_t index;                   // Among all connections, to stagger open-loop schedules.
+    conn_state_t state;
+    ps_socket_t socket;
+    uint64_t retry_at;              // Earliest time to reconnect after a failure.
+    bool resend;                    // Resend the current request once reconnected.
+    bool close_after;               // The server closes the connection after this answer.
+    uint64_t served;                // Requests answered on the current connection.
+
+    char *request;
+    ps_packet_t send_packet;
+    uint64_t sequence;
+    uint64_t due;                   // When the current request was due: its latency starts here.
+    uint64_t sent_at;               // When it actually went out, for the timeout.
+    uint64_t next_due;              // Open loop: when the next request is due.
+
+    char response[LOADGEN_RESPONSE_BUFFER];
+    ps_packet_t read_packet;
+    size_t received;
+    size_t header_size;             // HTTP: size of the header once it arrived, 0 before.
+    size_t expected;                // Size of the whole answer, once known.
+} conn_t;
+
+struct worker_s {
+    pthread_t thread;
+    ps_loop_t loop;
+    conn_t *conns;
+    size_t conn_count;
+
+    uint64_t *samples;
+    size_t sample_count;
+    size_t sample_capacity;
+    unsigned long long connect_errors;
+    unsigned long long errors;
+    unsigned long long status_errors;
+    unsigned long long timeouts;
+    unsigned long long reconnects;
+    unsigned long long bytes;
+};
+
+static loadgen_protocol_t s_protocol = LOADGEN_TCP;
+static const char *s_host;
+static ps_port_t s_port;
+static size_t s_connections = LOADGEN_CONNECTIONS;
+static size_t s_threads = LOADGEN_THREADS;
+static double s_seconds = LOADGEN_SECONDS;
+static double s_rate;
+static size_t s_size = LOADGEN_SIZE;
+static const char *s_path = "/";
+static uint32_t s_timeout_ms = LOADGEN_TIMEOUT_MS;
+
+static pthread_barrier_t s_barrier;
+static uint64_t s_start, s_end;
+static uint64_t s_interval;         // Open loop: time between requests of one connection.
+static atomic_bool s_running;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void record(worker_t *worker, uint64_t latency) {
+    if (worker->sample_count == worker->sample_capacity) {
+        size_t capacity = worker->sample_capacity ? worker->sample_capacity * 2 : 65536;
+        uint64_t *samples = realloc(worker->samples, capacity * sizeof(*samples));
+        if (!samples) return;
+        worker->samples = samples;
+        worker->sample_capacity = capacity;
+    }
+    worker->samples[worker->sample_count++] = latency;
+}
+
+static void conn_connect(conn_t *conn);
+static void conn_read(conn_t *conn);
+static void conn_next(conn_t *conn, uint64_t now);
+
+static void conn_close(conn_t *conn, uint64_t retry_delay_ms) {
+    if (conn->socket) ps_destroy_socket(conn->socket);
+    conn->socket = NULL;
+    conn->state = CONN_CLOSED;
+    conn->served = 0;
+    conn->retry_at = now_ns() + retry_delay_ms * 1000000;
+}
+
+static void conn_fail(conn_t *conn) {
+    conn->worker->errors++;
+    conn->resend = false;
+    conn_close(conn, 0);
+}
+
+static void on_sent(ps_loop_t loop, ps_socket_t socket, ps_result_t result, ps_packet_t *packet, void *user_data) {
+    (void)loop; (void)socket; (void)packet;
+    conn_t *conn = (conn_t *)user_data;
+    if (result != PS_SUCCESS && conn->state == CONN_BUSY) conn_fail(conn);
+}
+
+static void conn_send(conn_t *conn, uint64_t due) {
+    conn->due = due;
+    conn->sent_at = now_ns();
+    conn->received = 0;
+    conn->header_size = 0;
+    conn->expected = s_protocol == LOADGEN_HTTP ? 0 : s_size;
+    conn->state = CONN_BUSY;
+    if (s_protocol == LOADGEN_UDP) {
+        conn->sequence++;
+        memcpy(conn->request, &conn->sequence, sizeof(conn->sequence));
+    }
+
+    ps_loop_t loop = conn->worker->loop;
+    if (ps_loop_send_socket_packet(loop, conn->socket, &conn->send_packet, on_sent, conn) != PS_SUCCESS) {
+        conn_fail(conn);
+        return;
+    }
+    conn_read(conn);
+}
+
+// Closed loop sends right away; open loop once the next request is due. Nothing is due after the run.
+static void conn_next(conn_t *conn, uint64_t now) {
+    if (conn->state != CONN_IDLE || !atomic_load_explicit(&s_running, memory_order_relaxed)) return;
+    if (!s_interval) {
+        if (now < s_end) conn_send(conn, now);
+    } else if (conn->next_due <= now && conn->next_due < s_end) {
+        uint64_t due = conn->next_due;
+        conn->next_due += s_interval;
+        conn_send(conn, due);
+    }
+}
+
+static void conn_complete(conn_t *conn) {
+    uint64_t now = now_ns();
+    worker_t *worker = conn->worker;
+    if (conn->due >= s_start && conn->due < s_end) {
+        record(worker, now - conn->due);
+        worker->bytes += conn->received;
+    }
+    conn->served++;
+    conn->state = CONN_IDLE;
+    if (conn->close_after) conn_close(conn, 0);
+    else conn_next(conn, now);
+}
+
+// Parses the header of an HTTP answer once it arrived whole; false if the answer cannot be used.
+static bool parse_http_header(conn_t *conn) {
+    char *end = NULL;
+    for (size_t i = 3; i < conn->received; ++i) {
+        if (!memcmp(conn->response + i - 3, "\r\n\r\n", 4)) {
+            end = conn->response + i + 1;
+            break;
+        }
+    }
+    if (!end) return conn->received < sizeof(conn->response);
+    conn->header_size = (size_t)(end - conn->response);
+
+    int status = 0;
+    if (sscanf(conn->response, "HTTP/1.%*d %d", &status) != 1) return false;
+    if (status < 200 || status > 299) conn->worker->status_errors++;
+
+    bool has_length = status == 204 || status == 304;
+    size_t length = 0;
+    conn->close_after = !strncmp(conn->response, "HTTP/1.0", 8);
+    for (char *line = strstr(conn->response, "\r\n") + 2; line < end - 2; line = strstr(line, "\r\n") + 2) {
+        if (!strncasecmp(line, "Content-Length:", 15)) {
+            length = strtoull(line + 15, NULL, 10);
+            has_length = true;
+        } else if (!strncasecmp(line, "Connection:", 11)) {
+            const char *value = line + 11;
+            while (*value == ' ') value++;
+            conn->close_after = !strncasecmp(value, "close", 5);
+        }
+    }
+    conn->expected = conn->header_size + length;
+    return has_length;
+}
+
+static void on_read(ps_loop_t loop, ps_socket_t socket, ps_result_t result, ps_packet_t *packet, void *user_data) {
+    (void)loop; (void)socket;
+    conn_t *conn = (conn_t *)user_data;
+    if (conn->state != CONN_BUSY) return;
+
+    if (result != PS_SUCCESS) {
+        // A keep-alive connection the server dropped between requests: reopen it and ask again.
+        if (!conn->received && conn->served && !conn->resend && (result == PS_CONNCLOSED || result == PS_ERROR_CONNRESET)) {
+            conn->worker->reconnects++;
+            conn->resend = true;
+            conn_close(conn, 0);
+            conn_connect(conn);
+            return;
+        }
+        conn_fail(conn);
+        return;
+    }
+
+    if (s_protocol == LOADGEN_UDP) {
+        uint64_t sequence;
+        if (packet->size >= sizeof(sequence)) memcpy(&sequence, packet->buf, sizeof(sequence));
+        if (packet->size < sizeof(sequence) || sequence != conn->sequence) {
+            conn_read(conn);  // The late answer of a request that timed out.
+            return;
+        }
+        conn->received = packet->size;
+        conn_complete(conn);
+        return;
+    }
+
+    conn->received += packet->size;
+    if (s_protocol == LOADGEN_HTTP && !conn->header_size) {
+        conn->response[conn->received] = '\0';
+        if (!parse_http_header(conn)) {
+            conn_fail(conn);
+            return;
+        }
+    }
+    if (conn->expected && conn->received >= conn->expected) conn_complete(conn);
+    else conn_read(conn);
+}
+
+// Reads go to the buffer's start, except while an HTTP header is still arriving; the body is only counted.
+static void conn_read(conn_t *conn) {
+    size_t offset = s_protocol == LOADGEN_HTTP && !conn->header_size ? conn->received : 0;
+    conn->read_packet = (ps_packet_t){ 0, conn->response + offset, sizeof(conn->response) - offset };
+    if (s_protocol == LOADGEN_HTTP && !conn->header_size) conn->read_packet.capacity--;  // Room for a terminator.
+    if (ps_loop_read_socket_packet(conn->worker->loop, conn->socket, &conn->read_packet, on_read, conn) != PS_SUCCESS) {
+        conn_fail(conn);
+    }
+}
+
+static void on_connect(ps_loop_t loop, ps_result_t result, ps_socket_t socket, void *user_data) {
+    (void)loop;
+    conn_t *conn = (conn_t *)user_data;
+    if (result != PS_SUCCESS) {
+        conn->worker->connect_errors++;
+        conn->resend = false;
+        conn_close(conn, LOADGEN_RETRY_DELAY_MS);
+        return;
+    }
+
+    conn->socket = socket;
+    conn->close_after = false;
+    ps_set_socket_nodelay(socket, true);
+    conn->state = CONN_IDLE;
+    if (conn->resend) {
+        conn->resend = false;
+        conn_send(conn, conn->due);
+    } else {
+        conn_next(conn, now_ns());
+    }
+}
+
+static void conn_connect(conn_t *conn) {
+    conn->state = CONN_CONNECTING;
+    if (s_protocol != LOADGEN_UDP) {
+        ps_connect_options_t options = {0};
+        options.timeout_ms = s_timeout_ms;
+        ps_result_t result = ps_connect_async(conn->worker->loop, s_host, s_port, &options, on_connect, conn);
+        if (result != PS_SUCCESS) on_connect(conn->worker->loop, result, NULL, conn);
+        return;
+    }
+
+    ps_socket_t socket;
+    ps_result_t result = ps_create_socket(&socket, PS_PROTOCOL_UDP, PS_ADDRESS_IPV4);
+    if (result == PS_SUCCESS) {
+        result = ps_connect_socket(socket, s_host, s_port);
+        if (result != PS_SUCCESS) ps_destroy_socket(socket);
+    }
+    on_connect(conn->worker->loop, result, result == PS_SUCCESS ? socket : NULL, conn);
+}
+
+// True while a request is in flight, or waits for its connection to be reopened.
+static bool worker_busy(worker_t *worker) {
+    for (size_t i = 0; i < worker->conn_count; ++i) {
+        if (worker->conns[i].state == CONN_BUSY || worker->conns[i].resend) return true;
+    }
+    return false;
+}
+
+// Reconnects, expires requests past the timeout and sends what is due; returns how long the loop may wait.
+static int worker_poll(worker_t *worker, uint64_t now) {
+    uint64_t wait = 10000000;
+    for (size_t i = 0; i < worker->conn_count; ++i) {
+        conn_t *conn = &worker->conns[i];
+        if (conn->state == CONN_CLOSED && conn->retry_at <= now) {
+            conn_connect(conn);
+        } else if (conn->state == CONN_BUSY && now - conn->sent_at > (uint64_t)s_timeout_ms * 1000000) {
+            worker->timeouts++;
+            if (s_protocol == LOADGEN_UDP) {
+                conn->state = CONN_IDLE;
+            } else {
+                conn_close(conn, 0);
+                continue;
+            }
+        }
+        conn_next(conn, now);
+        if (s_interval && conn->state == CONN_IDLE) {
+            uint64_t until = conn->next_due > now ? conn->next_due - now : 0;
+            if (until < wait) wait = until;
+        }
+    }
+    return (int)(wait / 1000000);
+}
+
+static void *worker_thread(void *arg) {
+    worker_t *worker = (worker_t *)arg;
+    ps_loop_t loop = worker->loop;
+
+    // Open every connection before the clock starts.
+    for (size_t i = 0; i < worker->conn_count; ++i) conn_connect(&worker->conns[i]);
+    uint64_t deadline = now_ns() + (uint64_t)LOADGEN_CONNECT_WAIT_MS * 1000000;
+    for (;;) {
+        size_t pending = 0;
+        for (size_t i = 0; i < worker->conn_count; ++i) pending += worker->conns[i].state == CONN_CONNECTING;
+        if (!pending || now_ns() >= deadline) break;
+        ps_loop_run_once(loop, 10);
+    }
+
+    pthread_barrier_wait(&s_barrier);
+    pthread_barrier_wait(&s_barrier);
+    for (size_t i = 0; i < worker->conn_count; ++i) {
+        conn_t *conn = &worker->conns[i];
+        conn->next_due = s_start + (s_interval * conn->index) / s_connections;
+    }
+
+    uint64_t now;
+    while ((now = now_ns()) < s_end) {
+        int wait_ms = worker_poll(worker, now);
+        uint64_t left_ms = (s_end - now) / 1000000;
+        ps_loop_run_once(loop, (uint64_t)wait_ms < left_ms ? wait_ms : (int)left_ms);
+    }
+
+    // Let the requests in flight finish; the poll expires those that do not within the timeout.
+    while (worker_busy(worker)) {
+        worker_poll(worker, now_ns());
+        ps_loop_run_once(loop, 10);
+    }
+    atomic_store(&s_running, false);
+
+    for (size_t i = 0; i < worker->conn_count; ++i) {
+        if (worker->conns[i].socket) ps_destroy_socket(worker->conns[i].socket);
+        free(worker->conns[i].request);
+    }
+    return NULL;
+}
+
+static void usage(void) {
+    fprintf(stderr, "Usage: ps_loadgen [--protocol tcp|udp|http] [--connections N] [--threads M] [--duration S] [--rate R]\n"
+                    "                  [--size B] [--path P] [--timeout MS] host port\n");
+}
+
+static bool parse_args(int argc, char **argv) {
+    int positional = 0;
+    for (int i = 1; i < argc; ++i) {
+        bool has_value = i + 1 < argc;
+        if (!strcmp(argv[i], "--protocol") && has_value) {
+            const char *name = argv[++i];
+            if (!strcmp(name, "tcp")) s_protocol = LOADGEN_TCP;
+            else if (!strcmp(name, "udp")) s_protocol = LOADGEN_UDP;
+            else if (!strcmp(name, "http")) s_protocol = LOADGEN_HTTP;
+            else return false;
+        }
+        else if (!strcmp(argv[i], "--connections") && has_value) s_connections = (size_t)atol(argv[++i]);
+        else if (!strcmp(argv[i], "--threads") && has_value) s_threads = (size_t)atol(argv[++i]);
+        else if (!strcmp(argv[i], "--duration") && has_value) s_seconds = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--rate") && has_value) s_rate = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--size") && has_value) s_size = (size_t)atol(argv[++i]);
+        else if (!strcmp(argv[i], "--path") && has_value) s_path = argv[++i];
+        else if (!strcmp(argv[i], "--timeout") && has_value) s_timeout_ms = (uint32_t)atol(argv[++i]);
+        else if (argv[i][0] == '-') return false;
+        else if (positional == 0 && ++positional) s_host = argv[i];
+        else if (positional == 1 && ++positional) s_port = (ps_port_t)atoi(argv[i]);
+        else return false;
+    }
+    if (positional != 2 || !s_port || !s_connections || !s_threads || s_seconds <= 0 || s_rate < 0) return false;
+    if (s_threads > s_connections) s_threads = s_connections;
+    // UDP answers are matched by the sequence number in their first bytes.
+    if (s_protocol == LOADGEN_UDP && s_size < sizeof(uint64_t)) s_size = sizeof(uint64_t);
+    return s_size > 0 && s_size <= LOADGEN_RESPONSE_BUFFER;
+}
+
+static char *build_request(size_t *size) {
+    if (s_protocol == LOADGEN_HTTP) {
+        int length = snprintf(NULL, 0, "GET %s HTTP/1.1\r\nHost: %s:%u\r\nUser-Agent: ps_loadgen\r\n\r\n", s_path, s_host, s_port);
+        char *request = malloc((size_t)length + 1);
+        if (request) snprintf(request, (size_t)length + 1, "GET %s HTTP/1.1\r\nHost: %s:%u\r\nUser-Agent: ps_loadgen\r\n\r\n", s_path, s_host, s_port);
+        *size = (size_t)length;
+        return request;
+    }
+    char *request = malloc(s_size);
+    if (request) memset(request, 'x', s_size);
+    *size = s_size;
+    return request;
+}
+
+static void print_results(worker_t *workers, double elapsed) {
+    size_t total = 0;
+    unsigned long long connect_errors = 0, errors = 0, status_errors = 0, timeouts = 0, reconnects = 0, bytes = 0;
+    for (size_t i = 0; i < s_threads; ++i) {
+        total += workers[i].sample_count;
+        connect_errors += workers[i].connect_errors;
+        errors += workers[i].errors;
+        status_errors += workers[i].status_errors;
+        timeouts += workers[i].timeouts;
+        reconnects += workers[i].reconnects;
+        bytes += workers[i].bytes;
+    }
+    uint64_t *samples = malloc((total ? total : 1) * sizeof(*samples));
+    if (!samples) return;
+    size_t count = 0;
+    for (size_t i = 0; i < s_threads; ++i) {
+        memcpy(samples + count, workers[i].samples, workers[i].sample_count * sizeof(*samples));
+        count += workers[i].sample_count;
+    }
+    qsort(samples, count, sizeof(*samples), compare_u64);
+
+    printf("requests   %10zu  %12.1f/s", count, count / elapsed);
+    if (s_rate > 0) printf("  (target %.1f/s)", s_rate);
+    printf("\nreceived   %10.2f MiB %8.2f MiB/s\n", bytes / 1048576.0, bytes / 1048576.0 / elapsed);
+    printf("errors     %10llu  connect %llu, timeouts %llu, status %llu, reconnects %llu\n",
+           errors + connect_errors + timeouts + status_errors, connect_errors, timeouts, status_errors, reconnects);
+    if (!count) {
+        free(samples);
+        return;
+    }
+
+    static const double percentiles[] = { 50, 90, 99, 99.9, 99.99 };
+    size_t percentile_count = sizeof(percentiles) / sizeof(percentiles[0]);
+    printf("latency us %10s", "min");
+    for (size_t i = 0; i < percentile_count; ++i) printf("  p%-8g", percentiles[i]);
+    printf("  %-9s\n           %10.1f", "max", samples[0] / 1e3);
+    for (size_t i = 0; i < percentile_count; ++i) {
+        size_t rank = (size_t)(percentiles[i] / 100 * count);
+        printf("  %-9.1f", samples[rank < count ? rank : count - 1] / 1e3);
+    }
+    printf("  %-9.1f\n", samples[count - 1] / 1e3);
+    free(samples);
+}
+
+int main(int argc, char **argv) {
+    if (!parse_args(argc, argv)) {
+        usage();
+        return 1;
+    }
+    if (!ps_init()) return 1;
+
+    static const char *names[] = { "tcp", "udp", "http" };
+    printf("ps_loadgen: %s %s:%u, %zu connections on %zu threads, %.1fs, ", names[s_protocol], s_host, s_port,
+           s_connections, s_threads, s_seconds);
+    if (s_rate > 0) printf("open loop at %.1f requests/s\n", s_rate);
+    else printf("closed loop\n");
+
+    worker_t *workers = calloc(s_threads, sizeof(*workers));
+    conn_t *conns = calloc(s_connections, sizeof(*conns));
+    if (!workers || !conns) return 1;
+    for (size_t i = 0; i < s_threads; ++i) {
+        if (ps_create_loop(&workers[i].loop) != PS_SUCCESS) {
+            fprintf(stderr, "Failed to create a loop\n");
+            return 1;
+        }
+        workers[i].conns = conns + i * s_connections / s_threads;
+        workers[i].conn_count = (i + 1) * s_connections / s_threads - i * s_connections / s_threads;
+    }
+    for (size_t i = 0; i < s_threads; ++i) {
+        for (size_t j = 0; j < workers[i].conn_count; ++j) {
+            conn_t *conn = &workers[i].conns[j];
+            conn->worker = &workers[i];
+            conn->index = (size_t)(conn - conns);
+            size_t size;
+            conn->request = build_request(&size);
+            if (!conn->request) return 1;
+            conn->send_packet = (ps_packet_t){ size, conn->request, size };
+        }
+    }
+    if (s_rate > 0) s_interval = (uint64_t)(s_connections * 1e9 / s_rate);
+
+    pthread_barrier_init(&s_barrier, NULL, (unsigned)s_threads + 1);
+    for (size_t i = 0; i < s_threads; ++i) pthread_create(&workers[i].thread, NULL, worker_thread, &workers[i]);
+
+    // Start the clock for every thread at once, after they connected.
+    pthread_barrier_wait(&s_barrier);
+    s_start = now_ns();
+    s_end = s_start + (uint64_t)(s_seconds * 1e9);
+    atomic_store(&s_running, true);
+    pthread_barrier_wait(&s_barrier);
+    for (size_t i = 0; i < s_threads; ++i) pthread_join(workers[i].thread, NULL);
+    pthread_barrier_destroy(&s_barrier);
+
+    print_results(workers, s_seconds);
+
+    for (size_t i = 0; i < s_threads; ++i) {
+        ps_destroy_loop(workers[i].loop);
+        free(workers[i].samples);
+    }
+    free(conns);
+    free(workers);
+    ps_cleanup();
+    return 0;
+}
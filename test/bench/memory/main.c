@@ -0,0 +1,151 @@
+#include <purrsock/purrsock.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_SECONDS 1.0
+#define BENCH_MESSAGE 64
+#define BENCH_CHUNK (64 * 1024)
+
+/**
+ * @brief Library overhead with and without the kernel: the same exchanges over TCP loopback and `PS_PROTOCOL_MEMORY`.
+ *
+ * A ping-pong of small messages between two threads measures the per-call cost of a round trip, and a
+ * one-way stream of large sends measures copying throughput. What memory sockets still spend is
+ * purrsock's own work; the difference to TCP is what the kernel adds.
+ * Usage: bench_memory [seconds] [message_size]
+ */
+
+static size_t s_message = BENCH_MESSAGE;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool read_exactly(ps_socket_t socket, char *buf, size_t size) {
+    size_t received = 0;
+    while (received < size) {
+        ps_packet_t packet = { 0, buf + received, size - received };
+        if (ps_read_socket_packet(socket, &packet, NULL) != PS_SUCCESS) return false;
+        received += packet.size;
+    }
+    return true;
+}
+
+static bool connect_pair(ps_protocol_t protocol, ps_socket_t *client, ps_socket_t *server) {
+    ps_socket_t listener;
+    ps_endpoint_t endpoint;
+    bool connected = ps_create_socket(&listener, protocol, PS_ADDRESS_IPV4) == PS_SUCCESS &&
+                     ps_bind_socket(listener, "127.0.0.1", 0) == PS_SUCCESS &&
+                     ps_listen_socket(listener) == PS_SUCCESS &&
+                     ps_get_socket_endpoint(listener, &endpoint) == PS_SUCCESS &&
+                     ps_create_socket(client, protocol, PS_ADDRESS_IPV4) == PS_SUCCESS &&
+                     ps_connect_socket(*client, "127.0.0.1", endpoint.port) == PS_SUCCESS &&
+                     ps_accept_socket(listener, server) == PS_SUCCESS;
+    ps_destroy_socket(listener);
+    if (connected && protocol == PS_PROTOCOL_TCP) {
+        ps_set_socket_nodelay(*client, true);
+        ps_set_socket_nodelay(*server, true);
+    }
+    return connected;
+}
+
+// Echoes messages until the peer hangs up.
+static void *echo_thread(void *arg) {
+    ps_socket_t socket = (ps_socket_t)arg;
+    char *buf = malloc(s_message);
+    while (read_exactly(socket, buf, s_message)) {
+        ps_packet_t packet = { s_message, buf, s_message };
+        if (ps_send_socket_packet(socket, packet, NULL) != PS_SUCCESS) break;
+    }
+    free(buf);
+    return NULL;
+}
+
+// Drains a stream until the peer hangs up, counting the bytes.
+static void *drain_thread(void *arg) {
+    ps_socket_t socket = (ps_socket_t)arg;
+    static char buf[BENCH_CHUNK];
+    unsigned long long *received = malloc(sizeof(*received));
+    *received = 0;
+    ps_packet_t packet = { 0, buf, sizeof(buf) };
+    while (ps_read_socket_packet(socket, &packet, NULL) == PS_SUCCESS) *received += packet.size;
+    return received;
+}
+
+static double run_ping_pong(ps_protocol_t protocol, double seconds) {
+    ps_socket_t client, server;
+    if (!connect_pair(protocol, &client, &server)) return 0;
+    pthread_t echo;
+    pthread_create(&echo, NULL, echo_thread, server);
+
+    char *buf = calloc(1, s_message);
+    unsigned long long round_trips = 0;
+    double start = now_seconds();
+    double elapsed = 0;
+    while (elapsed < seconds) {
+        for (int i = 0; i < 1000; ++i) {
+            ps_packet_t packet = { s_message, buf, s_message };
+            if (ps_send_socket_packet(client, packet, NULL) != PS_SUCCESS || !read_exactly(client, buf, s_message)) break;
+            round_trips++;
+        }
+        elapsed = now_seconds() - start;
+    }
+
+    ps_destroy_socket(client);
+    pthread_join(echo, NULL);
+    ps_destroy_socket(server);
+    free(buf);
+    return round_trips / elapsed;
+}
+
+static double run_stream(ps_protocol_t protocol, double seconds) {
+    ps_socket_t client, server;
+    if (!connect_pair(protocol, &client, &server)) return 0;
+    pthread_t drain;
+    pthread_create(&drain, NULL, drain_thread, server);
+
+    static char buf[BENCH_CHUNK];
+    double start = now_seconds();
+    double elapsed = 0;
+    while (elapsed < seconds) {
+        for (int i = 0; i < 64; ++i) {
+            ps_packet_t packet = { sizeof(buf), buf, sizeof(buf) };
+            if (ps_send_socket_packet(client, packet, NULL) != PS_SUCCESS) break;
+        }
+        elapsed = now_seconds() - start;
+    }
+
+    ps_destroy_socket(client);
+    unsigned long long *received;
+    pthread_join(drain, (void **)&received);
+    elapsed = now_seconds() - start;
+    ps_destroy_socket(server);
+    double rate = *received / elapsed / (1024.0 * 1024.0);
+    free(received);
+    return rate;
+}
+
+int main(int argc, char **argv) {
+    double seconds = argc > 1 ? atof(argv[1]) : BENCH_SECONDS;
+    if (argc > 2 && atoi(argv[2]) > 0) s_message = (size_t)atoi(argv[2]);
+    if (!ps_init()) return 1;
+
+    const struct { const char *name; ps_protocol_t protocol; } modes[] = {
+        { "tcp loopback", PS_PROTOCOL_TCP },
+        { "memory", PS_PROTOCOL_MEMORY },
+    };
+    printf("Ping-pong of %zu-byte messages and %d KiB stream sends, %.1fs per mode\n", s_message, BENCH_CHUNK / 1024, seconds);
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); ++i) {
+        double round_trips = run_ping_pong(modes[i].protocol, seconds);
+        double throughput = run_stream(modes[i].protocol, seconds);
+        printf("%-16s %12.0f round trips/s %10.0f MiB/s\n", modes[i].name, round_trips, throughput);
+    }
+
+    ps_cleanup();
+    return 0;
+}
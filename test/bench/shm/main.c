@@ -0,0 +1,115 @@
+#include <purrsock/purrsock.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_ITERATIONS 200000
+#define BENCH_WARMUP 10000
+#define BENCH_MESSAGE 64
+
+/**
+ * @brief Same-host round-trip latency between two processes, over TCP loopback and `PS_PROTOCOL_SHM`.
+ *
+ * A forked child echoes every message; the parent times each round trip on its own and reports the
+ * median and tail. Usage: bench_shm [iterations] [message_size]
+ */
+
+static size_t s_message = BENCH_MESSAGE;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static bool read_exactly(ps_socket_t socket, char *buf, size_t size) {
+    size_t received = 0;
+    while (received < size) {
+        ps_packet_t packet = { 0, buf + received, size - received };
+        if (ps_read_socket_packet(socket, &packet, NULL) != PS_SUCCESS) return false;
+        received += packet.size;
+    }
+    return true;
+}
+
+// Child process: connects back to the parent and echoes until it hangs up.
+static void echo_child(ps_protocol_t protocol, ps_port_t port) {
+    ps_socket_t socket;
+    if (ps_create_socket(&socket, protocol, PS_ADDRESS_IPV4) != PS_SUCCESS ||
+        ps_connect_socket(socket, "127.0.0.1", port) != PS_SUCCESS) {
+        _exit(1);
+    }
+    if (protocol == PS_PROTOCOL_TCP) ps_set_socket_nodelay(socket, true);
+    char *buf = malloc(s_message);
+    while (read_exactly(socket, buf, s_message)) {
+        ps_packet_t packet = { s_message, buf, s_message };
+        if (ps_send_socket_packet(socket, packet, NULL) != PS_SUCCESS) break;
+    }
+    ps_destroy_socket(socket);
+    _exit(0);
+}
+
+static void run(const char *name, ps_protocol_t protocol, size_t iterations) {
+    ps_socket_t listener, server;
+    ps_endpoint_t endpoint;
+    if (ps_create_socket(&listener, protocol, PS_ADDRESS_IPV4) != PS_SUCCESS ||
+        ps_bind_socket(listener, "127.0.0.1", 0) != PS_SUCCESS ||
+        ps_listen_socket(listener) != PS_SUCCESS ||
+        ps_get_socket_endpoint(listener, &endpoint) != PS_SUCCESS) {
+        printf("%-16s unavailable\n", name);
+        return;
+    }
+
+    pid_t child = fork();
+    if (child == 0) echo_child(protocol, endpoint.port);
+    if (child < 0 || ps_accept_socket(listener, &server) != PS_SUCCESS) {
+        printf("%-16s failed to connect\n", name);
+        ps_destroy_socket(listener);
+        return;
+    }
+    if (protocol == PS_PROTOCOL_TCP) ps_set_socket_nodelay(server, true);
+
+    char *buf = calloc(1, s_message);
+    uint64_t *samples = malloc(iterations * sizeof(*samples));
+    size_t count = 0;
+    for (size_t i = 0; i < BENCH_WARMUP + iterations; ++i) {
+        ps_packet_t packet = { s_message, buf, s_message };
+        uint64_t start = now_ns();
+        if (ps_send_socket_packet(server, packet, NULL) != PS_SUCCESS || !read_exactly(server, buf, s_message)) break;
+        if (i >= BENCH_WARMUP) samples[count++] = now_ns() - start;
+    }
+
+    ps_destroy_socket(server);
+    ps_destroy_socket(listener);
+    waitpid(child, NULL, 0);
+
+    if (count) {
+        qsort(samples, count, sizeof(*samples), compare_u64);
+        printf("%-16s p50 %8.2f us   p99 %8.2f us   p99.9 %8.2f us\n", name,
+               samples[count / 2] / 1e3, samples[count * 99 / 100] / 1e3, samples[count * 999 / 1000] / 1e3);
+    }
+    free(samples);
+    free(buf);
+}
+
+int main(int argc, char **argv) {
+    size_t iterations = argc > 1 && atol(argv[1]) > 0 ? (size_t)atol(argv[1]) : BENCH_ITERATIONS;
+    if (argc > 2 && atoi(argv[2]) > 0) s_message = (size_t)atoi(argv[2]);
+    if (!ps_init()) return 1;
+
+    printf("Round trips of %zu-byte messages between two processes, %zu samples\n", s_message, iterations);
+    run("tcp loopback", PS_PROTOCOL_TCP, iterations);
+    run("shared memory", PS_PROTOCOL_SHM, iterations);
+
+    ps_cleanup();
+    return 0;
+}
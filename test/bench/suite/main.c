@@ -0,0 +1,646 @@
+#include <purrsock/purrsock.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_SECONDS 1.0
+#define BENCH_THRESHOLD 10.0
+#define BENCH_PINGPONG_MESSAGE 64
+#define BENCH_PINGPONG_WARMUP 1000
+#define BENCH_MAX_SAMPLES (1 << 20)
+#define BENCH_STREAM_CHUNK 65536
+#define BENCH_UDP_PAYLOAD 64
+#define BENCH_WEBSOCKET_PAYLOAD 64
+#define BENCH_MAX_RESULTS 64
+
+/**
+ * @brief Regression suite over loopback: TCP ping-pong latency, TCP streaming throughput, UDP datagrams per
+ *        second and TCP connect/accept rate, each with the heap allocations (and, with statistics built in,
+ *        the system calls) it costs per message, small WebSocket frames per second, and the throughput of HTTP
+ *        header scanning on each instruction set the CPU supports.
+ *
+ * Results print as a table, or as JSON with `--json`; `--output` also saves the JSON to a file. `--compare`
+ * loads such a file as the baseline, reports the change of every metric and exits with 2 if any got worse by
+ * more than `--threshold` percent, so a build can fail on a regression.
+ * Usage: purrsock_bench [--seconds S] [--filter NAME] [--json] [--output FILE] [--compare FILE] [--threshold PCT]
+ */
+
+typedef struct {
+    char benchmark[32];
+    char metric[32];
+    double value;
+    bool lower_is_better;
+} result_t;
+
+static result_t s_results[BENCH_MAX_RESULTS];
+static size_t s_result_count;
+static double s_seconds = BENCH_SECONDS;
+
+static atomic_bool s_stop;
+
+// Allocations are counted by wrapping glibc's allocator; sanitizers bring their own and are left alone.
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+#define BENCH_COUNT_ALLOCATIONS
+static atomic_ullong s_allocations;
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size) {
+    atomic_fetch_add_explicit(&s_allocations, 1, memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    atomic_fetch_add_explicit(&s_allocations, 1, memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    atomic_fetch_add_explicit(&s_allocations, 1, memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+#endif
+
+static unsigned long long allocations(void) {
+#ifdef BENCH_COUNT_ALLOCATIONS
+    return atomic_load(&s_allocations);
+#else
+    return 0;
+#endif
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void add_result(const char *benchmark, const char *metric, double value, bool lower_is_better) {
+    if (s_result_count == BENCH_MAX_RESULTS) return;
+    result_t *result = &s_results[s_result_count++];
+    snprintf(result->benchmark, sizeof(result->benchmark), "%s", benchmark);
+    snprintf(result->metric, sizeof(result->metric), "%s", metric);
+    result->value = value;
+    result->lower_is_better = lower_is_better;
+}
+
+static void add_allocations(const char *benchmark, unsigned long long before, unsigned long long messages) {
+#ifdef BENCH_COUNT_ALLOCATIONS
+    // Hundredths are enough to tell per-message allocations apart; finer would only be one-off setup noise.
+    double per_message = messages ? (double)(allocations() - before) / messages : 0;
+    add_result(benchmark, "allocs_per_msg", (unsigned long long)(per_message * 100 + 0.5) / 100.0, true);
+#else
+    (void)benchmark; (void)before; (void)messages;
+#endif
+}
+
+// System calls per message come from the socket statistics, when the library keeps them.
+static void add_syscalls(const char *benchmark, ps_socket_t socket, unsigned long long messages) {
+    ps_socket_stats_t stats;
+    if (ps_get_socket_stats(socket, &stats) != PS_SUCCESS || !messages) return;
+    add_result(benchmark, "syscalls_per_msg", (double)(stats.read_calls + stats.send_calls) / messages, true);
+}
+
+static bool read_exactly(ps_socket_t socket, char *buf, size_t size) {
+    size_t received = 0;
+    while (received < size) {
+        ps_packet_t packet = { 0, buf + received, size - received };
+        if (ps_read_socket_packet(socket, &packet, NULL) != PS_SUCCESS) return false;
+        received += packet.size;
+    }
+    return true;
+}
+
+static bool create_listener(ps_socket_t *listener, ps_port_t *port) {
+    ps_endpoint_t endpoint;
+    if (ps_create_socket_from_addr(listener, PS_PROTOCOL_TCP, PS_ADDRESS_IPV4, "127.0.0.1", 0) != PS_SUCCESS) return false;
+    if (ps_listen_socket(*listener) != PS_SUCCESS || ps_get_socket_endpoint(*listener, &endpoint) != PS_SUCCESS) {
+        ps_destroy_socket(*listener);
+        return false;
+    }
+    *port = endpoint.port;
+    return true;
+}
+
+static bool connect_pair(ps_socket_t *client, ps_socket_t *server) {
+    ps_socket_t listener;
+    ps_port_t port;
+    if (!create_listener(&listener, &port)) return false;
+    bool connected = ps_create_socket(client, PS_PROTOCOL_TCP, PS_ADDRESS_IPV4) == PS_SUCCESS &&
+                     ps_connect_socket(*client, "127.0.0.1", port) == PS_SUCCESS &&
+                     ps_accept_socket(listener, server) == PS_SUCCESS;
+    ps_destroy_socket(listener);
+    if (!connected) return false;
+    ps_set_socket_nodelay(*client, true);
+    ps_set_socket_nodelay(*server, true);
+    return true;
+}
+
+// TCP ping-pong: the other thread echoes; every round trip is timed on its own.
+
+static void *echo_thread(void *arg) {
+    ps_socket_t socket = (ps_socket_t)arg;
+    char buf[BENCH_PINGPONG_MESSAGE];
+    while (read_exactly(socket, buf, sizeof(buf))) {
+        if (ps_send_socket_packet(socket, (ps_packet_t){ sizeof(buf), buf, sizeof(buf) }, NULL) != PS_SUCCESS) break;
+    }
+    return NULL;
+}
+
+static bool bench_tcp_pingpong(void) {
+    ps_socket_t client, server;
+    if (!connect_pair(&client, &server)) return false;
+    pthread_t thread;
+    pthread_create(&thread, NULL, echo_thread, server);
+
+    char buf[BENCH_PINGPONG_MESSAGE];
+    memset(buf, 'p', sizeof(buf));
+    ps_packet_t message = { sizeof(buf), buf, sizeof(buf) };
+    for (int i = 0; i < BENCH_PINGPONG_WARMUP; ++i) {
+        if (ps_send_socket_packet(client, message, NULL) != PS_SUCCESS || !read_exactly(client, buf, sizeof(buf))) return false;
+    }
+
+    uint64_t *samples = malloc(BENCH_MAX_SAMPLES * sizeof(*samples));
+    ps_socket_stats_t before_stats;
+    ps_get_socket_stats(client, &before_stats);
+    unsigned long long before = allocations();
+    size_t count = 0;
+    uint64_t start = now_ns(), deadline = start + (uint64_t)(s_seconds * 1e9), end = start;
+    while (end < deadline && count < BENCH_MAX_SAMPLES) {
+        uint64_t sent = end;
+        if (ps_send_socket_packet(client, message, NULL) != PS_SUCCESS || !read_exactly(client, buf, sizeof(buf))) break;
+        end = now_ns();
+        samples[count++] = end - sent;
+    }
+    add_allocations("tcp_pingpong", before, count);
+
+    qsort(samples, count, sizeof(*samples), compare_u64);
+    add_result("tcp_pingpong", "round_trips_per_s", count / ((end - start) / 1e9), false);
+    add_result("tcp_pingpong", "p50_ns", count ? samples[count / 2] : 0, true);
+    add_result("tcp_pingpong", "p99_ns", count ? samples[count * 99 / 100] : 0, true);
+    ps_socket_stats_t stats;
+    if (ps_get_socket_stats(client, &stats) == PS_SUCCESS && count) {
+        uint64_t calls = stats.read_calls + stats.send_calls - before_stats.read_calls - before_stats.send_calls;
+        add_result("tcp_pingpong", "syscalls_per_msg", (double)calls / count, true);
+    }
+    free(samples);
+
+    ps_destroy_socket(client);
+    pthread_join(thread, NULL);
+    ps_destroy_socket(server);
+    return count > 0;
+}
+
+// TCP streaming: the other thread writes chunks as fast as they are drained.
+
+static void *stream_writer_thread(void *arg) {
+    ps_socket_t socket = (ps_socket_t)arg;
+    static char chunk[BENCH_STREAM_CHUNK];
+    while (!atomic_load(&s_stop)) {
+        if (ps_send_socket_packet(socket, (ps_packet_t){ sizeof(chunk), chunk, sizeof(chunk) }, NULL) != PS_SUCCESS) break;
+    }
+    ps_destroy_socket(socket);
+    return NULL;
+}
+
+static bool bench_tcp_stream(void) {
+    ps_socket_t client, server;
+    if (!connect_pair(&client, &server)) return false;
+    atomic_store(&s_stop, false);
+    pthread_t thread;
+    pthread_create(&thread, NULL, stream_writer_thread, client);
+
+    static char buf[BENCH_STREAM_CHUNK];
+    unsigned long long bytes = 0, reads = 0;
+    unsigned long long before = allocations();
+    uint64_t start = now_ns(), deadline = start + (uint64_t)(s_seconds * 1e9), end;
+    while ((end = now_ns()) < deadline) {
+        ps_packet_t packet = { 0, buf, sizeof(buf) };
+        if (ps_read_socket_packet(server, &packet, NULL) != PS_SUCCESS) break;
+        bytes += packet.size;
+        reads++;
+    }
+    add_allocations("tcp_stream", before, reads);
+    add_syscalls("tcp_stream", server, reads);
+    add_result("tcp_stream", "mib_per_s", bytes / 1048576.0 / ((end - start) / 1e9), false);
+
+    // Drain until the writer notices and hangs up, so it cannot stay blocked on a full buffer.
+    atomic_store(&s_stop, true);
+    ps_packet_t packet = { 0, buf, sizeof(buf) };
+    while (ps_read_socket_packet(server, &packet, NULL) == PS_SUCCESS) packet.size = 0;
+    pthread_join(thread, NULL);
+    ps_destroy_socket(server);
+    return bytes > 0;
+}
+
+// UDP: the other thread floods small datagrams in batches; the rate is what the receiver gets.
+
+static void *udp_sender_thread(void *arg) {
+    ps_socket_t sender = (ps_socket_t)arg;
+    static char payload[BENCH_UDP_PAYLOAD];
+    ps_packet_t packets[PS_MAX_PACKET_BATCH];
+    for (int i = 0; i < PS_MAX_PACKET_BATCH; ++i) {
+        packets[i] = (ps_packet_t){ BENCH_UDP_PAYLOAD, payload, BENCH_UDP_PAYLOAD };
+    }
+    // A full receive buffer surfaces as an error on loopback; keep going until told to stop.
+    while (!atomic_load(&s_stop)) {
+        size_t sent = 0;
+        ps_send_socket_packets(sender, packets, NULL, PS_MAX_PACKET_BATCH, &sent);
+    }
+    return NULL;
+}
+
+static bool bench_udp(void) {
+    ps_socket_t receiver, sender;
+    ps_endpoint_t endpoint;
+    if (ps_create_socket_from_addr(&receiver, PS_PROTOCOL_UDP, PS_ADDRESS_IPV4, "127.0.0.1", 0) != PS_SUCCESS) return false;
+    if (ps_get_socket_endpoint(receiver, &endpoint) != PS_SUCCESS ||
+        ps_create_socket(&sender, PS_PROTOCOL_UDP, PS_ADDRESS_IPV4) != PS_SUCCESS) {
+        ps_destroy_socket(receiver);
+        return false;
+    }
+    if (ps_connect_socket(sender, "127.0.0.1", endpoint.port) != PS_SUCCESS) {
+        ps_destroy_socket(sender);
+        ps_destroy_socket(receiver);
+        return false;
+    }
+    // Wake up now and then in case the sender is starved, so the deadline is kept.
+    ps_socket_timeouts_t timeouts = {0};
+    timeouts.read_ms = 100;
+    ps_set_socket_timeouts(receiver, &timeouts);
+
+    atomic_store(&s_stop, false);
+    pthread_t thread;
+    pthread_create(&thread, NULL, udp_sender_thread, sender);
+
+    static char bufs[PS_MAX_PACKET_BATCH][2048];
+    ps_packet_t packets[PS_MAX_PACKET_BATCH];
+    unsigned long long datagrams = 0;
+    unsigned long long before = allocations();
+    uint64_t start = now_ns(), deadline = start + (uint64_t)(s_seconds * 1e9), end;
+    while ((end = now_ns()) < deadline) {
+        for (int i = 0; i < PS_MAX_PACKET_BATCH; ++i) packets[i] = (ps_packet_t){ 0, bufs[i], sizeof(bufs[i]) };
+        size_t received = 0;
+        if (ps_read_socket_packets(receiver, packets, NULL, PS_MAX_PACKET_BATCH, &received) == PS_SUCCESS) datagrams += received;
+    }
+    add_allocations("udp", before, datagrams);
+    add_syscalls("udp", receiver, datagrams);
+    add_result("udp", "datagrams_per_s", datagrams / ((end - start) / 1e9), false);
+
+    atomic_store(&s_stop, true);
+    pthread_join(thread, NULL);
+    ps_destroy_socket(sender);
+    ps_destroy_socket(receiver);
+    return datagrams > 0;
+}
+
+// Connect/accept: one thread connects and accepts in turn. The client resets its side rather than
+// leave it in TIME_WAIT, which would run out of ephemeral ports within a few seconds.
+
+static bool bench_connect_accept(void) {
+    ps_socket_t listener;
+    ps_port_t port;
+    if (!create_listener(&listener, &port)) return false;
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    struct linger linger = {1, 0};
+
+    unsigned long long connections = 0;
+    unsigned long long before = allocations();
+    uint64_t start = now_ns(), deadline = start + (uint64_t)(s_seconds * 1e9), end;
+    while ((end = now_ns()) < deadline) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) break;
+        setsockopt(fd, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+        ps_socket_t accepted;
+        bool ok = connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0 && ps_accept_socket(listener, &accepted) == PS_SUCCESS;
+        close(fd);
+        if (!ok) break;
+        ps_destroy_socket(accepted);
+        connections++;
+    }
+    add_allocations("connect_accept", before, connections);
+    add_result("connect_accept", "connections_per_s", connections / ((end - start) / 1e9), false);
+
+    ps_destroy_socket(listener);
+    return connections > 0;
+}
+
+// WebSocket: the other thread sends small masked text frames, like a dashboard feed; the server unmasks,
+// validates and hands them out.
+
+static void *websocket_sender_thread(void *arg) {
+    ps_socket_t socket = (ps_socket_t)arg;
+    ps_websocket_t websocket;
+    char payload[BENCH_WEBSOCKET_PAYLOAD];
+    memset(payload, 'w', sizeof(payload));
+    if (ps_create_websocket_client(&websocket, socket, "127.0.0.1", "/bench", NULL) == PS_SUCCESS) {
+        if (ps_websocket_handshake(websocket) == PS_SUCCESS) {
+            ps_packet_t message = { sizeof(payload), payload, sizeof(payload) };
+            while (!atomic_load(&s_stop) && ps_websocket_send(websocket, PS_WEBSOCKET_TEXT, message) == PS_SUCCESS) {}
+        }
+        ps_destroy_websocket(websocket);
+    }
+    ps_destroy_socket(socket);
+    return NULL;
+}
+
+static bool bench_websocket(void) {
+    ps_socket_t client, server;
+    if (!connect_pair(&client, &server)) return false;
+    atomic_store(&s_stop, false);
+    pthread_t thread;
+    pthread_create(&thread, NULL, websocket_sender_thread, client);
+
+    ps_websocket_t websocket;
+    if (ps_create_websocket_server(&websocket, server, NULL) != PS_SUCCESS) websocket = NULL;
+    bool open = websocket && ps_websocket_handshake(websocket) == PS_SUCCESS;
+    unsigned long long frames = 0;
+    if (open) {
+        ps_socket_stats_t before_stats;
+        ps_get_socket_stats(server, &before_stats);
+        unsigned long long before = allocations();
+        ps_websocket_message_t message;
+        uint64_t start = now_ns(), deadline = start + (uint64_t)(s_seconds * 1e9), end;
+        while ((end = now_ns()) < deadline) {
+            if (ps_websocket_read(websocket, &message) != PS_SUCCESS || message.payload.size != BENCH_WEBSOCKET_PAYLOAD) break;
+            frames++;
+        }
+        add_allocations("websocket", before, frames);
+        ps_socket_stats_t stats;
+        if (ps_get_socket_stats(server, &stats) == PS_SUCCESS && frames) {
+            add_result("websocket", "syscalls_per_msg", (double)(stats.read_calls - before_stats.read_calls) / frames, true);
+        }
+        add_result("websocket", "frames_per_s", frames / ((end - start) / 1e9), false);
+    }
+
+    // Drain until the sender notices and hangs up, so it cannot stay blocked on a full buffer.
+    atomic_store(&s_stop, true);
+    static char buf[BENCH_STREAM_CHUNK];
+    ps_packet_t packet = { 0, buf, sizeof(buf) };
+    while (ps_read_socket_packet(server, &packet, NULL) == PS_SUCCESS) packet.size = 0;
+    pthread_join(thread, NULL);
+    if (websocket) ps_destroy_websocket(websocket);
+    ps_destroy_socket(server);
+    return frames > 0;
+}
+
+// Header scanning: a browser-sized request head parsed the way the HTTP server does it, once per instruction
+// set the CPU supports. No sockets; this is the parser's share of every request.
+
+static size_t scan_head(const char *head, size_t size) {
+    size_t end = ps_scan_find(head, size, "\r\n\r\n", 4) + 2;
+    size_t fields = 0;
+    for (size_t line = ps_scan_find(head, end, "\r\n", 2) + 2; line < end; fields++) {
+        size_t colon = line + ps_scan_token(head + line, end - line);
+        line = colon + 1 + ps_scan_field_value(head + colon + 1, end - colon - 1) + 2;
+    }
+    return fields;
+}
+
+static bool bench_http_head_scan(void) {
+    static const char head[] =
+        "GET /static/app/main.3f9a1c.js?v=20240611 HTTP/1.1\r\n"
+        "Host: www.example.com\r\n"
+        "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/126.0.0.0 Safari/537.36\r\n"
+        "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+        "Accept-Language: en-US,en;q=0.9,de;q=0.8\r\n"
+        "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+        "Referer: https://www.example.com/products/catalogue?page=2&sort=price\r\n"
+        "Cookie: session=6b1f0e0c2c3d4a8f9e7b5a1d2c3e4f50; theme=dark; consent=analytics%3Dfalse%26ads%3Dfalse\r\n"
+        "Sec-Fetch-Dest: script\r\n"
+        "Sec-Fetch-Mode: no-cors\r\n"
+        "Sec-Fetch-Site: same-origin\r\n"
+        "Connection: keep-alive\r\n"
+        "\r\n";
+    static const struct {
+        ps_scan_isa_t isa;
+        const char *metric;
+    } isas[] = { { PS_SCAN_SCALAR, "scalar_mb_per_s" }, { PS_SCAN_SSE42, "sse42_mb_per_s" }, { PS_SCAN_AVX2, "avx2_mb_per_s" } };
+
+    ps_scan_isa_t original = ps_scan_get_isa();
+    for (size_t i = 0; i < sizeof(isas) / sizeof(isas[0]); ++i) {
+        if (!ps_scan_set_isa(isas[i].isa)) continue;
+        unsigned long long heads = 0;
+        size_t fields = 0;
+        uint64_t start = now_ns(), deadline = start + (uint64_t)(s_seconds * 1e9 / 3), end;
+        while ((end = now_ns()) < deadline) {
+            for (int j = 0; j < 1000; ++j) {
+                // Keeps the compiler from hoisting the scan out of the loop.
+                const char *volatile buf = head;
+                fields += scan_head(buf, sizeof(head) - 1);
+            }
+            heads += 1000;
+        }
+        if (fields != heads * 11) {
+            ps_scan_set_isa(original);
+            return false;
+        }
+        add_result("http_head_scan", isas[i].metric, heads * (sizeof(head) - 1) / ((end - start) / 1e3), false);
+    }
+    ps_scan_set_isa(original);
+    return true;
+}
+
+static const struct {
+    const char *name;
+    bool (*run)(void);
+} s_benchmarks[] = {
+    { "tcp_pingpong", bench_tcp_pingpong },
+    { "tcp_stream", bench_tcp_stream },
+    { "udp", bench_udp },
+    { "connect_accept", bench_connect_accept },
+    { "websocket", bench_websocket },
+    { "http_head_scan", bench_http_head_scan },
+};
+
+// Output and comparison. The JSON is one flat list of results so baselines are trivial to read back.
+
+static void write_json(FILE *file) {
+    fprintf(file, "{\n  \"version\": 1,\n  \"seconds\": %g,\n  \"results\": [\n", s_seconds);
+    for (size_t i = 0; i < s_result_count; ++i) {
+        const result_t *result = &s_results[i];
+        fprintf(file, "    {\"benchmark\": \"%s\", \"metric\": \"%s\", \"value\": %.6g, \"better\": \"%s\"}%s\n",
+                result->benchmark, result->metric, result->value, result->lower_is_better ? "lower" : "higher",
+                i + 1 < s_result_count ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+}
+
+static void print_table(void) {
+    printf("%-16s %-20s %16s\n", "benchmark", "metric", "value");
+    for (size_t i = 0; i < s_result_count; ++i) {
+        printf("%-16s %-20s %16.6g\n", s_results[i].benchmark, s_results[i].metric, s_results[i].value);
+    }
+}
+
+// Reads the string value of `"key"` within [object, end), as written by `write_json`.
+static bool json_string(const char *object, const char *end, const char *key, char *value, size_t size) {
+    char pattern[40];
+    snprintf(pattern, sizeof(pattern), "\"%s\"", key);
+    const char *found = strstr(object, pattern);
+    if (!found || found >= end) return false;
+    const char *start = strchr(found + strlen(pattern), '"');
+    if (!start || start >= end) return false;
+    const char *stop = strchr(++start, '"');
+    if (!stop || stop >= end || (size_t)(stop - start) >= size) return false;
+    memcpy(value, start, stop - start);
+    value[stop - start] = '\0';
+    return true;
+}
+
+static bool json_number(const char *object, const char *end, const char *key, double *value) {
+    char pattern[40];
+    snprintf(pattern, sizeof(pattern), "\"%s\"", key);
+    const char *found = strstr(object, pattern);
+    if (!found || found >= end) return false;
+    const char *colon = strchr(found + strlen(pattern), ':');
+    if (!colon || colon >= end) return false;
+    char *parsed;
+    *value = strtod(colon + 1, &parsed);
+    return parsed != colon + 1;
+}
+
+static char *read_file(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) return NULL;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *text = size >= 0 ? malloc((size_t)size + 1) : NULL;
+    if (text) {
+        size_t read = fread(text, 1, (size_t)size, file);
+        text[read] = '\0';
+    }
+    fclose(file);
+    return text;
+}
+
+// Prints every metric next to its baseline; returns the number that regressed past the threshold.
+static int compare(const char *path, double threshold) {
+    char *baseline = read_file(path);
+    if (!baseline) {
+        fprintf(stderr, "Failed to read the baseline %s\n", path);
+        return -1;
+    }
+
+    int regressions = 0;
+    printf("%-16s %-20s %14s %14s %9s\n", "benchmark", "metric", "baseline", "current", "change");
+    for (size_t i = 0; i < s_result_count; ++i) {
+        const result_t *result = &s_results[i];
+        bool found = false;
+        double old = 0;
+        for (const char *object = strchr(baseline, '{'); object && !found; object = strchr(object + 1, '{')) {
+            const char *end = strchr(object, '}');
+            if (!end) break;
+            char benchmark[32], metric[32];
+            if (json_string(object, end, "benchmark", benchmark, sizeof(benchmark)) &&
+                json_string(object, end, "metric", metric, sizeof(metric)) &&
+                !strcmp(benchmark, result->benchmark) && !strcmp(metric, result->metric)) {
+                found = json_number(object, end, "value", &old);
+            }
+        }
+        if (!found) {
+            printf("%-16s %-20s %14s %14.6g %9s\n", result->benchmark, result->metric, "-", result->value, "new");
+            continue;
+        }
+
+        // Positive changes are improvements whichever way the metric goes. From a baseline of zero (no
+        // allocations, say) any growth of a lower-is-better metric is a regression.
+        bool regressed;
+        if (old) {
+            double change = (result->value - old) / old * 100;
+            if (result->lower_is_better) change = -change;
+            regressed = change < -threshold;
+            printf("%-16s %-20s %14.6g %14.6g %+8.1f%%%s\n", result->benchmark, result->metric, old, result->value,
+                   change, regressed ? "  REGRESSION" : "");
+        } else {
+            regressed = result->lower_is_better ? result->value > 0 : false;
+            printf("%-16s %-20s %14.6g %14.6g %9s%s\n", result->benchmark, result->metric, old, result->value,
+                   "-", regressed ? "  REGRESSION" : "");
+        }
+        regressions += regressed;
+    }
+    free(baseline);
+    return regressions;
+}
+
+static void usage(void) {
+    fprintf(stderr, "Usage: purrsock_bench [--seconds S] [--filter NAME] [--json] [--output FILE] [--compare FILE] [--threshold PCT]\n");
+}
+
+int main(int argc, char **argv) {
+    const char *filter = NULL, *output = NULL, *baseline = NULL;
+    double threshold = BENCH_THRESHOLD;
+    bool json = false;
+    for (int i = 1; i < argc; ++i) {
+        bool has_value = i + 1 < argc;
+        if (!strcmp(argv[i], "--seconds") && has_value) s_seconds = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--filter") && has_value) filter = argv[++i];
+        else if (!strcmp(argv[i], "--output") && has_value) output = argv[++i];
+        else if (!strcmp(argv[i], "--compare") && has_value) baseline = argv[++i];
+        else if (!strcmp(argv[i], "--threshold") && has_value) threshold = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--json")) json = true;
+        else {
+            usage();
+            return 1;
+        }
+    }
+    if (s_seconds <= 0) s_seconds = BENCH_SECONDS;
+
+    // ps_init announces the platform on stdout; keep it out of JSON written there.
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    if (json) dup2(STDERR_FILENO, STDOUT_FILENO);
+    bool initialized = ps_init();
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+    if (!initialized) return 1;
+
+    for (size_t i = 0; i < sizeof(s_benchmarks) / sizeof(s_benchmarks[0]); ++i) {
+        if (filter && !strstr(s_benchmarks[i].name, filter)) continue;
+        if (!s_benchmarks[i].run()) {
+            fprintf(stderr, "Benchmark %s failed\n", s_benchmarks[i].name);
+            ps_cleanup();
+            return 1;
+        }
+    }
+    ps_cleanup();
+
+    if (output) {
+        FILE *file = fopen(output, "w");
+        if (!file) {
+            fprintf(stderr, "Failed to write %s\n", output);
+            return 1;
+        }
+        write_json(file);
+        fclose(file);
+    }
+
+    if (baseline) {
+        int regressions = compare(baseline, threshold);
+        if (regressions < 0) return 1;
+        if (regressions) printf("%d metric(s) regressed by more than %.1f%%\n", regressions, threshold);
+        return regressions ? 2 : 0;
+    }
+    if (json) write_json(stdout);
+    else print_table();
+    return 0;
+}
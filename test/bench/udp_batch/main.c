@@ -0,0 +1,105 @@
+#include <purrsock/purrsock.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_PORT 9400
+#define BENCH_PAYLOAD 64
+#define BENCH_SECONDS 1.0
+
+/**
+ * @brief UDP receive throughput: `ps_read_socket_packet` versus batched `ps_read_socket_packets`.
+ *
+ * A sender thread floods a loopback socket with small datagrams using `ps_send_socket_packets` while the
+ * main thread drains it for a fixed time, once per mode, and reports datagrams and syscalls per second.
+ * Usage: bench_udp_batch [seconds]
+ */
+
+static atomic_bool s_stop;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *sender_thread(void *arg) {
+    (void)arg;
+    ps_socket_t sender;
+    if (ps_create_socket(&sender, PS_PROTOCOL_UDP, PS_ADDRESS_IPV4) != PS_SUCCESS) return NULL;
+    if (ps_connect_socket(sender, "127.0.0.1", BENCH_PORT) != PS_SUCCESS) return NULL;
+
+    static char payload[BENCH_PAYLOAD];
+    ps_packet_t packets[PS_MAX_PACKET_BATCH];
+    for (int i = 0; i < PS_MAX_PACKET_BATCH; ++i) {
+        packets[i] = (ps_packet_t){ BENCH_PAYLOAD, payload, BENCH_PAYLOAD };
+    }
+
+    // A full receive buffer surfaces as an error on loopback; keep going until told to stop.
+    while (!atomic_load(&s_stop)) {
+        size_t sent = 0;
+        ps_send_socket_packets(sender, packets, NULL, PS_MAX_PACKET_BATCH, &sent);
+    }
+
+    ps_destroy_socket(sender);
+    return NULL;
+}
+
+static void run(const char *name, ps_socket_t receiver, bool batched, double seconds) {
+    atomic_store(&s_stop, false);
+    pthread_t thread;
+    pthread_create(&thread, NULL, sender_thread, NULL);
+
+    char bufs[PS_MAX_PACKET_BATCH][2048];
+    ps_packet_t packets[PS_MAX_PACKET_BATCH];
+    unsigned long long datagrams = 0, calls = 0;
+
+    double start = now_seconds();
+    while (now_seconds() - start < seconds) {
+        for (int i = 0; i < PS_MAX_PACKET_BATCH; ++i) {
+            packets[i] = (ps_packet_t){ 0, bufs[i], sizeof(bufs[i]) };
+        }
+        calls++;
+        if (batched) {
+            size_t received = 0;
+            if (ps_read_socket_packets(receiver, packets, NULL, PS_MAX_PACKET_BATCH, &received) == PS_SUCCESS) datagrams += received;
+        } else {
+            if (ps_read_socket_packet(receiver, &packets[0], NULL) == PS_SUCCESS) datagrams++;
+        }
+    }
+    double elapsed = now_seconds() - start;
+
+    atomic_store(&s_stop, true);
+    pthread_join(thread, NULL);
+
+    // Drain what the sender left behind so the next run starts empty.
+    ps_set_socket_blocking(receiver, false);
+    size_t received;
+    while (ps_read_socket_packets(receiver, packets, NULL, PS_MAX_PACKET_BATCH, &received) == PS_SUCCESS) {}
+    ps_set_socket_blocking(receiver, true);
+
+    printf("%-8s %12.0f datagrams/s %12.0f calls/s %6.2f datagrams/call\n",
+           name, datagrams / elapsed, calls / elapsed, calls ? (double)datagrams / calls : 0.0);
+}
+
+int main(int argc, char **argv) {
+    double seconds = argc > 1 ? atof(argv[1]) : BENCH_SECONDS;
+    if (!ps_init()) return 1;
+
+    ps_socket_t receiver;
+    if (ps_create_socket_from_addr(&receiver, PS_PROTOCOL_UDP, PS_ADDRESS_IPV4, "127.0.0.1", BENCH_PORT) != PS_SUCCESS) {
+        fprintf(stderr, "Failed to bind 127.0.0.1:%d\n", BENCH_PORT);
+        return 1;
+    }
+
+    printf("UDP receive, %d byte datagrams, %.1fs per mode\n", BENCH_PAYLOAD, seconds);
+    run("single", receiver, false, seconds);
+    run("batched", receiver, true, seconds);
+
+    ps_destroy_socket(receiver);
+    ps_cleanup();
+    return 0;
+}
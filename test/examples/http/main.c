@@ -3,68 +3,83 @@
 #include <stdlib.h>
 #include <string.h>
 
+/**
+ * @brief Answers every request with a small HTML page.
+ */
+static void serve_page(const ps_http_request_t *request, ps_http_response_t response, void *user_data) {
+    (void)request;
+    (void)user_data;
+    static const char body[] = "<body><h1>purrsock example</h1></body>";  ///< HTML body content for a valid response
+
+    ps_http_response_add_header(response, "Content-Type", "text/html; charset=ascii");
+    ps_http_response_send(response, (ps_packet_t){ sizeof(body) - 1, (char *)body, sizeof(body) - 1 });
+}
+
+/**
+ * @brief Sends the file named by the request path from the directory in `user_data`, or a 404 if it cannot be served.
+ */
+static void serve_static_file(const ps_http_request_t *request, ps_http_response_t response, void *user_data) {
+    const char *root = (const char *)user_data;
+
+    // Refuse to leave the served directory, and serve index.html for directories
+    char path[1024];
+    const char *index = request->path.buf[request->path.size - 1] == '/' ? "index.html" : "";
+    bool valid = (size_t)snprintf(path, sizeof(path), "%s%.*s%s", root, (int)request->path.size, request->path.buf, index) < sizeof(path) &&
+        !strstr(path + strlen(root), "..");
+
+    // The file is sent straight from the page cache, however large it is; a slow client is served as it reads
+    ps_http_response_add_header(response, "Content-Type", "application/octet-stream");
+    if (valid && ps_http_response_send_file_path(response, path) == PS_SUCCESS) return;
+
+    // Nothing was sent, so the response can still become an empty 404
+    ps_http_response_set_status(response, 404);
+    ps_http_response_end(response);
+}
+
 /**
  * @brief Main server function for the purrsock example.
- * 
- * This program demonstrates a simple TCP server using the purrsock library. It binds a socket to a local IP and port,
- * listens for incoming connections, and handles client requests by sending HTTP responses. If the client sends a 
- * "GET" request, the server responds with a basic HTML page; otherwise, it responds with a 401 Unauthorized message.
- * 
+ *
+ * This program demonstrates an HTTP server built on `ps_http_server_t`. It listens on 127.0.0.1:6969 and answers
+ * GET requests with a basic HTML page; other methods get 405 Method Not Allowed. Connections are kept alive and
+ * pipelined requests are answered in order.
+ *
+ * Started as `http <directory>`, the server instead answers GET requests with the files below that directory.
+ *
  * @return int Returns 0 on success, 1 on failure.
  */
-int main(void) {
+int main(int argc, char **argv) {
+    const char *root = argc > 1 ? argv[1] : NULL;  ///< Directory served in static-file mode, NULL for the built-in page
+
     // Initialize purrsock library
     if (!ps_init()) return 1;  ///< Initialize the purrsock library (returns 0 if successful)
 
     ps_result_t result = PS_SUCCESS;
-    ps_socket_t socket = {0};  ///< Socket for listening for incoming connections
-    
-    // Create a TCP socket
-    if ((result = ps_create_socket(&socket, PS_PROTOCOL_TCP)) != PS_SUCCESS) goto cleanup;
-
-    // Bind socket to localhost and port 6969
-    if ((result = ps_bind_socket(socket, "127.0.0.1", 6969)) != PS_SUCCESS) goto cleanup;
-    
-    // Start listening for incoming connections
-    if ((result = ps_listen_socket(socket)) != PS_SUCCESS) goto cleanup;
-
-    ps_socket_t client_socket = {0};  ///< Client socket for handling communication
-    while (1) {
-        // Accept an incoming connection from a client
-        if ((result = ps_accept_socket(socket, &client_socket)) != PS_SUCCESS) goto cleanup;
-
-        ps_packet_t request = {0};  ///< Variable to store the incoming request
-        request.buf = malloc(request.capacity = 1024);  ///< Allocate memory for the request buffer
-
-        // Read the incoming packet from the client
-        if ((result = ps_read_socket_packet(client_socket, &request, NULL)) != PS_SUCCESS) goto cleanup;
-
-        // Check if the request is a "GET" request, otherwise return a 401 Unauthorized error
-        if (memcmp(request.buf, "GET", 3) != 0) {
-            ps_packet_t response = {0};  ///< Variable to store the response packet
-            response.buf = "HTTP/1.1 401 Unauthorized\r\nContent-Type: text/plain; charset=ascii\r\nContent-Length: 13\r\n\r\nFuck off mate";
-            response.size = 103;  ///< Set the size of the response buffer
-
-            // Send the response to the client
-            if ((result = ps_send_socket_packet(client_socket, response, NULL)) != PS_SUCCESS) goto cleanup;
-        } else {
-            const char *body = "<body><h1>purrsock example</h1></body>";  ///< HTML body content for a valid response
-
-            ps_packet_t response = {0};  ///< Variable to store the response packet for a valid request
-            response.buf = malloc(2048);  ///< Allocate memory for the response buffer
-            response.size = sprintf(response.buf, "HTTP/1.1 200 OK\r\nContent-Type: text/html; charset=ascii\r\nContent-Length: %zu\r\n\r\n%s", strlen(body)-1, body);
-
-            // Send the response (HTML page) to the client
-            if ((result = ps_send_socket_packet(client_socket, response, NULL)) != PS_SUCCESS) goto cleanup;
-        }
+    ps_http_server_t server = NULL;  ///< Server answering on one worker thread per CPU
+
+    // Create the server on localhost and port 6969
+    if ((result = ps_create_http_server(&server, PS_ADDRESS_IPV4, "127.0.0.1", 6969, NULL)) != PS_SUCCESS) goto cleanup;
+
+    // Route every GET request to the page, or to the served directory
+    if (root) {
+        result = ps_http_route(server, "GET", "/*", serve_static_file, (void *)root);
+    } else {
+        result = ps_http_route(server, "GET", "/*", serve_page, NULL);
     }
+    if (result != PS_SUCCESS) goto cleanup;
+
+    // Serve on the worker threads until Enter is pressed
+    if ((result = ps_http_server_start(server)) != PS_SUCCESS) goto cleanup;
+    printf("Listening on http://127.0.0.1:%u, press Enter to stop\n", ps_http_server_get_port(server));
+    getchar();
 
 cleanup:
-    // Cleanup: close the socket and free resources
-    if (socket) ps_destroy_socket(socket);
+    if (result != PS_SUCCESS) printf("Failed to serve: %s\n", ps_result_to_cstr(result));
+
+    // Cleanup: stop the workers and close all connections
+    if (server) ps_destroy_http_server(server);
 
     // Final cleanup for purrsock library
     ps_cleanup();
 
-    return 0;  ///< Return 0 to indicate successful execution
+    return result == PS_SUCCESS ? 0 : 1;
 }
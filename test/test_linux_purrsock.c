@@ -5,6 +5,14 @@
 #include <setjmp.h>
 #include <cmocka.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <fcntl.h>
 #include "purrsock/purrsock.h"
 
 static void test_initialization(void **state) {
@@ -15,7 +23,7 @@ static void test_initialization(void **state) {
 static void test_create_socket_tcp(void **state) {
     (void)state;
     ps_socket_t socket;
-    ps_result_t result = ps_create_socket(&socket, PS_PROTOCOL_TCP);
+    ps_result_t result = ps_create_socket(&socket, PS_PROTOCOL_TCP, PS_ADDRESS_IPV4);
     assert_int_equal(result, PS_SUCCESS);
     ps_destroy_socket(socket);
 }
@@ -23,7 +31,7 @@ static void test_create_socket_tcp(void **state) {
 static void test_create_socket_udp(void **state) {
     (void)state;
     ps_socket_t socket;
-    ps_result_t result = ps_create_socket(&socket, PS_PROTOCOL_UDP);
+    ps_result_t result = ps_create_socket(&socket, PS_PROTOCOL_UDP, PS_ADDRESS_IPV4);
     assert_int_equal(result, PS_SUCCESS);
     ps_destroy_socket(socket);
 }
@@ -31,10 +39,10 @@ static void test_create_socket_udp(void **state) {
 static void test_bind_socket(void **state) {
     (void)state;
     ps_socket_t socket;
-    ps_result_t result = ps_create_socket(&socket, PS_PROTOCOL_TCP);
+    ps_result_t result = ps_create_socket(&socket, PS_PROTOCOL_TCP, PS_ADDRESS_IPV4);
     assert_int_equal(result, PS_SUCCESS);
 
-    result = ps_bind_socket(socket, "127.0.0.1", 8080);
+    result = ps_bind_socket(socket, "127.0.0.1", 0);
     assert_int_equal(result, PS_SUCCESS);
 
     ps_destroy_socket(socket);
@@ -43,10 +51,10 @@ static void test_bind_socket(void **state) {
 static void test_listen_socket(void **state) {
     (void)state;
     ps_socket_t socket;
-    ps_result_t result = ps_create_socket(&socket, PS_PROTOCOL_TCP);
+    ps_result_t result = ps_create_socket(&socket, PS_PROTOCOL_TCP, PS_ADDRESS_IPV4);
     assert_int_equal(result, PS_SUCCESS);
 
-    result = ps_bind_socket(socket, "127.0.0.1", 8080);
+    result = ps_bind_socket(socket, "127.0.0.1", 0);
     assert_int_equal(result, PS_SUCCESS);
 
     result = ps_listen_socket(socket);
@@ -55,28 +63,43 @@ static void test_listen_socket(void **state) {
     ps_destroy_socket(socket);
 }
 
+// The in-process transport gives the tests below a peer without ports or timing.
+static void create_memory_listener(ps_socket_t *listener, ps_port_t port) {
+    assert_int_equal(ps_create_socket(listener, PS_PROTOCOL_MEMORY, PS_ADDRESS_IPV4), PS_SUCCESS);
+    assert_int_equal(ps_bind_socket(*listener, "127.0.0.1", port), PS_SUCCESS);
+    assert_int_equal(ps_listen_socket(*listener), PS_SUCCESS);
+}
+
 static void test_connect_socket(void **state) {
     (void)state;
+    ps_socket_t listener;
+    create_memory_listener(&listener, 8080);
+
     ps_socket_t socket;
-    ps_result_t result = ps_create_socket(&socket, PS_PROTOCOL_TCP);
+    ps_result_t result = ps_create_socket(&socket, PS_PROTOCOL_MEMORY, PS_ADDRESS_IPV4);
     assert_int_equal(result, PS_SUCCESS);
 
     result = ps_connect_socket(socket, "127.0.0.1", 8080);
     assert_int_equal(result, PS_SUCCESS);
 
+    ps_socket_t server_socket;
+    result = ps_accept_socket(listener, &server_socket);
+    assert_int_equal(result, PS_SUCCESS);
+
+    ps_destroy_socket(server_socket);
     ps_destroy_socket(socket);
+    ps_destroy_socket(listener);
 }
 
 static void test_send_packet(void **state) {
     (void)state;
     ps_socket_t socket;
-    ps_result_t result = ps_create_socket(&socket, PS_PROTOCOL_TCP);
-    assert_int_equal(result, PS_SUCCESS);
+    create_memory_listener(&socket, 8080);
 
-    result = ps_bind_socket(socket, "127.0.0.1", 8080);
+    ps_socket_t peer_socket;
+    ps_result_t result = ps_create_socket(&peer_socket, PS_PROTOCOL_MEMORY, PS_ADDRESS_IPV4);
     assert_int_equal(result, PS_SUCCESS);
-
-    result = ps_listen_socket(socket);
+    result = ps_connect_socket(peer_socket, "127.0.0.1", 8080);
     assert_int_equal(result, PS_SUCCESS);
 
     ps_socket_t client_socket;
@@ -84,23 +107,23 @@ static void test_send_packet(void **state) {
     assert_int_equal(result, PS_SUCCESS);
 
     ps_packet_t packet = {5, "Hello", 10};
-    result = ps_send_socket_packet(client_socket, packet, socket);
+    result = ps_send_socket_packet(client_socket, packet, NULL);
     assert_int_equal(result, PS_SUCCESS);
 
     ps_destroy_socket(client_socket);
+    ps_destroy_socket(peer_socket);
     ps_destroy_socket(socket);
 }
 
 static void test_read_packet(void **state) {
     (void)state;
     ps_socket_t socket;
-    ps_result_t result = ps_create_socket(&socket, PS_PROTOCOL_TCP);
-    assert_int_equal(result, PS_SUCCESS);
+    create_memory_listener(&socket, 8080);
 
-    result = ps_bind_socket(socket, "127.0.0.1", 8080);
+    ps_socket_t peer_socket;
+    ps_result_t result = ps_create_socket(&peer_socket, PS_PROTOCOL_MEMORY, PS_ADDRESS_IPV4);
     assert_int_equal(result, PS_SUCCESS);
-
-    result = ps_listen_socket(socket);
+    result = ps_connect_socket(peer_socket, "127.0.0.1", 8080);
     assert_int_equal(result, PS_SUCCESS);
 
     ps_socket_t client_socket;
@@ -108,17 +131,19 @@ static void test_read_packet(void **state) {
     assert_int_equal(result, PS_SUCCESS);
 
     ps_packet_t packet = {5, "Hello", 10};
-    result = ps_send_socket_packet(client_socket, packet, socket);
+    result = ps_send_socket_packet(client_socket, packet, NULL);
     assert_int_equal(result, PS_SUCCESS);
 
-    ps_packet_t received_packet;
-    result = ps_read_socket_packet(socket, &received_packet, NULL);
+    ps_packet_t received_packet = {0};
+    result = ps_read_socket_packet(peer_socket, &received_packet, NULL);
     assert_int_equal(result, PS_SUCCESS);
 
     assert_int_equal(received_packet.size, 5);
-    assert_string_equal(received_packet.buf, "Hello");
+    assert_memory_equal(received_packet.buf, "Hello", 5);
+    ps_packet_release(&received_packet);
 
     ps_destroy_socket(client_socket);
+    ps_destroy_socket(peer_socket);
     ps_destroy_socket(socket);
 }
 
@@ -133,16 +158,19 @@ static void test_bind_socket_address_in_use(void **state) {
     ps_socket_t socket1, socket2;
     ps_result_t result;
 
-    result = ps_create_socket(&socket1, PS_PROTOCOL_TCP);
+    result = ps_create_socket(&socket1, PS_PROTOCOL_TCP, PS_ADDRESS_IPV4);
     assert_int_equal(result, PS_SUCCESS);
 
-    result = ps_bind_socket(socket1, "127.0.0.1", 8080);
+    result = ps_bind_socket(socket1, "127.0.0.1", 0);
+    assert_int_equal(result, PS_SUCCESS);
+    ps_endpoint_t endpoint;
+    result = ps_get_socket_endpoint(socket1, &endpoint);
     assert_int_equal(result, PS_SUCCESS);
 
-    result = ps_create_socket(&socket2, PS_PROTOCOL_TCP);
+    result = ps_create_socket(&socket2, PS_PROTOCOL_TCP, PS_ADDRESS_IPV4);
     assert_int_equal(result, PS_SUCCESS);
 
-    result = ps_bind_socket(socket2, "127.0.0.1", 8080);
+    result = ps_bind_socket(socket2, "127.0.0.1", endpoint.port);
     assert_int_equal(result, PS_ERROR_ADDRINUSE);
 
     ps_destroy_socket(socket1);
@@ -152,34 +180,28 @@ static void test_bind_socket_address_in_use(void **state) {
 static void *send_packet_thread(void *arg) {
     ps_socket_t *client_socket = (ps_socket_t *)arg;
     ps_packet_t packet = {5, "Hello", 10};
-    ps_result_t result = ps_send_socket_packet(*client_socket, packet, *client_socket);
+    ps_result_t result = ps_send_socket_packet(*client_socket, packet, NULL);
     assert_int_equal(result, PS_SUCCESS);
     return NULL;
 }
 
 static void *read_packet_thread(void *arg) {
     ps_socket_t *server_socket = (ps_socket_t *)arg;
-    ps_packet_t received_packet;
+    ps_packet_t received_packet = {0};
     ps_result_t result = ps_read_socket_packet(*server_socket, &received_packet, NULL);
     assert_int_equal(result, PS_SUCCESS);
     assert_int_equal(received_packet.size, 5);
-    assert_string_equal(received_packet.buf, "Hello");
+    assert_memory_equal(received_packet.buf, "Hello", 5);
+    ps_packet_release(&received_packet);
     return NULL;
 }
 
 static void test_send_receive_packet_multithreaded(void **state) {
     (void)state;
     ps_socket_t server_socket, client_socket;
-    ps_result_t result = ps_create_socket(&server_socket, PS_PROTOCOL_TCP);
-    assert_int_equal(result, PS_SUCCESS);
-
-    result = ps_bind_socket(server_socket, "127.0.0.1", 8080);
-    assert_int_equal(result, PS_SUCCESS);
+    create_memory_listener(&server_socket, 8080);
 
-    result = ps_listen_socket(server_socket);
-    assert_int_equal(result, PS_SUCCESS);
-
-    result = ps_create_socket(&client_socket, PS_PROTOCOL_TCP);
+    ps_result_t result = ps_create_socket(&client_socket, PS_PROTOCOL_MEMORY, PS_ADDRESS_IPV4);
     assert_int_equal(result, PS_SUCCESS);
 
     result = ps_connect_socket(client_socket, "127.0.0.1", 8080);
@@ -191,7 +213,7 @@ static void test_send_receive_packet_multithreaded(void **state) {
 
     pthread_t send_thread, recv_thread;
 
-    pthread_create(&recv_thread, NULL, read_packet_thread, (void *)&server_socket);
+    pthread_create(&recv_thread, NULL, read_packet_thread, (void *)&accepted_client_socket);
     pthread_create(&send_thread, NULL, send_packet_thread, (void *)&client_socket);
 
     pthread_join(send_thread, NULL);
@@ -202,6 +224,3628 @@ static void test_send_receive_packet_multithreaded(void **state) {
     ps_destroy_socket(server_socket);
 }
 
+#define LOOP_TEST_PORT 8090
+#define LOOP_TEST_CLIENTS 32
+
+typedef struct {
+    int accepted;
+    int echoed;
+    int closed;
+} loop_test_state_t;
+
+static void loop_test_on_read(ps_loop_t loop, ps_socket_t socket, void *user_data) {
+    (void)loop;
+    loop_test_state_t *state = (loop_test_state_t *)user_data;
+    while (1) {
+        ps_packet_t packet = {0};
+        ps_result_t result = ps_read_socket_packet(socket, &packet, NULL);
+        if (result != PS_SUCCESS) {
+            assert_true(result == PS_ERROR_WOULDBLOCK || result == PS_CONNCLOSED);
+            return;
+        }
+        assert_int_equal(ps_send_socket_packet(socket, packet, NULL), PS_SUCCESS);
+        ps_packet_release(&packet);
+        state->echoed++;
+    }
+}
+
+static void loop_test_on_close(ps_loop_t loop, ps_socket_t socket, void *user_data) {
+    (void)loop;
+    loop_test_state_t *state = (loop_test_state_t *)user_data;
+    state->closed++;
+    ps_destroy_socket(socket);
+}
+
+static void loop_test_on_accept(ps_loop_t loop, ps_socket_t socket, ps_socket_t client, void *user_data) {
+    (void)socket;
+    loop_test_state_t *state = (loop_test_state_t *)user_data;
+    ps_loop_callbacks_t callbacks = {0};
+    callbacks.on_read = loop_test_on_read;
+    callbacks.on_close = loop_test_on_close;
+    callbacks.user_data = state;
+    assert_int_equal(ps_loop_add_socket(loop, client, callbacks), PS_SUCCESS);
+    state->accepted++;
+}
+
+static void test_loop_echo_loopback(void **state) {
+    (void)state;
+    assert_true(ps_init());
+    loop_test_state_t test_state = {0};
+
+    ps_loop_t loop;
+    assert_int_equal(ps_create_loop(&loop), PS_SUCCESS);
+
+    ps_socket_t server_socket;
+    assert_int_equal(ps_create_socket(&server_socket, PS_PROTOCOL_TCP, PS_ADDRESS_IPV4), PS_SUCCESS);
+    assert_int_equal(ps_bind_socket(server_socket, "127.0.0.1", LOOP_TEST_PORT), PS_SUCCESS);
+    assert_int_equal(ps_listen_socket(server_socket), PS_SUCCESS);
+
+    ps_loop_callbacks_t callbacks = {0};
+    callbacks.on_accept = loop_test_on_accept;
+    callbacks.user_data = &test_state;
+    assert_int_equal(ps_loop_add_socket(loop, server_socket, callbacks), PS_SUCCESS);
+
+    ps_socket_t clients[LOOP_TEST_CLIENTS];
+    ps_packet_t packet = {5, "Hello", 5};
+    for (int i = 0; i < LOOP_TEST_CLIENTS; ++i) {
+        assert_int_equal(ps_create_socket(&clients[i], PS_PROTOCOL_TCP, PS_ADDRESS_IPV4), PS_SUCCESS);
+        assert_int_equal(ps_connect_socket(clients[i], "127.0.0.1", LOOP_TEST_PORT), PS_SUCCESS);
+        assert_int_equal(ps_send_socket_packet(clients[i], packet, NULL), PS_SUCCESS);
+        // Accept as we go so the listen backlog never fills up.
+        assert_int_equal(ps_loop_run_once(loop, 0), PS_SUCCESS);
+    }
+
+    for (int i = 0; i < 100 && test_state.echoed < LOOP_TEST_CLIENTS; ++i) {
+        assert_int_equal(ps_loop_run_once(loop, 100), PS_SUCCESS);
+    }
+    assert_int_equal(test_state.accepted, LOOP_TEST_CLIENTS);
+    assert_int_equal(test_state.echoed, LOOP_TEST_CLIENTS);
+
+    for (int i = 0; i < LOOP_TEST_CLIENTS; ++i) {
+        ps_packet_t received_packet = {0};
+        assert_int_equal(ps_read_socket_packet(clients[i], &received_packet, NULL), PS_SUCCESS);
+        assert_int_equal(received_packet.size, 5);
+        assert_memory_equal(received_packet.buf, "Hello", 5);
+        ps_packet_release(&received_packet);
+        ps_destroy_socket(clients[i]);
+    }
+
+    for (int i = 0; i < 100 && test_state.closed < LOOP_TEST_CLIENTS; ++i) {
+        assert_int_equal(ps_loop_run_once(loop, 100), PS_SUCCESS);
+    }
+    assert_int_equal(test_state.closed, LOOP_TEST_CLIENTS);
+
+    ps_destroy_socket(server_socket);
+    ps_destroy_loop(loop);
+}
+
+#define ASYNC_TEST_PORT 8091
+#define ASYNC_TEST_CLIENTS 8
+
+typedef struct {
+    int accepted;
+    int echoed;
+    int replies;
+    int closed;
+} async_test_state_t;
+
+typedef struct {
+    async_test_state_t *state;
+    ps_packet_t packet;
+    char buf[64];
+} async_test_conn_t;
+
+static void async_test_on_echoed(ps_loop_t loop, ps_socket_t socket, ps_result_t result, ps_packet_t *packet, void *user_data) {
+    (void)loop; (void)socket; (void)packet;
+    async_test_conn_t *conn = (async_test_conn_t *)user_data;
+    assert_int_equal(result, PS_SUCCESS);
+    conn->state->echoed++;
+}
+
+static void async_test_on_server_read(ps_loop_t loop, ps_socket_t socket, ps_result_t result, ps_packet_t *packet, void *user_data) {
+    async_test_conn_t *conn = (async_test_conn_t *)user_data;
+    if (result != PS_SUCCESS) {
+        assert_int_equal(result, PS_CONNCLOSED);
+        conn->state->closed++;
+        ps_destroy_socket(socket);
+        free(conn);
+        return;
+    }
+
+    // The multishot buffer is only lent for the duration of the callback.
+    memcpy(conn->buf, packet->buf, packet->size);
+    conn->packet.buf = conn->buf;
+    conn->packet.size = packet->size;
+    conn->packet.capacity = sizeof(conn->buf);
+    assert_int_equal(ps_loop_send_socket_packet(loop, socket, &conn->packet, async_test_on_echoed, conn), PS_SUCCESS);
+}
+
+static void async_test_on_accept(ps_loop_t loop, ps_socket_t socket, ps_result_t result, ps_socket_t client, void *user_data) {
+    (void)socket;
+    assert_int_equal(result, PS_SUCCESS);
+    async_test_conn_t *conn = (async_test_conn_t *)calloc(1, sizeof(*conn));
+    conn->state = (async_test_state_t *)user_data;
+    conn->state->accepted++;
+    assert_int_equal(ps_loop_read_socket_packet_multishot(loop, client, async_test_on_server_read, conn), PS_SUCCESS);
+}
+
+static void async_test_on_client_read(ps_loop_t loop, ps_socket_t socket, ps_result_t result, ps_packet_t *packet, void *user_data) {
+    (void)loop; (void)socket;
+    async_test_conn_t *conn = (async_test_conn_t *)user_data;
+    assert_int_equal(result, PS_SUCCESS);
+    assert_int_equal(packet->size, 5);
+    assert_memory_equal(packet->buf, "Hello", 5);
+    conn->state->replies++;
+}
+
+static void run_async_echo_loopback(ps_loop_backend_t backend, ps_port_t port) {
+    async_test_state_t test_state = {0};
+
+    ps_loop_options_t options = {0};
+    options.backend = backend;
+    ps_loop_t loop;
+    assert_int_equal(ps_create_loop_with_options(&loop, &options), PS_SUCCESS);
+    if (backend == PS_LOOP_BACKEND_EPOLL) assert_int_equal(ps_loop_get_backend(loop), PS_LOOP_BACKEND_EPOLL);
+
+    ps_socket_t server_socket;
+    assert_int_equal(ps_create_socket(&server_socket, PS_PROTOCOL_TCP, PS_ADDRESS_IPV4), PS_SUCCESS);
+    assert_int_equal(ps_bind_socket(server_socket, "127.0.0.1", port), PS_SUCCESS);
+    assert_int_equal(ps_listen_socket(server_socket), PS_SUCCESS);
+    assert_int_equal(ps_loop_accept_socket(loop, server_socket, true, async_test_on_accept, &test_state), PS_SUCCESS);
+
+    ps_socket_t clients[ASYNC_TEST_CLIENTS];
+    async_test_conn_t client_conns[ASYNC_TEST_CLIENTS];
+    ps_packet_t hello = {5, "Hello", 5};
+    for (int i = 0; i < ASYNC_TEST_CLIENTS; ++i) {
+        client_conns[i].state = &test_state;
+        client_conns[i].packet.buf = client_conns[i].buf;
+        client_conns[i].packet.capacity = sizeof(client_conns[i].buf);
+
+        assert_int_equal(ps_create_socket(&clients[i], PS_PROTOCOL_TCP, PS_ADDRESS_IPV4), PS_SUCCESS);
+        assert_int_equal(ps_connect_socket(clients[i], "127.0.0.1", port), PS_SUCCESS);
+        assert_int_equal(ps_loop_send_socket_packet(loop, clients[i], &hello, NULL, NULL), PS_SUCCESS);
+        assert_int_equal(ps_loop_read_socket_packet(loop, clients[i], &client_conns[i].packet, async_test_on_client_read, &client_conns[i]), PS_SUCCESS);
+        assert_int_equal(ps_loop_run_once(loop, 0), PS_SUCCESS);
+    }
+
+    for (int i = 0; i < 100 && test_state.replies < ASYNC_TEST_CLIENTS; ++i) {
+        assert_int_equal(ps_loop_run_once(loop, 100), PS_SUCCESS);
+    }
+    assert_int_equal(test_state.accepted, ASYNC_TEST_CLIENTS);
+    assert_int_equal(test_state.echoed, ASYNC_TEST_CLIENTS);
+    assert_int_equal(test_state.replies, ASYNC_TEST_CLIENTS);
+
+    for (int i = 0; i < ASYNC_TEST_CLIENTS; ++i) ps_destroy_socket(clients[i]);
+    for (int i = 0; i < 100 && test_state.closed < ASYNC_TEST_CLIENTS; ++i) {
+        assert_int_equal(ps_loop_run_once(loop, 100), PS_SUCCESS);
+    }
+    assert_int_equal(test_state.closed, ASYNC_TEST_CLIENTS);
+
+    ps_destroy_socket(server_socket);
+    ps_loop_run_once(loop, 0);
+    ps_destroy_loop(loop);
+}
+
+static void test_loop_async_echo_epoll(void **state) {
+    (void)state;
+    run_async_echo_loopback(PS_LOOP_BACKEND_EPOLL, ASYNC_TEST_PORT);
+}
+
+static void test_loop_async_echo_auto(void **state) {
+    (void)state;
+    // Runs on io_uring when the kernel supports it and on the epoll fallback otherwise.
+    run_async_echo_loopback(PS_LOOP_BACKEND_AUTO, ASYNC_TEST_PORT + 1);
+}
+
+static void test_packet_pool(void **state) {
+    (void)state;
+    assert_true(ps_init());
+
+    ps_packet_pool_t pool;
+    assert_int_equal(ps_create_packet_pool(&pool), PS_SUCCESS);
+
+    ps_packet_t small = {0};
+    assert_int_equal(ps_packet_acquire(pool, 100, &small), PS_SUCCESS);
+    assert_non_null(small.buf);
+    assert_int_equal(small.capacity, 256);
+    assert_int_equal(small.size, 0);
+    memset(small.buf, 0xAB, small.capacity);
+
+    // A released buffer is handed out again from the thread cache.
+    char *reused = small.buf;
+    ps_packet_release(&small);
+    assert_null(small.buf);
+    assert_int_equal(ps_packet_acquire(pool, 200, &small), PS_SUCCESS);
+    assert_ptr_equal(small.buf, reused);
+
+    ps_packet_t medium = {0};
+    assert_int_equal(ps_packet_acquire(pool, 1500, &medium), PS_SUCCESS);
+    assert_int_equal(medium.capacity, 4096);
+
+    ps_packet_t large = {0};
+    assert_int_equal(ps_packet_acquire(pool, 100000, &large), PS_SUCCESS);
+    assert_int_equal(large.capacity, 100000);
+    memset(large.buf, 0, large.capacity);
+
+    ps_packet_pool_stats_t stats;
+    ps_get_packet_pool_stats(pool, &stats);
+    assert_int_equal(stats.slabs, 2);
+
+    // Steady-state acquire/release cycles must not grow the pool.
+    for (int i = 0; i < 10000; ++i) {
+        ps_packet_t packet = {0};
+        assert_int_equal(ps_packet_acquire(pool, 1024, &packet), PS_SUCCESS);
+        ps_packet_release(&packet);
+    }
+    ps_get_packet_pool_stats(pool, &stats);
+    assert_int_equal(stats.slabs, 3);
+
+    ps_packet_release(&small);
+    ps_packet_release(&medium);
+    ps_packet_release(&large);
+    ps_destroy_packet_pool(pool);
+
+    // Live pools are bounded: creating one too many fails instead of leaving it unregistered.
+    ps_packet_pool_t pools[64];
+    size_t created = 0;
+    ps_result_t result;
+    while ((result = ps_create_packet_pool(&pools[created])) == PS_SUCCESS) {
+        assert_true(++created < 64);
+    }
+    assert_int_equal(result, PS_ERROR_WOULDBLOCK);
+    ps_destroy_packet_pool(pools[--created]);
+    assert_int_equal(ps_create_packet_pool(&pools[created++]), PS_SUCCESS);
+    while (created) ps_destroy_packet_pool(pools[--created]);
+}
+
+#define POOL_TEST_THREADS 4
+#define POOL_TEST_PACKETS 256
+
+static ps_packet_t pool_test_packets[POOL_TEST_THREADS][POOL_TEST_PACKETS];
+
+static void *pool_release_thread(void *arg) {
+    ps_packet_t *packets = (ps_packet_t *)arg;
+    for (int i = 0; i < POOL_TEST_PACKETS; ++i) {
+        ps_packet_release(&packets[i]);
+    }
+    return NULL;
+}
+
+static void test_packet_pool_cross_thread_release(void **state) {
+    (void)state;
+    ps_packet_pool_t pool;
+    assert_int_equal(ps_create_packet_pool(&pool), PS_SUCCESS);
+
+    for (int round = 0; round < 3; ++round) {
+        for (int t = 0; t < POOL_TEST_THREADS; ++t) {
+            for (int i = 0; i < POOL_TEST_PACKETS; ++i) {
+                assert_int_equal(ps_packet_acquire(pool, 512, &pool_test_packets[t][i]), PS_SUCCESS);
+                memset(pool_test_packets[t][i].buf, t, pool_test_packets[t][i].capacity);
+            }
+        }
+
+        pthread_t threads[POOL_TEST_THREADS];
+        for (int t = 0; t < POOL_TEST_THREADS; ++t) {
+            pthread_create(&threads[t], NULL, pool_release_thread, pool_test_packets[t]);
+        }
+        for (int t = 0; t < POOL_TEST_THREADS; ++t) {
+            pthread_join(threads[t], NULL);
+        }
+    }
+
+    // Chunks spilled back by the releasing threads are reused instead of growing without bound.
+    ps_packet_pool_stats_t stats;
+    ps_get_packet_pool_stats(pool, &stats);
+    assert_true(stats.slabs <= 5);
+
+    ps_destroy_packet_pool(pool);
+}
+
+static void test_read_packet_udp_into_buffer(void **state) {
+    (void)state;
+    assert_true(ps_init());
+
+    ps_socket_t receiver, sender;
+    assert_int_equal(ps_create_socket_from_addr(&receiver, PS_PROTOCOL_UDP, PS_ADDRESS_IPV4, "127.0.0.1", 8093), PS_SUCCESS);
+    assert_int_equal(ps_create_socket(&sender, PS_PROTOCOL_UDP, PS_ADDRESS_IPV4), PS_SUCCESS);
+    assert_int_equal(ps_connect_socket(sender, "127.0.0.1", 8093), PS_SUCCESS);
+
+    ps_packet_t hello = {5, "Hello", 5};
+    assert_int_equal(ps_send_socket_packet(sender, hello, NULL), PS_SUCCESS);
+    assert_int_equal(ps_send_socket_packet(sender, hello, NULL), PS_SUCCESS);
+    assert_int_equal(ps_send_socket_packet(sender, hello, NULL), PS_SUCCESS);
+
+    // Caller-provided buffer: filled in place.
+    char buf[16];
+    ps_packet_t packet = {0, buf, sizeof(buf)};
+    assert_int_equal(ps_read_socket_packet(receiver, &packet, NULL), PS_SUCCESS);
+    assert_ptr_equal(packet.buf, buf);
+    assert_int_equal(packet.size, 5);
+    assert_memory_equal(buf, "Hello", 5);
+
+    // Too small: the datagram is truncated and reported.
+    ps_packet_t tiny = {0, buf, 3};
+    assert_int_equal(ps_read_socket_packet(receiver, &tiny, NULL), PS_ERROR_MSGTOOLONG);
+    assert_int_equal(tiny.size, 3);
+    assert_memory_equal(buf, "Hel", 3);
+
+    // No buffer: one is taken from the default pool.
+    ps_packet_t pooled = {0};
+    assert_int_equal(ps_read_socket_packet(receiver, &pooled, NULL), PS_SUCCESS);
+    assert_non_null(pooled.buf);
+    assert_int_equal(pooled.size, 5);
+    assert_memory_equal(pooled.buf, "Hello", 5);
+    ps_packet_release(&pooled);
+
+    ps_destroy_socket(sender);
+    ps_destroy_socket(receiver);
+}
+
+static void test_read_send_socket_packets_batched(void **state) {
+    (void)state;
+    assert_true(ps_init());
+
+    ps_socket_t receiver, sender;
+    assert_int_equal(ps_create_socket_from_addr(&receiver, PS_PROTOCOL_UDP, PS_ADDRESS_IPV4, "127.0.0.1", 8094), PS_SUCCESS);
+    assert_int_equal(ps_create_socket_from_addr(&sender, PS_PROTOCOL_UDP, PS_ADDRESS_IPV4, "127.0.0.1", 8095), PS_SUCCESS);
+
+    enum { BATCH = 10 };
+    char payloads[BATCH][8];
+    ps_packet_t out[BATCH];
+    ps_endpoint_t to[BATCH];
+    for (int i = 0; i < BATCH; ++i) {
+        out[i].size = (size_t)snprintf(payloads[i], sizeof(payloads[i]), "pkt%d", i);
+        out[i].buf = payloads[i];
+        out[i].capacity = sizeof(payloads[i]);
+        assert_int_equal(ps_endpoint_from_addr(&to[i], "127.0.0.1", 8094), PS_SUCCESS);
+    }
+
+    size_t sent = 0;
+    assert_int_equal(ps_send_socket_packets(sender, out, to, BATCH, &sent), PS_SUCCESS);
+    assert_int_equal(sent, BATCH);
+
+    ps_packet_t in[BATCH] = {0};
+    ps_endpoint_t from[BATCH];
+    size_t total = 0;
+    while (total < BATCH) {
+        size_t received = 0;
+        assert_int_equal(ps_read_socket_packets(receiver, in + total, from + total, BATCH - total, &received), PS_SUCCESS);
+        assert_true(received > 0);
+        total += received;
+    }
+
+    for (int i = 0; i < BATCH; ++i) {
+        assert_int_equal(in[i].size, out[i].size);
+        assert_memory_equal(in[i].buf, payloads[i], out[i].size);
+        assert_int_equal(from[i].family, PS_ADDRESS_IPV4);
+        assert_int_equal(from[i].port, 8095);
+        assert_memory_equal(from[i].addr, "\x7f\x00\x00\x01", 4);
+        ps_packet_release(&in[i]);
+    }
+
+    assert_int_equal(ps_endpoint_from_addr(&to[0], "not an address", 1), PS_ERROR_INVALID_ARGUMENT);
+
+    ps_destroy_socket(sender);
+    ps_destroy_socket(receiver);
+}
+
+#define GSO_TEST_SEGMENT 1000
+#define GSO_TEST_SIZE 9500
+
+// Collects the segments of one GSO_TEST_SIZE buffer and checks every boundary.
+static void gso_test_receive(ps_socket_t receiver, const char *expected, bool segmented_reads) {
+    size_t offset = 0;
+    size_t segments_seen = 0;
+    while (offset < GSO_TEST_SIZE) {
+        ps_packet_t packet = {0};
+        ps_packet_t segments[PS_MAX_PACKET_SEGMENTS];
+        size_t count = 1;
+        if (segmented_reads) {
+            assert_int_equal(ps_read_socket_packet_segmented(receiver, &packet, segments, PS_MAX_PACKET_SEGMENTS, &count, NULL), PS_SUCCESS);
+        } else {
+            assert_int_equal(ps_read_socket_packet(receiver, &packet, NULL), PS_SUCCESS);
+            segments[0] = packet;
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            size_t expected_size = GSO_TEST_SIZE - offset < GSO_TEST_SEGMENT ? GSO_TEST_SIZE - offset : GSO_TEST_SEGMENT;
+            assert_int_equal(segments[i].size, expected_size);
+            assert_memory_equal(segments[i].buf, expected + offset, expected_size);
+            offset += expected_size;
+            segments_seen++;
+        }
+        ps_packet_release(&packet);
+    }
+    assert_int_equal(segments_seen, (GSO_TEST_SIZE + GSO_TEST_SEGMENT - 1) / GSO_TEST_SEGMENT);
+}
+
+static void test_udp_segmentation_offload(void **state) {
+    (void)state;
+    assert_true(ps_init());
+
+    ps_socket_t receiver, sender;
+    assert_int_equal(ps_create_socket_from_addr(&receiver, PS_PROTOCOL_UDP, PS_ADDRESS_IPV4, "127.0.0.1", 8096), PS_SUCCESS);
+    assert_int_equal(ps_create_socket(&sender, PS_PROTOCOL_UDP, PS_ADDRESS_IPV4), PS_SUCCESS);
+
+    static char payload[GSO_TEST_SIZE];
+    for (int i = 0; i < GSO_TEST_SIZE; ++i) {
+        payload[i] = (char)(i / GSO_TEST_SEGMENT * 31 + i);
+    }
+    ps_packet_t packet = {GSO_TEST_SIZE, payload, GSO_TEST_SIZE};
+    ps_endpoint_t to;
+    assert_int_equal(ps_endpoint_from_addr(&to, "127.0.0.1", 8096), PS_SUCCESS);
+
+    // Without GRO the receiver sees individual datagrams.
+    size_t sent;
+    assert_int_equal(ps_send_socket_packet_segmented(sender, packet, GSO_TEST_SEGMENT, &to, &sent), PS_SUCCESS);
+    assert_int_equal(sent, (GSO_TEST_SIZE + GSO_TEST_SEGMENT - 1) / GSO_TEST_SEGMENT);
+    gso_test_receive(receiver, payload, false);
+
+    // With GRO, coalesced receives are split back at the original boundaries.
+    ps_result_t result = ps_set_socket_gro(receiver, true);
+    assert_true(result == PS_SUCCESS || result == PS_ERROR_UNSUPPORTED);
+    assert_int_equal(ps_send_socket_packet_segmented(sender, packet, GSO_TEST_SEGMENT, &to, &sent), PS_SUCCESS);
+    gso_test_receive(receiver, payload, true);
+
+    assert_int_equal(ps_send_socket_packet_segmented(sender, packet, 0, &to, &sent), PS_ERROR_INVALID_ARGUMENT);
+    assert_int_equal(sent, 0);
+
+    ps_destroy_socket(sender);
+    ps_destroy_socket(receiver);
+}
+
+#define SEND_FILE_TEST_SIZE (300 * 1024)
+#define SEND_FILE_TEST_OFFSET 1000
+
+// Reads from a socket on its own thread until `capacity` bytes arrived or the connection ends.
+typedef struct {
+    ps_socket_t socket;
+    char *buf;
+    size_t size;
+    size_t capacity;
+} stream_reader_t;
+
+static void *stream_reader_thread(void *arg) {
+    stream_reader_t *reader = (stream_reader_t *)arg;
+    while (1) {
+        ps_packet_t packet = {0, reader->buf + reader->size, reader->capacity - reader->size};
+        if (!packet.capacity || ps_read_socket_packet(reader->socket, &packet, NULL) != PS_SUCCESS) break;
+        reader->size += packet.size;
+    }
+    return NULL;
+}
+
+// Connects a client to `listener` and returns both ends of the connection.
+static void connect_pair(ps_socket_t listener, ps_port_t port, ps_socket_t *client, ps_socket_t *server) {
+    assert_int_equal(ps_create_socket(client, PS_PROTOCOL_TCP, PS_ADDRESS_IPV4), PS_SUCCESS);
+    assert_int_equal(ps_connect_socket(*client, "127.0.0.1", port), PS_SUCCESS);
+    assert_int_equal(ps_accept_socket(listener, server), PS_SUCCESS);
+}
+
+static void test_send_file(void **state) {
+    (void)state;
+    assert_true(ps_init());
+
+    char path[] = "/tmp/purrsock_send_file_XXXXXX";
+    int fd = mkstemp(path);
+    assert_true(fd >= 0);
+    static char contents[SEND_FILE_TEST_SIZE];
+    for (size_t i = 0; i < sizeof(contents); ++i) contents[i] = (char)(i * 7 + i / 4096);
+    assert_int_equal(write(fd, contents, sizeof(contents)), sizeof(contents));
+
+    ps_socket_t listener, client, server;
+    assert_int_equal(ps_create_socket_from_addr(&listener, PS_PROTOCOL_TCP, PS_ADDRESS_IPV4, "127.0.0.1", 8097), PS_SUCCESS);
+    assert_int_equal(ps_listen_socket(listener), PS_SUCCESS);
+    connect_pair(listener, 8097, &client, &server);
+
+    static char received[SEND_FILE_TEST_SIZE];
+    stream_reader_t reader = {client, received, 0, sizeof(received)};
+    pthread_t thread;
+    pthread_create(&thread, NULL, stream_reader_thread, &reader);
+
+    // The rest of the file from an offset, then a bounded range by path.
+    uint64_t sent = 0;
+    assert_int_equal(ps_send_file(server, fd, SEND_FILE_TEST_OFFSET, 0, &sent), PS_SUCCESS);
+    assert_int_equal(sent, SEND_FILE_TEST_SIZE - SEND_FILE_TEST_OFFSET);
+    assert_int_equal(ps_send_file_path(server, path, 0, SEND_FILE_TEST_OFFSET, &sent), PS_SUCCESS);
+    assert_int_equal(sent, SEND_FILE_TEST_OFFSET);
+
+    pthread_join(thread, NULL);
+
+    assert_int_equal(reader.size, SEND_FILE_TEST_SIZE);
+    assert_memory_equal(received, contents + SEND_FILE_TEST_OFFSET, SEND_FILE_TEST_SIZE - SEND_FILE_TEST_OFFSET);
+    assert_memory_equal(received + SEND_FILE_TEST_SIZE - SEND_FILE_TEST_OFFSET, contents, SEND_FILE_TEST_OFFSET);
+
+    assert_int_equal(ps_send_file_path(client, "/nonexistent/purrsock", 0, 0, &sent), PS_ERROR_INVALID_ARGUMENT);
+
+    // Clients close first so no TIME_WAIT is left on the listening port.
+    ps_destroy_socket(client);
+    ps_destroy_socket(server);
+    ps_destroy_socket(listener);
+    close(fd);
+    unlink(path);
+}
+
+static void test_splice(void **state) {
+    (void)state;
+    assert_true(ps_init());
+
+    ps_socket_t listener, upstream_client, upstream, downstream_client, downstream;
+    assert_int_equal(ps_create_socket_from_addr(&listener, PS_PROTOCOL_TCP, PS_ADDRESS_IPV4, "127.0.0.1", 8098), PS_SUCCESS);
+    assert_int_equal(ps_listen_socket(listener), PS_SUCCESS);
+    connect_pair(listener, 8098, &upstream_client, &upstream);
+    connect_pair(listener, 8098, &downstream_client, &downstream);
+
+    ps_packet_t hello = {11, "Hello proxy", 11};
+    assert_int_equal(ps_send_socket_packet(upstream_client, hello, NULL), PS_SUCCESS);
+
+    size_t moved = 0;
+    size_t total = 0;
+    while (total < hello.size) {
+        assert_int_equal(ps_splice(upstream, downstream, 4096, &moved), PS_SUCCESS);
+        total += moved;
+    }
+    assert_int_equal(total, hello.size);
+
+    char buf[32];
+    size_t received = 0;
+    while (received < hello.size) {
+        ps_packet_t packet = {0, buf + received, sizeof(buf) - received};
+        assert_int_equal(ps_read_socket_packet(downstream_client, &packet, NULL), PS_SUCCESS);
+        received += packet.size;
+    }
+    assert_memory_equal(buf, "Hello proxy", hello.size);
+
+    ps_destroy_socket(upstream_client);
+    assert_int_equal(ps_splice(upstream, downstream, 4096, &moved), PS_CONNCLOSED);
+    assert_int_equal(moved, 0);
+
+    ps_destroy_socket(downstream_client);
+    ps_destroy_socket(upstream);
+    ps_destroy_socket(downstream);
+    ps_destroy_socket(listener);
+}
+
+#define UNSENT_TEST_CHUNK (256 * 1024)
+
+// Splices from `upstream` into a `downstream` whose peer stops reading, then checks nothing is lost or reordered.
+static void run_splice_nonblocking_full(ps_socket_t upstream_client, ps_socket_t upstream, ps_socket_t downstream_client, ps_socket_t downstream) {
+    assert_int_equal(ps_set_socket_blocking(upstream_client, false), PS_SUCCESS);
+    assert_int_equal(ps_set_socket_blocking(upstream, false), PS_SUCCESS);
+    assert_int_equal(ps_set_socket_blocking(downstream, false), PS_SUCCESS);
+    assert_int_equal(ps_set_socket_blocking(downstream_client, false), PS_SUCCESS);
+
+    // The downstream peer does not read: splicing must stop without waiting and keep what `downstream` cannot take.
+    static char chunk[UNSENT_TEST_CHUNK];
+    size_t written = 0;
+    size_t moved_total = 0;
+    while (!ps_get_socket_unsent(downstream)) {
+        assert_true(written < 1024 * UNSENT_TEST_CHUNK);
+        for (size_t i = 0; i < sizeof(chunk); ++i) chunk[i] = (char)((written + i) % 251);
+        if (ps_send_socket_packet(upstream_client, (ps_packet_t){sizeof(chunk), chunk, sizeof(chunk)}, NULL) == PS_SUCCESS) {
+            written += sizeof(chunk);
+        }
+
+        size_t moved = 0;
+        ps_result_t result;
+        do {
+            result = ps_splice(upstream, downstream, UNSENT_TEST_CHUNK, &moved);
+            moved_total += moved;
+        } while (result == PS_SUCCESS);
+        assert_int_equal(result, PS_ERROR_WOULDBLOCK);
+    }
+
+    // Nothing more is taken from `upstream` until the kept bytes are out, even with data waiting there.
+    for (size_t i = 0; i < sizeof(chunk); ++i) chunk[i] = (char)((written + i) % 251);
+    assert_int_equal(ps_send_socket_packet(upstream_client, (ps_packet_t){sizeof(chunk), chunk, sizeof(chunk)}, NULL), PS_SUCCESS);
+    written += sizeof(chunk);
+    size_t moved = 1;
+    assert_int_equal(ps_splice(upstream, downstream, UNSENT_TEST_CHUNK, &moved), PS_ERROR_WOULDBLOCK);
+    assert_int_equal(moved, 0);
+
+    // Once the peer reads, everything arrives in order.
+    static char buf[UNSENT_TEST_CHUNK];
+    size_t received = 0;
+    for (size_t spins = 0; received < written; ++spins) {
+        assert_true(spins < 10 * 1000 * 1000);
+        ps_flush_socket(upstream_client);
+        ps_flush_socket(downstream);
+        if (ps_splice(upstream, downstream, UNSENT_TEST_CHUNK, &moved) != PS_SUCCESS) moved = 0;
+        moved_total += moved;
+
+        ps_packet_t packet = {0, buf, sizeof(buf)};
+        if (ps_read_socket_packet(downstream_client, &packet, NULL) != PS_SUCCESS) continue;
+        for (size_t i = 0; i < packet.size; ++i) assert_int_equal(buf[i], (char)((received + i) % 251));
+        received += packet.size;
+    }
+    assert_int_equal(received, written);
+    assert_int_equal(moved_total, written);
+    assert_int_equal(ps_get_socket_unsent(downstream), 0);
+}
+
+static void test_splice_nonblocking_full(void **state) {
+    (void)state;
+
+    ps_socket_t listener, upstream_client, upstream, downstream_client, downstream;
+    assert_int_equal(ps_create_socket_from_addr(&listener, PS_PROTOCOL_TCP, PS_ADDRESS_IPV4, "127.0.0.1", 0), PS_SUCCESS);
+    assert_int_equal(ps_listen_socket(listener), PS_SUCCESS);
+    ps_endpoint_t endpoint;
+    assert_int_equal(ps_get_socket_endpoint(listener, &endpoint), PS_SUCCESS);
+    connect_pair(listener, endpoint.port, &upstream_client, &upstream);
+    connect_pair(listener, endpoint.port, &downstream_client, &downstream);
+    run_splice_nonblocking_full(upstream_client, upstream, downstream_client, downstream);
+
+    ps_destroy_socket(upstream_client);
+    ps_destroy_socket(downstream_client);
+    ps_destroy_socket(upstream);
+    ps_destroy_socket(downstream);
+    ps_destroy_socket(listener);
+}
+
+static void test_splice_copy_nonblocking_full(void **state) {
+    (void)state;
+
+    // The kernel cannot splice from the in-process transport, so this runs the copying fallback.
+    ps_socket_t memory_listener, upstream_client, upstream;
+    create_memory_listener(&memory_listener, 8110);
+    assert_int_equal(ps_create_socket(&upstream_client, PS_PROTOCOL_MEMORY, PS_ADDRESS_IPV4), PS_SUCCESS);
+    assert_int_equal(ps_connect_socket(upstream_client, "127.0.0.1", 8110), PS_SUCCESS);
+    assert_int_equal(ps_accept_socket(memory_listener, &upstream), PS_SUCCESS);
+
+    ps_socket_t listener, downstream_client, downstream;
+    assert_int_equal(ps_create_socket_from_addr(&listener, PS_PROTOCOL_TCP, PS_ADDRESS_IPV4, "127.0.0.1", 0), PS_SUCCESS);
+    assert_int_equal(ps_listen_socket(listener), PS_SUCCESS);
+    ps_endpoint_t endpoint;
+    assert_int_equal(ps_get_socket_endpoint(listener, &endpoint), PS_SUCCESS);
+    connect_pair(listener, endpoint.port, &downstream_client, &downstream);
+    run_splice_nonblocking_full(upstream_client, upstream, downstream_client, downstream);
+
+    ps_destroy_socket(upstream_client);
+    ps_destroy_socket(downstream_client);
+    ps_destroy_socket(upstream);
+    ps_destroy_socket(downstream);
+    ps_destroy_socket(memory_listener);
+    ps_destroy_socket(listener);
+}
+
+#define ZEROCOPY_TEST_PACKETS 8
+#define ZEROCOPY_TEST_SIZE (64 * 1024)
+
+typedef struct {
+    int completed;
+    int closed;
+} zerocopy_test_state_t;
+
+static void zerocopy_test_on_complete(ps_socket_t socket, ps_packet_t *packet, bool copied, void *user_data) {
+    (void)socket; (void)copied;
+    zerocopy_test_state_t *state = (zerocopy_test_state_t *)user_data;
+    assert_int_equal(packet->size, packet->capacity);
+    ps_packet_release(packet);
+    state->completed++;
+}
+
+static void zerocopy_test_on_close(ps_loop_t loop, ps_socket_t socket, void *user_data) {
+    (void)loop; (void)socket;
+    ((zerocopy_test_state_t *)user_data)->closed++;
+}
+
+static void zerocopy_test_send(ps_socket_t socket, zerocopy_test_state_t *state) {
+    for (int i = 0; i < ZEROCOPY_TEST_PACKETS; ++i) {
+        ps_packet_t packet = {0};
+        assert_int_equal(ps_packet_acquire(NULL, ZEROCOPY_TEST_SIZE, &packet), PS_SUCCESS);
+        memset(packet.buf, 'z', packet.capacity);
+        packet.size = packet.capacity;
+        assert_int_equal(ps_send_socket_packet_zerocopy(socket, packet, zerocopy_test_on_complete, state), PS_SUCCESS);
+    }
+}
+
+static void test_send_zerocopy(void **state) {
+    (void)state;
+    assert_true(ps_init());
+
+    ps_socket_t listener, client, server;
+    assert_int_equal(ps_create_socket_from_addr(&listener, PS_PROTOCOL_TCP, PS_ADDRESS_IPV4, "127.0.0.1", 8099), PS_SUCCESS);
+    assert_int_equal(ps_listen_socket(listener), PS_SUCCESS);
+    connect_pair(listener, 8099, &client, &server);
+
+    ps_result_t result = ps_set_socket_zerocopy(server, true);
+    if (result == PS_ERROR_UNSUPPORTED) skip();
+    assert_int_equal(result, PS_SUCCESS);
+
+    static char received[2 * ZEROCOPY_TEST_PACKETS * ZEROCOPY_TEST_SIZE];
+    stream_reader_t reader = {client, received, 0, sizeof(received)};
+    pthread_t thread;
+    pthread_create(&thread, NULL, stream_reader_thread, &reader);
+
+    // Small packets are copied and handed back right away.
+    zerocopy_test_state_t test_state = {0};
+    ps_packet_t small = {0};
+    assert_int_equal(ps_packet_acquire(NULL, 100, &small), PS_SUCCESS);
+    small.size = 0;
+    assert_int_equal(ps_send_socket_packet_zerocopy(server, small, NULL, NULL), PS_SUCCESS);
+
+    // Blocking use: completions are collected by polling.
+    zerocopy_test_send(server, &test_state);
+    for (int i = 0; i < 1000 && test_state.completed < ZEROCOPY_TEST_PACKETS; ++i) {
+        assert_int_equal(ps_process_zerocopy_completions(server, NULL), PS_SUCCESS);
+        usleep(1000);
+    }
+    assert_int_equal(test_state.completed, ZEROCOPY_TEST_PACKETS);
+
+    // Loop use: completions raise EPOLLERR, which must not be taken for a closed socket.
+    ps_loop_t loop;
+    assert_int_equal(ps_create_loop(&loop), PS_SUCCESS);
+    ps_loop_callbacks_t callbacks = {0};
+    callbacks.on_close = zerocopy_test_on_close;
+    callbacks.user_data = &test_state;
+    assert_int_equal(ps_loop_add_socket(loop, server, callbacks), PS_SUCCESS);
+
+    zerocopy_test_send(server, &test_state);
+    for (int i = 0; i < 1000 && test_state.completed < 2 * ZEROCOPY_TEST_PACKETS; ++i) {
+        assert_int_equal(ps_loop_run_once(loop, 10), PS_SUCCESS);
+    }
+    assert_int_equal(test_state.completed, 2 * ZEROCOPY_TEST_PACKETS);
+    assert_int_equal(test_state.closed, 0);
+
+    assert_int_equal(ps_loop_remove_socket(loop, server), PS_SUCCESS);
+    ps_destroy_loop(loop);
+
+    pthread_join(thread, NULL);
+    assert_int_equal(reader.size, sizeof(received));
+    ps_destroy_socket(client);
+    ps_destroy_socket(server);
+    ps_destroy_socket(listener);
+}
+
+static void zerocopy_test_on_destroyed(ps_socket_t socket, ps_packet_t *packet, bool copied, void *user_data) {
+    (void)copied;
+    zerocopy_test_state_t *state = (zerocopy_test_state_t *)user_data;
+    if (!socket) state->closed++;
+    ps_packet_release(packet);
+    state->completed++;
+}
+
+// Sends until the socket is full while the peer does not read, destroys the socket and reads everything at the
+// peer; returns the number of packets handed to the sends.
+static int zerocopy_test_destroy_sending(ps_socket_t server, ps_socket_t client, zerocopy_test_state_t *test_state) {
+    assert_int_equal(ps_set_socket_blocking(server, false), PS_SUCCESS);
+
+    // Destroying the socket must neither lose the packets nor hand them back early.
+    ps_result_t result;
+    size_t total = 0;
+    int attempted = 0;
+    while (attempted < ZEROCOPY_TEST_PACKETS) {
+        attempted++;
+        ps_packet_t packet = {0};
+        assert_int_equal(ps_packet_acquire(NULL, ZEROCOPY_TEST_SIZE, &packet), PS_SUCCESS);
+        for (size_t j = 0; j < packet.capacity; ++j) packet.buf[j] = (char)((total + j) % 251);
+        packet.size = packet.capacity;
+        result = ps_send_socket_packet_zerocopy(server, packet, zerocopy_test_on_destroyed, test_state);
+        if (result == PS_ERROR_WOULDBLOCK) break;
+        assert_int_equal(result, PS_SUCCESS);
+        total += packet.size;
+    }
+    ps_destroy_socket(server);
+
+    static char buf[ZEROCOPY_TEST_PACKETS * ZEROCOPY_TEST_SIZE];
+    size_t received = 0;
+    while (1) {
+        ps_packet_t packet = {0, buf, sizeof(buf)};
+        result = ps_read_socket_packet(client, &packet, NULL);
+        if (result == PS_CONNCLOSED) break;
+        assert_int_equal(result, PS_SUCCESS);
+        for (size_t i = 0; i < packet.size; ++i) assert_int_equal(buf[i], (char)((received + i) % 251));
+        received += packet.size;
+    }
+    assert_int_equal(received, total);
+    return attempted;
+}
+
+static void test_send_zerocopy_destroy(void **state) {
+    (void)state;
+
+    ps_socket_t listener, client, server;
+    assert_int_equal(ps_create_socket_from_addr(&listener, PS_PROTOCOL_TCP, PS_ADDRESS_IPV4, "127.0.0.1", 0), PS_SUCCESS);
+    assert_int_equal(ps_listen_socket(listener), PS_SUCCESS);
+    ps_endpoint_t endpoint;
+    assert_int_equal(ps_get_socket_endpoint(listener, &endpoint), PS_SUCCESS);
+    connect_pair(listener, endpoint.port, &client, &server);
+
+    ps_result_t result = ps_set_socket_zerocopy(server, true);
+    if (result == PS_ERROR_UNSUPPORTED) skip();
+    assert_int_equal(result, PS_SUCCESS);
+
+    // Every buffer comes back exactly once, from later zero-copy calls on any socket.
+    zerocopy_test_state_t test_state = {0};
+    int attempted = zerocopy_test_destroy_sending(server, client, &test_state);
+    for (int i = 0; i < 1000 && test_state.completed < attempted; ++i) {
+        assert_int_equal(ps_process_zerocopy_completions(client, NULL), PS_SUCCESS);
+        usleep(1000);
+    }
+    assert_int_equal(test_state.completed, attempted);
+    ps_destroy_socket(client);
+
+    // Without further zero-copy calls, the library's cleanup hands them back.
+    connect_pair(listener, endpoint.port, &client, &server);
+    assert_int_equal(ps_set_socket_zerocopy(server, true), PS_SUCCESS);
+    test_state = (zerocopy_test_state_t){0};
+    attempted = zerocopy_test_destroy_sending(server, client, &test_state);
+    ps_cleanup();
+    assert_int_equal(test_state.completed, attempted);
+    assert_true(ps_init());
+
+    ps_destroy_socket(client);
+    ps_destroy_socket(listener);
+}
+
+#define SENDV_TEST_BODY_SIZE (512 * 1024)
+
+static void test_sendv_recvv(void **state) {
+    (void)state;
+
+    // TCP: a body much larger than the socket buffer forces partial writes in the middle of a slice.
+    ps_socket_t listener, client, server;
+    assert_int_equal(ps_create_socket_from_addr(&listener, PS_PROTOCOL_TCP, PS_ADDRESS_IPV4, "127.0.0.1", 8100), PS_SUCCESS);
+    assert_int_equal(ps_listen_socket(listener), PS_SUCCESS);
+    connect_pair(listener, 8100, &client, &server);
+
+    static char body[SENDV_TEST_BODY_SIZE];
+    for (size_t i = 0; i < sizeof(body); ++i) body[i] = (char)(i * 13);
+    static char received[SENDV_TEST_BODY_SIZE + 16];
+    stream_reader_t reader = {client, received, 0, sizeof(received)};
+    pthread_t thread;
+    pthread_create(&thread, NULL, stream_reader_thread, &reader);
+
+    ps_packet_t slices[3] = {
+        {6, "HEADER", 6},
+        {sizeof(body), body, sizeof(body)},
+        {10, "ENDTRAILER", 10},
+    };
+    assert_int_equal(ps_sendv(server, slices, 3, NULL), PS_SUCCESS);
+    pthread_join(thread, NULL);
+
+    assert_int_equal(reader.size, sizeof(received));
+    assert_memory_equal(received, "HEADER", 6);
+    assert_memory_equal(received + 6, body, sizeof(body));
+    assert_memory_equal(received + 6 + sizeof(body), "ENDTRAILER", 10);
+    assert_int_equal(ps_sendv(server, slices, 0, NULL), PS_ERROR_INVALID_ARGUMENT);
+
+    ps_destroy_socket(client);
+    ps_destroy_socket(server);
+    ps_destroy_socket(listener);
+
+    // UDP: the slices form one datagram, which a read spreads over slices again.
+    ps_socket_t receiver, sender;
+    assert_int_equal(ps_create_socket_from_addr(&receiver, PS_PROTOCOL_UDP, PS_ADDRESS_IPV4, "127.0.0.1", 8101), PS_SUCCESS);
+    assert_int_equal(ps_create_socket(&sender, PS_PROTOCOL_UDP, PS_ADDRESS_IPV4), PS_SUCCESS);
+    ps_endpoint_t to;
+    assert_int_equal(ps_endpoint_from_addr(&to, "127.0.0.1", 8101), PS_SUCCESS);
+
+    ps_packet_t datagram[2] = {{4, "HEAD", 4}, {7, "payload", 7}};
+    assert_int_equal(ps_sendv(sender, datagram, 2, &to), PS_SUCCESS);
+
+    char header[4], payload[32];
+    ps_packet_t parts[2] = {{0, header, sizeof(header)}, {0, payload, sizeof(payload)}};
+    size_t size = 0;
+    ps_endpoint_t from;
+    assert_int_equal(ps_recvv(receiver, parts, 2, &size, &from), PS_SUCCESS);
+    assert_int_equal(size, 11);
+    assert_int_equal(parts[0].size, 4);
+    assert_int_equal(parts[1].size, 7);
+    assert_memory_equal(header, "HEAD", 4);
+    assert_memory_equal(payload, "payload", 7);
+    assert_int_equal(from.family, PS_ADDRESS_IPV4);
+
+    // A datagram larger than all slices together is truncated.
+    assert_int_equal(ps_sendv(sender, datagram, 2, &to), PS_SUCCESS);
+    parts[1].capacity = 3;
+    assert_int_equal(ps_recvv(receiver, parts, 2, &size, NULL), PS_ERROR_MSGTOOLONG);
+    assert_int_equal(parts[1].size, 3);
+    assert_memory_equal(payload, "pay", 3);
+
+    ps_destroy_socket(sender);
+    ps_destroy_socket(receiver);
+}
+
+
+static void test_framed_socket(void **state) {
+    (void)state;
+
+    ps_socket_t listener, client, server;
+    assert_int_equal(ps_create_socket_from_addr(&listener, PS_PROTOCOL_TCP, PS_ADDRESS_IPV4, "127.0.0.1", 8102), PS_SUCCESS);
+    assert_int_equal(ps_listen_socket(listener), PS_SUCCESS);
+    connect_pair(listener, 8102, &client, &server);
+
+    // Varint prefixes: frames around the 1- and 2-byte boundaries and larger than the initial ring.
+    ps_framing_options_t options = {0};
+    options.framing = PS_FRAMING_VARINT;
+    options.initial_capacity = 64;
+    ps_framed_socket_t sender, receiver;
+    assert_int_equal(ps_create_framed_socket(&sender, client, &options), PS_SUCCESS);
+    assert_int_equal(ps_create_framed_socket(&receiver, server, &options), PS_SUCCESS);
+
+    static char payload[100000];
+    for (size_t i = 0; i < sizeof(payload); ++i) payload[i] = (char)(i * 31 + 7);
+    const size_t sizes[] = {0, 1, 127, 128, 300, 40, 40, 40, 5000, sizeof(payload), 3};
+    const size_t size_count = sizeof(sizes) / sizeof(sizes[0]);
+    for (size_t i = 0; i < size_count; ++i) {
+        ps_packet_t frame = {sizes[i], payload, sizes[i]};
+        assert_int_equal(ps_framed_send(sender, frame), PS_SUCCESS);
+    }
+    for (size_t i = 0; i < size_count; ++i) {
+        ps_packet_t frame = {0};
+        assert_int_equal(ps_framed_read(receiver, &frame), PS_SUCCESS);
+        assert_int_equal(frame.size, sizes[i]);
+        if (frame.size) assert_memory_equal(frame.buf, payload, frame.size);
+    }
+
+    // Nothing is buffered any more: a non-blocking read reports it.
+    ps_packet_t frame = {0};
+    assert_int_equal(ps_set_socket_blocking(server, false), PS_SUCCESS);
+    assert_int_equal(ps_framed_read(receiver, &frame), PS_ERROR_WOULDBLOCK);
+    assert_int_equal(ps_set_socket_blocking(server, true), PS_SUCCESS);
+    ps_destroy_framed_socket(sender);
+    ps_destroy_framed_socket(receiver);
+
+    // Fixed prefixes written in odd pieces: frames are split and coalesced, and wrap around a 64-byte ring.
+    options.framing = PS_FRAMING_FIXED32;
+    assert_int_equal(ps_create_framed_socket(&receiver, server, &options), PS_SUCCESS);
+    char stream[10 * 44];
+    for (size_t i = 0; i < 10; ++i) {
+        char *record = stream + i * 44;
+        memcpy(record, "\0\0\0\x28", 4);
+        memset(record + 4, 'a' + (int)i, 40);
+    }
+    for (size_t offset = 0; offset < sizeof(stream); offset += 7) {
+        size_t size = sizeof(stream) - offset < 7 ? sizeof(stream) - offset : 7;
+        ps_packet_t piece = {size, stream + offset, size};
+        assert_int_equal(ps_send_socket_packet(client, piece, NULL), PS_SUCCESS);
+    }
+    for (size_t i = 0; i < 10; ++i) {
+        assert_int_equal(ps_framed_read(receiver, &frame), PS_SUCCESS);
+        assert_int_equal(frame.size, 40);
+        assert_memory_equal(frame.buf, stream + i * 44 + 4, 40);
+    }
+
+    // A prefix above the size limit is refused.
+    ps_destroy_framed_socket(receiver);
+    options.max_frame_size = 16;
+    assert_int_equal(ps_create_framed_socket(&receiver, server, &options), PS_SUCCESS);
+    ps_packet_t oversized = {44, stream, 44};
+    assert_int_equal(ps_send_socket_packet(client, oversized, NULL), PS_SUCCESS);
+    assert_int_equal(ps_framed_read(receiver, &frame), PS_ERROR_MSGTOOLONG);
+    ps_destroy_framed_socket(receiver);
+
+    // Delimiters, also split across writes; the last frame is cut off by the peer closing.
+    ps_socket_t framed_client, framed_server;
+    connect_pair(listener, 8102, &framed_client, &framed_server);
+    options.framing = PS_FRAMING_DELIMITER;
+    options.delimiter = "\r\n";
+    options.delimiter_size = 2;
+    options.max_frame_size = 0;
+    assert_int_equal(ps_create_framed_socket(&receiver, framed_server, &options), PS_SUCCESS);
+    assert_int_equal(ps_create_framed_socket(&sender, framed_client, &options), PS_SUCCESS);
+    ps_packet_t line = {5, "hello", 5};
+    assert_int_equal(ps_framed_send(sender, line), PS_SUCCESS);
+    const char *pieces[] = {"a\rb\r", "\nsecond", " line\r", "\n\r\npartial"};
+    for (size_t i = 0; i < 4; ++i) {
+        ps_packet_t piece = {strlen(pieces[i]), (char *)pieces[i], strlen(pieces[i])};
+        assert_int_equal(ps_send_socket_packet(framed_client, piece, NULL), PS_SUCCESS);
+    }
+    const char *expected[] = {"hello", "a\rb", "second line", ""};
+    for (size_t i = 0; i < 4; ++i) {
+        assert_int_equal(ps_framed_read(receiver, &frame), PS_SUCCESS);
+        assert_int_equal(frame.size, strlen(expected[i]));
+        assert_memory_equal(frame.buf, expected[i], frame.size);
+    }
+    ps_destroy_framed_socket(sender);
+    ps_destroy_socket(framed_client);
+    assert_int_equal(ps_framed_read(receiver, &frame), PS_CONNCLOSED);
+    ps_destroy_framed_socket(receiver);
+
+    options.delimiter_size = 0;
+    assert_int_equal(ps_create_framed_socket(&receiver, framed_server, &options), PS_ERROR_INVALID_ARGUMENT);
+
+    ps_destroy_socket(client);
+    ps_destroy_socket(server);
+    ps_destroy_socket(framed_server);
+    ps_destroy_socket(listener);
+}
+
+static void buffered_stream_test_tick(ps_loop_t loop, void *user_data) {
+    (void)loop;
+    (*(int *)user_data)++;
+}
+
+// Reads exactly `size` bytes from a plain socket.
+static void read_exactly(ps_socket_t socket, char *buf, size_t size) {
+    size_t received = 0;
+    while (received < size) {
+        ps_packet_t packet = {0, buf + received, size - received};
+        assert_int_equal(ps_read_socket_packet(socket, &packet, NULL), PS_SUCCESS);
+        received += packet.size;
+    }
+}
+
+static void test_send_packet_nonblocking_full(void **state) {
+    (void)state;
+
+    ps_socket_t listener, client, server;
+    assert_int_equal(ps_create_socket_from_addr(&listener, PS_PROTOCOL_TCP, PS_ADDRESS_IPV4, "127.0.0.1", 0), PS_SUCCESS);
+    assert_int_equal(ps_listen_socket(listener), PS_SUCCESS);
+    ps_endpoint_t endpoint;
+    assert_int_equal(ps_get_socket_endpoint(listener, &endpoint), PS_SUCCESS);
+    connect_pair(listener, endpoint.port, &client, &server);
+    assert_int_equal(ps_set_socket_blocking(client, false), PS_SUCCESS);
+
+    // The peer does not read: sends must stop without waiting, and the one cut short is kept, not lost.
+    static char chunk[UNSENT_TEST_CHUNK];
+    size_t accepted = 0;
+    ps_result_t result;
+    while (1) {
+        for (size_t i = 0; i < sizeof(chunk); ++i) chunk[i] = (char)((accepted + i) % 251);
+        result = ps_send_socket_packet(client, (ps_packet_t){sizeof(chunk), chunk, sizeof(chunk)}, NULL);
+        if (result != PS_SUCCESS) break;
+        accepted += sizeof(chunk);
+        assert_true(accepted < 1024 * UNSENT_TEST_CHUNK);
+    }
+    assert_int_equal(result, PS_ERROR_WOULDBLOCK);
+    assert_true(ps_get_socket_unsent(client) > 0);
+    assert_int_equal(ps_flush_socket(client), PS_ERROR_WOULDBLOCK);
+
+    // Reading makes room; flushing then sends the kept bytes, after which sends go through again.
+    static char buf[UNSENT_TEST_CHUNK];
+    size_t received = 0;
+    while (received < accepted) {
+        ps_packet_t packet = {0, buf, sizeof(buf)};
+        assert_int_equal(ps_read_socket_packet(server, &packet, NULL), PS_SUCCESS);
+        for (size_t i = 0; i < packet.size; ++i) assert_int_equal(buf[i], (char)((received + i) % 251));
+        received += packet.size;
+        if (ps_get_socket_unsent(client)) {
+            result = ps_flush_socket(client);
+            assert_true(result == PS_SUCCESS || result == PS_ERROR_WOULDBLOCK);
+        }
+    }
+    assert_int_equal(received, accepted);
+    assert_int_equal(ps_get_socket_unsent(client), 0);
+    assert_int_equal(ps_flush_socket(client), PS_SUCCESS);
+    assert_int_equal(ps_send_socket_packet(client, (ps_packet_t){5, "hello", 5}, NULL), PS_SUCCESS);
+    read_exactly(server, buf, 5);
+    assert_memory_equal(buf, "hello", 5);
+
+    ps_destroy_socket(client);
+    ps_destroy_socket(server);
+    ps_destroy_socket(listener);
+}
+
+
+static void test_sendv_partial(void **state) {
+    (void)state;
+
+    ps_socket_t listener, client, server;
+    assert_int_equal(ps_create_socket_from_addr(&listener, PS_PROTOCOL_TCP, PS_ADDRESS_IPV4, "127.0.0.1", 0), PS_SUCCESS);
+    assert_int_equal(ps_listen_socket(listener), PS_SUCCESS);
+    ps_endpoint_t endpoint;
+    assert_int_equal(ps_get_socket_endpoint(listener, &endpoint), PS_SUCCESS);
+    connect_pair(listener, endpoint.port, &client, &server);
+    assert_int_equal(ps_set_socket_blocking(client, false), PS_SUCCESS);
+
+    // The peer does not read: the partial write reports its progress and keeps nothing back.
+    static char head[16], body[UNSENT_TEST_CHUNK];
+    memset(head, 'h', sizeof(head));
+    memset(body, 'b', sizeof(body));
+    ps_packet_t slices[2] = { {sizeof(head), head, sizeof(head)}, {sizeof(body), body, sizeof(body)} };
+    size_t total = 0, sent = 0;
+    ps_result_t result;
+    while ((result = ps_sendv_partial(client, slices, 2, &sent)) == PS_SUCCESS) {
+        assert_int_equal(sent, sizeof(head) + sizeof(body));
+        total += sent;
+        assert_true(total < 1024 * UNSENT_TEST_CHUNK);
+    }
+    assert_int_equal(result, PS_ERROR_WOULDBLOCK);
+    assert_true(sent < sizeof(head) + sizeof(body));
+    assert_int_equal(ps_get_socket_unsent(client), 0);
+    total += sent;
+
+    static char buf[UNSENT_TEST_CHUNK];
+    size_t received = 0;
+    while (received < total) {
+        ps_packet_t packet = {0, buf, sizeof(buf)};
+        assert_int_equal(ps_read_socket_packet(server, &packet, NULL), PS_SUCCESS);
+        received += packet.size;
+    }
+    assert_int_equal(received, total);
+
+    ps_destroy_socket(client);
+    ps_destroy_socket(server);
+    ps_destroy_socket(listener);
+}
+
+static void loop_send_test_done(ps_loop_t loop, ps_socket_t socket, ps_result_t result, ps_packet_t *packet, void *user_data) {
+    (void)loop; (void)socket; (void)packet;
+    assert_int_equal(result, PS_SUCCESS);
+    (*(int *)user_data)++;
+}
+
+static void run_loop_send_after_unsent(ps_loop_backend_t backend) {
+    ps_loop_options_t options = {0};
+    options.backend = backend;
+    ps_loop_t loop;
+    assert_int_equal(ps_create_loop_with_options(&loop, &options), PS_SUCCESS);
+
+    ps_socket_t listener, client, server;
+    assert_int_equal(ps_create_socket_from_addr(&listener, PS_PROTOCOL_TCP, PS_ADDRESS_IPV4, "127.0.0.1", 0), PS_SUCCESS);
+    assert_int_equal(ps_listen_socket(listener), PS_SUCCESS);
+    ps_endpoint_t endpoint;
+    assert_int_equal(ps_get_socket_endpoint(listener, &endpoint), PS_SUCCESS);
+    connect_pair(listener, endpoint.port, &client, &server);
+    assert_int_equal(ps_set_socket_blocking(client, false), PS_SUCCESS);
+
+    // Fill the socket until a send is cut short and its rest is kept.
+    static char chunk[UNSENT_TEST_CHUNK];
+    size_t accepted = 0;
+    ps_result_t result;
+    while (1) {
+        for (size_t i = 0; i < sizeof(chunk); ++i) chunk[i] = (char)((accepted + i) % 251);
+        result = ps_send_socket_packet(client, (ps_packet_t){sizeof(chunk), chunk, sizeof(chunk)}, NULL);
+        if (result != PS_SUCCESS) break;
+        accepted += sizeof(chunk);
+        assert_true(accepted < 1024 * UNSENT_TEST_CHUNK);
+    }
+    assert_int_equal(result, PS_ERROR_WOULDBLOCK);
+    assert_true(ps_get_socket_unsent(client) > 0);
+    assert_int_equal(ps_set_socket_blocking(server, false), PS_SUCCESS);
+
+    // The loop send must not overtake the kept bytes.
+    int done = 0;
+    ps_packet_t tail = {4, "tail", 4};
+    assert_int_equal(ps_loop_send_socket_packet(loop, client, &tail, loop_send_test_done, &done), PS_SUCCESS);
+
+    static char buf[UNSENT_TEST_CHUNK];
+    size_t received = 0;
+    while (received < accepted) {
+        assert_int_equal(ps_loop_run_once(loop, 10), PS_SUCCESS);
+        ps_packet_t packet = {0, buf, sizeof(buf)};
+        if (accepted - received < packet.capacity) packet.capacity = accepted - received;
+        result = ps_read_socket_packet(server, &packet, NULL);
+        if (result == PS_ERROR_WOULDBLOCK) continue;
+        assert_int_equal(result, PS_SUCCESS);
+        for (size_t i = 0; i < packet.size; ++i) assert_int_equal(buf[i], (char)((received + i) % 251));
+        received += packet.size;
+    }
+    for (int i = 0; i < 100 && !done; ++i) assert_int_equal(ps_loop_run_once(loop, 10), PS_SUCCESS);
+    assert_int_equal(done, 1);
+    assert_int_equal(ps_get_socket_unsent(client), 0);
+    assert_int_equal(ps_set_socket_blocking(server, true), PS_SUCCESS);
+    read_exactly(server, buf, 4);
+    assert_memory_equal(buf, "tail", 4);
+
+    ps_destroy_socket(client);
+    ps_destroy_socket(server);
+    ps_destroy_socket(listener);
+    ps_loop_run_once(loop, 0);
+    ps_destroy_loop(loop);
+}
+
+static void test_loop_send_after_unsent_epoll(void **state) {
+    (void)state;
+    run_loop_send_after_unsent(PS_LOOP_BACKEND_EPOLL);
+}
+
+static void test_loop_send_after_unsent_auto(void **state) {
+    (void)state;
+    run_loop_send_after_unsent(PS_LOOP_BACKEND_AUTO);
+}
+
+static void test_buffered_stream(void **state) {
+    (void)state;
+
+    ps_socket_t listener, client, server;
+    assert_int_equal(ps_create_socket_from_addr(&listener, PS_PROTOCOL_TCP, PS_ADDRESS_IPV4, "127.0.0.1", 8103), PS_SUCCESS);
+    assert_int_equal(ps_listen_socket(listener), PS_SUCCESS);
+    connect_pair(listener, 8103, &client, &server);
+
+    ps_buffered_stream_options_t options = {0};
+    options.read_buffer_size = 16;
+    options.write_buffer_size = 64;
+    ps_buffered_stream_t writer, reader;
+    assert_int_equal(ps_create_buffered_stream(&writer, client, &options), PS_SUCCESS);
+    assert_int_equal(ps_create_buffered_stream(&reader, server, &options), PS_SUCCESS);
+
+    // Tiny writes collect in the buffer until one no longer fits and is sent along with them.
+    char expected[20 * 5 + 1000];
+    for (int i = 0; i < 20; ++i) {
+        ps_packet_t message = {5, expected + i * 5, 5};
+        snprintf(message.buf, 6, "msg%02d", i);
+        assert_int_equal(ps_buffered_stream_write(writer, message), PS_SUCCESS);
+        assert_true(ps_buffered_stream_pending(writer) <= 64);
+    }
+    assert_int_equal(ps_buffered_stream_pending(writer), 100 - 65);
+
+    // A write larger than the buffer leaves together with what is buffered.
+    memset(expected + 100, 'L', 1000);
+    ps_packet_t large = {1000, expected + 100, 1000};
+    assert_int_equal(ps_buffered_stream_write(writer, large), PS_SUCCESS);
+    assert_int_equal(ps_buffered_stream_pending(writer), 0);
+
+    // Small reads are served from the read-ahead buffer, large ones bypass it.
+    char received[sizeof(expected)];
+    size_t size = 0;
+    while (size < 50) {
+        ps_packet_t packet = {0, received + size, 3};
+        assert_int_equal(ps_buffered_stream_read(reader, &packet), PS_SUCCESS);
+        assert_true(packet.size > 0 && packet.size <= 3);
+        size += packet.size;
+    }
+    while (size < sizeof(expected)) {
+        ps_packet_t packet = {0, received + size, sizeof(received) - size};
+        assert_int_equal(ps_buffered_stream_read(reader, &packet), PS_SUCCESS);
+        size += packet.size;
+    }
+    assert_memory_equal(received, expected, sizeof(expected));
+
+    // A read that has to wait flushes pending writes first, so a request is not stuck behind its response.
+    ps_packet_t request = {4, "ping", 4};
+    assert_int_equal(ps_buffered_stream_write(writer, request), PS_SUCCESS);
+    assert_int_equal(ps_buffered_stream_pending(writer), 4);
+    assert_int_equal(ps_set_socket_blocking(client, false), PS_SUCCESS);
+    char buf[16];
+    ps_packet_t response = {0, buf, sizeof(buf)};
+    assert_int_equal(ps_buffered_stream_read(writer, &response), PS_ERROR_WOULDBLOCK);
+    assert_int_equal(ps_buffered_stream_pending(writer), 0);
+    read_exactly(server, buf, 4);
+    assert_memory_equal(buf, "ping", 4);
+    ps_destroy_buffered_stream(writer);
+
+    // With a loop, every iteration flushes.
+    ps_loop_t loop;
+    assert_int_equal(ps_create_loop(&loop), PS_SUCCESS);
+    int ticks = 0;
+    assert_int_equal(ps_loop_add_tick(loop, buffered_stream_test_tick, &ticks), PS_SUCCESS);
+    ps_loop_callbacks_t callbacks = {0};
+    assert_int_equal(ps_loop_add_socket(loop, client, callbacks), PS_SUCCESS);
+    options.loop = loop;
+    assert_int_equal(ps_create_buffered_stream(&writer, client, &options), PS_SUCCESS);
+
+    ps_packet_t hello = {5, "hello", 5};
+    assert_int_equal(ps_buffered_stream_write(writer, hello), PS_SUCCESS);
+    assert_int_equal(ps_buffered_stream_pending(writer), 5);
+    assert_int_equal(ps_loop_run_once(loop, 0), PS_SUCCESS);
+    assert_int_equal(ps_buffered_stream_pending(writer), 0);
+    assert_int_equal(ticks, 1);
+    read_exactly(server, buf, 5);
+    assert_memory_equal(buf, "hello", 5);
+
+    assert_int_equal(ps_loop_remove_tick(loop, buffered_stream_test_tick, &ticks), PS_SUCCESS);
+    assert_int_equal(ps_loop_remove_tick(loop, buffered_stream_test_tick, &ticks), PS_ERROR_INVALID_ARGUMENT);
+    assert_int_equal(ps_loop_run_once(loop, 0), PS_SUCCESS);
+    assert_int_equal(ticks, 1);
+
+    ps_destroy_buffered_stream(writer);
+    ps_destroy_buffered_stream(reader);
+    assert_int_equal(ps_loop_remove_socket(loop, client), PS_SUCCESS);
+    ps_destroy_loop(loop);
+
+    ps_destroy_socket(client);
+    ps_destroy_socket(server);
+    ps_destroy_socket(listener);
+}
+
+static void test_buffered_stream_nonblocking_full(void **state) {
+    (void)state;
+
+    ps_socket_t listener, client, server;
+    assert_int_equal(ps_create_socket_from_addr(&listener, PS_PROTOCOL_TCP, PS_ADDRESS_IPV4, "127.0.0.1", 0), PS_SUCCESS);
+    assert_int_equal(ps_listen_socket(listener), PS_SUCCESS);
+    ps_endpoint_t endpoint;
+    assert_int_equal(ps_get_socket_endpoint(listener, &endpoint), PS_SUCCESS);
+    connect_pair(listener, endpoint.port, &client, &server);
+    assert_int_equal(ps_set_socket_blocking(client, false), PS_SUCCESS);
+
+    ps_buffered_stream_options_t options = {0};
+    options.write_buffer_size = 64 * 1024;
+    ps_buffered_stream_t writer;
+    assert_int_equal(ps_create_buffered_stream(&writer, client, &options), PS_SUCCESS);
+
+    // The peer does not read: writes stop without waiting and what the socket does not take stays buffered.
+    static char chunk[5000];
+    size_t accepted = 0;
+    ps_result_t result;
+    while (1) {
+        for (size_t i = 0; i < sizeof(chunk); ++i) chunk[i] = (char)((accepted + i) % 251);
+        result = ps_buffered_stream_write(writer, (ps_packet_t){sizeof(chunk), chunk, sizeof(chunk)});
+        if (result != PS_SUCCESS) break;
+        accepted += sizeof(chunk);
+        assert_true(accepted < 1024 * UNSENT_TEST_CHUNK);
+    }
+    assert_int_equal(result, PS_ERROR_WOULDBLOCK);
+    assert_true(ps_buffered_stream_pending(writer) > 0);
+    assert_int_equal(ps_buffered_stream_flush(writer), PS_ERROR_WOULDBLOCK);
+
+    static char buf[UNSENT_TEST_CHUNK];
+    size_t received = 0;
+    while (received < accepted) {
+        ps_packet_t packet = {0, buf, sizeof(buf)};
+        assert_int_equal(ps_read_socket_packet(server, &packet, NULL), PS_SUCCESS);
+        for (size_t i = 0; i < packet.size; ++i) assert_int_equal(buf[i], (char)((received + i) % 251));
+        received += packet.size;
+        result = ps_buffered_stream_flush(writer);
+        assert_true(result == PS_SUCCESS || result == PS_ERROR_WOULDBLOCK);
+    }
+    assert_int_equal(received, accepted);
+    assert_int_equal(ps_buffered_stream_pending(writer), 0);
+
+    ps_destroy_buffered_stream(writer);
+    ps_destroy_socket(client);
+    ps_destroy_socket(server);
+    ps_destroy_socket(listener);
+}
+
+#define SERVER_TEST_WORKERS 4
+#define SERVER_TEST_CONNECTIONS 64
+
+typedef struct {
+    ps_server_t server;
+    atomic_int accepted[SERVER_TEST_WORKERS];
+} server_test_state_t;
+
+static void server_test_on_accept(ps_loop_t loop, ps_socket_t socket, ps_socket_t client, void *user_data) {
+    (void)socket;
+    server_test_state_t *state = (server_test_state_t *)user_data;
+    for (size_t i = 0; i < SERVER_TEST_WORKERS; ++i) {
+        if (ps_server_get_loop(state->server, i) == loop) atomic_fetch_add(&state->accepted[i], 1);
+    }
+    ps_destroy_socket(client);
+}
+
+static void test_server_reuseport_workers(void **state) {
+    (void)state;
+
+    server_test_state_t test_state = {0};
+    ps_server_options_t options = {0};
+    options.workers = SERVER_TEST_WORKERS;
+    options.backlog = 256;
+    options.pin_workers = true;
+    options.on_accept = server_test_on_accept;
+    options.user_data = &test_state;
+    assert_int_equal(ps_create_server(&test_state.server, PS_ADDRESS_IPV4, "127.0.0.1", 0, &options), PS_SUCCESS);
+    assert_int_equal(ps_server_get_worker_count(test_state.server), SERVER_TEST_WORKERS);
+    ps_port_t port = ps_server_get_port(test_state.server);
+    assert_true(port != 0);
+
+    // Connections made before the start wait in the listeners' backlogs.
+    ps_socket_t early;
+    assert_int_equal(ps_create_socket(&early, PS_PROTOCOL_TCP, PS_ADDRESS_IPV4), PS_SUCCESS);
+    assert_int_equal(ps_connect_socket(early, "127.0.0.1", port), PS_SUCCESS);
+    ps_destroy_socket(early);
+    assert_int_equal(ps_server_start(test_state.server), PS_SUCCESS);
+
+    for (int i = 1; i < SERVER_TEST_CONNECTIONS; ++i) {
+        ps_socket_t client;
+        assert_int_equal(ps_create_socket(&client, PS_PROTOCOL_TCP, PS_ADDRESS_IPV4), PS_SUCCESS);
+        assert_int_equal(ps_connect_socket(client, "127.0.0.1", port), PS_SUCCESS);
+        ps_destroy_socket(client);
+    }
+
+    int total = 0;
+    int busy_workers = 0;
+    for (int attempt = 0; attempt < 1000 && total < SERVER_TEST_CONNECTIONS; ++attempt) {
+        usleep(1000);
+        total = 0;
+        busy_workers = 0;
+        for (size_t i = 0; i < SERVER_TEST_WORKERS; ++i) {
+            int accepted = atomic_load(&test_state.accepted[i]);
+            total += accepted;
+            busy_workers += accepted > 0;
+        }
+    }
+    assert_int_equal(total, SERVER_TEST_CONNECTIONS);
+    // The kernel hashes connections over the listeners; 64 landing on one of four is practically impossible.
+    assert_true(busy_workers > 1);
+
+    assert_int_equal(ps_server_stop(test_state.server), PS_SUCCESS);
+    ps_destroy_server(test_state.server);
+
+    // Without the option, a second listener cannot take the port.
+    ps_socket_t first, second;
+    assert_int_equal(ps_create_socket(&first, PS_PROTOCOL_TCP, PS_ADDRESS_IPV4), PS_SUCCESS);
+    assert_int_equal(ps_create_socket(&second, PS_PROTOCOL_TCP, PS_ADDRESS_IPV4), PS_SUCCESS);
+    assert_int_equal(ps_bind_socket(first, "127.0.0.1", 0), PS_SUCCESS);
+    ps_endpoint_t endpoint;
+    assert_int_equal(ps_get_socket_endpoint(first, &endpoint), PS_SUCCESS);
+    assert_int_equal(ps_listen_socket_backlog(first, 1), PS_SUCCESS);
+    assert_int_equal(ps_bind_socket(second, "127.0.0.1", endpoint.port), PS_ERROR_ADDRINUSE);
+    ps_destroy_socket(first);
+    ps_destroy_socket(second);
+}
+
+#define EXECUTOR_TEST_TASKS 1000
+#define EXECUTOR_TEST_FANOUT 8
+
+typedef struct {
+    ps_executor_t executor;
+    atomic_int ran;
+    atomic_int failures;
+    pthread_t loop_thread;
+    ps_socket_t socket;
+    int replies;
+    bool wrong_thread;
+} executor_test_state_t;
+
+typedef struct {
+    executor_test_state_t *test;
+    ps_loop_t loop;
+    uint32_t value;
+} executor_test_job_t;
+
+static void executor_test_leaf(void *user_data) {
+    executor_test_state_t *test = (executor_test_state_t *)user_data;
+    atomic_fetch_add(&test->ran, 1);
+}
+
+// Tasks submitted from a task go to the worker's own deque, from which idle workers steal.
+static void executor_test_fanout(void *user_data) {
+    executor_test_state_t *test = (executor_test_state_t *)user_data;
+    for (int i = 0; i < EXECUTOR_TEST_FANOUT; ++i) {
+        if (ps_executor_submit(test->executor, executor_test_leaf, test) != PS_SUCCESS) atomic_fetch_add(&test->failures, 1);
+    }
+    atomic_fetch_add(&test->ran, 1);
+}
+
+static void executor_test_reply(void *user_data) {
+    executor_test_job_t *job = (executor_test_job_t *)user_data;
+    executor_test_state_t *test = job->test;
+    if (!pthread_equal(pthread_self(), test->loop_thread)) test->wrong_thread = true;
+
+    ps_packet_t reply = {sizeof(job->value), (char *)&job->value, sizeof(job->value)};
+    if (ps_send_socket_packet(test->socket, reply, NULL) != PS_SUCCESS) test->wrong_thread = true;
+    test->replies++;
+}
+
+static void executor_test_handle(void *user_data) {
+    executor_test_job_t *job = (executor_test_job_t *)user_data;
+    job->value = job->value * job->value;
+    if (ps_loop_post(job->loop, executor_test_reply, job) != PS_SUCCESS) atomic_fetch_add(&job->test->failures, 1);
+}
+
+static void test_executor(void **state) {
+    (void)state;
+
+    executor_test_state_t test = {0};
+    ps_executor_options_t options = {0};
+    options.workers = 4;
+    options.queue_capacity = 16;
+    assert_int_equal(ps_create_executor(&test.executor, &options), PS_SUCCESS);
+    assert_int_equal(ps_executor_get_worker_count(test.executor), 4);
+
+    // The shared queue pushes back once full; tasks fanned out from workers are not bounded by it.
+    int submitted = 0;
+    while (submitted < EXECUTOR_TEST_TASKS) {
+        ps_result_t result = ps_executor_submit(test.executor, executor_test_fanout, &test);
+        if (result == PS_ERROR_WOULDBLOCK) {
+            usleep(100);
+            continue;
+        }
+        assert_int_equal(result, PS_SUCCESS);
+        submitted++;
+    }
+
+    // Handlers run on the executor and post their replies back to the loop that owns the connection.
+    ps_socket_t listener, client;
+    assert_int_equal(ps_create_socket_from_addr(&listener, PS_PROTOCOL_TCP, PS_ADDRESS_IPV4, "127.0.0.1", 0), PS_SUCCESS);
+    assert_int_equal(ps_listen_socket(listener), PS_SUCCESS);
+    ps_endpoint_t endpoint;
+    assert_int_equal(ps_get_socket_endpoint(listener, &endpoint), PS_SUCCESS);
+    connect_pair(listener, endpoint.port, &client, &test.socket);
+
+    ps_loop_t loop;
+    assert_int_equal(ps_create_loop(&loop), PS_SUCCESS);
+    assert_null(ps_socket_get_loop(test.socket));
+    assert_int_equal(ps_loop_add_socket(loop, test.socket, (ps_loop_callbacks_t){0}), PS_SUCCESS);
+    assert_ptr_equal(ps_socket_get_loop(test.socket), loop);
+    test.loop_thread = pthread_self();
+
+    static executor_test_job_t jobs[EXECUTOR_TEST_TASKS];
+    uint32_t expected = 0;
+    for (int i = 0; i < EXECUTOR_TEST_TASKS; ++i) {
+        jobs[i] = (executor_test_job_t){&test, ps_socket_get_loop(test.socket), (uint32_t)i};
+        expected += (uint32_t)(i * i);
+        while (ps_executor_submit(test.executor, executor_test_handle, &jobs[i]) == PS_ERROR_WOULDBLOCK) {
+            ps_loop_run_once(loop, 0);
+        }
+    }
+    for (int attempt = 0; attempt < 1000 && test.replies < EXECUTOR_TEST_TASKS; ++attempt) {
+        assert_int_equal(ps_loop_run_once(loop, 100), PS_SUCCESS);
+    }
+    assert_int_equal(test.replies, EXECUTOR_TEST_TASKS);
+    assert_false(test.wrong_thread);
+
+    static uint32_t replies[EXECUTOR_TEST_TASKS];
+    read_exactly(client, (char *)replies, sizeof(replies));
+    uint32_t sum = 0;
+    for (int i = 0; i < EXECUTOR_TEST_TASKS; ++i) sum += replies[i];
+    assert_int_equal(sum, expected);
+
+    // Destroying runs whatever is still queued.
+    for (int i = 0; i < EXECUTOR_TEST_FANOUT; ++i) {
+        assert_int_equal(ps_executor_submit(test.executor, executor_test_fanout, &test), PS_SUCCESS);
+    }
+    ps_destroy_executor(test.executor);
+    assert_int_equal(atomic_load(&test.ran), (EXECUTOR_TEST_TASKS + EXECUTOR_TEST_FANOUT) * (EXECUTOR_TEST_FANOUT + 1));
+    assert_int_equal(atomic_load(&test.failures), 0);
+
+    // Posts still queued when the loop is destroyed are dropped.
+    assert_int_equal(ps_loop_post(loop, executor_test_leaf, &test), PS_SUCCESS);
+    ps_destroy_socket(client);
+    ps_destroy_socket(test.socket);
+    ps_destroy_socket(listener);
+    ps_destroy_loop(loop);
+    assert_int_equal(atomic_load(&test.ran), (EXECUTOR_TEST_TASKS + EXECUTOR_TEST_FANOUT) * (EXECUTOR_TEST_FANOUT + 1));
+}
+
+#define TIMER_TEST_COUNT 6
+#define TIMER_TEST_MANY 1000
+
+typedef struct {
+    ps_timer_t timer;
+    int index;
+    uint64_t started;
+    uint64_t timeout;
+    uint64_t fired;
+    int repeats;
+    int *order;
+    int *fired_count;
+} timer_test_t;
+
+static void timer_test_expired(ps_loop_t loop, ps_timer_t *timer, void *user_data) {
+    timer_test_t *test = (timer_test_t *)user_data;
+    test->fired = ps_loop_now(loop);
+    test->order[(*test->fired_count)++] = test->index;
+    if (test->repeats > 0) {
+        test->repeats--;
+        test->started = ps_loop_now(loop);
+        ps_loop_start_timer(loop, timer, test->timeout);
+    }
+}
+
+static void *loop_run_thread(void *arg) {
+    return (void *)(intptr_t)ps_loop_run((ps_loop_t)arg);
+}
+
+static void test_loop_stop(void **state) {
+    (void)state;
+
+    ps_loop_t loop;
+    assert_int_equal(ps_create_loop(&loop), PS_SUCCESS);
+
+    // A stop issued before the loop runs is not lost, and it is used up by that run.
+    ps_loop_stop(loop);
+    assert_int_equal(ps_loop_run(loop), PS_SUCCESS);
+
+    // Stopping from another thread wakes a loop that waits for events.
+    pthread_t thread;
+    pthread_create(&thread, NULL, loop_run_thread, loop);
+    usleep(20 * 1000);
+    ps_loop_stop(loop);
+    void *result;
+    pthread_join(thread, &result);
+    assert_int_equal((ps_result_t)(intptr_t)result, PS_SUCCESS);
+
+    ps_destroy_loop(loop);
+}
+
+static void test_loop_timers(void **state) {
+    (void)state;
+
+    ps_loop_t loop;
+    assert_int_equal(ps_create_loop(&loop), PS_SUCCESS);
+
+    // Timeouts around the first level's 64 ms span, so the later ones cascade down before they expire.
+    static const uint64_t timeouts[TIMER_TEST_COUNT + 2] = { 0, 5, 63, 64, 100, 250, 20, 10ull * 24 * 3600 * 1000 };
+    timer_test_t timers[TIMER_TEST_COUNT + 2];
+    int order[16];
+    int fired_count = 0;
+    for (int i = 0; i < TIMER_TEST_COUNT + 2; ++i) {
+        timers[i] = (timer_test_t){0};
+        ps_timer_init(&timers[i].timer, timer_test_expired, &timers[i]);
+        assert_false(ps_timer_is_active(&timers[i].timer));
+        timers[i].index = i;
+        timers[i].order = order;
+        timers[i].fired_count = &fired_count;
+        timers[i].timeout = timeouts[i];
+    }
+    // Started in reverse so the wheel, not insertion order, decides what runs first.
+    for (int i = TIMER_TEST_COUNT + 1; i >= 0; --i) {
+        timers[i].started = ps_loop_now(loop);
+        assert_int_equal(ps_loop_start_timer(loop, &timers[i].timer, timers[i].timeout), PS_SUCCESS);
+        assert_true(ps_timer_is_active(&timers[i].timer));
+    }
+    // The 5 ms timer re-arms itself twice from its callback.
+    timers[1].repeats = 2;
+
+    // A stopped timer never runs.
+    timer_test_t *stopped = &timers[TIMER_TEST_COUNT];
+    timer_test_t *far = &timers[TIMER_TEST_COUNT + 1];
+    ps_loop_stop_timer(loop, &stopped->timer);
+    assert_false(ps_timer_is_active(&stopped->timer));
+    ps_loop_stop_timer(loop, &stopped->timer);
+
+    // Waiting indefinitely still wakes up for every timer.
+    for (int attempt = 0; attempt < 100 && fired_count < TIMER_TEST_COUNT + 2; ++attempt) {
+        assert_int_equal(ps_loop_run_once(loop, -1), PS_SUCCESS);
+    }
+    assert_int_equal(fired_count, TIMER_TEST_COUNT + 2);
+    static const int expected_order[TIMER_TEST_COUNT + 2] = { 0, 1, 1, 1, 2, 3, 4, 5 };
+    assert_memory_equal(order, expected_order, sizeof(expected_order));
+    for (int i = 0; i < TIMER_TEST_COUNT; ++i) {
+        assert_true(timers[i].fired >= timers[i].started + timers[i].timeout);
+        assert_true(timers[i].fired < timers[i].started + timers[i].timeout + 50);
+        assert_false(ps_timer_is_active(&timers[i].timer));
+    }
+    assert_int_equal(stopped->fired, 0);
+    assert_true(ps_timer_is_active(&far->timer));
+
+    // A timer days away does not shorten the wait.
+    uint64_t before = ps_loop_now(loop);
+    assert_int_equal(ps_loop_run_once(loop, 30), PS_SUCCESS);
+    assert_true(ps_loop_now(loop) >= before + 25);
+    assert_int_equal(fired_count, TIMER_TEST_COUNT + 2);
+
+    // Restarting replaces the earlier expiry.
+    assert_int_equal(ps_loop_start_timer(loop, &far->timer, 1), PS_SUCCESS);
+    for (int attempt = 0; attempt < 100 && fired_count < TIMER_TEST_COUNT + 3; ++attempt) {
+        assert_int_equal(ps_loop_run_once(loop, 100), PS_SUCCESS);
+    }
+    assert_int_equal(fired_count, TIMER_TEST_COUNT + 3);
+    assert_int_equal(order[TIMER_TEST_COUNT + 2], TIMER_TEST_COUNT + 1);
+    assert_false(ps_timer_is_active(&far->timer));
+
+    // Many timers spread over several levels, some stopped again: each expires once, never early.
+    static timer_test_t many[TIMER_TEST_MANY];
+    static int many_order[TIMER_TEST_MANY];
+    int many_fired = 0;
+    srand(42);
+    for (int i = 0; i < TIMER_TEST_MANY; ++i) {
+        many[i] = (timer_test_t){0};
+        ps_timer_init(&many[i].timer, timer_test_expired, &many[i]);
+        many[i].index = i;
+        many[i].order = many_order;
+        many[i].fired_count = &many_fired;
+        many[i].timeout = (uint64_t)(rand() % 200);
+        many[i].started = ps_loop_now(loop);
+        assert_int_equal(ps_loop_start_timer(loop, &many[i].timer, many[i].timeout), PS_SUCCESS);
+    }
+    for (int i = 0; i < TIMER_TEST_MANY; i += 3) ps_loop_stop_timer(loop, &many[i].timer);
+    int expected_fired = TIMER_TEST_MANY - (TIMER_TEST_MANY + 2) / 3;
+    for (int attempt = 0; attempt < 1000 && many_fired < expected_fired; ++attempt) {
+        assert_int_equal(ps_loop_run_once(loop, -1), PS_SUCCESS);
+    }
+    assert_int_equal(many_fired, expected_fired);
+    for (int i = 0; i < TIMER_TEST_MANY; ++i) {
+        if (i % 3 == 0) {
+            assert_int_equal(many[i].fired, 0);
+        } else {
+            assert_true(many[i].fired >= many[i].started + many[i].timeout);
+        }
+    }
+
+    ps_destroy_loop(loop);
+}
+
+static void test_socket_timeouts(void **state) {
+    (void)state;
+
+    ps_socket_t listener, client, server;
+    assert_int_equal(ps_create_socket_from_addr(&listener, PS_PROTOCOL_TCP, PS_ADDRESS_IPV4, "127.0.0.1", 0), PS_SUCCESS);
+    assert_int_equal(ps_listen_socket_backlog(listener, 1), PS_SUCCESS);
+    ps_endpoint_t endpoint;
+    assert_int_equal(ps_get_socket_endpoint(listener, &endpoint), PS_SUCCESS);
+    connect_pair(listener, endpoint.port, &client, &server);
+
+    // A read with nothing to receive gives up after the read timeout.
+    ps_socket_timeouts_t timeouts = {0};
+    timeouts.read_ms = 50;
+    timeouts.write_ms = 50;
+    assert_int_equal(ps_set_socket_timeouts(server, &timeouts), PS_SUCCESS);
+    char buf[64];
+    ps_packet_t packet = {0, buf, sizeof(buf)};
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    assert_int_equal(ps_read_socket_packet(server, &packet, NULL), PS_ERROR_TIMEOUT);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    long elapsed_ms = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000;
+    assert_true(elapsed_ms >= 40);
+
+    // A send into a peer that does not read gives up once its buffers stay full for the write timeout.
+    size_t large_size = 16 * 1024 * 1024;
+    char *large = calloc(1, large_size);
+    ps_packet_t flood = {large_size, large, large_size};
+    assert_int_equal(ps_send_socket_packet(server, flood, NULL), PS_ERROR_TIMEOUT);
+    free(large);
+
+    // Timeouts leave non-blocking sockets alone.
+    assert_int_equal(ps_set_socket_blocking(server, false), PS_SUCCESS);
+    assert_int_equal(ps_read_socket_packet(server, &packet, NULL), PS_ERROR_WOULDBLOCK);
+
+    ps_destroy_socket(client);
+    ps_destroy_socket(server);
+
+    // With the accept queue full the listener drops handshakes, so a connect only ends with its timeout.
+    ps_socket_t pending[8];
+    int connected = 0;
+    ps_result_t result = PS_SUCCESS;
+    timeouts = (ps_socket_timeouts_t){0};
+    timeouts.connect_ms = 100;
+    while (connected < 8 && result == PS_SUCCESS) {
+        assert_int_equal(ps_create_socket(&pending[connected], PS_PROTOCOL_TCP, PS_ADDRESS_IPV4), PS_SUCCESS);
+        assert_int_equal(ps_set_socket_timeouts(pending[connected], &timeouts), PS_SUCCESS);
+        result = ps_connect_socket(pending[connected], "127.0.0.1", endpoint.port);
+        connected++;
+    }
+    assert_int_equal(result, PS_ERROR_TIMEOUT);
+    for (int i = 0; i < connected; ++i) ps_destroy_socket(pending[i]);
+    ps_destroy_socket(listener);
+}
+
+typedef struct {
+    int closed;
+} heartbeat_test_state_t;
+
+static void heartbeat_test_on_close(ps_loop_t loop, ps_socket_t socket, void *user_data) {
+    (void)loop; (void)socket;
+    ((heartbeat_test_state_t *)user_data)->closed++;
+}
+
+static void heartbeat_test_on_read(ps_loop_t loop, ps_socket_t socket, void *user_data) {
+    (void)loop; (void)user_data;
+    char buf[64];
+    ps_packet_t packet = {0, buf, sizeof(buf)};
+    while (ps_read_socket_packet(socket, &packet, NULL) == PS_SUCCESS) {}
+}
+
+static void test_loop_heartbeat(void **state) {
+    (void)state;
+
+    ps_socket_t listener, client, server;
+    assert_int_equal(ps_create_socket_from_addr(&listener, PS_PROTOCOL_TCP, PS_ADDRESS_IPV4, "127.0.0.1", 0), PS_SUCCESS);
+    assert_int_equal(ps_listen_socket(listener), PS_SUCCESS);
+    ps_endpoint_t endpoint;
+    assert_int_equal(ps_get_socket_endpoint(listener, &endpoint), PS_SUCCESS);
+    connect_pair(listener, endpoint.port, &client, &server);
+
+    ps_loop_t loop;
+    assert_int_equal(ps_create_loop(&loop), PS_SUCCESS);
+    heartbeat_test_state_t test_state = {0};
+    ps_heartbeat_options_t options = {0};
+    options.interval_ms = 30;
+    options.max_missed = 2;
+    options.message = (ps_packet_t){4, "ping", 4};
+    assert_int_equal(ps_loop_set_socket_heartbeat(loop, server, &options), PS_ERROR_INVALID_ARGUMENT);
+
+    ps_loop_callbacks_t callbacks = {0};
+    callbacks.on_read = heartbeat_test_on_read;
+    callbacks.on_close = heartbeat_test_on_close;
+    callbacks.user_data = &test_state;
+    assert_int_equal(ps_loop_add_socket(loop, server, callbacks), PS_SUCCESS);
+    assert_int_equal(ps_loop_set_socket_heartbeat(loop, server, &options), PS_SUCCESS);
+
+    // A peer that keeps talking is never pinged or closed.
+    uint64_t start = ps_loop_now(loop);
+    while (ps_loop_now(loop) < start + 150) {
+        ps_packet_t chatter = {1, "x", 1};
+        assert_int_equal(ps_send_socket_packet(client, chatter, NULL), PS_SUCCESS);
+        assert_int_equal(ps_loop_run_once(loop, 10), PS_SUCCESS);
+    }
+    assert_int_equal(test_state.closed, 0);
+    assert_int_equal(ps_set_socket_blocking(client, false), PS_SUCCESS);
+    char buf[64];
+    ps_packet_t packet = {0, buf, sizeof(buf)};
+    assert_int_equal(ps_read_socket_packet(client, &packet, NULL), PS_ERROR_WOULDBLOCK);
+
+    // A silent peer gets its two heartbeats, then is closed after one more quiet interval.
+    start = ps_loop_now(loop);
+    for (int attempt = 0; attempt < 100 && !test_state.closed; ++attempt) {
+        assert_int_equal(ps_loop_run_once(loop, -1), PS_SUCCESS);
+    }
+    assert_int_equal(test_state.closed, 1);
+    assert_true(ps_loop_now(loop) >= start + 3 * options.interval_ms);
+    assert_null(ps_socket_get_loop(server));
+    assert_int_equal(ps_set_socket_blocking(client, true), PS_SUCCESS);
+    read_exactly(client, buf, 8);
+    assert_memory_equal(buf, "pingping", 8);
+
+    // A peer that stopped reading fills the socket buffer: heartbeats are skipped rather than waited on.
+    ps_socket_t full_client, full_server;
+    connect_pair(listener, endpoint.port, &full_client, &full_server);
+    assert_int_equal(ps_loop_add_socket(loop, full_server, callbacks), PS_SUCCESS);
+    static char filler[64 * 1024];
+    size_t filled = 0;
+    while (ps_send_socket_packet(full_server, (ps_packet_t){sizeof(filler), filler, sizeof(filler)}, NULL) == PS_SUCCESS) {
+        filled += sizeof(filler);
+        assert_true(filled < 1024 * sizeof(filler));
+    }
+    assert_int_equal(ps_loop_set_socket_heartbeat(loop, full_server, &options), PS_SUCCESS);
+    for (int attempt = 0; attempt < 100 && test_state.closed < 2; ++attempt) {
+        assert_int_equal(ps_loop_run_once(loop, -1), PS_SUCCESS);
+    }
+    assert_int_equal(test_state.closed, 2);
+
+    // Without a message and with no misses allowed, the heartbeat is a plain idle timeout.
+    ps_socket_t idle_client, idle_server;
+    connect_pair(listener, endpoint.port, &idle_client, &idle_server);
+    assert_int_equal(ps_loop_add_socket(loop, idle_server, callbacks), PS_SUCCESS);
+    ps_heartbeat_options_t idle = {0};
+    idle.interval_ms = 20;
+    assert_int_equal(ps_loop_set_socket_heartbeat(loop, idle_server, &idle), PS_SUCCESS);
+    for (int attempt = 0; attempt < 100 && test_state.closed < 3; ++attempt) {
+        assert_int_equal(ps_loop_run_once(loop, -1), PS_SUCCESS);
+    }
+    assert_int_equal(test_state.closed, 3);
+
+    ps_destroy_socket(client);
+    ps_destroy_socket(full_client);
+    ps_destroy_socket(idle_client);
+    ps_destroy_socket(server);
+    ps_destroy_socket(full_server);
+    ps_destroy_socket(idle_server);
+    ps_destroy_socket(listener);
+    ps_destroy_loop(loop);
+}
+
+typedef struct {
+    int completed;
+    ps_result_t result;
+    ps_socket_t socket;
+} connect_test_state_t;
+
+static void connect_test_on_connect(ps_loop_t loop, ps_result_t result, ps_socket_t socket, void *user_data) {
+    (void)loop;
+    connect_test_state_t *test_state = (connect_test_state_t *)user_data;
+    test_state->completed++;
+    test_state->result = result;
+    test_state->socket = socket;
+}
+
+static void run_until_connected(ps_loop_t loop, connect_test_state_t *test_state) {
+    for (int attempt = 0; attempt < 100 && !test_state->completed; ++attempt) {
+        assert_int_equal(ps_loop_run_once(loop, 50), PS_SUCCESS);
+    }
+    assert_int_equal(test_state->completed, 1);
+}
+
+static void test_connect_async(void **state) {
+    (void)state;
+
+    ps_socket_t listener;
+    assert_int_equal(ps_create_socket_from_addr(&listener, PS_PROTOCOL_TCP, PS_ADDRESS_IPV4, "127.0.0.1", 0), PS_SUCCESS);
+    assert_int_equal(ps_listen_socket_backlog(listener, 1), PS_SUCCESS);
+    ps_endpoint_t endpoint;
+    assert_int_equal(ps_get_socket_endpoint(listener, &endpoint), PS_SUCCESS);
+
+    ps_loop_t loop;
+    assert_int_equal(ps_create_loop(&loop), PS_SUCCESS);
+
+    // A host name resolves and the connected socket is handed over outside the loop.
+    connect_test_state_t test_state = {0};
+    assert_int_equal(ps_connect_async(loop, "localhost", endpoint.port, NULL, connect_test_on_connect, &test_state), PS_SUCCESS);
+    assert_int_equal(test_state.completed, 0);
+    run_until_connected(loop, &test_state);
+    assert_int_equal(test_state.result, PS_SUCCESS);
+    assert_non_null(test_state.socket);
+    assert_null(ps_socket_get_loop(test_state.socket));
+
+    ps_socket_t server;
+    assert_int_equal(ps_accept_socket(listener, &server), PS_SUCCESS);
+    ps_packet_t hello = {5, "hello", 5};
+    assert_int_equal(ps_send_socket_packet(test_state.socket, hello, NULL), PS_SUCCESS);
+    char buf[8];
+    read_exactly(server, buf, 5);
+    assert_memory_equal(buf, "hello", 5);
+    ps_destroy_socket(server);
+    ps_destroy_socket(test_state.socket);
+
+    // Names that do not resolve fail right away, without a callback.
+    test_state = (connect_test_state_t){0};
+    assert_int_equal(ps_connect_async(loop, "host.invalid", endpoint.port, NULL, connect_test_on_connect, &test_state), PS_ERROR_ADDRNOTAVAIL);
+    assert_int_equal(test_state.completed, 0);
+
+    // Fill the accept queue: the listener then drops handshakes, and only the deadline ends the connect.
+    ps_socket_t pending[8];
+    int connected = 0;
+    ps_result_t result = PS_SUCCESS;
+    ps_socket_timeouts_t timeouts = {0};
+    timeouts.connect_ms = 100;
+    while (connected < 8 && result == PS_SUCCESS) {
+        assert_int_equal(ps_create_socket(&pending[connected], PS_PROTOCOL_TCP, PS_ADDRESS_IPV4), PS_SUCCESS);
+        assert_int_equal(ps_set_socket_timeouts(pending[connected], &timeouts), PS_SUCCESS);
+        result = ps_connect_socket(pending[connected], "127.0.0.1", endpoint.port);
+        connected++;
+    }
+    assert_int_equal(result, PS_ERROR_TIMEOUT);
+
+    test_state = (connect_test_state_t){0};
+    ps_connect_options_t options = {0};
+    options.timeout_ms = 100;
+    uint64_t start = ps_loop_now(loop);
+    assert_int_equal(ps_connect_async(loop, "127.0.0.1", endpoint.port, &options, connect_test_on_connect, &test_state), PS_SUCCESS);
+    run_until_connected(loop, &test_state);
+    assert_int_equal(test_state.result, PS_ERROR_TIMEOUT);
+    assert_null(test_state.socket);
+    assert_true(ps_loop_now(loop) >= start + options.timeout_ms);
+
+    for (int i = 0; i < connected; ++i) ps_destroy_socket(pending[i]);
+    ps_destroy_socket(listener);
+
+    // Nothing listens anymore: the attempt is refused.
+    test_state = (connect_test_state_t){0};
+    assert_int_equal(ps_connect_async(loop, "127.0.0.1", endpoint.port, &options, connect_test_on_connect, &test_state), PS_SUCCESS);
+    run_until_connected(loop, &test_state);
+    assert_int_equal(test_state.result, PS_ERROR_CONNREFUSED);
+    assert_null(test_state.socket);
+
+    ps_destroy_loop(loop);
+}
+
+#define CONN_POOL_TEST_THREADS 4
+#define CONN_POOL_TEST_ROUNDS 200
+
+typedef struct {
+    ps_conn_pool_t pool;
+    ps_port_t port;
+} conn_pool_test_args_t;
+
+static void *conn_pool_checkout_thread(void *arg) {
+    conn_pool_test_args_t *args = (conn_pool_test_args_t *)arg;
+    for (int round = 0; round < CONN_POOL_TEST_ROUNDS; ++round) {
+        ps_socket_t socket;
+        if (ps_conn_pool_checkout(args->pool, "127.0.0.1", args->port, PS_PROTOCOL_TCP, &socket) != PS_SUCCESS) return (void *)1;
+        ps_conn_pool_checkin(args->pool, socket, round % 50 != 0);
+    }
+    return NULL;
+}
+
+static void test_conn_pool(void **state) {
+    (void)state;
+
+    ps_socket_t listener;
+    assert_int_equal(ps_create_socket_from_addr(&listener, PS_PROTOCOL_TCP, PS_ADDRESS_IPV4, "127.0.0.1", 0), PS_SUCCESS);
+    assert_int_equal(ps_listen_socket_backlog(listener, 64), PS_SUCCESS);
+    ps_endpoint_t endpoint;
+    assert_int_equal(ps_get_socket_endpoint(listener, &endpoint), PS_SUCCESS);
+
+    ps_conn_pool_options_t options = {0};
+    options.max_connections = 2;
+    options.wait_timeout_ms = 50;
+    ps_conn_pool_t pool;
+    assert_int_equal(ps_create_conn_pool(&pool, &options), PS_SUCCESS);
+
+    // The first checkout connects, the next one reuses the connection checked in.
+    ps_socket_t first;
+    assert_int_equal(ps_conn_pool_checkout(pool, "127.0.0.1", endpoint.port, PS_PROTOCOL_TCP, &first), PS_SUCCESS);
+    ps_socket_t server;
+    assert_int_equal(ps_accept_socket(listener, &server), PS_SUCCESS);
+    ps_conn_pool_checkin(pool, first, true);
+    ps_socket_t again;
+    assert_int_equal(ps_conn_pool_checkout(pool, "127.0.0.1", endpoint.port, PS_PROTOCOL_TCP, &again), PS_SUCCESS);
+    assert_ptr_equal(again, first);
+    ps_packet_t hello = {5, "hello", 5};
+    assert_int_equal(ps_send_socket_packet(again, hello, NULL), PS_SUCCESS);
+    char buf[8];
+    read_exactly(server, buf, 5);
+    assert_memory_equal(buf, "hello", 5);
+
+    ps_conn_pool_stats_t stats;
+    ps_get_conn_pool_stats(pool, &stats);
+    assert_int_equal(stats.checkouts, 2);
+    assert_int_equal(stats.hits, 1);
+    assert_int_equal(stats.misses, 1);
+    assert_int_equal(stats.active, 1);
+
+    // At the limit, a checkout waits and then gives up.
+    ps_socket_t second, third;
+    assert_int_equal(ps_conn_pool_checkout(pool, "127.0.0.1", endpoint.port, PS_PROTOCOL_TCP, &second), PS_SUCCESS);
+    assert_int_equal(ps_conn_pool_checkout(pool, "127.0.0.1", endpoint.port, PS_PROTOCOL_TCP, &third), PS_ERROR_TIMEOUT);
+    ps_get_conn_pool_stats(pool, &stats);
+    assert_int_equal(stats.waits, 1);
+    assert_int_equal(stats.timeouts, 1);
+    assert_true(stats.max_wait_time_us >= 40000);
+    assert_int_equal(stats.active, 2);
+
+    // A connection whose peer hung up is not handed out again.
+    ps_conn_pool_checkin(pool, again, true);
+    ps_destroy_socket(server);
+    usleep(10000);
+    assert_int_equal(ps_conn_pool_checkout(pool, "127.0.0.1", endpoint.port, PS_PROTOCOL_TCP, &third), PS_SUCCESS);
+    ps_get_conn_pool_stats(pool, &stats);
+    assert_int_equal(stats.failed_checks, 1);
+    assert_int_equal(stats.misses, 3);
+
+    // Connections checked in as broken are closed, which frees their slot.
+    ps_conn_pool_checkin(pool, second, false);
+    ps_conn_pool_checkin(pool, third, true);
+    ps_get_conn_pool_stats(pool, &stats);
+    assert_int_equal(stats.idle, 1);
+    assert_int_equal(stats.active, 0);
+    ps_destroy_conn_pool(pool);
+
+    // Idle connections expire, and maintenance keeps a minimum open ahead of demand.
+    options = (ps_conn_pool_options_t){0};
+    options.min_idle = 2;
+    options.idle_timeout_ms = 20;
+    assert_int_equal(ps_create_conn_pool(&pool, &options), PS_SUCCESS);
+    assert_int_equal(ps_conn_pool_checkout(pool, "127.0.0.1", endpoint.port, PS_PROTOCOL_TCP, &first), PS_SUCCESS);
+    ps_conn_pool_checkin(pool, first, true);
+    usleep(30000);
+    ps_conn_pool_maintain(pool);
+    ps_get_conn_pool_stats(pool, &stats);
+    assert_int_equal(stats.evictions, 1);
+    assert_int_equal(stats.idle, 2);
+    assert_int_equal(ps_conn_pool_checkout(pool, "127.0.0.1", endpoint.port, PS_PROTOCOL_TCP, &first), PS_SUCCESS);
+    ps_get_conn_pool_stats(pool, &stats);
+    assert_int_equal(stats.hits, 1);
+    ps_conn_pool_checkin(pool, first, true);
+
+    ps_destroy_conn_pool(pool);
+
+    // The most recently checked in connection goes out first; host names are resolved, and a pool full of
+    // destinations refuses new ones.
+    options = (ps_conn_pool_options_t){0};
+    options.max_hosts = 1;
+    assert_int_equal(ps_create_conn_pool(&pool, &options), PS_SUCCESS);
+    assert_int_equal(ps_conn_pool_checkout(pool, "localhost", endpoint.port, PS_PROTOCOL_TCP, &first), PS_SUCCESS);
+    assert_int_equal(ps_conn_pool_checkout(pool, "localhost", endpoint.port, PS_PROTOCOL_TCP, &second), PS_SUCCESS);
+    ps_conn_pool_checkin(pool, first, true);
+    ps_conn_pool_checkin(pool, second, true);
+    assert_int_equal(ps_conn_pool_checkout(pool, "localhost", endpoint.port, PS_PROTOCOL_TCP, &again), PS_SUCCESS);
+    assert_ptr_equal(again, second);
+    ps_conn_pool_checkin(pool, again, true);
+    assert_int_equal(ps_conn_pool_checkout(pool, "127.0.0.1", endpoint.port, PS_PROTOCOL_TCP, &third), PS_ERROR_WOULDBLOCK);
+    ps_destroy_conn_pool(pool);
+    assert_int_equal(ps_create_conn_pool(&pool, NULL), PS_SUCCESS);
+    assert_int_equal(ps_conn_pool_checkout(pool, "unknown.invalid", endpoint.port, PS_PROTOCOL_TCP, &first), PS_ERROR_ADDRNOTAVAIL);
+    ps_destroy_conn_pool(pool);
+
+    // Threads share a handful of connections, waiting for each other at the limit.
+    options = (ps_conn_pool_options_t){0};
+    options.max_connections = 3;
+    options.max_idle = 2;
+    assert_int_equal(ps_create_conn_pool(&pool, &options), PS_SUCCESS);
+    conn_pool_test_args_t args = {pool, endpoint.port};
+    pthread_t threads[CONN_POOL_TEST_THREADS];
+    for (int t = 0; t < CONN_POOL_TEST_THREADS; ++t) pthread_create(&threads[t], NULL, conn_pool_checkout_thread, &args);
+    for (int t = 0; t < CONN_POOL_TEST_THREADS; ++t) {
+        void *failed;
+        pthread_join(threads[t], &failed);
+        assert_null(failed);
+    }
+    ps_get_conn_pool_stats(pool, &stats);
+    assert_int_equal(stats.checkouts, CONN_POOL_TEST_THREADS * CONN_POOL_TEST_ROUNDS);
+    assert_int_equal(stats.hits + stats.misses, stats.checkouts);
+    assert_int_equal(stats.active, 0);
+    assert_true(stats.idle <= 2);
+    ps_destroy_conn_pool(pool);
+
+    ps_destroy_socket(listener);
+}
+
+// Stand-in name server on loopback, answering from a fixed zone.
+typedef struct {
+    ps_socket_t socket;
+    int queries;
+    ps_port_t ports[16];  // Source port of each query.
+    uint16_t failure;     // Flags every answer carries instead of records, e.g. an rcode or TC; 0 serves the zone.
+} dns_test_server_t;
+
+static void dns_test_put_u16(uint8_t *p, uint16_t value) {
+    p[0] = (uint8_t)(value >> 8);
+    p[1] = (uint8_t)value;
+}
+
+static void dns_test_put_u32(uint8_t *p, uint32_t value) {
+    dns_test_put_u16(p, (uint16_t)(value >> 16));
+    dns_test_put_u16(p + 2, (uint16_t)value);
+}
+
+// Appends a record named by a pointer to the question.
+static size_t dns_test_put_record(uint8_t *p, uint16_t type, uint32_t ttl, const uint8_t *rdata, uint16_t rdlength) {
+    dns_test_put_u16(p, 0xc00c);
+    dns_test_put_u16(p + 2, type);
+    dns_test_put_u16(p + 4, 1);
+    dns_test_put_u32(p + 6, ttl);
+    dns_test_put_u16(p + 10, rdlength);
+    memcpy(p + 12, rdata, rdlength);
+    return 12 + rdlength;
+}
+
+static size_t dns_test_answer(const dns_test_server_t *server, const uint8_t *query, size_t size, uint8_t *response) {
+    char name[256] = "";
+    size_t offset = 12;
+    while (offset < size && query[offset]) {
+        if (name[0]) strcat(name, ".");
+        strncat(name, (const char *)&query[offset + 1], query[offset]);
+        offset += 1 + query[offset];
+    }
+    offset++;
+    uint16_t type = (uint16_t)((query[offset] << 8) | query[offset + 1]);
+    offset += 4;
+    if (!strcmp(name, "drop.test")) return 0;
+
+    memcpy(response, query, offset);
+    memset(response + 4, 0, 8);
+    response[5] = 1;
+    uint16_t flags = 0x8180;
+    uint16_t answers = 0;
+    uint16_t authorities = 0;
+    if (server->failure) {
+        flags |= server->failure;
+    } else if (!strcmp(name, "svc.test") && type == 1) {
+        uint8_t address[4] = {10, 1, 2, 3};
+        offset += dns_test_put_record(response + offset, 1, 60, address, 4);
+        answers++;
+    } else if (!strcmp(name, "echo.test") && type == 1) {
+        uint8_t address[4] = {127, 0, 0, 1};
+        offset += dns_test_put_record(response + offset, 1, 60, address, 4);
+        answers++;
+    } else if (!strcmp(name, "missing.test")) {
+        // Empty MNAME and RNAME, then serial, refresh, retry, expire and the negative TTL.
+        uint8_t soa[22] = {0};
+        dns_test_put_u32(soa + 18, 60);
+        offset += dns_test_put_record(response + offset, 6, 300, soa, sizeof(soa));
+        authorities++;
+        flags |= 3;
+    } else if (!strcmp(name, "soa.test")) {
+        // Addresses for A; an empty AAAA answer whose SOA allows no negative caching at all.
+        if (type == 1) {
+            uint8_t address[4] = {10, 4, 5, 6};
+            offset += dns_test_put_record(response + offset, 1, 60, address, 4);
+            answers++;
+        } else {
+            uint8_t soa[22] = {0};
+            offset += dns_test_put_record(response + offset, 6, 0, soa, sizeof(soa));
+            authorities++;
+        }
+    }
+    dns_test_put_u16(response + 2, flags);
+    dns_test_put_u16(response + 6, answers);
+    dns_test_put_u16(response + 8, authorities);
+    return offset;
+}
+
+static void dns_test_on_read(ps_loop_t loop, ps_socket_t socket, void *user_data) {
+    (void)loop;
+    dns_test_server_t *server = (dns_test_server_t *)user_data;
+    while (1) {
+        uint8_t query[512];
+        ps_packet_t packet = {0, (char *)query, sizeof(query)};
+        ps_endpoint_t from;
+        size_t received = 0;
+        if (ps_read_socket_packets(socket, &packet, &from, 1, &received) != PS_SUCCESS || !received) return;
+        if (server->queries < 16) server->ports[server->queries] = from.port;
+        server->queries++;
+
+        uint8_t response[512];
+        ps_packet_t reply = {dns_test_answer(server, query, packet.size, response), (char *)response, sizeof(response)};
+        size_t sent;
+        if (reply.size) assert_int_equal(ps_send_socket_packets(socket, &reply, &from, 1, &sent), PS_SUCCESS);
+    }
+}
+
+static void dns_test_server_open(ps_loop_t loop, dns_test_server_t *server, ps_endpoint_t *endpoint) {
+    assert_int_equal(ps_create_socket_from_addr(&server->socket, PS_PROTOCOL_UDP, PS_ADDRESS_IPV4, "127.0.0.1", 0), PS_SUCCESS);
+    assert_int_equal(ps_set_socket_blocking(server->socket, false), PS_SUCCESS);
+    ps_loop_callbacks_t callbacks = {0};
+    callbacks.on_read = dns_test_on_read;
+    callbacks.user_data = server;
+    assert_int_equal(ps_loop_add_socket(loop, server->socket, callbacks), PS_SUCCESS);
+    assert_int_equal(ps_get_socket_endpoint(server->socket, endpoint), PS_SUCCESS);
+}
+
+typedef struct {
+    int completed;
+    ps_result_t result;
+    size_t count;
+    ps_endpoint_t addresses[PS_RESOLVE_MAX_ADDRESSES];
+} resolve_test_state_t;
+
+static void resolve_test_on_resolve(ps_resolver_t resolver, ps_result_t result, const ps_endpoint_t *addresses, size_t count, void *user_data) {
+    (void)resolver;
+    resolve_test_state_t *test_state = (resolve_test_state_t *)user_data;
+    test_state->completed++;
+    test_state->result = result;
+    test_state->count = count;
+    if (count) memcpy(test_state->addresses, addresses, count * sizeof(*addresses));
+}
+
+static void run_until_resolved(ps_loop_t loop, resolve_test_state_t *test_state, int expected) {
+    for (int attempt = 0; attempt < 100 && test_state->completed < expected; ++attempt) {
+        assert_int_equal(ps_loop_run_once(loop, 50), PS_SUCCESS);
+    }
+    assert_int_equal(test_state->completed, expected);
+}
+
+static void test_resolver(void **state) {
+    (void)state;
+
+    ps_loop_t loop;
+    assert_int_equal(ps_create_loop(&loop), PS_SUCCESS);
+
+    dns_test_server_t server = {0};
+    ps_endpoint_t name_server;
+    dns_test_server_open(loop, &server, &name_server);
+    ps_resolver_options_t options = {0};
+    options.servers = &name_server;
+    options.server_count = 1;
+    options.timeout_ms = 50;
+    options.max_ttl_ms = 300;
+    ps_resolver_t resolver;
+    assert_int_equal(ps_create_resolver(&resolver, loop, &options), PS_SUCCESS);
+
+    // Concurrent lookups of a name share one A and one AAAA query; the empty AAAA answer adds nothing.
+    ps_endpoint_t addresses[4];
+    size_t count = 0;
+    assert_int_equal(ps_resolver_lookup(resolver, "svc.test", addresses, 4, &count), PS_ERROR_WOULDBLOCK);
+    resolve_test_state_t test_state = {0};
+    assert_int_equal(ps_resolve_async(resolver, "svc.test", resolve_test_on_resolve, &test_state), PS_SUCCESS);
+    assert_int_equal(ps_resolve_async(resolver, "svc.test", resolve_test_on_resolve, &test_state), PS_SUCCESS);
+    run_until_resolved(loop, &test_state, 2);
+    assert_int_equal(test_state.result, PS_SUCCESS);
+    assert_int_equal(test_state.count, 1);
+    assert_int_equal(test_state.addresses[0].family, PS_ADDRESS_IPV4);
+    assert_memory_equal(test_state.addresses[0].addr, "\x0a\x01\x02\x03", 4);
+    assert_int_equal(server.queries, 2);
+
+    // Now a hash lookup answers, whatever the case or trailing dot, and asynchronous lookups send nothing.
+    assert_int_equal(ps_resolver_lookup(resolver, "SVC.Test.", addresses, 4, &count), PS_SUCCESS);
+    assert_int_equal(count, 1);
+    assert_memory_equal(addresses[0].addr, "\x0a\x01\x02\x03", 4);
+    test_state = (resolve_test_state_t){0};
+    assert_int_equal(ps_resolve_async(resolver, "svc.test", resolve_test_on_resolve, &test_state), PS_SUCCESS);
+    assert_int_equal(test_state.completed, 0);
+    run_until_resolved(loop, &test_state, 1);
+    assert_int_equal(test_state.result, PS_SUCCESS);
+    assert_int_equal(server.queries, 2);
+
+    // NXDOMAIN is cached as well.
+    test_state = (resolve_test_state_t){0};
+    assert_int_equal(ps_resolve_async(resolver, "missing.test", resolve_test_on_resolve, &test_state), PS_SUCCESS);
+    run_until_resolved(loop, &test_state, 1);
+    assert_int_equal(test_state.result, PS_ERROR_ADDRNOTAVAIL);
+    assert_int_equal(test_state.count, 0);
+    assert_int_equal(ps_resolver_lookup(resolver, "missing.test", addresses, 4, &count), PS_ERROR_ADDRNOTAVAIL);
+    assert_int_equal(server.queries, 4);
+
+    // Each lookup asks from a source port of its own.
+    assert_int_equal(server.ports[0], server.ports[1]);
+    assert_int_equal(server.ports[2], server.ports[3]);
+    assert_int_not_equal(server.ports[0], server.ports[2]);
+
+    // Entries expire, here after max_ttl_ms.
+    usleep((options.max_ttl_ms + 50) * 1000);
+    assert_int_equal(ps_resolver_lookup(resolver, "svc.test", addresses, 4, &count), PS_ERROR_WOULDBLOCK);
+    assert_int_equal(ps_resolver_lookup(resolver, "missing.test", addresses, 4, &count), PS_ERROR_WOULDBLOCK);
+
+    // An unanswered lookup is retransmitted once, then times out.
+    test_state = (resolve_test_state_t){0};
+    assert_int_equal(ps_resolve_async(resolver, "drop.test", resolve_test_on_resolve, &test_state), PS_SUCCESS);
+    run_until_resolved(loop, &test_state, 1);
+    assert_int_equal(test_state.result, PS_ERROR_TIMEOUT);
+    assert_int_equal(server.queries, 8);
+    assert_int_equal(ps_resolver_lookup(resolver, "drop.test", addresses, 4, &count), PS_ERROR_WOULDBLOCK);
+
+    // Literals and localhost never reach the server; malformed names are refused.
+    test_state = (resolve_test_state_t){0};
+    assert_int_equal(ps_resolve_async(resolver, "localhost", resolve_test_on_resolve, &test_state), PS_SUCCESS);
+    run_until_resolved(loop, &test_state, 1);
+    assert_int_equal(test_state.result, PS_SUCCESS);
+    assert_int_equal(test_state.count, 2);
+    assert_int_equal(ps_resolver_lookup(resolver, "192.0.2.1", addresses, 4, &count), PS_SUCCESS);
+    assert_int_equal(count, 1);
+    assert_int_equal(ps_resolve_async(resolver, "bad..name", resolve_test_on_resolve, &test_state), PS_ERROR_INVALID_ARGUMENT);
+    assert_int_equal(server.queries, 8);
+
+    ps_resolver_stats_t stats;
+    ps_get_resolver_stats(resolver, &stats);
+    assert_int_equal(stats.lookups, 3);
+    assert_int_equal(stats.queries, 8);
+    assert_int_equal(stats.retransmits, 1);
+    assert_int_equal(stats.timeouts, 1);
+    assert_int_equal(stats.cache_hits, 2);
+    assert_int_equal(stats.negative_hits, 1);
+
+    // Connects resolve through the resolver without blocking the loop.
+    ps_socket_t listener;
+    assert_int_equal(ps_create_socket_from_addr(&listener, PS_PROTOCOL_TCP, PS_ADDRESS_IPV4, "127.0.0.1", 0), PS_SUCCESS);
+    assert_int_equal(ps_listen_socket(listener), PS_SUCCESS);
+    ps_endpoint_t endpoint;
+    assert_int_equal(ps_get_socket_endpoint(listener, &endpoint), PS_SUCCESS);
+    connect_test_state_t connect_state = {0};
+    ps_connect_options_t connect_options = {0};
+    connect_options.resolver = resolver;
+    assert_int_equal(ps_connect_async(loop, "echo.test", endpoint.port, &connect_options, connect_test_on_connect, &connect_state), PS_SUCCESS);
+    run_until_connected(loop, &connect_state);
+    assert_int_equal(connect_state.result, PS_SUCCESS);
+    ps_destroy_socket(connect_state.socket);
+
+    connect_state = (connect_test_state_t){0};
+    assert_int_equal(ps_connect_async(loop, "missing.test", endpoint.port, &connect_options, connect_test_on_connect, &connect_state), PS_SUCCESS);
+    run_until_connected(loop, &connect_state);
+    assert_int_equal(connect_state.result, PS_ERROR_ADDRNOTAVAIL);
+    ps_destroy_socket(listener);
+
+    // Lookups still running when the resolver goes complete with PS_ERROR_SHUTDOWN.
+    test_state = (resolve_test_state_t){0};
+    assert_int_equal(ps_resolve_async(resolver, "drop.test", resolve_test_on_resolve, &test_state), PS_SUCCESS);
+    assert_int_equal(ps_resolve_async(resolver, "svc.test", resolve_test_on_resolve, &test_state), PS_SUCCESS);
+    assert_int_equal(ps_loop_run_once(loop, 0), PS_SUCCESS);
+    ps_destroy_resolver(resolver);
+    assert_int_equal(test_state.completed, 2);
+    assert_int_equal(test_state.result, PS_ERROR_SHUTDOWN);
+
+    ps_destroy_socket(server.socket);
+    ps_destroy_loop(loop);
+}
+
+// Resolves `host`, which must complete well before the resolver's timeout: failed answers move on at once.
+static void resolve_without_timeout(ps_loop_t loop, ps_resolver_t resolver, const char *host, resolve_test_state_t *test_state) {
+    *test_state = (resolve_test_state_t){0};
+    assert_int_equal(ps_resolve_async(resolver, host, resolve_test_on_resolve, test_state), PS_SUCCESS);
+    for (int attempt = 0; attempt < 10 && !test_state->completed; ++attempt) {
+        assert_int_equal(ps_loop_run_once(loop, 50), PS_SUCCESS);
+    }
+    assert_int_equal(test_state->completed, 1);
+}
+
+static void test_resolver_failover(void **state) {
+    (void)state;
+
+    ps_loop_t loop;
+    assert_int_equal(ps_create_loop(&loop), PS_SUCCESS);
+    dns_test_server_t servers[2] = {0};
+    ps_endpoint_t name_servers[2];
+    for (int i = 0; i < 2; ++i) dns_test_server_open(loop, &servers[i], &name_servers[i]);
+
+    ps_resolver_options_t options = {0};
+    options.servers = name_servers;
+    options.server_count = 2;
+    options.timeout_ms = 5000;
+    ps_resolver_t resolver;
+    assert_int_equal(ps_create_resolver(&resolver, loop, &options), PS_SUCCESS);
+
+    // SERVFAIL and truncated answers from the first server send both questions to the second one.
+    servers[0].failure = 2;
+    resolve_test_state_t test_state;
+    resolve_without_timeout(loop, resolver, "svc.test", &test_state);
+    assert_int_equal(test_state.result, PS_SUCCESS);
+    assert_int_equal(test_state.count, 1);
+    assert_memory_equal(test_state.addresses[0].addr, "\x0a\x01\x02\x03", 4);
+    assert_int_equal(servers[1].queries, 2);
+
+    servers[0].failure = 0x0200;
+    resolve_without_timeout(loop, resolver, "echo.test", &test_state);
+    assert_int_equal(test_state.result, PS_SUCCESS);
+    assert_int_equal(test_state.count, 1);
+    assert_int_equal(servers[1].queries, 4);
+
+    // Refused everywhere, the lookup fails after every attempt rather than timing out, and is not cached.
+    servers[0].failure = servers[1].failure = 5;
+    resolve_without_timeout(loop, resolver, "missing.test", &test_state);
+    assert_int_equal(test_state.result, PS_ERROR_HOSTDOWN);
+    ps_endpoint_t addresses[4];
+    size_t count = 0;
+    assert_int_equal(ps_resolver_lookup(resolver, "missing.test", addresses, 4, &count), PS_ERROR_WOULDBLOCK);
+
+    // The SOA of the empty AAAA answer allows no caching, which must not stop the A record from being cached.
+    servers[0].failure = servers[1].failure = 0;
+    resolve_without_timeout(loop, resolver, "soa.test", &test_state);
+    assert_int_equal(test_state.result, PS_SUCCESS);
+    assert_int_equal(ps_resolver_lookup(resolver, "soa.test", addresses, 4, &count), PS_SUCCESS);
+    assert_int_equal(count, 1);
+    assert_memory_equal(addresses[0].addr, "\x0a\x04\x05\x06", 4);
+
+    ps_resolver_stats_t stats;
+    ps_get_resolver_stats(resolver, &stats);
+    assert_int_equal(stats.timeouts, 0);
+    assert_int_equal(stats.failures, 1);
+    assert_int_equal(stats.retransmits, 1 + 1 + 3);
+
+    ps_destroy_resolver(resolver);
+    for (int i = 0; i < 2; ++i) ps_destroy_socket(servers[i].socket);
+    ps_destroy_loop(loop);
+}
+
+static void test_conn_pool_resolver(void **state) {
+    (void)state;
+
+    ps_loop_t loop;
+    assert_int_equal(ps_create_loop(&loop), PS_SUCCESS);
+    dns_test_server_t server = {0};
+    ps_endpoint_t name_server;
+    dns_test_server_open(loop, &server, &name_server);
+    ps_resolver_options_t resolver_options = {0};
+    resolver_options.servers = &name_server;
+    resolver_options.server_count = 1;
+    ps_resolver_t resolver;
+    assert_int_equal(ps_create_resolver(&resolver, loop, &resolver_options), PS_SUCCESS);
+
+    ps_socket_t listener;
+    assert_int_equal(ps_create_socket_from_addr(&listener, PS_PROTOCOL_TCP, PS_ADDRESS_IPV4, "127.0.0.1", 0), PS_SUCCESS);
+    assert_int_equal(ps_listen_socket(listener), PS_SUCCESS);
+    ps_endpoint_t endpoint;
+    assert_int_equal(ps_get_socket_endpoint(listener, &endpoint), PS_SUCCESS);
+
+    ps_conn_pool_options_t options = {0};
+    options.resolver = resolver;
+    ps_conn_pool_t pool;
+    assert_int_equal(ps_create_conn_pool(&pool, &options), PS_SUCCESS);
+    pthread_t thread;
+    pthread_create(&thread, NULL, loop_run_thread, loop);
+
+    // The first connection waits for a lookup on the loop; the next one is dialed from the cache.
+    ps_socket_t first, second, server_socket;
+    assert_int_equal(ps_conn_pool_checkout(pool, "echo.test", endpoint.port, PS_PROTOCOL_TCP, &first), PS_SUCCESS);
+    assert_int_equal(ps_accept_socket(listener, &server_socket), PS_SUCCESS);
+    ps_destroy_socket(server_socket);
+    assert_int_equal(ps_conn_pool_checkout(pool, "echo.test", endpoint.port, PS_PROTOCOL_TCP, &second), PS_SUCCESS);
+    assert_int_equal(ps_accept_socket(listener, &server_socket), PS_SUCCESS);
+    ps_destroy_socket(server_socket);
+    ps_conn_pool_checkin(pool, first, false);
+    ps_conn_pool_checkin(pool, second, false);
+    ps_socket_t missing;
+    assert_int_equal(ps_conn_pool_checkout(pool, "missing.test", endpoint.port, PS_PROTOCOL_TCP, &missing), PS_ERROR_ADDRNOTAVAIL);
+
+    ps_loop_stop(loop);
+    pthread_join(thread, NULL);
+    ps_resolver_stats_t stats;
+    ps_get_resolver_stats(resolver, &stats);
+    assert_int_equal(stats.lookups, 2);
+    ps_conn_pool_stats_t pool_stats;
+    ps_get_conn_pool_stats(pool, &pool_stats);
+    assert_int_equal(pool_stats.misses, 2);
+    assert_int_equal(pool_stats.connect_failures, 1);
+
+    ps_destroy_conn_pool(pool);
+    ps_destroy_socket(listener);
+    ps_destroy_resolver(resolver);
+    ps_destroy_socket(server.socket);
+    ps_destroy_loop(loop);
+}
+
+#define MEMORY_TEST_STREAM_SIZE (3 * 1024 * 1024)
+
+static void *memory_test_send_stream(void *arg) {
+    ps_socket_t socket = (ps_socket_t)arg;
+    static char chunk[7000];
+    size_t sent = 0;
+    while (sent < MEMORY_TEST_STREAM_SIZE) {
+        size_t size = MEMORY_TEST_STREAM_SIZE - sent < sizeof(chunk) ? MEMORY_TEST_STREAM_SIZE - sent : sizeof(chunk);
+        for (size_t i = 0; i < size; ++i) chunk[i] = (char)((sent + i) * 13);
+        ps_packet_t packet = {size, chunk, size};
+        assert_int_equal(ps_send_socket_packet(socket, packet, NULL), PS_SUCCESS);
+        sent += size;
+    }
+    return NULL;
+}
+
+static void test_memory_transport(void **state) {
+    (void)state;
+
+    // Port 0 picks a free port; addresses are taken until their socket goes.
+    ps_socket_t listener, other;
+    create_memory_listener(&listener, 0);
+    ps_endpoint_t endpoint;
+    assert_int_equal(ps_get_socket_endpoint(listener, &endpoint), PS_SUCCESS);
+    assert_int_not_equal(endpoint.port, 0);
+    assert_int_equal(ps_create_socket(&other, PS_PROTOCOL_MEMORY, PS_ADDRESS_IPV4), PS_SUCCESS);
+    assert_int_equal(ps_bind_socket(other, "127.0.0.1", endpoint.port), PS_ERROR_ADDRINUSE);
+    assert_int_equal(ps_connect_socket(other, "127.0.0.1", endpoint.port + 1), PS_ERROR_CONNREFUSED);
+    ps_destroy_socket(other);
+
+    // Nothing to accept or read: non-blocking calls and timeouts report it.
+    assert_int_equal(ps_set_socket_blocking(listener, false), PS_SUCCESS);
+    ps_socket_t client, server;
+    assert_int_equal(ps_accept_socket(listener, &server), PS_ERROR_WOULDBLOCK);
+    assert_int_equal(ps_set_socket_blocking(listener, true), PS_SUCCESS);
+    assert_int_equal(ps_create_socket(&client, PS_PROTOCOL_MEMORY, PS_ADDRESS_IPV4), PS_SUCCESS);
+    assert_int_equal(ps_connect_socket(client, "127.0.0.1", endpoint.port), PS_SUCCESS);
+    assert_int_equal(ps_accept_socket(listener, &server), PS_SUCCESS);
+
+    char buf[64];
+    ps_packet_t packet = {0, buf, sizeof(buf)};
+    assert_int_equal(ps_set_socket_blocking(server, false), PS_SUCCESS);
+    assert_int_equal(ps_read_socket_packet(server, &packet, NULL), PS_ERROR_WOULDBLOCK);
+    assert_int_equal(ps_set_socket_blocking(server, true), PS_SUCCESS);
+    ps_socket_timeouts_t timeouts = {0};
+    timeouts.read_ms = 20;
+    assert_int_equal(ps_set_socket_timeouts(server, &timeouts), PS_SUCCESS);
+    assert_int_equal(ps_read_socket_packet(server, &packet, NULL), PS_ERROR_TIMEOUT);
+
+    // Bytes stream through the rings, larger than they are, while both threads run.
+    pthread_t sender;
+    pthread_create(&sender, NULL, memory_test_send_stream, client);
+    static char stream[MEMORY_TEST_STREAM_SIZE];
+    read_exactly(server, stream, sizeof(stream));
+    pthread_join(sender, NULL);
+    for (size_t i = 0; i < sizeof(stream); ++i) {
+        if (stream[i] != (char)(i * 13)) fail_msg("byte %zu differs", i);
+    }
+
+    // Framing works as over TCP; memory sockets have no file descriptor to poll.
+    ps_framing_options_t framing = {0};
+    ps_framed_socket_t sender_framed, receiver_framed;
+    assert_int_equal(ps_create_framed_socket(&sender_framed, client, &framing), PS_SUCCESS);
+    assert_int_equal(ps_create_framed_socket(&receiver_framed, server, &framing), PS_SUCCESS);
+    ps_packet_t frame = {5, "frame", 5};
+    assert_int_equal(ps_framed_send(sender_framed, frame), PS_SUCCESS);
+    ps_packet_t received = {0};
+    assert_int_equal(ps_framed_read(receiver_framed, &received), PS_SUCCESS);
+    assert_int_equal(received.size, 5);
+    assert_memory_equal(received.buf, "frame", 5);
+    ps_destroy_framed_socket(sender_framed);
+    ps_destroy_framed_socket(receiver_framed);
+
+    ps_loop_t loop;
+    assert_int_equal(ps_create_loop(&loop), PS_SUCCESS);
+    ps_loop_callbacks_t callbacks = {0};
+    assert_int_equal(ps_loop_add_socket(loop, server, callbacks), PS_ERROR_UNSUPPORTED);
+    ps_destroy_loop(loop);
+
+    // Data sent before a hang-up is still read; then the connection reports it, and sends fail.
+    ps_packet_t last = {4, "last", 4};
+    assert_int_equal(ps_send_socket_packet(client, last, NULL), PS_SUCCESS);
+    ps_destroy_socket(client);
+    packet = (ps_packet_t){0, buf, sizeof(buf)};
+    assert_int_equal(ps_read_socket_packet(server, &packet, NULL), PS_SUCCESS);
+    assert_int_equal(packet.size, 4);
+    assert_int_equal(ps_read_socket_packet(server, &packet, NULL), PS_CONNCLOSED);
+    assert_int_equal(ps_send_socket_packet(server, last, NULL), PS_ERROR_CONNRESET);
+    ps_destroy_socket(server);
+
+    // A full backlog refuses; destroying the listener hangs up on connections never accepted.
+    ps_destroy_socket(listener);
+    assert_int_equal(ps_create_socket(&listener, PS_PROTOCOL_MEMORY, PS_ADDRESS_IPV4), PS_SUCCESS);
+    assert_int_equal(ps_bind_socket(listener, "0.0.0.0", endpoint.port), PS_SUCCESS);
+    assert_int_equal(ps_listen_socket_backlog(listener, 1), PS_SUCCESS);
+    assert_int_equal(ps_create_socket(&client, PS_PROTOCOL_MEMORY, PS_ADDRESS_IPV4), PS_SUCCESS);
+    assert_int_equal(ps_connect_socket(client, "127.0.0.1", endpoint.port), PS_SUCCESS);
+    assert_int_equal(ps_create_socket(&other, PS_PROTOCOL_MEMORY, PS_ADDRESS_IPV4), PS_SUCCESS);
+    assert_int_equal(ps_connect_socket(other, "127.0.0.1", endpoint.port), PS_ERROR_CONNREFUSED);
+    ps_destroy_socket(other);
+    ps_destroy_socket(listener);
+    assert_int_equal(ps_read_socket_packet(client, &packet, NULL), PS_CONNCLOSED);
+    ps_destroy_socket(client);
+}
+
+// Child side of test_shm_transport: echoes until told to quit, then exits without destroying its socket.
+static void shm_test_echo_child(ps_port_t port) {
+    ps_socket_t socket;
+    if (ps_create_socket(&socket, PS_PROTOCOL_SHM, PS_ADDRESS_IPV4) != PS_SUCCESS ||
+        ps_connect_socket(socket, "127.0.0.1", port) != PS_SUCCESS) {
+        _exit(1);
+    }
+    char buf[4096];
+    for (;;) {
+        ps_packet_t packet = {0, buf, sizeof(buf)};
+        if (ps_read_socket_packet(socket, &packet, NULL) != PS_SUCCESS) _exit(1);
+        if (packet.size == 4 && !memcmp(buf, "quit", 4)) _exit(0);
+        ps_packet_t echo = {packet.size, buf, packet.size};
+        if (ps_send_socket_packet(socket, echo, NULL) != PS_SUCCESS) _exit(1);
+    }
+}
+
+static void wait_child(pid_t child) {
+    int status;
+    assert_int_equal(waitpid(child, &status, 0), child);
+    assert_true(WIFEXITED(status));
+    assert_int_equal(WEXITSTATUS(status), 0);
+}
+
+static void test_shm_transport(void **state) {
+    (void)state;
+
+    ps_socket_t listener, other;
+    assert_int_equal(ps_create_socket(&listener, PS_PROTOCOL_SHM, PS_ADDRESS_IPV4), PS_SUCCESS);
+    assert_int_equal(ps_bind_socket(listener, "127.0.0.1", 0), PS_SUCCESS);
+    assert_int_equal(ps_listen_socket(listener), PS_SUCCESS);
+    ps_endpoint_t endpoint;
+    assert_int_equal(ps_get_socket_endpoint(listener, &endpoint), PS_SUCCESS);
+    assert_int_not_equal(endpoint.port, 0);
+    assert_int_equal(ps_create_socket(&other, PS_PROTOCOL_SHM, PS_ADDRESS_IPV4), PS_SUCCESS);
+    assert_int_equal(ps_bind_socket(other, "127.0.0.1", endpoint.port), PS_ERROR_ADDRINUSE);
+    ps_destroy_socket(other);
+
+    // Another process connects and echoes; the rings stay in step across the process boundary.
+    pid_t child = fork();
+    assert_true(child >= 0);
+    if (!child) shm_test_echo_child(endpoint.port);
+    ps_socket_t server;
+    assert_int_equal(ps_accept_socket(listener, &server), PS_SUCCESS);
+    char sent[4096], echoed[4096];
+    for (int round = 0; round < 256; ++round) {
+        for (size_t i = 0; i < sizeof(sent); ++i) sent[i] = (char)(i * 7 + round);
+        ps_packet_t packet = {sizeof(sent), sent, sizeof(sent)};
+        assert_int_equal(ps_send_socket_packet(server, packet, NULL), PS_SUCCESS);
+        read_exactly(server, echoed, sizeof(echoed));
+        assert_memory_equal(sent, echoed, sizeof(sent));
+    }
+
+    // The child exits without closing its side; once it is gone, the connection reports a hang-up.
+    ps_packet_t quit = {4, "quit", 4};
+    assert_int_equal(ps_send_socket_packet(server, quit, NULL), PS_SUCCESS);
+    wait_child(child);
+    ps_packet_t packet = {0, echoed, sizeof(echoed)};
+    assert_int_equal(ps_read_socket_packet(server, &packet, NULL), PS_CONNCLOSED);
+    ps_destroy_socket(server);
+    ps_destroy_socket(listener);
+
+    // An address whose owner died without unbinding can be bound again.
+    child = fork();
+    assert_true(child >= 0);
+    if (!child) {
+        _exit(ps_create_socket(&listener, PS_PROTOCOL_SHM, PS_ADDRESS_IPV4) == PS_SUCCESS &&
+              ps_bind_socket(listener, "127.0.0.1", endpoint.port) == PS_SUCCESS ? 0 : 1);
+    }
+    wait_child(child);
+    assert_int_equal(ps_create_socket(&listener, PS_PROTOCOL_SHM, PS_ADDRESS_IPV4), PS_SUCCESS);
+    assert_int_equal(ps_bind_socket(listener, "127.0.0.1", endpoint.port), PS_SUCCESS);
+    assert_int_equal(ps_create_socket(&other, PS_PROTOCOL_SHM, PS_ADDRESS_IPV4), PS_SUCCESS);
+    assert_int_equal(ps_connect_socket(other, "127.0.0.1", endpoint.port), PS_ERROR_CONNREFUSED);
+    ps_destroy_socket(other);
+
+    // The backlog bounds connections waiting for accept; destroying the listener hangs up on them.
+    assert_int_equal(ps_listen_socket_backlog(listener, 1), PS_SUCCESS);
+    ps_socket_t client;
+    assert_int_equal(ps_create_socket(&client, PS_PROTOCOL_SHM, PS_ADDRESS_IPV4), PS_SUCCESS);
+    assert_int_equal(ps_connect_socket(client, "127.0.0.1", endpoint.port), PS_SUCCESS);
+    assert_int_equal(ps_create_socket(&other, PS_PROTOCOL_SHM, PS_ADDRESS_IPV4), PS_SUCCESS);
+    assert_int_equal(ps_connect_socket(other, "127.0.0.1", endpoint.port), PS_ERROR_CONNREFUSED);
+    ps_destroy_socket(other);
+    ps_destroy_socket(listener);
+    assert_int_equal(ps_read_socket_packet(client, &packet, NULL), PS_CONNCLOSED);
+    ps_destroy_socket(client);
+}
+
+static void test_unix_sockets(void **state) {
+    (void)state;
+
+    // Abstract names need no file; paths are bound like files and stay until unlinked.
+    char abstract[64], path[64];
+    snprintf(abstract, sizeof(abstract), "@purrsock-test-%d", (int)getpid());
+    snprintf(path, sizeof(path), "/tmp/purrsock-test-%d.sock", (int)getpid());
+    const char *names[] = {abstract, path};
+    for (int i = 0; i < 2; ++i) {
+        ps_socket_t listener, client, server;
+        assert_int_equal(ps_create_socket_from_addr(&listener, PS_PROTOCOL_UNIX_STREAM, PS_ADDRESS_IPV4, names[i], 0), PS_SUCCESS);
+        assert_int_equal(ps_listen_socket(listener), PS_SUCCESS);
+        assert_int_equal(ps_create_socket(&client, PS_PROTOCOL_UNIX_STREAM, PS_ADDRESS_IPV4), PS_SUCCESS);
+        assert_int_equal(ps_connect_socket(client, names[i], 0), PS_SUCCESS);
+        assert_int_equal(ps_accept_socket(listener, &server), PS_SUCCESS);
+        assert_int_equal(ps_set_socket_nodelay(client, true), PS_SUCCESS);
+        ps_endpoint_t endpoint;
+        assert_int_equal(ps_get_socket_endpoint(server, &endpoint), PS_ERROR_UNSUPPORTED);
+
+        ps_packet_t hello = {5, "hello", 5};
+        assert_int_equal(ps_send_socket_packet(client, hello, NULL), PS_SUCCESS);
+        char buf[16];
+        read_exactly(server, buf, 5);
+        assert_memory_equal(buf, "hello", 5);
+        ps_destroy_socket(client);
+        ps_packet_t packet = {0, buf, sizeof(buf)};
+        assert_int_equal(ps_read_socket_packet(server, &packet, NULL), PS_CONNCLOSED);
+        ps_destroy_socket(server);
+        ps_destroy_socket(listener);
+    }
+    assert_int_equal(access(path, F_OK), 0);
+    unlink(path);
+
+    // Datagrams keep their boundaries, and the sender's name answers back.
+    char first_name[64], second_name[64];
+    snprintf(first_name, sizeof(first_name), "@purrsock-test-%d-a", (int)getpid());
+    snprintf(second_name, sizeof(second_name), "@purrsock-test-%d-b", (int)getpid());
+    ps_socket_t first, second, from = NULL;
+    assert_int_equal(ps_create_socket_from_addr(&first, PS_PROTOCOL_UNIX_DGRAM, PS_ADDRESS_IPV4, first_name, 0), PS_SUCCESS);
+    assert_int_equal(ps_create_socket_from_addr(&second, PS_PROTOCOL_UNIX_DGRAM, PS_ADDRESS_IPV4, second_name, 0), PS_SUCCESS);
+    assert_int_equal(ps_connect_socket(first, second_name, 0), PS_SUCCESS);
+    ps_packet_t ping = {4, "ping", 4}, pong = {4, "pong", 4};
+    assert_int_equal(ps_send_socket_packet(first, ping, NULL), PS_SUCCESS);
+    assert_int_equal(ps_send_socket_packet(first, ping, NULL), PS_SUCCESS);
+    char buf[16];
+    ps_packet_t packet = {0, buf, sizeof(buf)};
+    assert_int_equal(ps_read_socket_packet(second, &packet, &from), PS_SUCCESS);
+    assert_int_equal(packet.size, 4);
+    assert_non_null(from);
+    assert_int_equal(ps_send_socket_packet(second, pong, from), PS_SUCCESS);
+    packet = (ps_packet_t){0, buf, sizeof(buf)};
+    assert_int_equal(ps_read_socket_packet(first, &packet, NULL), PS_SUCCESS);
+    assert_int_equal(packet.size, 4);
+    assert_memory_equal(buf, "pong", 4);
+    ps_destroy_socket(from);
+    ps_destroy_socket(first);
+    ps_destroy_socket(second);
+}
+
+static void test_unix_fd_passing(void **state) {
+    (void)state;
+
+    char name[64];
+    snprintf(name, sizeof(name), "@purrsock-test-%d-channel", (int)getpid());
+    ps_socket_t channel_listener, sender, receiver;
+    assert_int_equal(ps_create_socket_from_addr(&channel_listener, PS_PROTOCOL_UNIX_STREAM, PS_ADDRESS_IPV4, name, 0), PS_SUCCESS);
+    assert_int_equal(ps_listen_socket(channel_listener), PS_SUCCESS);
+    assert_int_equal(ps_create_socket(&sender, PS_PROTOCOL_UNIX_STREAM, PS_ADDRESS_IPV4), PS_SUCCESS);
+    assert_int_equal(ps_connect_socket(sender, name, 0), PS_SUCCESS);
+    assert_int_equal(ps_accept_socket(channel_listener, &receiver), PS_SUCCESS);
+
+    // Plain descriptors: the received one is a new descriptor for the same pipe.
+    int fds[2];
+    assert_int_equal(pipe(fds), 0);
+    ps_packet_t note = {4, "pipe", 4};
+    assert_int_equal(ps_send_socket_fds(sender, note, &fds[1], 1), PS_SUCCESS);
+    char buf[16];
+    int received[4];
+    size_t count;
+    ps_packet_t packet = {0, buf, sizeof(buf)};
+    assert_int_equal(ps_read_socket_fds(receiver, &packet, received, 4, &count), PS_SUCCESS);
+    assert_int_equal(packet.size, 4);
+    assert_int_equal(count, 1);
+    assert_int_not_equal(received[0], fds[1]);
+    assert_int_equal(write(received[0], "x", 1), 1);
+    assert_int_equal(read(fds[0], buf, 1), 1);
+    assert_int_equal(buf[0], 'x');
+    close(received[0]);
+    close(fds[0]);
+    close(fds[1]);
+    assert_int_equal(ps_send_socket_fds(sender, (ps_packet_t){0, buf, 0}, NULL, 0), PS_ERROR_INVALID_ARGUMENT);
+
+    // A whole TCP connection changes hands and keeps working after the original socket is gone.
+    ps_socket_t listener, client, server, passed;
+    assert_int_equal(ps_create_socket_from_addr(&listener, PS_PROTOCOL_TCP, PS_ADDRESS_IPV4, "127.0.0.1", 0), PS_SUCCESS);
+    assert_int_equal(ps_listen_socket(listener), PS_SUCCESS);
+    ps_endpoint_t endpoint;
+    assert_int_equal(ps_get_socket_endpoint(listener, &endpoint), PS_SUCCESS);
+    connect_pair(listener, endpoint.port, &client, &server);
+    assert_int_equal(ps_pass_socket(sender, server), PS_SUCCESS);
+    ps_destroy_socket(server);
+    assert_int_equal(ps_accept_passed_socket(receiver, &passed), PS_SUCCESS);
+    ps_packet_t hello = {5, "hello", 5};
+    assert_int_equal(ps_send_socket_packet(passed, hello, NULL), PS_SUCCESS);
+    read_exactly(client, buf, 5);
+    assert_memory_equal(buf, "hello", 5);
+    ps_destroy_socket(passed);
+    packet = (ps_packet_t){0, buf, sizeof(buf)};
+    assert_int_equal(ps_read_socket_packet(client, &packet, NULL), PS_CONNCLOSED);
+
+    // A message without a descriptor is not a passed socket.
+    assert_int_equal(ps_send_socket_packet(sender, hello, NULL), PS_SUCCESS);
+    assert_int_equal(ps_accept_passed_socket(receiver, &passed), PS_ERROR_INVALID_ARGUMENT);
+
+    ps_destroy_socket(client);
+    ps_destroy_socket(listener);
+    ps_destroy_socket(sender);
+    ps_destroy_socket(receiver);
+    ps_destroy_socket(channel_listener);
+}
+
+static void test_socket_stats(void **state) {
+    (void)state;
+
+    ps_socket_t listener, client, server;
+    assert_int_equal(ps_create_socket_from_addr(&listener, PS_PROTOCOL_TCP, PS_ADDRESS_IPV4, "127.0.0.1", 0), PS_SUCCESS);
+    assert_int_equal(ps_listen_socket(listener), PS_SUCCESS);
+    ps_endpoint_t endpoint;
+    assert_int_equal(ps_get_socket_endpoint(listener, &endpoint), PS_SUCCESS);
+    connect_pair(listener, endpoint.port, &client, &server);
+
+    ps_socket_stats_t stats;
+    ps_stats_t before, after;
+    if (ps_get_socket_stats(client, &stats) == PS_ERROR_UNSUPPORTED) {
+        ps_destroy_socket(client);
+        ps_destroy_socket(server);
+        ps_destroy_socket(listener);
+        skip();
+    }
+    assert_int_equal(stats.bytes_sent, 0);
+    assert_int_equal(ps_get_stats(&before), PS_SUCCESS);
+
+    // Three packets out and in; a non-blocking read of nothing counts as a call that would block.
+    char buf[100];
+    memset(buf, 'x', sizeof(buf));
+    for (int i = 0; i < 3; ++i) {
+        assert_int_equal(ps_send_socket_packet(client, (ps_packet_t){sizeof(buf), buf, sizeof(buf)}, NULL), PS_SUCCESS);
+    }
+    static char received[300];
+    read_exactly(server, received, sizeof(received));
+    assert_int_equal(ps_set_socket_blocking(server, false), PS_SUCCESS);
+    ps_packet_t packet = {0, buf, sizeof(buf)};
+    assert_int_equal(ps_read_socket_packet(server, &packet, NULL), PS_ERROR_WOULDBLOCK);
+
+    assert_int_equal(ps_get_socket_stats(client, &stats), PS_SUCCESS);
+    assert_int_equal(stats.bytes_sent, 300);
+    assert_int_equal(stats.packets_sent, 3);
+    assert_true(stats.send_calls >= 3);
+    assert_int_equal(stats.bytes_read, 0);
+    assert_int_equal(ps_get_socket_stats(server, &stats), PS_SUCCESS);
+    assert_int_equal(stats.bytes_read, 300);
+    assert_true(stats.packets_read >= 1);
+    assert_int_equal(stats.read_calls, stats.packets_read + 1);
+    assert_int_equal(stats.read_wouldblocks, 1);
+
+    // The process totals and the latency histograms grew by at least as much.
+    assert_int_equal(ps_get_stats(&after), PS_SUCCESS);
+    assert_true(after.io.bytes_sent - before.io.bytes_sent >= 300);
+    assert_true(after.io.read_wouldblocks - before.io.read_wouldblocks >= 1);
+    assert_true(after.send_latency.count - before.send_latency.count >= 3);
+    assert_true(after.read_latency.count >= after.io.read_calls - before.io.read_calls);
+    uint64_t p50 = ps_latency_percentile(&after.send_latency, 50);
+    uint64_t p99 = ps_latency_percentile(&after.send_latency, 99);
+    assert_true(p50 > 0 && p50 <= p99);
+    assert_true(p99 <= after.send_latency.max_ns);
+    assert_int_equal(ps_latency_percentile(&after.send_latency, 100), after.send_latency.max_ns);
+
+    // Buckets hold an eighth of their power of two, and percentiles report a bucket's highest value.
+    static ps_latency_histogram_t histogram;
+    histogram.count = 2;
+    histogram.max_ns = 1000;
+    histogram.buckets[5] = 1;
+    histogram.buckets[7 * 8 + 7] = 1;  // 960 to 1023 ns.
+    assert_int_equal(ps_latency_percentile(&histogram, 50), 5);
+    assert_int_equal(ps_latency_percentile(&histogram, 99), 1000);
+    histogram.max_ns = 2000;
+    assert_int_equal(ps_latency_percentile(&histogram, 99), 1023);
+
+    // A loop reports the shard of the thread that ran it, here the one that did the I/O above.
+    ps_loop_t loop;
+    ps_stats_t loop_stats;
+    assert_int_equal(ps_create_loop(&loop), PS_SUCCESS);
+    assert_int_equal(ps_get_loop_stats(loop, &loop_stats), PS_SUCCESS);
+    assert_int_equal(loop_stats.io.send_calls, 0);
+    assert_int_equal(ps_loop_run_once(loop, 0), PS_SUCCESS);
+    assert_int_equal(ps_get_loop_stats(loop, &loop_stats), PS_SUCCESS);
+    assert_true(loop_stats.io.bytes_sent >= 300);
+    ps_destroy_loop(loop);
+
+    ps_destroy_socket(client);
+    ps_destroy_socket(server);
+    ps_destroy_socket(listener);
+}
+
+
+#define HTTP_TEST_LARGE_SIZE (100 * 1024)
+
+typedef struct {
+    atomic_int failures;
+    char large[HTTP_TEST_LARGE_SIZE];
+} http_test_state_t;
+
+static void http_test_hello(const ps_http_request_t *request, ps_http_response_t response, void *user_data) {
+    http_test_state_t *state = (http_test_state_t *)user_data;
+    char query[64];
+    snprintf(query, sizeof(query), "%.*s", (int)request->query.size, request->query.buf);
+    if (ps_http_response_add_header(response, "Content-Type", "text/plain") != PS_SUCCESS) atomic_fetch_add(&state->failures, 1);
+    if (ps_http_response_add_header(response, "X-Query", query) != PS_SUCCESS) atomic_fetch_add(&state->failures, 1);
+    // Framing is the server's business, and header injection is refused.
+    if (ps_http_response_add_header(response, "Content-Length", "5") != PS_ERROR_INVALID_ARGUMENT) atomic_fetch_add(&state->failures, 1);
+    if (ps_http_response_add_header(response, "X-Bad", "a\r\nSet-Cookie: b") != PS_ERROR_INVALID_ARGUMENT) atomic_fetch_add(&state->failures, 1);
+    if (ps_http_response_send(response, (ps_packet_t){5, "hello", 5}) != PS_SUCCESS) atomic_fetch_add(&state->failures, 1);
+    if (ps_http_response_set_status(response, 500) != PS_ERROR_INVALID_ARGUMENT) atomic_fetch_add(&state->failures, 1);
+}
+
+static void http_test_echo(const ps_http_request_t *request, ps_http_response_t response, void *user_data) {
+    http_test_state_t *state = (http_test_state_t *)user_data;
+    ps_http_string_t type;
+    if (!ps_http_request_header(request, "content-TYPE", &type) || type.size != 10 || memcmp(type.buf, "text/plain", 10) != 0) {
+        atomic_fetch_add(&state->failures, 1);
+    }
+    ps_http_response_set_status(response, 201);
+    ps_http_response_send(response, (ps_packet_t){request->body.size, (char *)request->body.buf, request->body.size});
+}
+
+static void http_test_stream(const ps_http_request_t *request, ps_http_response_t response, void *user_data) {
+    (void)user_data;
+    ps_http_response_write(response, (ps_packet_t){request->path.size, (char *)request->path.buf, request->path.size});
+    ps_http_response_write(response, (ps_packet_t){4, "-end", 4});
+    // Left unfinished: the server ends the chunked body.
+}
+
+static void http_test_large(const ps_http_request_t *request, ps_http_response_t response, void *user_data) {
+    (void)request;
+    http_test_state_t *state = (http_test_state_t *)user_data;
+    ps_http_response_send(response, (ps_packet_t){HTTP_TEST_LARGE_SIZE, state->large, HTTP_TEST_LARGE_SIZE});
+}
+
+static ps_socket_t http_test_connect(ps_port_t port) {
+    ps_socket_t client;
+    assert_int_equal(ps_create_socket(&client, PS_PROTOCOL_TCP, PS_ADDRESS_IPV4), PS_SUCCESS);
+    assert_int_equal(ps_connect_socket(client, "127.0.0.1", port), PS_SUCCESS);
+    ps_socket_timeouts_t timeouts = {0};
+    timeouts.read_ms = 2000;
+    assert_int_equal(ps_set_socket_timeouts(client, &timeouts), PS_SUCCESS);
+    return client;
+}
+
+static void http_test_send(ps_socket_t client, const char *data) {
+    assert_int_equal(ps_send_socket_packet(client, (ps_packet_t){strlen(data), (char *)data, strlen(data)}, NULL), PS_SUCCESS);
+}
+
+// Receives into `buf` until it holds `needle`, or `size` bytes if `needle` is NULL; `buf` stays NUL-terminated.
+static size_t http_test_receive(ps_socket_t client, char *buf, size_t capacity, const char *needle, size_t size) {
+    size_t received = 0;
+    buf[0] = '\0';
+    while (needle ? !strstr(buf, needle) : received < size) {
+        ps_packet_t packet = {0, buf + received, capacity - 1 - received};
+        assert_true(packet.capacity > 0);
+        assert_int_equal(ps_read_socket_packet(client, &packet, NULL), PS_SUCCESS);
+        received += packet.size;
+        buf[received] = '\0';
+    }
+    return received;
+}
+
+static void http_test_expect_closed(ps_socket_t client) {
+    char buf[256];
+    ps_packet_t packet = {0, buf, sizeof(buf)};
+    ps_result_t result;
+    while ((result = ps_read_socket_packet(client, &packet, NULL)) == PS_SUCCESS) packet.size = 0;
+    assert_int_equal(result, PS_CONNCLOSED);
+}
+
+static void test_http_server(void **state) {
+    (void)state;
+
+    static http_test_state_t test_state;
+    memset(test_state.large, 'x', sizeof(test_state.large));
+    ps_http_server_options_t options = {0};
+    options.workers = 1;
+    options.max_body_size = 64;
+    options.idle_timeout_ms = 200;
+    ps_http_server_t server;
+    assert_int_equal(ps_create_http_server(&server, PS_ADDRESS_IPV4, "127.0.0.1", 0, &options), PS_SUCCESS);
+    assert_int_equal(ps_http_route(server, "GET", "/hello", http_test_hello, &test_state), PS_SUCCESS);
+    assert_int_equal(ps_http_route(server, "GET", "/hello", http_test_hello, &test_state), PS_ERROR_INVALID_ARGUMENT);
+    assert_int_equal(ps_http_route(server, "POST", "/echo", http_test_echo, &test_state), PS_SUCCESS);
+    assert_int_equal(ps_http_route(server, NULL, "/stream/*", http_test_stream, &test_state), PS_SUCCESS);
+    assert_int_equal(ps_http_route(server, "GET", "/large", http_test_large, &test_state), PS_SUCCESS);
+    assert_int_equal(ps_http_route(server, "GET", "no-slash", http_test_hello, &test_state), PS_ERROR_INVALID_ARGUMENT);
+    assert_int_equal(ps_http_server_start(server), PS_SUCCESS);
+    assert_int_equal(ps_http_route(server, "GET", "/late", http_test_hello, &test_state), PS_ERROR_INVALID_ARGUMENT);
+    ps_port_t port = ps_http_server_get_port(server);
+
+    static char buf[HTTP_TEST_LARGE_SIZE + 1024];
+    ps_socket_t client = http_test_connect(port);
+
+    // A plain request, with the preformatted headers and the handler's own.
+    http_test_send(client, "GET /hello?name=cat HTTP/1.1\r\nHost: localhost\r\n\r\n");
+    http_test_receive(client, buf, sizeof(buf), "hello", 0);
+    assert_true(strncmp(buf, "HTTP/1.1 200 OK\r\n", 17) == 0);
+    assert_non_null(strstr(buf, "\r\nServer: purrsock\r\n"));
+    assert_non_null(strstr(buf, "\r\nDate: "));
+    assert_non_null(strstr(buf, " GMT\r\n"));
+    assert_non_null(strstr(buf, "\r\nX-Query: name=cat\r\n"));
+    assert_non_null(strstr(buf, "\r\nContent-Length: 5\r\n\r\nhello"));
+    assert_null(strstr(buf, "Connection:"));
+
+    // Pipelined requests, one of them arriving in pieces, are answered in order on the same connection.
+    http_test_send(client, "POST /echo HTTP/1.1\r\nContent-Type: text/plain\r\nContent-Length: 3\r\n\r\nabc"
+                           "HEAD /hello HTTP/1.1\r\n\r\n"
+                           "DELETE /hello HTTP/1.1\r\n\r\n"
+                           "GET /missing HTTP/1.1\r\n\r\n"
+                           "GET /stream/cat HTTP/1.1\r\n\r\n"
+                           "POST /echo HTTP/1.1\r\nContent-Type: text/plain\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabc\r\n");
+    usleep(20000);
+    http_test_send(client, "4;ext=1\r\ndefg\r\n0\r\nTrailer: x\r\n\r\n");
+    http_test_receive(client, buf, sizeof(buf), "abcdefg", 0);
+    char *echo = strstr(buf, "HTTP/1.1 201 Created\r\n");
+    char *head = strstr(buf, "HTTP/1.1 200 OK\r\n");
+    char *not_allowed = strstr(buf, "HTTP/1.1 405 Method Not Allowed\r\n");
+    char *not_found = strstr(buf, "HTTP/1.1 404 Not Found\r\n");
+    char *stream = strstr(buf, "Transfer-Encoding: chunked\r\n\r\nb\r\n/stream/cat\r\n4\r\n-end\r\n0\r\n\r\n");
+    char *chunked_echo = strstr(buf, "Content-Length: 7\r\n\r\nabcdefg");
+    assert_true(echo == buf && echo < head && head < not_allowed && not_allowed < not_found && not_found < stream && stream < chunked_echo);
+    assert_non_null(strstr(buf, "Content-Length: 3\r\n\r\nabcHTTP/1.1 200 OK"));
+    // HEAD gets the GET route's head without the body.
+    assert_non_null(strstr(buf, "Content-Length: 5\r\n\r\nHTTP/1.1 405"));
+
+    // Bodies past 16 KiB go out without a copy, behind what is buffered.
+    http_test_send(client, "GET /hello HTTP/1.1\r\n\r\nGET /large HTTP/1.1\r\n\r\n");
+    size_t received = http_test_receive(client, buf, sizeof(buf), "Content-Length: 102400\r\n\r\n", 0);
+    size_t head_end = (size_t)(strstr(buf, "Content-Length: 102400\r\n\r\n") - buf) + 26;
+    if (received < head_end + HTTP_TEST_LARGE_SIZE) {
+        received += http_test_receive(client, buf + received, sizeof(buf) - received, NULL, head_end + HTTP_TEST_LARGE_SIZE - received);
+    }
+    assert_int_equal(received, head_end + HTTP_TEST_LARGE_SIZE);
+    assert_true(memcmp(buf + head_end, test_state.large, HTTP_TEST_LARGE_SIZE) == 0);
+
+    // A client that expects 100-continue hears it before sending the body.
+    http_test_send(client, "POST /echo HTTP/1.1\r\nContent-Type: text/plain\r\nContent-Length: 4\r\nExpect: 100-continue\r\n\r\n");
+    http_test_receive(client, buf, sizeof(buf), "HTTP/1.1 100 Continue\r\n\r\n", 0);
+    http_test_send(client, "ping");
+    http_test_receive(client, buf, sizeof(buf), "ping", 0);
+    assert_true(strncmp(buf, "HTTP/1.1 201 Created\r\n", 22) == 0);
+    ps_destroy_socket(client);
+
+    // HTTP/1.0 closes after the response unless asked to keep the connection.
+    client = http_test_connect(port);
+    http_test_send(client, "GET /hello HTTP/1.0\r\nConnection: keep-alive\r\n\r\n");
+    http_test_receive(client, buf, sizeof(buf), "hello", 0);
+    assert_non_null(strstr(buf, "\r\nConnection: keep-alive\r\n"));
+    http_test_send(client, "GET /hello HTTP/1.0\r\n\r\n");
+    http_test_receive(client, buf, sizeof(buf), "hello", 0);
+    assert_non_null(strstr(buf, "\r\nConnection: close\r\n"));
+    http_test_expect_closed(client);
+    ps_destroy_socket(client);
+
+    // Malformed, oversized and smuggling-prone requests are answered with an error and the connection closed.
+    const char *bad_requests[] = {
+        "GARBAGE\r\n\r\n",
+        "GET /hello HTTP/1.1\r\nBad Name: x\r\n\r\n",
+        "POST /echo HTTP/1.1\r\nContent-Length: 65\r\n\r\n",
+        "POST /echo HTTP/1.1\r\nContent-Length: 3\r\nTransfer-Encoding: chunked\r\n\r\n",
+        "POST /echo HTTP/1.1\r\nTransfer-Encoding: gzip\r\n\r\n",
+        "GET /hello HTTP/2.0\r\n\r\n",
+    };
+    const char *bad_statuses[] = { "400", "400", "413", "400", "501", "505" };
+    for (size_t i = 0; i < sizeof(bad_requests) / sizeof(bad_requests[0]); ++i) {
+        client = http_test_connect(port);
+        http_test_send(client, bad_requests[i]);
+        http_test_receive(client, buf, sizeof(buf), "\r\n\r\n", 0);
+        assert_true(strncmp(buf + 9, bad_statuses[i], 3) == 0);
+        assert_non_null(strstr(buf, "\r\nConnection: close\r\n"));
+        http_test_expect_closed(client);
+        ps_destroy_socket(client);
+    }
+
+    // Connections that stay quiet past the idle timeout are closed.
+    client = http_test_connect(port);
+    http_test_send(client, "GET /hel");
+    http_test_expect_closed(client);
+    ps_destroy_socket(client);
+
+    // Connections still open when the server goes away are closed with it.
+    client = http_test_connect(port);
+    http_test_send(client, "GET /hello HTTP/1.1\r\n\r\n");
+    http_test_receive(client, buf, sizeof(buf), "hello", 0);
+    assert_int_equal(ps_http_server_stop(server), PS_SUCCESS);
+    ps_destroy_http_server(server);
+    http_test_expect_closed(client);
+    ps_destroy_socket(client);
+
+    assert_int_equal(atomic_load(&test_state.failures), 0);
+}
+
+#define HTTP_TEST_PIPELINED 128
+
+// A client that pipelines requests for large responses and never reads fills its socket; the worker must keep
+// serving its other connections meanwhile, and resume the responses once the client reads.
+static void test_http_server_slow_reader(void **state) {
+    (void)state;
+
+    static http_test_state_t test_state;
+    memset(test_state.large, 'x', sizeof(test_state.large));
+    ps_http_server_options_t options = {0};
+    options.workers = 1;
+    ps_http_server_t server;
+    assert_int_equal(ps_create_http_server(&server, PS_ADDRESS_IPV4, "127.0.0.1", 0, &options), PS_SUCCESS);
+    assert_int_equal(ps_http_route(server, "GET", "/hello", http_test_hello, &test_state), PS_SUCCESS);
+    assert_int_equal(ps_http_route(server, "GET", "/large", http_test_large, &test_state), PS_SUCCESS);
+    assert_int_equal(ps_http_server_start(server), PS_SUCCESS);
+    ps_port_t port = ps_http_server_get_port(server);
+
+    ps_socket_t slow = http_test_connect(port);
+    for (int i = 0; i < HTTP_TEST_PIPELINED; ++i) http_test_send(slow, "GET /large HTTP/1.1\r\n\r\n");
+    usleep(50000);
+
+    static char buf[HTTP_TEST_LARGE_SIZE + 1024];
+    for (int i = 0; i < 3; ++i) {
+        ps_socket_t client = http_test_connect(port);
+        http_test_send(client, "GET /hello HTTP/1.1\r\n\r\n");
+        http_test_receive(client, buf, sizeof(buf), "hello", 0);
+        ps_destroy_socket(client);
+    }
+
+    // Every response arrives whole and in order once the client reads.
+    size_t total = http_test_receive(slow, buf, sizeof(buf), "Content-Length: 102400\r\n\r\n", 0);
+    size_t head_size = (size_t)(strstr(buf, "\r\n\r\n") + 4 - buf);
+    size_t expected = (size_t)HTTP_TEST_PIPELINED * (head_size + HTTP_TEST_LARGE_SIZE);
+    char last = buf[total - 1];
+    while (total < expected) {
+        ps_packet_t packet = {0, buf, expected - total < sizeof(buf) ? expected - total : sizeof(buf)};
+        assert_int_equal(ps_read_socket_packet(slow, &packet, NULL), PS_SUCCESS);
+        total += packet.size;
+        last = buf[packet.size - 1];
+    }
+    assert_int_equal(last, 'x');
+    assert_int_equal(total, expected);
+    ps_destroy_socket(slow);
+
+    assert_int_equal(ps_http_server_stop(server), PS_SUCCESS);
+    ps_destroy_http_server(server);
+    assert_int_equal(atomic_load(&test_state.failures), 0);
+}
+
+#define HTTP_TEST_FILE_SIZE (4 * 1024 * 1024)
+#define HTTP_TEST_FILE_BYTE(i) ((char)((i) * 7 + (i) / 4096))
+
+typedef struct {
+    atomic_int failures;
+    char path[64];
+} http_file_test_state_t;
+
+static void http_test_file(const ps_http_request_t *request, ps_http_response_t response, void *user_data) {
+    (void)request;
+    http_file_test_state_t *state = (http_file_test_state_t *)user_data;
+    if (ps_http_response_send_file_path(response, state->path) != PS_SUCCESS) atomic_fetch_add(&state->failures, 1);
+}
+
+static void http_test_file_range(const ps_http_request_t *request, ps_http_response_t response, void *user_data) {
+    (void)request;
+    http_file_test_state_t *state = (http_file_test_state_t *)user_data;
+    // A range past the end is refused before anything is sent, and the descriptor is closed either way.
+    if (ps_http_response_send_file(response, open(state->path, O_RDONLY), HTTP_TEST_FILE_SIZE - 10, 11) != PS_ERROR_INVALID_ARGUMENT) {
+        atomic_fetch_add(&state->failures, 1);
+    }
+    if (ps_http_response_send_file(response, open(state->path, O_RDONLY), 1000, 100) != PS_SUCCESS) atomic_fetch_add(&state->failures, 1);
+}
+
+static void http_test_file_missing(const ps_http_request_t *request, ps_http_response_t response, void *user_data) {
+    (void)request;
+    http_file_test_state_t *state = (http_file_test_state_t *)user_data;
+    if (ps_http_response_send_file_path(response, "/nonexistent/purrsock") != PS_ERROR_INVALID_ARGUMENT) atomic_fetch_add(&state->failures, 1);
+    if (ps_http_response_send_file_path(response, "/tmp") != PS_ERROR_INVALID_ARGUMENT) atomic_fetch_add(&state->failures, 1);
+    ps_http_response_set_status(response, 404);
+    ps_http_response_send(response, (ps_packet_t){7, "missing", 7});
+}
+
+// Reads the next response of a pipeline from `buf`, receiving more as needed; returns where its body starts.
+static size_t http_test_next_response(ps_socket_t client, char *buf, size_t capacity, size_t *received, size_t *offset, size_t *body_size) {
+    char *end;
+    // Heads hold no NUL, and `buf` is NUL-terminated after what was received.
+    while (!(end = strstr(buf + *offset, "\r\n\r\n"))) {
+        *received += http_test_receive(client, buf + *received, capacity - *received, NULL, 1);
+    }
+    *end = '\0';
+    char *length = strstr(buf + *offset, "Content-Length: ");
+    assert_non_null(length);
+    *body_size = (size_t)strtoull(length + 16, NULL, 10);
+    size_t body = (size_t)(end + 4 - buf);
+    while (*received < body + *body_size) {
+        *received += http_test_receive(client, buf + *received, capacity - *received, NULL, body + *body_size - *received);
+    }
+    return body;
+}
+
+// File bodies are sent from the file after the responses before them, the rest as a slow client reads,
+// while the worker keeps serving its other connections.
+static void test_http_server_send_file(void **state) {
+    (void)state;
+
+    static http_file_test_state_t test_state;
+    strcpy(test_state.path, "/tmp/purrsock_http_file_XXXXXX");
+    int fd = mkstemp(test_state.path);
+    assert_true(fd >= 0);
+    static char contents[HTTP_TEST_FILE_SIZE];
+    for (size_t i = 0; i < sizeof(contents); ++i) contents[i] = HTTP_TEST_FILE_BYTE(i);
+    assert_int_equal(write(fd, contents, sizeof(contents)), sizeof(contents));
+    close(fd);
+
+    static http_test_state_t hello_state;
+    ps_http_server_options_t options = {0};
+    options.workers = 1;
+    ps_http_server_t server;
+    assert_int_equal(ps_create_http_server(&server, PS_ADDRESS_IPV4, "127.0.0.1", 0, &options), PS_SUCCESS);
+    assert_int_equal(ps_http_route(server, "GET", "/hello", http_test_hello, &hello_state), PS_SUCCESS);
+    assert_int_equal(ps_http_route(server, "GET", "/file", http_test_file, &test_state), PS_SUCCESS);
+    assert_int_equal(ps_http_route(server, "GET", "/range", http_test_file_range, &test_state), PS_SUCCESS);
+    assert_int_equal(ps_http_route(server, "GET", "/missing", http_test_file_missing, &test_state), PS_SUCCESS);
+    assert_int_equal(ps_http_server_start(server), PS_SUCCESS);
+    ps_port_t port = ps_http_server_get_port(server);
+
+    ps_socket_t slow = http_test_connect(port);
+    http_test_send(slow, "GET /file HTTP/1.1\r\n\r\nGET /range HTTP/1.1\r\n\r\nHEAD /file HTTP/1.1\r\n\r\n"
+                         "GET /missing HTTP/1.1\r\n\r\nGET /file HTTP/1.1\r\n\r\nGET /hello HTTP/1.1\r\n\r\n");
+    usleep(50000);
+
+    char hello[1024];
+    ps_socket_t client = http_test_connect(port);
+    http_test_send(client, "GET /hello HTTP/1.1\r\n\r\n");
+    http_test_receive(client, hello, sizeof(hello), "hello", 0);
+    ps_destroy_socket(client);
+
+    static char buf[3 * HTTP_TEST_FILE_SIZE];
+
+    // Every response arrives whole and in order once the client reads.
+    size_t received = 0, offset = 0, body_size = 0;
+    static const struct {
+        const char *status;
+        size_t offset;
+        size_t size;
+    } expected[] = {
+        { "200", 0, HTTP_TEST_FILE_SIZE }, { "200", 1000, 100 }, { "200", 0, 0 }, { "404", 0, 7 }, { "200", 0, HTTP_TEST_FILE_SIZE }, { "200", 0, 5 },
+    };
+    for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); ++i) {
+        size_t body = http_test_next_response(slow, buf, sizeof(buf), &received, &offset, &body_size);
+        assert_true(strncmp(buf + offset + 9, expected[i].status, 3) == 0);
+        if (i == 2) {
+            // HEAD announces the length of the file without sending it.
+            assert_int_equal(body_size, HTTP_TEST_FILE_SIZE);
+            body_size = 0;
+        } else {
+            assert_int_equal(body_size, expected[i].size);
+        }
+        if (expected[i].status[0] == '2' && i != 5) assert_memory_equal(buf + body, contents + expected[i].offset, body_size);
+        offset = body + body_size;
+    }
+    assert_memory_equal(buf + offset - 5, "hello", 5);
+    assert_int_equal(received, offset);
+    ps_destroy_socket(slow);
+
+    assert_int_equal(ps_http_server_stop(server), PS_SUCCESS);
+    ps_destroy_http_server(server);
+    assert_int_equal(atomic_load(&test_state.failures), 0);
+    assert_int_equal(atomic_load(&hello_state.failures), 0);
+    unlink(test_state.path);
+}
+
+static size_t scan_reference_find(const char *buf, size_t size, const char *needle, size_t needle_size) {
+    for (size_t i = 0; i + needle_size <= size; ++i) {
+        if (memcmp(buf + i, needle, needle_size) == 0) return i;
+    }
+    return size;
+}
+
+static size_t scan_reference_token(const char *buf, size_t size) {
+    static const char tchar[] = "!#$%&'*+-.^_`|~0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    size_t i = 0;
+    while (i < size && buf[i] && strchr(tchar, buf[i])) i++;
+    return i;
+}
+
+static size_t scan_reference_field_value(const char *buf, size_t size) {
+    size_t i = 0;
+    while (i < size && (((unsigned char)buf[i] >= 0x20 && buf[i] != 0x7f) || buf[i] == '\t')) i++;
+    return i;
+}
+
+static void test_scan(void **state) {
+    (void)state;
+
+    // Bytes from a small alphabet so that every kind of stop shows up often, in buffers allocated to their exact
+    // size so that a scanner reading past the end trips the address sanitizer.
+    static const char alphabet[] = "aZ0-:\r\n\t \"\x7f\x80\xff";
+    static const struct {
+        const char *needle;
+        size_t size;
+    } needles[] = { { "\r\n", 2 }, { "\r\n\r\n", 4 }, { "\n", 1 }, { "a:a", 3 }, { "0123456789abcdef", 16 } };
+    ps_scan_isa_t original = ps_scan_get_isa();
+    unsigned int seed = 42;
+
+    for (int isa = PS_SCAN_SCALAR; isa <= PS_SCAN_AVX2; ++isa) {
+        if (!ps_scan_set_isa((ps_scan_isa_t)isa)) {
+            assert_int_not_equal(isa, PS_SCAN_SCALAR);
+            continue;
+        }
+        assert_int_equal(ps_scan_get_isa(), isa);
+
+        for (size_t size = 0; size <= 200; ++size) {
+            for (int round = 0; round < 20; ++round) {
+                char *buf = malloc(size ? size : 1);
+                assert_non_null(buf);
+                // Long runs of one kind of byte reach the vector loops before the first stop.
+                char fill = round % 2 ? 'a' : ' ';
+                for (size_t i = 0; i < size; ++i) {
+                    buf[i] = rand_r(&seed) % (round + 4) ? fill : alphabet[rand_r(&seed) % (sizeof(alphabet) - 1)];
+                }
+                for (size_t n = 0; n < sizeof(needles) / sizeof(needles[0]); ++n) {
+                    assert_int_equal(ps_scan_find(buf, size, needles[n].needle, needles[n].size),
+                                     scan_reference_find(buf, size, needles[n].needle, needles[n].size));
+                }
+                assert_int_equal(ps_scan_token(buf, size), scan_reference_token(buf, size));
+                assert_int_equal(ps_scan_field_value(buf, size), scan_reference_field_value(buf, size));
+                free(buf);
+            }
+        }
+
+        // Stops past the first vector of a request head.
+        char head[] = "GET / HTTP/1.1\r\nHost: example.com\r\nAccept: */*\r\nUser-Agent: purrsock-test/1.0\r\n\r\n";
+        size_t head_size = sizeof(head) - 1;
+        assert_int_equal(ps_scan_find(head, head_size, "\r\n\r\n", 4), head_size - 4);
+        assert_int_equal(ps_scan_token(head + 48, head_size - 48), 10);
+        assert_int_equal(ps_scan_field_value(head + 60, head_size - 60), 17);
+    }
+    assert_true(ps_scan_set_isa(original));
+}
+
+#define WEBSOCKET_TEST_REQUEST "GET /chat?room=1 HTTP/1.1\r\nHost: example.com\r\nUpgrade: websocket\r\nConnection: keep-alive, Upgrade\r\n" \
+                               "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n"
+
+// Builds a frame the way a client would send it, or without the mask when `masked` is false.
+static size_t websocket_test_frame(char *out, unsigned char first, const char *payload, size_t size, bool masked) {
+    static const unsigned char key[4] = {0x12, 0x34, 0x56, 0x78};
+    size_t header_size = 0;
+    assert_true(size < 126);
+    out[header_size++] = (char)first;
+    out[header_size++] = (char)((masked ? 0x80 : 0) | size);
+    if (masked) {
+        memcpy(out + header_size, key, 4);
+        header_size += 4;
+    }
+    for (size_t i = 0; i < size; ++i) out[header_size + i] = (char)(payload[i] ^ (masked ? key[i % 4] : 0));
+    return header_size + size;
+}
+
+// Accepts a connection from a raw socket that sends the handshake of RFC 6455 1.3 and checks the answer.
+static void websocket_test_accept_raw(ps_socket_t listener, ps_port_t port, ps_socket_t *raw, ps_socket_t *server,
+                                      ps_websocket_t *websocket, const ps_websocket_options_t *options) {
+    connect_pair(listener, port, raw, server);
+    ps_packet_t request = {sizeof(WEBSOCKET_TEST_REQUEST) - 1, WEBSOCKET_TEST_REQUEST, sizeof(WEBSOCKET_TEST_REQUEST) - 1};
+    assert_int_equal(ps_send_socket_packet(*raw, request, NULL), PS_SUCCESS);
+    assert_int_equal(ps_create_websocket_server(websocket, *server, options), PS_SUCCESS);
+    assert_int_equal(ps_websocket_handshake(*websocket), PS_SUCCESS);
+    assert_string_equal(ps_websocket_get_path(*websocket), "/chat?room=1");
+
+    char response[512];
+    http_test_receive(*raw, response, sizeof(response), "\r\n\r\n", 0);
+    assert_true(strncmp(response, "HTTP/1.1 101 Switching Protocols\r\n", 34) == 0);
+    assert_non_null(strstr(response, "\r\nSec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n"));
+}
+
+static void websocket_test_expect_close(ps_socket_t raw, uint16_t code) {
+    char frame[4];
+    read_exactly(raw, frame, sizeof(frame));
+    assert_int_equal((unsigned char)frame[0], 0x88);
+    assert_int_equal((unsigned char)frame[1], 2);
+    assert_int_equal((unsigned char)frame[2] << 8 | (unsigned char)frame[3], code);
+}
+
+static void websocket_test_destroy(ps_websocket_t websocket, ps_socket_t first, ps_socket_t second) {
+    ps_destroy_websocket(websocket);
+    ps_destroy_socket(first);
+    ps_destroy_socket(second);
+}
+
+#define WEBSOCKET_TEST_QUEUED_SIZE 60000
+
+static void test_websocket(void **state) {
+    (void)state;
+
+    ps_socket_t listener, client, server;
+    assert_int_equal(ps_create_socket_from_addr(&listener, PS_PROTOCOL_TCP, PS_ADDRESS_IPV4, "127.0.0.1", 0), PS_SUCCESS);
+    assert_int_equal(ps_listen_socket(listener), PS_SUCCESS);
+    ps_endpoint_t endpoint;
+    assert_int_equal(ps_get_socket_endpoint(listener, &endpoint), PS_SUCCESS);
+    connect_pair(listener, endpoint.port, &client, &server);
+
+    // A small buffer on the server makes it compact and grow on the way.
+    ps_websocket_t websocket_client, websocket_server;
+    ps_websocket_options_t options = {0, 0, 64};
+    assert_int_equal(ps_create_websocket_client(&websocket_client, client, "127.0.0.1", "no-slash", NULL), PS_ERROR_INVALID_ARGUMENT);
+    assert_int_equal(ps_create_websocket_client(&websocket_client, client, "127.0.0.1", "/feed?topic=cpu", NULL), PS_SUCCESS);
+    assert_int_equal(ps_create_websocket_server(&websocket_server, server, &options), PS_SUCCESS);
+    ps_websocket_message_t message;
+    assert_int_equal(ps_websocket_read(websocket_server, &message), PS_ERROR_INVALID_ARGUMENT);
+    assert_null(ps_websocket_get_path(websocket_server));
+
+    // Both ends in one thread: the client sends its request without waiting, then collects the answer.
+    assert_int_equal(ps_set_socket_blocking(client, false), PS_SUCCESS);
+    assert_int_equal(ps_websocket_handshake(websocket_client), PS_ERROR_WOULDBLOCK);
+    assert_int_equal(ps_websocket_handshake(websocket_server), PS_SUCCESS);
+    assert_string_equal(ps_websocket_get_path(websocket_server), "/feed?topic=cpu");
+    assert_int_equal(ps_set_socket_blocking(client, true), PS_SUCCESS);
+    assert_int_equal(ps_websocket_handshake(websocket_client), PS_SUCCESS);
+    assert_int_equal(ps_websocket_handshake(websocket_server), PS_SUCCESS);
+
+    // Every payload length encoding, unmasked by each masking implementation, in both directions.
+    static char payload[70000];
+    static const size_t sizes[] = {0, 1, 3, 4, 5, 31, 32, 33, 64, 125, 126, 127, 300, 4093, 65535, 65536, sizeof(payload)};
+    unsigned int seed = 7;
+    for (size_t i = 0; i < sizeof(payload); ++i) payload[i] = (char)rand_r(&seed);
+    ps_scan_isa_t original = ps_scan_get_isa();
+    for (int isa = PS_SCAN_SCALAR; isa <= PS_SCAN_AVX2; ++isa) {
+        if (!ps_scan_set_isa((ps_scan_isa_t)isa)) continue;
+        for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+            // Odd offsets start the payload off alignment.
+            ps_packet_t packet = {sizes[i], payload + isa, sizes[i]};
+            if (sizes[i] == sizeof(payload)) packet.size = packet.capacity = sizes[i] - isa;
+            assert_int_equal(ps_websocket_send(websocket_client, PS_WEBSOCKET_BINARY, packet), PS_SUCCESS);
+            assert_int_equal(ps_websocket_read(websocket_server, &message), PS_SUCCESS);
+            assert_int_equal(message.opcode, PS_WEBSOCKET_BINARY);
+            assert_int_equal(message.payload.size, packet.size);
+            assert_memory_equal(message.payload.buf, packet.buf, packet.size);
+
+            assert_int_equal(ps_websocket_send(websocket_server, PS_WEBSOCKET_BINARY, packet), PS_SUCCESS);
+            assert_int_equal(ps_websocket_read(websocket_client, &message), PS_SUCCESS);
+            assert_int_equal(message.payload.size, packet.size);
+            assert_memory_equal(message.payload.buf, packet.buf, packet.size);
+        }
+    }
+    assert_true(ps_scan_set_isa(original));
+
+    // Many messages in flight are parsed out of one buffer.
+    char text[32];
+    for (int i = 0; i < 200; ++i) {
+        int size = snprintf(text, sizeof(text), "h\xc3\xa9llo %d", i);
+        assert_int_equal(ps_websocket_send(websocket_client, PS_WEBSOCKET_TEXT, (ps_packet_t){(size_t)size, text, (size_t)size}), PS_SUCCESS);
+    }
+    for (int i = 0; i < 200; ++i) {
+        int size = snprintf(text, sizeof(text), "h\xc3\xa9llo %d", i);
+        assert_int_equal(ps_websocket_read(websocket_server, &message), PS_SUCCESS);
+        assert_int_equal(message.opcode, PS_WEBSOCKET_TEXT);
+        assert_int_equal(message.payload.size, size);
+        assert_memory_equal(message.payload.buf, text, (size_t)size);
+    }
+
+    // Fragments are joined around a ping, which the server answers by itself.
+    assert_int_equal(ps_websocket_send_fragment(websocket_client, PS_WEBSOCKET_CONTINUATION, (ps_packet_t){1, "x", 1}, true), PS_ERROR_INVALID_ARGUMENT);
+    assert_int_equal(ps_websocket_send_fragment(websocket_client, PS_WEBSOCKET_TEXT, (ps_packet_t){4, "Hel\xc3", 4}, false), PS_SUCCESS);
+    assert_int_equal(ps_websocket_send(websocket_client, PS_WEBSOCKET_BINARY, (ps_packet_t){1, "x", 1}), PS_ERROR_INVALID_ARGUMENT);
+    assert_int_equal(ps_websocket_send(websocket_client, PS_WEBSOCKET_PING, (ps_packet_t){4, "ping", 4}), PS_SUCCESS);
+    assert_int_equal(ps_websocket_send_fragment(websocket_client, PS_WEBSOCKET_CONTINUATION, (ps_packet_t){0, NULL, 0}, false), PS_SUCCESS);
+    assert_int_equal(ps_websocket_send_fragment(websocket_client, PS_WEBSOCKET_CONTINUATION, (ps_packet_t){6, "\xa9world", 6}, true), PS_SUCCESS);
+    assert_int_equal(ps_websocket_read(websocket_server, &message), PS_SUCCESS);
+    assert_int_equal(message.opcode, PS_WEBSOCKET_TEXT);
+    assert_int_equal(message.payload.size, 10);
+    assert_memory_equal(message.payload.buf, "Hel\xc3\xa9world", 10);
+    assert_int_equal(ps_websocket_read(websocket_client, &message), PS_SUCCESS);
+    assert_int_equal(message.opcode, PS_WEBSOCKET_PONG);
+    assert_int_equal(message.payload.size, 4);
+    assert_memory_equal(message.payload.buf, "ping", 4);
+
+    static char control[126];
+    assert_int_equal(ps_websocket_send(websocket_server, PS_WEBSOCKET_PING, (ps_packet_t){126, control, 126}), PS_ERROR_INVALID_ARGUMENT);
+    assert_int_equal(ps_websocket_send(websocket_server, PS_WEBSOCKET_CONTINUATION, (ps_packet_t){0, NULL, 0}), PS_ERROR_INVALID_ARGUMENT);
+
+    // Nothing buffered on a non-blocking socket.
+    assert_int_equal(ps_set_socket_blocking(server, false), PS_SUCCESS);
+    assert_int_equal(ps_websocket_read(websocket_server, &message), PS_ERROR_WOULDBLOCK);
+    assert_int_equal(ps_set_socket_blocking(server, true), PS_SUCCESS);
+
+    // A full socket queues frames instead of waiting, on both ends; flushing while the peer reads delivers them
+    // whole and in order.
+    ps_websocket_t senders[2] = {websocket_server, websocket_client};
+    ps_websocket_t readers[2] = {websocket_client, websocket_server};
+    assert_int_equal(ps_set_socket_blocking(server, false), PS_SUCCESS);
+    assert_int_equal(ps_set_socket_blocking(client, false), PS_SUCCESS);
+    for (int side = 0; side < 2; ++side) {
+        int sent = 0;
+        while (ps_websocket_get_unsent(senders[side]) == 0) {
+            assert_true(sent < 1000);
+            ps_packet_t packet = {WEBSOCKET_TEST_QUEUED_SIZE, payload + sent % 256, WEBSOCKET_TEST_QUEUED_SIZE};
+            assert_int_equal(ps_websocket_send(senders[side], PS_WEBSOCKET_BINARY, packet), PS_SUCCESS);
+            sent++;
+        }
+        // More go behind the queued bytes without touching the socket. Acknowledgements arriving late can still
+        // make room, so frames are added until a flush finds the socket full.
+        ps_result_t flushed;
+        do {
+            assert_true(sent < 1000);
+            ps_packet_t packet = {WEBSOCKET_TEST_QUEUED_SIZE, payload + sent % 256, WEBSOCKET_TEST_QUEUED_SIZE};
+            assert_int_equal(ps_websocket_send(senders[side], PS_WEBSOCKET_BINARY, packet), PS_SUCCESS);
+            sent++;
+        } while ((flushed = ps_websocket_flush(senders[side])) == PS_SUCCESS);
+        assert_int_equal(flushed, PS_ERROR_WOULDBLOCK);
+
+        for (int received = 0; received < sent;) {
+            ps_result_t result = ps_websocket_flush(senders[side]);
+            assert_true(result == PS_SUCCESS || result == PS_ERROR_WOULDBLOCK);
+            result = ps_websocket_read(readers[side], &message);
+            if (result == PS_ERROR_WOULDBLOCK) continue;
+            assert_int_equal(result, PS_SUCCESS);
+            assert_int_equal(message.payload.size, WEBSOCKET_TEST_QUEUED_SIZE);
+            assert_memory_equal(message.payload.buf, payload + received % 256, WEBSOCKET_TEST_QUEUED_SIZE);
+            received++;
+        }
+        assert_int_equal(ps_websocket_flush(senders[side]), PS_SUCCESS);
+        assert_int_equal(ps_websocket_get_unsent(senders[side]), 0);
+    }
+    assert_int_equal(ps_set_socket_blocking(server, true), PS_SUCCESS);
+    assert_int_equal(ps_set_socket_blocking(client, true), PS_SUCCESS);
+
+    // Closing handshake: the server echoes the code and neither side sends afterwards.
+    assert_int_equal(ps_websocket_close(websocket_client, 1000, "bye"), PS_SUCCESS);
+    assert_int_equal(ps_websocket_send(websocket_client, PS_WEBSOCKET_TEXT, (ps_packet_t){2, "hi", 2}), PS_ERROR_SHUTDOWN);
+    assert_int_equal(ps_websocket_close(websocket_client, 1000, NULL), PS_ERROR_SHUTDOWN);
+    assert_int_equal(ps_websocket_read(websocket_server, &message), PS_SUCCESS);
+    assert_int_equal(message.opcode, PS_WEBSOCKET_CLOSE);
+    assert_int_equal(message.close_code, 1000);
+    assert_int_equal(message.payload.size, 3);
+    assert_memory_equal(message.payload.buf, "bye", 3);
+    assert_int_equal(ps_websocket_read(websocket_server, &message), PS_CONNCLOSED);
+    assert_int_equal(ps_websocket_send(websocket_server, PS_WEBSOCKET_TEXT, (ps_packet_t){2, "hi", 2}), PS_ERROR_SHUTDOWN);
+    assert_int_equal(ps_websocket_read(websocket_client, &message), PS_SUCCESS);
+    assert_int_equal(message.opcode, PS_WEBSOCKET_CLOSE);
+    assert_int_equal(message.close_code, 1000);
+    assert_int_equal(message.payload.size, 0);
+    ps_destroy_websocket(websocket_client);
+    websocket_test_destroy(websocket_server, client, server);
+
+    // A client's request that finds the socket full is queued, and later handshake steps send it before
+    // they wait for the answer.
+    connect_pair(listener, endpoint.port, &client, &server);
+    assert_int_equal(ps_set_socket_blocking(client, false), PS_SUCCESS);
+    assert_int_equal(ps_set_socket_blocking(server, false), PS_SUCCESS);
+    size_t filled = 0;
+    while (ps_send_socket_packet(client, (ps_packet_t){sizeof(payload), payload, sizeof(payload)}, NULL) == PS_SUCCESS) {
+        filled += sizeof(payload);
+    }
+    assert_int_equal(ps_create_websocket_client(&websocket_client, client, "127.0.0.1", "/queued", NULL), PS_SUCCESS);
+    assert_int_equal(ps_websocket_handshake(websocket_client), PS_ERROR_WOULDBLOCK);
+    assert_true(ps_websocket_get_unsent(websocket_client) > 0);
+    assert_int_equal(ps_create_websocket_server(&websocket_server, server, NULL), PS_SUCCESS);
+    ps_result_t client_result = PS_ERROR_WOULDBLOCK;
+    for (int step = 0; step < 100000 && client_result == PS_ERROR_WOULDBLOCK; ++step) {
+        if (filled) {
+            static char discard[65536];
+            ps_packet_t packet = {0, discard, filled < sizeof(discard) ? filled : sizeof(discard)};
+            ps_result_t result = ps_read_socket_packet(server, &packet, NULL);
+            assert_true(result == PS_SUCCESS || result == PS_ERROR_WOULDBLOCK);
+            if (result == PS_SUCCESS) filled -= packet.size;
+        } else {
+            ps_result_t result = ps_websocket_handshake(websocket_server);
+            assert_true(result == PS_SUCCESS || result == PS_ERROR_WOULDBLOCK);
+        }
+        client_result = ps_websocket_handshake(websocket_client);
+    }
+    assert_int_equal(client_result, PS_SUCCESS);
+    assert_string_equal(ps_websocket_get_path(websocket_server), "/queued");
+    ps_destroy_websocket(websocket_client);
+    websocket_test_destroy(websocket_server, client, server);
+
+    // Protocol violations from a raw client fail the read and tell the peer why.
+    ps_socket_t raw;
+    ps_websocket_t websocket;
+    char frame[256];
+    websocket_test_accept_raw(listener, endpoint.port, &raw, &server, &websocket, NULL);
+    size_t frame_size = websocket_test_frame(frame, 0x82, "unmasked", 8, false);
+    assert_int_equal(ps_send_socket_packet(raw, (ps_packet_t){frame_size, frame, frame_size}, NULL), PS_SUCCESS);
+    assert_int_equal(ps_websocket_read(websocket, &message), PS_ERROR_PROTOCOL);
+    assert_int_equal(ps_websocket_read(websocket, &message), PS_ERROR_PROTOCOL);
+    websocket_test_expect_close(raw, 1002);
+    websocket_test_destroy(websocket, raw, server);
+
+    websocket_test_accept_raw(listener, endpoint.port, &raw, &server, &websocket, NULL);
+    frame_size = websocket_test_frame(frame, 0x81, "\xc0\xaf", 2, true);
+    assert_int_equal(ps_send_socket_packet(raw, (ps_packet_t){frame_size, frame, frame_size}, NULL), PS_SUCCESS);
+    assert_int_equal(ps_websocket_read(websocket, &message), PS_ERROR_PROTOCOL);
+    websocket_test_expect_close(raw, 1007);
+    websocket_test_destroy(websocket, raw, server);
+
+    websocket_test_accept_raw(listener, endpoint.port, &raw, &server, &websocket, NULL);
+    frame_size = websocket_test_frame(frame, 0xc2, "rsv", 3, true);
+    assert_int_equal(ps_send_socket_packet(raw, (ps_packet_t){frame_size, frame, frame_size}, NULL), PS_SUCCESS);
+    assert_int_equal(ps_websocket_read(websocket, &message), PS_ERROR_PROTOCOL);
+    websocket_test_expect_close(raw, 1002);
+    websocket_test_destroy(websocket, raw, server);
+
+    // Fragments count towards the message limit together.
+    options = (ps_websocket_options_t){100, 0, 0};
+    websocket_test_accept_raw(listener, endpoint.port, &raw, &server, &websocket, &options);
+    frame_size = websocket_test_frame(frame, 0x02, control, 60, true);
+    frame_size += websocket_test_frame(frame + frame_size, 0x80, control, 60, true);
+    assert_int_equal(ps_send_socket_packet(raw, (ps_packet_t){frame_size, frame, frame_size}, NULL), PS_SUCCESS);
+    assert_int_equal(ps_websocket_read(websocket, &message), PS_ERROR_MSGTOOLONG);
+    websocket_test_expect_close(raw, 1009);
+    websocket_test_destroy(websocket, raw, server);
+
+    // A request that is not a WebSocket handshake is refused, as is another version.
+    static const char *refused[][2] = {
+        {"GET / HTTP/1.1\r\nHost: example.com\r\n\r\n", "HTTP/1.1 400 "},
+        {"GET / HTTP/1.1\r\nHost: a\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+         "Sec-WebSocket-Version: 8\r\n\r\n", "HTTP/1.1 426 "},
+    };
+    for (size_t i = 0; i < sizeof(refused) / sizeof(refused[0]); ++i) {
+        connect_pair(listener, endpoint.port, &raw, &server);
+        size_t size = strlen(refused[i][0]);
+        assert_int_equal(ps_send_socket_packet(raw, (ps_packet_t){size, (char *)refused[i][0], size}, NULL), PS_SUCCESS);
+        assert_int_equal(ps_create_websocket_server(&websocket, server, NULL), PS_SUCCESS);
+        assert_int_equal(ps_websocket_handshake(websocket), PS_ERROR_PROTOCOL);
+        assert_int_equal(ps_websocket_handshake(websocket), PS_ERROR_PROTOCOL);
+        char response[512];
+        http_test_receive(raw, response, sizeof(response), "\r\n\r\n", 0);
+        assert_true(strncmp(response, refused[i][1], strlen(refused[i][1])) == 0);
+        websocket_test_destroy(websocket, raw, server);
+    }
+
+    ps_destroy_socket(listener);
+}
+
 int main(void) {
     const struct CMUnitTest tests[] = {
         cmocka_unit_test(test_initialization),
@@ -215,6 +3859,49 @@ int main(void) {
         cmocka_unit_test(test_cleanup),
         cmocka_unit_test(test_bind_socket_address_in_use),
         cmocka_unit_test(test_send_receive_packet_multithreaded),
+        cmocka_unit_test(test_loop_echo_loopback),
+        cmocka_unit_test(test_loop_async_echo_epoll),
+        cmocka_unit_test(test_loop_async_echo_auto),
+        cmocka_unit_test(test_packet_pool),
+        cmocka_unit_test(test_packet_pool_cross_thread_release),
+        cmocka_unit_test(test_read_packet_udp_into_buffer),
+        cmocka_unit_test(test_read_send_socket_packets_batched),
+        cmocka_unit_test(test_udp_segmentation_offload),
+        cmocka_unit_test(test_send_file),
+        cmocka_unit_test(test_splice),
+        cmocka_unit_test(test_splice_nonblocking_full),
+        cmocka_unit_test(test_splice_copy_nonblocking_full),
+        cmocka_unit_test(test_send_zerocopy),
+        cmocka_unit_test(test_send_zerocopy_destroy),
+        cmocka_unit_test(test_sendv_recvv),
+        cmocka_unit_test(test_send_packet_nonblocking_full),
+        cmocka_unit_test(test_sendv_partial),
+        cmocka_unit_test(test_loop_send_after_unsent_epoll),
+        cmocka_unit_test(test_loop_send_after_unsent_auto),
+        cmocka_unit_test(test_framed_socket),
+        cmocka_unit_test(test_buffered_stream),
+        cmocka_unit_test(test_buffered_stream_nonblocking_full),
+        cmocka_unit_test(test_server_reuseport_workers),
+        cmocka_unit_test(test_executor),
+        cmocka_unit_test(test_loop_stop),
+        cmocka_unit_test(test_loop_timers),
+        cmocka_unit_test(test_socket_timeouts),
+        cmocka_unit_test(test_loop_heartbeat),
+        cmocka_unit_test(test_connect_async),
+        cmocka_unit_test(test_conn_pool),
+        cmocka_unit_test(test_resolver),
+        cmocka_unit_test(test_resolver_failover),
+        cmocka_unit_test(test_conn_pool_resolver),
+        cmocka_unit_test(test_memory_transport),
+        cmocka_unit_test(test_shm_transport),
+        cmocka_unit_test(test_unix_sockets),
+        cmocka_unit_test(test_unix_fd_passing),
+        cmocka_unit_test(test_socket_stats),
+        cmocka_unit_test(test_http_server),
+        cmocka_unit_test(test_http_server_slow_reader),
+        cmocka_unit_test(test_http_server_send_file),
+        cmocka_unit_test(test_scan),
+        cmocka_unit_test(test_websocket),
     };
 
     return cmocka_run_group_tests(tests, NULL, NULL);